@@ -200,6 +200,9 @@ static GstFlowReturn gst_dash_demux_stream_seek (GstAdaptiveDemuxStream *
     stream, GstClockTime ts);
 static GstFlowReturn
 gst_dash_demux_stream_advance_fragment (GstAdaptiveDemuxStream * stream);
+static guint
+gst_dash_demux_stream_peek_fragments (GstAdaptiveDemuxStream * stream,
+    GstAdaptiveDemuxStreamFragment * fragments, guint n_fragments);
 static gboolean
 gst_dash_demux_stream_advance_subfragment (GstAdaptiveDemuxStream * stream);
 static gboolean gst_dash_demux_stream_select_bitrate (GstAdaptiveDemuxStream *
@@ -327,6 +330,8 @@ gst_dash_demux_class_init (GstDashDemuxClass * klass)
       gst_dash_demux_stream_select_bitrate;
   gstadaptivedemux_class->stream_update_fragment_info =
       gst_dash_demux_stream_update_fragment_info;
+  gstadaptivedemux_class->stream_peek_fragments =
+      gst_dash_demux_stream_peek_fragments;
   gstadaptivedemux_class->stream_free = gst_dash_demux_stream_free;
 }
 
@@ -927,6 +932,36 @@ gst_dash_demux_stream_advance_fragment (GstAdaptiveDemuxStream * stream)
       dashstream->active_stream, stream->demux->segment.rate > 0.0);
 }
 
+static guint
+gst_dash_demux_stream_peek_fragments (GstAdaptiveDemuxStream * stream,
+    GstAdaptiveDemuxStreamFragment * fragments, guint n_fragments)
+{
+  GstDashDemuxStream *dashstream = (GstDashDemuxStream *) stream;
+  GstDashDemux *dashdemux = GST_DASH_DEMUX_CAST (stream->demux);
+  GstMediaFragmentInfo fragment;
+  guint i;
+
+  /* The subsegments of the on-demand profile are ranges of a single file
+   * driven by its index, and the next segments of a live stream might not
+   * be available yet */
+  if (gst_mpd_client_has_isoff_ondemand_profile (dashdemux->client)
+      || gst_mpd_client_is_live (dashdemux->client))
+    return 0;
+
+  for (i = 0; i < n_fragments; i++) {
+    if (!gst_mpd_client_peek_fragment (dashdemux->client, dashstream->index,
+            i + 1, stream->demux->segment.rate > 0.0, &fragment))
+      break;
+
+    fragments[i].uri = fragment.uri;
+    fragments[i].range_start = fragment.range_start;
+    fragments[i].range_end = fragment.range_end;
+    g_free (fragment.index_uri);
+  }
+
+  return i;
+}
+
 static gboolean
 gst_dash_demux_stream_select_bitrate (GstAdaptiveDemuxStream * stream,
     guint64 bitrate)
@@ -1092,6 +1127,14 @@ gst_dash_demux_update_manifest (GstAdaptiveDemux * demux, GstBuffer * buffer)
     GList *iter;
     GList *streams_iter;
 
+    /* usually only new segments were added, keep the current streams */
+    if (gst_mpd_client_merge (dashdemux->client, new_client)) {
+      GST_DEBUG_OBJECT (demux, "Merged manifest update");
+      gst_mpd_client_free (new_client);
+      gst_buffer_unmap (buffer, &mapinfo);
+      return GST_FLOW_OK;
+    }
+
     /* prepare the new manifest and try to transfer the stream position
      * status from the old manifest client  */
 
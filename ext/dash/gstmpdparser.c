@@ -27,6 +27,7 @@
 #include <string.h>
 #include <libxml/parser.h>
 #include <libxml/tree.h>
+#include <libxml/xmlreader.h>
 #include "gstmpdparser.h"
 #include "gstdash_debug.h"
 
@@ -108,8 +109,8 @@ static void gst_mpdparser_parse_program_info_node (GList ** list,
 static void gst_mpdparser_parse_metrics_range_node (GList ** list,
     xmlNode * a_node);
 static void gst_mpdparser_parse_metrics_node (GList ** list, xmlNode * a_node);
-static void gst_mpdparser_parse_root_node (GstMPDNode ** pointer,
-    xmlNode * a_node);
+static gboolean gst_mpdparser_read_root_node (GstMPDNode ** pointer,
+    xmlTextReaderPtr reader);
 
 /* Helper functions */
 static gint convert_to_millisecs (gint decimals, gint pos);
@@ -1832,18 +1833,9 @@ gst_mpdparser_parse_metrics_node (GList ** list, xmlNode * a_node)
 }
 
 static void
-gst_mpdparser_parse_root_node (GstMPDNode ** pointer, xmlNode * a_node)
+gst_mpdparser_parse_root_node_attributes (GstMPDNode * new_mpd,
+    xmlNode * a_node)
 {
-  xmlNode *cur_node;
-  GstMPDNode *new_mpd;
-
-  gst_mpdparser_free_mpd_node (*pointer);
-  *pointer = new_mpd = g_slice_new0 (GstMPDNode);
-  if (new_mpd == NULL) {
-    GST_WARNING ("Allocation of MPD node failed!");
-    return;
-  }
-
   GST_LOG ("namespaces of root MPD node:");
   new_mpd->default_namespace =
       gst_mpdparser_get_xml_node_namespace (a_node, NULL);
@@ -1874,24 +1866,76 @@ gst_mpdparser_parse_root_node (GstMPDNode ** pointer, xmlNode * a_node)
       &new_mpd->maxSegmentDuration);
   gst_mpdparser_get_xml_prop_duration (a_node, "maxSubsegmentDuration", -1,
       &new_mpd->maxSubsegmentDuration);
+}
 
-  /* explore children Period nodes */
-  for (cur_node = a_node->children; cur_node; cur_node = cur_node->next) {
-    if (cur_node->type == XML_ELEMENT_NODE) {
-      if (xmlStrcmp (cur_node->name, (xmlChar *) "Period") == 0) {
-        gst_mpdparser_parse_period_node (&new_mpd->Periods, cur_node);
-      } else if (xmlStrcmp (cur_node->name,
-              (xmlChar *) "ProgramInformation") == 0) {
-        gst_mpdparser_parse_program_info_node (&new_mpd->ProgramInfo, cur_node);
-      } else if (xmlStrcmp (cur_node->name, (xmlChar *) "BaseURL") == 0) {
-        gst_mpdparser_parse_baseURL_node (&new_mpd->BaseURLs, cur_node);
-      } else if (xmlStrcmp (cur_node->name, (xmlChar *) "Location") == 0) {
-        gst_mpdparser_parse_location_node (&new_mpd->Locations, cur_node);
-      } else if (xmlStrcmp (cur_node->name, (xmlChar *) "Metrics") == 0) {
-        gst_mpdparser_parse_metrics_node (&new_mpd->Metrics, cur_node);
-      }
+static void
+gst_mpdparser_parse_root_child_node (GstMPDNode * new_mpd, xmlNode * cur_node)
+{
+  if (xmlStrcmp (cur_node->name, (xmlChar *) "Period") == 0) {
+    gst_mpdparser_parse_period_node (&new_mpd->Periods, cur_node);
+  } else if (xmlStrcmp (cur_node->name, (xmlChar *) "ProgramInformation") == 0) {
+    gst_mpdparser_parse_program_info_node (&new_mpd->ProgramInfo, cur_node);
+  } else if (xmlStrcmp (cur_node->name, (xmlChar *) "BaseURL") == 0) {
+    gst_mpdparser_parse_baseURL_node (&new_mpd->BaseURLs, cur_node);
+  } else if (xmlStrcmp (cur_node->name, (xmlChar *) "Location") == 0) {
+    gst_mpdparser_parse_location_node (&new_mpd->Locations, cur_node);
+  } else if (xmlStrcmp (cur_node->name, (xmlChar *) "Metrics") == 0) {
+    gst_mpdparser_parse_metrics_node (&new_mpd->Metrics, cur_node);
+  }
+}
+
+/* Reads the MPD element from @reader. Only the subtree of one child of the
+ * root (usually a Period) is expanded at a time, the reader frees it once
+ * it moves past it, so the whole document is never held in memory */
+static gboolean
+gst_mpdparser_read_root_node (GstMPDNode ** pointer, xmlTextReaderPtr reader)
+{
+  xmlNode *cur_node;
+  GstMPDNode *new_mpd;
+  gint depth, ret;
+
+  /* move to the root element */
+  while ((ret = xmlTextReaderRead (reader)) == 1
+      && xmlTextReaderNodeType (reader) != XML_READER_TYPE_ELEMENT);
+  if (ret != 1)
+    return FALSE;
+
+  cur_node = xmlTextReaderCurrentNode (reader);
+  if (cur_node == NULL || xmlStrcmp (cur_node->name, (xmlChar *) "MPD") != 0) {
+    GST_ERROR
+        ("can not find the root element MPD, failed to parse the MPD file");
+    return FALSE;
+  }
+
+  gst_mpdparser_free_mpd_node (*pointer);
+  *pointer = new_mpd = g_slice_new0 (GstMPDNode);
+
+  /* the attributes of the element are available as soon as it is read */
+  gst_mpdparser_parse_root_node_attributes (new_mpd, cur_node);
+  if (xmlTextReaderIsEmptyElement (reader))
+    return TRUE;
+
+  /* explore children nodes */
+  depth = xmlTextReaderDepth (reader);
+  ret = xmlTextReaderRead (reader);
+  while (ret == 1 && xmlTextReaderDepth (reader) > depth) {
+    if (xmlTextReaderNodeType (reader) != XML_READER_TYPE_ELEMENT) {
+      ret = xmlTextReaderRead (reader);
+      continue;
     }
+
+    cur_node = xmlTextReaderExpand (reader);
+    if (cur_node == NULL) {
+      ret = -1;
+      break;
+    }
+    gst_mpdparser_parse_root_child_node (new_mpd, cur_node);
+
+    /* skip to the next sibling */
+    ret = xmlTextReaderNext (reader);
   }
+
+  return ret != -1;
 }
 
 /* comparison functions */
@@ -2347,6 +2391,8 @@ gst_mpdparser_free_segment_timeline_node (GstSegmentTimelineNode * seg_timeline)
   if (seg_timeline) {
     g_queue_foreach (&seg_timeline->S, (GFunc) gst_mpdparser_free_s_node, NULL);
     g_queue_clear (&seg_timeline->S);
+    if (seg_timeline->runs)
+      g_array_free (seg_timeline->runs, TRUE);
     g_slice_free (GstSegmentTimelineNode, seg_timeline);
   }
 }
@@ -2858,37 +2904,29 @@ gboolean
 gst_mpd_parse (GstMpdClient * client, const gchar * data, gint size)
 {
   if (data) {
-    xmlDocPtr doc;
-    xmlNode *root_element = NULL;
+    xmlTextReaderPtr reader;
+    gboolean ret;
 
     GST_DEBUG ("MPD file fully buffered, start parsing...");
 
-    /* parse the complete MPD file into a tree (using the libxml2 default parser API) */
-
     /* this initialize the library and check potential ABI mismatches
      * between the version it was compiled for and the actual shared
      * library used
      */
     LIBXML_TEST_VERSION
-        /* parse "data" into a document (which is a libxml2 tree structure xmlDoc) */
-        doc = xmlReadMemory (data, size, "noname.xml", NULL, 0);
-    if (doc == NULL) {
-      GST_ERROR ("failed to parse the MPD file");
+        /* stream through "data" instead of building the whole document */
+        reader = xmlReaderForMemory (data, size, "noname.xml", NULL, 0);
+    if (reader == NULL) {
+      GST_ERROR ("failed to create a reader for the MPD file");
       return FALSE;
-    } else {
-      /* get the root element node */
-      root_element = xmlDocGetRootElement (doc);
+    }
 
-      if (root_element->type != XML_ELEMENT_NODE
-          || xmlStrcmp (root_element->name, (xmlChar *) "MPD") != 0) {
-        GST_ERROR
-            ("can not find the root element MPD, failed to parse the MPD file");
-      } else {
-        /* now we can parse the MPD root node and all children nodes, recursively */
-        gst_mpdparser_parse_root_node (&client->mpd_node, root_element);
-      }
-      /* free the document */
-      xmlFreeDoc (doc);
+    ret = gst_mpdparser_read_root_node (&client->mpd_node, reader);
+    xmlFreeTextReader (reader);
+
+    if (!ret || client->mpd_node == NULL) {
+      GST_ERROR ("failed to parse the MPD file");
+      return FALSE;
     }
 
     gst_mpd_client_check_profiles (client);
@@ -2912,6 +2950,162 @@ gst_mpdparser_get_baseURL (GstMpdClient * client, guint indexStream)
   return stream->baseURL;
 }
 
+/* Merges the S nodes of @timeline into runs of segments of the same
+ * duration, so that segments can be computed when needed instead of being
+ * listed. The runs stay with the node, selecting a representation using it
+ * again does not walk the timeline */
+static void
+gst_mpdparser_build_timeline_runs (GstSegmentTimelineNode * timeline,
+    guint timescale, GstClockTime period_start)
+{
+  GstSegmentTimelineRun *run = NULL;
+  GstClockTime start_time = period_start;
+  guint64 start = 0;
+  GList *list;
+
+  if (timeline->runs) {
+    if (timeline->runs_period_start == period_start)
+      return;
+    g_array_free (timeline->runs, TRUE);
+  }
+
+  timeline->runs = g_array_new (FALSE, FALSE, sizeof (GstSegmentTimelineRun));
+  timeline->runs_period_start = period_start;
+  timeline->n_segments = 0;
+
+  for (list = g_queue_peek_head_link (&timeline->S); list;
+      list = g_list_next (list)) {
+    GstSNode *S = (GstSNode *) list->data;
+    GstClockTime duration;
+    guint count = S->r + 1;
+
+    GST_LOG ("Processing S node: d=%" G_GUINT64_FORMAT " r=%u t=%"
+        G_GUINT64_FORMAT, S->d, S->r, S->t);
+    duration = S->d * GST_SECOND;
+    if (timescale > 1)
+      duration /= timescale;
+    if (S->t > 0) {
+      start = S->t;
+      start_time = S->t * GST_SECOND;
+      if (timescale > 1)
+        start_time /= timescale;
+    }
+
+    if (run && run->d == S->d && run->t + run->count * run->d == start
+        && run->start_time + run->count * run->duration == start_time) {
+      /* continues the previous run */
+      run->count += count;
+    } else {
+      g_array_set_size (timeline->runs, timeline->runs->len + 1);
+      run = &g_array_index (timeline->runs, GstSegmentTimelineRun,
+          timeline->runs->len - 1);
+      run->first = timeline->n_segments;
+      run->count = count;
+      run->t = start;
+      run->d = S->d;
+      run->start_time = start_time;
+      run->duration = duration;
+    }
+
+    timeline->n_segments += count;
+    start += count * S->d;
+    start_time += count * duration;
+  }
+
+  GST_LOG ("Segment timeline has %u segments in %u runs",
+      timeline->n_segments, timeline->runs->len);
+}
+
+/* Returns the run containing segment @index */
+static GstSegmentTimelineRun *
+gst_mpdparser_find_timeline_run (GstSegmentTimelineNode * timeline,
+    guint index)
+{
+  guint lo = 0, hi = timeline->runs->len;
+
+  while (lo < hi) {
+    guint mid = lo + (hi - lo) / 2;
+    GstSegmentTimelineRun *run =
+        &g_array_index (timeline->runs, GstSegmentTimelineRun, mid);
+
+    if (index < run->first)
+      hi = mid;
+    else if (index >= run->first + run->count)
+      lo = mid + 1;
+    else
+      return run;
+  }
+
+  return NULL;
+}
+
+/* Returns the index of the segment containing @ts, -1 if none does */
+static gint
+gst_mpdparser_find_timeline_segment_at_time (GstSegmentTimelineNode *
+    timeline, GstClockTime ts)
+{
+  GstSegmentTimelineRun *run;
+  guint lo = 0, hi = timeline->runs->len;
+  guint64 offset;
+
+  /* last run starting before @ts */
+  while (lo < hi) {
+    guint mid = lo + (hi - lo) / 2;
+
+    run = &g_array_index (timeline->runs, GstSegmentTimelineRun, mid);
+    if (run->start_time <= ts)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo == 0)
+    return -1;
+
+  run = &g_array_index (timeline->runs, GstSegmentTimelineRun, lo - 1);
+  if (run->duration == 0)
+    return -1;
+
+  offset = (ts - run->start_time) / run->duration;
+  if (offset >= run->count)
+    return -1;
+
+  return run->first + offset;
+}
+
+static gboolean
+gst_mpd_client_get_timeline_segment (GstMpdClient * client,
+    GstActiveStream * stream, guint index, GstMediaSegment * segment)
+{
+  GstSegmentTimelineRun *run;
+  GstStreamPeriod *stream_period;
+  guint offset;
+
+  run = gst_mpdparser_find_timeline_run (stream->cur_timeline, index);
+  if (run == NULL)
+    return FALSE;
+
+  offset = index - run->first;
+  segment->SegmentURL = NULL;
+  segment->number = index
+      + stream->cur_seg_template->MultSegBaseType->startNumber;
+  segment->start = run->t + offset * run->d;
+  segment->start_time = run->start_time + offset * run->duration;
+  segment->duration = run->duration;
+
+  /* the last segment ends with the period */
+  stream_period = gst_mpdparser_get_stream_period (client);
+  if (index == stream->cur_timeline->n_segments - 1 && stream_period
+      && GST_CLOCK_TIME_IS_VALID (stream_period->duration)) {
+    GstClockTime period_end = stream_period->start + stream_period->duration;
+
+    if (segment->start_time < period_end
+        && segment->start_time + segment->duration > period_end)
+      segment->duration = period_end - segment->start_time;
+  }
+
+  return TRUE;
+}
+
 gboolean
 gst_mpdparser_get_chunk_by_index (GstMpdClient * client, guint indexStream,
     guint indexChunk, GstMediaSegment * segment)
@@ -2936,6 +3130,9 @@ gst_mpdparser_get_chunk_by_index (GstMpdClient * client, guint indexStream,
     segment->start = list_segment->start;
     segment->start_time = list_segment->start_time;
     segment->duration = list_segment->duration;
+  } else if (stream->cur_timeline) {
+    return gst_mpd_client_get_timeline_segment (client, stream, indexChunk,
+        segment);
   } else {
     GstClockTime duration;
     GstStreamPeriod *stream_period;
@@ -3017,6 +3214,7 @@ gst_mpd_client_setup_representation (GstMpdClient * client,
     g_ptr_array_unref (stream->segments);
     stream->segments = NULL;
   }
+  stream->cur_timeline = NULL;
 
   stream_period = gst_mpdparser_get_stream_period (client);
   g_return_val_if_fail (stream_period != NULL, FALSE);
@@ -3141,49 +3339,15 @@ gst_mpd_client_setup_representation (GstMpdClient * client,
         return FALSE;
       }
     } else {
-      /* build segment list */
-      i = stream->cur_seg_template->MultSegBaseType->startNumber;
-      start = 0;
-      start_time = PeriodStart;
-
-      GST_LOG ("Building media segment list using this template: %s",
-          stream->cur_seg_template->media);
+      GST_LOG ("Using this template: %s", stream->cur_seg_template->media);
       if (stream->cur_seg_template->MultSegBaseType->SegmentTimeline) {
-        GstSegmentTimelineNode *timeline;
-        GstSNode *S;
-        GList *list;
-
-        timeline = stream->cur_seg_template->MultSegBaseType->SegmentTimeline;
-        gst_mpdparser_init_active_stream_segments (stream);
-        for (list = g_queue_peek_head_link (&timeline->S); list;
-            list = g_list_next (list)) {
-          guint j, timescale;
-
-          S = (GstSNode *) list->data;
-          GST_LOG ("Processing S node: d=%" G_GUINT64_FORMAT " r=%u t=%"
-              G_GUINT64_FORMAT, S->d, S->r, S->t);
-          duration = S->d * GST_SECOND;
-          timescale =
-              stream->cur_seg_template->MultSegBaseType->SegBaseType->timescale;
-          if (timescale > 1)
-            duration /= timescale;
-          if (S->t > 0) {
-            start = S->t;
-            start_time = S->t * GST_SECOND;
-            if (timescale > 1)
-              start_time /= timescale;
-          }
-
-          for (j = 0; j <= S->r; j++) {
-            if (!gst_mpd_client_add_media_segment (stream, NULL, i, start,
-                    start_time, duration)) {
-              return FALSE;
-            }
-            i++;
-            start += S->d;
-            start_time += duration;
-          }
-        }
+        /* Segments are computed on demand from the runs of the timeline,
+         * so that switching does not depend on the number of segments */
+        stream->cur_timeline =
+            stream->cur_seg_template->MultSegBaseType->SegmentTimeline;
+        gst_mpdparser_build_timeline_runs (stream->cur_timeline,
+            stream->cur_seg_template->MultSegBaseType->SegBaseType->timescale,
+            PeriodStart);
       } else {
         /* NOP - The segment is created on demand with the template, no need
          * to build a list */
@@ -3315,6 +3479,349 @@ no_mem:
   return FALSE;
 }
 
+/* Start of @S in timescale units, @end is the end of the previous node */
+#define S_NODE_START(S, end) ((S)->t > 0 ? (S)->t : (end))
+
+static guint
+gst_mpdparser_get_mult_seg_base_timescale (GstMultSegmentBaseType * base)
+{
+  if (base->SegBaseType && base->SegBaseType->timescale > 1)
+    return base->SegBaseType->timescale;
+  return 1;
+}
+
+/* End of the last segment of @timeline */
+static guint64
+gst_mpdparser_segment_timeline_end (GstSegmentTimelineNode * timeline)
+{
+  guint64 end = 0;
+  GList *list;
+
+  for (list = g_queue_peek_head_link (&timeline->S); list;
+      list = g_list_next (list)) {
+    GstSNode *S = (GstSNode *) list->data;
+
+    end = S_NODE_START (S, end) + (S->r + 1) * S->d;
+  }
+
+  return end;
+}
+
+/* Whether the end of @old is on a segment boundary of @update, so that the
+ * segments of @update that follow can be appended */
+static gboolean
+gst_mpdparser_segment_timelines_align (GstSegmentTimelineNode * old,
+    GstSegmentTimelineNode * update)
+{
+  guint64 end = 0, old_end = gst_mpdparser_segment_timeline_end (old);
+  GList *list;
+
+  for (list = g_queue_peek_head_link (&update->S); list;
+      list = g_list_next (list)) {
+    GstSNode *S = (GstSNode *) list->data;
+    guint64 start = S_NODE_START (S, end);
+
+    end = start + (S->r + 1) * S->d;
+    if (S->d > 0 && start < old_end && old_end < end)
+      return (old_end - start) % S->d == 0;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+gst_mpdparser_can_merge_segment_template (GstSegmentTemplateNode * old,
+    GstSegmentTemplateNode * update)
+{
+  GstMultSegmentBaseType *old_base, *new_base;
+
+  if (old == NULL || update == NULL)
+    return old == update;
+  if (g_strcmp0 (old->media, update->media) != 0)
+    return FALSE;
+
+  old_base = old->MultSegBaseType;
+  new_base = update->MultSegBaseType;
+  if (old_base == NULL || new_base == NULL)
+    return old_base == new_base;
+
+  if ((old_base->SegmentTimeline == NULL) !=
+      (new_base->SegmentTimeline == NULL)
+      || gst_mpdparser_get_mult_seg_base_timescale (old_base) !=
+      gst_mpdparser_get_mult_seg_base_timescale (new_base))
+    return FALSE;
+
+  /* a segment that changed duration, like a provisional last one, needs a
+   * full rebuild */
+  return old_base->SegmentTimeline == NULL ||
+      gst_mpdparser_segment_timelines_align (old_base->SegmentTimeline,
+      new_base->SegmentTimeline);
+}
+
+/* Whether @update describes the same streams as @old. SegmentLists are not
+ * merged, their segments are listed in the nodes kept by the streams */
+static gboolean
+gst_mpdparser_can_merge_period (GstPeriodNode * old, GstPeriodNode * update)
+{
+  GList *a, *b, *c, *d;
+
+  if (old->id || update->id) {
+    if (g_strcmp0 (old->id, update->id) != 0)
+      return FALSE;
+  } else if (old->start != update->start) {
+    return FALSE;
+  }
+
+  if (old->SegmentList || update->SegmentList
+      || !gst_mpdparser_can_merge_segment_template (old->SegmentTemplate,
+          update->SegmentTemplate))
+    return FALSE;
+
+  for (a = old->AdaptationSets, b = update->AdaptationSets; a && b;
+      a = g_list_next (a), b = g_list_next (b)) {
+    GstAdaptationSetNode *old_set = a->data, *new_set = b->data;
+
+    if (old_set->id != new_set->id || old_set->SegmentList
+        || new_set->SegmentList
+        || !gst_mpdparser_can_merge_segment_template (old_set->SegmentTemplate,
+            new_set->SegmentTemplate))
+      return FALSE;
+
+    for (c = old_set->Representations, d = new_set->Representations; c && d;
+        c = g_list_next (c), d = g_list_next (d)) {
+      GstRepresentationNode *old_rep = c->data, *new_rep = d->data;
+
+      if (g_strcmp0 (old_rep->id, new_rep->id) != 0
+          || old_rep->bandwidth != new_rep->bandwidth || old_rep->SegmentList
+          || new_rep->SegmentList
+          || !gst_mpdparser_can_merge_segment_template (old_rep->
+              SegmentTemplate, new_rep->SegmentTemplate))
+        return FALSE;
+    }
+    if (c || d)
+      return FALSE;
+  }
+
+  return a == NULL && b == NULL;
+}
+
+/* Appends the segments of @update that follow the ones of @old and drops
+ * the ones of @old that are before the first one of @update. Returns the
+ * number of segments dropped */
+static guint
+gst_mpdparser_merge_segment_timeline (GstSegmentTimelineNode * old,
+    GstSegmentTimelineNode * update)
+{
+  guint64 end = 0, old_end, new_first = G_MAXUINT64;
+  gboolean changed = FALSE;
+  guint dropped = 0;
+  GstSNode *S;
+  GList *list;
+
+  old_end = gst_mpdparser_segment_timeline_end (old);
+
+  /* append what comes after the known segments */
+  end = 0;
+  for (list = g_queue_peek_head_link (&update->S); list;
+      list = g_list_next (list)) {
+    guint64 start, skip;
+    GstSNode *clone;
+
+    S = (GstSNode *) list->data;
+    start = S_NODE_START (S, end);
+    end = start + (S->r + 1) * S->d;
+    if (new_first == G_MAXUINT64)
+      new_first = start;
+    if (S->d == 0 || end <= old_end)
+      continue;
+
+    skip = start < old_end ? (old_end - start + S->d - 1) / S->d : 0;
+    /* the known timeline ends inside the last segment of this node */
+    if (skip > S->r)
+      continue;
+
+    clone = gst_mpdparser_clone_s_node (S);
+    clone->t = start + skip * S->d;
+    clone->r = S->r - skip;
+    g_queue_push_tail (&old->S, clone);
+    changed = TRUE;
+  }
+
+  /* drop what left the window */
+  end = 0;
+  while ((S = g_queue_peek_head (&old->S)) && S->d > 0) {
+    guint64 start = S_NODE_START (S, end);
+    guint64 count = S->r + 1, skip;
+    GstSNode *next;
+
+    if (start >= new_first)
+      break;
+
+    skip = (new_first - start + S->d - 1) / S->d;
+    if (skip < count) {
+      S->t = start + skip * S->d;
+      S->r -= skip;
+      dropped += skip;
+      changed = TRUE;
+      break;
+    }
+
+    end = start + count * S->d;
+    g_queue_pop_head (&old->S);
+    gst_mpdparser_free_s_node (S);
+    dropped += count;
+    changed = TRUE;
+
+    /* the next node might have been following the dropped one */
+    next = g_queue_peek_head (&old->S);
+    if (next && next->t == 0)
+      next->t = end;
+  }
+
+  if (changed && old->runs) {
+    g_array_free (old->runs, TRUE);
+    old->runs = NULL;
+  }
+
+  GST_LOG ("Merged timeline update, dropped %u segments", dropped);
+  return dropped;
+}
+
+static void
+gst_mpdparser_merge_segment_template (GstSegmentTemplateNode * old,
+    GstSegmentTemplateNode * update, GHashTable * dropped)
+{
+  GstMultSegmentBaseType *old_base, *new_base;
+
+  if (old == NULL || old->MultSegBaseType == NULL)
+    return;
+
+  old_base = old->MultSegBaseType;
+  new_base = update->MultSegBaseType;
+  old_base->duration = new_base->duration;
+  old_base->startNumber = new_base->startNumber;
+  if (old_base->SegBaseType && new_base->SegBaseType)
+    old_base->SegBaseType->presentationTimeOffset =
+        new_base->SegBaseType->presentationTimeOffset;
+
+  if (old_base->SegmentTimeline) {
+    guint n = gst_mpdparser_merge_segment_timeline (old_base->SegmentTimeline,
+        new_base->SegmentTimeline);
+
+    g_hash_table_insert (dropped, old_base->SegmentTimeline,
+        GUINT_TO_POINTER (n));
+  }
+}
+
+static void
+gst_mpdparser_merge_period (GstPeriodNode * old, GstPeriodNode * update,
+    GHashTable * dropped)
+{
+  GList *a, *b, *c, *d;
+
+  old->start = update->start;
+  old->duration = update->duration;
+  gst_mpdparser_merge_segment_template (old->SegmentTemplate,
+      update->SegmentTemplate, dropped);
+
+  for (a = old->AdaptationSets, b = update->AdaptationSets; a && b;
+      a = g_list_next (a), b = g_list_next (b)) {
+    GstAdaptationSetNode *old_set = a->data, *new_set = b->data;
+
+    gst_mpdparser_merge_segment_template (old_set->SegmentTemplate,
+        new_set->SegmentTemplate, dropped);
+    for (c = old_set->Representations, d = new_set->Representations; c && d;
+        c = g_list_next (c), d = g_list_next (d)) {
+      GstRepresentationNode *old_rep = c->data, *new_rep = d->data;
+
+      gst_mpdparser_merge_segment_template (old_rep->SegmentTemplate,
+          new_rep->SegmentTemplate, dropped);
+    }
+  }
+}
+
+/* Merges @update, a newer version of the MPD of @client, without rebuilding
+ * the streams: new segments of the timelines are appended, the ones that
+ * left the window are dropped and new periods are added. Returns FALSE,
+ * leaving @client untouched, if @update describes other streams */
+gboolean
+gst_mpd_client_merge (GstMpdClient * client, GstMpdClient * update)
+{
+  GstMPDNode *mpd, *new_mpd;
+  GstStreamPeriod *stream_period;
+  GHashTable *dropped;
+  GList *a, *b;
+
+  g_return_val_if_fail (client != NULL, FALSE);
+  g_return_val_if_fail (update != NULL, FALSE);
+
+  mpd = client->mpd_node;
+  new_mpd = update->mpd_node;
+  if (mpd == NULL || new_mpd == NULL)
+    return FALSE;
+
+  /* the known periods have to be kept in the same order, new ones can
+   * only follow them */
+  for (a = mpd->Periods, b = new_mpd->Periods; a;
+      a = g_list_next (a), b = g_list_next (b)) {
+    if (b == NULL || !gst_mpdparser_can_merge_period (a->data, b->data)) {
+      GST_DEBUG ("Periods of the update differ, can't merge it");
+      return FALSE;
+    }
+  }
+
+  dropped = g_hash_table_new (NULL, NULL);
+  for (a = mpd->Periods, b = new_mpd->Periods; a;
+      a = g_list_next (a), b = g_list_next (b))
+    gst_mpdparser_merge_period (a->data, b->data, dropped);
+
+  while (b) {
+    GList *next = g_list_next (b);
+
+    GST_DEBUG ("Adding new Period %s", GST_STR_NULL (((GstPeriodNode *)
+                b->data)->id));
+    new_mpd->Periods = g_list_remove_link (new_mpd->Periods, b);
+    mpd->Periods = g_list_concat (mpd->Periods, b);
+    b = next;
+  }
+
+  mpd->type = new_mpd->type;
+  mpd->mediaPresentationDuration = new_mpd->mediaPresentationDuration;
+  mpd->minimumUpdatePeriod = new_mpd->minimumUpdatePeriod;
+  mpd->minBufferTime = new_mpd->minBufferTime;
+  mpd->timeShiftBufferDepth = new_mpd->timeShiftBufferDepth;
+  mpd->suggestedPresentationDelay = new_mpd->suggestedPresentationDelay;
+  mpd->maxSegmentDuration = new_mpd->maxSegmentDuration;
+  if (mpd->availabilityEndTime)
+    gst_date_time_unref (mpd->availabilityEndTime);
+  mpd->availabilityEndTime = new_mpd->availabilityEndTime;
+  new_mpd->availabilityEndTime = NULL;
+
+  /* periods might have got a duration or new ones */
+  if (!gst_mpd_client_setup_media_presentation (client))
+    GST_WARNING ("Failed to set up the periods of the update");
+
+  /* keep the streams on the same segments */
+  stream_period = gst_mpdparser_get_stream_period (client);
+  for (a = client->active_streams; a; a = g_list_next (a)) {
+    GstActiveStream *stream = a->data;
+    guint n;
+
+    if (stream->cur_timeline == NULL || stream_period == NULL)
+      continue;
+
+    n = GPOINTER_TO_UINT (g_hash_table_lookup (dropped, stream->cur_timeline));
+    stream->segment_idx -= MIN (n, stream->segment_idx);
+    gst_mpdparser_build_timeline_runs (stream->cur_timeline,
+        stream->cur_seg_template->MultSegBaseType->SegBaseType->timescale,
+        stream_period->start);
+  }
+
+  g_hash_table_unref (dropped);
+
+  return TRUE;
+}
+
 static GList *
 gst_mpd_client_get_adaptation_sets_for_period (GstMpdClient * client,
     GstStreamPeriod * period)
@@ -3429,6 +3936,11 @@ gst_mpd_client_stream_seek (GstMpdClient * client, GstActiveStream * stream,
     if (selectedChunk == NULL) {
       return FALSE;
     }
+  } else if (stream->cur_timeline) {
+    index = gst_mpdparser_find_timeline_segment_at_time (stream->cur_timeline,
+        ts);
+    if (index < 0)
+      return FALSE;
   } else {
     GstClockTime duration =
         gst_mpd_client_get_segment_duration (client, stream);
@@ -3584,25 +4096,18 @@ gst_mpd_client_get_next_fragment_timestamp (GstMpdClient * client,
   return TRUE;
 }
 
-gboolean
-gst_mpd_client_get_next_fragment (GstMpdClient * client,
-    guint indexStream, GstMediaFragmentInfo * fragment)
+static gboolean
+gst_mpd_client_get_fragment (GstMpdClient * client, guint indexStream,
+    guint segment_idx, GstMediaFragmentInfo * fragment)
 {
   GstActiveStream *stream = NULL;
   GstMediaSegment currentChunk;
   gchar *mediaURL = NULL;
   gchar *indexURL = NULL;
   GstUri *base_url, *frag_url;
-  guint segment_idx;
 
-  /* select stream */
-  g_return_val_if_fail (client != NULL, FALSE);
-  g_return_val_if_fail (client->active_streams != NULL, FALSE);
   stream = g_list_nth_data (client->active_streams, indexStream);
-  g_return_val_if_fail (stream != NULL, FALSE);
-  g_return_val_if_fail (stream->cur_representation != NULL, FALSE);
 
-  segment_idx = gst_mpd_client_get_segment_index (stream);
   GST_DEBUG ("Looking for fragment sequence chunk %d", segment_idx);
 
   if (!gst_mpdparser_get_chunk_by_index (client, indexStream, segment_idx,
@@ -3692,6 +4197,51 @@ gst_mpd_client_get_next_fragment (GstMpdClient * client,
   return TRUE;
 }
 
+gboolean
+gst_mpd_client_get_next_fragment (GstMpdClient * client,
+    guint indexStream, GstMediaFragmentInfo * fragment)
+{
+  GstActiveStream *stream = NULL;
+
+  /* select stream */
+  g_return_val_if_fail (client != NULL, FALSE);
+  g_return_val_if_fail (client->active_streams != NULL, FALSE);
+  stream = g_list_nth_data (client->active_streams, indexStream);
+  g_return_val_if_fail (stream != NULL, FALSE);
+  g_return_val_if_fail (stream->cur_representation != NULL, FALSE);
+
+  return gst_mpd_client_get_fragment (client, indexStream,
+      gst_mpd_client_get_segment_index (stream), fragment);
+}
+
+/* Gets the fragment @ahead segments after the next one, without advancing */
+gboolean
+gst_mpd_client_peek_fragment (GstMpdClient * client, guint indexStream,
+    guint ahead, gboolean forward, GstMediaFragmentInfo * fragment)
+{
+  GstActiveStream *stream = NULL;
+  guint segment_idx;
+
+  /* select stream */
+  g_return_val_if_fail (client != NULL, FALSE);
+  g_return_val_if_fail (client->active_streams != NULL, FALSE);
+  stream = g_list_nth_data (client->active_streams, indexStream);
+  g_return_val_if_fail (stream != NULL, FALSE);
+  g_return_val_if_fail (stream->cur_representation != NULL, FALSE);
+
+  segment_idx = gst_mpd_client_get_segment_index (stream);
+  if (forward) {
+    segment_idx += ahead;
+  } else {
+    if (segment_idx < ahead)
+      return FALSE;
+    segment_idx -= ahead;
+  }
+
+  return gst_mpd_client_get_fragment (client, indexStream, segment_idx,
+      fragment);
+}
+
 static GstFlowReturn
 gst_mpd_client_update_segment (GstMpdClient * client, GstActiveStream * stream,
     gint update)
@@ -3828,6 +4378,13 @@ gst_mpd_client_get_next_fragment_duration (GstMpdClient * client,
       media_segment = g_ptr_array_index (stream->segments, seg_idx);
 
     return media_segment == NULL ? 0 : media_segment->duration;
+  } else if (stream->cur_timeline) {
+    GstMediaSegment segment;
+
+    if (!gst_mpd_client_get_timeline_segment (client, stream, seg_idx,
+            &segment))
+      return 0;
+    return segment.duration;
   } else {
     GstClockTime duration =
         gst_mpd_client_get_segment_duration (client, stream);
@@ -3994,6 +4551,8 @@ gst_mpd_client_get_segments_counts (GstActiveStream * stream)
 
   if (stream->segments)
     return stream->segments->len;
+  if (stream->cur_timeline)
+    return stream->cur_timeline->n_segments;
   g_return_val_if_fail (stream->cur_seg_template->MultSegBaseType->
       SegmentTimeline == NULL, 0);
   return 0;
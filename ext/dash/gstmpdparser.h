@@ -58,6 +58,7 @@ typedef struct _GstMetricsRangeNode       GstMetricsRangeNode;
 typedef struct _GstMetricsNode            GstMetricsNode;
 typedef struct _GstSNode                  GstSNode;
 typedef struct _GstSegmentTimelineNode    GstSegmentTimelineNode;
+typedef struct _GstSegmentTimelineRun     GstSegmentTimelineRun;
 typedef struct _GstSegmentBaseType        GstSegmentBaseType;
 typedef struct _GstURLType                GstURLType;
 typedef struct _GstMultSegmentBaseType    GstMultSegmentBaseType;
@@ -132,6 +133,26 @@ struct _GstSegmentTimelineNode
 {
   /* list of S nodes */
   GQueue S;
+
+  /* S nodes merged in runs of segments, built when first used */
+  GArray *runs;                               /* array of GstSegmentTimelineRun */
+  guint n_segments;                           /* total number of segments */
+  GstClockTime runs_period_start;             /* Period start the runs were built for */
+};
+
+/**
+ * GstSegmentTimelineRun:
+ *
+ * Consecutive segments of a SegmentTimeline with the same duration
+ */
+struct _GstSegmentTimelineRun
+{
+  guint first;                                /* index of the first segment */
+  guint count;                                /* number of segments */
+  guint64 t;                                  /* first segment start in timescale units */
+  guint64 d;                                  /* segment duration in timescale units */
+  GstClockTime start_time;                    /* first segment start time */
+  GstClockTime duration;                      /* segment duration */
 };
 
 struct _GstURLType
@@ -456,6 +477,8 @@ struct _GstActiveStream
   GstSegmentTemplateNode *cur_seg_template;   /* active segment template */
   guint segment_idx;                          /* index of next sequence chunk */
   GPtrArray *segments;                        /* array of GstMediaSegment */
+  GstSegmentTimelineNode *cur_timeline;       /* active template timeline, its
+                                               * segments are computed on demand */
 };
 
 struct _GstMpdClient
@@ -484,6 +507,7 @@ void gst_media_fragment_info_clear (GstMediaFragmentInfo * fragment);
 
 /* MPD file parsing */
 gboolean gst_mpd_parse (GstMpdClient *client, const gchar *data, gint size);
+gboolean gst_mpd_client_merge (GstMpdClient *client, GstMpdClient *update);
 
 /* Streaming management */
 gboolean gst_mpd_client_setup_media_presentation (GstMpdClient *client);
@@ -495,6 +519,7 @@ GstClockTime gst_mpd_client_get_media_presentation_duration (GstMpdClient *clien
 gboolean gst_mpd_client_get_last_fragment_timestamp (GstMpdClient * client, guint stream_idx, GstClockTime * ts);
 gboolean gst_mpd_client_get_next_fragment_timestamp (GstMpdClient * client, guint stream_idx, GstClockTime * ts);
 gboolean gst_mpd_client_get_next_fragment (GstMpdClient *client, guint indexStream, GstMediaFragmentInfo * fragment);
+gboolean gst_mpd_client_peek_fragment (GstMpdClient *client, guint indexStream, guint ahead, gboolean forward, GstMediaFragmentInfo * fragment);
 gboolean gst_mpd_client_get_next_header (GstMpdClient *client, gchar **uri, guint stream_idx, gint64 * range_start, gint64 * range_end);
 gboolean gst_mpd_client_get_next_header_index (GstMpdClient *client, gchar **uri, guint stream_idx, gint64 * range_start, gint64 * range_end);
 gboolean gst_mpd_client_is_live (GstMpdClient * client);
@@ -98,6 +98,7 @@ static gboolean
 gst_hls_demux_decrypt_start (GstHLSDemux * demux, const guint8 * key_data,
     const guint8 * iv_data);
 static void gst_hls_demux_decrypt_end (GstHLSDemux * demux);
+static void gst_hls_demux_prune_keys (GstHLSDemux * demux);
 
 static gboolean gst_hls_demux_is_live (GstAdaptiveDemux * demux);
 static GstClockTime gst_hls_demux_get_duration (GstAdaptiveDemux * demux);
@@ -121,6 +122,8 @@ static GstFlowReturn gst_hls_demux_advance_fragment (GstAdaptiveDemuxStream *
     stream);
 static GstFlowReturn gst_hls_demux_update_fragment_info (GstAdaptiveDemuxStream
     * stream);
+static guint gst_hls_demux_peek_fragments (GstAdaptiveDemuxStream * stream,
+    GstAdaptiveDemuxStreamFragment * fragments, guint n_fragments);
 static gboolean gst_hls_demux_select_bitrate (GstAdaptiveDemuxStream * stream,
     guint64 bitrate);
 static void gst_hls_demux_reset (GstAdaptiveDemux * demux);
@@ -143,6 +146,11 @@ gst_hls_demux_dispose (GObject * obj)
   gst_hls_demux_reset (GST_ADAPTIVE_DEMUX_CAST (demux));
   gst_m3u8_client_free (demux->client);
 
+  if (demux->keys) {
+    g_hash_table_unref (demux->keys);
+    demux->keys = NULL;
+  }
+
   G_OBJECT_CLASS (parent_class)->dispose (obj);
 }
 
@@ -212,6 +220,7 @@ gst_hls_demux_class_init (GstHLSDemuxClass * klass)
   adaptivedemux_class->stream_advance_fragment = gst_hls_demux_advance_fragment;
   adaptivedemux_class->stream_update_fragment_info =
       gst_hls_demux_update_fragment_info;
+  adaptivedemux_class->stream_peek_fragments = gst_hls_demux_peek_fragments;
   adaptivedemux_class->stream_select_bitrate = gst_hls_demux_select_bitrate;
 
   adaptivedemux_class->start_fragment = gst_hls_demux_start_fragment;
@@ -225,8 +234,13 @@ gst_hls_demux_class_init (GstHLSDemuxClass * klass)
 static void
 gst_hls_demux_init (GstHLSDemux * demux)
 {
-  /* Downloader */
+  /* Downloader, shares the connections of the fragment downloads */
   demux->downloader = gst_uri_downloader_new ();
+  gst_uri_downloader_set_source_pool (demux->downloader,
+      gst_adaptive_demux_get_source_pool (GST_ADAPTIVE_DEMUX_CAST (demux)));
+
+  demux->keys = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      (GDestroyNotify) gst_buffer_unref);
 
   demux->do_typefind = TRUE;
 
@@ -344,10 +358,7 @@ gst_hls_demux_seek (GstAdaptiveDemux * demux, GstEvent * seek)
   GstSeekType start_type, stop_type;
   gint64 start, stop;
   gdouble rate;
-  GList *walk;
-  GstClockTime current_pos, target_pos;
-  gint64 current_sequence;
-  GstM3U8MediaFile *file;
+  GstClockTime target_pos;
   guint64 bitrate;
 
   gst_event_parse_seek (seek, &rate, &format, &flags, &start_type, &start,
@@ -404,33 +415,14 @@ gst_hls_demux_seek (GstAdaptiveDemux * demux, GstEvent * seek)
         NULL);
   }
 
-  GST_M3U8_CLIENT_LOCK (hlsdemux->client);
-  file = GST_M3U8_MEDIA_FILE (hlsdemux->client->current->files->data);
-  current_sequence = file->sequence;
-  current_pos = 0;
   target_pos = rate > 0 ? start : stop;
-  /* FIXME: Here we need proper discont handling */
-  for (walk = hlsdemux->client->current->files; walk; walk = walk->next) {
-    file = walk->data;
-
-    current_sequence = file->sequence;
-    if (current_pos <= target_pos && target_pos < current_pos + file->duration) {
-      break;
-    }
-    current_pos += file->duration;
-  }
-  GST_M3U8_CLIENT_UNLOCK (hlsdemux->client);
-
-  if (walk == NULL) {
+  if (!gst_m3u8_client_seek (hlsdemux->client, target_pos))
     GST_DEBUG_OBJECT (demux, "seeking further than track duration");
-    current_sequence++;
-  }
 
   GST_M3U8_CLIENT_LOCK (hlsdemux->client);
-  GST_DEBUG_OBJECT (demux, "seeking to sequence %u", (guint) current_sequence);
+  GST_DEBUG_OBJECT (demux, "seeking to sequence %u",
+      (guint) hlsdemux->client->sequence);
   hlsdemux->reset_pts = TRUE;
-  hlsdemux->client->sequence = current_sequence;
-  hlsdemux->client->sequence_position = current_pos;
   GST_M3U8_CLIENT_UNLOCK (hlsdemux->client);
 
   return TRUE;
@@ -534,21 +526,20 @@ gst_hls_demux_start_fragment (GstAdaptiveDemux * demux,
 
   if (hlsdemux->current_key) {
     GError *err = NULL;
-    GstFragment *key_fragment;
     GstBuffer *key_buffer;
     GstMapInfo key_info;
+    gboolean ret;
 
-    /* new key? */
-    if (hlsdemux->key_url
-        && strcmp (hlsdemux->key_url, hlsdemux->current_key) == 0) {
-      key_fragment = g_object_ref (hlsdemux->key_fragment);
-    } else {
-      g_free (hlsdemux->key_url);
-      hlsdemux->key_url = NULL;
+    /* keys are only fetched once for as long as the playlist refers to them,
+     * the table is pruned from the playlist update thread */
+    GST_OBJECT_LOCK (demux);
+    key_buffer = g_hash_table_lookup (hlsdemux->keys, hlsdemux->current_key);
+    if (key_buffer)
+      gst_buffer_ref (key_buffer);
+    GST_OBJECT_UNLOCK (demux);
 
-      if (hlsdemux->key_fragment)
-        g_object_unref (hlsdemux->key_fragment);
-      hlsdemux->key_fragment = NULL;
+    if (key_buffer == NULL) {
+      GstFragment *key_fragment;
 
       GST_INFO_OBJECT (demux, "Fetching key %s", hlsdemux->current_key);
       key_fragment =
@@ -557,20 +548,37 @@ gst_hls_demux_start_fragment (GstAdaptiveDemux * demux,
           hlsdemux->client->main->uri : NULL, FALSE, FALSE,
           hlsdemux->client->current ? hlsdemux->client->current->
           allowcache : TRUE, &err);
-      if (key_fragment == NULL)
+      if (key_fragment == NULL) {
+        GST_WARNING_OBJECT (demux, "Failed to fetch key %s: %s",
+            hlsdemux->current_key, err ? err->message : "unknown error");
+        g_clear_error (&err);
         goto key_failed;
-      hlsdemux->key_url = g_strdup (hlsdemux->current_key);
-      hlsdemux->key_fragment = g_object_ref (key_fragment);
-    }
+      }
 
-    key_buffer = gst_fragment_get_buffer (key_fragment);
-    gst_buffer_map (key_buffer, &key_info, GST_MAP_READ);
+      key_buffer = gst_fragment_get_buffer (key_fragment);
+      g_object_unref (key_fragment);
 
-    gst_hls_demux_decrypt_start (hlsdemux, key_info.data, hlsdemux->current_iv);
+      if (gst_buffer_get_size (key_buffer) != 16) {
+        GST_WARNING_OBJECT (demux, "Key %s is %" G_GSIZE_FORMAT " bytes long",
+            hlsdemux->current_key, gst_buffer_get_size (key_buffer));
+        gst_buffer_unref (key_buffer);
+        goto key_failed;
+      }
 
+      GST_OBJECT_LOCK (demux);
+      g_hash_table_insert (hlsdemux->keys, g_strdup (hlsdemux->current_key),
+          gst_buffer_ref (key_buffer));
+      GST_OBJECT_UNLOCK (demux);
+    }
+
+    gst_buffer_map (key_buffer, &key_info, GST_MAP_READ);
+    ret = gst_hls_demux_decrypt_start (hlsdemux, key_info.data,
+        hlsdemux->current_iv);
     gst_buffer_unmap (key_buffer, &key_info);
     gst_buffer_unref (key_buffer);
-    g_object_unref (key_fragment);
+
+    if (!ret)
+      goto key_failed;
   }
 
   return TRUE;
@@ -587,8 +595,8 @@ gst_hls_demux_finish_fragment (GstAdaptiveDemux * demux,
 {
   GstHLSDemux *hlsdemux = GST_HLS_DEMUX_CAST (demux);
 
-  if (hlsdemux->current_key)
-    gst_hls_demux_decrypt_end (hlsdemux);
+  /* the cipher context is kept for the next fragment, which usually uses
+   * the same key and only needs a new IV */
 
   /* ideally this should be empty, but this eos might have been
    * caused by an error on the source element */
@@ -780,6 +788,23 @@ gst_hls_demux_update_fragment_info (GstAdaptiveDemuxStream * stream)
   return GST_FLOW_OK;
 }
 
+static guint
+gst_hls_demux_peek_fragments (GstAdaptiveDemuxStream * stream,
+    GstAdaptiveDemuxStreamFragment * fragments, guint n_fragments)
+{
+  GstHLSDemux *hlsdemux = GST_HLS_DEMUX_CAST (stream->demux);
+  guint i;
+
+  for (i = 0; i < n_fragments; i++) {
+    if (!gst_m3u8_client_peek_fragment (hlsdemux->client, i + 1,
+            &fragments[i].uri, &fragments[i].range_start,
+            &fragments[i].range_end, stream->demux->segment.rate > 0))
+      break;
+  }
+
+  return i;
+}
+
 static gboolean
 gst_hls_demux_select_bitrate (GstAdaptiveDemuxStream * stream, guint64 bitrate)
 {
@@ -815,12 +840,10 @@ gst_hls_demux_reset (GstAdaptiveDemux * ademux)
   demux->do_typefind = TRUE;
   demux->reset_pts = TRUE;
 
-  g_free (demux->key_url);
-  demux->key_url = NULL;
-
-  if (demux->key_fragment)
-    g_object_unref (demux->key_fragment);
-  demux->key_fragment = NULL;
+  GST_OBJECT_LOCK (demux);
+  if (demux->keys)
+    g_hash_table_remove_all (demux->keys);
+  GST_OBJECT_UNLOCK (demux);
 
   if (demux->input_caps) {
     gst_caps_unref (demux->input_caps);
@@ -998,6 +1021,8 @@ retry:
     return FALSE;
   }
 
+  gst_hls_demux_prune_keys (demux);
+
   /* If it's a live source, do not let the sequence number go beyond
    * three fragments before the end of the list */
   if (update == FALSE && demux->client->current &&
@@ -1006,8 +1031,8 @@ retry:
 
     GST_M3U8_CLIENT_LOCK (demux->client);
     last_sequence =
-        GST_M3U8_MEDIA_FILE (g_list_last (demux->client->current->
-            files)->data)->sequence;
+        GST_M3U8_MEDIA_FILE (g_ptr_array_index (demux->client->current->files,
+            demux->client->current->files->len - 1))->sequence;
 
     if (demux->client->sequence >= last_sequence - 3) {
       GST_DEBUG_OBJECT (demux, "Sequence is beyond playlist. Moving back to %u",
@@ -1017,9 +1042,7 @@ retry:
     }
     GST_M3U8_CLIENT_UNLOCK (demux->client);
   } else if (demux->client->current && !gst_m3u8_client_is_live (demux->client)) {
-    GstClockTime current_pos, target_pos;
-    guint sequence = 0;
-    GList *walk;
+    GstClockTime target_pos;
 
     /* Sequence numbers are not guaranteed to be the same in different
      * playlists, so get the correct fragment here based on the current
@@ -1039,23 +1062,9 @@ retry:
       target_pos = MAX (target_pos, demux->client->sequence_position);
     }
 
-    current_pos = 0;
-    for (walk = demux->client->current->files; walk; walk = walk->next) {
-      GstM3U8MediaFile *file = walk->data;
-
-      sequence = file->sequence;
-      if (current_pos <= target_pos
-          && target_pos < current_pos + file->duration) {
-        break;
-      }
-      current_pos += file->duration;
-    }
-    /* End of playlist */
-    if (!walk)
-      sequence++;
-    demux->client->sequence = sequence;
-    demux->client->sequence_position = current_pos;
     GST_M3U8_CLIENT_UNLOCK (demux->client);
+
+    gst_m3u8_client_seek (demux->client, target_pos);
   }
 
   return updated;
@@ -1155,44 +1164,52 @@ retry_failover_protection:
 
 #if defined(HAVE_OPENSSL)
 static gboolean
-gst_hls_demux_decrypt_start (GstHLSDemux * demux, const guint8 * key_data,
+decrypt_init (GstHLSDemux * demux, const guint8 * key_data,
     const guint8 * iv_data)
 {
   EVP_CIPHER_CTX_init (&demux->aes_ctx);
   if (!EVP_DecryptInit_ex (&demux->aes_ctx, EVP_aes_128_cbc (), NULL, key_data,
-          iv_data))
+          iv_data)) {
+    EVP_CIPHER_CTX_cleanup (&demux->aes_ctx);
     return FALSE;
+  }
   EVP_CIPHER_CTX_set_padding (&demux->aes_ctx, 0);
   return TRUE;
 }
 
 static gboolean
-decrypt_fragment (GstHLSDemux * demux, gsize length,
-    const guint8 * encrypted_data, guint8 * decrypted_data)
+decrypt_set_iv (GstHLSDemux * demux, const guint8 * iv_data)
 {
-  int len, flen = 0;
+  /* NULL cipher and key keep the current ones and their key schedule */
+  return EVP_DecryptInit_ex (&demux->aes_ctx, NULL, NULL, NULL, iv_data);
+}
+
+static gboolean
+decrypt_fragment (GstHLSDemux * demux, gsize length, guint8 * data)
+{
+  int len;
 
   if (G_UNLIKELY (length > G_MAXINT || length % 16 != 0))
     return FALSE;
 
+  /* without padding the context keeps no data back, the last block of
+   * ciphertext is kept as the IV of the next call */
   len = (int) length;
-  if (!EVP_DecryptUpdate (&demux->aes_ctx, decrypted_data, &len, encrypted_data,
-          len))
+  if (!EVP_DecryptUpdate (&demux->aes_ctx, data, &len, data, len))
     return FALSE;
-  EVP_DecryptFinal_ex (&demux->aes_ctx, decrypted_data + len, &flen);
-  g_return_val_if_fail (len + flen == length, FALSE);
+  g_return_val_if_fail (len == length, FALSE);
   return TRUE;
 }
 
 static void
-gst_hls_demux_decrypt_end (GstHLSDemux * demux)
+decrypt_cleanup (GstHLSDemux * demux)
 {
   EVP_CIPHER_CTX_cleanup (&demux->aes_ctx);
 }
 
 #elif defined(HAVE_NETTLE)
 static gboolean
-gst_hls_demux_decrypt_start (GstHLSDemux * demux, const guint8 * key_data,
+decrypt_init (GstHLSDemux * demux, const guint8 * key_data,
     const guint8 * iv_data)
 {
   aes_set_decrypt_key (&demux->aes_ctx.ctx, 16, key_data);
@@ -1202,27 +1219,33 @@ gst_hls_demux_decrypt_start (GstHLSDemux * demux, const guint8 * key_data,
 }
 
 static gboolean
-decrypt_fragment (GstHLSDemux * demux, gsize length,
-    const guint8 * encrypted_data, guint8 * decrypted_data)
+decrypt_set_iv (GstHLSDemux * demux, const guint8 * iv_data)
+{
+  CBC_SET_IV (&demux->aes_ctx, iv_data);
+
+  return TRUE;
+}
+
+static gboolean
+decrypt_fragment (GstHLSDemux * demux, gsize length, guint8 * data)
 {
   if (length % 16 != 0)
     return FALSE;
 
-  CBC_DECRYPT (&demux->aes_ctx, aes_decrypt, length, decrypted_data,
-      encrypted_data);
+  CBC_DECRYPT (&demux->aes_ctx, aes_decrypt, length, data, data);
 
   return TRUE;
 }
 
 static void
-gst_hls_demux_decrypt_end (GstHLSDemux * demux)
+decrypt_cleanup (GstHLSDemux * demux)
 {
   /* NOP */
 }
 
 #else
 static gboolean
-gst_hls_demux_decrypt_start (GstHLSDemux * demux, const guint8 * key_data,
+decrypt_init (GstHLSDemux * demux, const guint8 * key_data,
     const guint8 * iv_data)
 {
   gcry_error_t err = 0;
@@ -1241,27 +1264,33 @@ gst_hls_demux_decrypt_start (GstHLSDemux * demux, const guint8 * key_data,
     ret = TRUE;
 
 out:
-  if (!ret)
-    if (demux->aes_ctx)
-      gcry_cipher_close (demux->aes_ctx);
+  if (!ret && demux->aes_ctx) {
+    gcry_cipher_close (demux->aes_ctx);
+    demux->aes_ctx = NULL;
+  }
 
   return ret;
 }
 
 static gboolean
-decrypt_fragment (GstHLSDemux * demux, gsize length,
-    const guint8 * encrypted_data, guint8 * decrypted_data)
+decrypt_set_iv (GstHLSDemux * demux, const guint8 * iv_data)
+{
+  return gcry_cipher_setiv (demux->aes_ctx, iv_data, 16) == 0;
+}
+
+static gboolean
+decrypt_fragment (GstHLSDemux * demux, gsize length, guint8 * data)
 {
   gcry_error_t err = 0;
 
-  err = gcry_cipher_decrypt (demux->aes_ctx, decrypted_data, length,
-      encrypted_data, length);
+  /* a NULL input decrypts the output buffer in place */
+  err = gcry_cipher_decrypt (demux->aes_ctx, data, length, NULL, 0);
 
   return err == 0;
 }
 
 static void
-gst_hls_demux_decrypt_end (GstHLSDemux * demux)
+decrypt_cleanup (GstHLSDemux * demux)
 {
   if (demux->aes_ctx) {
     gcry_cipher_close (demux->aes_ctx);
@@ -1270,42 +1299,109 @@ gst_hls_demux_decrypt_end (GstHLSDemux * demux)
 }
 #endif
 
+/* Sets up the cipher for a fragment. Consecutive fragments of the same key
+ * keep the expanded key and only restart the chaining from their IV */
+static gboolean
+gst_hls_demux_decrypt_start (GstHLSDemux * demux, const guint8 * key_data,
+    const guint8 * iv_data)
+{
+  if (demux->aes_ctx_ready && memcmp (demux->aes_key, key_data, 16) == 0) {
+    if (decrypt_set_iv (demux, iv_data))
+      return TRUE;
+    GST_WARNING_OBJECT (demux, "Failed to reset the IV, setting up the key");
+  }
+
+  gst_hls_demux_decrypt_end (demux);
+  if (!decrypt_init (demux, key_data, iv_data))
+    return FALSE;
+
+  GST_DEBUG_OBJECT (demux, "Set up decryption with a new key");
+  memcpy (demux->aes_key, key_data, 16);
+  demux->aes_ctx_ready = TRUE;
+  return TRUE;
+}
+
+static void
+gst_hls_demux_decrypt_end (GstHLSDemux * demux)
+{
+  if (!demux->aes_ctx_ready)
+    return;
+
+  decrypt_cleanup (demux);
+  demux->aes_ctx_ready = FALSE;
+}
+
+/* Drops the keys the current playlist doesn't refer to anymore */
+static void
+gst_hls_demux_prune_keys (GstHLSDemux * demux)
+{
+  GHashTable *in_use;
+  GHashTableIter iter;
+  gpointer key;
+  guint i;
+
+  GST_OBJECT_LOCK (demux);
+  if (g_hash_table_size (demux->keys) == 0) {
+    GST_OBJECT_UNLOCK (demux);
+    return;
+  }
+
+  in_use = g_hash_table_new (g_str_hash, g_str_equal);
+
+  GST_M3U8_CLIENT_LOCK (demux->client);
+  if (demux->client->current) {
+    for (i = 0; i < demux->client->current->files->len; i++) {
+      GstM3U8MediaFile *file = g_ptr_array_index (demux->client->current->files,
+          i);
+
+      if (file->key)
+        g_hash_table_add (in_use, file->key);
+    }
+  }
+
+  g_hash_table_iter_init (&iter, demux->keys);
+  while (g_hash_table_iter_next (&iter, &key, NULL)) {
+    if (!g_hash_table_contains (in_use, key)) {
+      GST_DEBUG_OBJECT (demux, "Key %s left the playlist", (gchar *) key);
+      g_hash_table_iter_remove (&iter);
+    }
+  }
+  GST_M3U8_CLIENT_UNLOCK (demux->client);
+  GST_OBJECT_UNLOCK (demux);
+
+  g_hash_table_unref (in_use);
+}
+
+/* Decrypts @encrypted_buffer in place. The CBC state stays in the cipher
+ * context, so consecutive buffers of a fragment chain without keeping
+ * a copy of their last block */
 static GstBuffer *
 gst_hls_demux_decrypt_fragment (GstHLSDemux * demux,
     GstBuffer * encrypted_buffer, GError ** err)
 {
-  GstBuffer *decrypted_buffer = NULL;
-  GstMapInfo encrypted_info, decrypted_info;
-
-  decrypted_buffer =
-      gst_buffer_new_allocate (NULL, gst_buffer_get_size (encrypted_buffer),
-      NULL);
+  GstBuffer *buffer;
+  GstMapInfo info;
 
-  gst_buffer_map (encrypted_buffer, &encrypted_info, GST_MAP_READ);
-  gst_buffer_map (decrypted_buffer, &decrypted_info, GST_MAP_WRITE);
+  /* only copies the memory if it is shared with another buffer */
+  buffer = gst_buffer_make_writable (encrypted_buffer);
+  if (!gst_buffer_map (buffer, &info, GST_MAP_READWRITE))
+    goto map_error;
 
-  if (!decrypt_fragment (demux, encrypted_info.size,
-          encrypted_info.data, decrypted_info.data))
+  if (!decrypt_fragment (demux, info.size, info.data))
     goto decrypt_error;
 
+  gst_buffer_unmap (buffer, &info);
 
-  gst_buffer_unmap (decrypted_buffer, &decrypted_info);
-  gst_buffer_unmap (encrypted_buffer, &encrypted_info);
-
-  gst_buffer_unref (encrypted_buffer);
-
-  return decrypted_buffer;
+  return buffer;
 
 decrypt_error:
+  gst_buffer_unmap (buffer, &info);
+map_error:
   GST_ERROR_OBJECT (demux, "Failed to decrypt fragment");
   g_set_error (err, GST_STREAM_ERROR, GST_STREAM_ERROR_DECRYPT,
       "Failed to decrypt fragment");
 
-  gst_buffer_unmap (decrypted_buffer, &decrypted_info);
-  gst_buffer_unmap (encrypted_buffer, &encrypted_info);
-
-  gst_buffer_unref (encrypted_buffer);
-  gst_buffer_unref (decrypted_buffer);
+  gst_buffer_unref (buffer);
 
   return NULL;
 }
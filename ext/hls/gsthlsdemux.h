@@ -81,9 +81,8 @@ struct _GstHLSDemux
   /* Streaming task */
   gint64 next_download;
 
-  /* Cache for the last key */
-  gchar *key_url;
-  GstFragment *key_fragment;
+  /* Keys of the current playlist window, key URI -> GstBuffer */
+  GHashTable *keys;
 
   /* decryption tooling */
 #if defined(HAVE_OPENSSL)
@@ -93,6 +92,8 @@ struct _GstHLSDemux
 #else
   gcry_cipher_hd_t aes_ctx;
 #endif
+  gboolean aes_ctx_ready;       /* aes_ctx is set up with aes_key */
+  guint8 aes_key[16];
   gchar *current_key;
   guint8 *current_iv;
   GstBuffer *pending_buffer; /* decryption scenario:
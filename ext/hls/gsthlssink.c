@@ -28,6 +28,20 @@
  * gst-launch-1.0 videotestsrc is-live=true ! x264enc ! mpegtsmux ! hlssink max-files=5
  * ]|
  * </refsect2>
+ *
+ * With #GstHlsSink:part-duration set, the segments are also announced as
+ * low-latency HLS partial segments while they are being written. The parts
+ * are byte ranges of the segment, so they don't need files of their own, and
+ * a HTTP server can implement blocking playlist reloads with the
+ * #GstHlsSink::get-playlist action signal.
+ *
+ * #GstHlsSink:output selects where the segments and the playlist go: files
+ * on disk, memory (read back with #GstHlsSink::get-fragment) or the
+ * #GstHlsSink::write-data and #GstHlsSink::write-playlist signals.
+ *
+ * #GstHlsSink:output and #GstHlsSink:part-duration can only be changed in
+ * the NULL and READY states, they are taken into account when going to
+ * PAUSED.
  */
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -50,6 +64,8 @@ GST_DEBUG_CATEGORY_STATIC (gst_hls_sink_debug);
 #define DEFAULT_MAX_FILES 10
 #define DEFAULT_TARGET_DURATION 15
 #define DEFAULT_PLAYLIST_LENGTH 5
+#define DEFAULT_PART_DURATION 0
+#define DEFAULT_OUTPUT GST_HLS_SINK_OUTPUT_FILE
 
 enum
 {
@@ -59,9 +75,55 @@ enum
   PROP_PLAYLIST_ROOT,
   PROP_MAX_FILES,
   PROP_TARGET_DURATION,
-  PROP_PLAYLIST_LENGTH
+  PROP_PLAYLIST_LENGTH,
+  PROP_PART_DURATION,
+  PROP_OUTPUT
+};
+
+enum
+{
+  SIGNAL_WRITE_DATA,
+  SIGNAL_WRITE_PLAYLIST,
+  SIGNAL_DELETE_FRAGMENT,
+  SIGNAL_GET_PLAYLIST,
+  SIGNAL_GET_FRAGMENT,
+  LAST_SIGNAL
 };
 
+static guint gst_hls_sink_signals[LAST_SIGNAL] = { 0 };
+
+/* Where the segments and the playlist are written when hlssink writes the
+ * segments itself */
+struct _GstHlsSinkWriter
+{
+  gboolean (*open) (GstHlsSink * sink);
+  gboolean (*write) (GstHlsSink * sink, GstBuffer * buffer);
+  void (*flush) (GstHlsSink * sink);
+  void (*close) (GstHlsSink * sink);
+  void (*write_playlist) (GstHlsSink * sink, const gchar * content);
+  void (*remove) (GstHlsSink * sink, const gchar * location);
+};
+
+#define GST_TYPE_HLS_SINK_OUTPUT (gst_hls_sink_output_get_type ())
+static GType
+gst_hls_sink_output_get_type (void)
+{
+  static GType output_type = 0;
+  static const GEnumValue output_types[] = {
+    {GST_HLS_SINK_OUTPUT_FILE, "Write segments and playlist to files", "file"},
+    {GST_HLS_SINK_OUTPUT_MEMORY, "Keep segments and playlist in memory",
+        "memory"},
+    {GST_HLS_SINK_OUTPUT_CALLBACK, "Hand segments and playlist to signals",
+        "callback"},
+    {0, NULL, NULL}
+  };
+
+  if (!output_type) {
+    output_type = g_enum_register_static ("GstHlsSinkOutput", output_types);
+  }
+  return output_type;
+}
+
 static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
     GST_PAD_SINK,
     GST_PAD_ALWAYS,
@@ -83,6 +145,14 @@ static void gst_hls_sink_reset (GstHlsSink * sink);
 static GstStateChangeReturn
 gst_hls_sink_change_state (GstElement * element, GstStateChange trans);
 static gboolean schedule_next_key_unit (GstHlsSink * sink);
+static GstPadProbeReturn gst_hls_sink_ghost_data_probe (GstPad * pad,
+    GstPadProbeInfo * info, gpointer data);
+static void gst_hls_sink_close_segment (GstHlsSink * sink, GstClockTime end);
+static void gst_hls_sink_write_playlist (GstHlsSink * sink);
+static gchar *gst_hls_sink_get_playlist (GstHlsSink * sink, gint64 msn,
+    gint part, GstClockTime timeout);
+static GBytes *gst_hls_sink_get_fragment (GstHlsSink * sink,
+    const gchar * location);
 
 static void
 gst_hls_sink_dispose (GObject * object)
@@ -102,6 +172,13 @@ gst_hls_sink_finalize (GObject * object)
   g_free (sink->playlist_root);
   if (sink->playlist)
     gst_m3u8_playlist_free (sink->playlist);
+  g_free (sink->segment_location);
+  g_queue_foreach (&sink->old_segments, (GFunc) g_free, NULL);
+  g_queue_clear (&sink->old_segments);
+  g_hash_table_destroy (sink->fragments);
+  g_free (sink->playlist_content);
+  g_mutex_clear (&sink->lock);
+  g_cond_clear (&sink->cond);
 
   G_OBJECT_CLASS (parent_class)->finalize ((GObject *) sink);
 }
@@ -164,6 +241,89 @@ gst_hls_sink_class_init (GstHlsSinkClass * klass)
           "of the HLS specification, this should be at least 3.",
           1, G_MAXUINT, DEFAULT_PLAYLIST_LENGTH,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_PART_DURATION,
+      g_param_spec_uint ("part-duration", "Part duration",
+          "The duration in milliseconds of the low-latency partial segments "
+          "(0 - disabled)", 0, G_MAXUINT, DEFAULT_PART_DURATION,
+          G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY |
+          G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_OUTPUT,
+      g_param_spec_enum ("output", "Output",
+          "Where to write the segments and the playlist",
+          GST_TYPE_HLS_SINK_OUTPUT, DEFAULT_OUTPUT,
+          G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY |
+          G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstHlsSink::write-data:
+   * @sink: the #GstHlsSink
+   * @location: the location of the segment
+   * @buffer: the data to append to the segment
+   *
+   * Emitted with output=callback for the data of the segments.
+   */
+  gst_hls_sink_signals[SIGNAL_WRITE_DATA] =
+      g_signal_new ("write-data", G_TYPE_FROM_CLASS (klass), G_SIGNAL_RUN_LAST,
+      0, NULL, NULL, g_cclosure_marshal_generic, G_TYPE_NONE, 2,
+      G_TYPE_STRING, GST_TYPE_BUFFER);
+  /**
+   * GstHlsSink::write-playlist:
+   * @sink: the #GstHlsSink
+   * @location: the location of the playlist
+   * @content: the playlist
+   *
+   * Emitted with output=callback every time the playlist changes.
+   */
+  gst_hls_sink_signals[SIGNAL_WRITE_PLAYLIST] =
+      g_signal_new ("write-playlist", G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST, 0, NULL, NULL, g_cclosure_marshal_generic,
+      G_TYPE_NONE, 2, G_TYPE_STRING, G_TYPE_STRING);
+  /**
+   * GstHlsSink::delete-fragment:
+   * @sink: the #GstHlsSink
+   * @location: the location of the segment
+   *
+   * Emitted with output=callback when a segment is no longer needed.
+   */
+  gst_hls_sink_signals[SIGNAL_DELETE_FRAGMENT] =
+      g_signal_new ("delete-fragment", G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST, 0, NULL, NULL, g_cclosure_marshal_generic,
+      G_TYPE_NONE, 1, G_TYPE_STRING);
+  /**
+   * GstHlsSink::get-playlist:
+   * @sink: the #GstHlsSink
+   * @msn: the media sequence number to wait for, or -1
+   * @part: the part of @msn to wait for, or -1 for the whole segment
+   * @timeout: how long to wait, in nanoseconds
+   *
+   * Blocking playlist reload: waits until the playlist contains the requested
+   * segment or part and returns it.
+   *
+   * Returns: the playlist, or %NULL on timeout or when the element stops.
+   */
+  gst_hls_sink_signals[SIGNAL_GET_PLAYLIST] =
+      g_signal_new ("get-playlist", G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+      G_STRUCT_OFFSET (GstHlsSinkClass, get_playlist), NULL, NULL,
+      g_cclosure_marshal_generic, G_TYPE_STRING, 3, G_TYPE_INT64, G_TYPE_INT,
+      G_TYPE_UINT64);
+  /**
+   * GstHlsSink::get-fragment:
+   * @sink: the #GstHlsSink
+   * @location: the location of the segment
+   *
+   * Returns the data written so far for a segment with output=memory.
+   *
+   * Returns: the data, or %NULL if the segment is unknown.
+   */
+  gst_hls_sink_signals[SIGNAL_GET_FRAGMENT] =
+      g_signal_new ("get-fragment", G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+      G_STRUCT_OFFSET (GstHlsSinkClass, get_fragment), NULL, NULL,
+      g_cclosure_marshal_generic, G_TYPE_BYTES, 1, G_TYPE_STRING);
+
+  klass->get_playlist = gst_hls_sink_get_playlist;
+  klass->get_fragment = gst_hls_sink_get_fragment;
 }
 
 static void
@@ -177,6 +337,9 @@ gst_hls_sink_init (GstHlsSink * sink)
       gst_hls_sink_ghost_event_probe, sink, NULL);
   gst_pad_add_probe (sink->ghostpad, GST_PAD_PROBE_TYPE_BUFFER,
       gst_hls_sink_ghost_buffer_probe, sink, NULL);
+  gst_pad_add_probe (sink->ghostpad,
+      GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+      gst_hls_sink_ghost_data_probe, sink, NULL);
 
   sink->location = g_strdup (DEFAULT_LOCATION);
   sink->playlist_location = g_strdup (DEFAULT_PLAYLIST_LOCATION);
@@ -184,6 +347,14 @@ gst_hls_sink_init (GstHlsSink * sink)
   sink->playlist_length = DEFAULT_PLAYLIST_LENGTH;
   sink->max_files = DEFAULT_MAX_FILES;
   sink->target_duration = DEFAULT_TARGET_DURATION;
+  sink->part_duration = DEFAULT_PART_DURATION;
+  sink->output = DEFAULT_OUTPUT;
+  g_queue_init (&sink->old_segments);
+  g_mutex_init (&sink->lock);
+  g_cond_init (&sink->cond);
+  sink->flushing = TRUE;
+  sink->fragments = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      (GDestroyNotify) g_byte_array_unref);
 
   /* haven't added a sink yet, make it is detected as a sink meanwhile */
   GST_OBJECT_FLAG_SET (sink, GST_ELEMENT_FLAG_SINK);
@@ -205,45 +376,302 @@ gst_hls_sink_reset (GstHlsSink * sink)
   if (sink->playlist)
     gst_m3u8_playlist_free (sink->playlist);
   sink->playlist = gst_m3u8_playlist_new (6, sink->playlist_length, FALSE);
+  sink->playlist->part_target = sink->part_duration * GST_MSECOND;
+
+  if (sink->segment_file) {
+    fclose (sink->segment_file);
+    sink->segment_file = NULL;
+  }
+  g_free (sink->segment_location);
+  sink->segment_location = NULL;
+  sink->segment_index = 0;
+  sink->segment_offset = 0;
+  sink->segment_start = 0;
+  sink->part_offset = 0;
+  sink->part_start = 0;
+  sink->part_independent = FALSE;
+  sink->split_pending = FALSE;
+  sink->last_buffer_end = 0;
+  g_queue_foreach (&sink->old_segments, (GFunc) g_free, NULL);
+  g_queue_clear (&sink->old_segments);
+
+  g_mutex_lock (&sink->lock);
+  g_hash_table_remove_all (sink->fragments);
+  g_free (sink->playlist_content);
+  sink->playlist_content = NULL;
+  sink->published_msn = 0;
+  sink->published_parts = 0;
+  g_cond_broadcast (&sink->cond);
+  g_mutex_unlock (&sink->lock);
+}
+
+static gboolean
+gst_hls_sink_file_open (GstHlsSink * sink)
+{
+  sink->segment_file = g_fopen (sink->segment_location, "wb");
+  if (sink->segment_file == NULL) {
+    GST_ELEMENT_ERROR (sink, RESOURCE, OPEN_WRITE,
+        (("Could not open file \"%s\" for writing."), sink->segment_location),
+        GST_ERROR_SYSTEM);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+gst_hls_sink_file_write (GstHlsSink * sink, GstBuffer * buffer)
+{
+  GstMapInfo map;
+  gboolean ret = TRUE;
+
+  gst_buffer_map (buffer, &map, GST_MAP_READ);
+  if (map.size > 0 && fwrite (map.data, map.size, 1, sink->segment_file) != 1) {
+    GST_ELEMENT_ERROR (sink, RESOURCE, WRITE,
+        (("Error while writing to file \"%s\"."), sink->segment_location),
+        GST_ERROR_SYSTEM);
+    ret = FALSE;
+  }
+  gst_buffer_unmap (buffer, &map);
+
+  return ret;
+}
+
+static void
+gst_hls_sink_file_flush (GstHlsSink * sink)
+{
+  /* parts are announced once they can be read from the file */
+  fflush (sink->segment_file);
+}
+
+static void
+gst_hls_sink_file_close (GstHlsSink * sink)
+{
+  fclose (sink->segment_file);
+  sink->segment_file = NULL;
+}
+
+static void
+gst_hls_sink_file_write_playlist (GstHlsSink * sink, const gchar * content)
+{
+  GError *error = NULL;
+
+  if (!g_file_set_contents (sink->playlist_location, content, -1, &error)) {
+    GST_ERROR ("Failed to write playlist: %s", error->message);
+    GST_ELEMENT_ERROR (sink, RESOURCE, OPEN_WRITE,
+        (("Failed to write playlist '%s'."), error->message), (NULL));
+    g_error_free (error);
+  }
+}
+
+static void
+gst_hls_sink_file_remove (GstHlsSink * sink, const gchar * location)
+{
+  g_remove (location);
+}
+
+static gboolean
+gst_hls_sink_memory_open (GstHlsSink * sink)
+{
+  g_mutex_lock (&sink->lock);
+  g_hash_table_insert (sink->fragments, g_strdup (sink->segment_location),
+      g_byte_array_new ());
+  g_mutex_unlock (&sink->lock);
+
+  return TRUE;
+}
+
+static gboolean
+gst_hls_sink_memory_write (GstHlsSink * sink, GstBuffer * buffer)
+{
+  GByteArray *data;
+  GstMapInfo map;
+
+  gst_buffer_map (buffer, &map, GST_MAP_READ);
+  g_mutex_lock (&sink->lock);
+  data = g_hash_table_lookup (sink->fragments, sink->segment_location);
+  g_byte_array_append (data, map.data, map.size);
+  g_mutex_unlock (&sink->lock);
+  gst_buffer_unmap (buffer, &map);
+
+  return TRUE;
+}
+
+static void
+gst_hls_sink_memory_write_playlist (GstHlsSink * sink, const gchar * content)
+{
+  /* the playlist is published by gst_hls_sink_write_playlist() */
+}
+
+static void
+gst_hls_sink_memory_remove (GstHlsSink * sink, const gchar * location)
+{
+  g_mutex_lock (&sink->lock);
+  g_hash_table_remove (sink->fragments, location);
+  g_mutex_unlock (&sink->lock);
+}
+
+static gboolean
+gst_hls_sink_callback_write (GstHlsSink * sink, GstBuffer * buffer)
+{
+  g_signal_emit (sink, gst_hls_sink_signals[SIGNAL_WRITE_DATA], 0,
+      sink->segment_location, buffer);
+
+  return TRUE;
+}
+
+static void
+gst_hls_sink_callback_write_playlist (GstHlsSink * sink, const gchar * content)
+{
+  g_signal_emit (sink, gst_hls_sink_signals[SIGNAL_WRITE_PLAYLIST], 0,
+      sink->playlist_location, content);
+}
+
+static void
+gst_hls_sink_callback_remove (GstHlsSink * sink, const gchar * location)
+{
+  g_signal_emit (sink, gst_hls_sink_signals[SIGNAL_DELETE_FRAGMENT], 0,
+      location);
+}
+
+/* indexed by GstHlsSinkOutput */
+static const GstHlsSinkWriter gst_hls_sink_writers[] = {
+  {gst_hls_sink_file_open, gst_hls_sink_file_write, gst_hls_sink_file_flush,
+      gst_hls_sink_file_close, gst_hls_sink_file_write_playlist,
+      gst_hls_sink_file_remove},
+  {gst_hls_sink_memory_open, gst_hls_sink_memory_write, NULL, NULL,
+        gst_hls_sink_memory_write_playlist, gst_hls_sink_memory_remove},
+  {NULL, gst_hls_sink_callback_write, NULL, NULL,
+        gst_hls_sink_callback_write_playlist, gst_hls_sink_callback_remove}
+};
+
+static void
+gst_hls_sink_remove_elements (GstHlsSink * sink)
+{
+  GstElement *element;
+
+  element = sink->multifilesink ? sink->multifilesink : sink->fakesink;
+  if (element == NULL)
+    return;
+
+  GST_DEBUG_OBJECT (sink, "Removing internal elements");
+
+  gst_ghost_pad_set_target (GST_GHOST_PAD (sink->ghostpad), NULL);
+  gst_element_set_state (element, GST_STATE_NULL);
+  gst_bin_remove (GST_BIN_CAST (sink), element);
+  sink->multifilesink = NULL;
+  sink->fakesink = NULL;
+  sink->elements_created = FALSE;
 }
 
 static gboolean
 gst_hls_sink_create_elements (GstHlsSink * sink)
 {
   GstPad *pad = NULL;
+  GstElement *element;
+  const gchar *name;
 
-  GST_DEBUG_OBJECT (sink, "Creating internal elements");
+  gboolean use_multifilesink;
 
-  if (sink->elements_created)
-    return TRUE;
+  /* multifilesink can only write whole segments to files, otherwise the
+   * buffers are written from the ghost pad probe and dropped in a fakesink */
+  use_multifilesink = sink->output == GST_HLS_SINK_OUTPUT_FILE &&
+      sink->part_duration == 0;
+
+  if (sink->elements_created) {
+    if (use_multifilesink == (sink->multifilesink != NULL))
+      goto done;
+
+    /* output or part-duration changed since the elements were created */
+    gst_hls_sink_remove_elements (sink);
+  }
 
-  sink->multifilesink = gst_element_factory_make ("multifilesink", NULL);
-  if (sink->multifilesink == NULL)
-    goto missing_element;
+  GST_DEBUG_OBJECT (sink, "Creating internal elements");
 
-  g_object_set (sink->multifilesink, "location", sink->location,
-      "next-file", 3, "post-messages", TRUE, "max-files", sink->max_files,
-      NULL);
+  if (use_multifilesink) {
+    name = "multifilesink";
+    element = sink->multifilesink = gst_element_factory_make (name, NULL);
+    if (element == NULL)
+      goto missing_element;
+
+    g_object_set (sink->multifilesink, "location", sink->location,
+        "next-file", 3, "post-messages", TRUE, "max-files", sink->max_files,
+        NULL);
+  } else {
+    name = "fakesink";
+    element = sink->fakesink = gst_element_factory_make (name, NULL);
+    if (element == NULL)
+      goto missing_element;
+
+    g_object_set (sink->fakesink, "sync", FALSE, "async", FALSE, NULL);
+  }
 
-  gst_bin_add (GST_BIN_CAST (sink), sink->multifilesink);
+  gst_bin_add (GST_BIN_CAST (sink), element);
 
-  pad = gst_element_get_static_pad (sink->multifilesink, "sink");
+  pad = gst_element_get_static_pad (element, "sink");
   gst_ghost_pad_set_target (GST_GHOST_PAD (sink->ghostpad), pad);
   gst_object_unref (pad);
 
   sink->elements_created = TRUE;
+
+done:
+  sink->writer = &gst_hls_sink_writers[sink->output];
   return TRUE;
 
 missing_element:
   gst_element_post_message (GST_ELEMENT_CAST (sink),
-      gst_missing_element_message_new (GST_ELEMENT_CAST (sink),
-          "multifilesink"));
+      gst_missing_element_message_new (GST_ELEMENT_CAST (sink), name));
   GST_ELEMENT_ERROR (sink, CORE, MISSING_PLUGIN,
       (("Missing element '%s' - check your GStreamer installation."),
-          "multifilesink"), (NULL));
+          name), (NULL));
   return FALSE;
 }
 
+/* Location of a segment as written in the playlist */
+static gchar *
+gst_hls_sink_entry_location (GstHlsSink * sink, const gchar * location)
+{
+  gchar *name, *entry_location;
+
+  name = g_path_get_basename (location);
+  if (sink->playlist_root == NULL)
+    return name;
+
+  entry_location = g_build_filename (sink->playlist_root, name, NULL);
+  g_free (name);
+  return entry_location;
+}
+
+/* Renders the playlist, hands it to the output and wakes up the blocking
+ * playlist requests */
+static void
+gst_hls_sink_write_playlist (GstHlsSink * sink)
+{
+  gchar *playlist_content;
+
+  if (sink->part_duration > 0) {
+    gchar *entry_location = NULL;
+
+    if (sink->segment_location)
+      entry_location = gst_hls_sink_entry_location (sink,
+          sink->segment_location);
+    gst_m3u8_playlist_set_preload_hint (sink->playlist, entry_location,
+        sink->part_offset);
+    g_free (entry_location);
+  }
+
+  playlist_content = gst_m3u8_playlist_render (sink->playlist);
+  sink->writer->write_playlist (sink, playlist_content);
+
+  g_mutex_lock (&sink->lock);
+  g_free (sink->playlist_content);
+  sink->playlist_content = playlist_content;
+  sink->published_msn = sink->playlist->sequence_number;
+  sink->published_parts = gst_m3u8_playlist_n_parts (sink->playlist);
+  g_cond_broadcast (&sink->cond);
+  g_mutex_unlock (&sink->lock);
+}
+
 static void
 gst_hls_sink_handle_message (GstBin * bin, GstMessage * message)
 {
@@ -254,10 +682,8 @@ gst_hls_sink_handle_message (GstBin * bin, GstMessage * message)
     {
       GFile *file;
       const char *filename;
-      char *playlist_content;
       GstClockTime running_time, duration;
       gboolean discont = FALSE;
-      GError *error = NULL;
       gchar *entry_location;
       const GstStructure *structure;
 
@@ -272,27 +698,12 @@ gst_hls_sink_handle_message (GstBin * bin, GstMessage * message)
 
       file = g_file_new_for_path (filename);
       GST_INFO_OBJECT (sink, "COUNT %d", sink->index);
-      if (sink->playlist_root == NULL)
-        entry_location = g_path_get_basename (filename);
-      else {
-        gchar *name = g_path_get_basename (filename);
-        entry_location = g_build_filename (sink->playlist_root, name, NULL);
-        g_free (name);
-      }
+      entry_location = gst_hls_sink_entry_location (sink, filename);
 
       gst_m3u8_playlist_add_entry (sink->playlist, entry_location, file,
           NULL, duration, sink->index, discont);
       g_free (entry_location);
-      playlist_content = gst_m3u8_playlist_render (sink->playlist);
-      if (!g_file_set_contents (sink->playlist_location,
-              playlist_content, -1, &error)) {
-        GST_ERROR ("Failed to write playlist: %s", error->message);
-        GST_ELEMENT_ERROR (sink, RESOURCE, OPEN_WRITE,
-            (("Failed to write playlist '%s'."), error->message), (NULL));
-        g_error_free (error);
-        error = NULL;
-      }
-      g_free (playlist_content);
+      gst_hls_sink_write_playlist (sink);
 
       /* multifilesink is starting a new file. It means that upstream sent a key
        * unit and we can schedule the next key unit now.
@@ -327,6 +738,22 @@ gst_hls_sink_change_state (GstElement * element, GstStateChange trans)
         return GST_STATE_CHANGE_FAILURE;
       }
       break;
+    case GST_STATE_CHANGE_READY_TO_PAUSED:
+      /* output and part-duration may have changed in READY */
+      if (!gst_hls_sink_create_elements (sink)) {
+        return GST_STATE_CHANGE_FAILURE;
+      }
+      g_mutex_lock (&sink->lock);
+      sink->flushing = FALSE;
+      g_mutex_unlock (&sink->lock);
+      break;
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      /* release the blocking playlist requests */
+      g_mutex_lock (&sink->lock);
+      sink->flushing = TRUE;
+      g_cond_broadcast (&sink->cond);
+      g_mutex_unlock (&sink->lock);
+      break;
     case GST_STATE_CHANGE_PAUSED_TO_PLAYING:
       break;
     default:
@@ -351,6 +778,20 @@ gst_hls_sink_change_state (GstElement * element, GstStateChange trans)
   return ret;
 }
 
+/* whether the element is in NULL or READY */
+static gboolean
+gst_hls_sink_is_stopped (GstHlsSink * sink)
+{
+  gboolean stopped;
+
+  GST_OBJECT_LOCK (sink);
+  stopped = GST_STATE (sink) <= GST_STATE_READY &&
+      GST_STATE_PENDING (sink) <= GST_STATE_READY;
+  GST_OBJECT_UNLOCK (sink);
+
+  return stopped;
+}
+
 static void
 gst_hls_sink_set_property (GObject * object, guint prop_id,
     const GValue * value, GParamSpec * pspec)
@@ -387,6 +828,23 @@ gst_hls_sink_set_property (GObject * object, guint prop_id,
       sink->playlist_length = g_value_get_uint (value);
       sink->playlist->window_size = sink->playlist_length;
       break;
+    case PROP_PART_DURATION:
+      if (!gst_hls_sink_is_stopped (sink)) {
+        GST_WARNING_OBJECT (sink, "part-duration can only be changed in NULL or "
+            "READY");
+        break;
+      }
+      sink->part_duration = g_value_get_uint (value);
+      sink->playlist->part_target = sink->part_duration * GST_MSECOND;
+      break;
+    case PROP_OUTPUT:
+      if (!gst_hls_sink_is_stopped (sink)) {
+        GST_WARNING_OBJECT (sink, "output can only be changed in NULL or "
+            "READY");
+        break;
+      }
+      sink->output = g_value_get_enum (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -418,6 +876,12 @@ gst_hls_sink_get_property (GObject * object, guint prop_id,
     case PROP_PLAYLIST_LENGTH:
       g_value_set_uint (value, sink->playlist_length);
       break;
+    case PROP_PART_DURATION:
+      g_value_set_uint (value, sink->part_duration);
+      break;
+    case PROP_OUTPUT:
+      g_value_set_enum (value, sink->output);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -440,6 +904,12 @@ gst_hls_sink_ghost_event_probe (GstPad * pad, GstPadProbeInfo * info,
     case GST_EVENT_FLUSH_STOP:
       gst_segment_init (&sink->segment, GST_FORMAT_UNDEFINED);
       break;
+    case GST_EVENT_EOS:
+      if (sink->fakesink && sink->segment_location) {
+        gst_hls_sink_close_segment (sink, sink->last_buffer_end);
+        gst_hls_sink_write_playlist (sink);
+      }
+      break;
     case GST_EVENT_CUSTOM_DOWNSTREAM:
     {
       GstClockTime timestamp;
@@ -455,6 +925,8 @@ gst_hls_sink_ghost_event_probe (GstPad * pad, GstPadProbeInfo * info,
           &timestamp, &stream_time, &running_time, &all_headers, &count);
       GST_INFO_OBJECT (sink, "setting index %d", count);
       sink->index = count;
+      /* the next buffer starts a new segment */
+      sink->split_pending = TRUE;
       break;
     }
     default:
@@ -516,6 +988,216 @@ gst_hls_sink_ghost_buffer_probe (GstPad * pad, GstPadProbeInfo * info,
   return GST_PAD_PROBE_OK;
 }
 
+/* Announces the data written since the last part as a new part */
+static void
+gst_hls_sink_close_part (GstHlsSink * sink, GstClockTime end)
+{
+  gchar *entry_location;
+
+  if (sink->segment_offset > sink->part_offset) {
+    if (sink->writer->flush)
+      sink->writer->flush (sink);
+
+    entry_location = gst_hls_sink_entry_location (sink, sink->segment_location);
+    gst_m3u8_playlist_add_part (sink->playlist, entry_location,
+        end - sink->part_start, sink->part_offset,
+        sink->segment_offset - sink->part_offset, sink->part_independent);
+    g_free (entry_location);
+  }
+
+  sink->part_offset = sink->segment_offset;
+  sink->part_start = end;
+  sink->part_independent = FALSE;
+}
+
+static gboolean
+gst_hls_sink_open_segment (GstHlsSink * sink, GstClockTime start)
+{
+  sink->segment_location = g_strdup_printf (sink->location, sink->index);
+  sink->segment_index = sink->index;
+  sink->segment_offset = 0;
+  sink->segment_start = start;
+  sink->part_offset = 0;
+  sink->part_start = start;
+  sink->split_pending = FALSE;
+
+  GST_INFO_OBJECT (sink, "opening segment %s", sink->segment_location);
+
+  if (sink->writer->open && !sink->writer->open (sink)) {
+    g_free (sink->segment_location);
+    sink->segment_location = NULL;
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static void
+gst_hls_sink_close_segment (GstHlsSink * sink, GstClockTime end)
+{
+  GFile *file = NULL;
+  gchar *entry_location;
+
+  GST_INFO_OBJECT (sink, "closing segment %s", sink->segment_location);
+
+  if (sink->part_duration > 0)
+    gst_hls_sink_close_part (sink, end);
+  if (sink->writer->close)
+    sink->writer->close (sink);
+
+  entry_location = gst_hls_sink_entry_location (sink, sink->segment_location);
+  if (sink->output == GST_HLS_SINK_OUTPUT_FILE)
+    file = g_file_new_for_path (sink->segment_location);
+  gst_m3u8_playlist_add_entry (sink->playlist, entry_location, file, NULL,
+      end - sink->segment_start, sink->segment_index, FALSE);
+  g_free (entry_location);
+  sink->last_running_time = end;
+
+  /* like multifilesink, only keep the last max-files segments around */
+  g_queue_push_tail (&sink->old_segments, sink->segment_location);
+  sink->segment_location = NULL;
+  while (sink->max_files > 0
+      && g_queue_get_length (&sink->old_segments) > sink->max_files) {
+    gchar *location = g_queue_pop_head (&sink->old_segments);
+
+    sink->writer->remove (sink, location);
+    g_free (location);
+  }
+}
+
+static gboolean
+gst_hls_sink_write_buffer (GstHlsSink * sink, GstBuffer * buffer)
+{
+  GstClockTime timestamp, running_time, end_time;
+  gboolean changed = FALSE;
+
+  timestamp = GST_BUFFER_TIMESTAMP (buffer);
+  if (GST_CLOCK_TIME_IS_VALID (timestamp))
+    running_time = gst_segment_to_running_time (&sink->segment,
+        GST_FORMAT_TIME, timestamp);
+  else
+    running_time = sink->last_buffer_end;
+  end_time = running_time;
+  if (GST_BUFFER_DURATION_IS_VALID (buffer))
+    end_time += GST_BUFFER_DURATION (buffer);
+
+  if (sink->segment_location && sink->split_pending) {
+    gst_hls_sink_close_segment (sink, running_time);
+    changed = TRUE;
+
+    /* a new segment means upstream sent the key unit and the next one can be
+     * scheduled, like when multifilesink starts a new file */
+    sink->waiting_fku = FALSE;
+    schedule_next_key_unit (sink);
+  } else if (sink->segment_location && sink->part_duration > 0
+      && sink->segment_offset > sink->part_offset
+      && end_time > sink->part_start + sink->part_duration * GST_MSECOND) {
+    /* parts must not be longer than the part target, close the current one
+     * before the buffer that would make it longer */
+    gst_hls_sink_close_part (sink, running_time);
+    changed = TRUE;
+  }
+
+  if (sink->segment_location == NULL) {
+    if (!gst_hls_sink_open_segment (sink, running_time))
+      return FALSE;
+    changed = TRUE;
+  }
+
+  if (sink->segment_offset == sink->part_offset)
+    sink->part_independent =
+        !GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+
+  if (!sink->writer->write (sink, buffer))
+    return FALSE;
+  sink->segment_offset += gst_buffer_get_size (buffer);
+
+  sink->last_buffer_end = end_time;
+
+  if (changed)
+    gst_hls_sink_write_playlist (sink);
+
+  return TRUE;
+}
+
+static GstPadProbeReturn
+gst_hls_sink_ghost_data_probe (GstPad * pad, GstPadProbeInfo * info,
+    gpointer data)
+{
+  GstHlsSink *sink = GST_HLS_SINK_CAST (data);
+  GstBufferList *list;
+  guint i;
+
+  if (sink->fakesink == NULL)
+    return GST_PAD_PROBE_OK;
+
+  if (info->type & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+    list = gst_pad_probe_info_get_buffer_list (info);
+    for (i = 0; i < gst_buffer_list_length (list); i++) {
+      if (!gst_hls_sink_write_buffer (sink, gst_buffer_list_get (list, i)))
+        return GST_PAD_PROBE_DROP;
+    }
+  } else if (!gst_hls_sink_write_buffer (sink,
+          gst_pad_probe_info_get_buffer (info))) {
+    return GST_PAD_PROBE_DROP;
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* whether the published playlist has the part @part of the segment @msn, or
+ * the complete segment if @part is -1 */
+static gboolean
+gst_hls_sink_has_part (GstHlsSink * sink, gint64 msn, gint part)
+{
+  if (sink->playlist_content == NULL)
+    return FALSE;
+  if (msn < 0 || msn < sink->published_msn)
+    return TRUE;
+
+  return msn == sink->published_msn && part >= 0
+      && (guint) part < sink->published_parts;
+}
+
+static gchar *
+gst_hls_sink_get_playlist (GstHlsSink * sink, gint64 msn, gint part,
+    GstClockTime timeout)
+{
+  gint64 end_time = 0;
+  gchar *playlist = NULL;
+
+  if (GST_CLOCK_TIME_IS_VALID (timeout))
+    end_time = g_get_monotonic_time () + GST_TIME_AS_USECONDS (timeout);
+
+  g_mutex_lock (&sink->lock);
+  while (!sink->flushing && !gst_hls_sink_has_part (sink, msn, part)) {
+    if (!GST_CLOCK_TIME_IS_VALID (timeout))
+      g_cond_wait (&sink->cond, &sink->lock);
+    else if (!g_cond_wait_until (&sink->cond, &sink->lock, end_time))
+      break;
+  }
+  if (!sink->flushing && gst_hls_sink_has_part (sink, msn, part))
+    playlist = g_strdup (sink->playlist_content);
+  g_mutex_unlock (&sink->lock);
+
+  return playlist;
+}
+
+static GBytes *
+gst_hls_sink_get_fragment (GstHlsSink * sink, const gchar * location)
+{
+  GByteArray *data;
+  GBytes *bytes = NULL;
+
+  g_mutex_lock (&sink->lock);
+  data = g_hash_table_lookup (sink->fragments, location);
+  if (data)
+    bytes = g_bytes_new (data->data, data->len);
+  g_mutex_unlock (&sink->lock);
+
+  return bytes;
+}
+
 gboolean
 gst_hls_sink_plugin_init (GstPlugin * plugin)
 {
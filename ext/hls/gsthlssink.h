@@ -21,6 +21,7 @@
 
 #include "gstm3u8playlist.h"
 #include <gst/gst.h>
+#include <stdio.h>
 
 G_BEGIN_DECLS
 
@@ -33,6 +34,14 @@ G_BEGIN_DECLS
 
 typedef struct _GstHlsSink GstHlsSink;
 typedef struct _GstHlsSinkClass GstHlsSinkClass;
+typedef struct _GstHlsSinkWriter GstHlsSinkWriter;
+
+typedef enum
+{
+  GST_HLS_SINK_OUTPUT_FILE,
+  GST_HLS_SINK_OUTPUT_MEMORY,
+  GST_HLS_SINK_OUTPUT_CALLBACK
+} GstHlsSinkOutput;
 
 struct _GstHlsSink
 {
@@ -56,11 +65,43 @@ struct _GstHlsSink
   GstSegment segment;
   gboolean waiting_fku;
   GstClockTime last_running_time;
+
+  /* low-latency mode and outputs other than files, where the segments are
+   * written by hlssink itself instead of multifilesink */
+  GstHlsSinkOutput output;
+  guint part_duration;
+  const GstHlsSinkWriter *writer;
+  GstElement *fakesink;
+  gchar *segment_location;
+  guint segment_index;
+  guint64 segment_offset;
+  GstClockTime segment_start;
+  guint64 part_offset;
+  GstClockTime part_start;
+  gboolean part_independent;
+  gboolean split_pending;
+  GstClockTime last_buffer_end;
+  FILE *segment_file;
+  GQueue old_segments;
+
+  /* protects the published playlist and the fragments kept in memory */
+  GMutex lock;
+  GCond cond;
+  GHashTable *fragments;
+  gchar *playlist_content;
+  guint published_msn;
+  guint published_parts;
+  gboolean flushing;            /* not running, playlist requests fail */
 };
 
 struct _GstHlsSinkClass
 {
   GstBinClass bin_class;
+
+  /* actions */
+  gchar * (*get_playlist) (GstHlsSink * sink, gint64 msn, gint part,
+      GstClockTime timeout);
+  GBytes * (*get_fragment) (GstHlsSink * sink, const gchar * location);
 };
 
 GType gst_hls_sink_get_type (void);
@@ -35,6 +35,10 @@
 #define M3U8_INT_INF_TAG "#EXTINF:%d,%s\n%s\n"
 #define M3U8_FLOAT_INF_TAG "#EXTINF:%s,%s\n%s\n"
 #define M3U8_ENDLIST_TAG "#EXT-X-ENDLIST"
+#define M3U8_SERVER_CONTROL_TAG "#EXT-X-SERVER-CONTROL:CAN-BLOCK-RELOAD=YES,PART-HOLD-BACK=%s\n"
+#define M3U8_PART_INF_TAG "#EXT-X-PART-INF:PART-TARGET=%s\n"
+#define M3U8_PART_TAG "#EXT-X-PART:DURATION=%s,URI=\"%s\",BYTERANGE=\"%" G_GUINT64_FORMAT "@%" G_GUINT64_FORMAT "\"%s\n"
+#define M3U8_PRELOAD_HINT_TAG "#EXT-X-PRELOAD-HINT:TYPE=PART,URI=\"%s\",BYTERANGE-START=%" G_GUINT64_FORMAT "\n"
 
 enum
 {
@@ -59,6 +63,32 @@ gst_m3u8_entry_new (const gchar * url, GFile * file, const gchar * title,
   return entry;
 }
 
+static GstM3U8Part *
+gst_m3u8_part_new (const gchar * url, gfloat duration, guint64 offset,
+    guint64 size, gboolean independent)
+{
+  GstM3U8Part *part;
+
+  g_return_val_if_fail (url != NULL, NULL);
+
+  part = g_new0 (GstM3U8Part, 1);
+  part->url = g_strdup (url);
+  part->duration = duration;
+  part->offset = offset;
+  part->size = size;
+  part->independent = independent;
+  return part;
+}
+
+static void
+gst_m3u8_part_free (GstM3U8Part * part)
+{
+  g_return_if_fail (part != NULL);
+
+  g_free (part->url);
+  g_free (part);
+}
+
 static void
 gst_m3u8_entry_free (GstM3U8Entry * entry)
 {
@@ -68,9 +98,21 @@ gst_m3u8_entry_free (GstM3U8Entry * entry)
   g_free (entry->title);
   if (entry->file != NULL)
     g_object_unref (entry->file);
+  g_list_free_full (entry->parts, (GDestroyNotify) gst_m3u8_part_free);
   g_free (entry);
 }
 
+static void
+render_part (GstM3U8Part * part, GString * str)
+{
+  gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+
+  g_string_append_printf (str, M3U8_PART_TAG,
+      g_ascii_formatd (buf, sizeof (buf), "%.5f", part->duration / GST_SECOND),
+      part->url, part->size, part->offset,
+      part->independent ? ",INDEPENDENT=YES" : "");
+}
+
 static gchar *
 gst_m3u8_entry_render (GstM3U8Entry * entry, guint version)
 {
@@ -113,6 +155,8 @@ gst_m3u8_playlist_free (GstM3U8Playlist * playlist)
 
   g_queue_foreach (playlist->entries, (GFunc) gst_m3u8_entry_free, NULL);
   g_queue_free (playlist->entries);
+  g_list_free_full (playlist->parts, (GDestroyNotify) gst_m3u8_part_free);
+  g_free (playlist->preload_hint_url);
   g_free (playlist);
 }
 
@@ -142,12 +186,54 @@ gst_m3u8_playlist_add_entry (GstM3U8Playlist * playlist,
     }
   }
 
+  /* the parts written so far were the ones of this segment */
+  entry->parts = playlist->parts;
+  playlist->parts = NULL;
+
   playlist->sequence_number = index + 1;
   g_queue_push_tail (playlist->entries, entry);
 
   return TRUE;
 }
 
+/* Adds a part to the segment being written, which will be added with
+ * gst_m3u8_playlist_add_entry() once complete */
+gboolean
+gst_m3u8_playlist_add_part (GstM3U8Playlist * playlist, const gchar * url,
+    gfloat duration, guint64 offset, guint64 size, gboolean independent)
+{
+  g_return_val_if_fail (playlist != NULL, FALSE);
+  g_return_val_if_fail (url != NULL, FALSE);
+
+  if (playlist->type == GST_M3U8_PLAYLIST_TYPE_VOD)
+    return FALSE;
+
+  playlist->parts = g_list_append (playlist->parts,
+      gst_m3u8_part_new (url, duration, offset, size, independent));
+
+  return TRUE;
+}
+
+/* Announces the part that is being written, @url NULL removes the hint */
+void
+gst_m3u8_playlist_set_preload_hint (GstM3U8Playlist * playlist,
+    const gchar * url, guint64 offset)
+{
+  g_return_if_fail (playlist != NULL);
+
+  g_free (playlist->preload_hint_url);
+  playlist->preload_hint_url = g_strdup (url);
+  playlist->preload_hint_offset = offset;
+}
+
+guint
+gst_m3u8_playlist_n_parts (GstM3U8Playlist * playlist)
+{
+  g_return_val_if_fail (playlist != NULL, 0);
+
+  return g_list_length (playlist->parts);
+}
+
 static guint
 gst_m3u8_playlist_target_duration (GstM3U8Playlist * playlist)
 {
@@ -165,10 +251,13 @@ gst_m3u8_playlist_target_duration (GstM3U8Playlist * playlist)
 }
 
 static void
-render_entry (GstM3U8Entry * entry, GstM3U8Playlist * playlist)
+render_entry (GstM3U8Entry * entry, GstM3U8Playlist * playlist,
+    gboolean with_parts)
 {
   gchar *entry_str;
 
+  if (with_parts)
+    g_list_foreach (entry->parts, (GFunc) render_part, playlist->playlist_str);
   entry_str = gst_m3u8_entry_render (entry, playlist->version);
   g_string_append_printf (playlist->playlist_str, "%s", entry_str);
   g_free (entry_str);
@@ -178,6 +267,10 @@ gchar *
 gst_m3u8_playlist_render (GstM3U8Playlist * playlist)
 {
   gchar *pl;
+  gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+  guint target_duration;
+  gfloat parts_duration;
+  gint i, first_parts;
 
   g_return_val_if_fail (playlist != NULL, NULL);
 
@@ -195,12 +288,40 @@ gst_m3u8_playlist_render (GstM3U8Playlist * playlist)
   g_string_append_printf (playlist->playlist_str, M3U8_MEDIA_SEQUENCE_TAG,
       playlist->sequence_number - playlist->entries->length);
   /* #EXT-X-TARGETDURATION */
+  target_duration = gst_m3u8_playlist_target_duration (playlist);
   g_string_append_printf (playlist->playlist_str, M3U8_TARGETDURATION_TAG,
-      gst_m3u8_playlist_target_duration (playlist));
+      target_duration);
+  if (playlist->part_target > 0) {
+    /* #EXT-X-SERVER-CONTROL */
+    g_string_append_printf (playlist->playlist_str, M3U8_SERVER_CONTROL_TAG,
+        g_ascii_formatd (buf, sizeof (buf), "%.5f",
+            3 * playlist->part_target / GST_SECOND));
+    /* #EXT-X-PART-INF */
+    g_string_append_printf (playlist->playlist_str, M3U8_PART_INF_TAG,
+        g_ascii_formatd (buf, sizeof (buf), "%.5f",
+            playlist->part_target / GST_SECOND));
+  }
   g_string_append_printf (playlist->playlist_str, "\n");
 
+  /* Parts are only listed for the segments in the last 3 target durations */
+  first_parts = playlist->entries->length;
+  parts_duration = 0;
+  while (first_parts > 0 && parts_duration < 3 * target_duration * GST_SECOND) {
+    GstM3U8Entry *entry = g_queue_peek_nth (playlist->entries, --first_parts);
+
+    parts_duration += entry->duration;
+  }
+
   /* Entries */
-  g_queue_foreach (playlist->entries, (GFunc) render_entry, playlist);
+  for (i = 0; i < playlist->entries->length; i++)
+    render_entry (g_queue_peek_nth (playlist->entries, i), playlist,
+        i >= first_parts);
+
+  /* Segment being written */
+  g_list_foreach (playlist->parts, (GFunc) render_part, playlist->playlist_str);
+  if (playlist->preload_hint_url)
+    g_string_append_printf (playlist->playlist_str, M3U8_PRELOAD_HINT_TAG,
+        playlist->preload_hint_url, playlist->preload_hint_offset);
 
   if (playlist->end_list)
     g_string_append_printf (playlist->playlist_str, M3U8_ENDLIST_TAG);
@@ -217,6 +338,9 @@ gst_m3u8_playlist_clear (GstM3U8Playlist * playlist)
 
   g_queue_foreach (playlist->entries, (GFunc) gst_m3u8_entry_free, NULL);
   g_queue_clear (playlist->entries);
+  g_list_free_full (playlist->parts, (GDestroyNotify) gst_m3u8_part_free);
+  playlist->parts = NULL;
+  gst_m3u8_playlist_set_preload_hint (playlist, NULL, 0);
 }
 
 guint
@@ -29,7 +29,17 @@ G_BEGIN_DECLS
 
 typedef struct _GstM3U8Playlist GstM3U8Playlist;
 typedef struct _GstM3U8Entry GstM3U8Entry;
+typedef struct _GstM3U8Part GstM3U8Part;
 
+/* A partial segment of low-latency HLS, as a byte range of its segment */
+struct _GstM3U8Part
+{
+  gfloat duration;
+  gchar *url;
+  guint64 offset;
+  guint64 size;
+  gboolean independent;
+};
 
 struct _GstM3U8Entry
 {
@@ -38,6 +48,7 @@ struct _GstM3U8Entry
   gchar *url;
   GFile *file;
   gboolean discontinuous;
+  GList *parts;
 };
 
 struct _GstM3U8Playlist
@@ -48,9 +59,13 @@ struct _GstM3U8Playlist
   gint type;
   gboolean end_list;
   guint sequence_number;
+  gfloat part_target;           /* 0 if the segments aren't split in parts */
 
   /*< Private >*/
   GQueue *entries;
+  GList *parts;                 /* parts of the segment being written */
+  gchar *preload_hint_url;
+  guint64 preload_hint_offset;
   GString *playlist_str;
 };
 
@@ -66,6 +81,16 @@ gboolean gst_m3u8_playlist_add_entry (GstM3U8Playlist * playlist,
 				     gfloat duration,
 				     guint index,
 				     gboolean discontinuous);
+gboolean gst_m3u8_playlist_add_part (GstM3U8Playlist * playlist,
+                                    const gchar * url,
+                                    gfloat duration,
+                                    guint64 offset,
+                                    guint64 size,
+                                    gboolean independent);
+void gst_m3u8_playlist_set_preload_hint (GstM3U8Playlist * playlist,
+                                         const gchar * url,
+                                         guint64 offset);
+guint gst_m3u8_playlist_n_parts (GstM3U8Playlist * playlist);
 gchar * gst_m3u8_playlist_render (GstM3U8Playlist * playlist); 
 void gst_m3u8_playlist_clear (GstM3U8Playlist * playlist); 
 guint gst_m3u8_playlist_n_entries (GstM3U8Playlist * playlist); 
@@ -30,25 +30,6 @@
 
 #define GST_CAT_DEFAULT fragmented_debug
 
-#if !GLIB_CHECK_VERSION (2, 33, 4)
-#define g_list_copy_deep gst_g_list_copy_deep
-static GList *
-gst_g_list_copy_deep (GList * list, GCopyFunc func, gpointer user_data)
-{
-  list = g_list_copy (list);
-
-  if (func != NULL) {
-    GList *l;
-
-    for (l = list; l != NULL; l = l->next) {
-      l->data = func (l->data, user_data);
-    }
-  }
-
-  return list;
-}
-#endif
-
 static GstM3U8 *gst_m3u8_new (void);
 static void gst_m3u8_free (GstM3U8 * m3u8);
 static gboolean gst_m3u8_update (GstM3U8Client * client, GstM3U8 * m3u8,
@@ -64,6 +45,9 @@ gst_m3u8_new (void)
   GstM3U8 *m3u8;
 
   m3u8 = g_new0 (GstM3U8, 1);
+  m3u8->files =
+      g_ptr_array_new_with_free_func ((GDestroyNotify)
+      gst_m3u8_media_file_free);
 
   return m3u8;
 }
@@ -93,8 +77,7 @@ gst_m3u8_free (GstM3U8 * self)
   g_free (self->name);
   g_free (self->codecs);
 
-  g_list_foreach (self->files, (GFunc) gst_m3u8_media_file_free, NULL);
-  g_list_free (self->files);
+  g_ptr_array_free (self->files, TRUE);
 
   g_free (self->last_data);
   g_list_foreach (self->lists, (GFunc) gst_m3u8_free, NULL);
@@ -131,84 +114,6 @@ gst_m3u8_media_file_free (GstM3U8MediaFile * self)
   g_free (self);
 }
 
-static GstM3U8MediaFile *
-gst_m3u8_media_file_copy (const GstM3U8MediaFile * self, gpointer user_data)
-{
-  g_return_val_if_fail (self != NULL, NULL);
-
-  return gst_m3u8_media_file_new (g_strdup (self->uri), g_strdup (self->title),
-      self->duration, self->sequence);
-}
-
-static GstM3U8 *
-_m3u8_copy (const GstM3U8 * self, GstM3U8 * parent)
-{
-  GstM3U8 *dup;
-
-  g_return_val_if_fail (self != NULL, NULL);
-
-  dup = gst_m3u8_new ();
-  dup->uri = g_strdup (self->uri);
-  dup->base_uri = g_strdup (self->base_uri);
-  dup->name = g_strdup (self->name);
-  dup->endlist = self->endlist;
-  dup->version = self->version;
-  dup->targetduration = self->targetduration;
-  dup->allowcache = self->allowcache;
-  dup->bandwidth = self->bandwidth;
-  dup->program_id = self->program_id;
-  dup->codecs = g_strdup (self->codecs);
-  dup->width = self->width;
-  dup->height = self->height;
-  dup->iframe = self->iframe;
-  dup->files =
-      g_list_copy_deep (self->files, (GCopyFunc) gst_m3u8_media_file_copy,
-      NULL);
-
-  /* private */
-  dup->last_data = g_strdup (self->last_data);
-  dup->lists = g_list_copy_deep (self->lists, (GCopyFunc) _m3u8_copy, dup);
-  dup->iframe_lists =
-      g_list_copy_deep (self->iframe_lists, (GCopyFunc) _m3u8_copy, dup);
-  /* NOTE: current_variant will get set in gst_m3u8_copy () */
-  dup->parent = parent;
-  dup->mediasequence = self->mediasequence;
-  return dup;
-}
-
-static GstM3U8 *
-gst_m3u8_copy (const GstM3U8 * self)
-{
-  GList *entry;
-  guint n;
-
-  GstM3U8 *dup = _m3u8_copy (self, NULL);
-
-  if (self->current_variant != NULL) {
-    for (n = 0, entry = self->lists; entry; entry = entry->next, n++) {
-      if (entry == self->current_variant) {
-        dup->current_variant = g_list_nth (dup->lists, n);
-        break;
-      }
-    }
-
-    if (!dup->current_variant) {
-      for (n = 0, entry = self->iframe_lists; entry; entry = entry->next, n++) {
-        if (entry == self->current_variant) {
-          dup->current_variant = g_list_nth (dup->iframe_lists, n);
-          break;
-        }
-      }
-
-      if (!dup->current_variant) {
-        GST_ERROR ("Failed to determine current playlist");
-      }
-    }
-  }
-
-  return dup;
-}
-
 static gboolean
 int_from_string (gchar * ptr, gchar ** endptr, gint * val)
 {
@@ -378,6 +283,28 @@ gst_m3u8_compare_playlist_by_bitrate (gconstpointer a, gconstpointer b)
   return ((GstM3U8 *) (a))->bandwidth - ((GstM3U8 *) (b))->bandwidth;
 }
 
+/* Removes the files that left the window of a live playlist now starting at
+ * @sequence, or all of them if it does not continue the known files */
+static void
+gst_m3u8_remove_files_before (GstM3U8 * self, gint64 sequence,
+    gint64 * known_sequence)
+{
+  GstM3U8MediaFile *first;
+
+  if (self->files->len == 0)
+    return;
+
+  first = g_ptr_array_index (self->files, 0);
+  if (sequence < first->sequence || sequence > *known_sequence + 1) {
+    GST_DEBUG ("Media sequence jumped from %" G_GINT64_FORMAT " to %"
+        G_GINT64_FORMAT ", reloading all files", first->sequence, sequence);
+    g_ptr_array_set_size (self->files, 0);
+    *known_sequence = -1;
+  } else if (sequence > first->sequence) {
+    g_ptr_array_remove_range (self->files, 0, sequence - first->sequence);
+  }
+}
+
 /*
  * @data: a m3u8 playlist text data, taking ownership
  */
@@ -394,6 +321,7 @@ gst_m3u8_update (GstM3U8Client * client, GstM3U8 * self, gchar * data,
   gboolean have_iv = FALSE;
   guint8 iv[16] = { 0, };
   gint64 size = -1, offset = -1;
+  gint64 known_sequence = -1, first_sequence = -1;
 
   g_return_val_if_fail (self != NULL, FALSE);
   g_return_val_if_fail (data != NULL, FALSE);
@@ -419,11 +347,15 @@ gst_m3u8_update (GstM3U8Client * client, GstM3U8 * self, gchar * data,
   g_free (self->last_data);
   self->last_data = data;
 
-  client->current_file = NULL;
-  if (self->files) {
-    g_list_foreach (self->files, (GFunc) gst_m3u8_media_file_free, NULL);
-    g_list_free (self->files);
-    self->files = NULL;
+  /* Live playlists only get files appended and removed from the start, the
+   * ones we already know are kept instead of being parsed again */
+  if (self->files->len > 0 && !self->endlist) {
+    GstM3U8MediaFile *last =
+        g_ptr_array_index (self->files, self->files->len - 1);
+
+    known_sequence = last->sequence;
+  } else {
+    g_ptr_array_set_size (self->files, 0);
   }
   client->duration = GST_CLOCK_TIME_NONE;
 
@@ -452,6 +384,23 @@ gst_m3u8_update (GstM3U8Client * client, GstM3U8 * self, gchar * data,
         goto next_line;
       }
 
+      if (list == NULL) {
+        if (first_sequence == -1) {
+          first_sequence = self->mediasequence;
+          gst_m3u8_remove_files_before (self, first_sequence, &known_sequence);
+        }
+
+        if (self->mediasequence <= known_sequence) {
+          self->mediasequence++;
+          g_free (title);
+          duration = 0;
+          title = NULL;
+          discontinuity = FALSE;
+          size = offset = -1;
+          goto next_line;
+        }
+      }
+
       data = uri_join (self->base_uri ? self->base_uri : self->uri, data);
       if (data == NULL)
         goto next_line;
@@ -468,10 +417,14 @@ gst_m3u8_update (GstM3U8Client * client, GstM3U8 * self, gchar * data,
         }
         list = NULL;
       } else {
-        GstM3U8MediaFile *file;
+        GstM3U8MediaFile *file, *prev;
+
+        prev = self->files->len > 0 ?
+            g_ptr_array_index (self->files, self->files->len - 1) : NULL;
         file =
             gst_m3u8_media_file_new (data, title, duration,
             self->mediasequence++);
+        file->start = prev ? prev->start + prev->duration : 0;
 
         /* set encryption params */
         file->key = current_key ? g_strdup (current_key) : NULL;
@@ -489,8 +442,6 @@ gst_m3u8_update (GstM3U8Client * client, GstM3U8 * self, gchar * data,
           if (offset != -1) {
             file->offset = offset;
           } else {
-            GstM3U8MediaFile *prev = self->files ? self->files->data : NULL;
-
             if (!prev) {
               offset = 0;
             } else {
@@ -509,7 +460,7 @@ gst_m3u8_update (GstM3U8Client * client, GstM3U8 * self, gchar * data,
         title = NULL;
         discontinuity = FALSE;
         size = offset = -1;
-        self->files = g_list_prepend (self->files, file);
+        g_ptr_array_add (self->files, file);
       }
 
     } else if (g_str_has_prefix (data, "#EXTINF:")) {
@@ -702,7 +653,15 @@ gst_m3u8_update (GstM3U8Client * client, GstM3U8 * self, gchar * data,
   g_free (current_key);
   current_key = NULL;
 
-  self->files = g_list_reverse (self->files);
+  if (first_sequence == -1) {
+    g_ptr_array_set_size (self->files, 0);
+  } else if (self->files->len > 0) {
+    GstM3U8MediaFile *first = g_ptr_array_index (self->files, 0);
+
+    /* files removed from the end of the playlist */
+    if (self->mediasequence - first->sequence < self->files->len)
+      g_ptr_array_set_size (self->files, self->mediasequence - first->sequence);
+  }
 
   /* reorder playlists by bitrate */
   if (self->lists) {
@@ -733,28 +692,34 @@ gst_m3u8_update (GstM3U8Client * client, GstM3U8 * self, gchar * data,
           (GCompareFunc) _m3u8_compare_uri);
   }
   /* calculate the start and end times of this media playlist. */
-  if (self->files) {
-    GList *walk;
-    GstM3U8MediaFile *file;
-    GstClockTime duration = 0;
-
-    for (walk = self->files; walk; walk = walk->next) {
-      file = walk->data;
-      duration += file->duration;
-      if (file->sequence > client->highest_sequence_number) {
-        if (client->highest_sequence_number >= 0) {
-          /* if an update of the media playlist has been missed, there
-             will be a gap between self->highest_sequence_number and the
-             first sequence number in this media playlist. In this situation
-             assume that the missing fragments had a duration of
-             targetduration each */
-          client->last_file_end +=
-              (file->sequence - client->highest_sequence_number -
-              1) * self->targetduration;
-        }
-        client->last_file_end += file->duration;
-        client->highest_sequence_number = file->sequence;
+  if (self->files->len > 0) {
+    GstM3U8MediaFile *first, *last, *file;
+    GstClockTime duration;
+    guint i = 0;
+
+    first = g_ptr_array_index (self->files, 0);
+    last = g_ptr_array_index (self->files, self->files->len - 1);
+    duration = last->start + last->duration - first->start;
+
+    /* only the files after the highest sequence seen move the end */
+    if (client->highest_sequence_number >= first->sequence)
+      i = MIN (client->highest_sequence_number - first->sequence + 1,
+          self->files->len);
+
+    for (; i < self->files->len; i++) {
+      file = g_ptr_array_index (self->files, i);
+      if (client->highest_sequence_number >= 0) {
+        /* if an update of the media playlist has been missed, there
+           will be a gap between self->highest_sequence_number and the
+           first sequence number in this media playlist. In this situation
+           assume that the missing fragments had a duration of
+           targetduration each */
+        client->last_file_end +=
+            (file->sequence - client->highest_sequence_number -
+            1) * self->targetduration;
       }
+      client->last_file_end += file->duration;
+      client->highest_sequence_number = file->sequence;
     }
     if (GST_M3U8_CLIENT_IS_LIVE (client)) {
       client->first_file_start = client->last_file_end - duration;
@@ -778,7 +743,6 @@ gst_m3u8_client_new (const gchar * uri, const gchar * base_uri)
   client = g_new0 (GstM3U8Client, 1);
   client->main = gst_m3u8_new ();
   client->current = NULL;
-  client->current_file = NULL;
   client->sequence = -1;
   client->sequence_position = 0;
   client->update_failed_count = 0;
@@ -810,7 +774,6 @@ gst_m3u8_client_set_current (GstM3U8Client * self, GstM3U8 * m3u8)
     self->current = m3u8;
     self->update_failed_count = 0;
     self->duration = GST_CLOCK_TIME_NONE;
-    self->current_file = NULL;
   }
   GST_M3U8_CLIENT_UNLOCK (self);
 }
@@ -835,7 +798,7 @@ gst_m3u8_client_update (GstM3U8Client * self, gchar * data)
     goto out;
   }
 
-  if (self->current && !self->current->files) {
+  if (self->current && self->current->files->len == 0) {
     GST_ERROR ("Invalid media playlist, it does not contain any media files");
     goto out;
   }
@@ -849,9 +812,9 @@ gst_m3u8_client_update (GstM3U8Client * self, gchar * data)
     }
   }
 
-  if (m3u8->files && self->sequence == -1) {
-    self->current_file = g_list_first (m3u8->files);
-    self->sequence = GST_M3U8_MEDIA_FILE (self->current_file->data)->sequence;
+  if (m3u8->files->len > 0 && self->sequence == -1) {
+    self->sequence =
+        GST_M3U8_MEDIA_FILE (g_ptr_array_index (m3u8->files, 0))->sequence;
     self->sequence_position = 0;
     GST_DEBUG ("Setting first sequence at %u", (guint) self->sequence);
   }
@@ -927,17 +890,17 @@ gst_m3u8_client_update_variant_playlist (GstM3U8Client * self, gchar * data,
       goto out;
     }
 
-    /* Switch out the variant playlist */
+    /* Switch out the variant playlist, the old one is freed with the new
+     * client */
     old = self->main;
 
-    self->main = gst_m3u8_copy (new_client->main);
+    self->main = new_client->main;
+    new_client->main = old;
     if (self->main->lists)
       self->current = self->main->current_variant->data;
     else
       self->current = self->main;
 
-    gst_m3u8_free (old);
-
     ret = TRUE;
 
   out:
@@ -948,52 +911,39 @@ gst_m3u8_client_update_variant_playlist (GstM3U8Client * self, gchar * data,
   return ret;
 }
 
-static gboolean
-_find_current (GstM3U8MediaFile * file, GstM3U8Client * client)
+/* Sequence numbers follow each other in the files, so the index of a file
+ * is the difference with the sequence of the first one */
+static gint
+find_fragment (GstM3U8 * m3u8, gint64 sequence)
 {
-  return file->sequence != client->sequence;
-}
+  GstM3U8MediaFile *first;
 
-static GList *
-find_next_fragment (GstM3U8Client * client, GList * l, gboolean forward)
-{
-  GstM3U8MediaFile *file;
+  if (m3u8->files->len == 0)
+    return -1;
 
-  if (forward) {
-    while (l) {
-      file = l->data;
-
-      if (file->sequence >= client->sequence)
-        break;
-
-      l = l->next;
-    }
-  } else {
-    l = g_list_last (l);
+  first = g_ptr_array_index (m3u8->files, 0);
+  if (sequence < first->sequence
+      || sequence - first->sequence >= m3u8->files->len)
+    return -1;
 
-    while (l) {
-      file = l->data;
-
-      if (file->sequence <= client->sequence)
-        break;
-
-      l = l->prev;
-    }
-  }
-
-  return l;
+  return sequence - first->sequence;
 }
 
-static gboolean
-has_next_fragment (GstM3U8Client * client, GList * l, gboolean forward)
+static gint
+find_next_fragment (GstM3U8Client * client, GstM3U8 * m3u8, gboolean forward)
 {
-  l = find_next_fragment (client, l, forward);
+  GstM3U8MediaFile *first;
 
-  if (l) {
-    return (forward && l->next) || (!forward && l->prev);
-  }
+  if (m3u8->files->len == 0)
+    return -1;
 
-  return FALSE;
+  first = g_ptr_array_index (m3u8->files, 0);
+  if (client->sequence < first->sequence)
+    return forward ? 0 : -1;
+  if (client->sequence - first->sequence >= m3u8->files->len)
+    return forward ? -1 : m3u8->files->len - 1;
+
+  return client->sequence - first->sequence;
 }
 
 gboolean
@@ -1003,6 +953,7 @@ gst_m3u8_client_get_next_fragment (GstM3U8Client * client,
     gchar ** key, guint8 ** iv, gboolean forward)
 {
   GstM3U8MediaFile *file;
+  gint idx;
 
   g_return_val_if_fail (client != NULL, FALSE);
   g_return_val_if_fail (client->current != NULL, FALSE);
@@ -1013,17 +964,14 @@ gst_m3u8_client_get_next_fragment (GstM3U8Client * client,
     GST_M3U8_CLIENT_UNLOCK (client);
     return FALSE;
   }
-  if (!client->current_file) {
-    client->current_file =
-        find_next_fragment (client, client->current->files, forward);
-  }
 
-  if (!client->current_file) {
+  idx = find_next_fragment (client, client->current, forward);
+  if (idx < 0) {
     GST_M3U8_CLIENT_UNLOCK (client);
     return FALSE;
   }
 
-  file = GST_M3U8_MEDIA_FILE (client->current_file->data);
+  file = g_ptr_array_index (client->current->files, idx);
   GST_DEBUG ("Got fragment with sequence %u (client sequence %u)",
       (guint) file->sequence, (guint) client->sequence);
 
@@ -1053,10 +1001,47 @@ gst_m3u8_client_get_next_fragment (GstM3U8Client * client,
   return TRUE;
 }
 
+/* Gets the uri and byte range of the fragment @ahead positions after the
+ * next one, without advancing */
+gboolean
+gst_m3u8_client_peek_fragment (GstM3U8Client * client, guint ahead,
+    gchar ** uri, gint64 * range_start, gint64 * range_end, gboolean forward)
+{
+  GstM3U8MediaFile *file;
+  gint idx;
+
+  g_return_val_if_fail (client != NULL, FALSE);
+  g_return_val_if_fail (client->current != NULL, FALSE);
+
+  GST_M3U8_CLIENT_LOCK (client);
+  if (client->sequence < 0) {
+    GST_M3U8_CLIENT_UNLOCK (client);
+    return FALSE;
+  }
+
+  idx = find_next_fragment (client, client->current, forward);
+  if (idx >= 0)
+    idx = forward ? idx + ahead : idx - (gint) ahead;
+
+  if (idx < 0 || idx >= client->current->files->len) {
+    GST_M3U8_CLIENT_UNLOCK (client);
+    return FALSE;
+  }
+
+  file = g_ptr_array_index (client->current->files, idx);
+  *uri = g_strdup (file->uri);
+  *range_start = file->offset;
+  *range_end = file->size != -1 ? file->offset + file->size - 1 : -1;
+
+  GST_M3U8_CLIENT_UNLOCK (client);
+  return TRUE;
+}
+
 gboolean
 gst_m3u8_client_has_next_fragment (GstM3U8Client * client, gboolean forward)
 {
-  gboolean ret;
+  gboolean ret = FALSE;
+  gint idx;
 
   g_return_val_if_fail (client != NULL, FALSE);
   g_return_val_if_fail (client->current != NULL, FALSE);
@@ -1064,13 +1049,9 @@ gst_m3u8_client_has_next_fragment (GstM3U8Client * client, gboolean forward)
   GST_M3U8_CLIENT_LOCK (client);
   GST_DEBUG ("Checking if has next fragment %" G_GINT64_FORMAT,
       client->sequence + (forward ? 1 : -1));
-  if (client->current_file) {
-    ret =
-        (forward ? client->current_file->next : client->current_file->prev) !=
-        NULL;
-  } else {
-    ret = has_next_fragment (client, client->current->files, forward);
-  }
+  idx = find_next_fragment (client, client->current, forward);
+  if (idx >= 0)
+    ret = forward ? idx + 1 < client->current->files->len : idx > 0;
   GST_M3U8_CLIENT_UNLOCK (client);
   return ret;
 }
@@ -1079,46 +1060,27 @@ void
 gst_m3u8_client_advance_fragment (GstM3U8Client * client, gboolean forward)
 {
   GstM3U8MediaFile *file;
+  gint idx;
 
   g_return_if_fail (client != NULL);
   g_return_if_fail (client->current != NULL);
 
   GST_M3U8_CLIENT_LOCK (client);
-  if (!client->current_file) {
-    GList *l;
-
-    GST_DEBUG ("Looking for fragment %" G_GINT64_FORMAT, client->sequence);
-    l = g_list_find_custom (client->current->files, client,
-        (GCompareFunc) _find_current);
-    if (l == NULL) {
-      GST_ERROR ("Could not find current fragment");
-      GST_M3U8_CLIENT_UNLOCK (client);
-      return;
-    }
-    client->current_file = l;
+  GST_DEBUG ("Looking for fragment %" G_GINT64_FORMAT, client->sequence);
+  idx = find_fragment (client->current, client->sequence);
+  if (idx < 0) {
+    GST_ERROR ("Could not find current fragment");
+    GST_M3U8_CLIENT_UNLOCK (client);
+    return;
   }
 
-  file = GST_M3U8_MEDIA_FILE (client->current_file->data);
+  file = g_ptr_array_index (client->current->files, idx);
   GST_DEBUG ("Advancing from sequence %u", (guint) file->sequence);
   if (forward) {
-    client->current_file = client->current_file->next;
-    if (client->current_file) {
-      client->sequence =
-          GST_M3U8_MEDIA_FILE (client->current_file->data)->sequence;
-    } else {
-      client->sequence = file->sequence + 1;
-    }
-
+    client->sequence = file->sequence + 1;
     client->sequence_position += file->duration;
   } else {
-    client->current_file = client->current_file->prev;
-    if (client->current_file) {
-      client->sequence =
-          GST_M3U8_MEDIA_FILE (client->current_file->data)->sequence;
-    } else {
-      client->sequence = file->sequence - 1;
-    }
-
+    client->sequence = file->sequence - 1;
     if (client->sequence_position > file->duration)
       client->sequence_position -= file->duration;
     else
@@ -1127,12 +1089,6 @@ gst_m3u8_client_advance_fragment (GstM3U8Client * client, gboolean forward)
   GST_M3U8_CLIENT_UNLOCK (client);
 }
 
-static void
-_sum_duration (GstM3U8MediaFile * self, GstClockTime * duration)
-{
-  *duration += self->duration;
-}
-
 GstClockTime
 gst_m3u8_client_get_duration (GstM3U8Client * client)
 {
@@ -1147,10 +1103,13 @@ gst_m3u8_client_get_duration (GstM3U8Client * client)
     return GST_CLOCK_TIME_NONE;
   }
 
-  if (!GST_CLOCK_TIME_IS_VALID (client->duration) && client->current->files) {
-    client->duration = 0;
-    g_list_foreach (client->current->files, (GFunc) _sum_duration,
-        &client->duration);
+  if (!GST_CLOCK_TIME_IS_VALID (client->duration)
+      && client->current->files->len > 0) {
+    GPtrArray *files = client->current->files;
+    GstM3U8MediaFile *first = g_ptr_array_index (files, 0);
+    GstM3U8MediaFile *last = g_ptr_array_index (files, files->len - 1);
+
+    client->duration = last->start + last->duration - first->start;
   }
   duration = client->duration;
   GST_M3U8_CLIENT_UNLOCK (client);
@@ -1326,18 +1285,18 @@ guint64
 gst_m3u8_client_get_current_fragment_duration (GstM3U8Client * client)
 {
   guint64 dur;
-  GList *list;
+  gint idx;
 
   g_return_val_if_fail (client != NULL, 0);
 
   GST_M3U8_CLIENT_LOCK (client);
 
-  list = g_list_find_custom (client->current->files, client,
-      (GCompareFunc) _find_current);
-  if (list == NULL) {
+  idx = find_fragment (client->current, client->sequence);
+  if (idx < 0) {
     dur = -1;
   } else {
-    dur = GST_M3U8_MEDIA_FILE (list->data)->duration;
+    dur = GST_M3U8_MEDIA_FILE (g_ptr_array_index (client->current->files,
+            idx))->duration;
   }
 
   GST_M3U8_CLIENT_UNLOCK (client);
@@ -1349,29 +1308,27 @@ gst_m3u8_client_get_seek_range (GstM3U8Client * client, gint64 * start,
     gint64 * stop)
 {
   GstClockTime duration = 0;
-  GList *walk;
-  GstM3U8MediaFile *file;
-  guint count;
+  GPtrArray *files;
+  GstM3U8MediaFile *first, *last;
 
   g_return_val_if_fail (client != NULL, FALSE);
 
   GST_M3U8_CLIENT_LOCK (client);
 
-  if (client->current == NULL || client->current->files == NULL) {
+  if (client->current == NULL || client->current->files->len == 0) {
     GST_M3U8_CLIENT_UNLOCK (client);
     return FALSE;
   }
 
-  count = g_list_length (client->current->files);
-
-  /* count is used to make sure the seek range is never closer than
+  /* make sure the seek range is never closer than
      GST_M3U8_LIVE_MIN_FRAGMENT_DISTANCE fragments from the end of the
      playlist - see 6.3.3. "Playing the Playlist file" of the HLS draft */
-  for (walk = client->current->files;
-      walk && count >= GST_M3U8_LIVE_MIN_FRAGMENT_DISTANCE; walk = walk->next) {
-    file = walk->data;
-    --count;
-    duration += file->duration;
+  files = client->current->files;
+  if (files->len >= GST_M3U8_LIVE_MIN_FRAGMENT_DISTANCE) {
+    first = g_ptr_array_index (files, 0);
+    last = g_ptr_array_index (files,
+        files->len - GST_M3U8_LIVE_MIN_FRAGMENT_DISTANCE);
+    duration = last->start + last->duration - first->start;
   }
 
   if (duration <= 0) {
@@ -1383,3 +1340,59 @@ gst_m3u8_client_get_seek_range (GstM3U8Client * client, gint64 * start,
   GST_M3U8_CLIENT_UNLOCK (client);
   return TRUE;
 }
+
+/* Moves the client to the fragment containing @position, counted from the
+ * start of the first fragment of the current playlist. If @position is after
+ * the end of the playlist, the client is placed right after the last
+ * fragment and FALSE is returned. */
+gboolean
+gst_m3u8_client_seek (GstM3U8Client * client, GstClockTime position)
+{
+  GPtrArray *files;
+  GstM3U8MediaFile *first, *file;
+  GstClockTime target;
+  gboolean ret;
+  guint lo, hi;
+
+  g_return_val_if_fail (client != NULL, FALSE);
+  g_return_val_if_fail (client->current != NULL, FALSE);
+
+  GST_M3U8_CLIENT_LOCK (client);
+  files = client->current->files;
+  if (files->len == 0) {
+    GST_M3U8_CLIENT_UNLOCK (client);
+    return FALSE;
+  }
+
+  first = g_ptr_array_index (files, 0);
+  target = first->start + position;
+
+  /* last file starting before the target */
+  lo = 0;
+  hi = files->len;
+  while (hi - lo > 1) {
+    guint mid = lo + (hi - lo) / 2;
+
+    file = g_ptr_array_index (files, mid);
+    if (file->start <= target)
+      lo = mid;
+    else
+      hi = mid;
+  }
+
+  /* FIXME: Here we need proper discont handling */
+  file = g_ptr_array_index (files, lo);
+  ret = target < file->start + file->duration;
+  if (ret) {
+    client->sequence = file->sequence;
+    client->sequence_position = file->start - first->start;
+  } else {
+    client->sequence = file->sequence + 1;
+    client->sequence_position = file->start + file->duration - first->start;
+  }
+  GST_DEBUG ("Seeking to %" GST_TIME_FORMAT ", sequence %" G_GINT64_FORMAT,
+      GST_TIME_ARGS (position), client->sequence);
+  GST_M3U8_CLIENT_UNLOCK (client);
+
+  return ret;
+}
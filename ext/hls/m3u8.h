@@ -61,7 +61,7 @@ struct _GstM3U8
   gint width;
   gint height;
   gboolean iframe;
-  GList *files;
+  GPtrArray *files;             /* GstM3U8MediaFile, one per sequence number */
 
   /*< private > */
   gchar *last_data;
@@ -78,6 +78,8 @@ struct _GstM3U8MediaFile
   GstClockTime duration;
   gchar *uri;
   gint64 sequence;               /* the sequence nb of this file */
+  GstClockTime start;           /* start since the first file of the playlist,
+                                 * kept across live updates */
   gboolean discont;             /* this file marks a discontinuity */
   gchar *key;
   guint8 iv[16];
@@ -89,7 +91,6 @@ struct _GstM3U8Client
   GstM3U8 *main;                /* main playlist */
   GstM3U8 *current;
   guint update_failed_count;
-  GList *current_file;
   gint64 sequence;              /* the next sequence for this client */
   GstClockTime sequence_position; /* position of this sequence */
   gint64 highest_sequence_number; /* largest seen sequence number */
@@ -109,6 +110,8 @@ gboolean gst_m3u8_client_get_next_fragment (GstM3U8Client * client,
     gboolean * discontinuity, gchar ** uri, GstClockTime * duration,
     GstClockTime * timestamp, gint64 * range_start, gint64 * range_end,
     gchar ** key, guint8 ** iv, gboolean forward);
+gboolean gst_m3u8_client_peek_fragment (GstM3U8Client * client, guint ahead,
+    gchar ** uri, gint64 * range_start, gint64 * range_end, gboolean forward);
 gboolean gst_m3u8_client_has_next_fragment (GstM3U8Client * client, gboolean forward);
 void gst_m3u8_client_advance_fragment (GstM3U8Client * client, gboolean forward);
 GstClockTime gst_m3u8_client_get_duration (GstM3U8Client * client);
@@ -122,6 +125,7 @@ GList * gst_m3u8_client_get_playlist_for_bitrate (GstM3U8Client * client,
     guint bitrate);
 
 guint64 gst_m3u8_client_get_current_fragment_duration (GstM3U8Client * client);
+gboolean gst_m3u8_client_seek (GstM3U8Client * client, GstClockTime position);
 
 gboolean gst_m3u8_client_get_seek_range(GstM3U8Client * client, gint64 * start, gint64 * stop);
 
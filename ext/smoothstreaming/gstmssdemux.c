@@ -134,6 +134,9 @@ static gboolean gst_mss_demux_stream_select_bitrate (GstAdaptiveDemuxStream *
     stream, guint64 bitrate);
 static GstFlowReturn
 gst_mss_demux_stream_update_fragment_info (GstAdaptiveDemuxStream * stream);
+static guint
+gst_mss_demux_stream_peek_fragments (GstAdaptiveDemuxStream * stream,
+    GstAdaptiveDemuxStreamFragment * fragments, guint n_fragments);
 static gboolean gst_mss_demux_seek (GstAdaptiveDemux * demux, GstEvent * seek);
 static gint64
 gst_mss_demux_get_manifest_update_interval (GstAdaptiveDemux * demux);
@@ -204,6 +207,8 @@ gst_mss_demux_class_init (GstMssDemuxClass * klass)
       gst_mss_demux_stream_select_bitrate;
   gstadaptivedemux_class->stream_update_fragment_info =
       gst_mss_demux_stream_update_fragment_info;
+  gstadaptivedemux_class->stream_peek_fragments =
+      gst_mss_demux_stream_peek_fragments;
   gstadaptivedemux_class->update_manifest = gst_mss_demux_update_manifest;
 
   GST_DEBUG_CATEGORY_INIT (mssdemux_debug, "mssdemux", 0, "mssdemux plugin");
@@ -337,12 +342,34 @@ gst_mss_demux_stream_update_fragment_info (GstAdaptiveDemuxStream * stream)
   return ret;
 }
 
+static guint
+gst_mss_demux_stream_peek_fragments (GstAdaptiveDemuxStream * stream,
+    GstAdaptiveDemuxStreamFragment * fragments, guint n_fragments)
+{
+  GstMssDemuxStream *mssstream = (GstMssDemuxStream *) stream;
+  GstMssDemux *mssdemux = GST_MSS_DEMUX_CAST (stream->demux);
+  gchar *path = NULL;
+  guint i;
+
+  for (i = 0; i < n_fragments; i++) {
+    if (gst_mss_stream_peek_fragment_url (mssstream->manifest_stream, i + 1,
+            stream->demux->segment.rate >= 0, &path) != GST_FLOW_OK)
+      break;
+
+    fragments[i].uri = g_strdup_printf ("%s/%s", mssdemux->base_url, path);
+    g_free (path);
+  }
+
+  return i;
+}
+
 static GstFlowReturn
 gst_mss_demux_stream_seek (GstAdaptiveDemuxStream * stream, GstClockTime ts)
 {
   GstMssDemuxStream *mssstream = (GstMssDemuxStream *) stream;
 
-  gst_mss_stream_seek (mssstream->manifest_stream, ts);
+  gst_mss_stream_seek (mssstream->manifest_stream,
+      stream->demux->segment.rate >= 0, ts);
   return GST_FLOW_OK;
 }
 
@@ -499,6 +526,30 @@ gst_mss_demux_process_manifest (GstAdaptiveDemux * demux, GstBuffer * buf)
   return gst_mss_demux_setup_streams (demux);
 }
 
+static void
+gst_mss_demux_stream_update_caps (GstAdaptiveDemuxStream * stream)
+{
+  GstMssDemuxStream *mssstream = (GstMssDemuxStream *) stream;
+  GstCaps *caps;
+  GstCaps *msscaps;
+
+  caps = gst_mss_stream_get_caps (mssstream->manifest_stream);
+
+  GST_DEBUG_OBJECT (stream->pad,
+      "Starting streams reconfiguration due to bitrate changes");
+  msscaps = create_mss_caps (mssstream, caps);
+
+  GST_DEBUG_OBJECT (stream->pad,
+      "Stream changed bitrate to %" G_GUINT64_FORMAT " caps: %"
+      GST_PTR_FORMAT,
+      gst_mss_stream_get_current_bitrate (mssstream->manifest_stream), caps);
+
+  gst_caps_unref (caps);
+
+  gst_adaptive_demux_stream_set_caps (stream, msscaps);
+  GST_DEBUG_OBJECT (stream->pad, "Finished streams reconfiguration");
+}
+
 static gboolean
 gst_mss_demux_stream_select_bitrate (GstAdaptiveDemuxStream * stream,
     guint64 bitrate)
@@ -516,24 +567,8 @@ gst_mss_demux_stream_select_bitrate (GstAdaptiveDemuxStream * stream,
       "Using stream download bitrate %" G_GUINT64_FORMAT, bitrate);
 
   if (gst_mss_stream_select_bitrate (mssstream->manifest_stream, bitrate)) {
-    GstCaps *caps;
-    GstCaps *msscaps;
-    caps = gst_mss_stream_get_caps (mssstream->manifest_stream);
-
-    GST_DEBUG_OBJECT (stream->pad,
-        "Starting streams reconfiguration due to bitrate changes");
-    msscaps = create_mss_caps (mssstream, caps);
-
-    GST_DEBUG_OBJECT (stream->pad,
-        "Stream changed bitrate to %" G_GUINT64_FORMAT " caps: %"
-        GST_PTR_FORMAT,
-        gst_mss_stream_get_current_bitrate (mssstream->manifest_stream), caps);
-
-    gst_caps_unref (caps);
-
-    gst_adaptive_demux_stream_set_caps (stream, msscaps);
+    gst_mss_demux_stream_update_caps (stream);
     ret = TRUE;
-    GST_DEBUG_OBJECT (stream->pad, "Finished streams reconfiguration");
   }
   return ret;
 }
@@ -547,6 +582,7 @@ gst_mss_demux_seek (GstAdaptiveDemux * demux, GstEvent * seek)
   GstSeekType start_type, stop_type;
   gint64 start, stop;
   GstMssDemux *mssdemux = GST_MSS_DEMUX_CAST (demux);
+  GList *iter;
 
   gst_event_parse_seek (seek, &rate, &format, &flags, &start_type, &start,
       &stop_type, &stop);
@@ -555,7 +591,18 @@ gst_mss_demux_seek (GstAdaptiveDemux * demux, GstEvent * seek)
       "seek event, rate: %f start: %" GST_TIME_FORMAT " stop: %"
       GST_TIME_FORMAT, rate, GST_TIME_ARGS (start), GST_TIME_ARGS (stop));
 
-  gst_mss_manifest_seek (mssdemux->manifest, start);
+  /* Use keyframe-only downloads of the lowest bitrate for trick modes */
+  for (iter = demux->streams; iter; iter = g_list_next (iter)) {
+    GstMssDemuxStream *stream = iter->data;
+
+    if (gst_mss_stream_set_trick_mode (stream->manifest_stream, rate))
+      gst_mss_demux_stream_update_caps (GST_ADAPTIVE_DEMUX_STREAM_CAST
+          (stream));
+  }
+
+  /* Reverse playback starts from the end of the segment */
+  gst_mss_manifest_seek (mssdemux->manifest, rate >= 0, rate >= 0 ? start :
+      stop);
 
   return TRUE;
 }
@@ -26,6 +26,7 @@
 #include <ctype.h>
 #include <libxml/parser.h>
 #include <libxml/tree.h>
+#include <libxml/xmlreader.h>
 
 /* for parsing h264 codec data */
 #include <gst/codecparsers/gsth264parser.h>
@@ -38,6 +39,7 @@ GST_DEBUG_CATEGORY_EXTERN (mssdemux_debug);
 #define DEFAULT_TIMESCALE             10000000
 
 #define MSS_NODE_STREAM_FRAGMENT      "c"
+#define MSS_NODE_STREAM_INDEX         "StreamIndex"
 #define MSS_NODE_STREAM_QUALITY       "QualityLevel"
 
 #define MSS_PROP_BITRATE              "Bitrate"
@@ -50,6 +52,7 @@ GST_DEBUG_CATEGORY_EXTERN (mssdemux_debug);
 #define MSS_PROP_TIMESCALE            "TimeScale"
 #define MSS_PROP_URL                  "Url"
 
+/* A run of @repetitions fragments of the same @duration, starting at @time */
 typedef struct _GstMssStreamFragment
 {
   guint number;
@@ -73,16 +76,22 @@ struct _GstMssStream
   gboolean active;              /* if the stream is currently being used */
   gint selectedQualityIndex;
 
-  GList *fragments;
+  GArray *fragments;            /* sorted GstMssStreamFragment runs */
   GList *qualities;
 
   gchar *url;
   gchar *lang;
 
   guint fragment_repetition_index;
-  GList *current_fragment;
+  guint current_fragment;       /* fragments->len when the stream is over */
   GList *current_quality;
 
+  /* keyframe-only trick mode */
+  gboolean trick_mode;
+  guint trick_mode_stride;      /* fragments to move forward/backward */
+  gboolean trick_mode_skip;     /* not a video stream, nothing to download */
+  GList *normal_quality;        /* quality to restore after the trick mode */
+
   /* TODO move this to somewhere static */
   GRegex *regex_bitrate;
   GRegex *regex_position;
@@ -98,12 +107,17 @@ struct _GstMssManifest
   GSList *streams;
 };
 
+#define FRAGMENT(fragments, i) \
+  (&g_array_index ((fragments), GstMssStreamFragment, (i)))
+#define FRAGMENT_END(fragment) \
+  ((fragment)->time + (fragment)->duration * (fragment)->repetitions)
+
 /* For parsing and building a fragments list */
 typedef struct _GstMssFragmentListBuilder
 {
-  GList *fragments;
+  GArray *fragments;
 
-  GstMssStreamFragment *previous_fragment;
+  gint previous_fragment;       /* waiting for its duration, or -1 */
   guint fragment_number;
   guint64 fragment_time_accum;
 } GstMssFragmentListBuilder;
@@ -111,12 +125,40 @@ typedef struct _GstMssFragmentListBuilder
 static void
 gst_mss_fragment_list_builder_init (GstMssFragmentListBuilder * builder)
 {
-  builder->fragments = NULL;
-  builder->previous_fragment = NULL;
+  builder->fragments = g_array_new (FALSE, FALSE,
+      sizeof (GstMssStreamFragment));
+  builder->previous_fragment = -1;
   builder->fragment_time_accum = 0;
   builder->fragment_number = 0;
 }
 
+/* Merges the last fragment run into the one before it if it continues it
+ * with the same duration, so that lists of individual fragments end up in
+ * a few runs.
+ *
+ * Many manifests, live ones especially, list every fragment as its own
+ * "c" node without an "r" attribute. Without coalescing, N fragments of
+ * the same duration would be N entries, and seeking or merging a reloaded
+ * manifest would walk all of them. Coalesced, they are a single run with
+ * N repetitions and fragments->len goes from N to 1. */
+static void
+gst_mss_fragment_list_builder_coalesce (GstMssFragmentListBuilder * builder)
+{
+  GstMssStreamFragment *last, *previous;
+
+  if (builder->fragments->len < 2)
+    return;
+
+  last = FRAGMENT (builder->fragments, builder->fragments->len - 1);
+  previous = FRAGMENT (builder->fragments, builder->fragments->len - 2);
+  if (last->duration == 0 || last->duration != previous->duration
+      || last->time != FRAGMENT_END (previous))
+    return;
+
+  previous->repetitions += last->repetitions;
+  g_array_set_size (builder->fragments, builder->fragments->len - 1);
+}
+
 static void
 gst_mss_fragment_list_builder_add (GstMssFragmentListBuilder * builder,
     xmlNodePtr node)
@@ -125,7 +167,8 @@ gst_mss_fragment_list_builder_add (GstMssFragmentListBuilder * builder,
   gchar *time_str;
   gchar *seqnum_str;
   gchar *repetition_str;
-  GstMssStreamFragment *fragment = g_new (GstMssStreamFragment, 1);
+  GstMssStreamFragment fragment_data = { 0, };
+  GstMssStreamFragment *fragment = &fragment_data;
 
   duration_str = (gchar *) xmlGetProp (node, (xmlChar *) MSS_PROP_DURATION);
   time_str = (gchar *) xmlGetProp (node, (xmlChar *) MSS_PROP_TIME);
@@ -160,29 +203,41 @@ gst_mss_fragment_list_builder_add (GstMssFragmentListBuilder * builder,
   }
 
   /* if we have a previous fragment, means we need to set its duration */
-  if (builder->previous_fragment)
-    builder->previous_fragment->duration =
-        (fragment->time -
-        builder->previous_fragment->time) /
-        builder->previous_fragment->repetitions;
+  if (builder->previous_fragment >= 0) {
+    GstMssStreamFragment *previous =
+        FRAGMENT (builder->fragments, builder->previous_fragment);
+
+    previous->duration = (fragment->time - previous->time) /
+        previous->repetitions;
+    /* Now that its end is known, it can be merged. It is the last entry
+     * since nothing was appended after it */
+    gst_mss_fragment_list_builder_coalesce (builder);
+  }
 
   if (duration_str) {
     fragment->duration = g_ascii_strtoull (duration_str, NULL, 10);
 
-    builder->previous_fragment = NULL;
+    builder->previous_fragment = -1;
     builder->fragment_time_accum += fragment->duration * fragment->repetitions;
     xmlFree (duration_str);
   } else {
     /* store to set the duration at the next iteration */
-    builder->previous_fragment = fragment;
+    builder->previous_fragment = builder->fragments->len;
   }
 
-  /* we reverse it later */
-  builder->fragments = g_list_prepend (builder->fragments, fragment);
+  /* Logged before appending, as the fragment may not get an entry of its
+   * own */
   GST_LOG ("Adding fragment number: %u, time: %" G_GUINT64_FORMAT
       ", duration: %" G_GUINT64_FORMAT ", repetitions: %u",
       fragment->number, fragment->time, fragment->duration,
       fragment->repetitions);
+  g_array_append_val (builder->fragments, fragment_data);
+  /* A fragment without duration can't be merged yet: its duration, and so
+   * its end, is only known from the time of the next node, and
+   * previous_fragment must keep pointing at it until then. It is
+   * coalesced once its duration is set above */
+  if (builder->previous_fragment < 0)
+    gst_mss_fragment_list_builder_coalesce (builder);
 }
 
 static GstBuffer *gst_buffer_from_hex_string (const gchar * s);
@@ -254,13 +309,13 @@ _gst_mss_stream_init (GstMssStream * stream, xmlNodePtr node)
     }
   }
 
-  stream->fragments = g_list_reverse (builder.fragments);
+  stream->fragments = builder.fragments;
 
   /* order them from smaller to bigger based on bitrates */
   stream->qualities =
       g_list_sort (stream->qualities, (GCompareFunc) compare_bitrate);
 
-  stream->current_fragment = stream->fragments;
+  stream->current_fragment = 0;
   stream->current_quality = stream->qualities;
 
   stream->regex_bitrate = g_regex_new ("\\{[Bb]itrate\\}", 0, 0, NULL);
@@ -310,7 +365,7 @@ gst_mss_manifest_new (GstBuffer * data)
 static void
 gst_mss_stream_free (GstMssStream * stream)
 {
-  g_list_free_full (stream->fragments, g_free);
+  g_array_free (stream->fragments, TRUE);
   g_list_free_full (stream->qualities,
       (GDestroyNotify) gst_mss_stream_quality_free);
   xmlFree (stream->url);
@@ -862,24 +917,14 @@ gst_mss_stream_get_caps (GstMssStream * stream)
   return caps;
 }
 
-GstFlowReturn
-gst_mss_stream_get_fragment_url (GstMssStream * stream, gchar ** url)
+static GstFlowReturn
+gst_mss_stream_build_fragment_url (GstMssStream * stream, guint64 time,
+    gchar ** url)
 {
   gchar *tmp;
   gchar *start_time_str;
-  guint64 time;
-  GstMssStreamFragment *fragment;
   GstMssStreamQuality *quality = stream->current_quality->data;
 
-  g_return_val_if_fail (stream->active, GST_FLOW_ERROR);
-
-  if (stream->current_fragment == NULL) /* stream is over */
-    return GST_FLOW_EOS;
-
-  fragment = stream->current_fragment->data;
-
-  time =
-      fragment->time + fragment->duration * stream->fragment_repetition_index;
   start_time_str = g_strdup_printf ("%" G_GUINT64_FORMAT, time);
 
   tmp = g_regex_replace_literal (stream->regex_bitrate, stream->url,
@@ -896,31 +941,118 @@ gst_mss_stream_get_fragment_url (GstMssStream * stream, gchar ** url)
   return GST_FLOW_OK;
 }
 
-GstClockTime
-gst_mss_stream_get_fragment_gst_timestamp (GstMssStream * stream)
+/* Time of the current fragment in timescale units, or the end of the last
+ * fragment once the stream is over */
+static guint64
+gst_mss_stream_get_fragment_time (GstMssStream * stream)
 {
-  guint64 time;
-  guint64 timescale;
   GstMssStreamFragment *fragment;
 
-  g_return_val_if_fail (stream->active, GST_FLOW_ERROR);
+  if (stream->current_fragment >= stream->fragments->len) {
+    if (stream->fragments->len == 0)
+      return 0;
+
+    fragment = FRAGMENT (stream->fragments, stream->fragments->len - 1);
+    return FRAGMENT_END (fragment);
+  }
+
+  fragment = FRAGMENT (stream->fragments, stream->current_fragment);
+  return fragment->time +
+      fragment->duration * stream->fragment_repetition_index;
+}
+
+/* Moves the run @index and the @repetition inside it by @steps fragments,
+ * returns FALSE when going out of the fragments list */
+static gboolean
+gst_mss_stream_move (GstMssStream * stream, gint64 steps, guint * index,
+    guint * repetition)
+{
+  GstMssStreamFragment *fragment;
+  gint64 pos = (gint64) * repetition + steps;
+  guint i = *index;
 
-  if (!stream->current_fragment) {
-    GList *last = g_list_last (stream->fragments);
-    if (last == NULL)
-      return GST_CLOCK_TIME_NONE;
+  if (i >= stream->fragments->len)
+    return FALSE;
 
-    fragment = last->data;
-    return fragment->time + (fragment->duration * fragment->repetitions);
+  fragment = FRAGMENT (stream->fragments, i);
+  while (pos >= (gint64) fragment->repetitions) {
+    pos -= fragment->repetitions;
+    if (++i >= stream->fragments->len)
+      return FALSE;
+    fragment = FRAGMENT (stream->fragments, i);
+  }
+  while (pos < 0) {
+    if (i-- == 0)
+      return FALSE;
+    fragment = FRAGMENT (stream->fragments, i);
+    pos += fragment->repetitions;
   }
 
-  fragment = stream->current_fragment->data;
+  *index = i;
+  *repetition = pos;
+  return TRUE;
+}
+
+/* Number of fragments to move at once, more than one in trick mode */
+static gint64
+gst_mss_stream_get_stride (GstMssStream * stream)
+{
+  return stream->trick_mode ? stream->trick_mode_stride : 1;
+}
+
+GstFlowReturn
+gst_mss_stream_get_fragment_url (GstMssStream * stream, gchar ** url)
+{
+  g_return_val_if_fail (stream->active, GST_FLOW_ERROR);
+
+  if (stream->current_fragment >= stream->fragments->len
+      || stream->trick_mode_skip)       /* stream is over */
+    return GST_FLOW_EOS;
+
+  return gst_mss_stream_build_fragment_url (stream,
+      gst_mss_stream_get_fragment_time (stream), url);
+}
+
+/* Gets the url of the fragment @ahead fragments after the current one,
+ * without advancing */
+GstFlowReturn
+gst_mss_stream_peek_fragment_url (GstMssStream * stream, guint ahead,
+    gboolean forward, gchar ** url)
+{
+  GstMssStreamFragment *fragment;
+  guint index = stream->current_fragment;
+  guint repetition = stream->fragment_repetition_index;
+  gint64 steps;
+
+  g_return_val_if_fail (stream->active, GST_FLOW_ERROR);
+
+  if (stream->trick_mode_skip)
+    return GST_FLOW_EOS;
+
+  steps = (gint64) ahead * gst_mss_stream_get_stride (stream);
+  if (!gst_mss_stream_move (stream, forward ? steps : -steps, &index,
+          &repetition))
+    return GST_FLOW_EOS;
+
+  fragment = FRAGMENT (stream->fragments, index);
+  return gst_mss_stream_build_fragment_url (stream,
+      fragment->time + fragment->duration * repetition, url);
+}
+
+GstClockTime
+gst_mss_stream_get_fragment_gst_timestamp (GstMssStream * stream)
+{
+  guint64 timescale;
+
+  g_return_val_if_fail (stream->active, GST_FLOW_ERROR);
+
+  if (stream->fragments->len == 0)
+    return GST_CLOCK_TIME_NONE;
 
-  time =
-      fragment->time + (fragment->duration * stream->fragment_repetition_index);
   timescale = gst_mss_stream_get_timescale (stream);
-  return (GstClockTime) gst_util_uint64_scale_round (time, GST_SECOND,
-      timescale);
+  return (GstClockTime)
+      gst_util_uint64_scale_round (gst_mss_stream_get_fragment_time (stream),
+      GST_SECOND, timescale);
 }
 
 GstClockTime
@@ -932,10 +1064,10 @@ gst_mss_stream_get_fragment_gst_duration (GstMssStream * stream)
 
   g_return_val_if_fail (stream->active, GST_FLOW_ERROR);
 
-  if (!stream->current_fragment)
+  if (stream->current_fragment >= stream->fragments->len)
     return GST_CLOCK_TIME_NONE;
 
-  fragment = stream->current_fragment->data;
+  fragment = FRAGMENT (stream->fragments, stream->current_fragment);
 
   dur = fragment->duration;
   timescale = gst_mss_stream_get_timescale (stream);
@@ -948,7 +1080,8 @@ gst_mss_stream_has_next_fragment (GstMssStream * stream)
 {
   g_return_val_if_fail (stream->active, FALSE);
 
-  if (stream->current_fragment == NULL)
+  if (stream->current_fragment >= stream->fragments->len
+      || stream->trick_mode_skip)
     return FALSE;
 
   return TRUE;
@@ -957,43 +1090,33 @@ gst_mss_stream_has_next_fragment (GstMssStream * stream)
 GstFlowReturn
 gst_mss_stream_advance_fragment (GstMssStream * stream)
 {
-  GstMssStreamFragment *fragment;
   g_return_val_if_fail (stream->active, GST_FLOW_ERROR);
 
-  if (stream->current_fragment == NULL)
+  if (stream->current_fragment >= stream->fragments->len)
     return GST_FLOW_EOS;
 
-  fragment = stream->current_fragment->data;
-  stream->fragment_repetition_index++;
-  if (stream->fragment_repetition_index < fragment->repetitions) {
-    return GST_FLOW_OK;
-  }
-
-  stream->fragment_repetition_index = 0;
-  stream->current_fragment = g_list_next (stream->current_fragment);
-  if (stream->current_fragment == NULL)
+  if (!gst_mss_stream_move (stream, gst_mss_stream_get_stride (stream),
+          &stream->current_fragment, &stream->fragment_repetition_index)) {
+    stream->current_fragment = stream->fragments->len;
+    stream->fragment_repetition_index = 0;
     return GST_FLOW_EOS;
+  }
   return GST_FLOW_OK;
 }
 
 GstFlowReturn
 gst_mss_stream_regress_fragment (GstMssStream * stream)
 {
-  GstMssStreamFragment *fragment;
   g_return_val_if_fail (stream->active, GST_FLOW_ERROR);
 
-  if (stream->current_fragment == NULL)
+  if (stream->current_fragment >= stream->fragments->len)
     return GST_FLOW_EOS;
 
-  fragment = stream->current_fragment->data;
-  if (stream->fragment_repetition_index == 0) {
-    stream->current_fragment = g_list_previous (stream->current_fragment);
-    if (stream->current_fragment == NULL)
-      return GST_FLOW_EOS;
-    fragment = stream->current_fragment->data;
-    stream->fragment_repetition_index = fragment->repetitions - 1;
-  } else {
-    stream->fragment_repetition_index--;
+  if (!gst_mss_stream_move (stream, -gst_mss_stream_get_stride (stream),
+          &stream->current_fragment, &stream->fragment_repetition_index)) {
+    stream->current_fragment = stream->fragments->len;
+    stream->fragment_repetition_index = 0;
+    return GST_FLOW_EOS;
   }
   return GST_FLOW_OK;
 }
@@ -1015,64 +1138,125 @@ gst_mss_stream_type_name (GstMssStreamType streamtype)
 /**
  * Seeks all streams to the fragment that contains the set time
  *
+ * @forward: if FALSE, the fragment containing the sample just before @time
  * @time: time in nanoseconds
  */
 void
-gst_mss_manifest_seek (GstMssManifest * manifest, guint64 time)
+gst_mss_manifest_seek (GstMssManifest * manifest, gboolean forward,
+    guint64 time)
 {
   GSList *iter;
 
   for (iter = manifest->streams; iter; iter = g_slist_next (iter)) {
-    gst_mss_stream_seek (iter->data, time);
+    gst_mss_stream_seek (iter->data, forward, time);
   }
 }
 
+/* Finds the fragment that contains @time, in timescale units, with a binary
+ * search on the runs. A time in a gap between two runs gives the first
+ * fragment after the gap. Returns FALSE if @time is after the last fragment */
+static gboolean
+gst_mss_stream_find_fragment (GstMssStream * stream, guint64 time,
+    guint * index, guint * repetition)
+{
+  GstMssStreamFragment *fragment;
+  guint low = 0, high = stream->fragments->len;
+
+  if (high == 0)
+    return FALSE;
+
+  /* last run starting at or before @time */
+  while (high - low > 1) {
+    guint mid = low + (high - low) / 2;
+
+    if (FRAGMENT (stream->fragments, mid)->time <= time)
+      low = mid;
+    else
+      high = mid;
+  }
+
+  fragment = FRAGMENT (stream->fragments, low);
+  *index = low;
+  *repetition = 0;
+  if (time < fragment->time || fragment->duration == 0)
+    return TRUE;
+
+  *repetition = (time - fragment->time) / fragment->duration;
+  if (*repetition >= fragment->repetitions) {
+    if (low + 1 >= stream->fragments->len)
+      return FALSE;
+    *index = low + 1;
+    *repetition = 0;
+  }
+  return TRUE;
+}
+
+static void
+gst_mss_stream_seek_time (GstMssStream * stream, guint64 time)
+{
+  if (!gst_mss_stream_find_fragment (stream, time, &stream->current_fragment,
+          &stream->fragment_repetition_index)) {
+    stream->current_fragment = stream->fragments->len;  /* EOS */
+    stream->fragment_repetition_index = 0;
+  }
+}
+
+/* Finds the last fragment starting before @time, in timescale units, which
+ * is where reverse playback up to @time starts. Returns FALSE if there is
+ * none */
+static gboolean
+gst_mss_stream_find_fragment_before (GstMssStream * stream, guint64 time,
+    guint * index, guint * repetition)
+{
+  GstMssStreamFragment *fragment;
+
+  if (stream->fragments->len == 0 || time == 0)
+    return FALSE;
+
+  if (!gst_mss_stream_find_fragment (stream, time - 1, index, repetition)) {
+    fragment = FRAGMENT (stream->fragments, stream->fragments->len - 1);
+    *index = stream->fragments->len - 1;
+    *repetition = fragment->repetitions - 1;
+    return TRUE;
+  }
+
+  /* in a gap, the fragment after it was found */
+  fragment = FRAGMENT (stream->fragments, *index);
+  if (fragment->time + (guint64) * repetition * fragment->duration > time - 1)
+    return gst_mss_stream_move (stream, -1, index, repetition);
+
+  return TRUE;
+}
+
 /**
  * Seeks this stream to the fragment that contains the sample at time
  *
+ * @forward: if FALSE, the fragment containing the sample just before @time,
+ *     or the last one if @time is GST_CLOCK_TIME_NONE
  * @time: time in nanoseconds
  */
 void
-gst_mss_stream_seek (GstMssStream * stream, guint64 time)
+gst_mss_stream_seek (GstMssStream * stream, gboolean forward, guint64 time)
 {
-  GList *iter;
   guint64 timescale;
-  GstMssStreamFragment *fragment = NULL;
 
   timescale = gst_mss_stream_get_timescale (stream);
-  time = gst_util_uint64_scale_round (time, timescale, GST_SECOND);
-
-  GST_DEBUG ("Stream %s seeking to %" G_GUINT64_FORMAT, stream->url, time);
-
-  for (iter = stream->fragments; iter; iter = g_list_next (iter)) {
-    GList *next = g_list_next (iter);
-    if (next) {
-      fragment = next->data;
-
-      if (fragment->time > time) {
-        stream->current_fragment = iter;
-        break;
-      }
-    } else {
-      fragment = iter->data;
-      if (fragment->time + fragment->repetitions * fragment->duration > time) {
-        stream->current_fragment = iter;
-      } else {
-        stream->current_fragment = NULL;        /* EOS */
-      }
-      break;
-    }
-  }
-
-  /* position inside the repetitions */
-  if (stream->current_fragment) {
-    fragment = stream->current_fragment->data;
-    stream->fragment_repetition_index =
-        (time - fragment->time) / fragment->duration;
+  if (GST_CLOCK_TIME_IS_VALID (time))
+    time = gst_util_uint64_scale_round (time, timescale, GST_SECOND);
+
+  GST_DEBUG ("Stream %s seeking %s to %" G_GUINT64_FORMAT, stream->url,
+      forward ? "forward" : "backward", time);
+
+  if (forward) {
+    gst_mss_stream_seek_time (stream, time);
+  } else if (!gst_mss_stream_find_fragment_before (stream, time,
+          &stream->current_fragment, &stream->fragment_repetition_index)) {
+    stream->current_fragment = stream->fragments->len;  /* EOS */
+    stream->fragment_repetition_index = 0;
   }
 
   GST_DEBUG ("Stream %s seeked to fragment time %" G_GUINT64_FORMAT
-      " repetition %u", stream->url, fragment->time,
+      " repetition %u", stream->url, gst_mss_stream_get_fragment_time (stream),
       stream->fragment_repetition_index);
 }
 
@@ -1101,73 +1285,140 @@ gst_mss_manifest_is_live (GstMssManifest * manifest)
   return manifest->is_live;
 }
 
+/* Appends the fragments of a reloaded manifest that come after the known
+ * ones, and drops the known ones that left the DVR window. Takes ownership of
+ * @fragments */
 static void
-gst_mss_stream_reload_fragments (GstMssStream * stream, xmlNodePtr streamIndex)
+gst_mss_stream_merge_fragments (GstMssStream * stream, GArray * fragments)
 {
-  xmlNodePtr iter;
-  guint64 current_gst_time = gst_mss_stream_get_fragment_gst_timestamp (stream);
-  GstMssFragmentListBuilder builder;
+  GstMssStreamFragment *last = NULL;
+  guint64 current_time, known_end = 0, window_start;
+  guint i, removed = 0;
 
-  gst_mss_fragment_list_builder_init (&builder);
+  if (fragments->len == 0) {
+    g_array_free (fragments, TRUE);
+    return;
+  }
 
-  GST_DEBUG ("Current position: %" GST_TIME_FORMAT,
-      GST_TIME_ARGS (current_gst_time));
+  current_time = gst_mss_stream_get_fragment_time (stream);
 
-  for (iter = streamIndex->children; iter; iter = iter->next) {
-    if (node_has_type (iter, MSS_NODE_STREAM_FRAGMENT)) {
-      gst_mss_fragment_list_builder_add (&builder, iter);
-    } else {
-      /* TODO gst log this */
-    }
+  if (stream->fragments->len > 0) {
+    last = FRAGMENT (stream->fragments, stream->fragments->len - 1);
+    known_end = FRAGMENT_END (last);
   }
 
-  /* store the new fragments list */
-  if (builder.fragments) {
-    g_list_free_full (stream->fragments, g_free);
-    stream->fragments = g_list_reverse (builder.fragments);
-    stream->current_fragment = stream->fragments;
-    gst_mss_stream_seek (stream, current_gst_time);
-  }
-}
+  for (i = 0; i < fragments->len; i++) {
+    GstMssStreamFragment fragment = *FRAGMENT (fragments, i);
 
-static void
-gst_mss_manifest_reload_fragments_from_xml (GstMssManifest * manifest,
-    xmlNodePtr root)
-{
-  xmlNodePtr nodeiter;
-  GSList *streams = manifest->streams;
+    if (last && last->duration == 0 && fragment.time == last->time) {
+      /* the duration of the last fragment is known now */
+      *last = fragment;
+    } else {
+      if (last && FRAGMENT_END (&fragment) <= known_end)
+        continue;
 
-  /* we assume the server is providing the streams in the same order in
-   * every manifest */
-  for (nodeiter = root->children; nodeiter && streams;
-      nodeiter = nodeiter->next) {
-    if (nodeiter->type == XML_ELEMENT_NODE
-        && (strcmp ((const char *) nodeiter->name, "StreamIndex") == 0)) {
-      gst_mss_stream_reload_fragments (streams->data, nodeiter);
-      streams = g_slist_next (streams);
+      if (last && fragment.time < known_end) {
+        /* the run was already partly known, only keep the new repetitions */
+        guint known = (known_end - fragment.time + fragment.duration - 1) /
+            fragment.duration;
+
+        fragment.number += known;
+        fragment.time += known * fragment.duration;
+        fragment.repetitions -= known;
+      }
+
+      if (last && fragment.time == known_end
+          && fragment.duration == last->duration) {
+        last->repetitions += fragment.repetitions;
+      } else {
+        g_array_append_val (stream->fragments, fragment);
+        last = FRAGMENT (stream->fragments, stream->fragments->len - 1);
+      }
     }
+    known_end = FRAGMENT_END (last);
   }
+
+  window_start = FRAGMENT (fragments, 0)->time;
+  while (removed < stream->fragments->len
+      && FRAGMENT_END (FRAGMENT (stream->fragments, removed)) <= window_start
+      && FRAGMENT (stream->fragments, removed)->duration > 0)
+    removed++;
+  if (removed > 0)
+    g_array_remove_range (stream->fragments, 0, removed);
+
+  GST_DEBUG ("Stream %s: %u fragment runs, %u removed", stream->url,
+      stream->fragments->len, removed);
+
+  g_array_free (fragments, TRUE);
+
+  /* back to the same position in the updated list */
+  gst_mss_stream_seek_time (stream, current_time);
 }
 
+/* Live manifests are read with a xmlTextReader, only expanding the fragment
+ * nodes, as only the fragments list is updated */
 void
 gst_mss_manifest_reload_fragments (GstMssManifest * manifest, GstBuffer * data)
 {
-  xmlDocPtr xml;
-  xmlNodePtr root;
+  xmlTextReaderPtr reader;
+  GstMssFragmentListBuilder builder = { NULL, };
+  GSList *streams = manifest->streams;
+  GstMssStream *stream = NULL;
   GstMapInfo info;
+  gint ret;
 
   g_return_if_fail (manifest->is_live);
 
   gst_buffer_map (data, &info, GST_MAP_READ);
 
-  xml = xmlReadMemory ((const gchar *) info.data,
-      info.size, "manifest", NULL, 0);
-  root = xmlDocGetRootElement (xml);
+  reader = xmlReaderForMemory ((const gchar *) info.data, info.size,
+      "manifest", NULL, 0);
+  if (reader == NULL) {
+    GST_WARNING ("Could not create a reader for the manifest");
+    gst_buffer_unmap (data, &info);
+    return;
+  }
+
+  /* we assume the server is providing the streams in the same order in
+   * every manifest */
+  ret = xmlTextReaderRead (reader);
+  while (ret == 1) {
+    const gchar *name;
 
-  gst_mss_manifest_reload_fragments_from_xml (manifest, root);
+    if (xmlTextReaderNodeType (reader) != XML_READER_TYPE_ELEMENT) {
+      ret = xmlTextReaderRead (reader);
+      continue;
+    }
+
+    name = (const gchar *) xmlTextReaderConstLocalName (reader);
+    if (strcmp (name, MSS_NODE_STREAM_INDEX) == 0) {
+      if (stream)
+        gst_mss_stream_merge_fragments (stream, builder.fragments);
+      stream = NULL;
+      if (streams == NULL)
+        break;
+
+      stream = streams->data;
+      streams = g_slist_next (streams);
+      gst_mss_fragment_list_builder_init (&builder);
+      ret = xmlTextReaderRead (reader);
+    } else if (stream && strcmp (name, MSS_NODE_STREAM_FRAGMENT) == 0) {
+      xmlNodePtr node = xmlTextReaderExpand (reader);
+
+      if (node)
+        gst_mss_fragment_list_builder_add (&builder, node);
+      ret = xmlTextReaderNext (reader);
+    } else if (strcmp (name, MSS_NODE_STREAM_QUALITY) == 0) {
+      ret = xmlTextReaderNext (reader);
+    } else {
+      ret = xmlTextReaderRead (reader);
+    }
+  }
 
-  xmlFreeDoc (xml);
+  if (stream)
+    gst_mss_stream_merge_fragments (stream, builder.fragments);
 
+  xmlFreeTextReader (reader);
   gst_buffer_unmap (data, &info);
 }
 
@@ -1178,6 +1429,10 @@ gst_mss_stream_select_bitrate (GstMssStream * stream, guint64 bitrate)
   GList *next;
   GstMssStreamQuality *q = iter->data;
 
+  /* the lowest bitrate is kept during the trick mode */
+  if (stream->trick_mode)
+    return FALSE;
+
   while (q->bitrate > bitrate) {
     next = g_list_previous (iter);
     if (next) {
@@ -1221,6 +1476,52 @@ gst_mss_stream_get_current_bitrate (GstMssStream * stream)
   return q->bitrate;
 }
 
+/**
+ * gst_mss_stream_set_trick_mode:
+ * @stream: the stream
+ * @rate: the playback rate
+ *
+ * Rates faster than 1x in either direction enable the keyframe-only trick
+ * mode: video streams switch to their lowest bitrate and only download one
+ * fragment every |@rate| fragments, each fragment starting with a keyframe,
+ * and the other streams don't download anything.
+ *
+ * Return: %TRUE if the stream changed its bitrate
+ */
+gboolean
+gst_mss_stream_set_trick_mode (GstMssStream * stream, gdouble rate)
+{
+  gboolean trick_mode = ABS (rate) > 1.0;
+  GList *quality;
+
+  if (!trick_mode && !stream->trick_mode)
+    return FALSE;
+
+  stream->trick_mode = trick_mode;
+  stream->trick_mode_stride = trick_mode ? (guint) ABS (rate) : 1;
+  stream->trick_mode_skip = trick_mode
+      && gst_mss_stream_get_type (stream) != MSS_STREAM_TYPE_VIDEO;
+
+  GST_DEBUG ("Stream %s trick mode %d, stride %u", stream->url, trick_mode,
+      stream->trick_mode_stride);
+
+  if (stream->trick_mode_skip) {
+    return FALSE;
+  } else if (trick_mode) {
+    if (stream->normal_quality == NULL)
+      stream->normal_quality = stream->current_quality;
+    quality = stream->qualities;
+  } else {
+    quality = stream->normal_quality;
+    stream->normal_quality = NULL;
+  }
+
+  if (quality == NULL || quality == stream->current_quality)
+    return FALSE;
+  stream->current_quality = quality;
+  return TRUE;
+}
+
 /**
  * gst_mss_manifest_change_bitrate:
  * @manifest: the manifest
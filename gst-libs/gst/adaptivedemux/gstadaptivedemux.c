@@ -60,6 +60,23 @@
  *                       interrupted to save network bandwidth. When they are
  *                       relinked a reconfigure event is received and the
  *                       stream is restarted.
+ * - Prefetching: With the "prefetch-depth" property, the fragments that follow
+ *                the current one are downloaded concurrently in the
+ *                background, up to "prefetch-max-size" bytes per stream. They
+ *                are then pushed like the ones coming from the source element.
+ *                The prefetched fragments are dropped on seeks and bitrate
+ *                switches. Subclasses support it by implementing
+ *                stream_peek_fragments.
+ * - Connection reuse: The source elements of the streams and the downloaders
+ *                     are taken from a pool of idle sources kept per host,
+ *                     so that keep-alive connections survive stream
+ *                     switches, host changes and manifest updates. The
+ *                     "source-pool-stats" property reports the reuse rate.
+ * - Bitrate adaptation: The "abr-algorithm" property selects how the bitrate
+ *                       passed to stream_select_bitrate is computed from the
+ *                       downloaded chunks and the buffered duration (see
+ *                       #GstAdaptiveDemuxAbr). Each decision is posted as an
+ *                       "adaptive-streaming-abr-decision" element message.
  *
  * Subclasses:
  * While GstAdaptiveDemux is responsible for the workflow, it knows nothing
@@ -87,6 +104,22 @@ GST_DEBUG_CATEGORY (adaptivedemux_debug);
 #define MAX_DOWNLOAD_ERROR_COUNT 3
 #define DEFAULT_FAILED_COUNT 3
 
+#define DEFAULT_PREFETCH_DEPTH 0
+#define DEFAULT_PREFETCH_MAX_SIZE (16 * 1024 * 1024)
+#define DEFAULT_ABR_ALGORITHM GST_ADAPTIVE_DEMUX_ABR_EWMA
+#define DEFAULT_ABR_WINDOW_SIZE 10
+
+enum
+{
+  PROP_0,
+  PROP_PREFETCH_DEPTH,
+  PROP_PREFETCH_MAX_SIZE,
+  PROP_ABR_ALGORITHM,
+  PROP_ABR_WINDOW_SIZE,
+  PROP_SOURCE_POOL_STATS,
+  PROP_LAST
+};
+
 enum GstAdaptiveDemuxFlowReturn
 {
   GST_ADAPTIVE_DEMUX_FLOW_SWITCH = GST_FLOW_CUSTOM_SUCCESS_2 + 1
@@ -98,6 +131,8 @@ struct _GstAdaptiveDemuxPrivate
   GstBuffer *manifest_buffer;
 
   GstUriDownloader *downloader;
+  /* idle source elements shared by the streams and all the downloaders */
+  GstUriSourcePool *source_pool;
 
   GList *old_streams;
 
@@ -111,13 +146,48 @@ struct _GstAdaptiveDemuxPrivate
   gint64 next_update;
 
   gboolean exposing;
+
+  /* runs the downloads of the fragments fetched ahead */
+  GThreadPool *prefetch_pool;
+  guint prefetch_depth;
+  guint64 prefetch_max_size;
+
+  /* used to create the bitrate adaptation of new streams */
+  GstAdaptiveDemuxAbrAlgorithm abr_algorithm;
+  guint abr_window_size;
+  const GstAdaptiveDemuxAbrFuncs *abr_funcs;
 };
 
+/* A fragment that is downloaded ahead of time. It is referenced by the
+ * stream's queue and by the thread downloading it, and is only accessed
+ * with the stream's prefetch_lock */
+typedef struct
+{
+  gint ref_count;
+  GstAdaptiveDemuxStream *stream;
+
+  gchar *uri;
+  gint64 range_start;
+  gint64 range_end;
+
+  GstUriDownloader *downloader;
+  GstBuffer *buffer;
+  /* expected size, counted in the stream's prefetch_size until done */
+  guint64 reserved_size;
+  gint64 download_time;
+  gboolean done;
+  gboolean cancelled;
+} GstAdaptiveDemuxPrefetch;
+
 static GstBinClass *parent_class = NULL;
 static void gst_adaptive_demux_class_init (GstAdaptiveDemuxClass * klass);
 static void gst_adaptive_demux_init (GstAdaptiveDemux * dec,
     GstAdaptiveDemuxClass * klass);
 static void gst_adaptive_demux_finalize (GObject * object);
+static void gst_adaptive_demux_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec);
+static void gst_adaptive_demux_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec);
 static GstStateChangeReturn gst_adaptive_demux_change_state (GstElement *
     element, GstStateChange transition);
 
@@ -160,6 +230,8 @@ static gboolean gst_adaptive_demux_has_next_period (GstAdaptiveDemux * demux);
 static void gst_adaptive_demux_advance_period (GstAdaptiveDemux * demux);
 
 static void gst_adaptive_demux_stream_free (GstAdaptiveDemuxStream * stream);
+static void gst_adaptive_demux_stream_release_source (GstAdaptiveDemuxStream *
+    stream);
 static GstFlowReturn
 gst_adaptive_demux_stream_push_event (GstAdaptiveDemuxStream * stream,
     GstEvent * event);
@@ -180,6 +252,11 @@ static GstFlowReturn
 gst_adaptive_demux_stream_finish_fragment_default (GstAdaptiveDemux * demux,
     GstAdaptiveDemuxStream * stream);
 
+static void gst_adaptive_demux_prefetch_func (GstAdaptiveDemuxPrefetch *
+    prefetch, GstAdaptiveDemux * demux);
+static void gst_adaptive_demux_stream_prefetch_clear (GstAdaptiveDemuxStream *
+    stream);
+
 
 /* we can't use G_DEFINE_ABSTRACT_TYPE because we need the klass in the _init
  * method to get to the padtemplates */
@@ -227,6 +304,40 @@ gst_adaptive_demux_class_init (GstAdaptiveDemuxClass * klass)
   g_type_class_add_private (klass, sizeof (GstAdaptiveDemuxPrivate));
 
   gobject_class->finalize = gst_adaptive_demux_finalize;
+  gobject_class->set_property = gst_adaptive_demux_set_property;
+  gobject_class->get_property = gst_adaptive_demux_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_PREFETCH_DEPTH,
+      g_param_spec_uint ("prefetch-depth", "Prefetch depth",
+          "Number of fragments following the current one to download "
+          "concurrently (0 = disabled)", 0, 16, DEFAULT_PREFETCH_DEPTH,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_PREFETCH_MAX_SIZE,
+      g_param_spec_uint64 ("prefetch-max-size", "Prefetch max size",
+          "Maximum amount of data prefetched or being prefetched per stream, "
+          "in bytes",
+          0, G_MAXUINT64, DEFAULT_PREFETCH_MAX_SIZE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_ABR_ALGORITHM,
+      g_param_spec_enum ("abr-algorithm", "ABR algorithm",
+          "Algorithm used to select the bitrate of the next fragment, applied "
+          "to the streams created afterwards",
+          GST_TYPE_ADAPTIVE_DEMUX_ABR_ALGORITHM, DEFAULT_ABR_ALGORITHM,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_ABR_WINDOW_SIZE,
+      g_param_spec_uint ("abr-window-size", "ABR window size",
+          "Number of throughput samples averaged by the harmonic and buffer "
+          "algorithms", 1, 100, DEFAULT_ABR_WINDOW_SIZE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SOURCE_POOL_STATS,
+      g_param_spec_boxed ("source-pool-stats", "Source pool statistics",
+          "Reuse of the source elements and connections between the "
+          "downloads of the fragments and manifests", GST_TYPE_STRUCTURE,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 
   gstelement_class->change_state = gst_adaptive_demux_change_state;
 
@@ -247,9 +358,20 @@ gst_adaptive_demux_init (GstAdaptiveDemux * demux,
 
   demux->priv = GST_ADAPTIVE_DEMUX_GET_PRIVATE (demux);
   demux->priv->input_adapter = gst_adapter_new ();
+  demux->priv->source_pool = gst_uri_source_pool_new (0);
   demux->priv->downloader = gst_uri_downloader_new ();
+  gst_uri_downloader_set_source_pool (demux->priv->downloader,
+      demux->priv->source_pool);
   demux->stream_struct_size = sizeof (GstAdaptiveDemuxStream);
 
+  demux->priv->prefetch_depth = DEFAULT_PREFETCH_DEPTH;
+  demux->priv->prefetch_max_size = DEFAULT_PREFETCH_MAX_SIZE;
+  demux->priv->abr_algorithm = DEFAULT_ABR_ALGORITHM;
+  demux->priv->abr_window_size = DEFAULT_ABR_WINDOW_SIZE;
+  demux->priv->prefetch_pool =
+      g_thread_pool_new ((GFunc) gst_adaptive_demux_prefetch_func, demux, -1,
+      FALSE, NULL);
+
   gst_segment_init (&demux->segment, GST_FORMAT_TIME);
 
   g_rec_mutex_init (&demux->priv->updates_lock);
@@ -287,6 +409,8 @@ gst_adaptive_demux_finalize (GObject * object)
 
   g_object_unref (priv->input_adapter);
   g_object_unref (priv->downloader);
+  gst_object_unref (priv->source_pool);
+  g_thread_pool_free (priv->prefetch_pool, FALSE, TRUE);
 
   g_mutex_clear (&priv->updates_timed_lock);
   g_cond_clear (&priv->updates_timed_cond);
@@ -298,6 +422,82 @@ gst_adaptive_demux_finalize (GObject * object)
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
+static void
+gst_adaptive_demux_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstAdaptiveDemux *demux = GST_ADAPTIVE_DEMUX_CAST (object);
+
+  switch (prop_id) {
+    case PROP_PREFETCH_DEPTH:
+      GST_OBJECT_LOCK (demux);
+      demux->priv->prefetch_depth = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (demux);
+      break;
+    case PROP_PREFETCH_MAX_SIZE:
+      GST_OBJECT_LOCK (demux);
+      demux->priv->prefetch_max_size = g_value_get_uint64 (value);
+      GST_OBJECT_UNLOCK (demux);
+      break;
+    case PROP_ABR_ALGORITHM:{
+      GstAdaptiveDemuxAbrAlgorithm algorithm = g_value_get_enum (value);
+
+      GST_OBJECT_LOCK (demux);
+      /* custom only makes sense with gst_adaptive_demux_set_abr_funcs() */
+      if (algorithm != GST_ADAPTIVE_DEMUX_ABR_CUSTOM
+          || demux->priv->abr_funcs != NULL)
+        demux->priv->abr_algorithm = algorithm;
+      GST_OBJECT_UNLOCK (demux);
+      break;
+    }
+    case PROP_ABR_WINDOW_SIZE:
+      GST_OBJECT_LOCK (demux);
+      demux->priv->abr_window_size = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (demux);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_adaptive_demux_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstAdaptiveDemux *demux = GST_ADAPTIVE_DEMUX_CAST (object);
+
+  switch (prop_id) {
+    case PROP_PREFETCH_DEPTH:
+      GST_OBJECT_LOCK (demux);
+      g_value_set_uint (value, demux->priv->prefetch_depth);
+      GST_OBJECT_UNLOCK (demux);
+      break;
+    case PROP_PREFETCH_MAX_SIZE:
+      GST_OBJECT_LOCK (demux);
+      g_value_set_uint64 (value, demux->priv->prefetch_max_size);
+      GST_OBJECT_UNLOCK (demux);
+      break;
+    case PROP_ABR_ALGORITHM:
+      GST_OBJECT_LOCK (demux);
+      g_value_set_enum (value, demux->priv->abr_algorithm);
+      GST_OBJECT_UNLOCK (demux);
+      break;
+    case PROP_ABR_WINDOW_SIZE:
+      GST_OBJECT_LOCK (demux);
+      g_value_set_uint (value, demux->priv->abr_window_size);
+      GST_OBJECT_UNLOCK (demux);
+      break;
+    case PROP_SOURCE_POOL_STATS:
+      g_value_take_boxed (value,
+          gst_uri_source_pool_get_stats (demux->priv->source_pool));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
 static GstStateChangeReturn
 gst_adaptive_demux_change_state (GstElement * element,
     GstStateChange transition)
@@ -487,6 +687,9 @@ gst_adaptive_demux_reset (GstAdaptiveDemux * demux)
     demux->priv->old_streams = NULL;
   }
 
+  /* the next stream might be on different hosts */
+  gst_uri_source_pool_clear (demux->priv->source_pool);
+
   g_free (demux->manifest_uri);
   g_free (demux->manifest_base_uri);
   demux->manifest_uri = NULL;
@@ -710,10 +913,26 @@ gst_adaptive_demux_stream_new (GstAdaptiveDemux * demux, GstPad * pad)
       GST_DEBUG_FUNCPTR (gst_adaptive_demux_src_event));
 
   gst_segment_init (&stream->segment, GST_FORMAT_TIME);
+  gst_adaptive_demux_stream_fragment_clear (&stream->fragment);
+  stream->src_request_time = -1;
+  stream->pushed_end = GST_CLOCK_TIME_NONE;
   g_cond_init (&stream->fragment_download_cond);
   g_mutex_init (&stream->fragment_download_lock);
   stream->adapter = gst_adapter_new ();
 
+  g_mutex_init (&stream->prefetch_lock);
+  g_cond_init (&stream->prefetch_cond);
+  g_queue_init (&stream->prefetch_queue);
+  g_queue_init (&stream->prefetch_downloaders);
+
+  GST_OBJECT_LOCK (demux);
+  if (demux->priv->abr_algorithm == GST_ADAPTIVE_DEMUX_ABR_CUSTOM)
+    stream->abr = gst_adaptive_demux_abr_new_custom (demux->priv->abr_funcs);
+  else
+    stream->abr = gst_adaptive_demux_abr_new (demux->priv->abr_algorithm,
+        demux->priv->abr_window_size);
+  GST_OBJECT_UNLOCK (demux);
+
   demux->next_streams = g_list_append (demux->next_streams, stream);
 
   return stream;
@@ -745,6 +964,21 @@ gst_adaptive_demux_stream_free (GstAdaptiveDemuxStream * stream)
     stream->download_task = NULL;
   }
 
+  /* the prefetches still running hold a pointer to the stream */
+  gst_adaptive_demux_stream_prefetch_clear (stream);
+  g_mutex_lock (&stream->prefetch_lock);
+  while (stream->prefetch_pending > 0)
+    g_cond_wait (&stream->prefetch_cond, &stream->prefetch_lock);
+  g_mutex_unlock (&stream->prefetch_lock);
+  g_queue_foreach (&stream->prefetch_downloaders, (GFunc) g_object_unref,
+      NULL);
+  g_queue_clear (&stream->prefetch_downloaders);
+
+  gst_adaptive_demux_abr_free (stream->abr);
+
+  g_mutex_clear (&stream->prefetch_lock);
+  g_cond_clear (&stream->prefetch_cond);
+
   gst_adaptive_demux_stream_fragment_clear (&stream->fragment);
 
   if (stream->pending_segment) {
@@ -752,16 +986,8 @@ gst_adaptive_demux_stream_free (GstAdaptiveDemuxStream * stream)
     stream->pending_segment = NULL;
   }
 
-  if (stream->src_srcpad) {
-    gst_object_unref (stream->src_srcpad);
-    stream->src_srcpad = NULL;
-  }
-
-  if (stream->src) {
-    gst_element_set_state (stream->src, GST_STATE_NULL);
-    gst_bin_remove (GST_BIN_CAST (demux), stream->src);
-    stream->src = NULL;
-  }
+  if (stream->src)
+    gst_adaptive_demux_stream_release_source (stream);
 
   g_cond_clear (&stream->fragment_download_cond);
   g_mutex_clear (&stream->fragment_download_lock);
@@ -1114,6 +1340,7 @@ gst_adaptive_demux_stop_tasks (GstAdaptiveDemux * demux)
     stream->download_finished = TRUE;
     g_cond_signal (&stream->fragment_download_cond);
     g_mutex_unlock (&stream->fragment_download_lock);
+    gst_adaptive_demux_stream_prefetch_clear (stream);
   }
 
   for (iter = demux->streams; iter; iter = g_list_next (iter)) {
@@ -1164,27 +1391,129 @@ gst_adaptive_demux_stream_set_tags (GstAdaptiveDemuxStream * stream,
   stream->pending_tags = tags;
 }
 
+/**
+ * gst_adaptive_demux_set_abr_funcs:
+ * @demux: a #GstAdaptiveDemux
+ * @funcs: (allow-none): the functions implementing the bitrate adaptation,
+ *     they must stay valid for the lifetime of @demux
+ *
+ * Sets a custom bitrate adaptation algorithm and selects it as the
+ * "abr-algorithm". It is used for the streams created afterwards. Setting
+ * %NULL goes back to the default algorithm.
+ */
+void
+gst_adaptive_demux_set_abr_funcs (GstAdaptiveDemux * demux,
+    const GstAdaptiveDemuxAbrFuncs * funcs)
+{
+  g_return_if_fail (GST_IS_ADAPTIVE_DEMUX (demux));
+  g_return_if_fail (funcs == NULL || funcs->get_bitrate != NULL);
+
+  GST_OBJECT_LOCK (demux);
+  demux->priv->abr_funcs = funcs;
+  if (funcs)
+    demux->priv->abr_algorithm = GST_ADAPTIVE_DEMUX_ABR_CUSTOM;
+  else if (demux->priv->abr_algorithm == GST_ADAPTIVE_DEMUX_ABR_CUSTOM)
+    demux->priv->abr_algorithm = DEFAULT_ABR_ALGORITHM;
+  GST_OBJECT_UNLOCK (demux);
+}
+
+/**
+ * gst_adaptive_demux_get_source_pool:
+ * @demux: a #GstAdaptiveDemux
+ *
+ * Gets the pool of source elements used for the downloads of @demux.
+ * Subclasses should set it on their own #GstUriDownloader so that their
+ * requests share the connections with the rest of the element.
+ *
+ * Returns: (transfer none): the #GstUriSourcePool of @demux
+ */
+GstUriSourcePool *
+gst_adaptive_demux_get_source_pool (GstAdaptiveDemux * demux)
+{
+  g_return_val_if_fail (GST_IS_ADAPTIVE_DEMUX (demux), NULL);
+
+  return demux->priv->source_pool;
+}
+
+/* Called when the first buffer of a fragment is pushed. The segment position
+ * is the start of the fragment, the data pushed goes up to its end (or down
+ * to its start in reverse playback) */
+static void
+gst_adaptive_demux_stream_update_pushed_end (GstAdaptiveDemuxStream * stream)
+{
+  GstClockTime start = stream->fragment.timestamp;
+  GstClockTime duration = stream->fragment.duration;
+
+  if (stream->demux->segment.rate < 0 || !GST_CLOCK_TIME_IS_VALID (duration))
+    stream->pushed_end = start;
+  else
+    stream->pushed_end = start + duration;
+}
+
+/* Duration of the data pushed on the stream and not played yet, or
+ * GST_CLOCK_TIME_NONE if it is not known because the pipeline isn't
+ * running */
+static GstClockTime
+gst_adaptive_demux_stream_get_buffer_level (GstAdaptiveDemuxStream * stream)
+{
+  GstElement *element = GST_ELEMENT_CAST (stream->demux);
+  GstClockTime level = GST_CLOCK_TIME_NONE;
+  GstClockTime base_time, now, position;
+  GstClock *clock;
+
+  if (!GST_CLOCK_TIME_IS_VALID (stream->pushed_end))
+    return GST_CLOCK_TIME_NONE;
+
+  position = gst_segment_to_running_time (&stream->segment, GST_FORMAT_TIME,
+      stream->pushed_end);
+  if (!GST_CLOCK_TIME_IS_VALID (position))
+    return GST_CLOCK_TIME_NONE;
+
+  GST_OBJECT_LOCK (element);
+  if (GST_STATE (element) == GST_STATE_PLAYING && element->clock) {
+    clock = gst_object_ref (element->clock);
+    base_time = element->base_time;
+    GST_OBJECT_UNLOCK (element);
+
+    now = gst_clock_get_time (clock);
+    gst_object_unref (clock);
+    if (now > base_time) {
+      now -= base_time;
+      level = position > now ? position - now : 0;
+    }
+  } else {
+    GST_OBJECT_UNLOCK (element);
+  }
+
+  return level;
+}
+
+/* Feeds the finished fragment to the bitrate adaptation and returns the
+ * bitrate to select for the next one */
 static guint64
 gst_adaptive_demux_stream_update_current_bitrate (GstAdaptiveDemuxStream *
-    stream)
+    stream, GstClockTime duration, GstClockTime * buffer_level)
 {
-  guint64 bitrate = 0;
+  guint64 bandwidth, bitrate;
+
+  if (!GST_CLOCK_TIME_IS_VALID (duration))
+    duration = stream->fragment.duration;
+
+  gst_adaptive_demux_abr_fragment_finished (stream->abr,
+      stream->abr_fragment_bytes, stream->abr_fragment_time, duration);
+  stream->abr_fragment_bytes = 0;
+  stream->abr_fragment_time = 0;
 
-  if (stream->download_total_time)
-    bitrate =
-        (stream->download_total_bytes * 8) /
-        ((double) stream->download_total_time / G_GUINT64_CONSTANT (1000000));
+  *buffer_level = gst_adaptive_demux_stream_get_buffer_level (stream);
+  bandwidth = gst_adaptive_demux_abr_get_bandwidth (stream->abr);
+  bitrate = gst_adaptive_demux_abr_get_bitrate (stream->abr, *buffer_level);
 
-  if (stream->current_download_rate != -1)
-    bitrate = (stream->current_download_rate + bitrate * 3) / 4;
-  if (bitrate > G_MAXINT)
-    bitrate = G_MAXINT;
-  stream->current_download_rate = bitrate;
-  GST_DEBUG_OBJECT (stream->pad, "Bitrate: %" G_GUINT64_FORMAT
-      " (bytes: %" G_GINT64_FORMAT " / %" G_GINT64_FORMAT " microsecs",
-      bitrate, stream->download_total_bytes, stream->download_total_time);
+  stream->current_download_rate = MIN (bandwidth, G_MAXINT);
+  GST_DEBUG_OBJECT (stream->pad, "Bandwidth: %" G_GUINT64_FORMAT
+      ", bitrate: %" G_GUINT64_FORMAT ", buffer level: %" GST_TIME_FORMAT,
+      bandwidth, bitrate, GST_TIME_ARGS (*buffer_level));
 
-  return bitrate;
+  return MIN (bitrate, G_MAXINT);
 }
 
 static GstFlowReturn
@@ -1233,8 +1562,10 @@ gst_adaptive_demux_stream_push_buffer (GstAdaptiveDemuxStream * stream,
       discont = TRUE;
 
     GST_BUFFER_PTS (buffer) = stream->fragment.timestamp;
-    if (GST_BUFFER_PTS_IS_VALID (buffer))
+    if (GST_BUFFER_PTS_IS_VALID (buffer)) {
       stream->segment.position = GST_BUFFER_PTS (buffer);
+      gst_adaptive_demux_stream_update_pushed_end (stream);
+    }
   } else {
     GST_BUFFER_PTS (buffer) = GST_CLOCK_TIME_NONE;
   }
@@ -1306,14 +1637,16 @@ gst_adaptive_demux_stream_data_received_default (GstAdaptiveDemux * demux,
   return gst_adaptive_demux_stream_push_buffer (stream, buffer);
 }
 
+/* Handles a chunk of the fragment being downloaded, from the source element
+ * or from a prefetched fragment */
 static GstFlowReturn
-_src_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
+gst_adaptive_demux_stream_chain (GstAdaptiveDemuxStream * stream,
+    GstBuffer * buffer)
 {
-  GstPad *srcpad = (GstPad *) parent;
-  GstAdaptiveDemuxStream *stream = gst_pad_get_element_private (srcpad);
   GstAdaptiveDemux *demux = stream->demux;
   GstAdaptiveDemuxClass *klass = GST_ADAPTIVE_DEMUX_GET_CLASS (demux);
   GstFlowReturn ret = GST_FLOW_OK;
+  gint64 chunk_time;
 
   if (stream->starting_fragment) {
     stream->starting_fragment = FALSE;
@@ -1326,17 +1659,24 @@ _src_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
     GST_LOG_OBJECT (stream->pad, "set fragment pts=%" GST_TIME_FORMAT,
         GST_TIME_ARGS (GST_BUFFER_PTS (buffer)));
 
-    if (GST_BUFFER_PTS_IS_VALID (buffer))
+    if (GST_BUFFER_PTS_IS_VALID (buffer)) {
       stream->segment.position = GST_BUFFER_PTS (buffer);
+      gst_adaptive_demux_stream_update_pushed_end (stream);
+    }
 
   } else {
     GST_BUFFER_PTS (buffer) = GST_CLOCK_TIME_NONE;
   }
 
-  stream->download_total_time +=
-      g_get_monotonic_time () - stream->download_chunk_start_time;
+  chunk_time = g_get_monotonic_time () - stream->download_chunk_start_time;
+  stream->download_total_time += chunk_time;
   stream->download_total_bytes += gst_buffer_get_size (buffer);
 
+  stream->abr_fragment_time += chunk_time * GST_USECOND;
+  stream->abr_fragment_bytes += gst_buffer_get_size (buffer);
+  gst_adaptive_demux_abr_add_sample (stream->abr, gst_buffer_get_size (buffer),
+      chunk_time * GST_USECOND);
+
   gst_adapter_push (stream->adapter, buffer);
   GST_DEBUG_OBJECT (stream->pad, "Received buffer of size %" G_GSIZE_FORMAT
       ". Now %" G_GSIZE_FORMAT " on adapter", gst_buffer_get_size (buffer),
@@ -1364,6 +1704,33 @@ _src_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
   return ret;
 }
 
+static GstFlowReturn
+_src_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
+{
+  GstPad *srcpad = (GstPad *) parent;
+  GstAdaptiveDemuxStream *stream = gst_pad_get_element_private (srcpad);
+
+  if (stream->src_request_time != -1) {
+    gst_uri_source_pool_record_first_byte (stream->demux->priv->source_pool,
+        stream->src, (g_get_monotonic_time () - stream->src_request_time) *
+        GST_USECOND);
+    stream->src_request_time = -1;
+  }
+
+  return gst_adaptive_demux_stream_chain (stream, buffer);
+}
+
+/* Called when all the data of the fragment was received */
+static void
+gst_adaptive_demux_stream_end_of_fragment (GstAdaptiveDemuxStream * stream)
+{
+  GstAdaptiveDemuxClass *klass = GST_ADAPTIVE_DEMUX_GET_CLASS (stream->demux);
+  GstFlowReturn ret;
+
+  ret = klass->finish_fragment (stream->demux, stream);
+  gst_adaptive_demux_stream_fragment_download_finish (stream, ret, NULL);
+}
+
 static void
 gst_adaptive_demux_stream_fragment_download_finish (GstAdaptiveDemuxStream *
     stream, GstFlowReturn ret, GError * err)
@@ -1394,15 +1761,9 @@ _src_event (GstPad * pad, GstObject * parent, GstEvent * event)
   GstAdaptiveDemuxStream *stream = gst_pad_get_element_private (srcpad);
 
   switch (GST_EVENT_TYPE (event)) {
-    case GST_EVENT_EOS:{
-      GstAdaptiveDemuxClass *klass;
-      GstFlowReturn ret;
-
-      klass = GST_ADAPTIVE_DEMUX_GET_CLASS (stream->demux);
-      ret = klass->finish_fragment (stream->demux, stream);
-      gst_adaptive_demux_stream_fragment_download_finish (stream, ret, NULL);
+    case GST_EVENT_EOS:
+      gst_adaptive_demux_stream_end_of_fragment (stream);
       break;
-    }
     default:
       break;
   }
@@ -1493,6 +1854,28 @@ gst_adaptive_demux_stream_clear_eos_and_flush_state (GstAdaptiveDemuxStream *
   gst_object_unref (internal_pad);
 }
 
+/* Takes the source element out of the stream and gives it back to the pool,
+ * which keeps it for another request to the same host if it is idle */
+static void
+gst_adaptive_demux_stream_release_source (GstAdaptiveDemuxStream * stream)
+{
+  GstAdaptiveDemux *demux = stream->demux;
+  GstElement *src = stream->src;
+
+  stream->src = NULL;
+  if (stream->pad)
+    gst_ghost_pad_set_target (GST_GHOST_PAD_CAST (stream->pad), NULL);
+  gst_object_replace ((GstObject **) & stream->src_srcpad, NULL);
+
+  /* a download that didn't finish leaves the connection in an unknown
+   * state, don't reuse it */
+  if (GST_STATE (src) > GST_STATE_READY)
+    gst_element_set_state (src, GST_STATE_NULL);
+
+  gst_bin_remove (GST_BIN_CAST (demux), src);
+  gst_uri_source_pool_release (demux->priv->source_pool, src);
+}
+
 static gboolean
 gst_adaptive_demux_stream_update_source (GstAdaptiveDemuxStream * stream,
     const gchar * uri, const gchar * referer, gboolean refresh,
@@ -1506,20 +1889,17 @@ gst_adaptive_demux_stream_update_source (GstAdaptiveDemuxStream * stream,
   }
 
   if (stream->src != NULL) {
-    gchar *old_protocol, *new_protocol;
     gchar *old_uri;
+    gboolean same_host;
 
     old_uri = gst_uri_handler_get_uri (GST_URI_HANDLER (stream->src));
-    old_protocol = gst_uri_get_protocol (old_uri);
-    new_protocol = gst_uri_get_protocol (uri);
-
-    if (!g_str_equal (old_protocol, new_protocol)) {
-      gst_object_unref (stream->src_srcpad);
-      gst_element_set_state (stream->src, GST_STATE_NULL);
-      gst_bin_remove (GST_BIN_CAST (demux), stream->src);
-      stream->src = NULL;
-      stream->src_srcpad = NULL;
+    same_host = old_uri && gst_uri_source_pool_is_same_host (old_uri, uri);
+    g_free (old_uri);
+
+    if (!same_host) {
+      /* keep the connection to the old host for whoever needs it next */
       GST_DEBUG_OBJECT (demux, "Can't re-use old source element");
+      gst_adaptive_demux_stream_release_source (stream);
     } else {
       GError *err = NULL;
 
@@ -1528,23 +1908,17 @@ gst_adaptive_demux_stream_update_source (GstAdaptiveDemuxStream * stream,
         GST_DEBUG_OBJECT (demux, "Failed to re-use old source element: %s",
             err->message);
         g_clear_error (&err);
-        gst_object_unref (stream->src_srcpad);
         gst_element_set_state (stream->src, GST_STATE_NULL);
-        gst_bin_remove (GST_BIN_CAST (demux), stream->src);
-        stream->src = NULL;
-        stream->src_srcpad = NULL;
+        gst_adaptive_demux_stream_release_source (stream);
       }
     }
-    g_free (old_uri);
-    g_free (old_protocol);
-    g_free (new_protocol);
   }
 
   if (stream->src == NULL) {
     GObjectClass *gobject_class;
     GstPad *internal_pad;
 
-    stream->src = gst_element_make_from_uri (GST_URI_SRC, uri, NULL, NULL);
+    stream->src = gst_uri_source_pool_acquire (demux->priv->source_pool, uri);
     if (stream->src == NULL) {
       GST_ELEMENT_ERROR (demux, CORE, MISSING_PLUGIN,
           ("Missing plugin to handle URI: '%s'", uri), (NULL));
@@ -1581,7 +1955,7 @@ gst_adaptive_demux_stream_update_source (GstAdaptiveDemuxStream * stream,
     }
 
     gst_element_set_locked_state (stream->src, TRUE);
-    gst_bin_add (GST_BIN_CAST (demux), stream->src);
+    gst_bin_add (GST_BIN_CAST (demux), gst_object_ref (stream->src));
     stream->src_srcpad = gst_element_get_static_pad (stream->src, "src");
 
     gst_ghost_pad_set_target (GST_GHOST_PAD_CAST (stream->pad),
@@ -1613,6 +1987,7 @@ gst_adaptive_demux_stream_download_uri (GstAdaptiveDemux * demux,
       " - %" G_GINT64_FORMAT, uri, start, end);
 
   stream->download_finished = FALSE;
+  stream->src_request_time = g_get_monotonic_time ();
 
   if (!gst_adaptive_demux_stream_update_source (stream, uri, NULL, FALSE, TRUE)) {
     g_mutex_lock (&stream->fragment_download_lock);
@@ -1675,6 +2050,275 @@ gst_adaptive_demux_stream_download_uri (GstAdaptiveDemux * demux,
   return ret;
 }
 
+/* must be called with the stream's prefetch_lock */
+static void
+gst_adaptive_demux_prefetch_unref (GstAdaptiveDemuxPrefetch * prefetch)
+{
+  GstAdaptiveDemuxStream *stream = prefetch->stream;
+
+  if (--prefetch->ref_count > 0)
+    return;
+
+  /* keep the downloaders around, they can reuse their connection */
+  gst_uri_downloader_reset (prefetch->downloader);
+  g_queue_push_tail (&stream->prefetch_downloaders, prefetch->downloader);
+  if (prefetch->buffer) {
+    stream->prefetch_size -= gst_buffer_get_size (prefetch->buffer);
+    gst_buffer_unref (prefetch->buffer);
+  }
+  g_free (prefetch->uri);
+  g_slice_free (GstAdaptiveDemuxPrefetch, prefetch);
+}
+
+/* must be called with the stream's prefetch_lock */
+static void
+gst_adaptive_demux_prefetch_cancel (GstAdaptiveDemuxPrefetch * prefetch)
+{
+  GST_DEBUG_OBJECT (prefetch->stream->pad, "Cancelling prefetch of %s",
+      prefetch->uri);
+
+  prefetch->cancelled = TRUE;
+  if (!prefetch->done)
+    gst_uri_downloader_cancel (prefetch->downloader);
+  gst_adaptive_demux_prefetch_unref (prefetch);
+}
+
+static gboolean
+gst_adaptive_demux_prefetch_matches (GstAdaptiveDemuxPrefetch * prefetch,
+    GstAdaptiveDemuxStreamFragment * fragment)
+{
+  return fragment->uri && g_str_equal (prefetch->uri, fragment->uri)
+      && prefetch->range_start == fragment->range_start
+      && prefetch->range_end == fragment->range_end;
+}
+
+static void
+gst_adaptive_demux_prefetch_func (GstAdaptiveDemuxPrefetch * prefetch,
+    GstAdaptiveDemux * demux)
+{
+  GstAdaptiveDemuxStream *stream = prefetch->stream;
+  GstFragment *download = NULL;
+  gint64 start_time;
+
+  g_mutex_lock (&stream->prefetch_lock);
+  if (!prefetch->cancelled) {
+    g_mutex_unlock (&stream->prefetch_lock);
+
+    GST_DEBUG_OBJECT (stream->pad, "Prefetching %s", prefetch->uri);
+    start_time = g_get_monotonic_time ();
+    download = gst_uri_downloader_fetch_uri_with_range (prefetch->downloader,
+        prefetch->uri, NULL, FALSE, FALSE, TRUE, prefetch->range_start,
+        prefetch->range_end, NULL);
+
+    g_mutex_lock (&stream->prefetch_lock);
+    prefetch->download_time = g_get_monotonic_time () - start_time;
+  }
+
+  if (download) {
+    if (!prefetch->cancelled)
+      prefetch->buffer = gst_fragment_get_buffer (download);
+    g_object_unref (download);
+  }
+
+  /* the actual size replaces the reserved one */
+  stream->prefetch_size -= prefetch->reserved_size;
+  prefetch->reserved_size = 0;
+
+  if (prefetch->buffer) {
+    stream->prefetch_size += gst_buffer_get_size (prefetch->buffer);
+    stream->prefetch_fragment_size = gst_buffer_get_size (prefetch->buffer);
+    GST_DEBUG_OBJECT (stream->pad, "Prefetched %s: %" G_GSIZE_FORMAT
+        " bytes in %" G_GINT64_FORMAT " us", prefetch->uri,
+        gst_buffer_get_size (prefetch->buffer), prefetch->download_time);
+  } else if (!prefetch->cancelled) {
+    GST_INFO_OBJECT (stream->pad, "Failed to prefetch %s", prefetch->uri);
+  }
+
+  prefetch->done = TRUE;
+  stream->prefetch_pending--;
+  g_cond_broadcast (&stream->prefetch_cond);
+  gst_adaptive_demux_prefetch_unref (prefetch);
+  g_mutex_unlock (&stream->prefetch_lock);
+}
+
+/* Cancels all the prefetches of the stream */
+static void
+gst_adaptive_demux_stream_prefetch_clear (GstAdaptiveDemuxStream * stream)
+{
+  GstAdaptiveDemuxPrefetch *prefetch;
+
+  g_mutex_lock (&stream->prefetch_lock);
+  while ((prefetch = g_queue_pop_head (&stream->prefetch_queue)))
+    gst_adaptive_demux_prefetch_cancel (prefetch);
+  g_cond_broadcast (&stream->prefetch_cond);
+  g_mutex_unlock (&stream->prefetch_lock);
+}
+
+/* Starts downloading the fragments that follow the current one, and drops
+ * the ones that aren't going to be used anymore.
+ * must be called with the manifest lock */
+static void
+gst_adaptive_demux_stream_prefetch (GstAdaptiveDemux * demux,
+    GstAdaptiveDemuxStream * stream)
+{
+  GstAdaptiveDemuxClass *klass = GST_ADAPTIVE_DEMUX_GET_CLASS (demux);
+  GstAdaptiveDemuxStreamFragment *fragments;
+  GstAdaptiveDemuxPrefetch *prefetch;
+  guint depth, n_fragments, i;
+  guint64 max_size;
+  gboolean matching = TRUE;
+  GList *iter;
+
+  GST_OBJECT_LOCK (demux);
+  depth = demux->priv->prefetch_depth;
+  max_size = demux->priv->prefetch_max_size;
+  GST_OBJECT_UNLOCK (demux);
+
+  if (klass->stream_peek_fragments == NULL)
+    return;
+
+  fragments = g_new0 (GstAdaptiveDemuxStreamFragment, depth + 1);
+  for (i = 0; i <= depth; i++)
+    gst_adaptive_demux_stream_fragment_clear (&fragments[i]);
+  n_fragments = depth > 0 ?
+      klass->stream_peek_fragments (stream, &fragments[1], depth) : 0;
+
+  /* The current fragment is downloaded normally if it isn't queued yet */
+  fragments[0].uri = g_strdup (stream->fragment.uri);
+  fragments[0].range_start = stream->fragment.range_start;
+  fragments[0].range_end = stream->fragment.range_end;
+
+  g_mutex_lock (&stream->prefetch_lock);
+
+  /* Keep the queued fragments as long as they are the expected ones, in
+   * order, and cancel the rest. After a seek or a bitrate switch nothing
+   * matches anymore */
+  i = 0;
+  iter = stream->prefetch_queue.head;
+  while (iter) {
+    GList *next = iter->next;
+
+    prefetch = iter->data;
+    if (matching && i <= n_fragments
+        && gst_adaptive_demux_prefetch_matches (prefetch, &fragments[i])) {
+      i++;
+    } else {
+      matching = FALSE;
+      g_queue_delete_link (&stream->prefetch_queue, iter);
+      gst_adaptive_demux_prefetch_cancel (prefetch);
+    }
+    iter = next;
+  }
+  i = MAX (stream->prefetch_queue.length, 1);
+
+  /* prefetch_size also counts the expected size of the downloads still
+   * running, that of their range or else that of the last prefetch. As
+   * long as nothing was prefetched yet, only one is started at a time */
+  for (; i <= n_fragments && !demux->cancelled; i++) {
+    guint64 reserved_size;
+
+    if (fragments[i].uri == NULL || stream->prefetch_size >= max_size)
+      break;
+
+    if (fragments[i].range_end >= 0)
+      reserved_size =
+          fragments[i].range_end - MAX (fragments[i].range_start, 0) + 1;
+    else
+      reserved_size = stream->prefetch_fragment_size;
+    if (reserved_size == 0 && stream->prefetch_pending > 0)
+      break;
+
+    prefetch = g_slice_new0 (GstAdaptiveDemuxPrefetch);
+    prefetch->ref_count = 2;
+    prefetch->stream = stream;
+    prefetch->uri = g_strdup (fragments[i].uri);
+    prefetch->range_start = fragments[i].range_start;
+    prefetch->range_end = fragments[i].range_end;
+    prefetch->reserved_size = reserved_size;
+    stream->prefetch_size += reserved_size;
+    prefetch->downloader = g_queue_pop_head (&stream->prefetch_downloaders);
+    if (prefetch->downloader == NULL) {
+      prefetch->downloader = gst_uri_downloader_new ();
+      gst_uri_downloader_set_source_pool (prefetch->downloader,
+          demux->priv->source_pool);
+    }
+
+    g_queue_push_tail (&stream->prefetch_queue, prefetch);
+    stream->prefetch_pending++;
+    g_thread_pool_push (demux->priv->prefetch_pool, prefetch, NULL);
+  }
+
+  g_mutex_unlock (&stream->prefetch_lock);
+
+  for (i = 0; i <= depth; i++)
+    gst_adaptive_demux_stream_fragment_clear (&fragments[i]);
+  g_free (fragments);
+}
+
+/* Returns the prefetched data for the current fragment, waiting for its
+ * download to finish, or NULL if it has to be downloaded normally */
+static GstBuffer *
+gst_adaptive_demux_stream_prefetch_take (GstAdaptiveDemuxStream * stream,
+    gint64 * download_time)
+{
+  GstAdaptiveDemuxPrefetch *prefetch;
+  GstBuffer *buffer = NULL;
+
+  g_mutex_lock (&stream->prefetch_lock);
+  prefetch = g_queue_peek_head (&stream->prefetch_queue);
+  if (prefetch == NULL
+      || !gst_adaptive_demux_prefetch_matches (prefetch, &stream->fragment))
+    goto done;
+
+  GST_DEBUG_OBJECT (stream->pad, "Waiting for prefetch of %s", prefetch->uri);
+  prefetch->ref_count++;
+  while (!prefetch->done && !prefetch->cancelled)
+    g_cond_wait (&stream->prefetch_cond, &stream->prefetch_lock);
+
+  if (!prefetch->cancelled) {
+    /* Still at the head, only the download loop pops prefetches */
+    g_queue_pop_head (&stream->prefetch_queue);
+    gst_adaptive_demux_prefetch_unref (prefetch);
+
+    if (prefetch->buffer) {
+      buffer = prefetch->buffer;
+      prefetch->buffer = NULL;
+      stream->prefetch_size -= gst_buffer_get_size (buffer);
+      *download_time = prefetch->download_time;
+    }
+  }
+  gst_adaptive_demux_prefetch_unref (prefetch);
+
+done:
+  g_mutex_unlock (&stream->prefetch_lock);
+  return buffer;
+}
+
+/* Feeds a prefetched fragment as if it came from the source element */
+static GstFlowReturn
+gst_adaptive_demux_stream_push_prefetched (GstAdaptiveDemuxStream * stream,
+    GstBuffer * buffer, gint64 download_time)
+{
+  GstFlowReturn ret;
+
+  GST_DEBUG_OBJECT (stream->pad, "Using prefetched fragment %s",
+      stream->fragment.uri);
+
+  stream->download_finished = FALSE;
+  stream->download_start_time = stream->download_chunk_start_time =
+      g_get_monotonic_time () - download_time;
+
+  ret = gst_adaptive_demux_stream_chain (stream, buffer);
+  if (ret == GST_FLOW_OK || ret == GST_FLOW_EOS)
+    gst_adaptive_demux_stream_end_of_fragment (stream);
+
+  g_mutex_lock (&stream->fragment_download_lock);
+  ret = stream->last_ret;
+  g_mutex_unlock (&stream->fragment_download_lock);
+
+  return ret;
+}
+
 static GstFlowReturn
 gst_adaptive_demux_stream_download_header_fragment (GstAdaptiveDemuxStream *
     stream)
@@ -1741,9 +2385,17 @@ gst_adaptive_demux_stream_download_fragment (GstAdaptiveDemuxStream * stream)
   url = stream->fragment.uri;
   GST_DEBUG_OBJECT (stream->pad, "Got url '%s' for stream %p", url, stream);
   if (url) {
-    ret =
-        gst_adaptive_demux_stream_download_uri (demux, stream, url,
-        stream->fragment.range_start, stream->fragment.range_end);
+    GstBuffer *buffer;
+    gint64 download_time;
+
+    buffer = gst_adaptive_demux_stream_prefetch_take (stream, &download_time);
+    if (buffer) {
+      ret = gst_adaptive_demux_stream_push_prefetched (stream, buffer,
+          download_time);
+    } else {
+      ret = gst_adaptive_demux_stream_download_uri (demux, stream, url,
+          stream->fragment.range_start, stream->fragment.range_end);
+    }
     GST_DEBUG_OBJECT (stream->pad, "Fragment download result: %d %s",
         stream->last_ret, gst_flow_get_name (stream->last_ret));
     if (ret != GST_FLOW_OK) {
@@ -1906,6 +2558,8 @@ gst_adaptive_demux_stream_download_loop (GstAdaptiveDemuxStream * stream)
         gst_adaptive_demux_stream_download_wait (stream, wait_time);
     }
 
+    gst_adaptive_demux_stream_prefetch (demux, stream);
+
     GST_MANIFEST_UNLOCK (demux);
 
     GST_OBJECT_LOCK (demux);
@@ -2222,13 +2876,18 @@ gst_adaptive_demux_stream_advance_fragment_unlocked (GstAdaptiveDemux * demux,
 {
   GstAdaptiveDemuxClass *klass = GST_ADAPTIVE_DEMUX_GET_CLASS (demux);
   GstFlowReturn ret;
+  gint64 chunk_time;
 
   g_return_val_if_fail (klass->stream_advance_fragment != NULL, GST_FLOW_ERROR);
 
   stream->download_error_count = 0;
   g_clear_error (&stream->last_error);
-  stream->download_total_time +=
-      g_get_monotonic_time () - stream->download_chunk_start_time;
+  chunk_time = g_get_monotonic_time () - stream->download_chunk_start_time;
+  stream->download_total_time += chunk_time;
+
+  /* the wait for the end of the fragment is download time too */
+  stream->abr_fragment_time += chunk_time * GST_USECOND;
+  gst_adaptive_demux_abr_add_sample (stream->abr, 0, chunk_time * GST_USECOND);
 
   /* FIXME - url has no indication of byte ranges for subsegments */
   gst_element_post_message (GST_ELEMENT_CAST (demux),
@@ -2252,10 +2911,38 @@ gst_adaptive_demux_stream_advance_fragment_unlocked (GstAdaptiveDemux * demux,
       g_get_monotonic_time ();
 
   if (ret == GST_FLOW_OK) {
-    if (gst_adaptive_demux_stream_select_bitrate (demux, stream,
-            gst_adaptive_demux_stream_update_current_bitrate (stream))) {
+    guint64 fragment_bytes = stream->abr_fragment_bytes;
+    GstClockTime fragment_time = stream->abr_fragment_time;
+    GstClockTime buffer_level;
+    guint64 bitrate;
+    gboolean switched;
+
+    bitrate = gst_adaptive_demux_stream_update_current_bitrate (stream,
+        duration, &buffer_level);
+    switched = gst_adaptive_demux_stream_select_bitrate (demux, stream,
+        bitrate);
+
+    gst_element_post_message (GST_ELEMENT_CAST (demux),
+        gst_message_new_element (GST_OBJECT_CAST (demux),
+            gst_structure_new (ABR_DECISION_MESSAGE_NAME,
+                "stream", G_TYPE_STRING, GST_PAD_NAME (stream->pad),
+                "algorithm", GST_TYPE_ADAPTIVE_DEMUX_ABR_ALGORITHM,
+                gst_adaptive_demux_abr_get_algorithm (stream->abr),
+                "fragment-size", G_TYPE_UINT64, fragment_bytes,
+                "fragment-download-time", GST_TYPE_CLOCK_TIME, fragment_time,
+                "fragment-duration", GST_TYPE_CLOCK_TIME,
+                GST_CLOCK_TIME_IS_VALID (duration) ? duration :
+                stream->fragment.duration,
+                "buffer-level", GST_TYPE_CLOCK_TIME, buffer_level,
+                "bandwidth", G_TYPE_UINT64,
+                (guint64) stream->current_download_rate,
+                "bitrate", G_TYPE_UINT64, bitrate,
+                "switched", G_TYPE_BOOLEAN, switched, NULL)));
+
+    if (switched) {
       stream->need_header = TRUE;
       gst_adapter_clear (stream->adapter);
+      gst_adaptive_demux_stream_prefetch_clear (stream);
       ret = (GstFlowReturn) GST_ADAPTIVE_DEMUX_FLOW_SWITCH;
     }
 
@@ -24,6 +24,8 @@
 
 #include <gst/gst.h>
 #include <gst/base/gstadapter.h>
+#include <gst/uridownloader/gsturisourcepool.h>
+#include "gstadaptivedemuxabr.h"
 
 G_BEGIN_DECLS
 
@@ -63,6 +65,7 @@ G_BEGIN_DECLS
 #define GST_ADAPTIVE_DEMUX_STREAM_NEED_HEADER(obj) (((GstAdaptiveDemuxStream *) (obj))->need_header)
 
 #define STATISTICS_MESSAGE_NAME "adaptive-streaming-statistics"
+#define ABR_DECISION_MESSAGE_NAME "adaptive-streaming-abr-decision"
 
 #define GST_MANIFEST_GET_LOCK(d) (&(GST_ADAPTIVE_DEMUX_CAST(d)->manifest_lock))
 #define GST_MANIFEST_LOCK(d) (g_mutex_lock (GST_MANIFEST_GET_LOCK (d)))
@@ -143,11 +146,27 @@ struct _GstAdaptiveDemuxStream
   gint64 download_total_time;
   gint64 download_total_bytes;
   gint current_download_rate;
+  gint64 src_request_time;
+
+  /* bitrate adaptation, fed with the downloaded chunks */
+  GstAdaptiveDemuxAbr *abr;
+  guint64 abr_fragment_bytes;
+  GstClockTime abr_fragment_time;
+  GstClockTime pushed_end;      /* end of the last fragment pushed */
 
   GstAdaptiveDemuxStreamFragment fragment;
 
   guint download_error_count;
 
+  /* fragments downloaded ahead of the current one, in order */
+  GMutex prefetch_lock;
+  GCond prefetch_cond;
+  GQueue prefetch_queue;
+  GQueue prefetch_downloaders;
+  guint prefetch_pending;
+  guint64 prefetch_size;
+  guint64 prefetch_fragment_size;
+
   /* TODO check if used */
   gboolean eos;
 };
@@ -292,6 +311,22 @@ struct _GstAdaptiveDemuxClass
    *          if there is no fragment.
    */
   GstFlowReturn (*stream_update_fragment_info) (GstAdaptiveDemuxStream * stream);
+  /**
+   * stream_peek_fragments:
+   * @stream: #GstAdaptiveDemuxStream
+   * @fragments: the fragments to fill
+   * @n_fragments: the number of fragments wanted
+   *
+   * Optional. Sets the information about the fragments that follow the
+   * current one without advancing the stream, so that they can be downloaded
+   * in advance. Only the uri and range fields are used. Fragments that are
+   * not certain to be available yet must not be returned.
+   *
+   * Returns: the number of fragments that were set
+   */
+  guint         (*stream_peek_fragments) (GstAdaptiveDemuxStream * stream,
+                                          GstAdaptiveDemuxStreamFragment * fragments,
+                                          guint n_fragments);
   /**
    * stream_select_bitrate:
    * @stream: #GstAdaptiveDemuxStream
@@ -379,6 +414,10 @@ void gst_adaptive_demux_stream_set_tags (GstAdaptiveDemuxStream * stream,
                                          GstTagList * tags);
 void gst_adaptive_demux_stream_fragment_clear (GstAdaptiveDemuxStreamFragment * f);
 
+void gst_adaptive_demux_set_abr_funcs (GstAdaptiveDemux * demux,
+                                       const GstAdaptiveDemuxAbrFuncs * funcs);
+GstUriSourcePool *gst_adaptive_demux_get_source_pool (GstAdaptiveDemux * demux);
+
 GstFlowReturn gst_adaptive_demux_stream_push_buffer (GstAdaptiveDemuxStream * stream, GstBuffer * buffer);
 GstFlowReturn
 gst_adaptive_demux_stream_advance_fragment (GstAdaptiveDemux * demux,
@@ -0,0 +1,441 @@
+/* GStreamer
+ *
+ * gstadaptivedemuxabr.c: bandwidth estimation and bitrate adaptation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * SECTION:gstadaptivedemuxabr
+ * @short_description: Bitrate adaptation for adaptive demuxers
+ *
+ * A #GstAdaptiveDemuxAbr is fed with the chunks and fragments downloaded by
+ * a stream and gives the bitrate to select for the next fragment. It does
+ * not depend on the demuxer, so recorded download traces can be replayed
+ * through it offline.
+ *
+ * The built-in algorithms are:
+ * - ewma: the previous behaviour of #GstAdaptiveDemux, an average of the
+ *         download rates of whole fragments. It is slow to react to changes.
+ * - harmonic: the harmonic mean of the throughput of the last chunks
+ *             received. Chunks are grouped into samples of at least
+ *             100 milliseconds so that small reads don't give meaningless
+ *             rates, and the shorter tails of fragments are ignored. The
+ *             harmonic mean is dominated by the low samples, which makes it
+ *             quick to go down and slow to go up.
+ * - buffer: the harmonic estimate scaled by the amount of media buffered
+ *           ahead of playback. With less than 2 fragments buffered it asks
+ *           for at most half of the throughput and with more than 6 it asks
+ *           for a bit more than the throughput, so it only switches up when
+ *           there is enough data to absorb a wrong guess.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstadaptivedemuxabr.h"
+
+/* minimum amount of download time grouped in a throughput sample */
+#define ABR_MIN_SAMPLE_TIME (100 * GST_MSECOND)
+/* fragment duration assumed until the first fragment is finished */
+#define ABR_DEFAULT_FRAGMENT_DURATION (2 * GST_SECOND)
+
+/* buffer levels, in fragment durations, between which the buffer based
+ * algorithm scales the throughput from ABR_BUFFER_LOW_FACTOR to
+ * ABR_BUFFER_HIGH_FACTOR */
+#define ABR_BUFFER_LOW_FRAGMENTS 2
+#define ABR_BUFFER_HIGH_FRAGMENTS 6
+#define ABR_BUFFER_LOW_FACTOR 0.5
+#define ABR_BUFFER_HIGH_FACTOR 1.25
+
+struct _GstAdaptiveDemuxAbr
+{
+  const GstAdaptiveDemuxAbrFuncs *funcs;
+  GstAdaptiveDemuxAbrAlgorithm algorithm;
+  guint window_size;
+
+  gpointer state;
+};
+
+typedef struct
+{
+  /* ewma */
+  gint64 average;
+
+  /* harmonic and buffer: ring of the last samples, in bits per second */
+  guint64 *rates;
+  guint n_rates;
+  guint rates_pos;
+  guint64 pending_bytes;
+  GstClockTime pending_time;
+  gboolean fragment_sampled;    /* a sample was taken in this fragment */
+
+  GstClockTime fragment_duration;
+} GstAdaptiveDemuxAbrBuiltin;
+
+GType
+gst_adaptive_demux_abr_algorithm_get_type (void)
+{
+  static volatile gsize type = 0;
+  static const GEnumValue values[] = {
+    {GST_ADAPTIVE_DEMUX_ABR_EWMA,
+        "Moving average of the fragment download rates", "ewma"},
+    {GST_ADAPTIVE_DEMUX_ABR_HARMONIC,
+        "Harmonic mean of the last chunk throughputs", "harmonic"},
+    {GST_ADAPTIVE_DEMUX_ABR_BUFFER,
+        "Throughput scaled by the buffer level", "buffer"},
+    {GST_ADAPTIVE_DEMUX_ABR_CUSTOM, "Application provided algorithm",
+        "custom"},
+    {0, NULL, NULL}
+  };
+
+  if (g_once_init_enter (&type)) {
+    GType _type =
+        g_enum_register_static ("GstAdaptiveDemuxAbrAlgorithm", values);
+    g_once_init_leave (&type, _type);
+  }
+  return type;
+}
+
+static guint64
+_bitrate (guint64 bytes, GstClockTime time)
+{
+  if (time == 0)
+    return 0;
+  return gst_util_uint64_scale (bytes, 8 * GST_SECOND, time);
+}
+
+static void
+_builtin_init (GstAdaptiveDemuxAbr * abr)
+{
+  GstAdaptiveDemuxAbrBuiltin *b = abr->state;
+
+  b->average = -1;
+  b->rates = g_new0 (guint64, MAX (abr->window_size, 1));
+  b->fragment_duration = ABR_DEFAULT_FRAGMENT_DURATION;
+}
+
+static void
+_builtin_clear (GstAdaptiveDemuxAbr * abr)
+{
+  GstAdaptiveDemuxAbrBuiltin *b = abr->state;
+
+  g_free (b->rates);
+}
+
+static void
+_ewma_fragment_finished (GstAdaptiveDemuxAbr * abr, guint64 bytes,
+    GstClockTime download_time, GstClockTime duration)
+{
+  GstAdaptiveDemuxAbrBuiltin *b = abr->state;
+  guint64 bitrate = _bitrate (bytes, download_time);
+
+  if (b->average != -1)
+    bitrate = (b->average + bitrate * 3) / 4;
+  if (bitrate > G_MAXINT)
+    bitrate = G_MAXINT;
+  b->average = bitrate;
+}
+
+static guint64
+_ewma_get_bandwidth (GstAdaptiveDemuxAbr * abr)
+{
+  GstAdaptiveDemuxAbrBuiltin *b = abr->state;
+
+  return MAX (b->average, 0);
+}
+
+static guint64
+_ewma_get_bitrate (GstAdaptiveDemuxAbr * abr, GstClockTime buffer_level)
+{
+  return _ewma_get_bandwidth (abr);
+}
+
+static void
+_harmonic_push_pending (GstAdaptiveDemuxAbrBuiltin * b, guint window_size)
+{
+  b->rates[b->rates_pos] = _bitrate (b->pending_bytes, b->pending_time);
+  b->rates_pos = (b->rates_pos + 1) % window_size;
+  if (b->n_rates < window_size)
+    b->n_rates++;
+
+  b->pending_bytes = 0;
+  b->pending_time = 0;
+  b->fragment_sampled = TRUE;
+}
+
+static void
+_harmonic_add_sample (GstAdaptiveDemuxAbr * abr, guint64 bytes,
+    GstClockTime time)
+{
+  GstAdaptiveDemuxAbrBuiltin *b = abr->state;
+
+  /* time without data is merged into the next sample that has some */
+  b->pending_bytes += bytes;
+  b->pending_time += time;
+  if (b->pending_time >= ABR_MIN_SAMPLE_TIME && b->pending_bytes > 0)
+    _harmonic_push_pending (b, abr->window_size);
+}
+
+static void
+_harmonic_fragment_finished (GstAdaptiveDemuxAbr * abr, guint64 bytes,
+    GstClockTime download_time, GstClockTime duration)
+{
+  GstAdaptiveDemuxAbrBuiltin *b = abr->state;
+
+  /* don't carry the tail of a fragment over the request of the next one.
+   * Tails shorter than a sample are ignored, unless they are the whole
+   * fragment, so that fast downloads are still measured */
+  if (b->pending_bytes > 0 && b->pending_time > 0 && !b->fragment_sampled)
+    _harmonic_push_pending (b, abr->window_size);
+  b->pending_bytes = 0;
+  b->pending_time = 0;
+  b->fragment_sampled = FALSE;
+
+  if (GST_CLOCK_TIME_IS_VALID (duration) && duration > 0)
+    b->fragment_duration = duration;
+}
+
+static guint64
+_harmonic_get_bandwidth (GstAdaptiveDemuxAbr * abr)
+{
+  GstAdaptiveDemuxAbrBuiltin *b = abr->state;
+  gdouble sum = 0;
+  guint i;
+
+  if (b->n_rates == 0)
+    return 0;
+
+  for (i = 0; i < b->n_rates; i++)
+    sum += 1.0 / MAX (b->rates[i], 1);
+
+  return b->n_rates / sum;
+}
+
+static guint64
+_harmonic_get_bitrate (GstAdaptiveDemuxAbr * abr, GstClockTime buffer_level)
+{
+  return _harmonic_get_bandwidth (abr);
+}
+
+static guint64
+_buffer_get_bitrate (GstAdaptiveDemuxAbr * abr, GstClockTime buffer_level)
+{
+  GstAdaptiveDemuxAbrBuiltin *b = abr->state;
+  guint64 bandwidth = _harmonic_get_bandwidth (abr);
+  GstClockTime low, high;
+  gdouble factor;
+
+  if (!GST_CLOCK_TIME_IS_VALID (buffer_level))
+    return bandwidth;
+
+  low = ABR_BUFFER_LOW_FRAGMENTS * b->fragment_duration;
+  high = ABR_BUFFER_HIGH_FRAGMENTS * b->fragment_duration;
+
+  if (buffer_level < low) {
+    factor = ABR_BUFFER_LOW_FACTOR * buffer_level / (gdouble) low;
+  } else if (buffer_level < high) {
+    factor = ABR_BUFFER_LOW_FACTOR +
+        (ABR_BUFFER_HIGH_FACTOR - ABR_BUFFER_LOW_FACTOR) *
+        (buffer_level - low) / (gdouble) (high - low);
+  } else {
+    factor = ABR_BUFFER_HIGH_FACTOR;
+  }
+
+  return bandwidth * factor;
+}
+
+static const GstAdaptiveDemuxAbrFuncs abr_ewma_funcs = {
+  sizeof (GstAdaptiveDemuxAbrBuiltin),
+  _builtin_init,
+  _builtin_clear,
+  NULL,
+  _ewma_fragment_finished,
+  _ewma_get_bandwidth,
+  _ewma_get_bitrate
+};
+
+static const GstAdaptiveDemuxAbrFuncs abr_harmonic_funcs = {
+  sizeof (GstAdaptiveDemuxAbrBuiltin),
+  _builtin_init,
+  _builtin_clear,
+  _harmonic_add_sample,
+  _harmonic_fragment_finished,
+  _harmonic_get_bandwidth,
+  _harmonic_get_bitrate
+};
+
+static const GstAdaptiveDemuxAbrFuncs abr_buffer_funcs = {
+  sizeof (GstAdaptiveDemuxAbrBuiltin),
+  _builtin_init,
+  _builtin_clear,
+  _harmonic_add_sample,
+  _harmonic_fragment_finished,
+  _harmonic_get_bandwidth,
+  _buffer_get_bitrate
+};
+
+static GstAdaptiveDemuxAbr *
+gst_adaptive_demux_abr_new_internal (const GstAdaptiveDemuxAbrFuncs * funcs,
+    GstAdaptiveDemuxAbrAlgorithm algorithm, guint window_size)
+{
+  GstAdaptiveDemuxAbr *abr = g_slice_new0 (GstAdaptiveDemuxAbr);
+
+  abr->funcs = funcs;
+  abr->algorithm = algorithm;
+  abr->window_size = MAX (window_size, 1);
+  if (funcs->state_size)
+    abr->state = g_malloc0 (funcs->state_size);
+  if (funcs->init)
+    funcs->init (abr);
+
+  return abr;
+}
+
+/**
+ * gst_adaptive_demux_abr_new:
+ * @algorithm: one of the built-in algorithms
+ * @window_size: number of throughput samples averaged by the harmonic and
+ *     buffer algorithms
+ *
+ * Returns: (transfer full): a new #GstAdaptiveDemuxAbr, or %NULL for
+ *     #GST_ADAPTIVE_DEMUX_ABR_CUSTOM
+ */
+GstAdaptiveDemuxAbr *
+gst_adaptive_demux_abr_new (GstAdaptiveDemuxAbrAlgorithm algorithm,
+    guint window_size)
+{
+  const GstAdaptiveDemuxAbrFuncs *funcs;
+
+  switch (algorithm) {
+    case GST_ADAPTIVE_DEMUX_ABR_EWMA:
+      funcs = &abr_ewma_funcs;
+      break;
+    case GST_ADAPTIVE_DEMUX_ABR_HARMONIC:
+      funcs = &abr_harmonic_funcs;
+      break;
+    case GST_ADAPTIVE_DEMUX_ABR_BUFFER:
+      funcs = &abr_buffer_funcs;
+      break;
+    default:
+      g_return_val_if_reached (NULL);
+  }
+
+  return gst_adaptive_demux_abr_new_internal (funcs, algorithm, window_size);
+}
+
+/**
+ * gst_adaptive_demux_abr_new_custom:
+ * @funcs: the functions implementing the algorithm. They must stay valid
+ *     for the lifetime of the returned object.
+ *
+ * Returns: (transfer full): a new #GstAdaptiveDemuxAbr
+ */
+GstAdaptiveDemuxAbr *
+gst_adaptive_demux_abr_new_custom (const GstAdaptiveDemuxAbrFuncs * funcs)
+{
+  g_return_val_if_fail (funcs != NULL, NULL);
+  g_return_val_if_fail (funcs->get_bitrate != NULL, NULL);
+
+  return gst_adaptive_demux_abr_new_internal (funcs,
+      GST_ADAPTIVE_DEMUX_ABR_CUSTOM, 1);
+}
+
+void
+gst_adaptive_demux_abr_free (GstAdaptiveDemuxAbr * abr)
+{
+  g_return_if_fail (abr != NULL);
+
+  if (abr->funcs->clear)
+    abr->funcs->clear (abr);
+  g_free (abr->state);
+  g_slice_free (GstAdaptiveDemuxAbr, abr);
+}
+
+GstAdaptiveDemuxAbrAlgorithm
+gst_adaptive_demux_abr_get_algorithm (GstAdaptiveDemuxAbr * abr)
+{
+  return abr->algorithm;
+}
+
+guint
+gst_adaptive_demux_abr_get_window_size (GstAdaptiveDemuxAbr * abr)
+{
+  return abr->window_size;
+}
+
+gpointer
+gst_adaptive_demux_abr_get_state (GstAdaptiveDemuxAbr * abr)
+{
+  return abr->state;
+}
+
+/**
+ * gst_adaptive_demux_abr_add_sample:
+ * @abr: a #GstAdaptiveDemuxAbr
+ * @bytes: the size of the chunk received
+ * @time: the time spent waiting for the chunk
+ *
+ * Adds a throughput sample, called for each chunk of a fragment.
+ */
+void
+gst_adaptive_demux_abr_add_sample (GstAdaptiveDemuxAbr * abr, guint64 bytes,
+    GstClockTime time)
+{
+  if (abr->funcs->add_sample)
+    abr->funcs->add_sample (abr, bytes, time);
+}
+
+/**
+ * gst_adaptive_demux_abr_fragment_finished:
+ * @abr: a #GstAdaptiveDemuxAbr
+ * @bytes: the size of the fragment
+ * @download_time: the time spent downloading the fragment
+ * @duration: the media duration of the fragment, or #GST_CLOCK_TIME_NONE
+ *
+ * Called once all the chunks of a fragment were added.
+ */
+void
+gst_adaptive_demux_abr_fragment_finished (GstAdaptiveDemuxAbr * abr,
+    guint64 bytes, GstClockTime download_time, GstClockTime duration)
+{
+  if (abr->funcs->fragment_finished)
+    abr->funcs->fragment_finished (abr, bytes, download_time, duration);
+}
+
+guint64
+gst_adaptive_demux_abr_get_bandwidth (GstAdaptiveDemuxAbr * abr)
+{
+  if (abr->funcs->get_bandwidth)
+    return abr->funcs->get_bandwidth (abr);
+  return abr->funcs->get_bitrate (abr, GST_CLOCK_TIME_NONE);
+}
+
+/**
+ * gst_adaptive_demux_abr_get_bitrate:
+ * @abr: a #GstAdaptiveDemuxAbr
+ * @buffer_level: the duration of media buffered ahead of the playback
+ *     position, or #GST_CLOCK_TIME_NONE if unknown
+ *
+ * Returns: the bitrate to request for the next fragment, in bits per second
+ */
+guint64
+gst_adaptive_demux_abr_get_bitrate (GstAdaptiveDemuxAbr * abr,
+    GstClockTime buffer_level)
+{
+  return abr->funcs->get_bitrate (abr, buffer_level);
+}
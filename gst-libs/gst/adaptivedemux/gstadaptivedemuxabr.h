@@ -0,0 +1,110 @@
+/* GStreamer
+ *
+ * gstadaptivedemuxabr.h: bandwidth estimation and bitrate adaptation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_ADAPTIVE_DEMUX_ABR_H__
+#define __GST_ADAPTIVE_DEMUX_ABR_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_ADAPTIVE_DEMUX_ABR_ALGORITHM \
+  (gst_adaptive_demux_abr_algorithm_get_type())
+
+/**
+ * GstAdaptiveDemuxAbrAlgorithm:
+ * @GST_ADAPTIVE_DEMUX_ABR_EWMA: moving average of the download rate of the
+ *     whole fragments, weighting the last one 3:1
+ * @GST_ADAPTIVE_DEMUX_ABR_HARMONIC: harmonic mean of the throughput of the
+ *     last downloaded chunks
+ * @GST_ADAPTIVE_DEMUX_ABR_BUFFER: harmonic mean throughput scaled by the
+ *     amount of data buffered ahead of the playback position
+ * @GST_ADAPTIVE_DEMUX_ABR_CUSTOM: functions set with
+ *     gst_adaptive_demux_set_abr_funcs()
+ *
+ * The algorithms used to choose the bitrate of the next fragment.
+ */
+typedef enum
+{
+  GST_ADAPTIVE_DEMUX_ABR_EWMA,
+  GST_ADAPTIVE_DEMUX_ABR_HARMONIC,
+  GST_ADAPTIVE_DEMUX_ABR_BUFFER,
+  GST_ADAPTIVE_DEMUX_ABR_CUSTOM
+} GstAdaptiveDemuxAbrAlgorithm;
+
+typedef struct _GstAdaptiveDemuxAbr GstAdaptiveDemuxAbr;
+typedef struct _GstAdaptiveDemuxAbrFuncs GstAdaptiveDemuxAbrFuncs;
+
+/**
+ * GstAdaptiveDemuxAbrFuncs:
+ * @state_size: size of the state allocated for each instance
+ * @init: optional, initializes the state of a new instance
+ * @clear: optional, frees what @init allocated
+ * @add_sample: a chunk of @bytes was received in @time
+ * @fragment_finished: a fragment of @bytes and @duration was downloaded in
+ *     @download_time
+ * @get_bandwidth: returns the estimated throughput in bits per second
+ * @get_bitrate: returns the bitrate to request for the next fragment, in bits
+ *     per second. @buffer_level is the duration buffered ahead of the
+ *     playback position or #GST_CLOCK_TIME_NONE if unknown.
+ *
+ * The functions implementing a bitrate adaptation algorithm. The state of
+ * an instance is available with gst_adaptive_demux_abr_get_state().
+ */
+struct _GstAdaptiveDemuxAbrFuncs
+{
+  gsize    state_size;
+
+  void     (*init)              (GstAdaptiveDemuxAbr * abr);
+  void     (*clear)             (GstAdaptiveDemuxAbr * abr);
+  void     (*add_sample)        (GstAdaptiveDemuxAbr * abr, guint64 bytes,
+                                 GstClockTime time);
+  void     (*fragment_finished) (GstAdaptiveDemuxAbr * abr, guint64 bytes,
+                                 GstClockTime download_time,
+                                 GstClockTime duration);
+  guint64  (*get_bandwidth)     (GstAdaptiveDemuxAbr * abr);
+  guint64  (*get_bitrate)       (GstAdaptiveDemuxAbr * abr,
+                                 GstClockTime buffer_level);
+};
+
+GType gst_adaptive_demux_abr_algorithm_get_type (void);
+
+GstAdaptiveDemuxAbr * gst_adaptive_demux_abr_new (GstAdaptiveDemuxAbrAlgorithm algorithm,
+                                                  guint window_size);
+GstAdaptiveDemuxAbr * gst_adaptive_demux_abr_new_custom (const GstAdaptiveDemuxAbrFuncs * funcs);
+void     gst_adaptive_demux_abr_free (GstAdaptiveDemuxAbr * abr);
+
+GstAdaptiveDemuxAbrAlgorithm gst_adaptive_demux_abr_get_algorithm (GstAdaptiveDemuxAbr * abr);
+guint    gst_adaptive_demux_abr_get_window_size (GstAdaptiveDemuxAbr * abr);
+gpointer gst_adaptive_demux_abr_get_state (GstAdaptiveDemuxAbr * abr);
+
+void     gst_adaptive_demux_abr_add_sample (GstAdaptiveDemuxAbr * abr,
+                                            guint64 bytes, GstClockTime time);
+void     gst_adaptive_demux_abr_fragment_finished (GstAdaptiveDemuxAbr * abr,
+                                                   guint64 bytes,
+                                                   GstClockTime download_time,
+                                                   GstClockTime duration);
+guint64  gst_adaptive_demux_abr_get_bandwidth (GstAdaptiveDemuxAbr * abr);
+guint64  gst_adaptive_demux_abr_get_bitrate (GstAdaptiveDemuxAbr * abr,
+                                             GstClockTime buffer_level);
+
+G_END_DECLS
+
+#endif /* __GST_ADAPTIVE_DEMUX_ABR_H__ */
@@ -43,6 +43,13 @@
  *    on that pad.
  *  </para></listitem>
  *  <listitem><para>
+ *    By default each pad holds a single buffer and upstream blocks until
+ *    it has been consumed. The #GstAggregatorPad:max-size-buffers and
+ *    #GstAggregatorPad:max-size-time properties allow more buffers to be
+ *    queued on a pad, in which case gst_aggregator_pad_peek_buffer () can
+ *    be used to look at the buffers following the current one.
+ *  </para></listitem>
+ *  <listitem><para>
  *    If the subclass wishes to push a buffer downstream in its aggregate
  *    implementation, it should do so through the
  *    gst_aggregator_finish_buffer () method. This method will take care
@@ -187,12 +194,84 @@ struct _GstAggregatorPadPrivate
   gboolean pending_eos;
   gboolean flushing;
 
+  /* Buffers queued after GstAggregatorPad.buffer, protected by the
+   * EVENT lock */
+  GQueue queue;
+  guint max_size_buffers;
+  GstClockTime max_size_time;
+
   GMutex event_lock;
   GCond event_cond;
 
   GMutex stream_lock;
 };
 
+/* Must be called with the EVENT lock held */
+static GstClockTime
+gst_aggregator_pad_get_queued_time_unlocked (GstAggregatorPad * aggpad)
+{
+  GstBuffer *head = aggpad->buffer, *tail;
+  GstClockTime start, end;
+
+  if (head == NULL)
+    return 0;
+
+  tail = g_queue_peek_tail (&aggpad->priv->queue);
+  if (tail == NULL)
+    tail = head;
+
+  start = GST_BUFFER_PTS (head);
+  end = GST_BUFFER_PTS (tail);
+  if (!GST_CLOCK_TIME_IS_VALID (start) || !GST_CLOCK_TIME_IS_VALID (end))
+    return 0;
+
+  if (GST_BUFFER_DURATION_IS_VALID (tail))
+    end += GST_BUFFER_DURATION (tail);
+
+  return end > start ? end - start : 0;
+}
+
+/* Must be called with the EVENT lock held */
+static gboolean
+gst_aggregator_pad_queue_is_full_unlocked (GstAggregatorPad * aggpad)
+{
+  GstAggregatorPadPrivate *priv = aggpad->priv;
+
+  /* An empty pad always accepts a buffer, whatever the limits */
+  if (aggpad->buffer == NULL)
+    return FALSE;
+
+  if (priv->max_size_buffers > 0
+      && priv->queue.length + 1 >= priv->max_size_buffers)
+    return TRUE;
+
+  if (priv->max_size_time > 0
+      && gst_aggregator_pad_get_queued_time_unlocked (aggpad) >=
+      priv->max_size_time)
+    return TRUE;
+
+  return FALSE;
+}
+
+/* Drops all the queued buffers and wakes up the pad streaming thread */
+static void
+gst_aggregator_pad_drop_buffers (GstAggregatorPad * aggpad)
+{
+  GstBuffer *buffer;
+
+  PAD_LOCK_EVENT (aggpad);
+  gst_buffer_replace (&aggpad->buffer, NULL);
+  while ((buffer = g_queue_pop_head (&aggpad->priv->queue)))
+    gst_buffer_unref (buffer);
+
+  if (aggpad->priv->pending_eos) {
+    aggpad->priv->pending_eos = FALSE;
+    aggpad->eos = TRUE;
+  }
+  PAD_BROADCAST_EVENT (aggpad);
+  PAD_UNLOCK_EVENT (aggpad);
+}
+
 static gboolean
 gst_aggregator_pad_flush (GstAggregatorPad * aggpad, GstAggregator * agg)
 {
@@ -756,14 +835,12 @@ static void
 gst_aggregator_flush_start (GstAggregator * self, GstAggregatorPad * aggpad,
     GstEvent * event)
 {
-  GstBuffer *tmpbuf;
   GstAggregatorPrivate *priv = self->priv;
   GstAggregatorPadPrivate *padpriv = aggpad->priv;
 
   g_atomic_int_set (&aggpad->priv->flushing, TRUE);
-  /*  Remove pad buffer and wake up the streaming thread */
-  tmpbuf = gst_aggregator_pad_steal_buffer (aggpad);
-  gst_buffer_replace (&tmpbuf, NULL);
+  /*  Remove pad buffers and wake up the streaming thread */
+  gst_aggregator_pad_drop_buffers (aggpad);
   PAD_STREAM_LOCK (aggpad);
   if (g_atomic_int_compare_and_exchange (&padpriv->pending_flush_start,
           TRUE, FALSE) == TRUE) {
@@ -792,8 +869,7 @@ gst_aggregator_flush_start (GstAggregator * self, GstAggregatorPad * aggpad,
   }
   PAD_STREAM_UNLOCK (aggpad);
 
-  tmpbuf = gst_aggregator_pad_steal_buffer (aggpad);
-  gst_buffer_replace (&tmpbuf, NULL);
+  gst_aggregator_pad_drop_buffers (aggpad);
 }
 
 /* GstAggregator vmethods default implementations */
@@ -988,15 +1064,13 @@ static void
 gst_aggregator_release_pad (GstElement * element, GstPad * pad)
 {
   GstAggregator *self = GST_AGGREGATOR (element);
-  GstBuffer *tmpbuf;
 
   GstAggregatorPad *aggpad = GST_AGGREGATOR_PAD (pad);
 
   GST_INFO_OBJECT (pad, "Removing pad");
 
   g_atomic_int_set (&aggpad->priv->flushing, TRUE);
-  tmpbuf = gst_aggregator_pad_steal_buffer (aggpad);
-  gst_buffer_replace (&tmpbuf, NULL);
+  gst_aggregator_pad_drop_buffers (aggpad);
   gst_element_remove_pad (element, pad);
 
   SRC_STREAM_BROADCAST (self);
@@ -1731,6 +1805,7 @@ gst_aggregator_pad_chain (GstPad * pad, GstObject * object, GstBuffer * buffer)
   GstAggregatorPrivate *priv = self->priv;
   GstAggregatorPad *aggpad = GST_AGGREGATOR_PAD (pad);
   GstAggregatorClass *aggclass = GST_AGGREGATOR_GET_CLASS (object);
+  gboolean was_empty;
 
   GST_DEBUG_OBJECT (aggpad, "Start chaining a buffer %" GST_PTR_FORMAT, buffer);
 
@@ -1744,8 +1819,9 @@ gst_aggregator_pad_chain (GstPad * pad, GstObject * object, GstBuffer * buffer)
 
   PAD_LOCK_EVENT (aggpad);
 
-  while (aggpad->buffer && g_atomic_int_get (&aggpad->priv->flushing) == FALSE) {
-    GST_DEBUG_OBJECT (aggpad, "Waiting for buffer to be consumed");
+  while (gst_aggregator_pad_queue_is_full_unlocked (aggpad)
+      && g_atomic_int_get (&aggpad->priv->flushing) == FALSE) {
+    GST_DEBUG_OBJECT (aggpad, "Waiting for a queued buffer to be consumed");
     PAD_WAIT_EVENT (aggpad);
   }
   PAD_UNLOCK_EVENT (aggpad);
@@ -1758,16 +1834,25 @@ gst_aggregator_pad_chain (GstPad * pad, GstObject * object, GstBuffer * buffer)
   }
 
   PAD_LOCK_EVENT (aggpad);
-  if (aggpad->buffer)
-    gst_buffer_unref (aggpad->buffer);
-  aggpad->buffer = actual_buf;
+  was_empty = (aggpad->buffer == NULL);
+  if (actual_buf) {
+    if (was_empty)
+      aggpad->buffer = actual_buf;
+    else
+      g_queue_push_tail (&aggpad->priv->queue, actual_buf);
+  }
   PAD_UNLOCK_EVENT (aggpad);
   PAD_STREAM_UNLOCK (aggpad);
 
-  SRC_STREAM_LOCK (self);
-  if (gst_aggregator_check_pads_ready (self))
-    SRC_STREAM_BROADCAST_UNLOCKED (self);
-  SRC_STREAM_UNLOCK (self);
+  /* The pad was already ready if it had a buffer queued, so only the
+   * buffer becoming the head of the queue can make the aggregate
+   * function runnable */
+  if (was_empty) {
+    SRC_STREAM_LOCK (self);
+    if (gst_aggregator_check_pads_ready (self))
+      SRC_STREAM_BROADCAST_UNLOCKED (self);
+    SRC_STREAM_UNLOCK (self);
+  }
 
   GST_DEBUG_OBJECT (aggpad, "Done chaining");
 
@@ -1871,11 +1956,8 @@ gst_aggregator_pad_activate_mode_func (GstPad * pad,
   GstAggregatorPad *aggpad = GST_AGGREGATOR_PAD (pad);
 
   if (active == FALSE) {
-    PAD_LOCK_EVENT (aggpad);
     g_atomic_int_set (&aggpad->priv->flushing, TRUE);
-    gst_buffer_replace (&aggpad->buffer, NULL);
-    PAD_BROADCAST_EVENT (aggpad);
-    PAD_UNLOCK_EVENT (aggpad);
+    gst_aggregator_pad_drop_buffers (aggpad);
   } else {
     g_atomic_int_set (&aggpad->priv->flushing, FALSE);
     PAD_LOCK_EVENT (aggpad);
@@ -1891,6 +1973,60 @@ gst_aggregator_pad_activate_mode_func (GstPad * pad,
  ************************************/
 G_DEFINE_TYPE (GstAggregatorPad, gst_aggregator_pad, GST_TYPE_PAD);
 
+#define DEFAULT_PAD_MAX_SIZE_BUFFERS  1
+#define DEFAULT_PAD_MAX_SIZE_TIME     0
+
+enum
+{
+  PAD_PROP_0,
+  PAD_PROP_MAX_SIZE_BUFFERS,
+  PAD_PROP_MAX_SIZE_TIME,
+};
+
+static void
+gst_aggregator_pad_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstAggregatorPad *pad = GST_AGGREGATOR_PAD (object);
+
+  PAD_LOCK_EVENT (pad);
+  switch (prop_id) {
+    case PAD_PROP_MAX_SIZE_BUFFERS:
+      pad->priv->max_size_buffers = g_value_get_uint (value);
+      break;
+    case PAD_PROP_MAX_SIZE_TIME:
+      pad->priv->max_size_time = g_value_get_uint64 (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+  /* Limits might have been raised, let a blocked chain function check */
+  PAD_BROADCAST_EVENT (pad);
+  PAD_UNLOCK_EVENT (pad);
+}
+
+static void
+gst_aggregator_pad_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstAggregatorPad *pad = GST_AGGREGATOR_PAD (object);
+
+  PAD_LOCK_EVENT (pad);
+  switch (prop_id) {
+    case PAD_PROP_MAX_SIZE_BUFFERS:
+      g_value_set_uint (value, pad->priv->max_size_buffers);
+      break;
+    case PAD_PROP_MAX_SIZE_TIME:
+      g_value_set_uint64 (value, pad->priv->max_size_time);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+  PAD_UNLOCK_EVENT (pad);
+}
+
 static void
 gst_aggregator_pad_constructed (GObject * object)
 {
@@ -1911,6 +2047,7 @@ gst_aggregator_pad_finalize (GObject * object)
 {
   GstAggregatorPad *pad = (GstAggregatorPad *) object;
 
+  g_queue_clear (&pad->priv->queue);
   g_mutex_clear (&pad->priv->event_lock);
   g_cond_clear (&pad->priv->event_cond);
   g_mutex_clear (&pad->priv->stream_lock);
@@ -1922,11 +2059,8 @@ static void
 gst_aggregator_pad_dispose (GObject * object)
 {
   GstAggregatorPad *pad = (GstAggregatorPad *) object;
-  GstBuffer *buf;
 
-  buf = gst_aggregator_pad_steal_buffer (pad);
-  if (buf)
-    gst_buffer_unref (buf);
+  gst_aggregator_pad_drop_buffers (pad);
 
   G_OBJECT_CLASS (gst_aggregator_pad_parent_class)->dispose (object);
 }
@@ -1941,6 +2075,33 @@ gst_aggregator_pad_class_init (GstAggregatorPadClass * klass)
   gobject_class->constructed = gst_aggregator_pad_constructed;
   gobject_class->finalize = gst_aggregator_pad_finalize;
   gobject_class->dispose = gst_aggregator_pad_dispose;
+  gobject_class->set_property = gst_aggregator_pad_set_property;
+  gobject_class->get_property = gst_aggregator_pad_get_property;
+
+  /**
+   * GstAggregatorPad:max-size-buffers:
+   *
+   * Maximum number of buffers queued on the pad before upstream blocks,
+   * 0 means no limit. The default of 1 makes upstream wait for each
+   * buffer to be consumed by the aggregate function.
+   */
+  g_object_class_install_property (gobject_class, PAD_PROP_MAX_SIZE_BUFFERS,
+      g_param_spec_uint ("max-size-buffers", "Max. size (buffers)",
+          "Max. number of buffers queued on the pad (0=disable)", 0,
+          G_MAXUINT, DEFAULT_PAD_MAX_SIZE_BUFFERS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstAggregatorPad:max-size-time:
+   *
+   * Maximum duration of the data queued on the pad before upstream blocks,
+   * computed from the buffer timestamps, 0 means no limit.
+   */
+  g_object_class_install_property (gobject_class, PAD_PROP_MAX_SIZE_TIME,
+      g_param_spec_uint64 ("max-size-time", "Max. size (ns)",
+          "Max. amount of data queued on the pad (in ns, 0=disable)", 0,
+          G_MAXUINT64, DEFAULT_PAD_MAX_SIZE_TIME,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 }
 
 static void
@@ -1951,6 +2112,9 @@ gst_aggregator_pad_init (GstAggregatorPad * pad)
       GstAggregatorPadPrivate);
 
   pad->buffer = NULL;
+  g_queue_init (&pad->priv->queue);
+  pad->priv->max_size_buffers = DEFAULT_PAD_MAX_SIZE_BUFFERS;
+  pad->priv->max_size_time = DEFAULT_PAD_MAX_SIZE_TIME;
   g_mutex_init (&pad->priv->event_lock);
   g_cond_init (&pad->priv->event_cond);
 
@@ -1961,7 +2125,8 @@ gst_aggregator_pad_init (GstAggregatorPad * pad)
  * gst_aggregator_pad_steal_buffer:
  * @pad: the pad to get buffer from
  *
- * Steal the ref to the buffer currently queued in @pad.
+ * Steal the ref to the buffer currently queued in @pad. The next
+ * buffer queued on @pad, if any, becomes the current buffer.
  *
  * Returns: (transfer full): The buffer in @pad or NULL if no buffer was
  *   queued. You should unref the buffer after usage.
@@ -1975,8 +2140,8 @@ gst_aggregator_pad_steal_buffer (GstAggregatorPad * pad)
   if (pad->buffer) {
     GST_TRACE_OBJECT (pad, "Consuming buffer");
     buffer = pad->buffer;
-    pad->buffer = NULL;
-    if (pad->priv->pending_eos) {
+    pad->buffer = g_queue_pop_head (&pad->priv->queue);
+    if (pad->buffer == NULL && pad->priv->pending_eos) {
       pad->priv->pending_eos = FALSE;
       pad->eos = TRUE;
     }
@@ -2009,6 +2174,57 @@ gst_aggregator_pad_get_buffer (GstAggregatorPad * pad)
   return buffer;
 }
 
+/**
+ * gst_aggregator_pad_peek_buffer:
+ * @pad: the pad to get buffer from
+ * @idx: the position of the buffer in the queue of @pad
+ *
+ * Look ahead in the buffers queued in @pad. Index 0 is the current
+ * buffer, as returned by gst_aggregator_pad_get_buffer(), the following
+ * indexes are the buffers that will replace it once it is stolen.
+ *
+ * Returns: (transfer full): A reference to the buffer at @idx in @pad
+ * or NULL if fewer buffers are queued. You should unref the buffer
+ * after usage.
+ */
+GstBuffer *
+gst_aggregator_pad_peek_buffer (GstAggregatorPad * pad, guint idx)
+{
+  GstBuffer *buffer = NULL;
+
+  PAD_LOCK_EVENT (pad);
+  if (idx == 0)
+    buffer = pad->buffer;
+  else if (pad->buffer)
+    buffer = g_queue_peek_nth (&pad->priv->queue, idx - 1);
+
+  if (buffer)
+    gst_buffer_ref (buffer);
+  PAD_UNLOCK_EVENT (pad);
+
+  return buffer;
+}
+
+/**
+ * gst_aggregator_pad_get_queued_buffers:
+ * @pad: the pad to query
+ *
+ * Returns: The number of buffers currently queued in @pad, including
+ * the current buffer.
+ */
+guint
+gst_aggregator_pad_get_queued_buffers (GstAggregatorPad * pad)
+{
+  guint n = 0;
+
+  PAD_LOCK_EVENT (pad);
+  if (pad->buffer)
+    n = pad->priv->queue.length + 1;
+  PAD_UNLOCK_EVENT (pad);
+
+  return n;
+}
+
 /**
  * gst_aggregator_merge_tags:
  * @self: a #GstAggregator
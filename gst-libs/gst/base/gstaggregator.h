@@ -60,7 +60,7 @@ typedef struct _GstAggregatorPadPrivate GstAggregatorPadPrivate;
 
 /**
  * GstAggregatorPad:
- * @buffer: currently queued buffer.
+ * @buffer: currently queued buffer, the head of the pad queue.
  * @segment: last segment received.
  *
  * The implementation the GstPad to use with #GstAggregator
@@ -105,6 +105,9 @@ GType gst_aggregator_pad_get_type           (void);
 
 GstBuffer * gst_aggregator_pad_steal_buffer (GstAggregatorPad *  pad);
 GstBuffer * gst_aggregator_pad_get_buffer   (GstAggregatorPad *  pad);
+GstBuffer * gst_aggregator_pad_peek_buffer  (GstAggregatorPad *  pad,
+                                             guint               idx);
+guint       gst_aggregator_pad_get_queued_buffers (GstAggregatorPad * pad);
 
 /*********************
  * GstAggregator API *
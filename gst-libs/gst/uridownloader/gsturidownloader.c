@@ -46,6 +46,11 @@ struct _GstUriDownloaderPrivate
 
   GCond cond;
   gboolean cancelled;
+
+  /* when set, the source element is taken from it for each fetch and given
+   * back afterwards instead of being kept */
+  GstUriSourcePool *pool;
+  gint64 fetch_start_time;
 };
 
 static void gst_uri_downloader_finalize (GObject * object);
@@ -133,6 +138,11 @@ gst_uri_downloader_dispose (GObject * object)
     downloader->priv->download = NULL;
   }
 
+  if (downloader->priv->pool) {
+    gst_object_unref (downloader->priv->pool);
+    downloader->priv->pool = NULL;
+  }
+
   G_OBJECT_CLASS (gst_uri_downloader_parent_class)->dispose (object);
 }
 
@@ -153,6 +163,32 @@ gst_uri_downloader_new (void)
   return g_object_new (GST_TYPE_URI_DOWNLOADER, NULL);
 }
 
+/**
+ * gst_uri_downloader_set_source_pool:
+ * @downloader: the #GstUriDownloader
+ * @pool: (allow-none): a #GstUriSourcePool
+ *
+ * Makes @downloader take its source elements from @pool, so that they can
+ * be shared with the other users of the pool. Must not be called while a
+ * fetch is running.
+ */
+void
+gst_uri_downloader_set_source_pool (GstUriDownloader * downloader,
+    GstUriSourcePool * pool)
+{
+  g_return_if_fail (downloader != NULL);
+
+  g_mutex_lock (&downloader->priv->download_lock);
+  if (downloader->priv->urisrc) {
+    gst_element_set_state (downloader->priv->urisrc, GST_STATE_NULL);
+    gst_object_unref (downloader->priv->urisrc);
+    downloader->priv->urisrc = NULL;
+  }
+  gst_object_replace ((GstObject **) & downloader->priv->pool,
+      (GstObject *) pool);
+  g_mutex_unlock (&downloader->priv->download_lock);
+}
+
 static gboolean
 gst_uri_downloader_sink_event (GstPad * pad, GstObject * parent,
     GstEvent * event)
@@ -268,6 +304,10 @@ gst_uri_downloader_chain (GstPad * pad, GstObject * parent, GstBuffer * buf)
 
   GST_LOG_OBJECT (downloader, "The uri fetcher received a new buffer "
       "of size %" G_GSIZE_FORMAT, gst_buffer_get_size (buf));
+  if (!downloader->priv->got_buffer && downloader->priv->pool)
+    gst_uri_source_pool_record_first_byte (downloader->priv->pool,
+        downloader->priv->urisrc, (g_get_monotonic_time () -
+            downloader->priv->fetch_start_time) * GST_USECOND);
   downloader->priv->got_buffer = TRUE;
   if (!gst_fragment_add_buffer (downloader->priv->download, buf)) {
     GST_WARNING_OBJECT (downloader, "Could not add buffer to fragment");
@@ -343,7 +383,14 @@ gst_uri_downloader_set_uri (GstUriDownloader * downloader, const gchar * uri,
   if (!gst_uri_is_valid (uri))
     return FALSE;
 
-  if (downloader->priv->urisrc) {
+  if (downloader->priv->pool) {
+    /* given back to the pool at the end of each fetch */
+    g_assert (downloader->priv->urisrc == NULL);
+    downloader->priv->urisrc =
+        gst_uri_source_pool_acquire (downloader->priv->pool, uri);
+    if (!downloader->priv->urisrc)
+      return FALSE;
+  } else if (downloader->priv->urisrc) {
     gchar *old_protocol, *new_protocol;
     gchar *old_uri;
 
@@ -460,6 +507,7 @@ gst_uri_downloader_fetch_uri_with_range (GstUriDownloader *
   g_mutex_lock (&downloader->priv->download_lock);
   downloader->priv->err = NULL;
   downloader->priv->got_buffer = FALSE;
+  downloader->priv->fetch_start_time = g_get_monotonic_time ();
 
   GST_OBJECT_LOCK (downloader);
   if (downloader->priv->cancelled) {
@@ -583,6 +631,13 @@ quit:
         gst_pad_unlink (pad, downloader->priv->pad);
         gst_object_unref (pad);
       }
+
+      if (downloader->priv->pool) {
+        downloader->priv->urisrc = NULL;
+        GST_OBJECT_UNLOCK (downloader);
+        gst_uri_source_pool_release (downloader->priv->pool, urisrc);
+        GST_OBJECT_LOCK (downloader);
+      }
     }
     GST_OBJECT_UNLOCK (downloader);
 
@@ -30,6 +30,7 @@
 #include <glib-object.h>
 #include <gst/gst.h>
 #include "gstfragment.h"
+#include "gsturisourcepool.h"
 
 G_BEGIN_DECLS
 
@@ -61,6 +62,7 @@ struct _GstUriDownloaderClass
 GType gst_uri_downloader_get_type (void);
 
 GstUriDownloader * gst_uri_downloader_new (void);
+void gst_uri_downloader_set_source_pool (GstUriDownloader * downloader, GstUriSourcePool * pool);
 GstFragment * gst_uri_downloader_fetch_uri (GstUriDownloader * downloader, const gchar * uri, const gchar * referer, gboolean compress, gboolean refresh, gboolean allow_cache, GError ** err);
 GstFragment * gst_uri_downloader_fetch_uri_with_range (GstUriDownloader * downloader, const gchar * uri, const gchar * referer, gboolean compress, gboolean refresh, gboolean allow_cache, gint64 range_start, gint64 range_end, GError ** err);
 void gst_uri_downloader_reset (GstUriDownloader *downloader);
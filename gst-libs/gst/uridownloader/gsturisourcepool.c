@@ -0,0 +1,414 @@
+/* GStreamer
+ *
+ * gsturisourcepool.c:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Keeps idle source elements per host so that the next request to the same
+ * host can reuse them. Sources with keep-alive enabled, like souphttpsrc,
+ * keep their connection open in READY, so a reused source doesn't pay the
+ * TCP and TLS setup again.
+ *
+ * A source is taken out with gst_uri_source_pool_acquire() and given back
+ * with gst_uri_source_pool_release() once its request is finished. Only
+ * sources that are in READY and not in a bin are kept, the others are
+ * destroyed. */
+
+#include <string.h>
+
+#include "gsturisourcepool.h"
+
+GST_DEBUG_CATEGORY_STATIC (urisourcepool_debug);
+#define GST_CAT_DEFAULT urisourcepool_debug
+
+#define GST_URI_SOURCE_POOL_GET_PRIVATE(obj)  \
+   (G_TYPE_INSTANCE_GET_PRIVATE ((obj), \
+    GST_TYPE_URI_SOURCE_POOL, GstUriSourcePoolPrivate))
+
+#define DEFAULT_MAX_IDLE_PER_HOST 4
+
+/* qdata set on the sources handed out by the pool */
+#define POOL_HOST_KEY "gst-uri-source-pool-host"
+#define POOL_REUSED_KEY "gst-uri-source-pool-reused"
+
+struct _GstUriSourcePoolPrivate
+{
+  guint max_idle_per_host;
+
+  /* host key -> GQueue of idle sources, most recently released first */
+  GHashTable *idle;
+  guint n_idle;
+
+  /* statistics */
+  guint64 n_requests;
+  guint64 n_reused;
+  guint64 n_created;
+  guint64 n_discarded;
+  guint64 n_first_byte_new;
+  GstClockTime first_byte_time_new;
+  guint64 n_first_byte_reused;
+  GstClockTime first_byte_time_reused;
+};
+
+static void gst_uri_source_pool_finalize (GObject * object);
+
+G_DEFINE_TYPE_WITH_CODE (GstUriSourcePool, gst_uri_source_pool,
+    GST_TYPE_OBJECT,
+    GST_DEBUG_CATEGORY_INIT (urisourcepool_debug, "urisourcepool", 0,
+        "URI source pool"));
+
+static void
+gst_uri_source_pool_class_init (GstUriSourcePoolClass * klass)
+{
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+
+  g_type_class_add_private (klass, sizeof (GstUriSourcePoolPrivate));
+
+  gobject_class->finalize = gst_uri_source_pool_finalize;
+}
+
+static void
+_free_idle_queue (GQueue * queue)
+{
+  GstElement *src;
+
+  while ((src = g_queue_pop_head (queue))) {
+    gst_element_set_state (src, GST_STATE_NULL);
+    gst_object_unref (src);
+  }
+  g_queue_free (queue);
+}
+
+static void
+gst_uri_source_pool_init (GstUriSourcePool * pool)
+{
+  pool->priv = GST_URI_SOURCE_POOL_GET_PRIVATE (pool);
+
+  pool->priv->max_idle_per_host = DEFAULT_MAX_IDLE_PER_HOST;
+  pool->priv->idle = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      (GDestroyNotify) _free_idle_queue);
+}
+
+static void
+gst_uri_source_pool_finalize (GObject * object)
+{
+  GstUriSourcePool *pool = GST_URI_SOURCE_POOL (object);
+
+  g_hash_table_destroy (pool->priv->idle);
+
+  G_OBJECT_CLASS (gst_uri_source_pool_parent_class)->finalize (object);
+}
+
+/**
+ * gst_uri_source_pool_new:
+ * @max_idle_per_host: the maximum number of idle sources kept per host, or
+ *     0 for the default
+ *
+ * Returns: (transfer full): a new #GstUriSourcePool
+ */
+GstUriSourcePool *
+gst_uri_source_pool_new (guint max_idle_per_host)
+{
+  GstUriSourcePool *pool = g_object_new (GST_TYPE_URI_SOURCE_POOL, NULL);
+
+  if (max_idle_per_host > 0)
+    pool->priv->max_idle_per_host = max_idle_per_host;
+
+  return pool;
+}
+
+/* Returns "protocol://authority" in lower case, which identifies the
+ * connection a source element would open, or NULL for uris that have no
+ * authority part */
+static gchar *
+_get_host_key (const gchar * uri)
+{
+  const gchar *authority, *end, *userinfo;
+  gchar *protocol, *host, *key;
+
+  authority = strstr (uri, "://");
+  if (authority == NULL)
+    return NULL;
+  authority += 3;
+
+  end = authority + strcspn (authority, "/?#");
+  userinfo = memchr (authority, '@', end - authority);
+  if (userinfo)
+    authority = userinfo + 1;
+  if (authority == end)
+    return NULL;
+
+  protocol = gst_uri_get_protocol (uri);
+  if (protocol == NULL)
+    return NULL;
+
+  host = g_ascii_strdown (authority, end - authority);
+  key = g_strdup_printf ("%s://%s", protocol, host);
+  g_free (protocol);
+  g_free (host);
+
+  return key;
+}
+
+/**
+ * gst_uri_source_pool_is_same_host:
+ * @uri1: an uri
+ * @uri2: another uri
+ *
+ * Returns: %TRUE if a source element for @uri1 can serve @uri2 over the same
+ *     connection
+ */
+gboolean
+gst_uri_source_pool_is_same_host (const gchar * uri1, const gchar * uri2)
+{
+  gchar *key1 = _get_host_key (uri1);
+  gchar *key2 = _get_host_key (uri2);
+  gboolean ret;
+
+  ret = key1 && key2 && g_str_equal (key1, key2);
+  g_free (key1);
+  g_free (key2);
+
+  return ret;
+}
+
+/**
+ * gst_uri_source_pool_acquire:
+ * @pool: a #GstUriSourcePool
+ * @uri: the uri to fetch
+ *
+ * Takes an idle source element for the host of @uri out of the pool, or
+ * creates a new one if there is none. The uri of the returned element is
+ * set to @uri.
+ *
+ * Returns: (transfer full): a source element in the NULL or READY state, or
+ *     %NULL if no element handles @uri
+ */
+GstElement *
+gst_uri_source_pool_acquire (GstUriSourcePool * pool, const gchar * uri)
+{
+  GstUriSourcePoolPrivate *priv = pool->priv;
+  GstElement *src = NULL;
+  gchar *key;
+
+  g_return_val_if_fail (GST_IS_URI_SOURCE_POOL (pool), NULL);
+  g_return_val_if_fail (uri != NULL, NULL);
+
+  key = _get_host_key (uri);
+
+  GST_OBJECT_LOCK (pool);
+  priv->n_requests++;
+  if (key) {
+    GQueue *queue = g_hash_table_lookup (priv->idle, key);
+
+    if (queue && (src = g_queue_pop_head (queue)))
+      priv->n_idle--;
+  }
+  GST_OBJECT_UNLOCK (pool);
+
+  if (src) {
+    GError *err = NULL;
+
+    if (gst_uri_handler_set_uri (GST_URI_HANDLER (src), uri, &err)) {
+      GST_DEBUG_OBJECT (pool, "Reusing %s for %s", GST_ELEMENT_NAME (src), uri);
+      g_object_set_data (G_OBJECT (src), POOL_REUSED_KEY, GINT_TO_POINTER (1));
+
+      GST_OBJECT_LOCK (pool);
+      priv->n_reused++;
+      GST_OBJECT_UNLOCK (pool);
+      g_free (key);
+      return src;
+    }
+
+    GST_DEBUG_OBJECT (pool, "Failed to reuse %s: %s", GST_ELEMENT_NAME (src),
+        err->message);
+    g_clear_error (&err);
+    gst_element_set_state (src, GST_STATE_NULL);
+    gst_object_unref (src);
+  }
+
+  src = gst_element_make_from_uri (GST_URI_SRC, uri, NULL, NULL);
+  if (src == NULL) {
+    g_free (key);
+    return NULL;
+  }
+  gst_object_ref_sink (src);
+
+  GST_DEBUG_OBJECT (pool, "Created %s for %s", GST_ELEMENT_NAME (src), uri);
+  g_object_set_data_full (G_OBJECT (src), POOL_HOST_KEY, key, g_free);
+  g_object_set_data (G_OBJECT (src), POOL_REUSED_KEY, GINT_TO_POINTER (0));
+
+  GST_OBJECT_LOCK (pool);
+  priv->n_created++;
+  GST_OBJECT_UNLOCK (pool);
+
+  return src;
+}
+
+/**
+ * gst_uri_source_pool_release:
+ * @pool: a #GstUriSourcePool
+ * @src: (transfer full): a source element returned by
+ *     gst_uri_source_pool_acquire()
+ *
+ * Gives @src back to the pool once the request it was used for is finished.
+ * It is kept for reuse if it is in READY and there are less than the
+ * maximum number of idle sources for its host, otherwise it is destroyed.
+ */
+void
+gst_uri_source_pool_release (GstUriSourcePool * pool, GstElement * src)
+{
+  GstUriSourcePoolPrivate *priv = pool->priv;
+  GstState state, pending;
+  const gchar *key;
+  gboolean keep = FALSE;
+
+  g_return_if_fail (GST_IS_URI_SOURCE_POOL (pool));
+  g_return_if_fail (GST_IS_ELEMENT (src));
+
+  key = g_object_get_data (G_OBJECT (src), POOL_HOST_KEY);
+
+  GST_OBJECT_LOCK (src);
+  state = GST_STATE (src);
+  pending = GST_STATE_PENDING (src);
+  GST_OBJECT_UNLOCK (src);
+
+  if (key && state == GST_STATE_READY && pending == GST_STATE_VOID_PENDING
+      && GST_OBJECT_PARENT (src) == NULL) {
+    GQueue *queue;
+
+    gst_element_set_locked_state (src, FALSE);
+
+    GST_OBJECT_LOCK (pool);
+    queue = g_hash_table_lookup (priv->idle, key);
+    if (queue == NULL) {
+      queue = g_queue_new ();
+      g_hash_table_insert (priv->idle, g_strdup (key), queue);
+    }
+    if (g_queue_get_length (queue) < priv->max_idle_per_host) {
+      g_queue_push_head (queue, src);
+      priv->n_idle++;
+      keep = TRUE;
+    } else {
+      priv->n_discarded++;
+    }
+    GST_OBJECT_UNLOCK (pool);
+  } else {
+    GST_OBJECT_LOCK (pool);
+    priv->n_discarded++;
+    GST_OBJECT_UNLOCK (pool);
+  }
+
+  if (!keep) {
+    GST_DEBUG_OBJECT (pool, "Discarding %s", GST_ELEMENT_NAME (src));
+    gst_element_set_state (src, GST_STATE_NULL);
+    gst_object_unref (src);
+  }
+}
+
+/**
+ * gst_uri_source_pool_record_first_byte:
+ * @pool: a #GstUriSourcePool
+ * @src: a source element returned by gst_uri_source_pool_acquire()
+ * @time: the time between the start of the request and its first data
+ *
+ * Accounts the time to the first byte of a request, separately for new and
+ * reused sources. The difference between both approximates the connection
+ * setup time saved by the reuse.
+ */
+void
+gst_uri_source_pool_record_first_byte (GstUriSourcePool * pool,
+    GstElement * src, GstClockTime time)
+{
+  GstUriSourcePoolPrivate *priv = pool->priv;
+
+  g_return_if_fail (GST_IS_URI_SOURCE_POOL (pool));
+  g_return_if_fail (GST_CLOCK_TIME_IS_VALID (time));
+
+  GST_OBJECT_LOCK (pool);
+  if (g_object_get_data (G_OBJECT (src), POOL_REUSED_KEY)) {
+    priv->n_first_byte_reused++;
+    priv->first_byte_time_reused += time;
+  } else {
+    priv->n_first_byte_new++;
+    priv->first_byte_time_new += time;
+  }
+  GST_OBJECT_UNLOCK (pool);
+}
+
+/**
+ * gst_uri_source_pool_clear:
+ * @pool: a #GstUriSourcePool
+ *
+ * Destroys all the idle sources, closing their connections.
+ */
+void
+gst_uri_source_pool_clear (GstUriSourcePool * pool)
+{
+  GHashTable *idle;
+
+  g_return_if_fail (GST_IS_URI_SOURCE_POOL (pool));
+
+  GST_OBJECT_LOCK (pool);
+  idle = pool->priv->idle;
+  pool->priv->idle = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      (GDestroyNotify) _free_idle_queue);
+  pool->priv->n_idle = 0;
+  GST_OBJECT_UNLOCK (pool);
+
+  /* changes the state of the sources, don't do it with the lock */
+  g_hash_table_destroy (idle);
+}
+
+/**
+ * gst_uri_source_pool_get_stats:
+ * @pool: a #GstUriSourcePool
+ *
+ * Returns: (transfer full): a #GstStructure named
+ *     GST_URI_SOURCE_POOL_STATS_NAME with the number of "requests", of
+ *     "reused" and "created" sources, the "reuse-rate", the number of
+ *     "idle" and "discarded" sources and the average "first-byte-time-new"
+ *     and "first-byte-time-reused"
+ */
+GstStructure *
+gst_uri_source_pool_get_stats (GstUriSourcePool * pool)
+{
+  GstUriSourcePoolPrivate *priv = pool->priv;
+  GstStructure *s;
+
+  g_return_val_if_fail (GST_IS_URI_SOURCE_POOL (pool), NULL);
+
+  GST_OBJECT_LOCK (pool);
+  s = gst_structure_new (GST_URI_SOURCE_POOL_STATS_NAME,
+      "requests", G_TYPE_UINT64, priv->n_requests,
+      "reused", G_TYPE_UINT64, priv->n_reused,
+      "created", G_TYPE_UINT64, priv->n_created,
+      "reuse-rate", G_TYPE_DOUBLE,
+      priv->n_requests ? (gdouble) priv->n_reused / priv->n_requests : 0.0,
+      "idle", G_TYPE_UINT, priv->n_idle,
+      "discarded", G_TYPE_UINT64, priv->n_discarded,
+      "first-byte-time-new", GST_TYPE_CLOCK_TIME,
+      priv->n_first_byte_new ?
+      priv->first_byte_time_new / priv->n_first_byte_new : GST_CLOCK_TIME_NONE,
+      "first-byte-time-reused", GST_TYPE_CLOCK_TIME,
+      priv->n_first_byte_reused ?
+      priv->first_byte_time_reused / priv->n_first_byte_reused :
+      GST_CLOCK_TIME_NONE, NULL);
+  GST_OBJECT_UNLOCK (pool);
+
+  return s;
+}
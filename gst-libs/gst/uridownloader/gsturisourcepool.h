@@ -0,0 +1,72 @@
+/* GStreamer
+ *
+ * gsturisourcepool.h:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GSTURISOURCEPOOL_H__
+#define __GSTURISOURCEPOOL_H__
+
+#ifndef GST_USE_UNSTABLE_API
+#warning "The UriDownloaded library from gst-plugins-bad is unstable API and may change in future."
+#warning "You can define GST_USE_UNSTABLE_API to avoid this warning."
+#endif
+
+#include <glib-object.h>
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_URI_SOURCE_POOL (gst_uri_source_pool_get_type())
+#define GST_URI_SOURCE_POOL(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_URI_SOURCE_POOL,GstUriSourcePool))
+#define GST_URI_SOURCE_POOL_CLASS(klass) (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_URI_SOURCE_POOL,GstUriSourcePoolClass))
+#define GST_IS_URI_SOURCE_POOL(obj) (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_URI_SOURCE_POOL))
+#define GST_IS_URI_SOURCE_POOL_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_URI_SOURCE_POOL))
+
+#define GST_URI_SOURCE_POOL_STATS_NAME "uri-source-pool-stats"
+
+typedef struct _GstUriSourcePool GstUriSourcePool;
+typedef struct _GstUriSourcePoolPrivate GstUriSourcePoolPrivate;
+typedef struct _GstUriSourcePoolClass GstUriSourcePoolClass;
+
+struct _GstUriSourcePool
+{
+  GstObject parent;
+
+  GstUriSourcePoolPrivate *priv;
+};
+
+struct _GstUriSourcePoolClass
+{
+  GstObjectClass parent_class;
+
+  /*< private >*/
+  gpointer _gst_reserved[GST_PADDING];
+};
+
+GType gst_uri_source_pool_get_type (void);
+
+GstUriSourcePool * gst_uri_source_pool_new (guint max_idle_per_host);
+GstElement * gst_uri_source_pool_acquire (GstUriSourcePool * pool, const gchar * uri);
+void gst_uri_source_pool_release (GstUriSourcePool * pool, GstElement * src);
+void gst_uri_source_pool_record_first_byte (GstUriSourcePool * pool, GstElement * src, GstClockTime time);
+gboolean gst_uri_source_pool_is_same_host (const gchar * uri1, const gchar * uri2);
+void gst_uri_source_pool_clear (GstUriSourcePool * pool);
+GstStructure * gst_uri_source_pool_get_stats (GstUriSourcePool * pool);
+
+G_END_DECLS
+#endif /* __GSTURISOURCEPOOL_H__ */
@@ -120,6 +120,22 @@ BLEND_A32 (argb, overlay, _overlay_loop_bgra);
 BLEND_A32 (bgra, overlay, _overlay_loop_argb);
 #endif
 
+/* For opaque frames, where blending at alpha 1.0 is a copy */
+static inline void
+_copy_loop_a32 (guint8 * dest, const guint8 * src, gint src_height,
+    gint src_width, gint src_stride, gint dest_stride, guint s_alpha)
+{
+  gint i;
+
+  for (i = 0; i < src_height; i++) {
+    memcpy (dest, src, 4 * src_width);
+    src += src_stride;
+    dest += dest_stride;
+  }
+}
+
+BLEND_A32 (a32, copy, _copy_loop_a32);
+
 #define A32_CHECKER_C(name, RGB, A, C1, C2, C3) \
 static void \
 fill_checker_##name##_c (GstVideoFrame * frame) \
@@ -520,18 +536,18 @@ blend_##format_name (GstVideoFrame * srcframe, gint xpos, gint ypos, \
     ypos = 0; \
   } \
   /* If x or y offset are larger then the source it's outside of the picture */ \
-  if (xoffset > src_width || yoffset > src_height) { \
+  if (xoffset >= src_width || yoffset >= src_height) { \
     return; \
   } \
   \
   /* adjust width/height if the src is bigger than dest */ \
-  if (xpos + src_width > dest_width) { \
+  if (xpos + b_src_width > dest_width) { \
     b_src_width = dest_width - xpos; \
   } \
-  if (ypos + src_height > dest_height) { \
+  if (ypos + b_src_height > dest_height) { \
     b_src_height = dest_height - ypos; \
   } \
-  if (b_src_width < 0 || b_src_height < 0) { \
+  if (b_src_width <= 0 || b_src_height <= 0) { \
     return; \
   } \
   \
@@ -949,6 +965,7 @@ BlendFunction gst_compositor_blend_bgra;
 BlendFunction gst_compositor_overlay_argb;
 BlendFunction gst_compositor_overlay_bgra;
 /* AYUV/ABGR is equal to ARGB, RGBA is equal to BGRA */
+BlendFunction gst_compositor_copy_a32;
 BlendFunction gst_compositor_blend_y444;
 BlendFunction gst_compositor_blend_y42b;
 BlendFunction gst_compositor_blend_i420;
@@ -1014,6 +1031,7 @@ gst_compositor_init_blend (void)
   gst_compositor_blend_bgra = blend_bgra;
   gst_compositor_overlay_argb = overlay_argb;
   gst_compositor_overlay_bgra = overlay_bgra;
+  gst_compositor_copy_a32 = copy_a32;
   gst_compositor_blend_i420 = blend_i420;
   gst_compositor_blend_nv12 = blend_nv12;
   gst_compositor_blend_nv21 = blend_nv21;
@@ -214,14 +214,169 @@ gst_compositor_pad_set_property (GObject * object, guint prop_id,
   }
 }
 
+/* Whether converting from @in_info to @out_info is more than a copy, only
+ * looking at what matters to GstVideoConverter. This is also what cached
+ * converters are matched on, so the interlace mode (which changes how
+ * chroma is resampled) and the pixel-aspect-ratio are compared too */
+static gboolean
+gst_compositor_pad_needs_conversion (const GstVideoInfo * in_info,
+    const GstVideoInfo * out_info)
+{
+  return GST_VIDEO_INFO_FORMAT (in_info) != GST_VIDEO_INFO_FORMAT (out_info)
+      || !gst_video_colorimetry_is_equal (&in_info->colorimetry,
+      &out_info->colorimetry)
+      || in_info->chroma_site != out_info->chroma_site
+      || GST_VIDEO_INFO_WIDTH (in_info) != GST_VIDEO_INFO_WIDTH (out_info)
+      || GST_VIDEO_INFO_HEIGHT (in_info) != GST_VIDEO_INFO_HEIGHT (out_info)
+      || GST_VIDEO_INFO_INTERLACE_MODE (in_info) !=
+      GST_VIDEO_INFO_INTERLACE_MODE (out_info)
+      || GST_VIDEO_INFO_PAR_N (in_info) != GST_VIDEO_INFO_PAR_N (out_info)
+      || GST_VIDEO_INFO_PAR_D (in_info) != GST_VIDEO_INFO_PAR_D (out_info);
+}
+
+static gboolean
+gst_compositor_pad_converter_matches (GstCompositorPadConverter * converter,
+    const GstVideoInfo * in_info, const GstVideoInfo * out_info)
+{
+  return !gst_compositor_pad_needs_conversion (&converter->in_info, in_info)
+      && !gst_compositor_pad_needs_conversion (&converter->out_info, out_info);
+}
+
+/* Returns a converter from @in_info to @out_info, reusing one of the
+ * converters recently used by the pad if possible. The converter stays
+ * owned by the pad. */
+static GstVideoConverter *
+gst_compositor_pad_get_converter (GstCompositorPad * cpad,
+    GstVideoInfo * in_info, GstVideoInfo * out_info)
+{
+  GstCompositorPadConverter converter;
+  guint i;
+
+  for (i = 0; i < cpad->n_converters; i++) {
+    if (gst_compositor_pad_converter_matches (&cpad->converters[i], in_info,
+            out_info))
+      break;
+  }
+
+  if (i < cpad->n_converters) {
+    GST_DEBUG_OBJECT (cpad, "Reusing cached converter %u", i);
+    converter = cpad->converters[i];
+  } else {
+    converter.convert = gst_video_converter_new (in_info, out_info, NULL);
+    if (!converter.convert)
+      return NULL;
+    converter.in_info = *in_info;
+    converter.out_info = *out_info;
+
+    /* Evict the least recently used converter if the cache is full */
+    if (cpad->n_converters == COMPOSITOR_PAD_MAX_CONVERTERS) {
+      i = cpad->n_converters - 1;
+      gst_video_converter_free (cpad->converters[i].convert);
+    } else {
+      i = cpad->n_converters++;
+    }
+    GST_DEBUG_OBJECT (cpad, "Created converter, %u cached", cpad->n_converters);
+  }
+
+  /* Keep the most recently used converter first */
+  memmove (&cpad->converters[1], &cpad->converters[0],
+      i * sizeof (GstCompositorPadConverter));
+  cpad->converters[0] = converter;
+
+  return converter.convert;
+}
+
+static void
+gst_compositor_pad_clear_converters (GstCompositorPad * cpad)
+{
+  guint i;
+
+  for (i = 0; i < cpad->n_converters; i++)
+    gst_video_converter_free (cpad->converters[i].convert);
+  cpad->n_converters = 0;
+  cpad->convert = NULL;
+}
+
+static GQuark pooled_buffer_quark;
+
+/* Makes sure the pad has a pool of buffers of @size bytes to convert
+ * frames into */
+static gboolean
+gst_compositor_pad_ensure_pool (GstCompositorPad * cpad, guint size)
+{
+  static GstAllocationParams params = { 0, 15, 0, 0, };
+  GstBufferPool *pool;
+  GstStructure *config;
+
+  if (cpad->convert_pool && cpad->convert_pool_size == size)
+    return TRUE;
+
+  if (cpad->convert_pool) {
+    GST_DEBUG_OBJECT (cpad, "Replacing pool of %u bytes buffers after %"
+        G_GUINT64_FORMAT " hits and %" G_GUINT64_FORMAT " misses",
+        cpad->convert_pool_size, cpad->pool_hits, cpad->pool_misses);
+    gst_buffer_pool_set_active (cpad->convert_pool, FALSE);
+    gst_object_unref (cpad->convert_pool);
+    cpad->convert_pool = NULL;
+  }
+
+  pool = gst_buffer_pool_new ();
+  config = gst_buffer_pool_get_config (pool);
+  gst_buffer_pool_config_set_params (config, NULL, size, 0, 0);
+  gst_buffer_pool_config_set_allocator (config, NULL, &params);
+
+  if (!gst_buffer_pool_set_config (pool, config)
+      || !gst_buffer_pool_set_active (pool, TRUE)) {
+    GST_WARNING_OBJECT (cpad, "Could not configure pool of %u bytes buffers",
+        size);
+    gst_object_unref (pool);
+    return FALSE;
+  }
+
+  GST_DEBUG_OBJECT (cpad, "Created pool of %u bytes buffers", size);
+  cpad->convert_pool = pool;
+  cpad->convert_pool_size = size;
+
+  return TRUE;
+}
+
+static GstBuffer *
+gst_compositor_pad_acquire_buffer (GstCompositorPad * cpad, guint size)
+{
+  GstBuffer *buffer = NULL;
+  GstMiniObject *obj;
+
+  if (!gst_compositor_pad_ensure_pool (cpad, size))
+    return NULL;
+
+  if (gst_buffer_pool_acquire_buffer (cpad->convert_pool, &buffer,
+          NULL) != GST_FLOW_OK)
+    return NULL;
+
+  /* Buffers allocated by the pool are marked, so that reused ones can be
+   * told apart */
+  obj = GST_MINI_OBJECT_CAST (buffer);
+  if (gst_mini_object_get_qdata (obj, pooled_buffer_quark)) {
+    cpad->pool_hits++;
+  } else {
+    cpad->pool_misses++;
+    gst_mini_object_set_qdata (obj, pooled_buffer_quark, GINT_TO_POINTER (1),
+        NULL);
+  }
+
+  GST_LOG_OBJECT (cpad, "Conversion pool: %" G_GUINT64_FORMAT " hits, %"
+      G_GUINT64_FORMAT " misses", cpad->pool_hits, cpad->pool_misses);
+
+  return buffer;
+}
+
 static gboolean
 gst_compositor_pad_set_info (GstVideoAggregatorPad * pad,
     GstVideoAggregator * vagg G_GNUC_UNUSED,
     GstVideoInfo * current_info, GstVideoInfo * wanted_info)
 {
   GstCompositorPad *cpad = GST_COMPOSITOR_PAD (pad);
-  gchar *colorimetry, *best_colorimetry;
-  const gchar *chroma, *best_chroma;
+  GstVideoInfo tmp_info;
   gint width, height;
 
   if (!current_info->finfo)
@@ -230,18 +385,8 @@ gst_compositor_pad_set_info (GstVideoAggregatorPad * pad,
   if (GST_VIDEO_INFO_FORMAT (current_info) == GST_VIDEO_FORMAT_UNKNOWN)
     return TRUE;
 
-  if (cpad->convert)
-    gst_video_converter_free (cpad->convert);
-
   cpad->convert = NULL;
 
-  colorimetry = gst_video_colorimetry_to_string (&(current_info->colorimetry));
-  chroma = gst_video_chroma_to_string (current_info->chroma_site);
-
-  best_colorimetry =
-      gst_video_colorimetry_to_string (&(wanted_info->colorimetry));
-  best_chroma = gst_video_chroma_to_string (wanted_info->chroma_site);
-
   if (cpad->width > 0)
     width = cpad->width;
   else
@@ -252,37 +397,30 @@ gst_compositor_pad_set_info (GstVideoAggregatorPad * pad,
   else
     height = current_info->height;
 
-  if (GST_VIDEO_INFO_FORMAT (wanted_info) !=
-      GST_VIDEO_INFO_FORMAT (current_info)
-      || g_strcmp0 (colorimetry, best_colorimetry)
-      || g_strcmp0 (chroma, best_chroma)
-      || width != current_info->width || height != current_info->height) {
-    GstVideoInfo tmp_info;
-
-    /* Initialize with the wanted video format and our original width and
-     * height as we don't want to rescale. Then copy over the wanted
-     * colorimetry, and chroma-site and our current pixel-aspect-ratio
-     * and other relevant fields.
-     */
-    gst_video_info_set_format (&tmp_info, GST_VIDEO_INFO_FORMAT (wanted_info),
-        width, height);
-    tmp_info.chroma_site = wanted_info->chroma_site;
-    tmp_info.colorimetry = wanted_info->colorimetry;
-    tmp_info.par_n = current_info->par_n;
-    tmp_info.par_d = current_info->par_d;
-    tmp_info.fps_n = current_info->fps_n;
-    tmp_info.fps_d = current_info->fps_d;
-    tmp_info.flags = current_info->flags;
-    tmp_info.interlace_mode = current_info->interlace_mode;
-
+  /* Initialize with the wanted video format and our original width and
+   * height as we don't want to rescale. Then copy over the wanted
+   * colorimetry, and chroma-site and our current pixel-aspect-ratio
+   * and other relevant fields.
+   */
+  gst_video_info_set_format (&tmp_info, GST_VIDEO_INFO_FORMAT (wanted_info),
+      width, height);
+  tmp_info.chroma_site = wanted_info->chroma_site;
+  tmp_info.colorimetry = wanted_info->colorimetry;
+  tmp_info.par_n = current_info->par_n;
+  tmp_info.par_d = current_info->par_d;
+  tmp_info.fps_n = current_info->fps_n;
+  tmp_info.fps_d = current_info->fps_d;
+  tmp_info.flags = current_info->flags;
+  tmp_info.interlace_mode = current_info->interlace_mode;
+
+  if (gst_compositor_pad_needs_conversion (current_info, &tmp_info)) {
     GST_DEBUG_OBJECT (pad, "This pad will be converted from %d to %d",
         GST_VIDEO_INFO_FORMAT (current_info),
         GST_VIDEO_INFO_FORMAT (&tmp_info));
-    cpad->convert = gst_video_converter_new (current_info, &tmp_info, NULL);
+    cpad->convert =
+        gst_compositor_pad_get_converter (cpad, current_info, &tmp_info);
     cpad->conversion_info = tmp_info;
     if (!cpad->convert) {
-      g_free (colorimetry);
-      g_free (best_colorimetry);
       GST_WARNING_OBJECT (pad, "No path found for conversion");
       return FALSE;
     }
@@ -290,8 +428,6 @@ gst_compositor_pad_set_info (GstVideoAggregatorPad * pad,
     cpad->conversion_info = *current_info;
     GST_DEBUG_OBJECT (pad, "This pad will not need conversion");
   }
-  g_free (colorimetry);
-  g_free (best_colorimetry);
 
   return TRUE;
 }
@@ -305,7 +441,6 @@ gst_compositor_pad_prepare_frame (GstVideoAggregatorPad * pad,
   GstVideoFrame *converted_frame;
   GstBuffer *converted_buf = NULL;
   GstVideoFrame *frame;
-  static GstAllocationParams params = { 0, 15, 0, 0, };
   gint width, height;
 
   if (!pad->buffer)
@@ -333,65 +468,40 @@ gst_compositor_pad_prepare_frame (GstVideoAggregatorPad * pad,
    * and height, otherwise set_info would've been called */
   if (cpad->conversion_info.width != width ||
       cpad->conversion_info.height != height) {
-    gchar *colorimetry, *wanted_colorimetry;
-    const gchar *chroma, *wanted_chroma;
+    GstVideoInfo tmp_info;
+
+    gst_video_info_set_format (&tmp_info, cpad->conversion_info.finfo->format,
+        width, height);
+    tmp_info.chroma_site = cpad->conversion_info.chroma_site;
+    tmp_info.colorimetry = cpad->conversion_info.colorimetry;
+    tmp_info.par_n = cpad->conversion_info.par_n;
+    tmp_info.par_d = cpad->conversion_info.par_d;
+    tmp_info.fps_n = cpad->conversion_info.fps_n;
+    tmp_info.fps_d = cpad->conversion_info.fps_d;
+    tmp_info.flags = cpad->conversion_info.flags;
+    tmp_info.interlace_mode = cpad->conversion_info.interlace_mode;
 
     /* We might end up with no converter afterwards if
      * the only reason for conversion was a different
      * width or height
      */
-    if (cpad->convert)
-      gst_video_converter_free (cpad->convert);
     cpad->convert = NULL;
+    cpad->conversion_info = tmp_info;
 
-    colorimetry = gst_video_colorimetry_to_string (&frame->info.colorimetry);
-    chroma = gst_video_chroma_to_string (frame->info.chroma_site);
-
-    wanted_colorimetry =
-        gst_video_colorimetry_to_string (&cpad->conversion_info.colorimetry);
-    wanted_chroma =
-        gst_video_chroma_to_string (cpad->conversion_info.chroma_site);
-
-    if (GST_VIDEO_INFO_FORMAT (&frame->info) !=
-        GST_VIDEO_INFO_FORMAT (&cpad->conversion_info)
-        || g_strcmp0 (colorimetry, wanted_colorimetry)
-        || g_strcmp0 (chroma, wanted_chroma)
-        || width != GST_VIDEO_FRAME_WIDTH (frame)
-        || height != GST_VIDEO_FRAME_HEIGHT (frame)) {
-      GstVideoInfo tmp_info;
-
-      gst_video_info_set_format (&tmp_info, cpad->conversion_info.finfo->format,
-          width, height);
-      tmp_info.chroma_site = cpad->conversion_info.chroma_site;
-      tmp_info.colorimetry = cpad->conversion_info.colorimetry;
-      tmp_info.par_n = cpad->conversion_info.par_n;
-      tmp_info.par_d = cpad->conversion_info.par_d;
-      tmp_info.fps_n = cpad->conversion_info.fps_n;
-      tmp_info.fps_d = cpad->conversion_info.fps_d;
-      tmp_info.flags = cpad->conversion_info.flags;
-      tmp_info.interlace_mode = cpad->conversion_info.interlace_mode;
-
+    if (gst_compositor_pad_needs_conversion (&frame->info, &tmp_info)) {
       GST_DEBUG_OBJECT (pad, "This pad will be converted from %d to %d",
           GST_VIDEO_INFO_FORMAT (&frame->info),
           GST_VIDEO_INFO_FORMAT (&tmp_info));
-      cpad->convert = gst_video_converter_new (&frame->info, &tmp_info, NULL);
-      cpad->conversion_info = tmp_info;
+      cpad->convert =
+          gst_compositor_pad_get_converter (cpad, &frame->info, &tmp_info);
 
       if (!cpad->convert) {
         GST_WARNING_OBJECT (pad, "No path found for conversion");
-        g_free (colorimetry);
-        g_free (wanted_colorimetry);
         gst_video_frame_unmap (frame);
         g_slice_free (GstVideoFrame, frame);
         return FALSE;
       }
-    } else {
-      cpad->conversion_info.width = width;
-      cpad->conversion_info.height = height;
     }
-
-    g_free (colorimetry);
-    g_free (wanted_colorimetry);
   }
 
   if (cpad->alpha == 0.0) {
@@ -408,22 +518,24 @@ gst_compositor_pad_prepare_frame (GstVideoAggregatorPad * pad,
     converted_size = cpad->conversion_info.size;
     outsize = GST_VIDEO_INFO_SIZE (&vagg->info);
     converted_size = converted_size > outsize ? converted_size : outsize;
-    converted_buf = gst_buffer_new_allocate (NULL, converted_size, &params);
+    converted_buf = gst_compositor_pad_acquire_buffer (cpad, converted_size);
 
-    if (!gst_video_frame_map (converted_frame, &(cpad->conversion_info),
-            converted_buf, GST_MAP_READWRITE)) {
+    if (!converted_buf || !gst_video_frame_map (converted_frame,
+            &(cpad->conversion_info), converted_buf, GST_MAP_READWRITE)) {
       GST_WARNING_OBJECT (vagg, "Could not map converted frame");
 
+      if (converted_buf)
+        gst_buffer_unref (converted_buf);
       g_slice_free (GstVideoFrame, converted_frame);
       gst_video_frame_unmap (frame);
       g_slice_free (GstVideoFrame, frame);
       return FALSE;
     }
 
-    gst_video_converter_frame (cpad->convert, frame, converted_frame);
+    /* The conversion itself is done by aggregate_frames, so that the
+     * frames of all pads can be converted in parallel */
     cpad->converted_buffer = converted_buf;
-    gst_video_frame_unmap (frame);
-    g_slice_free (GstVideoFrame, frame);
+    cpad->pending_frame = frame;
   } else {
     converted_frame = frame;
   }
@@ -439,6 +551,12 @@ gst_compositor_pad_clean_frame (GstVideoAggregatorPad * pad,
 {
   GstCompositorPad *cpad = GST_COMPOSITOR_PAD (pad);
 
+  if (cpad->pending_frame) {
+    gst_video_frame_unmap (cpad->pending_frame);
+    g_slice_free (GstVideoFrame, cpad->pending_frame);
+    cpad->pending_frame = NULL;
+  }
+
   if (pad->aggregated_frame) {
     gst_video_frame_unmap (pad->aggregated_frame);
     g_slice_free (GstVideoFrame, pad->aggregated_frame);
@@ -456,9 +574,15 @@ gst_compositor_pad_finalize (GObject * object)
 {
   GstCompositorPad *pad = GST_COMPOSITOR_PAD (object);
 
-  if (pad->convert)
-    gst_video_converter_free (pad->convert);
-  pad->convert = NULL;
+  gst_compositor_pad_clear_converters (pad);
+
+  if (pad->convert_pool) {
+    GST_DEBUG_OBJECT (pad, "Conversion pool: %" G_GUINT64_FORMAT " hits, %"
+        G_GUINT64_FORMAT " misses", pad->pool_hits, pad->pool_misses);
+    gst_buffer_pool_set_active (pad->convert_pool, FALSE);
+    gst_object_unref (pad->convert_pool);
+    pad->convert_pool = NULL;
+  }
 
   G_OBJECT_CLASS (gst_compositor_pad_parent_class)->finalize (object);
 }
@@ -474,6 +598,8 @@ gst_compositor_pad_class_init (GstCompositorPadClass * klass)
   gobject_class->get_property = gst_compositor_pad_get_property;
   gobject_class->finalize = gst_compositor_pad_finalize;
 
+  pooled_buffer_quark = g_quark_from_static_string ("compositor-pooled");
+
   g_object_class_install_property (gobject_class, PROP_PAD_XPOS,
       g_param_spec_int ("xpos", "X Position", "X Position of the picture",
           G_MININT, G_MAXINT, DEFAULT_PAD_XPOS,
@@ -513,10 +639,13 @@ gst_compositor_pad_init (GstCompositorPad * compo_pad)
 
 /* GstCompositor */
 #define DEFAULT_BACKGROUND COMPOSITOR_BACKGROUND_CHECKER
+#define DEFAULT_THREADS    1
+#define MAX_THREADS        64
 enum
 {
   PROP_0,
-  PROP_BACKGROUND
+  PROP_BACKGROUND,
+  PROP_THREADS
 };
 
 #define GST_TYPE_COMPOSITOR_BACKGROUND (gst_compositor_background_get_type())
@@ -552,6 +681,11 @@ gst_compositor_get_property (GObject * object,
     case PROP_BACKGROUND:
       g_value_set_enum (value, self->background);
       break;
+    case PROP_THREADS:
+      GST_OBJECT_LOCK (self);
+      g_value_set_uint (value, self->threads);
+      GST_OBJECT_UNLOCK (self);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -568,6 +702,11 @@ gst_compositor_set_property (GObject * object,
     case PROP_BACKGROUND:
       self->background = g_value_get_enum (value);
       break;
+    case PROP_THREADS:
+      GST_OBJECT_LOCK (self);
+      self->threads = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (self);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -584,6 +723,7 @@ set_functions (GstCompositor * self, GstVideoInfo * info)
 
   self->blend = NULL;
   self->overlay = NULL;
+  self->copy = NULL;
   self->fill_checker = NULL;
   self->fill_color = NULL;
 
@@ -591,6 +731,7 @@ set_functions (GstCompositor * self, GstVideoInfo * info)
     case GST_VIDEO_FORMAT_AYUV:
       self->blend = gst_compositor_blend_ayuv;
       self->overlay = gst_compositor_overlay_ayuv;
+      self->copy = gst_compositor_copy_a32;
       self->fill_checker = gst_compositor_fill_checker_ayuv;
       self->fill_color = gst_compositor_fill_color_ayuv;
       ret = TRUE;
@@ -598,6 +739,7 @@ set_functions (GstCompositor * self, GstVideoInfo * info)
     case GST_VIDEO_FORMAT_ARGB:
       self->blend = gst_compositor_blend_argb;
       self->overlay = gst_compositor_overlay_argb;
+      self->copy = gst_compositor_copy_a32;
       self->fill_checker = gst_compositor_fill_checker_argb;
       self->fill_color = gst_compositor_fill_color_argb;
       ret = TRUE;
@@ -605,6 +747,7 @@ set_functions (GstCompositor * self, GstVideoInfo * info)
     case GST_VIDEO_FORMAT_BGRA:
       self->blend = gst_compositor_blend_bgra;
       self->overlay = gst_compositor_overlay_bgra;
+      self->copy = gst_compositor_copy_a32;
       self->fill_checker = gst_compositor_fill_checker_bgra;
       self->fill_color = gst_compositor_fill_color_bgra;
       ret = TRUE;
@@ -612,6 +755,7 @@ set_functions (GstCompositor * self, GstVideoInfo * info)
     case GST_VIDEO_FORMAT_ABGR:
       self->blend = gst_compositor_blend_abgr;
       self->overlay = gst_compositor_overlay_abgr;
+      self->copy = gst_compositor_copy_a32;
       self->fill_checker = gst_compositor_fill_checker_abgr;
       self->fill_color = gst_compositor_fill_color_abgr;
       ret = TRUE;
@@ -619,6 +763,7 @@ set_functions (GstCompositor * self, GstVideoInfo * info)
     case GST_VIDEO_FORMAT_RGBA:
       self->blend = gst_compositor_blend_rgba;
       self->overlay = gst_compositor_overlay_rgba;
+      self->copy = gst_compositor_copy_a32;
       self->fill_checker = gst_compositor_fill_checker_rgba;
       self->fill_color = gst_compositor_fill_color_rgba;
       ret = TRUE;
@@ -739,6 +884,10 @@ set_functions (GstCompositor * self, GstVideoInfo * info)
       break;
   }
 
+  /* The other blend functions already copy when alpha is 1.0 */
+  if (self->copy == NULL)
+    self->copy = self->blend;
+
   return ret;
 }
 
@@ -792,70 +941,453 @@ _update_caps (GstVideoAggregator * vagg, GstCaps * caps)
   return ret;
 }
 
-static GstFlowReturn
-gst_compositor_aggregate_frames (GstVideoAggregator * vagg, GstBuffer * outbuf)
+/* Output frames are split in stripes of a multiple of this many lines, which
+ * keeps stripes aligned on the chroma subsampling and the checker pattern */
+#define STRIPE_ALIGN 16
+
+typedef struct _CompositorTask CompositorTask;
+typedef void (*CompositorTaskFunc) (CompositorTask * task);
+
+struct _CompositorTask
 {
-  GList *l;
-  GstCompositor *self = GST_COMPOSITOR (vagg);
+  CompositorTaskFunc func;
+};
+
+typedef struct
+{
+  CompositorTask **tasks;
+  guint n_tasks;
+  volatile gint next;
+} CompositorTaskList;
+
+typedef struct
+{
+  gint x0, y0, x1, y1;
+} CompositorRect;
+
+typedef struct
+{
+  GstCompositorPad *pad;
+  GstVideoFrame *frame;
   BlendFunction composite;
-  GstVideoFrame out_frame, *outframe;
+  gint xpos, ypos;
+  gdouble alpha;
+  /* part of the output frame written by the input */
+  CompositorRect rect;
+  gboolean opaque;
+} CompositorInput;
+
+typedef struct
+{
+  CompositorTask task;
+  GstCompositorPad *pad;
+} CompositorConvert;
 
-  if (!gst_video_frame_map (&out_frame, &vagg->info, outbuf, GST_MAP_WRITE)) {
-    GST_WARNING_OBJECT (vagg, "Could not map output buffer");
-    return GST_FLOW_ERROR;
+typedef struct
+{
+  CompositorTask task;
+  GstCompositor *self;
+  GstVideoFrame *outframe;
+  CompositorInput *inputs;
+  guint n_inputs;
+  /* whether each band of STRIPE_ALIGN lines needs a background */
+  const gboolean *fill_bands;
+  /* lines [y, y + height) of the output frame */
+  gint y, height;
+} CompositorStripe;
+
+static void
+gst_compositor_run_task_list (CompositorTaskList * list)
+{
+  gint i;
+
+  while ((i = g_atomic_int_add (&list->next, 1)) < (gint) list->n_tasks)
+    list->tasks[i]->func (list->tasks[i]);
+}
+
+static void
+gst_compositor_worker_func (CompositorTaskList * list, GstCompositor * self)
+{
+  gst_compositor_run_task_list (list);
+
+  g_mutex_lock (&self->workers_lock);
+  if (--self->workers_pending == 0)
+    g_cond_signal (&self->workers_cond);
+  g_mutex_unlock (&self->workers_lock);
+}
+
+static gboolean
+gst_compositor_ensure_workers (GstCompositor * self, guint n_threads)
+{
+  GError *err = NULL;
+
+  if (n_threads <= 1)
+    return TRUE;
+
+  if (self->workers) {
+    if ((guint) g_thread_pool_get_max_threads (self->workers) != n_threads - 1)
+      g_thread_pool_set_max_threads (self->workers, n_threads - 1, NULL);
+    return TRUE;
   }
 
-  outframe = &out_frame;
-  /* default to blending */
-  composite = self->blend;
+  self->workers = g_thread_pool_new ((GFunc) gst_compositor_worker_func, self,
+      n_threads - 1, FALSE, &err);
+  if (!self->workers) {
+    GST_WARNING ("Could not create helper threads: %s", err->message);
+    g_clear_error (&err);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Runs all the @tasks, on up to @n_threads threads including the calling
+ * one, and returns once they are all done */
+static void
+gst_compositor_run_tasks (GstCompositor * self, guint n_threads,
+    CompositorTask ** tasks, guint n_tasks)
+{
+  CompositorTaskList list = { tasks, n_tasks, 0 };
+  guint i, n_workers = 0;
+
+  if (self->workers && n_threads > 1 && n_tasks > 1)
+    n_workers = MIN (n_threads, n_tasks) - 1;
+
+  g_mutex_lock (&self->workers_lock);
+  self->workers_pending = n_workers;
+  g_mutex_unlock (&self->workers_lock);
+
+  for (i = 0; i < n_workers; i++)
+    g_thread_pool_push (self->workers, &list, NULL);
+
+  gst_compositor_run_task_list (&list);
+
+  g_mutex_lock (&self->workers_lock);
+  while (self->workers_pending > 0)
+    g_cond_wait (&self->workers_cond, &self->workers_lock);
+  g_mutex_unlock (&self->workers_lock);
+}
+
+static void
+gst_compositor_convert_task (CompositorConvert * convert)
+{
+  GstCompositorPad *cpad = convert->pad;
+
+  gst_video_converter_frame (cpad->convert, cpad->pending_frame,
+      GST_VIDEO_AGGREGATOR_PAD (cpad)->aggregated_frame);
+}
+
+static void
+gst_compositor_fill_background (GstCompositor * self, GstVideoFrame * frame)
+{
   switch (self->background) {
     case COMPOSITOR_BACKGROUND_CHECKER:
-      self->fill_checker (outframe);
+      self->fill_checker (frame);
       break;
     case COMPOSITOR_BACKGROUND_BLACK:
-      self->fill_color (outframe, 16, 128, 128);
+      self->fill_color (frame, 16, 128, 128);
       break;
     case COMPOSITOR_BACKGROUND_WHITE:
-      self->fill_color (outframe, 240, 128, 128);
+      self->fill_color (frame, 240, 128, 128);
       break;
     case COMPOSITOR_BACKGROUND_TRANSPARENT:
     {
       guint i, plane, num_planes, height;
 
-      num_planes = GST_VIDEO_FRAME_N_PLANES (outframe);
+      num_planes = GST_VIDEO_FRAME_N_PLANES (frame);
       for (plane = 0; plane < num_planes; ++plane) {
         guint8 *pdata;
         gsize rowsize, plane_stride;
 
-        pdata = GST_VIDEO_FRAME_PLANE_DATA (outframe, plane);
-        plane_stride = GST_VIDEO_FRAME_PLANE_STRIDE (outframe, plane);
-        rowsize = GST_VIDEO_FRAME_COMP_WIDTH (outframe, plane)
-            * GST_VIDEO_FRAME_COMP_PSTRIDE (outframe, plane);
-        height = GST_VIDEO_FRAME_COMP_HEIGHT (outframe, plane);
+        pdata = GST_VIDEO_FRAME_PLANE_DATA (frame, plane);
+        plane_stride = GST_VIDEO_FRAME_PLANE_STRIDE (frame, plane);
+        rowsize = GST_VIDEO_FRAME_COMP_WIDTH (frame, plane)
+            * GST_VIDEO_FRAME_COMP_PSTRIDE (frame, plane);
+        height = GST_VIDEO_FRAME_COMP_HEIGHT (frame, plane);
         for (i = 0; i < height; ++i) {
           memset (pdata, 0, rowsize);
           pdata += plane_stride;
         }
       }
-
-      /* use overlay to keep background transparent */
-      composite = self->overlay;
       break;
     }
   }
+}
+
+/* Makes @stripe a view on @height lines of @frame starting at line @y, which
+ * must be aligned on the vertical subsampling of the format */
+static void
+gst_compositor_frame_stripe (GstVideoFrame * frame, gint y, gint height,
+    GstVideoFrame * stripe)
+{
+  const GstVideoFormatInfo *finfo = frame->info.finfo;
+  guint comp, plane;
+
+  *stripe = *frame;
+  GST_VIDEO_INFO_HEIGHT (&stripe->info) = height;
+
+  for (comp = 0; comp < GST_VIDEO_FORMAT_INFO_N_COMPONENTS (finfo); comp++) {
+    plane = GST_VIDEO_FORMAT_INFO_PLANE (finfo, comp);
+    stripe->data[plane] = (guint8 *) frame->data[plane] +
+        GST_VIDEO_FORMAT_INFO_SCALE_HEIGHT (finfo, comp, y) *
+        GST_VIDEO_FRAME_PLANE_STRIDE (frame, plane);
+  }
+}
+
+static void
+gst_compositor_stripe_task (CompositorStripe * stripe)
+{
+  GstVideoFrame frame;
+  gint y, end, fill_end;
+  guint i;
+
+  end = stripe->y + stripe->height;
+
+  /* Only fill the runs of bands that are not hidden by opaque inputs */
+  for (y = stripe->y; y < end; y = fill_end) {
+    fill_end = y;
+    while (fill_end < end && stripe->fill_bands[fill_end / STRIPE_ALIGN])
+      fill_end = MIN (fill_end + STRIPE_ALIGN, end);
+
+    if (fill_end > y) {
+      gst_compositor_frame_stripe (stripe->outframe, y, fill_end - y, &frame);
+      gst_compositor_fill_background (stripe->self, &frame);
+    } else {
+      fill_end = MIN (y + STRIPE_ALIGN, end);
+    }
+  }
+
+  gst_compositor_frame_stripe (stripe->outframe, stripe->y, stripe->height,
+      &frame);
+
+  for (i = 0; i < stripe->n_inputs; i++) {
+    CompositorInput *input = &stripe->inputs[i];
+
+    if (input->rect.y1 <= stripe->y || input->rect.y0 >= end)
+      continue;
+
+    input->composite (input->frame, input->xpos, input->ypos - stripe->y,
+        input->alpha, &frame);
+  }
+}
+
+/* Rounds @v up to the subsampling of the chroma components, like the blend
+ * functions do with the position of the inputs */
+#define ROUND_UP_SUB(v, sub) (((v) + (1 << (sub)) - 1) & ~((1 << (sub)) - 1))
+
+static void
+gst_compositor_input_rect (CompositorInput * input, GstVideoFrame * outframe)
+{
+  const GstVideoFormatInfo *finfo = outframe->info.finfo;
+  gint xpos, ypos;
+
+  xpos = ROUND_UP_SUB (input->xpos, GST_VIDEO_FORMAT_INFO_W_SUB (finfo, 1));
+  ypos = ROUND_UP_SUB (input->ypos, GST_VIDEO_FORMAT_INFO_H_SUB (finfo, 1));
+
+  input->rect.x0 = MAX (xpos, 0);
+  input->rect.y0 = MAX (ypos, 0);
+  input->rect.x1 = MIN (xpos + GST_VIDEO_FRAME_WIDTH (input->frame),
+      GST_VIDEO_FRAME_WIDTH (outframe));
+  input->rect.y1 = MIN (ypos + GST_VIDEO_FRAME_HEIGHT (input->frame),
+      GST_VIDEO_FRAME_HEIGHT (outframe));
+}
+
+/* Whether @rect is completely covered by the opaque @inputs */
+static gboolean
+gst_compositor_rect_is_covered (const CompositorRect * rect,
+    const CompositorInput * inputs, guint n_inputs)
+{
+  gint x, y, next_y;
+  gboolean progress;
+  guint i;
+
+  for (y = rect->y0; y < rect->y1; y = next_y) {
+    next_y = rect->y1;
+
+    /* The inputs covering line y cover all the lines up to next_y */
+    for (i = 0; i < n_inputs; i++) {
+      const CompositorRect *o = &inputs[i].rect;
+
+      if (!inputs[i].opaque)
+        continue;
+
+      if (o->y0 > y)
+        next_y = MIN (next_y, o->y0);
+      else if (o->y1 > y)
+        next_y = MIN (next_y, o->y1);
+    }
+
+    /* Walk the line from left to right over the covering inputs */
+    x = rect->x0;
+    progress = TRUE;
+    while (progress && x < rect->x1) {
+      progress = FALSE;
+      for (i = 0; i < n_inputs; i++) {
+        const CompositorRect *o = &inputs[i].rect;
+
+        if (inputs[i].opaque && o->y0 <= y && o->y1 > y && o->x0 <= x
+            && o->x1 > x) {
+          x = o->x1;
+          progress = TRUE;
+        }
+      }
+    }
+
+    if (x < rect->x1)
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+static GstFlowReturn
+gst_compositor_aggregate_frames (GstVideoAggregator * vagg, GstBuffer * outbuf)
+{
+  GList *l;
+  GstCompositor *self = GST_COMPOSITOR (vagg);
+  BlendFunction composite;
+  GstVideoFrame out_frame, *outframe;
+  CompositorInput *inputs;
+  CompositorConvert *converts;
+  CompositorStripe *stripes;
+  CompositorTask **tasks;
+  gboolean *fill_bands;
+  guint n_pads, n_inputs = 0, n_visible, n_converts = 0, n_stripes, n_threads;
+  guint n_bands, n_filled = 0, i;
+  gint width, height, lines;
+
+  if (!gst_video_frame_map (&out_frame, &vagg->info, outbuf, GST_MAP_WRITE)) {
+    GST_WARNING_OBJECT (vagg, "Could not map output buffer");
+    return GST_FLOW_ERROR;
+  }
+
+  outframe = &out_frame;
+  width = GST_VIDEO_FRAME_WIDTH (outframe);
+  height = GST_VIDEO_FRAME_HEIGHT (outframe);
+
+  /* default to blending, use overlay to keep background transparent */
+  if (self->background == COMPOSITOR_BACKGROUND_TRANSPARENT)
+    composite = self->overlay;
+  else
+    composite = self->blend;
 
   GST_OBJECT_LOCK (vagg);
+  n_threads = self->threads;
+  if (!gst_compositor_ensure_workers (self, n_threads))
+    n_threads = 1;
+
+  n_pads = GST_ELEMENT (vagg)->numsinkpads;
+  inputs = g_new (CompositorInput, n_pads);
+  converts = g_new (CompositorConvert, n_pads);
+  tasks = g_new (CompositorTask *, MAX (n_pads, n_threads));
+
   for (l = GST_ELEMENT (vagg)->sinkpads; l; l = l->next) {
     GstVideoAggregatorPad *pad = l->data;
     GstCompositorPad *compo_pad = GST_COMPOSITOR_PAD (pad);
+    CompositorInput *input = &inputs[n_inputs];
+
+    if (pad->aggregated_frame == NULL)
+      continue;
+
+    input->pad = compo_pad;
+    input->frame = pad->aggregated_frame;
+    input->xpos = compo_pad->xpos;
+    input->ypos = compo_pad->ypos;
+    input->alpha = compo_pad->alpha;
+    gst_compositor_input_rect (input, outframe);
+
+    if (input->rect.x0 >= input->rect.x1 || input->rect.y0 >= input->rect.y1) {
+      GST_LOG_OBJECT (pad, "Outside of the output frame, skipping");
+      continue;
+    }
 
-    if (pad->aggregated_frame != NULL) {
-      composite (pad->aggregated_frame, compo_pad->xpos, compo_pad->ypos,
-          compo_pad->alpha, outframe);
+    /* Fully opaque inputs are copied and hide everything below them */
+    input->opaque = compo_pad->alpha == 1.0
+        && !GST_VIDEO_INFO_HAS_ALPHA (&pad->buffer_vinfo);
+    input->composite = input->opaque ? self->copy : composite;
+
+    n_inputs++;
+  }
+
+  /* Drop the inputs hidden by the opaque inputs above them, and only
+   * convert the remaining ones */
+  for (i = 0, n_visible = 0; i < n_inputs; i++) {
+    GstCompositorPad *compo_pad = inputs[i].pad;
+
+    if (gst_compositor_rect_is_covered (&inputs[i].rect, &inputs[i + 1],
+            n_inputs - i - 1)) {
+      GST_LOG_OBJECT (compo_pad, "Hidden by opaque pads, skipping");
+      continue;
+    }
+
+    inputs[n_visible] = inputs[i];
+
+    if (compo_pad->pending_frame) {
+      converts[n_converts].task.func =
+          (CompositorTaskFunc) gst_compositor_convert_task;
+      converts[n_converts].pad = compo_pad;
+      tasks[n_converts] = &converts[n_converts].task;
+      n_converts++;
     }
+
+    n_visible++;
+  }
+
+  if (n_converts > 0)
+    gst_compositor_run_tasks (self, n_threads, tasks, n_converts);
+
+  /* Find the bands of lines where the background is visible */
+  n_bands = (height + STRIPE_ALIGN - 1) / STRIPE_ALIGN;
+  fill_bands = g_new (gboolean, n_bands);
+  for (i = 0; i < n_bands; i++) {
+    CompositorRect band;
+
+    band.x0 = 0;
+    band.x1 = width;
+    band.y0 = i * STRIPE_ALIGN;
+    band.y1 = MIN (band.y0 + STRIPE_ALIGN, height);
+
+    fill_bands[i] = !gst_compositor_rect_is_covered (&band, inputs, n_visible);
+    if (fill_bands[i])
+      n_filled++;
+  }
+
+  /* Fill and blend each stripe of the output frame independently */
+  n_stripes = MAX (1, MIN (n_threads, height / STRIPE_ALIGN));
+  lines = GST_ROUND_UP_N ((height + n_stripes - 1) / n_stripes, STRIPE_ALIGN);
+
+  stripes = g_new (CompositorStripe, n_stripes);
+  for (i = 0; i < n_stripes; i++) {
+    CompositorStripe *stripe = &stripes[i];
+    gint y = i * lines;
+
+    if (y >= height)
+      break;
+
+    stripe->task.func = (CompositorTaskFunc) gst_compositor_stripe_task;
+    stripe->self = self;
+    stripe->outframe = outframe;
+    stripe->inputs = inputs;
+    stripe->n_inputs = n_visible;
+    stripe->fill_bands = fill_bands;
+    stripe->y = y;
+    stripe->height = MIN (lines, height - y);
+    tasks[i] = &stripe->task;
   }
+  n_stripes = i;
+
+  GST_LOG_OBJECT (vagg, "Blending %u of %u pads and filling %u of %u bands "
+      "in %u stripes on %u threads", n_visible, n_inputs, n_filled, n_bands,
+      n_stripes, n_threads);
+  gst_compositor_run_tasks (self, n_threads, tasks, n_stripes);
   GST_OBJECT_UNLOCK (vagg);
 
+  g_free (stripes);
+  g_free (fill_bands);
+  g_free (tasks);
+  g_free (converts);
+  g_free (inputs);
+
   gst_video_frame_unmap (outframe);
 
   return GST_FLOW_OK;
@@ -903,6 +1435,20 @@ _sink_query (GstAggregator * agg, GstAggregatorPad * bpad, GstQuery * query)
   }
 }
 
+static void
+gst_compositor_finalize (GObject * object)
+{
+  GstCompositor *self = GST_COMPOSITOR (object);
+
+  if (self->workers)
+    g_thread_pool_free (self->workers, FALSE, TRUE);
+  self->workers = NULL;
+  g_mutex_clear (&self->workers_lock);
+  g_cond_clear (&self->workers_cond);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
 /* GObject boilerplate */
 static void
 gst_compositor_class_init (GstCompositorClass * klass)
@@ -915,6 +1461,7 @@ gst_compositor_class_init (GstCompositorClass * klass)
 
   gobject_class->get_property = gst_compositor_get_property;
   gobject_class->set_property = gst_compositor_set_property;
+  gobject_class->finalize = gst_compositor_finalize;
 
   agg_class->sinkpads_type = GST_TYPE_COMPOSITOR_PAD;
   agg_class->sink_query = _sink_query;
@@ -926,6 +1473,12 @@ gst_compositor_class_init (GstCompositorClass * klass)
           GST_TYPE_COMPOSITOR_BACKGROUND,
           DEFAULT_BACKGROUND, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_THREADS,
+      g_param_spec_uint ("threads", "Threads",
+          "Number of threads used to convert and blend frames", 1,
+          MAX_THREADS, DEFAULT_THREADS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   gst_element_class_add_pad_template (gstelement_class,
       gst_static_pad_template_get (&src_factory));
   gst_element_class_add_pad_template (gstelement_class,
@@ -941,6 +1494,9 @@ static void
 gst_compositor_init (GstCompositor * self)
 {
   self->background = DEFAULT_BACKGROUND;
+  self->threads = DEFAULT_THREADS;
+  g_mutex_init (&self->workers_lock);
+  g_cond_init (&self->workers_cond);
   /* initialize variables */
 }
 
@@ -70,9 +70,17 @@ struct _GstCompositor
   GstVideoAggregator videoaggregator;
   GstCompositorBackground background;
 
-  BlendFunction blend, overlay;
+  guint threads;
+
+  BlendFunction blend, overlay, copy;
   FillCheckerFunction fill_checker;
   FillColorFunction fill_color;
+
+  /* Helper threads for stripe blending and pad conversion */
+  GThreadPool *workers;
+  GMutex workers_lock;
+  GCond workers_cond;
+  guint workers_pending;
 };
 
 struct _GstCompositorClass
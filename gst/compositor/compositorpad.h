@@ -39,6 +39,15 @@ G_BEGIN_DECLS
 typedef struct _GstCompositorPad GstCompositorPad;
 typedef struct _GstCompositorPadClass GstCompositorPadClass;
 
+#define COMPOSITOR_PAD_MAX_CONVERTERS 4
+
+typedef struct
+{
+  GstVideoInfo in_info;
+  GstVideoInfo out_info;
+  GstVideoConverter *convert;
+} GstCompositorPadConverter;
+
 /**
  * GstCompositorPad:
  *
@@ -53,9 +62,21 @@ struct _GstCompositorPad
   gint width, height;
   gdouble alpha;
 
+  /* current converter, owned by the converters cache */
   GstVideoConverter *convert;
   GstVideoInfo conversion_info;
   GstBuffer *converted_buffer;
+  /* mapped input frame, converted into aggregated_frame by aggregate_frames */
+  GstVideoFrame *pending_frame;
+
+  /* recently used converters, most recent first */
+  GstCompositorPadConverter converters[COMPOSITOR_PAD_MAX_CONVERTERS];
+  guint n_converters;
+
+  /* pool of buffers for converted_buffer */
+  GstBufferPool *convert_pool;
+  guint convert_pool_size;
+  guint64 pool_hits, pool_misses;
 };
 
 struct _GstCompositorPadClass
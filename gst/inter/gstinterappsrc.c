@@ -25,6 +25,12 @@
  * interappsink element in a different pipeline, allowing communication of
  * data between the two pipelines.
  *
+ * Any number of interappsrc elements can read from the same channel. The
+ * buffers are shared between them, and each of them has its own
+ * #GstInterAppSrc:buffer-mode and #GstInterAppSrc:max-buffers policy.
+ * The #GstInterAppSrc:stats property tells how far behind the sink an
+ * interappsrc is, and how many buffers it dropped.
+ *
  * <refsect2>
  * <title>Example launch line</title>
  * |[
@@ -58,6 +64,8 @@ static void gst_inter_app_src_finalize (GObject * object);
 
 static gboolean gst_inter_app_src_start (GstBaseSrc * src);
 static gboolean gst_inter_app_src_stop (GstBaseSrc * src);
+static gboolean gst_inter_app_src_unlock (GstBaseSrc * src);
+static gboolean gst_inter_app_src_unlock_stop (GstBaseSrc * src);
 static GstFlowReturn
 gst_inter_app_src_create (GstBaseSrc * src, guint64 offset, guint size,
     GstBuffer ** buf);
@@ -67,9 +75,34 @@ gst_inter_app_src_create (GstBaseSrc * src, guint64 offset, guint size,
 enum
 {
   PROP_0,
-  PROP_CHANNEL
+  PROP_CHANNEL,
+  PROP_BUFFER_MODE,
+  PROP_MAX_BUFFERS,
+  PROP_STATS
 };
 
+#define GST_TYPE_INTER_APP_SRC_BUFFER_MODE \
+  (gst_inter_app_src_buffer_mode_get_type ())
+static GType
+gst_inter_app_src_buffer_mode_get_type (void)
+{
+  static GType buffer_mode_type = 0;
+  static const GEnumValue buffer_modes[] = {
+    {GST_DEFERRED_CLIENT_BUFFER_MODE_LATEST,
+        "Only output the latest buffer", "latest"},
+    {GST_DEFERRED_CLIENT_BUFFER_MODE_LATEST_KEYFRAME,
+        "Start from the latest keyframe and output all buffers",
+        "latest-keyframe"},
+    {0, NULL, NULL},
+  };
+
+  if (!buffer_mode_type) {
+    buffer_mode_type =
+        g_enum_register_static ("GstInterAppSrcBufferMode", buffer_modes);
+  }
+  return buffer_mode_type;
+}
+
 /* pad templates */
 static GstStaticPadTemplate gst_inter_app_src_src_template =
 GST_STATIC_PAD_TEMPLATE ("src",
@@ -106,12 +139,34 @@ gst_inter_app_src_class_init (GstInterAppSrcClass * klass)
   gobject_class->finalize = gst_inter_app_src_finalize;
   base_src_class->start = GST_DEBUG_FUNCPTR (gst_inter_app_src_start);
   base_src_class->stop = GST_DEBUG_FUNCPTR (gst_inter_app_src_stop);
+  base_src_class->unlock = GST_DEBUG_FUNCPTR (gst_inter_app_src_unlock);
+  base_src_class->unlock_stop =
+      GST_DEBUG_FUNCPTR (gst_inter_app_src_unlock_stop);
   base_src_class->create = GST_DEBUG_FUNCPTR (gst_inter_app_src_create);
 
   g_object_class_install_property (gobject_class, PROP_CHANNEL,
       g_param_spec_string ("channel", "Channel",
           "Channel name to match inter src and sink elements",
           "default", G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_BUFFER_MODE,
+      g_param_spec_enum ("buffer-mode", "Buffer mode",
+          "Which of the buffers from the sink to output",
+          GST_TYPE_INTER_APP_SRC_BUFFER_MODE, DEFAULT_APP_BUFFER_MODE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_BUFFERS,
+      g_param_spec_int ("max-buffers", "Max buffers",
+          "In latest-keyframe mode, how many buffers this source can be "
+          "behind the sink before skipping to a newer keyframe "
+          "(-1 = up to two GOPs)", -1, G_MAXINT, DEFAULT_APP_MAX_BUFFERS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_STATS,
+      g_param_spec_boxed ("stats", "Statistics",
+          "Number of buffers delivered and dropped, and how many buffers "
+          "this source is behind the sink", GST_TYPE_STRUCTURE,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 }
 
 static void
@@ -121,6 +176,8 @@ gst_inter_app_src_init (GstInterAppSrc * interappsrc)
   gst_base_src_set_live (GST_BASE_SRC (interappsrc), TRUE);
 
   interappsrc->channel = g_strdup ("default");
+  interappsrc->buffer_mode = DEFAULT_APP_BUFFER_MODE;
+  interappsrc->max_buffers = DEFAULT_APP_MAX_BUFFERS;
 }
 
 void
@@ -134,6 +191,18 @@ gst_inter_app_src_set_property (GObject * object, guint property_id,
       g_free (interappsrc->channel);
       interappsrc->channel = g_value_dup_string (value);
       break;
+    case PROP_BUFFER_MODE:
+    case PROP_MAX_BUFFERS:
+      GST_OBJECT_LOCK (interappsrc);
+      if (property_id == PROP_BUFFER_MODE)
+        interappsrc->buffer_mode = g_value_get_enum (value);
+      else
+        interappsrc->max_buffers = g_value_get_int (value);
+      if (interappsrc->reader)
+        gst_deferred_reader_configure (interappsrc->reader,
+            interappsrc->buffer_mode, interappsrc->max_buffers);
+      GST_OBJECT_UNLOCK (interappsrc);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -150,6 +219,26 @@ gst_inter_app_src_get_property (GObject * object, guint property_id,
     case PROP_CHANNEL:
       g_value_set_string (value, interappsrc->channel);
       break;
+    case PROP_BUFFER_MODE:
+      g_value_set_enum (value, interappsrc->buffer_mode);
+      break;
+    case PROP_MAX_BUFFERS:
+      g_value_set_int (value, interappsrc->max_buffers);
+      break;
+    case PROP_STATS:
+      GST_OBJECT_LOCK (interappsrc);
+      if (interappsrc->reader) {
+        g_value_take_boxed (value,
+            gst_deferred_reader_get_stats (interappsrc->reader));
+      } else {
+        g_value_take_boxed (value,
+            gst_structure_new ("GstInterAppReaderStats",
+                "delivered", G_TYPE_UINT64, G_GUINT64_CONSTANT (0),
+                "dropped", G_TYPE_UINT64, G_GUINT64_CONSTANT (0),
+                "lag", G_TYPE_UINT64, G_GUINT64_CONSTANT (0), NULL));
+      }
+      GST_OBJECT_UNLOCK (interappsrc);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -176,6 +265,12 @@ gst_inter_app_src_start (GstBaseSrc * src)
 
   interappsrc->surface = gst_inter_surface_get (interappsrc->channel);
 
+  GST_OBJECT_LOCK (interappsrc);
+  interappsrc->reader =
+      gst_deferred_reader_new (&interappsrc->surface->app_client,
+      interappsrc->buffer_mode, interappsrc->max_buffers);
+  GST_OBJECT_UNLOCK (interappsrc);
+
   return TRUE;
 }
 
@@ -186,12 +281,47 @@ gst_inter_app_src_stop (GstBaseSrc * src)
 
   GST_DEBUG_OBJECT (interappsrc, "stop");
 
+  GST_OBJECT_LOCK (interappsrc);
+  gst_deferred_reader_free (interappsrc->reader);
+  interappsrc->reader = NULL;
+  GST_OBJECT_UNLOCK (interappsrc);
+
   gst_inter_surface_unref (interappsrc->surface);
   interappsrc->surface = NULL;
 
   return TRUE;
 }
 
+static gboolean
+gst_inter_app_src_unlock (GstBaseSrc * src)
+{
+  GstInterAppSrc *interappsrc = GST_INTER_APP_SRC (src);
+
+  GST_DEBUG_OBJECT (interappsrc, "unlock");
+
+  GST_OBJECT_LOCK (interappsrc);
+  if (interappsrc->reader)
+    gst_deferred_reader_set_flushing (interappsrc->reader, TRUE);
+  GST_OBJECT_UNLOCK (interappsrc);
+
+  return TRUE;
+}
+
+static gboolean
+gst_inter_app_src_unlock_stop (GstBaseSrc * src)
+{
+  GstInterAppSrc *interappsrc = GST_INTER_APP_SRC (src);
+
+  GST_DEBUG_OBJECT (interappsrc, "unlock stop");
+
+  GST_OBJECT_LOCK (interappsrc);
+  if (interappsrc->reader)
+    gst_deferred_reader_set_flushing (interappsrc->reader, FALSE);
+  GST_OBJECT_UNLOCK (interappsrc);
+
+  return TRUE;
+}
+
 static GstFlowReturn
 gst_inter_app_src_create (GstBaseSrc * src, guint64 offset, guint size,
     GstBuffer ** buf)
@@ -199,14 +329,19 @@ gst_inter_app_src_create (GstBaseSrc * src, guint64 offset, guint size,
   GstInterAppSrc *interappsrc = GST_INTER_APP_SRC (src);
   GstBuffer *buffer = NULL;
   GstCaps *caps = NULL;
-  gboolean changed;
+  gboolean changed = FALSE;
 
   GST_DEBUG_OBJECT (interappsrc, "create");
 
-  caps = gst_deferred_client_get_caps (&interappsrc->surface->app_client,
-      &changed, TRUE);
+  caps = gst_deferred_reader_get_caps (interappsrc->reader, &changed, TRUE);
+  if (!caps)
+    goto flushing;
 
-  buffer = gst_deferred_client_get_buffer (&interappsrc->surface->app_client);
+  buffer = gst_deferred_reader_get_buffer (interappsrc->reader);
+  if (!buffer) {
+    gst_caps_unref (caps);
+    goto flushing;
+  }
 
   if (changed) {
     GST_DEBUG_OBJECT (interappsrc, "Got caps: %" GST_PTR_FORMAT, caps);
@@ -214,16 +349,21 @@ gst_inter_app_src_create (GstBaseSrc * src, guint64 offset, guint size,
     if (!gst_base_src_set_caps (src, caps)) {
       GST_ERROR_OBJECT (interappsrc, "Failed to set caps");
       gst_caps_unref (caps);
+      gst_buffer_unref (buffer);
       return GST_FLOW_NOT_NEGOTIATED;
     }
-
-    gst_caps_unref (caps);
   }
 
+  gst_caps_unref (caps);
+
   GST_LOG_OBJECT (interappsrc, "Pushing %u bytes",
       (unsigned int) gst_buffer_get_size (buffer));
 
   *buf = buffer;
 
   return GST_FLOW_OK;
+
+flushing:
+  GST_DEBUG_OBJECT (interappsrc, "Flushing");
+  return GST_FLOW_FLUSHING;
 }
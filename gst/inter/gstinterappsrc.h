@@ -39,7 +39,11 @@ struct _GstInterAppSrc
   GstBaseSrc parent;
 
   GstInterSurface *surface;
+  GstDeferredReader *reader;
   char *channel;
+
+  GstDeferredClientBufferMode buffer_mode;
+  gint max_buffers;
 };
 
 struct _GstInterAppSrcClass
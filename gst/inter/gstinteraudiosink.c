@@ -23,6 +23,10 @@
  * in connection with a interaudiosrc element in a different pipeline,
  * similar to intervideosink and intervideosrc.
  *
+ * The #GstInterAudioSink:stats property tells how often the elements sharing
+ * the channel had to wait for each other, which helps when many channels
+ * are in use at the same time.
+ *
  * <refsect2>
  * <title>Example launch line</title>
  * |[
@@ -73,7 +77,8 @@ static gboolean gst_inter_audio_sink_query (GstBaseSink * sink,
 enum
 {
   PROP_0,
-  PROP_CHANNEL
+  PROP_CHANNEL,
+  PROP_STATS
 };
 
 #define DEFAULT_CHANNEL ("default")
@@ -124,6 +129,12 @@ gst_inter_audio_sink_class_init (GstInterAudioSinkClass * klass)
       g_param_spec_string ("channel", "Channel",
           "Channel name to match inter src and sink elements",
           DEFAULT_CHANNEL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_STATS,
+      g_param_spec_boxed ("stats", "Statistics",
+          "How often and how long the users of the channel waited for each "
+          "other (only gathered when the debug system is enabled)",
+          GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 }
 
 static void
@@ -160,6 +171,12 @@ gst_inter_audio_sink_get_property (GObject * object, guint property_id,
     case PROP_CHANNEL:
       g_value_set_string (value, interaudiosink->channel);
       break;
+    case PROP_STATS:
+      GST_OBJECT_LOCK (interaudiosink);
+      g_value_take_boxed (value,
+          gst_inter_surface_get_stats (interaudiosink->surface));
+      GST_OBJECT_UNLOCK (interaudiosink);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -178,6 +195,16 @@ gst_inter_audio_sink_finalize (GObject * object)
   G_OBJECT_CLASS (gst_inter_audio_sink_parent_class)->finalize (object);
 }
 
+static void
+gst_inter_audio_sink_push (GstInterAudioSink * interaudiosink,
+    GstBuffer * buffer)
+{
+  if (!gst_inter_surface_push_audio (interaudiosink->surface, buffer,
+          interaudiosink->audio_cookie)) {
+    GST_DEBUG_OBJECT (interaudiosink, "ring full, dropped the oldest audio");
+  }
+}
+
 static void
 gst_inter_audio_sink_get_times (GstBaseSink * sink, GstBuffer * buffer,
     GstClockTime * start, GstClockTime * end)
@@ -202,17 +229,23 @@ static gboolean
 gst_inter_audio_sink_start (GstBaseSink * sink)
 {
   GstInterAudioSink *interaudiosink = GST_INTER_AUDIO_SINK (sink);
+  GstInterSurface *surface;
 
   GST_DEBUG_OBJECT (interaudiosink, "start");
 
-  interaudiosink->surface = gst_inter_surface_get (interaudiosink->channel);
-  g_mutex_lock (&interaudiosink->surface->mutex);
-  memset (&interaudiosink->surface->audio_info, 0, sizeof (GstAudioInfo));
+  surface = gst_inter_surface_get (interaudiosink->channel);
+  GST_OBJECT_LOCK (interaudiosink);
+  interaudiosink->surface = surface;
+  GST_OBJECT_UNLOCK (interaudiosink);
+  interaudiosink->audio_cookie =
+      gst_inter_surface_set_audio_info (interaudiosink->surface, NULL);
 
+  g_mutex_lock (&interaudiosink->surface->mutex);
   /* We want to write latency-time before syncing has happened */
   /* FIXME: The other side can change this value when it starts */
   gst_base_sink_set_render_delay (sink,
       interaudiosink->surface->audio_latency_time);
+  interaudiosink->period_time = interaudiosink->surface->audio_period_time;
   g_mutex_unlock (&interaudiosink->surface->mutex);
 
   return TRUE;
@@ -222,16 +255,18 @@ static gboolean
 gst_inter_audio_sink_stop (GstBaseSink * sink)
 {
   GstInterAudioSink *interaudiosink = GST_INTER_AUDIO_SINK (sink);
+  GstInterSurface *surface;
 
   GST_DEBUG_OBJECT (interaudiosink, "stop");
 
-  g_mutex_lock (&interaudiosink->surface->mutex);
-  gst_adapter_clear (interaudiosink->surface->audio_adapter);
-  memset (&interaudiosink->surface->audio_info, 0, sizeof (GstAudioInfo));
-  g_mutex_unlock (&interaudiosink->surface->mutex);
+  /* The source drops what is left in the ring when the format changes */
+  gst_inter_surface_set_audio_info (interaudiosink->surface, NULL);
 
-  gst_inter_surface_unref (interaudiosink->surface);
+  GST_OBJECT_LOCK (interaudiosink);
+  surface = interaudiosink->surface;
   interaudiosink->surface = NULL;
+  GST_OBJECT_UNLOCK (interaudiosink);
+  gst_inter_surface_unref (surface);
 
   gst_adapter_clear (interaudiosink->input_adapter);
 
@@ -249,11 +284,13 @@ gst_inter_audio_sink_set_caps (GstBaseSink * sink, GstCaps * caps)
     return FALSE;
   }
 
-  g_mutex_lock (&interaudiosink->surface->mutex);
-  interaudiosink->surface->audio_info = info;
-  interaudiosink->info = info;
   /* TODO: Ideally we would drain the source here */
-  gst_adapter_clear (interaudiosink->surface->audio_adapter);
+  interaudiosink->audio_cookie =
+      gst_inter_surface_set_audio_info (interaudiosink->surface, &info);
+  interaudiosink->info = info;
+
+  g_mutex_lock (&interaudiosink->surface->mutex);
+  interaudiosink->period_time = interaudiosink->surface->audio_period_time;
   g_mutex_unlock (&interaudiosink->surface->mutex);
 
   return TRUE;
@@ -270,10 +307,9 @@ gst_inter_audio_sink_event (GstBaseSink * sink, GstEvent * event)
       guint n;
 
       if ((n = gst_adapter_available (interaudiosink->input_adapter)) > 0) {
-        g_mutex_lock (&interaudiosink->surface->mutex);
         tmp = gst_adapter_take_buffer (interaudiosink->input_adapter, n);
-        gst_adapter_push (interaudiosink->surface->audio_adapter, tmp);
-        g_mutex_unlock (&interaudiosink->surface->mutex);
+        gst_inter_audio_sink_push (interaudiosink, tmp);
+        gst_buffer_unref (tmp);
       }
       break;
     }
@@ -289,43 +325,18 @@ gst_inter_audio_sink_render (GstBaseSink * sink, GstBuffer * buffer)
 {
   GstInterAudioSink *interaudiosink = GST_INTER_AUDIO_SINK (sink);
   guint n, bpf;
-  guint64 period_time, buffer_time;
-  guint64 period_samples, buffer_samples;
+  guint64 period_samples;
 
   GST_DEBUG_OBJECT (interaudiosink, "render %" G_GSIZE_FORMAT,
       gst_buffer_get_size (buffer));
   bpf = interaudiosink->info.bpf;
 
-  g_mutex_lock (&interaudiosink->surface->mutex);
-
-  buffer_time = interaudiosink->surface->audio_buffer_time;
-  period_time = interaudiosink->surface->audio_period_time;
-
-  if (buffer_time < period_time) {
-    GST_ERROR_OBJECT (interaudiosink,
-        "Buffer time smaller than period time (%" GST_TIME_FORMAT " < %"
-        GST_TIME_FORMAT ")", GST_TIME_ARGS (buffer_time),
-        GST_TIME_ARGS (period_time));
-    g_mutex_unlock (&interaudiosink->surface->mutex);
-    return GST_FLOW_ERROR;
-  }
-
-  buffer_samples =
-      gst_util_uint64_scale (buffer_time, interaudiosink->info.rate,
-      GST_SECOND);
   period_samples =
-      gst_util_uint64_scale (period_time, interaudiosink->info.rate,
-      GST_SECOND);
-
-  n = gst_adapter_available (interaudiosink->surface->audio_adapter) / bpf;
-  while (n > buffer_samples) {
-    GST_DEBUG_OBJECT (interaudiosink, "flushing %" GST_TIME_FORMAT,
-        GST_TIME_ARGS (period_time));
-    gst_adapter_flush (interaudiosink->surface->audio_adapter,
-        period_samples * bpf);
-    n -= period_samples;
-  }
+      gst_util_uint64_scale (interaudiosink->period_time,
+      interaudiosink->info.rate, GST_SECOND);
 
+  /* Only hand over whole periods, the source trims what is older than its
+   * buffer-time */
   n = gst_adapter_available (interaudiosink->input_adapter);
   if (period_samples * bpf > gst_buffer_get_size (buffer) + n) {
     gst_adapter_push (interaudiosink->input_adapter, gst_buffer_ref (buffer));
@@ -334,12 +345,11 @@ gst_inter_audio_sink_render (GstBaseSink * sink, GstBuffer * buffer)
 
     if (n > 0) {
       tmp = gst_adapter_take_buffer (interaudiosink->input_adapter, n);
-      gst_adapter_push (interaudiosink->surface->audio_adapter, tmp);
+      gst_inter_audio_sink_push (interaudiosink, tmp);
+      gst_buffer_unref (tmp);
     }
-    gst_adapter_push (interaudiosink->surface->audio_adapter,
-        gst_buffer_ref (buffer));
+    gst_inter_audio_sink_push (interaudiosink, buffer);
   }
-  g_mutex_unlock (&interaudiosink->surface->mutex);
 
   return GST_FLOW_OK;
 }
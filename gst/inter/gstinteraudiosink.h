@@ -43,6 +43,10 @@ struct _GstInterAudioSink
 
   GstAdapter *input_adapter;
   GstAudioInfo info;
+
+  /* What the audio pushed to the surface is tagged with */
+  gint audio_cookie;
+  guint64 period_time;
 };
 
 struct _GstInterAudioSinkClass
@@ -161,6 +161,7 @@ gst_inter_audio_src_init (GstInterAudioSrc * interaudiosrc)
   interaudiosrc->buffer_time = DEFAULT_AUDIO_BUFFER_TIME;
   interaudiosrc->latency_time = DEFAULT_AUDIO_LATENCY_TIME;
   interaudiosrc->period_time = DEFAULT_AUDIO_PERIOD_TIME;
+  interaudiosrc->adapter = gst_adapter_new ();
 }
 
 void
@@ -221,6 +222,7 @@ gst_inter_audio_src_finalize (GObject * object)
 
   /* clean up object here */
   g_free (interaudiosrc->channel);
+  gst_object_unref (interaudiosrc->adapter);
 
   G_OBJECT_CLASS (gst_inter_audio_src_parent_class)->finalize (object);
 }
@@ -279,10 +281,23 @@ gst_inter_audio_src_start (GstBaseSrc * src)
 
   GST_DEBUG_OBJECT (interaudiosrc, "start");
 
+  if (interaudiosrc->buffer_time < interaudiosrc->period_time) {
+    GST_ELEMENT_ERROR (interaudiosrc, RESOURCE, SETTINGS, (NULL),
+        ("Buffer time smaller than period time (%" GST_TIME_FORMAT " < %"
+            GST_TIME_FORMAT ")", GST_TIME_ARGS (interaudiosrc->buffer_time),
+            GST_TIME_ARGS (interaudiosrc->period_time)));
+    return FALSE;
+  }
+
   interaudiosrc->surface = gst_inter_surface_get (interaudiosrc->channel);
   interaudiosrc->timestamp_offset = 0;
   interaudiosrc->n_samples = 0;
 
+  /* Make sure the info is read on the first buffer */
+  gst_audio_info_init (&interaudiosrc->surface_info);
+  interaudiosrc->audio_cookie =
+      g_atomic_int_get (&interaudiosrc->surface->audio_cookie) - 1;
+
   g_mutex_lock (&interaudiosrc->surface->mutex);
   interaudiosrc->surface->audio_buffer_time = interaudiosrc->buffer_time;
   interaudiosrc->surface->audio_latency_time = interaudiosrc->latency_time;
@@ -301,6 +316,7 @@ gst_inter_audio_src_stop (GstBaseSrc * src)
 
   gst_inter_surface_unref (interaudiosrc->surface);
   interaudiosrc->surface = NULL;
+  gst_adapter_clear (interaudiosrc->adapter);
 
   return TRUE;
 }
@@ -336,21 +352,25 @@ gst_inter_audio_src_create (GstBaseSrc * src, guint64 offset, guint size,
 {
   GstInterAudioSrc *interaudiosrc = GST_INTER_AUDIO_SRC (src);
   GstCaps *caps;
-  GstBuffer *buffer;
+  GstBuffer *buffer, *tmp;
   guint n, bpf;
-  guint64 period_time;
-  guint64 period_samples;
+  guint64 period_samples, buffer_samples;
 
   GST_DEBUG_OBJECT (interaudiosrc, "create");
 
   buffer = NULL;
   caps = NULL;
 
-  g_mutex_lock (&interaudiosrc->surface->mutex);
-  if (interaudiosrc->surface->audio_info.finfo) {
-    if (!gst_audio_info_is_equal (&interaudiosrc->surface->audio_info,
+  /* Only takes the surface lock if the format changed, the audio we have
+   * from the previous format is then useless */
+  if (gst_inter_surface_update_audio_info (interaudiosrc->surface,
+          &interaudiosrc->surface_info, &interaudiosrc->audio_cookie))
+    gst_adapter_clear (interaudiosrc->adapter);
+
+  if (interaudiosrc->surface_info.finfo) {
+    if (!gst_audio_info_is_equal (&interaudiosrc->surface_info,
             &interaudiosrc->info)) {
-      caps = gst_audio_info_to_caps (&interaudiosrc->surface->audio_info);
+      caps = gst_audio_info_to_caps (&interaudiosrc->surface_info);
       interaudiosrc->timestamp_offset +=
           gst_util_uint64_scale (interaudiosrc->n_samples, GST_SECOND,
           interaudiosrc->info.rate);
@@ -358,26 +378,39 @@ gst_inter_audio_src_create (GstBaseSrc * src, guint64 offset, guint size,
     }
   }
 
-  bpf = interaudiosrc->surface->audio_info.bpf;
-  period_time = interaudiosrc->surface->audio_period_time;
+  bpf = interaudiosrc->surface_info.bpf;
   period_samples =
-      gst_util_uint64_scale (period_time, interaudiosrc->info.rate, GST_SECOND);
-
-  if (bpf > 0)
-    n = gst_adapter_available (interaudiosrc->surface->audio_adapter) / bpf;
-  else
+      gst_util_uint64_scale (interaudiosrc->period_time,
+      interaudiosrc->info.rate, GST_SECOND);
+
+  if (bpf > 0) {
+    while ((tmp = gst_inter_surface_pop_audio (interaudiosrc->surface,
+                interaudiosrc->audio_cookie)))
+      gst_adapter_push (interaudiosrc->adapter, tmp);
+
+    /* Drop what is older than buffer-time */
+    buffer_samples =
+        gst_util_uint64_scale (interaudiosrc->buffer_time,
+        interaudiosrc->surface_info.rate, GST_SECOND);
+    n = gst_adapter_available (interaudiosrc->adapter) / bpf;
+    while (n > buffer_samples && period_samples > 0) {
+      GST_DEBUG_OBJECT (interaudiosrc, "flushing %" GST_TIME_FORMAT,
+          GST_TIME_ARGS (interaudiosrc->period_time));
+      gst_adapter_flush (interaudiosrc->adapter, period_samples * bpf);
+      n -= period_samples;
+    }
+  } else {
     n = 0;
+  }
 
   if (n > period_samples)
     n = period_samples;
   if (n > 0) {
-    buffer = gst_adapter_take_buffer (interaudiosrc->surface->audio_adapter,
-        n * bpf);
+    buffer = gst_adapter_take_buffer (interaudiosrc->adapter, n * bpf);
   } else {
     buffer = gst_buffer_new ();
     GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_GAP);
   }
-  g_mutex_unlock (&interaudiosrc->surface->mutex);
 
   if (caps) {
     gboolean ret = gst_base_src_set_caps (src, caps);
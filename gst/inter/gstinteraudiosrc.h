@@ -46,6 +46,12 @@ struct _GstInterAudioSrc
   GstClockTime timestamp_offset;
   GstAudioInfo info;
   guint64 buffer_time, latency_time, period_time;
+
+  /* Copy of the surface audio info, updated when audio_cookie changes, and
+   * the audio taken from the surface in that format */
+  GstAudioInfo surface_info;
+  gint audio_cookie;
+  GstAdapter *adapter;
 };
 
 struct _GstInterAudioSrcClass
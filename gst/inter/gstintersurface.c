@@ -30,9 +30,6 @@
 static GList *list;
 static GMutex mutex;
 
-#define DEFAULT_BUFFER_MODE GST_DEFERRED_CLIENT_BUFFER_MODE_LATEST_KEYFRAME
-#define DEFAULT_MAX_BUFFERS -1
-
 /* Call with client mutex held */
 static void
 gst_deferred_client_free_queue (GQueue * queue)
@@ -44,34 +41,199 @@ gst_deferred_client_free_queue (GQueue * queue)
   }
 }
 
+#define gst_deferred_client_next_seq(client) \
+  ((client)->first_seq + (client)->buffers->len)
+
+/* Call with client mutex held */
+static void
+gst_deferred_reader_skip_to (GstDeferredReader * reader, guint64 seq)
+{
+  if (seq <= reader->position)
+    return;
+
+  /* Buffers skipped before the reader starts are not drops */
+  if (reader->started)
+    reader->dropped += seq - reader->position;
+  reader->position = seq;
+}
+
+/* Call with client mutex held, moves the reader to where it should start
+ * reading according to its buffer mode */
+static void
+gst_deferred_reader_rewind (GstDeferredReader * reader)
+{
+  GstDeferredClient *client = reader->client;
+  guint64 next_seq = gst_deferred_client_next_seq (client);
+
+  if (reader->buffer_mode == GST_DEFERRED_CLIENT_BUFFER_MODE_LATEST) {
+    reader->position = client->buffers->len ? next_seq - 1 : next_seq;
+    reader->need_keyframe = FALSE;
+  } else if (client->keyframe_seq != GST_DEFERRED_SEQ_NONE) {
+    reader->position = client->keyframe_seq;
+    reader->need_keyframe = FALSE;
+  } else {
+    reader->position = next_seq;
+    reader->need_keyframe = TRUE;
+  }
+}
+
+/* Upper bounds of what is kept for the readers, so that streams with rare
+ * keyframes (or only one) and late readers don't grow without bound */
+#define GST_DEFERRED_CLIENT_MAX_BUFFERS 1000
+#define GST_DEFERRED_CLIENT_MAX_DURATION (10 * GST_SECOND)
+
+/* Call with client mutex held, TRUE if keeping the buffers from @seq on
+ * goes over the limits */
+static gboolean
+gst_deferred_client_over_limits (GstDeferredClient * client, guint64 seq)
+{
+  GstClockTime first_ts, last_ts;
+
+  if (gst_deferred_client_next_seq (client) - seq >
+      GST_DEFERRED_CLIENT_MAX_BUFFERS)
+    return TRUE;
+
+  first_ts = GST_BUFFER_PTS (g_ptr_array_index (client->buffers,
+          seq - client->first_seq));
+  last_ts = GST_BUFFER_PTS (g_ptr_array_index (client->buffers,
+          client->buffers->len - 1));
+
+  return GST_CLOCK_TIME_IS_VALID (first_ts) &&
+      GST_CLOCK_TIME_IS_VALID (last_ts) &&
+      last_ts > first_ts + GST_DEFERRED_CLIENT_MAX_DURATION;
+}
+
+/* Call with client mutex held. The last keyframe is only kept for the
+ * readers in latest-keyframe mode, or for the first reader to come */
+static gboolean
+gst_deferred_client_keyframe_wanted (GstDeferredClient * client)
+{
+  GList *l;
+
+  if (client->readers == NULL)
+    return TRUE;
+
+  for (l = client->readers; l; l = l->next) {
+    GstDeferredReader *reader = l->data;
+
+    if (reader->buffer_mode == GST_DEFERRED_CLIENT_BUFFER_MODE_LATEST_KEYFRAME)
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+/* Call with client mutex held. Drops the buffers that no reader needs
+ * anymore. The last GOP (or the last buffer if there is no keyframe) is kept
+ * for the readers that start later, within the retention limits; readers
+ * that fall behind the limits wait for the next keyframe */
+static void
+gst_deferred_client_trim (GstDeferredClient * client)
+{
+  guint64 keep, last;
+  GList *l;
+
+  if (client->buffers->len == 0)
+    return;
+
+  last = gst_deferred_client_next_seq (client) - 1;
+  keep = last;
+  if (client->keyframe_seq != GST_DEFERRED_SEQ_NONE &&
+      gst_deferred_client_keyframe_wanted (client))
+    keep = MIN (keep, client->keyframe_seq);
+
+  for (l = client->readers; l; l = l->next) {
+    GstDeferredReader *reader = l->data;
+
+    keep = MIN (keep, reader->position);
+  }
+
+  while (keep < last && gst_deferred_client_over_limits (client, keep))
+    keep++;
+
+  if (keep <= client->first_seq)
+    return;
+
+  if (client->keyframe_seq != GST_DEFERRED_SEQ_NONE &&
+      client->keyframe_seq < keep) {
+    GST_LOG ("Dropping keyframe %" G_GUINT64_FORMAT, client->keyframe_seq);
+    client->keyframe_seq = GST_DEFERRED_SEQ_NONE;
+  }
+
+  for (l = client->readers; l; l = l->next) {
+    GstDeferredReader *reader = l->data;
+
+    if (reader->position < keep) {
+      GST_DEBUG ("Reader is over the retention limits, waiting for a new "
+          "keyframe");
+      gst_deferred_reader_skip_to (reader, keep);
+      reader->need_keyframe = TRUE;
+    }
+  }
+
+  g_ptr_array_remove_range (client->buffers, 0, keep - client->first_seq);
+  client->first_seq = keep;
+}
+
+/* Call with client mutex held */
+static void
+gst_deferred_client_flush_buffers (GstDeferredClient * client)
+{
+  guint64 next_seq = gst_deferred_client_next_seq (client);
+  GList *l;
+
+  for (l = client->readers; l; l = l->next)
+    gst_deferred_reader_skip_to (l->data, next_seq);
+
+  g_ptr_array_set_size (client->buffers, 0);
+  client->first_seq = next_seq;
+  client->keyframe_seq = GST_DEFERRED_SEQ_NONE;
+
+  for (l = client->readers; l; l = l->next)
+    gst_deferred_reader_rewind (l->data);
+}
+
 void
 gst_deferred_client_init (GstDeferredClient * client)
 {
   g_mutex_init (&client->mutex);
+  g_cond_init (&client->cond);
 
-  g_cond_init (&client->caps_cond);
-  g_cond_init (&client->buffer_cond);
+  client->caps = NULL;
+  client->caps_cookie = 0;
 
-  client->buffer_mode = DEFAULT_BUFFER_MODE;
-  client->max_buffers = DEFAULT_MAX_BUFFERS;
-  client->started = FALSE;
-
-  g_queue_init (&client->buffers);
   g_queue_init (&client->headers);
+  client->headers_cookie = 0;
+
+  client->buffers = g_ptr_array_new_with_free_func ((GDestroyNotify)
+      gst_buffer_unref);
+  client->first_seq = 0;
+  client->keyframe_seq = GST_DEFERRED_SEQ_NONE;
+
+  client->readers = NULL;
 }
 
 void
 gst_deferred_client_reset (GstDeferredClient * client)
 {
+  GList *l;
+
   g_mutex_lock (&client->mutex);
 
-  if (client->caps)
-    gst_caps_unref (client->caps);
+  gst_caps_replace (&client->caps, NULL);
+
+  if (!g_queue_is_empty (&client->headers)) {
+    gst_deferred_client_free_queue (&client->headers);
+    client->headers_cookie++;
+  }
 
-  gst_deferred_client_free_queue (&client->headers);
-  gst_deferred_client_free_queue (&client->buffers);
+  gst_deferred_client_flush_buffers (client);
 
-  client->started = FALSE;
+  for (l = client->readers; l; l = l->next) {
+    GstDeferredReader *reader = l->data;
+
+    reader->started = FALSE;
+  }
 
   g_mutex_unlock (&client->mutex);
 }
@@ -81,10 +243,11 @@ gst_deferred_client_free (GstDeferredClient * client)
 {
   gst_deferred_client_reset (client);
 
-  g_mutex_clear (&client->mutex);
+  g_assert (client->readers == NULL);
+  g_ptr_array_unref (client->buffers);
 
-  g_cond_clear (&client->caps_cond);
-  g_cond_clear (&client->buffer_cond);
+  g_mutex_clear (&client->mutex);
+  g_cond_clear (&client->cond);
 }
 
 /* Call with client mutex held */
@@ -134,8 +297,10 @@ gst_deferred_client_get_stream_headers (GstDeferredClient * client,
     GArray *buffers;
     int i;
 
-    /* Free any existing headers */
+    /* Free any existing headers, the readers will all start over with the
+     * new ones */
     gst_deferred_client_free_queue (&client->headers);
+    client->headers_cookie++;
 
     GST_LOG ("sending streamheader from caps %" GST_PTR_FORMAT, new_caps);
     s = gst_caps_get_structure (new_caps, 0);
@@ -170,157 +335,289 @@ gst_deferred_client_set_caps (GstDeferredClient * client, GstCaps * caps)
 {
   g_mutex_lock (&client->mutex);
 
-  /* See if we have new stream headers in caps to pass to the client */
+  /* See if we have new stream headers in caps to pass to the readers */
   gst_deferred_client_get_stream_headers (client, client->caps, caps);
 
   if (client->caps) {
-    /* Drop queued buffer if caps changed */
+    /* Drop queued buffers if caps changed */
     if (!gst_caps_is_equal (client->caps, caps))
-      gst_deferred_client_free_queue (&client->buffers);
+      gst_deferred_client_flush_buffers (client);
 
     gst_caps_unref (client->caps);
   }
 
   client->caps = gst_caps_ref (caps);
-  client->caps_changed = TRUE;
+  client->caps_cookie++;
 
-  g_cond_signal (&client->caps_cond);
+  g_cond_broadcast (&client->cond);
 
   g_mutex_unlock (&client->mutex);
 }
 
-GstCaps *
-gst_deferred_client_get_caps (GstDeferredClient * client, gboolean * changed,
-    gboolean wait)
+static gboolean
+is_sync_frame (GstBuffer * buffer)
+{
+  if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT))
+    return FALSE;
+  else
+    return TRUE;
+}
+
+/* Call with client mutex held, after the buffer @seq was added.
+ * @prev_keyframe is the keyframe before @seq if @seq is a keyframe */
+static void
+gst_deferred_reader_update (GstDeferredReader * reader, guint64 seq,
+    gboolean keyframe, guint64 prev_keyframe)
+{
+  GstDeferredClient *client = reader->client;
+  guint64 next_seq = seq + 1;
+
+  switch (reader->buffer_mode) {
+    case GST_DEFERRED_CLIENT_BUFFER_MODE_LATEST:
+      /* Only the latest buffer is of interest */
+      if (reader->position < seq)
+        GST_LOG ("Replacing %" G_GUINT64_FORMAT " unconsumed buffer(s)",
+            seq - reader->position);
+      gst_deferred_reader_skip_to (reader, seq);
+      break;
+
+    case GST_DEFERRED_CLIENT_BUFFER_MODE_LATEST_KEYFRAME:
+      if (keyframe) {
+        if (!reader->started) {
+          GST_DEBUG ("Got new keyframe, dropping previous GOP (if any)");
+          reader->position = seq;
+          reader->need_keyframe = FALSE;
+        } else if (reader->max_buffers <= 0 &&
+            prev_keyframe != GST_DEFERRED_SEQ_NONE &&
+            reader->position < prev_keyframe) {
+          GST_DEBUG ("Reader is more than a GOP behind, skipping to the "
+              "new keyframe");
+          gst_deferred_reader_skip_to (reader, seq);
+          reader->need_keyframe = FALSE;
+        }
+      }
+
+      if (reader->max_buffers > 0 &&
+          next_seq - reader->position > (guint64) reader->max_buffers) {
+        if (client->keyframe_seq != GST_DEFERRED_SEQ_NONE &&
+            client->keyframe_seq > reader->position &&
+            next_seq - client->keyframe_seq <= (guint64) reader->max_buffers) {
+          GST_DEBUG ("Reader is too late, skipping to the last keyframe");
+          gst_deferred_reader_skip_to (reader, client->keyframe_seq);
+          reader->need_keyframe = FALSE;
+        } else {
+          GST_DEBUG ("Reader is too late, emptying and waiting for a new "
+              "keyframe");
+          gst_deferred_reader_skip_to (reader, next_seq);
+          reader->need_keyframe = TRUE;
+        }
+      }
+      break;
+
+    default:
+      g_assert_not_reached ();
+  }
+}
+
+void
+gst_deferred_client_push_buffer (GstDeferredClient * client, GstBuffer * buf)
 {
-  GstCaps *ret;
+  guint64 seq, prev_keyframe;
+  gboolean keyframe;
+  GList *l;
 
   g_mutex_lock (&client->mutex);
 
-  if (client->caps != NULL) {
-    /* We have some caps, good to go */
-    ret = gst_caps_ref (client->caps);
+  seq = gst_deferred_client_next_seq (client);
+  g_ptr_array_add (client->buffers, gst_buffer_ref (buf));
 
-    if (changed)
-      *changed = client->caps_changed;
-    client->caps_changed = FALSE;
+  keyframe = is_sync_frame (buf);
+  prev_keyframe = client->keyframe_seq;
+  if (keyframe)
+    client->keyframe_seq = seq;
 
-  } else if (wait) {
-    /* We don't have caps, and want to wait till we have some */
-    GST_LOG ("Waiting for caps");
+  for (l = client->readers; l; l = l->next)
+    gst_deferred_reader_update (l->data, seq, keyframe, prev_keyframe);
 
-    g_cond_wait (&client->caps_cond, &client->mutex);
-    g_assert (client->caps);
+  gst_deferred_client_trim (client);
 
-    ret = gst_caps_ref (client->caps);
+  g_cond_broadcast (&client->cond);
 
-    if (changed)
-      *changed = TRUE;
-    /* changed caps are being returned already */
-    client->caps_changed = FALSE;
+  g_mutex_unlock (&client->mutex);
+}
 
-  } else {
-    /* No caps, don't want to wait */
-    ret = NULL;
-  }
+GstDeferredReader *
+gst_deferred_reader_new (GstDeferredClient * client,
+    GstDeferredClientBufferMode buffer_mode, gint max_buffers)
+{
+  GstDeferredReader *reader = g_new0 (GstDeferredReader, 1);
 
+  reader->client = client;
+  reader->buffer_mode = buffer_mode;
+  reader->max_buffers = max_buffers;
+
+  g_mutex_lock (&client->mutex);
+  /* A new reader is sent the caps and stream headers that are already set */
+  reader->caps_cookie = client->caps ? client->caps_cookie - 1 :
+      client->caps_cookie;
+  reader->headers_cookie = client->headers_cookie;
+  gst_deferred_reader_rewind (reader);
+  client->readers = g_list_prepend (client->readers, reader);
   g_mutex_unlock (&client->mutex);
 
-  return ret;
+  return reader;
 }
 
-static gboolean
-is_sync_frame (GstBuffer * buffer)
+void
+gst_deferred_reader_free (GstDeferredReader * reader)
 {
-  if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT))
-    return FALSE;
-  else
-    return TRUE;
+  GstDeferredClient *client = reader->client;
+
+  g_mutex_lock (&client->mutex);
+  client->readers = g_list_remove (client->readers, reader);
+  gst_deferred_client_trim (client);
+  g_mutex_unlock (&client->mutex);
+
+  g_free (reader);
 }
 
 void
-gst_deferred_client_push_buffer (GstDeferredClient * client, GstBuffer * buf)
+gst_deferred_reader_configure (GstDeferredReader * reader,
+    GstDeferredClientBufferMode buffer_mode, gint max_buffers)
 {
-  GstBuffer *tmp;
-  gboolean new_buffer = FALSE;
+  GstDeferredClient *client = reader->client;
 
   g_mutex_lock (&client->mutex);
+  if (reader->buffer_mode != buffer_mode) {
+    reader->buffer_mode = buffer_mode;
+    reader->started = FALSE;
+    gst_deferred_reader_rewind (reader);
+  }
+  reader->max_buffers = max_buffers;
+  g_mutex_unlock (&client->mutex);
+}
 
-  switch (client->buffer_mode) {
-    case GST_DEFERRED_CLIENT_BUFFER_MODE_LATEST_KEYFRAME:
-      if (!client->started) {
-        if (is_sync_frame (buf)) {
-          GST_DEBUG ("Got new keyframe, dropping previous GOP (if any)");
-          gst_deferred_client_free_queue (&client->buffers);
-        }
-
-        if (client->max_buffers == -1 ||
-            g_queue_get_length (&client->headers) < client->max_buffers) {
-          /* We have room in the queue */
-          if (is_sync_frame (buf) || !g_queue_is_empty (&client->buffers)) {
-            /* Either this is a sync frame, or we already have one queued */
-            g_queue_push_tail (&client->buffers, gst_buffer_ref (buf));
-            new_buffer = TRUE;
-          } else {
-            GST_DEBUG ("Ignoring non-keyframe until we see a keyframe");
-          }
-        } else {
-          GST_DEBUG ("Queue is full, emptying and waiting for a new keyframe");
-          gst_deferred_client_free_queue (&client->buffers);
-        }
+void
+gst_deferred_reader_set_flushing (GstDeferredReader * reader,
+    gboolean flushing)
+{
+  GstDeferredClient *client = reader->client;
 
-        break;
-      }
-      /* the else case is a fall through */
+  g_mutex_lock (&client->mutex);
+  reader->flushing = flushing;
+  g_cond_broadcast (&client->cond);
+  g_mutex_unlock (&client->mutex);
+}
 
-    case GST_DEFERRED_CLIENT_BUFFER_MODE_LATEST:
-      /* Store one buffer at any given time */
-      if (!g_queue_is_empty (&client->buffers)) {
-        GST_DEBUG ("Replacing unconsumed buffer");
-        tmp = GST_BUFFER_CAST (g_queue_pop_head (&client->buffers));
-        gst_buffer_unref (tmp);
-      }
+/* Returns NULL if there are no caps and @wait is FALSE, or if the reader is
+ * flushing */
+GstCaps *
+gst_deferred_reader_get_caps (GstDeferredReader * reader, gboolean * changed,
+    gboolean wait)
+{
+  GstDeferredClient *client = reader->client;
+  GstCaps *ret = NULL;
 
-      g_queue_push_tail (&client->buffers, gst_buffer_ref (buf));
-      new_buffer = TRUE;
-      break;
+  g_mutex_lock (&client->mutex);
 
+  if (client->caps == NULL && wait) {
+    /* We don't have caps, and want to wait till we have some */
+    GST_LOG ("Waiting for caps");
 
-    default:
-      g_assert_not_reached ();
+    while (client->caps == NULL && !reader->flushing)
+      g_cond_wait (&client->cond, &client->mutex);
   }
 
-  if (new_buffer)
-    g_cond_signal (&client->buffer_cond);
+  if (client->caps != NULL && !reader->flushing) {
+    ret = gst_caps_ref (client->caps);
+
+    if (changed)
+      *changed = reader->caps_cookie != client->caps_cookie;
+    reader->caps_cookie = client->caps_cookie;
+  }
 
   g_mutex_unlock (&client->mutex);
+
+  return ret;
 }
 
+/* Blocks until there is a buffer for this reader, returns NULL if the reader
+ * is flushing */
 GstBuffer *
-gst_deferred_client_get_buffer (GstDeferredClient * client)
+gst_deferred_reader_get_buffer (GstDeferredReader * reader)
 {
-  GstBuffer *buf;
+  GstDeferredClient *client = reader->client;
+  GstBuffer *buf = NULL;
 
   g_mutex_lock (&client->mutex);
 
-  if (!g_queue_is_empty (&client->headers)) {
-    buf = g_queue_pop_head (&client->headers);
-    goto done;
-  }
+  while (!reader->flushing) {
+    guint64 next_seq;
+
+    if (reader->headers_cookie != client->headers_cookie) {
+      reader->headers_cookie = client->headers_cookie;
+      reader->headers_pos = 0;
+    }
+
+    if (reader->headers_pos < g_queue_get_length (&client->headers)) {
+      buf = g_queue_peek_nth (&client->headers, reader->headers_pos++);
+      buf = gst_buffer_ref (buf);
+      break;
+    }
+
+    next_seq = gst_deferred_client_next_seq (client);
+
+    if (reader->buffer_mode == GST_DEFERRED_CLIENT_BUFFER_MODE_LATEST &&
+        next_seq > 0)
+      gst_deferred_reader_skip_to (reader, next_seq - 1);
+
+    while (reader->need_keyframe && reader->position < next_seq) {
+      buf = g_ptr_array_index (client->buffers,
+          reader->position - client->first_seq);
+      if (is_sync_frame (buf))
+        reader->need_keyframe = FALSE;
+      else
+        gst_deferred_reader_skip_to (reader, reader->position + 1);
+    }
+
+    if (reader->position < next_seq) {
+      buf = g_ptr_array_index (client->buffers,
+          reader->position - client->first_seq);
+      buf = gst_buffer_ref (buf);
+      reader->position++;
+      reader->delivered++;
+      reader->started = TRUE;
+
+      gst_deferred_client_trim (client);
+      break;
+    }
 
-  if (g_queue_is_empty (&client->buffers)) {
+    buf = NULL;
     GST_LOG ("Waiting for a buffer");
-    g_cond_wait (&client->buffer_cond, &client->mutex);
+    g_cond_wait (&client->cond, &client->mutex);
   }
 
-  buf = GST_BUFFER_CAST (g_queue_pop_head (&client->buffers));
+  g_mutex_unlock (&client->mutex);
 
-  client->started = TRUE;
+  return buf;
+}
 
-done:
+GstStructure *
+gst_deferred_reader_get_stats (GstDeferredReader * reader)
+{
+  GstDeferredClient *client = reader->client;
+  GstStructure *s;
+  guint64 next_seq;
+
+  g_mutex_lock (&client->mutex);
+  next_seq = gst_deferred_client_next_seq (client);
+  s = gst_structure_new ("GstInterAppReaderStats",
+      "delivered", G_TYPE_UINT64, reader->delivered,
+      "dropped", G_TYPE_UINT64, reader->dropped,
+      "lag", G_TYPE_UINT64, next_seq - MIN (reader->position, next_seq), NULL);
   g_mutex_unlock (&client->mutex);
 
-  return buf;
+  return s;
 }
 
 GstInterSurface *
@@ -343,7 +640,8 @@ gst_inter_surface_get (const char *name)
   surface->ref_count = 1;
   surface->name = g_strdup (name);
   g_mutex_init (&surface->mutex);
-  surface->audio_adapter = gst_adapter_new ();
+  g_mutex_init (&surface->audio_write_lock);
+  g_mutex_init (&surface->audio_read_lock);
   surface->audio_buffer_time = DEFAULT_AUDIO_BUFFER_TIME;
   surface->audio_latency_time = DEFAULT_AUDIO_LATENCY_TIME;
   surface->audio_period_time = DEFAULT_AUDIO_PERIOD_TIME;
@@ -374,13 +672,331 @@ gst_inter_surface_unref (GstInterSurface * surface)
       }
     }
 
+    gst_inter_surface_set_video_buffer (surface, NULL);
     g_mutex_clear (&surface->mutex);
-    gst_buffer_replace (&surface->video_buffer, NULL);
+    g_mutex_clear (&surface->audio_write_lock);
+    g_mutex_clear (&surface->audio_read_lock);
     gst_buffer_replace (&surface->sub_buffer, NULL);
-    gst_object_unref (surface->audio_adapter);
+    while (surface->audio_ring_tail != surface->audio_ring_head) {
+      GstInterAudioChunk *chunk = &surface->audio_ring[surface->audio_ring_tail
+          % GST_INTER_AUDIO_RING_SIZE];
+
+      gst_buffer_unref (chunk->buffer);
+      surface->audio_ring_tail++;
+    }
     gst_deferred_client_free (&surface->app_client);
     g_free (surface->name);
     g_free (surface);
   }
   g_mutex_unlock (&mutex);
 }
+
+/* Contention statistics are only gathered when the debug system is
+ * enabled, so that they cost nothing otherwise */
+#ifndef GST_DISABLE_GST_DEBUG
+#define STATS_INC(counter) g_atomic_int_inc (&(counter))
+#else
+#define STATS_INC(counter) G_STMT_START { } G_STMT_END
+#endif
+
+/* Locks the surface mutex, accounting for the time spent waiting for it */
+static inline void
+gst_inter_surface_lock (GstInterSurface * surface)
+{
+#ifndef GST_DISABLE_GST_DEBUG
+  gint64 start;
+
+  if (g_mutex_trylock (&surface->mutex))
+    return;
+
+  start = g_get_monotonic_time ();
+  g_mutex_lock (&surface->mutex);
+  surface->lock_waits++;
+  surface->lock_wait_time += g_get_monotonic_time () - start;
+#else
+  g_mutex_lock (&surface->mutex);
+#endif
+}
+
+void
+gst_inter_surface_set_video_info (GstInterSurface * surface,
+    const GstVideoInfo * info)
+{
+  gst_inter_surface_lock (surface);
+  if (info)
+    surface->video_info = *info;
+  else
+    memset (&surface->video_info, 0, sizeof (GstVideoInfo));
+  g_atomic_int_inc (&surface->video_cookie);
+  g_mutex_unlock (&surface->mutex);
+}
+
+/* Copies the video info into @info if it changed since @cookie was
+ * updated, only takes the lock in that case */
+gboolean
+gst_inter_surface_update_video_info (GstInterSurface * surface,
+    GstVideoInfo * info, gint * cookie)
+{
+  if (g_atomic_int_get (&surface->video_cookie) == *cookie)
+    return FALSE;
+
+  gst_inter_surface_lock (surface);
+  *info = surface->video_info;
+  *cookie = surface->video_cookie;
+  g_mutex_unlock (&surface->mutex);
+
+  return TRUE;
+}
+
+/*
+ * The latest video frame is read without any lock: a reader announces
+ * itself in the counter of the current epoch, takes a ref on the buffer and
+ * leaves. After replacing the frame, the writer moves to the other epoch and
+ * waits for the readers of the previous one to leave before freeing the old
+ * frame, as they may still be about to ref it. Readers only stay for a
+ * couple of atomic operations, so this wait is very short.
+ */
+static void
+gst_inter_surface_video_synchronize (GstInterSurface * surface)
+{
+  gint epoch = g_atomic_int_get (&surface->video_epoch);
+#ifndef GST_DISABLE_GST_DEBUG
+  gint64 start;
+#endif
+
+  g_atomic_int_set (&surface->video_epoch, !epoch);
+
+  if (G_LIKELY (g_atomic_int_get (&surface->video_readers[epoch]) == 0))
+    return;
+
+#ifndef GST_DISABLE_GST_DEBUG
+  start = g_get_monotonic_time ();
+#endif
+  while (g_atomic_int_get (&surface->video_readers[epoch]) > 0)
+    g_thread_yield ();
+#ifndef GST_DISABLE_GST_DEBUG
+  surface->video_sync_waits++;
+  surface->video_sync_time += g_get_monotonic_time () - start;
+#endif
+}
+
+/* Publishes @buffer as the latest frame, NULL clears it */
+void
+gst_inter_surface_set_video_buffer (GstInterSurface * surface,
+    GstBuffer * buffer)
+{
+  GstInterVideoFrame *frame = NULL, *old;
+
+  if (buffer) {
+    frame = g_slice_new (GstInterVideoFrame);
+    frame->buffer = gst_buffer_ref (buffer);
+  }
+
+  /* Only serializes the writers, the readers never take it */
+  gst_inter_surface_lock (surface);
+  if (frame)
+    frame->seq = ++surface->video_seq;
+  old = g_atomic_pointer_get (&surface->video_frame);
+  g_atomic_pointer_set (&surface->video_frame, frame);
+  if (old)
+    gst_inter_surface_video_synchronize (surface);
+  g_mutex_unlock (&surface->mutex);
+
+  if (old) {
+    gst_buffer_unref (old->buffer);
+    g_slice_free (GstInterVideoFrame, old);
+  }
+}
+
+/* Returns a ref on the latest frame, and its sequence number in @seq, or
+ * NULL and 0 if there is none */
+GstBuffer *
+gst_inter_surface_get_video_buffer (GstInterSurface * surface, guint64 * seq)
+{
+  GstInterVideoFrame *frame;
+  GstBuffer *buffer = NULL;
+  gint epoch;
+
+  /* Make sure the writer waits for us if it changes the epoch after we
+   * looked at it */
+  do {
+    epoch = g_atomic_int_get (&surface->video_epoch);
+    g_atomic_int_inc (&surface->video_readers[epoch]);
+    if (G_LIKELY (g_atomic_int_get (&surface->video_epoch) == epoch))
+      break;
+    g_atomic_int_add (&surface->video_readers[epoch], -1);
+    STATS_INC (surface->video_read_retries);
+  } while (TRUE);
+
+  frame = g_atomic_pointer_get (&surface->video_frame);
+  if (frame) {
+    buffer = gst_buffer_ref (frame->buffer);
+    *seq = frame->seq;
+  } else {
+    *seq = 0;
+  }
+
+  g_atomic_int_add (&surface->video_readers[epoch], -1);
+
+  return buffer;
+}
+
+/* Returns the new cookie, that the writer tags its audio with. The audio
+ * that is still in the ring is dropped by the reader, as it is in the
+ * previous format */
+gint
+gst_inter_surface_set_audio_info (GstInterSurface * surface,
+    const GstAudioInfo * info)
+{
+  gint cookie;
+
+  gst_inter_surface_lock (surface);
+  if (info)
+    surface->audio_info = *info;
+  else
+    memset (&surface->audio_info, 0, sizeof (GstAudioInfo));
+  cookie = g_atomic_int_add (&surface->audio_cookie, 1) + 1;
+  g_mutex_unlock (&surface->mutex);
+
+  return cookie;
+}
+
+gboolean
+gst_inter_surface_update_audio_info (GstInterSurface * surface,
+    GstAudioInfo * info, gint * cookie)
+{
+  if (g_atomic_int_get (&surface->audio_cookie) == *cookie)
+    return FALSE;
+
+  gst_inter_surface_lock (surface);
+  *info = surface->audio_info;
+  *cookie = surface->audio_cookie;
+  g_mutex_unlock (&surface->mutex);
+
+  return TRUE;
+}
+
+/*
+ * The audio ring has a single producer and a single consumer. Each side owns
+ * its index, except that the producer drops the oldest chunk when the ring
+ * is full: both sides then compete for it with a compare-and-swap on the
+ * tail, and a chunk is only touched by the side that won it.
+ */
+
+/* Takes a ref on @buffer, returns FALSE if the oldest chunk had to be
+ * dropped to make room */
+gboolean
+gst_inter_surface_push_audio (GstInterSurface * surface, GstBuffer * buffer,
+    gint cookie)
+{
+  GstInterAudioChunk *chunk;
+  GstBuffer *dropped = NULL;
+  guint head, tail;
+
+  g_mutex_lock (&surface->audio_write_lock);
+
+  head = surface->audio_ring_head;
+  tail = g_atomic_int_get (&surface->audio_ring_tail);
+  if (head - tail >= GST_INTER_AUDIO_RING_SIZE &&
+      g_atomic_int_compare_and_exchange ((gint *) & surface->audio_ring_tail,
+          tail, tail + 1)) {
+    chunk = &surface->audio_ring[tail % GST_INTER_AUDIO_RING_SIZE];
+    dropped = g_atomic_pointer_get (&chunk->buffer);
+  }
+
+  chunk = &surface->audio_ring[head % GST_INTER_AUDIO_RING_SIZE];
+  g_atomic_pointer_set (&chunk->buffer, gst_buffer_ref (buffer));
+  g_atomic_int_set (&chunk->cookie, cookie);
+  g_atomic_int_set (&surface->audio_ring_head, head + 1);
+
+  g_mutex_unlock (&surface->audio_write_lock);
+
+  if (dropped) {
+    gst_buffer_unref (dropped);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Returns the oldest chunk written with @cookie, chunks from an older
+ * format are dropped. Returns NULL if the ring is empty or if the next
+ * chunk is in a newer format than @cookie */
+GstBuffer *
+gst_inter_surface_pop_audio (GstInterSurface * surface, gint cookie)
+{
+  GstBuffer *buffer = NULL;
+
+  g_mutex_lock (&surface->audio_read_lock);
+
+  while (TRUE) {
+    GstInterAudioChunk *chunk;
+    guint head, tail;
+    gint chunk_cookie;
+
+    tail = g_atomic_int_get (&surface->audio_ring_tail);
+    head = g_atomic_int_get (&surface->audio_ring_head);
+    if (tail == head)
+      break;
+
+    chunk = &surface->audio_ring[tail % GST_INTER_AUDIO_RING_SIZE];
+    buffer = g_atomic_pointer_get (&chunk->buffer);
+    chunk_cookie = g_atomic_int_get (&chunk->cookie);
+
+    if ((gint) ((guint) chunk_cookie - (guint) cookie) > 0) {
+      buffer = NULL;
+      break;
+    }
+
+    /* The producer dropped this chunk in the meantime, try again */
+    if (!g_atomic_int_compare_and_exchange ((gint *) &
+            surface->audio_ring_tail, tail, tail + 1)) {
+      STATS_INC (surface->audio_pop_retries);
+      buffer = NULL;
+      continue;
+    }
+
+    if (chunk_cookie == cookie)
+      break;
+
+    gst_buffer_unref (buffer);
+    buffer = NULL;
+  }
+
+  g_mutex_unlock (&surface->audio_read_lock);
+
+  return buffer;
+}
+
+/* Returns how much the users of @surface got in each other's way, or a
+ * structure with all the counters at 0 if @surface is NULL. The times are
+ * in nanoseconds. Nothing is counted if the debug system is disabled */
+GstStructure *
+gst_inter_surface_get_stats (GstInterSurface * surface)
+{
+  GstStructure *s;
+
+  if (surface == NULL) {
+    return gst_structure_new ("GstInterSurfaceStats",
+        "lock-waits", G_TYPE_UINT64, G_GUINT64_CONSTANT (0),
+        "lock-wait-time", G_TYPE_UINT64, G_GUINT64_CONSTANT (0),
+        "video-sync-waits", G_TYPE_UINT64, G_GUINT64_CONSTANT (0),
+        "video-sync-time", G_TYPE_UINT64, G_GUINT64_CONSTANT (0),
+        "video-read-retries", G_TYPE_UINT, 0,
+        "audio-pop-retries", G_TYPE_UINT, 0, NULL);
+  }
+
+  g_mutex_lock (&surface->mutex);
+  s = gst_structure_new ("GstInterSurfaceStats",
+      "lock-waits", G_TYPE_UINT64, surface->lock_waits,
+      "lock-wait-time", G_TYPE_UINT64, surface->lock_wait_time * GST_USECOND,
+      "video-sync-waits", G_TYPE_UINT64, surface->video_sync_waits,
+      "video-sync-time", G_TYPE_UINT64, surface->video_sync_time * GST_USECOND,
+      "video-read-retries", G_TYPE_UINT,
+      (guint) g_atomic_int_get (&surface->video_read_retries),
+      "audio-pop-retries", G_TYPE_UINT,
+      (guint) g_atomic_int_get (&surface->audio_pop_retries), NULL);
+  g_mutex_unlock (&surface->mutex);
+
+  return s;
+}
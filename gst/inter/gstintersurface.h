@@ -27,41 +27,100 @@
 G_BEGIN_DECLS
 
 typedef struct _GstDeferredClient GstDeferredClient;
+typedef struct _GstDeferredReader GstDeferredReader;
 
 typedef enum {
   GST_DEFERRED_CLIENT_BUFFER_MODE_LATEST,
   GST_DEFERRED_CLIENT_BUFFER_MODE_LATEST_KEYFRAME,
 } GstDeferredClientBufferMode;
 
+/* The stream pushed by an interappsink. The buffers and the stream headers
+ * are only stored once, and shared by all the readers of the surface */
 struct _GstDeferredClient
 {
   GMutex mutex;
 
   GstCaps *caps;
-  gboolean caps_changed;
+  guint caps_cookie;            /* incremented every time caps are set */
+
+  GQueue headers;
+  guint headers_cookie;         /* incremented when the headers change */
+
+  /* The buffers some reader may still need, the first one has the
+   * sequence number first_seq */
+  GPtrArray *buffers;
+  guint64 first_seq;
+  guint64 keyframe_seq;         /* kept keyframe, or GST_DEFERRED_SEQ_NONE */
+
+  GList *readers;
+
+  /* Signalled when caps are set or a buffer is pushed */
+  GCond cond;
+};
+
+#define GST_DEFERRED_SEQ_NONE G_MAXUINT64
+
+/* One consumer of a GstDeferredClient, all the fields are protected by the
+ * client mutex */
+struct _GstDeferredReader
+{
+  GstDeferredClient *client;
 
   GstDeferredClientBufferMode buffer_mode;
   gint max_buffers;
-  gboolean started; /* TRUE if the client has started consuming buffers */
+  gboolean started; /* TRUE if the reader has started consuming buffers */
+  gboolean flushing;
 
-  GQueue buffers;
-  GQueue headers;
+  guint64 position;             /* sequence number of the next buffer */
+  gboolean need_keyframe;       /* skip buffers until the next keyframe */
 
-  GCond caps_cond;
-  GCond buffer_cond;
+  guint caps_cookie;
+  guint headers_cookie;
+  guint headers_pos;
+
+  guint64 delivered;
+  guint64 dropped;
 };
 
 void gst_deferred_client_init (GstDeferredClient * client);
 void gst_deferred_client_reset (GstDeferredClient * client);
 void gst_deferred_client_free (GstDeferredClient * client);
 void gst_deferred_client_set_caps (GstDeferredClient * client, GstCaps * caps);
-GstCaps * gst_deferred_client_get_caps (GstDeferredClient * client,
-    gboolean * changed, gboolean wait);
 void gst_deferred_client_push_buffer (GstDeferredClient * client,
     GstBuffer * buf);
-GstBuffer * gst_deferred_client_get_buffer (GstDeferredClient * client);
+
+GstDeferredReader * gst_deferred_reader_new (GstDeferredClient * client,
+    GstDeferredClientBufferMode buffer_mode, gint max_buffers);
+void gst_deferred_reader_free (GstDeferredReader * reader);
+void gst_deferred_reader_configure (GstDeferredReader * reader,
+    GstDeferredClientBufferMode buffer_mode, gint max_buffers);
+void gst_deferred_reader_set_flushing (GstDeferredReader * reader,
+    gboolean flushing);
+GstCaps * gst_deferred_reader_get_caps (GstDeferredReader * reader,
+    gboolean * changed, gboolean wait);
+GstBuffer * gst_deferred_reader_get_buffer (GstDeferredReader * reader);
+GstStructure * gst_deferred_reader_get_stats (GstDeferredReader * reader);
 
 typedef struct _GstInterSurface GstInterSurface;
+typedef struct _GstInterVideoFrame GstInterVideoFrame;
+typedef struct _GstInterAudioChunk GstInterAudioChunk;
+
+/* The frame currently published by an intervideosink */
+struct _GstInterVideoFrame
+{
+  GstBuffer *buffer;
+  guint64 seq;                  /* starts at 1 */
+};
+
+/* An entry of the audio ring, tagged with the audio_cookie of the format it
+ * was written in */
+struct _GstInterAudioChunk
+{
+  GstBuffer *buffer;
+  gint cookie;
+};
+
+#define GST_INTER_AUDIO_RING_SIZE 256
 
 struct _GstInterSurface
 {
@@ -70,32 +129,82 @@ struct _GstInterSurface
 
   char *name;
 
-  /* video */
+  /* video, video_info is protected by the mutex and video_cookie is
+   * incremented every time it changes */
   GstVideoInfo video_info;
-  int video_buffer_count;
+  gint video_cookie;
+
+  /* The latest frame, read without any lock, see
+   * gst_inter_surface_get_video_frame() */
+  GstInterVideoFrame *video_frame;
+  guint64 video_seq;
+  gint video_epoch;
+  gint video_readers[2];
 
-  /* audio */
+  /* audio, audio_info is protected by the mutex and audio_cookie is
+   * incremented every time it changes */
   GstAudioInfo audio_info;
+  gint audio_cookie;
   guint64 audio_buffer_time;
   guint64 audio_latency_time;
   guint64 audio_period_time;
 
+  /* Single producer / single consumer ring, the writers are serialized by
+   * audio_write_lock and the readers by audio_read_lock, so that a reader
+   * never waits for a writer */
+  GMutex audio_write_lock;
+  GMutex audio_read_lock;
+  GstInterAudioChunk audio_ring[GST_INTER_AUDIO_RING_SIZE];
+  guint audio_ring_head;
+  guint audio_ring_tail;
+
   /* app */
   GstDeferredClient app_client;
 
-  GstBuffer *video_buffer;
   GstBuffer *sub_buffer;
-  GstAdapter *audio_adapter;
+
+  /* Contention statistics, only gathered when the debug system is enabled,
+   * see gst_inter_surface_get_stats(). The waits are protected by the
+   * mutex, the retries are updated atomically */
+  guint64 lock_waits;
+  guint64 lock_wait_time;       /* in microseconds */
+  guint64 video_sync_waits;
+  guint64 video_sync_time;      /* in microseconds */
+  gint video_read_retries;
+  gint audio_pop_retries;
 };
 
 #define DEFAULT_AUDIO_BUFFER_TIME  (GST_SECOND)
 #define DEFAULT_AUDIO_LATENCY_TIME (100 * GST_MSECOND)
 #define DEFAULT_AUDIO_PERIOD_TIME  (25 * GST_MSECOND)
 
+#define DEFAULT_APP_BUFFER_MODE GST_DEFERRED_CLIENT_BUFFER_MODE_LATEST_KEYFRAME
+#define DEFAULT_APP_MAX_BUFFERS -1
+
 
 GstInterSurface * gst_inter_surface_get (const char *name);
 void gst_inter_surface_unref (GstInterSurface *surface);
 
+void gst_inter_surface_set_video_info (GstInterSurface * surface,
+    const GstVideoInfo * info);
+gboolean gst_inter_surface_update_video_info (GstInterSurface * surface,
+    GstVideoInfo * info, gint * cookie);
+void gst_inter_surface_set_video_buffer (GstInterSurface * surface,
+    GstBuffer * buffer);
+GstBuffer * gst_inter_surface_get_video_buffer (GstInterSurface * surface,
+    guint64 * seq);
+
+gint gst_inter_surface_set_audio_info (GstInterSurface * surface,
+    const GstAudioInfo * info);
+gboolean gst_inter_surface_update_audio_info (GstInterSurface * surface,
+    GstAudioInfo * info, gint * cookie);
+gboolean gst_inter_surface_push_audio (GstInterSurface * surface,
+    GstBuffer * buffer, gint cookie);
+GstBuffer * gst_inter_surface_pop_audio (GstInterSurface * surface,
+    gint cookie);
+
+GstStructure * gst_inter_surface_get_stats (GstInterSurface * surface);
+
 
 G_END_DECLS
 
@@ -23,6 +23,10 @@
  * in connection with an intervideosrc element in a different pipeline,
  * similar to interaudiosink and interaudiosrc.
  *
+ * The #GstInterVideoSink:stats property tells how often the elements sharing
+ * the channel had to wait for each other, which helps when many channels
+ * are in use at the same time.
+ *
  * <refsect2>
  * <title>Example launch line</title>
  * |[
@@ -69,7 +73,8 @@ static GstFlowReturn gst_inter_video_sink_render (GstBaseSink * sink,
 enum
 {
   PROP_0,
-  PROP_CHANNEL
+  PROP_CHANNEL,
+  PROP_STATS
 };
 
 #define DEFAULT_CHANNEL ("default")
@@ -119,6 +124,12 @@ gst_inter_video_sink_class_init (GstInterVideoSinkClass * klass)
       g_param_spec_string ("channel", "Channel",
           "Channel name to match inter src and sink elements",
           DEFAULT_CHANNEL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_STATS,
+      g_param_spec_boxed ("stats", "Statistics",
+          "How often and how long the users of the channel waited for each "
+          "other (only gathered when the debug system is enabled)",
+          GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 }
 
 static void
@@ -154,6 +165,12 @@ gst_inter_video_sink_get_property (GObject * object, guint property_id,
     case PROP_CHANNEL:
       g_value_set_string (value, intervideosink->channel);
       break;
+    case PROP_STATS:
+      GST_OBJECT_LOCK (intervideosink);
+      g_value_take_boxed (value,
+          gst_inter_surface_get_stats (intervideosink->surface));
+      GST_OBJECT_UNLOCK (intervideosink);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -196,11 +213,13 @@ static gboolean
 gst_inter_video_sink_start (GstBaseSink * sink)
 {
   GstInterVideoSink *intervideosink = GST_INTER_VIDEO_SINK (sink);
+  GstInterSurface *surface;
 
-  intervideosink->surface = gst_inter_surface_get (intervideosink->channel);
-  g_mutex_lock (&intervideosink->surface->mutex);
-  memset (&intervideosink->surface->video_info, 0, sizeof (GstVideoInfo));
-  g_mutex_unlock (&intervideosink->surface->mutex);
+  surface = gst_inter_surface_get (intervideosink->channel);
+  GST_OBJECT_LOCK (intervideosink);
+  intervideosink->surface = surface;
+  GST_OBJECT_UNLOCK (intervideosink);
+  gst_inter_surface_set_video_info (intervideosink->surface, NULL);
 
   return TRUE;
 }
@@ -209,17 +228,16 @@ static gboolean
 gst_inter_video_sink_stop (GstBaseSink * sink)
 {
   GstInterVideoSink *intervideosink = GST_INTER_VIDEO_SINK (sink);
+  GstInterSurface *surface;
 
-  g_mutex_lock (&intervideosink->surface->mutex);
-  if (intervideosink->surface->video_buffer) {
-    gst_buffer_unref (intervideosink->surface->video_buffer);
-  }
-  intervideosink->surface->video_buffer = NULL;
-  memset (&intervideosink->surface->video_info, 0, sizeof (GstVideoInfo));
-  g_mutex_unlock (&intervideosink->surface->mutex);
+  gst_inter_surface_set_video_buffer (intervideosink->surface, NULL);
+  gst_inter_surface_set_video_info (intervideosink->surface, NULL);
 
-  gst_inter_surface_unref (intervideosink->surface);
+  GST_OBJECT_LOCK (intervideosink);
+  surface = intervideosink->surface;
   intervideosink->surface = NULL;
+  GST_OBJECT_UNLOCK (intervideosink);
+  gst_inter_surface_unref (surface);
 
   return TRUE;
 }
@@ -235,10 +253,8 @@ gst_inter_video_sink_set_caps (GstBaseSink * sink, GstCaps * caps)
     return FALSE;
   }
 
-  g_mutex_lock (&intervideosink->surface->mutex);
-  intervideosink->surface->video_info = info;
+  gst_inter_surface_set_video_info (intervideosink->surface, &info);
   intervideosink->info = info;
-  g_mutex_unlock (&intervideosink->surface->mutex);
 
   return TRUE;
 }
@@ -251,13 +267,7 @@ gst_inter_video_sink_render (GstBaseSink * sink, GstBuffer * buffer)
   GST_DEBUG_OBJECT (intervideosink, "render ts %" GST_TIME_FORMAT,
       GST_TIME_ARGS (GST_BUFFER_PTS (buffer)));
 
-  g_mutex_lock (&intervideosink->surface->mutex);
-  if (intervideosink->surface->video_buffer) {
-    gst_buffer_unref (intervideosink->surface->video_buffer);
-  }
-  intervideosink->surface->video_buffer = gst_buffer_ref (buffer);
-  intervideosink->surface->video_buffer_count = 0;
-  g_mutex_unlock (&intervideosink->surface->mutex);
+  gst_inter_surface_set_video_buffer (intervideosink->surface, buffer);
 
   return GST_FLOW_OK;
 }
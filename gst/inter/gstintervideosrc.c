@@ -277,6 +277,13 @@ gst_inter_video_src_start (GstBaseSrc * src)
   intervideosrc->timestamp_offset = 0;
   intervideosrc->n_frames = 0;
 
+  /* Make sure the info is read on the first frame */
+  gst_video_info_init (&intervideosrc->surface_info);
+  intervideosrc->video_cookie =
+      g_atomic_int_get (&intervideosrc->surface->video_cookie) - 1;
+  intervideosrc->video_seq = 0;
+  intervideosrc->video_buffer_count = 0;
+
   return TRUE;
 }
 
@@ -326,7 +333,7 @@ gst_inter_video_src_create (GstBaseSrc * src, guint64 offset, guint size,
   GstInterVideoSrc *intervideosrc = GST_INTER_VIDEO_SRC (src);
   GstCaps *caps;
   GstBuffer *buffer;
-  guint64 frames;
+  guint64 frames, seq;
   gboolean is_gap = FALSE;
 
   GST_DEBUG_OBJECT (intervideosrc, "create");
@@ -338,9 +345,12 @@ gst_inter_video_src_create (GstBaseSrc * src, guint64 offset, guint size,
       GST_VIDEO_INFO_FPS_N (&intervideosrc->info),
       GST_VIDEO_INFO_FPS_D (&intervideosrc->info) * GST_SECOND);
 
-  g_mutex_lock (&intervideosrc->surface->mutex);
-  if (intervideosrc->surface->video_info.finfo) {
-    GstVideoInfo tmp_info = intervideosrc->surface->video_info;
+  /* Only takes the surface lock if the info changed */
+  gst_inter_surface_update_video_info (intervideosrc->surface,
+      &intervideosrc->surface_info, &intervideosrc->video_cookie);
+
+  if (intervideosrc->surface_info.finfo) {
+    GstVideoInfo tmp_info = intervideosrc->surface_info;
 
     /* We negotiate the framerate ourselves */
     tmp_info.fps_n = intervideosrc->info.fps_n;
@@ -360,25 +370,26 @@ gst_inter_video_src_create (GstBaseSrc * src, guint64 offset, guint size,
     }
   }
 
-  if (intervideosrc->surface->video_buffer) {
-    /* We have a buffer to push */
-    buffer = gst_buffer_ref (intervideosrc->surface->video_buffer);
+  buffer = gst_inter_surface_get_video_buffer (intervideosrc->surface, &seq);
+  if (buffer && seq != intervideosrc->video_seq) {
+    /* A new frame from the sink */
+    intervideosrc->video_seq = seq;
+    intervideosrc->video_buffer_count = 0;
+  }
 
-    /* Can only be true if timeout > 0 */
-    if (intervideosrc->surface->video_buffer_count == frames) {
-      gst_buffer_unref (intervideosrc->surface->video_buffer);
-      intervideosrc->surface->video_buffer = NULL;
-    }
+  /* Stop repeating the frame after the timeout */
+  if (buffer && intervideosrc->video_buffer_count > frames) {
+    gst_buffer_unref (buffer);
+    buffer = NULL;
   }
 
-  if (intervideosrc->surface->video_buffer_count != 0 &&
-      intervideosrc->surface->video_buffer_count != (frames + 1)) {
+  if (intervideosrc->video_buffer_count != 0 &&
+      intervideosrc->video_buffer_count != (frames + 1)) {
     /* This is a repeat of the stored buffer or of a black frame */
     is_gap = TRUE;
   }
 
-  intervideosrc->surface->video_buffer_count++;
-  g_mutex_unlock (&intervideosrc->surface->mutex);
+  intervideosrc->video_buffer_count++;
 
   if (caps) {
     gboolean ret;
@@ -48,6 +48,14 @@ struct _GstInterVideoSrc
   GstBuffer *black_frame;
   int n_frames;
   GstClockTime timestamp_offset;
+
+  /* Copy of the surface video info, updated when video_cookie changes */
+  GstVideoInfo surface_info;
+  gint video_cookie;
+
+  /* The last frame from the sink, and how many times it was output */
+  guint64 video_seq;
+  guint64 video_buffer_count;
 };
 
 struct _GstInterVideoSrcClass
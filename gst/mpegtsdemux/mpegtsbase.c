@@ -208,6 +208,9 @@ mpegts_base_reset (MpegTSBase * base)
 
   if (klass->reset)
     klass->reset (base);
+
+  /* Subclasses might have set more known PIDs */
+  base->pid_types_dirty = TRUE;
 }
 
 static void
@@ -229,6 +232,7 @@ mpegts_base_init (MpegTSBase * base)
   base->parse_private_sections = FALSE;
   base->is_pes = g_new0 (guint8, 1024);
   base->known_psi = g_new0 (guint8, 1024);
+  base->pid_types = g_new0 (guint8, 0x2000);
   base->program_size = sizeof (MpegTSBaseProgram);
   base->stream_size = sizeof (MpegTSBaseStream);
 
@@ -248,6 +252,7 @@ mpegts_base_dispose (GObject * object)
     base->disposed = TRUE;
     g_free (base->known_psi);
     g_free (base->is_pes);
+    g_free (base->pid_types);
   }
 
   if (G_OBJECT_CLASS (parent_class)->dispose)
@@ -902,6 +907,7 @@ mpegts_base_handle_psi (MpegTSBase * base, GstMpegtsSection * section)
 
   switch (section->section_type) {
     case GST_MPEGTS_SECTION_PAT:
+      base->pid_types_dirty = TRUE;
       post_message = mpegts_base_apply_pat (base, section);
       if (base->seen_pat == FALSE) {
         base->seen_pat = TRUE;
@@ -911,6 +917,7 @@ mpegts_base_handle_psi (MpegTSBase * base, GstMpegtsSection * section)
       }
       break;
     case GST_MPEGTS_SECTION_PMT:
+      base->pid_types_dirty = TRUE;
       post_message = mpegts_base_apply_pmt (base, section);
       break;
     case GST_MPEGTS_SECTION_EIT:
@@ -918,6 +925,7 @@ mpegts_base_handle_psi (MpegTSBase * base, GstMpegtsSection * section)
       post_message = mpegts_base_get_tags_from_eit (base, section);
       break;
     case GST_MPEGTS_SECTION_ATSC_MGT:
+      base->pid_types_dirty = TRUE;
       post_message = mpegts_base_parse_atsc_mgt (base, section);
       break;
     default:
@@ -1105,6 +1113,37 @@ query_upstream_latency (MpegTSBase * base)
   base->queried_latency = TRUE;
 }
 
+static void
+mpegts_base_update_pid_types (MpegTSBase * base)
+{
+  guint i, pid;
+
+  /* Process 8 PIDs (one byte of each bit array) at a time, most of them
+   * are unused */
+  for (i = 0; i < 1024; i++) {
+    guint8 pes = base->is_pes[i];
+    guint8 psi = base->known_psi[i];
+    guint8 *types = base->pid_types + (i << 3);
+
+    if (G_LIKELY ((pes | psi) == 0)) {
+      memset (types, MPEGTS_BASE_PID_DROP, 8);
+      continue;
+    }
+
+    for (pid = 0; pid < 8; pid++) {
+      /* PES wins over PSI, like in the original bit checks */
+      if (pes & (1 << pid))
+        types[pid] = MPEGTS_BASE_PID_PES;
+      else if (psi & (1 << pid))
+        types[pid] = MPEGTS_BASE_PID_PSI;
+      else
+        types[pid] = MPEGTS_BASE_PID_DROP;
+    }
+  }
+
+  base->pid_types_dirty = FALSE;
+}
+
 static GstFlowReturn
 mpegts_base_chain (GstPad * pad, GstObject * parent, GstBuffer * buf)
 {
@@ -1112,7 +1151,7 @@ mpegts_base_chain (GstPad * pad, GstObject * parent, GstBuffer * buf)
   MpegTSBase *base;
   MpegTSPacketizerPacketReturn pret;
   MpegTSPacketizer2 *packetizer;
-  MpegTSPacketizerPacket packet;
+  MpegTSPacketizerPacket packets[MPEGTS_PACKETIZER_BATCH_SIZE];
   MpegTSBaseClass *klass;
 
   base = GST_MPEGTS_BASE (parent);
@@ -1140,50 +1179,83 @@ mpegts_base_chain (GstPad * pad, GstObject * parent, GstBuffer * buf)
   mpegts_packetizer_push (base->packetizer, buf);
 
   while (res == GST_FLOW_OK) {
-    pret = mpegts_packetizer_next_packet (base->packetizer, &packet);
+    guint i, n_packets;
+
+    pret = mpegts_packetizer_next_packets (packetizer, packets,
+        MPEGTS_PACKETIZER_BATCH_SIZE, &n_packets);
 
     /* If we don't have enough data, return */
     if (G_UNLIKELY (pret == PACKET_NEED_MORE))
       break;
 
-    if (G_UNLIKELY (pret == PACKET_BAD)) {
-      /* bad header, skip the packet */
-      GST_DEBUG_OBJECT (base, "bad packet, skipping");
-      goto next;
-    }
+    for (i = 0; i < n_packets && res == GST_FLOW_OK; i++) {
+      MpegTSPacketizerPacket *packet = &packets[i];
+      guint8 pid_type;
 
-    if (klass->inspect_packet)
-      klass->inspect_packet (base, &packet);
-
-    /* If it's a known PES, push it */
-    if (MPEGTS_BIT_IS_SET (base->is_pes, packet.pid)) {
-      /* push the packet downstream */
-      if (base->push_data)
-        res = klass->push (base, &packet, NULL);
-    } else if (packet.payload
-        && MPEGTS_BIT_IS_SET (base->known_psi, packet.pid)) {
-      /* base PSI data */
-      GList *others, *tmp;
-      GstMpegtsSection *section;
-
-      section = mpegts_packetizer_push_section (packetizer, &packet, &others);
-      if (section)
-        mpegts_base_handle_psi (base, section);
-      if (G_UNLIKELY (others)) {
-        for (tmp = others; tmp; tmp = tmp->next)
-          mpegts_base_handle_psi (base, (GstMpegtsSection *) tmp->data);
-        g_list_free (others);
+      if (G_UNLIKELY (base->pid_types_dirty))
+        mpegts_base_update_pid_types (base);
+
+      pid_type = base->pid_types[packet->pid];
+
+      /* Fast path for PIDs we don't handle. Packets with an adaptation
+       * field still need to be parsed to pick up PCR values */
+      if (pid_type == MPEGTS_BASE_PID_DROP && !klass->inspect_packet
+          && !FLAGS_HAS_AFC (packet->scram_afc_cc)) {
+        if (packet->pid != 0x1fff)
+          GST_LOG ("PID 0x%04x Saw packet on a pid we don't handle",
+              packet->pid);
+        continue;
       }
 
-      /* we need to push section packet downstream */
-      if (base->push_section)
-        res = klass->push (base, &packet, section);
+      if (G_UNLIKELY (mpegts_packetizer_parse_packet_data (packetizer,
+                  packet) == PACKET_BAD)) {
+        /* bad adaptation field, skip the packet */
+        GST_DEBUG_OBJECT (base, "bad packet, skipping");
+        continue;
+      }
+
+      if (klass->inspect_packet)
+        klass->inspect_packet (base, packet);
+
+      switch (pid_type) {
+        case MPEGTS_BASE_PID_PES:
+          /* If it's a known PES, push it */
+          if (base->push_data)
+            res = klass->push (base, packet, NULL);
+          break;
+        case MPEGTS_BASE_PID_PSI:
+        {
+          /* base PSI data */
+          GList *others, *tmp;
+          GstMpegtsSection *section;
+
+          if (!packet->payload)
+            break;
 
-    } else if (packet.payload && packet.pid != 0x1fff)
-      GST_LOG ("PID 0x%04x Saw packet on a pid we don't handle", packet.pid);
+          section =
+              mpegts_packetizer_push_section (packetizer, packet, &others);
+          if (section)
+            mpegts_base_handle_psi (base, section);
+          if (G_UNLIKELY (others)) {
+            for (tmp = others; tmp; tmp = tmp->next)
+              mpegts_base_handle_psi (base, (GstMpegtsSection *) tmp->data);
+            g_list_free (others);
+          }
+
+          /* we need to push section packet downstream */
+          if (base->push_section)
+            res = klass->push (base, packet, section);
+          break;
+        }
+        default:
+          if (packet->payload && packet->pid != 0x1fff)
+            GST_LOG ("PID 0x%04x Saw packet on a pid we don't handle",
+                packet->pid);
+          break;
+      }
+    }
 
-  next:
-    mpegts_packetizer_clear_packet (base->packetizer, &packet);
+    mpegts_packetizer_clear_packets (packetizer, packets, n_packets, i);
   }
 
   if (klass->input_done) {
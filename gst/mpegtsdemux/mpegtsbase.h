@@ -92,6 +92,13 @@ struct _MpegTSBaseProgram
   gboolean initial_program;
 };
 
+/* How packets of a given PID are handled, see MpegTSBase.pid_types */
+typedef enum {
+  MPEGTS_BASE_PID_DROP = 0,	/* Not handled, dropped */
+  MPEGTS_BASE_PID_PES,		/* PES (or PCR) PID, pushed to the subclass */
+  MPEGTS_BASE_PID_PSI		/* Known PSI PID, sections are parsed */
+} MpegTSBasePIDType;
+
 typedef enum {
   /* PULL MODE */
   BASE_MODE_SCANNING,		/* Looking for PAT/PMT */
@@ -128,6 +135,12 @@ struct _MpegTSBase {
   guint8 *known_psi;
   guint8 *is_pes;
 
+  /* Per-PID dispatch table (MpegTSBasePIDType) derived from the two arrays
+   * above. Since those only change when PSI is applied (or on reset), it is
+   * only rebuilt then, when pid_types_dirty is set */
+  guint8 *pid_types;
+  gboolean pid_types_dirty;
+
   gboolean disposed;
 
   /* size of the MpegTSBaseProgram structure, can be overridden
@@ -104,6 +104,21 @@ pcr_offset_group_free (PCROffsetGroup * group)
   g_slice_free (PCROffsetGroup, group);
 }
 
+/* Releases the currently mapped data, which is still in the adapter */
+static void
+mpegts_packetizer_drop_map (MpegTSPacketizer2 * packetizer)
+{
+  if (packetizer->map_buffer) {
+    gst_buffer_unmap (packetizer->map_buffer, &packetizer->map_info);
+    gst_buffer_unref (packetizer->map_buffer);
+    packetizer->map_buffer = NULL;
+  }
+
+  packetizer->map_data = NULL;
+  packetizer->map_size = 0;
+  packetizer->map_offset = 0;
+}
+
 static void
 flush_observations (MpegTSPacketizer2 * packetizer)
 {
@@ -260,6 +275,7 @@ mpegts_packetizer_init (MpegTSPacketizer2 * packetizer)
   packetizer->calculate_skew = FALSE;
   packetizer->calculate_offset = FALSE;
 
+  packetizer->map_buffer = NULL;
   packetizer->map_data = NULL;
   packetizer->map_size = 0;
   packetizer->map_offset = 0;
@@ -292,6 +308,7 @@ mpegts_packetizer_dispose (GObject * object)
       g_free (packetizer->streams);
     }
 
+    mpegts_packetizer_drop_map (packetizer);
     gst_adapter_clear (packetizer->adapter);
     g_object_unref (packetizer->adapter);
     g_mutex_clear (&packetizer->group_lock);
@@ -446,9 +463,10 @@ mpegts_packetizer_parse_adaptation_field_control (MpegTSPacketizer2 *
   return TRUE;
 }
 
-static MpegTSPacketizerPacketReturn
-mpegts_packetizer_parse_packet (MpegTSPacketizer2 * packetizer,
-    MpegTSPacketizerPacket * packet)
+/* Parses the fixed 4 byte header of the packet starting at
+ * packet->data_start */
+static inline MpegTSPacketizerPacketReturn
+mpegts_packetizer_parse_header (MpegTSPacketizerPacket * packet)
 {
   guint8 *data;
   guint8 tmp;
@@ -476,15 +494,22 @@ mpegts_packetizer_parse_packet (MpegTSPacketizer2 * packetizer,
 
   packet->data = data;
 
+  return PACKET_OK;
+}
+
+MpegTSPacketizerPacketReturn
+mpegts_packetizer_parse_packet_data (MpegTSPacketizer2 * packetizer,
+    MpegTSPacketizerPacket * packet)
+{
   packet->afc_flags = 0;
   packet->pcr = G_MAXUINT64;
 
-  if (FLAGS_HAS_AFC (tmp)) {
+  if (FLAGS_HAS_AFC (packet->scram_afc_cc)) {
     if (!mpegts_packetizer_parse_adaptation_field_control (packetizer, packet))
-      return FALSE;
+      return PACKET_BAD;
   }
 
-  if (FLAGS_HAS_PAYLOAD (tmp))
+  if (FLAGS_HAS_PAYLOAD (packet->scram_afc_cc))
     packet->payload = packet->data;
   else
     packet->payload = NULL;
@@ -492,6 +517,16 @@ mpegts_packetizer_parse_packet (MpegTSPacketizer2 * packetizer,
   return PACKET_OK;
 }
 
+static MpegTSPacketizerPacketReturn
+mpegts_packetizer_parse_packet (MpegTSPacketizer2 * packetizer,
+    MpegTSPacketizerPacket * packet)
+{
+  if (G_UNLIKELY (mpegts_packetizer_parse_header (packet) != PACKET_OK))
+    return PACKET_BAD;
+
+  return mpegts_packetizer_parse_packet_data (packetizer, packet);
+}
+
 static GstMpegtsSection *
 mpegts_packetizer_parse_section_header (MpegTSPacketizer2 * packetizer,
     MpegTSPacketizerStream * stream)
@@ -573,13 +608,11 @@ mpegts_packetizer_clear (MpegTSPacketizer2 * packetizer)
     memset (packetizer->streams, 0, 8192 * sizeof (MpegTSPacketizerStream *));
   }
 
+  mpegts_packetizer_drop_map (packetizer);
   gst_adapter_clear (packetizer->adapter);
   packetizer->offset = 0;
   packetizer->empty = TRUE;
   packetizer->need_sync = FALSE;
-  packetizer->map_data = NULL;
-  packetizer->map_size = 0;
-  packetizer->map_offset = 0;
   packetizer->last_in_time = GST_CLOCK_TIME_NONE;
 
   /* Close current PCR group */
@@ -607,14 +640,12 @@ mpegts_packetizer_flush (MpegTSPacketizer2 * packetizer, gboolean hard)
       }
     }
   }
+  mpegts_packetizer_drop_map (packetizer);
   gst_adapter_clear (packetizer->adapter);
 
   packetizer->offset = 0;
   packetizer->empty = TRUE;
   packetizer->need_sync = FALSE;
-  packetizer->map_data = NULL;
-  packetizer->map_size = 0;
-  packetizer->map_offset = 0;
   packetizer->last_in_time = GST_CLOCK_TIME_NONE;
 
   /* Close current PCR group */
@@ -680,9 +711,30 @@ mpegts_packetizer_flush_bytes (MpegTSPacketizer2 * packetizer, gsize size)
     gst_adapter_flush (packetizer->adapter, size);
   }
 
-  packetizer->map_data = NULL;
-  packetizer->map_size = 0;
-  packetizer->map_offset = 0;
+  mpegts_packetizer_drop_map (packetizer);
+}
+
+/* References all the @size bytes available in the adapter, without removing
+ * them from it */
+static GstBuffer *
+mpegts_packetizer_get_buffer (MpegTSPacketizer2 * packetizer, gsize size)
+{
+#if GST_CHECK_VERSION (1, 6, 0)
+  return gst_adapter_get_buffer_fast (packetizer->adapter, size);
+#else
+  GstBuffer *buffer;
+
+  /* Taking everything and pushing it back leaves the adapter unchanged, its
+   * timestamp tracking is not used */
+  g_return_val_if_fail (size == gst_adapter_available (packetizer->adapter),
+      NULL);
+
+  buffer = gst_adapter_take_buffer_fast (packetizer->adapter, size);
+  if (buffer)
+    gst_adapter_push (packetizer->adapter, gst_buffer_ref (buffer));
+
+  return buffer;
+#endif
 }
 
 static gboolean
@@ -699,11 +751,22 @@ mpegts_packetizer_map (MpegTSPacketizer2 * packetizer, gsize size)
   if (available < size)
     return FALSE;
 
-  packetizer->map_data =
-      (guint8 *) gst_adapter_map (packetizer->adapter, available);
-  if (!packetizer->map_data)
+  /* Reference the data of the adapter instead of mapping it in place, so
+   * that payloads can share the input memory instead of being copied. It
+   * stays in the adapter until it is flushed */
+  packetizer->map_buffer = mpegts_packetizer_get_buffer (packetizer, available);
+  if (!packetizer->map_buffer)
+    return FALSE;
+
+  if (!gst_buffer_map (packetizer->map_buffer, &packetizer->map_info,
+          GST_MAP_READ)) {
+    GST_ERROR ("Failed to map %" G_GSIZE_FORMAT " bytes", available);
+    gst_buffer_unref (packetizer->map_buffer);
+    packetizer->map_buffer = NULL;
     return FALSE;
+  }
 
+  packetizer->map_data = packetizer->map_info.data;
   packetizer->map_size = available;
   packetizer->map_offset = 0;
 
@@ -712,6 +775,26 @@ mpegts_packetizer_map (MpegTSPacketizer2 * packetizer, gsize size)
   return TRUE;
 }
 
+/* Returns the position of the first sync byte in data[start..end[, or @end
+ * if there is none.
+ * memchr() is used since all common libc implementations provide
+ * vectorized (SSE2/AVX2/NEON) versions of it, which are much faster
+ * than checking every byte in C */
+static inline gsize
+mpegts_packetizer_find_sync_byte (const guint8 * data, gsize start, gsize end)
+{
+  const guint8 *res;
+
+  if (G_UNLIKELY (start >= end))
+    return end;
+
+  res = memchr (data + start, PACKET_SYNC_BYTE, end - start);
+  if (G_UNLIKELY (res == NULL))
+    return end;
+
+  return res - data;
+}
+
 static gboolean
 mpegts_try_discover_packet_size (MpegTSPacketizer2 * packetizer)
 {
@@ -733,8 +816,10 @@ mpegts_try_discover_packet_size (MpegTSPacketizer2 * packetizer)
 
   for (i = 0; i + 3 * MPEGTS_MAX_PACKETSIZE < size; i++) {
     /* find a sync byte */
-    if (data[i] != PACKET_SYNC_BYTE)
-      continue;
+    i = mpegts_packetizer_find_sync_byte (data, i,
+        size - 3 * MPEGTS_MAX_PACKETSIZE);
+    if (i + 3 * MPEGTS_MAX_PACKETSIZE >= size)
+      break;
 
     /* check for 4 consecutive sync bytes with each possible packet size */
     for (j = 0; j < G_N_ELEMENTS (psizes); j++) {
@@ -790,8 +875,11 @@ mpegts_packetizer_sync (MpegTSPacketizer2 * packetizer)
     sync_offset = 0;
 
   for (i = sync_offset; i + 2 * packet_size < size; i++) {
-    if (data[i] == PACKET_SYNC_BYTE &&
-        data[i + packet_size] == PACKET_SYNC_BYTE &&
+    i = mpegts_packetizer_find_sync_byte (data, i, size - 2 * packet_size);
+    if (i + 2 * packet_size >= size)
+      break;
+
+    if (data[i + packet_size] == PACKET_SYNC_BYTE &&
         data[i + 2 * packet_size] == PACKET_SYNC_BYTE) {
       found = TRUE;
       break;
@@ -885,6 +973,116 @@ mpegts_packetizer_clear_packet (MpegTSPacketizer2 * packetizer,
   }
 }
 
+MpegTSPacketizerPacketReturn
+mpegts_packetizer_next_packets (MpegTSPacketizer2 * packetizer,
+    MpegTSPacketizerPacket * packets, guint max_packets, guint * n_packets)
+{
+  guint8 *data, *end;
+  guint packet_size;
+  gsize sync_offset;
+  guint n = 0;
+
+  *n_packets = 0;
+
+  packet_size = packetizer->packet_size;
+  if (G_UNLIKELY (!packet_size)) {
+    if (!mpegts_try_discover_packet_size (packetizer))
+      return PACKET_NEED_MORE;
+    packet_size = packetizer->packet_size;
+  }
+
+  /* M2TS packets don't start with the sync byte, all other variants do */
+  if (packet_size == MPEGTS_M2TS_PACKETSIZE)
+    sync_offset = 4;
+  else
+    sync_offset = 0;
+
+  while (1) {
+    if (packetizer->need_sync) {
+      if (!mpegts_packetizer_sync (packetizer))
+        return PACKET_NEED_MORE;
+      packetizer->need_sync = FALSE;
+    }
+
+    if (!mpegts_packetizer_map (packetizer, packet_size))
+      return PACKET_NEED_MORE;
+
+    data = packetizer->map_data + packetizer->map_offset;
+    end = packetizer->map_data + packetizer->map_size;
+
+    while (n < max_packets && data + packet_size <= end) {
+      MpegTSPacketizerPacket *packet = &packets[n];
+
+      packet->data_start = data + sync_offset;
+
+      /* Check sync byte */
+      if (G_UNLIKELY (*packet->data_start != PACKET_SYNC_BYTE)) {
+        GST_DEBUG ("lost sync");
+        packetizer->need_sync = TRUE;
+        break;
+      }
+
+      /* ALL mpeg-ts variants contain 188 bytes of data. Those with bigger
+       * packet sizes contain either extra data (timesync, FEC, ..) either
+       * before or after the data */
+      packet->data_end = packet->data_start + 188;
+      packet->offset = packetizer->offset;
+
+      packetizer->offset += packet_size;
+      packetizer->map_offset += packet_size;
+      data += packet_size;
+
+      if (G_UNLIKELY (mpegts_packetizer_parse_header (packet) != PACKET_OK)) {
+        GST_DEBUG ("bad packet header at offset %" G_GUINT64_FORMAT
+            ", skipping", packet->offset);
+        continue;
+      }
+
+      n++;
+    }
+
+    /* We lost sync before getting any valid packet, resync and try again
+     * (the packets we went over are no longer referenced) */
+    if (G_UNLIKELY (n == 0 && packetizer->need_sync))
+      continue;
+
+    break;
+  }
+
+  GST_LOG ("got %u packets, next offset %" G_GUINT64_FORMAT, n,
+      packetizer->offset);
+
+  *n_packets = n;
+
+  return PACKET_OK;
+}
+
+void
+mpegts_packetizer_clear_packets (MpegTSPacketizer2 * packetizer,
+    MpegTSPacketizerPacket * packets, guint n_packets, guint n_handled)
+{
+  guint packet_size = packetizer->packet_size;
+
+  /* The packetizer was flushed while handling the batch */
+  if (!packetizer->map_data)
+    return;
+
+  if (G_UNLIKELY (n_handled < n_packets)) {
+    /* Rewind to the first packet which wasn't handled, it will be
+     * returned again on the next call */
+    MpegTSPacketizerPacket *next = &packets[n_handled];
+    gsize sync_offset = packet_size == MPEGTS_M2TS_PACKETSIZE ? 4 : 0;
+
+    packetizer->map_offset =
+        next->data_start - sync_offset - packetizer->map_data;
+    packetizer->offset = next->offset;
+    packetizer->need_sync = FALSE;
+  }
+
+  if (packetizer->map_size - packetizer->map_offset < packet_size)
+    mpegts_packetizer_flush_bytes (packetizer, packetizer->map_offset);
+}
+
 gboolean
 mpegts_packetizer_has_packets (MpegTSPacketizer2 * packetizer)
 {
@@ -892,7 +1090,36 @@ mpegts_packetizer_has_packets (MpegTSPacketizer2 * packetizer)
     if (!mpegts_try_discover_packet_size (packetizer))
       return FALSE;
   }
-  return gst_adapter_available (packetizer->adapter) >= packetizer->packet_size;
+  /* The mapped data stays in the adapter until it is flushed, only the
+   * bytes consumed from it have to be left out */
+  return gst_adapter_available (packetizer->adapter) -
+      packetizer->map_offset >= packetizer->packet_size;
+}
+
+GstMemory *
+mpegts_packetizer_share_payload (MpegTSPacketizer2 * packetizer,
+    const guint8 * data, gsize size)
+{
+  GstMemory *mem;
+  guint idx, length;
+  gsize offset, skip;
+
+  if (G_UNLIKELY (packetizer->map_buffer == NULL))
+    return NULL;
+
+  g_return_val_if_fail (data >= packetizer->map_data &&
+      data + size <= packetizer->map_data + packetizer->map_size, NULL);
+
+  offset = data - packetizer->map_data;
+  if (!gst_buffer_find_memory (packetizer->map_buffer, offset, size, &idx,
+          &length, &skip) || length != 1)
+    return NULL;
+
+  mem = gst_buffer_peek_memory (packetizer->map_buffer, idx);
+  if (GST_MEMORY_FLAG_IS_SET (mem, GST_MEMORY_FLAG_NO_SHARE))
+    return NULL;
+
+  return gst_memory_share (mem, skip, size);
 }
 
 /*
@@ -50,6 +50,9 @@
 
 #define MAX_WINDOW 512
 
+/* Maximum number of packets handed out by mpegts_packetizer_next_packets() */
+#define MPEGTS_PACKETIZER_BATCH_SIZE 64
+
 G_BEGIN_DECLS
 
 #define GST_TYPE_MPEGTS_PACKETIZER \
@@ -263,7 +266,11 @@ struct _MpegTSPacketizer2 {
   /* offset/bitrate calculator */
   gboolean       calculate_offset;
 
-  /* Shortcuts for adapter usage */
+  /* Shortcuts for adapter usage. The mapped data is referenced from the
+   * adapter in map_buffer, so that packet payloads can be referenced
+   * without copying (see mpegts_packetizer_share_payload()) */
+  GstBuffer *map_buffer;
+  GstMapInfo map_info;
   guint8 *map_data;
   gsize map_offset;
   gsize map_size;
@@ -348,6 +355,34 @@ G_GNUC_INTERNAL MpegTSPacketizerPacketReturn
 mpegts_packetizer_process_next_packet(MpegTSPacketizer2 * packetizer);
 G_GNUC_INTERNAL void mpegts_packetizer_clear_packet (MpegTSPacketizer2 *packetizer,
 				     MpegTSPacketizerPacket *packet);
+
+/* Batch interface:
+ * mpegts_packetizer_next_packets() validates the headers (sync byte, TEI,
+ * scrambling, PID, PUSI, AFC/CC) of up to @max_packets consecutive packets
+ * of the currently mapped chunk in one go. Packets with a bad header are
+ * skipped. Only pid, payload_unit_start_indicator, scram_afc_cc, data_start,
+ * data_end and offset are filled in, the adaptation field and payload of
+ * each packet have to be parsed, in order, with
+ * mpegts_packetizer_parse_packet_data() before being used.
+ * mpegts_packetizer_clear_packets() must be called once the caller is done
+ * with the batch, with the number of packets it actually handled. */
+G_GNUC_INTERNAL MpegTSPacketizerPacketReturn
+mpegts_packetizer_next_packets (MpegTSPacketizer2 *packetizer,
+				MpegTSPacketizerPacket *packets,
+				guint max_packets, guint *n_packets);
+G_GNUC_INTERNAL MpegTSPacketizerPacketReturn
+mpegts_packetizer_parse_packet_data (MpegTSPacketizer2 *packetizer,
+				     MpegTSPacketizerPacket *packet);
+G_GNUC_INTERNAL void mpegts_packetizer_clear_packets (MpegTSPacketizer2 *packetizer,
+				      MpegTSPacketizerPacket *packets,
+				      guint n_packets, guint n_handled);
+
+/* Returns a new GstMemory sharing @size bytes of the packet data starting at
+ * @data (which must point within the current packet), or NULL if the
+ * underlying memory can't be shared. The returned memory keeps the input
+ * data alive and stays valid after the packet was cleared */
+G_GNUC_INTERNAL GstMemory *mpegts_packetizer_share_payload (MpegTSPacketizer2 *packetizer,
+							    const guint8 *data, gsize size);
 G_GNUC_INTERNAL void mpegts_packetizer_remove_stream(MpegTSPacketizer2 *packetizer,
   gint16 pid);
 
@@ -146,6 +146,9 @@ struct _TSDemuxStream
 
   /* Whether this is a sparse stream (subtitles or metadata) */
   gboolean sparse;
+  /* TRUE if the PES can be pushed as several buffers, for streams that
+   * are always parsed downstream */
+  gboolean split_pes;
 
   /* TRUE if we are waiting for a valid timestamp */
   gboolean pending_ts;
@@ -155,6 +158,12 @@ struct _TSDemuxStream
 
   /* Data being reconstructed (allocated) */
   guint8 *data;
+  /* Data being reconstructed without copying, as memories sharing the
+   * input. Used instead of ->data as long as the PES fits in a single
+   * GstBuffer, or in several ones if ->split_pes is set, in which case
+   * the full buffers preceding ->shared_data are in ->shared_list */
+  GstBuffer *shared_data;
+  GstBufferList *shared_list;
 
   /* Size of data being reconstructed (if known, else 0) */
   guint expected_size;
@@ -271,9 +280,43 @@ enum
   ARG_0,
   PROP_PROGRAM_NUMBER,
   PROP_EMIT_STATS,
+  PROP_WORKER_THREADS,
   /* FILL ME */
 };
 
+#define DEFAULT_WORKER_THREADS 0
+
+/* Maximum number of buffers/events queued per output worker before the
+ * streaming thread blocks */
+#define WORKER_MAX_QUEUED 64
+
+struct _TSDemuxWorker
+{
+  GstTSDemux *demux;
+  GThread *thread;
+
+  GMutex lock;
+  /* Signalled when an item was queued, when an item was handled and
+   * when flushing/running change */
+  GCond cond;
+  /* Queue of TSDemuxWorkerItem */
+  GQueue queue;
+  /* TRUE while an item is being pushed downstream */
+  gboolean busy;
+  gboolean flushing;
+  gboolean running;
+};
+
+typedef struct
+{
+  GstPad *pad;
+  /* GstBuffer or serialized GstEvent */
+  GstMiniObject *object;
+} TSDemuxWorkerItem;
+
+#define WORKER_FOR_STREAM(demux, stream) \
+  (&(demux)->workers[((MpegTSBaseStream *) (stream))->pid % (demux)->n_workers])
+
 /* Pad functions */
 
 
@@ -303,10 +346,12 @@ static GstFlowReturn
 gst_ts_demux_push_pending_data (GstTSDemux * demux, TSDemuxStream * stream);
 static void gst_ts_demux_stream_flush (TSDemuxStream * stream,
     GstTSDemux * demux);
+static void gst_ts_demux_stream_clear_shared_data (TSDemuxStream * stream);
 
 static gboolean push_event (MpegTSBase * base, GstEvent * event);
 static void gst_ts_demux_check_and_sync_streams (GstTSDemux * demux,
     GstClockTime time);
+static void gst_ts_demux_stop_workers (GstTSDemux * demux);
 
 static void
 _extra_init (void)
@@ -329,11 +374,26 @@ gst_ts_demux_dispose (GObject * object)
 {
   GstTSDemux *demux = GST_TS_DEMUX_CAST (object);
 
-  gst_flow_combiner_free (demux->flowcombiner);
+  gst_ts_demux_stop_workers (demux);
+
+  if (demux->flowcombiner) {
+    gst_flow_combiner_free (demux->flowcombiner);
+    demux->flowcombiner = NULL;
+  }
 
   GST_CALL_PARENT (G_OBJECT_CLASS, dispose, (object));
 }
 
+static void
+gst_ts_demux_finalize (GObject * object)
+{
+  GstTSDemux *demux = GST_TS_DEMUX_CAST (object);
+
+  g_mutex_clear (&demux->flow_lock);
+
+  GST_CALL_PARENT (G_OBJECT_CLASS, finalize, (object));
+}
+
 static void
 gst_ts_demux_class_init (GstTSDemuxClass * klass)
 {
@@ -345,6 +405,7 @@ gst_ts_demux_class_init (GstTSDemuxClass * klass)
   gobject_class->set_property = gst_ts_demux_set_property;
   gobject_class->get_property = gst_ts_demux_get_property;
   gobject_class->dispose = gst_ts_demux_dispose;
+  gobject_class->finalize = gst_ts_demux_finalize;
 
   g_object_class_install_property (gobject_class, PROP_PROGRAM_NUMBER,
       g_param_spec_int ("program-number", "Program number",
@@ -356,6 +417,23 @@ gst_ts_demux_class_init (GstTSDemuxClass * klass)
           "Emit messages for every pcr/opcr/pts/dts", FALSE,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  /**
+   * GstTSDemux:worker-threads:
+   *
+   * Number of threads used to push the demuxed streams downstream. Each
+   * stream is handled by one worker (picked by PID), so that downstream
+   * processing of the various streams runs in parallel instead of on the
+   * single input streaming thread. 0 pushes everything from the streaming
+   * thread. Changes are taken into account the next time a program starts.
+   *
+   * Since: 1.6
+   */
+  g_object_class_install_property (gobject_class, PROP_WORKER_THREADS,
+      g_param_spec_uint ("worker-threads", "Worker threads",
+          "Number of threads pushing streams downstream (0 = disabled)",
+          0, 64, DEFAULT_WORKER_THREADS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   element_class = GST_ELEMENT_CLASS (klass);
   gst_element_class_add_pad_template (element_class,
       gst_static_pad_template_get (&video_template));
@@ -414,6 +492,8 @@ gst_ts_demux_reset (MpegTSBase * base)
   demux->group_id = G_MAXUINT;
 
   demux->last_seek_offset = -1;
+
+  gst_ts_demux_stop_workers (demux);
 }
 
 static void
@@ -427,6 +507,8 @@ gst_ts_demux_init (GstTSDemux * demux)
   base->push_section = FALSE;
 
   demux->flowcombiner = gst_flow_combiner_new ();
+  g_mutex_init (&demux->flow_lock);
+  demux->worker_threads = DEFAULT_WORKER_THREADS;
   demux->requested_program_number = -1;
   demux->program_number = -1;
   gst_ts_demux_reset (base);
@@ -448,6 +530,11 @@ gst_ts_demux_set_property (GObject * object, guint prop_id,
     case PROP_EMIT_STATS:
       demux->emit_statistics = g_value_get_boolean (value);
       break;
+    case PROP_WORKER_THREADS:
+      GST_OBJECT_LOCK (demux);
+      demux->worker_threads = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (demux);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
   }
@@ -466,11 +553,302 @@ gst_ts_demux_get_property (GObject * object, guint prop_id,
     case PROP_EMIT_STATS:
       g_value_set_boolean (value, demux->emit_statistics);
       break;
+    case PROP_WORKER_THREADS:
+      GST_OBJECT_LOCK (demux);
+      g_value_set_uint (value, demux->worker_threads);
+      GST_OBJECT_UNLOCK (demux);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
   }
 }
 
+static void
+worker_item_free (TSDemuxWorkerItem * item)
+{
+  gst_mini_object_unref (item->object);
+  gst_object_unref (item->pad);
+  g_slice_free (TSDemuxWorkerItem, item);
+}
+
+static gpointer
+gst_ts_demux_worker_func (TSDemuxWorker * worker)
+{
+  GstTSDemux *demux = worker->demux;
+
+  g_mutex_lock (&worker->lock);
+  while (worker->running) {
+    TSDemuxWorkerItem *item = g_queue_pop_head (&worker->queue);
+
+    if (item == NULL) {
+      g_cond_wait (&worker->cond, &worker->lock);
+      continue;
+    }
+
+    worker->busy = TRUE;
+    /* Wake up the streaming thread if it is waiting for room */
+    g_cond_broadcast (&worker->cond);
+    g_mutex_unlock (&worker->lock);
+
+    if (GST_IS_BUFFER (item->object)) {
+      GstFlowReturn ret;
+
+      ret = gst_pad_push (item->pad, GST_BUFFER_CAST (item->object));
+      GST_LOG_OBJECT (item->pad, "Returned %s", gst_flow_get_name (ret));
+
+      g_mutex_lock (&demux->flow_lock);
+      demux->worker_flow =
+          gst_flow_combiner_update_flow (demux->flowcombiner, ret);
+      g_mutex_unlock (&demux->flow_lock);
+    } else if (GST_IS_BUFFER_LIST (item->object)) {
+      GstFlowReturn ret;
+
+      ret = gst_pad_push_list (item->pad,
+          GST_BUFFER_LIST_CAST (item->object));
+      GST_LOG_OBJECT (item->pad, "Returned %s", gst_flow_get_name (ret));
+
+      g_mutex_lock (&demux->flow_lock);
+      demux->worker_flow =
+          gst_flow_combiner_update_flow (demux->flowcombiner, ret);
+      g_mutex_unlock (&demux->flow_lock);
+    } else {
+      gst_pad_push_event (item->pad, GST_EVENT_CAST (item->object));
+    }
+    item->object = NULL;
+    gst_object_unref (item->pad);
+    g_slice_free (TSDemuxWorkerItem, item);
+
+    g_mutex_lock (&worker->lock);
+    worker->busy = FALSE;
+    g_cond_broadcast (&worker->cond);
+  }
+  g_mutex_unlock (&worker->lock);
+
+  return NULL;
+}
+
+/* Waits until all workers pushed everything they have queued */
+static void
+gst_ts_demux_drain_workers (GstTSDemux * demux)
+{
+  guint i;
+
+  for (i = 0; i < demux->n_workers; i++) {
+    TSDemuxWorker *worker = &demux->workers[i];
+
+    g_mutex_lock (&worker->lock);
+    while (!worker->flushing && (worker->busy || worker->queue.length))
+      g_cond_wait (&worker->cond, &worker->lock);
+    g_mutex_unlock (&worker->lock);
+  }
+}
+
+/* Called when a program starts, (re)creates the workers if the
+ * worker-threads property changed since they were started */
+static void
+gst_ts_demux_start_workers (GstTSDemux * demux)
+{
+  guint i, n_workers;
+
+  GST_OBJECT_LOCK (demux);
+  n_workers = demux->worker_threads;
+  GST_OBJECT_UNLOCK (demux);
+
+  if (demux->workers != NULL) {
+    if (n_workers == demux->n_workers)
+      return;
+
+    GST_DEBUG_OBJECT (demux, "Worker threads changed from %u to %u",
+        demux->n_workers, n_workers);
+    gst_ts_demux_drain_workers (demux);
+    gst_ts_demux_stop_workers (demux);
+  }
+
+  if (n_workers == 0)
+    return;
+
+  GST_DEBUG_OBJECT (demux, "Starting %u output workers", n_workers);
+
+  demux->worker_flow = GST_FLOW_OK;
+  demux->workers = g_new0 (TSDemuxWorker, n_workers);
+  for (i = 0; i < n_workers; i++) {
+    TSDemuxWorker *worker = &demux->workers[i];
+
+    worker->demux = demux;
+    g_mutex_init (&worker->lock);
+    g_cond_init (&worker->cond);
+    g_queue_init (&worker->queue);
+    worker->running = TRUE;
+    worker->thread = g_thread_new ("tsdemux-worker",
+        (GThreadFunc) gst_ts_demux_worker_func, worker);
+  }
+  demux->n_workers = n_workers;
+}
+
+static void
+gst_ts_demux_stop_workers (GstTSDemux * demux)
+{
+  guint i;
+
+  if (demux->workers == NULL)
+    return;
+
+  GST_DEBUG_OBJECT (demux, "Stopping %u output workers", demux->n_workers);
+
+  for (i = 0; i < demux->n_workers; i++) {
+    TSDemuxWorker *worker = &demux->workers[i];
+
+    g_mutex_lock (&worker->lock);
+    worker->running = FALSE;
+    worker->flushing = TRUE;
+    g_queue_foreach (&worker->queue, (GFunc) worker_item_free, NULL);
+    g_queue_clear (&worker->queue);
+    g_cond_broadcast (&worker->cond);
+    g_mutex_unlock (&worker->lock);
+
+    g_thread_join (worker->thread);
+    g_mutex_clear (&worker->lock);
+    g_cond_clear (&worker->cond);
+  }
+
+  g_free (demux->workers);
+  demux->workers = NULL;
+  demux->n_workers = 0;
+}
+
+/* Called with flushing=TRUE on FLUSH_START, drops everything that was
+ * queued. With flushing=FALSE (FLUSH_STOP), waits for the workers to be
+ * done with the item they were pushing before accepting data again */
+static void
+gst_ts_demux_flush_workers (GstTSDemux * demux, gboolean flushing)
+{
+  guint i;
+
+  for (i = 0; i < demux->n_workers; i++) {
+    TSDemuxWorker *worker = &demux->workers[i];
+
+    g_mutex_lock (&worker->lock);
+    if (flushing) {
+      worker->flushing = TRUE;
+      g_queue_foreach (&worker->queue, (GFunc) worker_item_free, NULL);
+      g_queue_clear (&worker->queue);
+    } else {
+      while (worker->busy)
+        g_cond_wait (&worker->cond, &worker->lock);
+      worker->flushing = FALSE;
+    }
+    g_cond_broadcast (&worker->cond);
+    g_mutex_unlock (&worker->lock);
+  }
+
+  if (!flushing) {
+    g_mutex_lock (&demux->flow_lock);
+    demux->worker_flow = GST_FLOW_OK;
+    g_mutex_unlock (&demux->flow_lock);
+  }
+}
+
+/* Waits until the worker handling @stream pushed everything queued */
+static void
+gst_ts_demux_stream_wait_worker (GstTSDemux * demux, TSDemuxStream * stream)
+{
+  TSDemuxWorker *worker;
+
+  if (demux->workers == NULL)
+    return;
+
+  worker = WORKER_FOR_STREAM (demux, stream);
+
+  g_mutex_lock (&worker->lock);
+  while (!worker->flushing && (worker->busy || worker->queue.length))
+    g_cond_wait (&worker->cond, &worker->lock);
+  g_mutex_unlock (&worker->lock);
+}
+
+static void
+gst_ts_demux_worker_queue (TSDemuxWorker * worker, GstPad * pad,
+    GstMiniObject * object)
+{
+  TSDemuxWorkerItem *item;
+
+  g_mutex_lock (&worker->lock);
+  while (!worker->flushing && worker->queue.length >= WORKER_MAX_QUEUED)
+    g_cond_wait (&worker->cond, &worker->lock);
+
+  if (G_UNLIKELY (worker->flushing)) {
+    g_mutex_unlock (&worker->lock);
+    GST_DEBUG_OBJECT (pad, "Worker flushing, dropping %" GST_PTR_FORMAT,
+        object);
+    gst_mini_object_unref (object);
+    return;
+  }
+
+  item = g_slice_new (TSDemuxWorkerItem);
+  item->pad = gst_object_ref (pad);
+  item->object = object;
+  g_queue_push_tail (&worker->queue, item);
+  g_cond_broadcast (&worker->cond);
+  g_mutex_unlock (&worker->lock);
+}
+
+/* Pushes @buffer on the stream pad, or hands it to its worker. In the
+ * latter case the combined flow return of the workers is returned */
+static GstFlowReturn
+gst_ts_demux_stream_push (GstTSDemux * demux, TSDemuxStream * stream,
+    GstBuffer * buffer)
+{
+  GstFlowReturn res;
+
+  if (demux->workers == NULL)
+    return gst_pad_push (stream->pad, buffer);
+
+  gst_ts_demux_worker_queue (WORKER_FOR_STREAM (demux, stream), stream->pad,
+      GST_MINI_OBJECT_CAST (buffer));
+
+  g_mutex_lock (&demux->flow_lock);
+  res = demux->worker_flow;
+  g_mutex_unlock (&demux->flow_lock);
+
+  return res;
+}
+
+/* Same as gst_ts_demux_stream_push() for the buffers of a PES split in
+ * several buffers */
+static GstFlowReturn
+gst_ts_demux_stream_push_list (GstTSDemux * demux, TSDemuxStream * stream,
+    GstBufferList * list)
+{
+  GstFlowReturn res;
+
+  if (demux->workers == NULL)
+    return gst_pad_push_list (stream->pad, list);
+
+  gst_ts_demux_worker_queue (WORKER_FOR_STREAM (demux, stream), stream->pad,
+      GST_MINI_OBJECT_CAST (list));
+
+  g_mutex_lock (&demux->flow_lock);
+  res = demux->worker_flow;
+  g_mutex_unlock (&demux->flow_lock);
+
+  return res;
+}
+
+static gboolean
+gst_ts_demux_stream_push_event (GstTSDemux * demux, TSDemuxStream * stream,
+    GstEvent * event)
+{
+  /* Non-serialized events and FLUSH_STOP (which is only sent once the
+   * workers are idle) go straight downstream */
+  if (demux->workers == NULL || !GST_EVENT_IS_SERIALIZED (event)
+      || GST_EVENT_TYPE (event) == GST_EVENT_FLUSH_STOP)
+    return gst_pad_push_event (stream->pad, event);
+
+  gst_ts_demux_worker_queue (WORKER_FOR_STREAM (demux, stream), stream->pad,
+      GST_MINI_OBJECT_CAST (event));
+
+  return TRUE;
+}
+
 static gboolean
 gst_ts_demux_srcpad_query (GstPad * pad, GstObject * parent, GstQuery * query)
 {
@@ -933,6 +1311,13 @@ push_event (MpegTSBase * base, GstEvent * event)
     return early_ret;
   }
 
+  if (demux->workers) {
+    if (GST_EVENT_TYPE (event) == GST_EVENT_FLUSH_START)
+      gst_ts_demux_flush_workers (demux, TRUE);
+    else if (GST_EVENT_TYPE (event) == GST_EVENT_FLUSH_STOP)
+      gst_ts_demux_flush_workers (demux, FALSE);
+  }
+
   for (tmp = demux->program->stream_list; tmp; tmp = tmp->next) {
     TSDemuxStream *stream = (TSDemuxStream *) tmp->data;
     if (stream->pad) {
@@ -942,7 +1327,7 @@ push_event (MpegTSBase * base, GstEvent * event)
         gst_ts_demux_push_pending_data (demux, stream);
 
       gst_event_ref (event);
-      gst_pad_push_event (stream->pad, event);
+      gst_ts_demux_stream_push_event (demux, stream, event);
     }
   }
 
@@ -1370,6 +1755,15 @@ done:
     if (sparse)
       gst_event_set_stream_flags (event, GST_STREAM_FLAG_SPARSE);
     stream->sparse = sparse;
+    /* Video elementary streams always go through a parser, which doesn't
+     * need a PES per buffer */
+    stream->split_pes =
+        gst_structure_has_name (gst_caps_get_structure (caps, 0),
+        "video/x-h264")
+        || gst_structure_has_name (gst_caps_get_structure (caps, 0),
+        "video/x-h265")
+        || gst_structure_has_name (gst_caps_get_structure (caps, 0),
+        "video/mpeg");
 
     gst_pad_push_event (pad, event);
     g_free (stream_id);
@@ -1403,8 +1797,11 @@ gst_ts_demux_stream_added (MpegTSBase * base, MpegTSBaseStream * bstream,
     /* Create the pad */
     if (bstream->stream_type != 0xff) {
       stream->pad = create_pad_for_stream (base, bstream, program);
-      if (stream->pad)
+      if (stream->pad) {
+        g_mutex_lock (&demux->flow_lock);
         gst_flow_combiner_add_pad (demux->flowcombiner, stream->pad);
+        g_mutex_unlock (&demux->flow_lock);
+      }
     }
 
     if (base->mode != BASE_MODE_PUSHING
@@ -1449,20 +1846,20 @@ tsdemux_h264_parsing_info_clear (TSDemuxH264ParsingInfos * h264infos)
 static void
 gst_ts_demux_stream_removed (MpegTSBase * base, MpegTSBaseStream * bstream)
 {
+  GstTSDemux *demux = GST_TS_DEMUX_CAST (base);
   TSDemuxStream *stream = (TSDemuxStream *) bstream;
 
   if (stream->pad) {
-    gst_flow_combiner_remove_pad (GST_TS_DEMUX_CAST (base)->flowcombiner,
-        stream->pad);
     if (stream->active) {
 
       if (gst_pad_is_active (stream->pad)) {
         /* Flush out all data */
         GST_DEBUG_OBJECT (stream->pad, "Flushing out pending data");
-        gst_ts_demux_push_pending_data ((GstTSDemux *) base, stream);
+        gst_ts_demux_push_pending_data (demux, stream);
 
         GST_DEBUG_OBJECT (stream->pad, "Pushing out EOS");
-        gst_pad_push_event (stream->pad, gst_event_new_eos ());
+        gst_ts_demux_stream_push_event (demux, stream, gst_event_new_eos ());
+        gst_ts_demux_stream_wait_worker (demux, stream);
         gst_pad_set_active (stream->pad, FALSE);
       }
 
@@ -1470,10 +1867,14 @@ gst_ts_demux_stream_removed (MpegTSBase * base, MpegTSBaseStream * bstream)
       gst_element_remove_pad (GST_ELEMENT_CAST (base), stream->pad);
       stream->active = FALSE;
     }
+    gst_ts_demux_stream_wait_worker (demux, stream);
+    g_mutex_lock (&demux->flow_lock);
+    gst_flow_combiner_remove_pad (demux->flowcombiner, stream->pad);
+    g_mutex_unlock (&demux->flow_lock);
     stream->pad = NULL;
   }
 
-  gst_ts_demux_stream_flush (stream, GST_TS_DEMUX_CAST (base));
+  gst_ts_demux_stream_flush (stream, demux);
 
   tsdemux_h264_parsing_info_clear (&stream->h264infos);
 }
@@ -1493,7 +1894,8 @@ activate_pad_for_stream (GstTSDemux * tsdemux, TSDemuxStream * stream)
      * and playsink waits for stream-start or another serialized event */
     if (stream->sparse) {
       GST_DEBUG_OBJECT (stream->pad, "sparse stream, pushing GAP event");
-      gst_pad_push_event (stream->pad, gst_event_new_gap (0, 0));
+      gst_ts_demux_stream_push_event (tsdemux, stream,
+          gst_event_new_gap (0, 0));
     }
   } else if (((MpegTSBaseStream *) stream)->stream_type != 0xff) {
     GST_WARNING_OBJECT (tsdemux,
@@ -1511,6 +1913,7 @@ gst_ts_demux_stream_flush (TSDemuxStream * stream, GstTSDemux * tsdemux)
   if (stream->data)
     g_free (stream->data);
   stream->data = NULL;
+  gst_ts_demux_stream_clear_shared_data (stream);
   stream->state = PENDING_PACKET_EMPTY;
   stream->expected_size = 0;
   stream->allocated_size = 0;
@@ -1556,6 +1959,8 @@ gst_ts_demux_program_started (MpegTSBase * base, MpegTSBaseProgram * program)
     demux->program_number = program->program_number;
     demux->program = program;
 
+    gst_ts_demux_start_workers (demux);
+
     /* If this is not the initial program, we need to calculate
      * an update newsegment */
     demux->calculate_update_segment = !program->initial_program;
@@ -1774,6 +2179,90 @@ check_pending_buffers (GstTSDemux * demux)
   return TRUE;
 }
 
+/* Appends @size bytes of packet payload to the shared (non-copied) data of
+ * @stream. Returns FALSE if the data has to be copied instead */
+static gboolean
+gst_ts_demux_stream_share_data (GstTSDemux * demux, TSDemuxStream * stream,
+    guint8 * data, guint size)
+{
+  GstMemory *mem;
+
+  if (stream->data)
+    return FALSE;
+
+  if (stream->shared_data == NULL)
+    stream->shared_data = gst_buffer_new ();
+
+  if (size == 0)
+    return TRUE;
+
+  /* Appending more memories would make the buffer merge them, continue in
+   * a new buffer if the PES can be split */
+  if (gst_buffer_n_memory (stream->shared_data) >=
+      gst_buffer_get_max_memory ()) {
+    if (!stream->split_pes)
+      return FALSE;
+
+    if (stream->shared_list == NULL)
+      stream->shared_list = gst_buffer_list_new ();
+    gst_buffer_list_add (stream->shared_list, stream->shared_data);
+    stream->shared_data = gst_buffer_new ();
+  }
+
+  mem = mpegts_packetizer_share_payload (MPEG_TS_BASE_PACKETIZER (demux),
+      data, size);
+  if (G_UNLIKELY (mem == NULL))
+    return FALSE;
+
+  gst_buffer_append_memory (stream->shared_data, mem);
+
+  return TRUE;
+}
+
+static void
+gst_ts_demux_stream_clear_shared_data (TSDemuxStream * stream)
+{
+  if (stream->shared_list)
+    gst_buffer_list_unref (stream->shared_list);
+  stream->shared_list = NULL;
+  if (stream->shared_data)
+    gst_buffer_unref (stream->shared_data);
+  stream->shared_data = NULL;
+}
+
+/* Copies the shared data of @stream (if any) into a newly allocated ->data
+ * with room for at least @extra more bytes */
+static void
+gst_ts_demux_stream_make_contiguous (TSDemuxStream * stream, guint extra)
+{
+  gsize offset = 0;
+  guint i;
+
+  if (stream->shared_data == NULL)
+    return;
+
+  GST_LOG ("copying %u bytes of shared data", stream->current_size);
+
+  if (stream->expected_size)
+    stream->allocated_size =
+        MAX (stream->expected_size, stream->current_size + extra);
+  else
+    stream->allocated_size = MAX (8192, 2 * (stream->current_size + extra));
+
+  stream->data = g_malloc (stream->allocated_size);
+  if (stream->shared_list) {
+    for (i = 0; i < gst_buffer_list_length (stream->shared_list); i++) {
+      GstBuffer *buffer = gst_buffer_list_get (stream->shared_list, i);
+
+      offset += gst_buffer_extract (buffer, 0, stream->data + offset,
+          stream->current_size - offset);
+    }
+  }
+  gst_buffer_extract (stream->shared_data, 0, stream->data + offset,
+      stream->current_size - offset);
+  gst_ts_demux_stream_clear_shared_data (stream);
+}
+
 static void
 gst_ts_demux_parse_pes_header (GstTSDemux * demux, TSDemuxStream * stream,
     guint8 * data, guint32 length, guint64 bufferoffset)
@@ -1832,17 +2321,22 @@ gst_ts_demux_parse_pes_header (GstTSDemux * demux, TSDemuxStream * stream,
   data += header.header_size;
   length -= header.header_size;
 
-  /* Create the output buffer */
-  if (stream->expected_size)
-    stream->allocated_size = MAX (stream->expected_size, length);
-  else
-    stream->allocated_size = MAX (8192, length);
-
-  g_assert (stream->data == NULL);
-  stream->data = g_malloc (stream->allocated_size);
-  memcpy (stream->data, data, length);
+  g_assert (stream->data == NULL && stream->shared_data == NULL);
   stream->current_size = length;
 
+  /* Reference the input data if possible, else create the output buffer */
+  if (!gst_ts_demux_stream_share_data (demux, stream, data, length)) {
+    gst_ts_demux_stream_clear_shared_data (stream);
+
+    if (stream->expected_size)
+      stream->allocated_size = MAX (stream->expected_size, length);
+    else
+      stream->allocated_size = MAX (8192, length);
+
+    stream->data = g_malloc (stream->allocated_size);
+    memcpy (stream->data, data, length);
+  }
+
   stream->state = PENDING_PACKET_BUFFER;
 
   return;
@@ -1904,6 +2398,12 @@ gst_ts_demux_queue_data (GstTSDemux * demux, TSDemuxStream * stream,
     case PENDING_PACKET_BUFFER:
     {
       GST_LOG ("BUFFER: appending data");
+      if (G_LIKELY (gst_ts_demux_stream_share_data (demux, stream, data,
+                  size))) {
+        stream->current_size += size;
+        break;
+      }
+      gst_ts_demux_stream_make_contiguous (stream, size);
       if (G_UNLIKELY (stream->current_size + size > stream->allocated_size)) {
         GST_LOG ("resizing buffer");
         do {
@@ -1922,6 +2422,8 @@ gst_ts_demux_queue_data (GstTSDemux * demux, TSDemuxStream * stream,
         g_free (stream->data);
         stream->data = NULL;
       }
+      if (G_UNLIKELY (stream->shared_data))
+        gst_ts_demux_stream_clear_shared_data (stream);
       stream->continuity_counter = CONTINUITY_UNSET;
       break;
     }
@@ -2019,17 +2521,17 @@ push_new_segment:
     if (demux->update_segment) {
       GST_DEBUG_OBJECT (stream->pad, "Pushing update segment");
       gst_event_ref (demux->update_segment);
-      gst_pad_push_event (stream->pad, demux->update_segment);
+      gst_ts_demux_stream_push_event (demux, stream, demux->update_segment);
     }
 
     if (demux->segment_event) {
       GST_DEBUG_OBJECT (stream->pad, "Pushing newsegment event");
       gst_event_ref (demux->segment_event);
-      gst_pad_push_event (stream->pad, demux->segment_event);
+      gst_ts_demux_stream_push_event (demux, stream, demux->segment_event);
     }
 
     if (demux->global_tags) {
-      gst_pad_push_event (stream->pad,
+      gst_ts_demux_stream_push_event (demux, stream,
           gst_event_new_tag (gst_tag_list_ref (demux->global_tags)));
     }
 
@@ -2037,7 +2539,8 @@ push_new_segment:
     if (stream->taglist) {
       GST_DEBUG_OBJECT (stream->pad, "Sending tags %" GST_PTR_FORMAT,
           stream->taglist);
-      gst_pad_push_event (stream->pad, gst_event_new_tag (stream->taglist));
+      gst_ts_demux_stream_push_event (demux, stream,
+          gst_event_new_tag (stream->taglist));
       stream->taglist = NULL;
     }
 
@@ -2095,7 +2598,7 @@ gst_ts_demux_check_and_sync_streams (GstTSDemux * demux, GstClockTime time)
         calculate_and_push_newsegment (demux, ps);
 
       /* Now send gap event */
-      gst_pad_push_event (ps->pad, gst_event_new_gap (time, 0));
+      gst_ts_demux_stream_push_event (demux, ps, gst_event_new_gap (time, 0));
     }
 
     /* Update GAP tracking vars so we don't re-check this stream for a while */
@@ -2114,12 +2617,13 @@ gst_ts_demux_push_pending_data (GstTSDemux * demux, TSDemuxStream * stream)
   MpegTSBaseStream *bs = (MpegTSBaseStream *) stream;
 #endif
   GstBuffer *buffer = NULL;
+  GstBufferList *list = NULL;
 
   GST_DEBUG_OBJECT (stream->pad,
       "stream:%p, pid:0x%04x stream_type:%d state:%d", stream, bs->pid,
       bs->stream_type, stream->state);
 
-  if (G_UNLIKELY (stream->data == NULL)) {
+  if (G_UNLIKELY (stream->data == NULL && stream->shared_data == NULL)) {
     GST_LOG ("stream->data == NULL");
     goto beach;
   }
@@ -2137,12 +2641,16 @@ gst_ts_demux_push_pending_data (GstTSDemux * demux, TSDemuxStream * stream)
   if (G_UNLIKELY (demux->program == NULL)) {
     GST_LOG_OBJECT (demux, "No program");
     g_free (stream->data);
+    gst_ts_demux_stream_clear_shared_data (stream);
     goto beach;
   }
 
   if (stream->needs_keyframe) {
     MpegTSBase *base = (MpegTSBase *) demux;
 
+    /* The keyframe scanners need contiguous data */
+    gst_ts_demux_stream_make_contiguous (stream, 0);
+
     if ((gst_ts_demux_adjust_seek_offset_for_keyframe (stream, stream->data,
                 stream->current_size)) || demux->last_seek_offset == 0) {
       GST_DEBUG_OBJECT (stream->pad,
@@ -2166,9 +2674,24 @@ gst_ts_demux_push_pending_data (GstTSDemux * demux, TSDemuxStream * stream)
       goto beach;
     }
   } else {
-    buffer = gst_buffer_new_wrapped (stream->data, stream->current_size);
+    gboolean pending = stream->pending_ts && !check_pending_buffers (demux);
+
+    /* Buffers waiting for timestamps are stored as a single buffer */
+    if (G_UNLIKELY (pending && stream->shared_list))
+      gst_ts_demux_stream_make_contiguous (stream, 0);
+
+    if (stream->shared_list) {
+      /* The first buffer of the list carries the timestamps and flags */
+      list = stream->shared_list;
+      gst_buffer_list_add (list, stream->shared_data);
+      buffer = gst_buffer_list_get (list, 0);
+    } else if (stream->shared_data) {
+      buffer = stream->shared_data;
+    } else {
+      buffer = gst_buffer_new_wrapped (stream->data, stream->current_size);
+    }
 
-    if (G_UNLIKELY (stream->pending_ts && !check_pending_buffers (demux))) {
+    if (G_UNLIKELY (pending)) {
       PendingBuffer *pend;
       pend = g_slice_new0 (PendingBuffer);
       pend->buffer = buffer;
@@ -2198,7 +2721,7 @@ gst_ts_demux_push_pending_data (GstTSDemux * demux, TSDemuxStream * stream)
         GST_BUFFER_FLAG_SET (pend->buffer, GST_BUFFER_FLAG_DISCONT);
       stream->discont = FALSE;
 
-      res = gst_pad_push (stream->pad, pend->buffer);
+      res = gst_ts_demux_stream_push (demux, stream, pend->buffer);
       stream->nb_out_buffers += 1;
       g_slice_free (PendingBuffer, pend);
     }
@@ -2216,7 +2739,10 @@ gst_ts_demux_push_pending_data (GstTSDemux * demux, TSDemuxStream * stream)
         "(seeked PTS: %" GST_TIME_FORMAT " DTS: %" GST_TIME_FORMAT ")",
         GST_TIME_ARGS (stream->pts), GST_TIME_ARGS (stream->dts),
         GST_TIME_ARGS (stream->seeked_pts), GST_TIME_ARGS (stream->seeked_dts));
-    gst_buffer_unref (buffer);
+    if (list)
+      gst_buffer_list_unref (list);
+    else
+      gst_buffer_unref (buffer);
     goto beach;
   }
 
@@ -2236,11 +2762,16 @@ gst_ts_demux_push_pending_data (GstTSDemux * demux, TSDemuxStream * stream)
     GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_DISCONT);
   stream->discont = FALSE;
 
-  res = gst_pad_push (stream->pad, buffer);
+  if (list)
+    res = gst_ts_demux_stream_push_list (demux, stream, list);
+  else
+    res = gst_ts_demux_stream_push (demux, stream, buffer);
   /* Record that a buffer was pushed */
   stream->nb_out_buffers += 1;
   GST_DEBUG_OBJECT (stream->pad, "Returned %s", gst_flow_get_name (res));
-  res = gst_flow_combiner_update_flow (demux->flowcombiner, res);
+  /* Workers already return a combined flow */
+  if (demux->workers == NULL)
+    res = gst_flow_combiner_update_flow (demux->flowcombiner, res);
   GST_DEBUG_OBJECT (stream->pad, "combined %s", gst_flow_get_name (res));
 
   /* GAP / sparse stream tracking */
@@ -2267,6 +2798,8 @@ beach:
   GST_LOG ("Resetting to EMPTY, returning %s", gst_flow_get_name (res));
   stream->state = PENDING_PACKET_EMPTY;
   stream->data = NULL;
+  stream->shared_data = NULL;
+  stream->shared_list = NULL;
   stream->expected_size = 0;
   stream->current_size = 0;
 
@@ -49,6 +49,7 @@ G_BEGIN_DECLS
 #define GST_TS_DEMUX_CAST(obj) ((GstTSDemux*) obj)
 typedef struct _GstTSDemux GstTSDemux;
 typedef struct _GstTSDemuxClass GstTSDemuxClass;
+typedef struct _TSDemuxWorker TSDemuxWorker;
 
 struct _GstTSDemux
 {
@@ -86,6 +87,17 @@ struct _GstTSDemux
 
   GstFlowCombiner *flowcombiner;
 
+  /* Output worker threads. When enabled, assembled PES packets and
+   * serialized events are handed to a worker (picked by PID) which pushes
+   * them downstream, instead of being pushed from the streaming thread */
+  guint worker_threads;		/* Requested number of workers (0: disabled) */
+  TSDemuxWorker *workers;
+  guint n_workers;
+  /* Protects flowcombiner and worker_flow when workers are used */
+  GMutex flow_lock;
+  /* Combined flow return of what the workers pushed */
+  GstFlowReturn worker_flow;
+
   /* Used when seeking for a keyframe to go backward in the stream */
   guint64 last_seek_offset;
 };
@@ -108,11 +108,14 @@ enum
   ARG_PAT_INTERVAL,
   ARG_PMT_INTERVAL,
   ARG_ALIGNMENT,
-  ARG_SI_INTERVAL
+  ARG_SI_INTERVAL,
+  ARG_BITRATE,
+  ARG_PCR_INTERVAL
 };
 
 #define MPEGTSMUX_DEFAULT_ALIGNMENT    -1
 #define MPEGTSMUX_DEFAULT_M2TS         FALSE
+#define MPEGTSMUX_DEFAULT_BITRATE      0
 
 static GstStaticPadTemplate mpegtsmux_sink_factory =
     GST_STATIC_PAD_TEMPLATE ("sink_%d",
@@ -168,23 +171,25 @@ static gboolean new_packet_m2ts (MpegTsMux * mux, GstBuffer * buf,
     gint64 new_pcr);
 
 static void mpegtsdemux_prepare_srcpad (MpegTsMux * mux);
-GstFlowReturn mpegtsmux_clip_inc_running_time (GstCollectPads * pads,
-    GstCollectData * cdata, GstBuffer * buf, GstBuffer ** outbuf,
-    gpointer user_data);
-static GstFlowReturn mpegtsmux_collected_buffer (GstCollectPads * pads,
-    GstCollectData * data, GstBuffer * buf, MpegTsMux * mux);
-
-static gboolean mpegtsmux_sink_event (GstCollectPads * pads,
-    GstCollectData * data, GstEvent * event, gpointer user_data);
+static GstFlowReturn mpegtsmux_clip_inc_running_time (GstAggregator * agg,
+    GstAggregatorPad * aggpad, GstBuffer * buf, GstBuffer ** outbuf);
+static GstFlowReturn mpegtsmux_aggregate (GstAggregator * agg,
+    gboolean timeout);
+static GstFlowReturn mpegtsmux_write_buffer (MpegTsMux * mux,
+    MpegTsPadData * best, GstBuffer * buf);
+static GstClockTime mpegtsmux_get_next_time (GstAggregator * agg);
+static gboolean mpegtsmux_start (GstAggregator * agg);
+static gboolean mpegtsmux_stop (GstAggregator * agg);
+
+static gboolean mpegtsmux_sink_event (GstAggregator * agg,
+    GstAggregatorPad * aggpad, GstEvent * event);
 static GstPad *mpegtsmux_request_new_pad (GstElement * element,
     GstPadTemplate * templ, const gchar * name, const GstCaps * caps);
 static void mpegtsmux_release_pad (GstElement * element, GstPad * pad);
-static GstStateChangeReturn mpegtsmux_change_state (GstElement * element,
-    GstStateChange transition);
 static gboolean mpegtsmux_send_event (GstElement * element, GstEvent * event);
 static void mpegtsdemux_set_header_on_caps (MpegTsMux * mux);
-static gboolean mpegtsmux_src_event (GstPad * pad, GstObject * parent,
-    GstEvent * event);
+static gboolean mpegtsmux_src_event (GstAggregator * agg, GstEvent * event);
+static void mpegtsmux_pad_reset (MpegTsPadData * pad_data);
 
 #if 0
 static void mpegtsmux_set_index (GstElement * element, GstIndex * index);
@@ -200,10 +205,12 @@ typedef struct
   GstBuffer *buffer;
 } StreamData;
 
-G_DEFINE_TYPE (MpegTsMux, mpegtsmux, GST_TYPE_ELEMENT)
+G_DEFINE_TYPE (MpegTsPadData, mpegtsmux_pad, GST_TYPE_AGGREGATOR_PAD);
+G_DEFINE_TYPE (MpegTsMux, mpegtsmux, GST_TYPE_AGGREGATOR);
 
 /* Takes over the ref on the buffer */
-     static StreamData *stream_data_new (GstBuffer * buffer)
+static StreamData *
+stream_data_new (GstBuffer * buffer)
 {
   StreamData *res = g_new (StreamData, 1);
   res->buffer = buffer;
@@ -224,11 +231,34 @@ stream_data_free (StreamData * data)
 
 #define parent_class mpegtsmux_parent_class
 
+static void
+mpegtsmux_pad_finalize (GObject * object)
+{
+  mpegtsmux_pad_reset (GST_MPEG_TSMUX_PAD (object));
+
+  G_OBJECT_CLASS (mpegtsmux_pad_parent_class)->finalize (object);
+}
+
+static void
+mpegtsmux_pad_class_init (MpegTsPadDataClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+  gobject_class->finalize = mpegtsmux_pad_finalize;
+}
+
+static void
+mpegtsmux_pad_init (MpegTsPadData * pad_data)
+{
+  mpegtsmux_pad_reset (pad_data);
+}
+
 static void
 mpegtsmux_class_init (MpegTsMuxClass * klass)
 {
   GstElementClass *gstelement_class = GST_ELEMENT_CLASS (klass);
   GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstAggregatorClass *gstagg_class = GST_AGGREGATOR_CLASS (klass);
 
   gst_element_class_add_pad_template (gstelement_class,
       gst_static_pad_template_get (&mpegtsmux_sink_factory));
@@ -246,9 +276,17 @@ mpegtsmux_class_init (MpegTsMuxClass * klass)
 
   gstelement_class->request_new_pad = mpegtsmux_request_new_pad;
   gstelement_class->release_pad = mpegtsmux_release_pad;
-  gstelement_class->change_state = mpegtsmux_change_state;
   gstelement_class->send_event = mpegtsmux_send_event;
 
+  gstagg_class->sinkpads_type = GST_TYPE_MPEG_TSMUX_PAD;
+  gstagg_class->aggregate = GST_DEBUG_FUNCPTR (mpegtsmux_aggregate);
+  gstagg_class->clip = GST_DEBUG_FUNCPTR (mpegtsmux_clip_inc_running_time);
+  gstagg_class->sink_event = GST_DEBUG_FUNCPTR (mpegtsmux_sink_event);
+  gstagg_class->src_event = GST_DEBUG_FUNCPTR (mpegtsmux_src_event);
+  gstagg_class->get_next_time = GST_DEBUG_FUNCPTR (mpegtsmux_get_next_time);
+  gstagg_class->start = GST_DEBUG_FUNCPTR (mpegtsmux_start);
+  gstagg_class->stop = GST_DEBUG_FUNCPTR (mpegtsmux_stop);
+
 #if 0
   gstelement_class->set_index = GST_DEBUG_FUNCPTR (mpegtsmux_set_index);
   gstelement_class->get_index = GST_DEBUG_FUNCPTR (mpegtsmux_get_index);
@@ -289,28 +327,25 @@ mpegtsmux_class_init (MpegTsMuxClass * klass)
           "Set the interval (in ticks of the 90kHz clock) for writing out the Service"
           "Information tables", 1, G_MAXUINT, TSMUX_DEFAULT_SI_INTERVAL,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (G_OBJECT_CLASS (klass), ARG_BITRATE,
+      g_param_spec_uint64 ("bitrate", "Bitrate (in bits per second)",
+          "Set the target bitrate, will insert null packets as padding "
+          "and timestamp output buffers for paced sending "
+          "(0 = variable bitrate)", 0, G_MAXUINT64, MPEGTSMUX_DEFAULT_BITRATE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (G_OBJECT_CLASS (klass), ARG_PCR_INTERVAL,
+      g_param_spec_uint ("pcr-interval", "PCR interval",
+          "Set the interval (in ticks of the 90kHz clock) for writing PCR",
+          1, G_MAXUINT, TSMUX_DEFAULT_PCR_INTERVAL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 }
 
 static void
 mpegtsmux_init (MpegTsMux * mux)
 {
-  mux->srcpad =
-      gst_pad_new_from_static_template (&mpegtsmux_src_factory, "src");
-  gst_pad_use_fixed_caps (mux->srcpad);
-  gst_pad_set_event_function (mux->srcpad,
-      GST_DEBUG_FUNCPTR (mpegtsmux_src_event));
-  gst_element_add_pad (GST_ELEMENT (mux), mux->srcpad);
-
-  mux->collect = gst_collect_pads_new ();
-  gst_collect_pads_set_buffer_function (mux->collect,
-      (GstCollectPadsBufferFunction)
-      GST_DEBUG_FUNCPTR (mpegtsmux_collected_buffer), mux);
-
-  gst_collect_pads_set_event_function (mux->collect,
-      (GstCollectPadsEventFunction) GST_DEBUG_FUNCPTR (mpegtsmux_sink_event),
-      mux);
-  gst_collect_pads_set_clip_function (mux->collect, (GstCollectPadsClipFunction)
-      GST_DEBUG_FUNCPTR (mpegtsmux_clip_inc_running_time), mux);
+  gst_pad_use_fixed_caps (GST_AGGREGATOR (mux)->srcpad);
 
   mux->tsmux = tsmux_new ();
   tsmux_set_write_func (mux->tsmux, new_packet_cb, mux);
@@ -323,6 +358,8 @@ mpegtsmux_init (MpegTsMux * mux)
   mux->pat_interval = TSMUX_DEFAULT_PAT_INTERVAL;
   mux->pmt_interval = TSMUX_DEFAULT_PMT_INTERVAL;
   mux->si_interval = TSMUX_DEFAULT_SI_INTERVAL;
+  mux->bitrate = MPEGTSMUX_DEFAULT_BITRATE;
+  mux->pcr_interval = TSMUX_DEFAULT_PCR_INTERVAL;
   mux->prog_map = NULL;
   mux->alignment = MPEGTSMUX_DEFAULT_ALIGNMENT;
 
@@ -333,9 +370,10 @@ mpegtsmux_init (MpegTsMux * mux)
 static void
 mpegtsmux_pad_reset (MpegTsPadData * pad_data)
 {
-  pad_data->pid = 0;
+  /* the PID is given by the pad name and kept across resets */
   pad_data->min_dts = GST_CLOCK_TIME_NONE;
   pad_data->prog_id = -1;
+  pad_data->tstd_errors = 0;
 #if 0
   pad_data->prog_id = -1;
   pad_data->element_index_writer_id = -1;
@@ -361,10 +399,19 @@ mpegtsmux_pad_reset (MpegTsPadData * pad_data)
 
 }
 
+static gboolean
+mpegtsmux_reset_pad (GstAggregator * agg, GstAggregatorPad * aggpad,
+    gpointer user_data)
+{
+  mpegtsmux_pad_reset (MPEG_TS_PAD_DATA (aggpad));
+
+  return TRUE;
+}
+
 static void
 mpegtsmux_reset (MpegTsMux * mux, gboolean alloc)
 {
-  GSList *walk;
+  GList *released;
 
   mux->first = TRUE;
   mux->last_flow_ret = GST_FLOW_OK;
@@ -412,17 +459,22 @@ mpegtsmux_reset (MpegTsMux * mux, gboolean alloc)
   gst_event_replace (&mux->force_key_unit_event, NULL);
   gst_buffer_replace (&mux->out_buffer, NULL);
 
-  if (mux->collect) {
-    GST_COLLECT_PADS_STREAM_LOCK (mux->collect);
-    for (walk = mux->collect->data; walk != NULL; walk = g_slist_next (walk))
-      mpegtsmux_pad_reset ((MpegTsPadData *) walk->data);
-    GST_COLLECT_PADS_STREAM_UNLOCK (mux->collect);
-  }
+  /* the streams of released pads went away with the muxer */
+  GST_OBJECT_LOCK (mux);
+  released = mux->released_pads;
+  mux->released_pads = NULL;
+  GST_OBJECT_UNLOCK (mux);
+  g_list_free_full (released, gst_object_unref);
+
+  gst_aggregator_iterate_sinkpads (GST_AGGREGATOR (mux), mpegtsmux_reset_pad,
+      NULL);
 
   if (alloc) {
     mux->tsmux = tsmux_new ();
     tsmux_set_write_func (mux->tsmux, new_packet_cb, mux);
     tsmux_set_alloc_func (mux->tsmux, alloc_packet_cb, mux);
+    tsmux_set_bitrate (mux->tsmux, mux->bitrate);
+    tsmux_set_pcr_interval (mux->tsmux, mux->pcr_interval);
   }
 }
 
@@ -441,10 +493,6 @@ mpegtsmux_dispose (GObject * object)
     g_object_unref (mux->out_adapter);
     mux->out_adapter = NULL;
   }
-  if (mux->collect) {
-    gst_object_unref (mux->collect);
-    mux->collect = NULL;
-  }
   if (mux->prog_map) {
     gst_structure_free (mux->prog_map);
     mux->prog_map = NULL;
@@ -452,12 +500,23 @@ mpegtsmux_dispose (GObject * object)
   GST_CALL_PARENT (G_OBJECT_CLASS, dispose, (object));
 }
 
+static gboolean
+mpegtsmux_set_pad_pmt_interval (GstAggregator * agg, GstAggregatorPad * aggpad,
+    gpointer user_data)
+{
+  MpegTsPadData *ts_data = MPEG_TS_PAD_DATA (aggpad);
+
+  if (ts_data->prog)
+    tsmux_set_pmt_interval (ts_data->prog, GST_MPEG_TSMUX (agg)->pmt_interval);
+
+  return TRUE;
+}
+
 static void
 gst_mpegtsmux_set_property (GObject * object, guint prop_id,
     const GValue * value, GParamSpec * pspec)
 {
   MpegTsMux *mux = GST_MPEG_TSMUX (object);
-  GSList *walk;
 
   switch (prop_id) {
     case ARG_M2TS_MODE:
@@ -482,15 +541,9 @@ gst_mpegtsmux_set_property (GObject * object, guint prop_id,
         tsmux_set_pat_interval (mux->tsmux, mux->pat_interval);
       break;
     case ARG_PMT_INTERVAL:
-      walk = mux->collect->data;
       mux->pmt_interval = g_value_get_uint (value);
-
-      while (walk) {
-        MpegTsPadData *ts_data = (MpegTsPadData *) walk->data;
-
-        tsmux_set_pmt_interval (ts_data->prog, mux->pmt_interval);
-        walk = g_slist_next (walk);
-      }
+      gst_aggregator_iterate_sinkpads (GST_AGGREGATOR (mux),
+          mpegtsmux_set_pad_pmt_interval, NULL);
       break;
     case ARG_ALIGNMENT:
       mux->alignment = g_value_get_int (value);
@@ -499,6 +552,16 @@ gst_mpegtsmux_set_property (GObject * object, guint prop_id,
       mux->si_interval = g_value_get_uint (value);
       tsmux_set_si_interval (mux->tsmux, mux->si_interval);
       break;
+    case ARG_BITRATE:
+      mux->bitrate = g_value_get_uint64 (value);
+      if (mux->tsmux)
+        tsmux_set_bitrate (mux->tsmux, mux->bitrate);
+      break;
+    case ARG_PCR_INTERVAL:
+      mux->pcr_interval = g_value_get_uint (value);
+      if (mux->tsmux)
+        tsmux_set_pcr_interval (mux->tsmux, mux->pcr_interval);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -530,6 +593,12 @@ gst_mpegtsmux_get_property (GObject * object, guint prop_id,
     case ARG_SI_INTERVAL:
       g_value_set_uint (value, mux->si_interval);
       break;
+    case ARG_BITRATE:
+      g_value_set_uint64 (value, mux->bitrate);
+      break;
+    case ARG_PCR_INTERVAL:
+      g_value_set_uint (value, mux->pcr_interval);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -586,7 +655,7 @@ mpegtsmux_create_stream (MpegTsMux * mux, MpegTsPadData * ts_data)
   const GValue *value = NULL;
   GstBuffer *codec_data = NULL;
 
-  pad = ts_data->collect.pad;
+  pad = GST_PAD (ts_data);
   caps = gst_pad_get_current_caps (pad);
   if (caps == NULL)
     goto not_negotiated;
@@ -730,92 +799,129 @@ not_negotiated:
   }
 }
 
-static GstFlowReturn
-mpegtsmux_create_streams (MpegTsMux * mux)
+static gboolean
+mpegtsmux_create_pad_stream (GstAggregator * agg, GstAggregatorPad * aggpad,
+    gpointer user_data)
 {
-  GstFlowReturn ret = GST_FLOW_OK;
-  GSList *walk = mux->collect->data;
-
-  /* Create the streams */
-  while (walk) {
-    GstCollectData *c_data = (GstCollectData *) walk->data;
-    MpegTsPadData *ts_data = (MpegTsPadData *) walk->data;
-    gchar *name = NULL;
-
-    walk = g_slist_next (walk);
-
-    if (ts_data->prog_id == -1) {
-      name = GST_PAD_NAME (c_data->pad);
-      if (mux->prog_map != NULL && gst_structure_has_field (mux->prog_map,
-              name)) {
-        gint idx;
-        gboolean ret = gst_structure_get_int (mux->prog_map, name, &idx);
-        if (!ret) {
-          GST_ELEMENT_ERROR (mux, STREAM, MUX,
-              ("Reading program map failed. Assuming default"), (NULL));
-          idx = DEFAULT_PROG_ID;
-        }
-        if (idx < 0 || idx >= MAX_PROG_NUMBER) {
-          GST_DEBUG_OBJECT (mux, "Program number %d associate with pad %s out "
-              "of range (max = %d); DEFAULT_PROGRAM = %d is used instead",
-              idx, name, MAX_PROG_NUMBER, DEFAULT_PROG_ID);
-          idx = DEFAULT_PROG_ID;
-        }
-        ts_data->prog_id = idx;
-      } else {
-        ts_data->prog_id = DEFAULT_PROG_ID;
-      }
-    }
+  MpegTsMux *mux = GST_MPEG_TSMUX (agg);
+  MpegTsPadData *ts_data = MPEG_TS_PAD_DATA (aggpad);
+  GstFlowReturn *ret = (GstFlowReturn *) user_data;
+  GstBuffer *buf;
+  gchar *name = NULL;
 
-    ts_data->prog = mux->programs[ts_data->prog_id];
-    if (ts_data->prog == NULL) {
-      ts_data->prog = tsmux_program_new (mux->tsmux, ts_data->prog_id);
-      if (ts_data->prog == NULL)
-        goto no_program;
-      tsmux_set_pmt_interval (ts_data->prog, mux->pmt_interval);
-      mux->programs[ts_data->prog_id] = ts_data->prog;
-    }
+  if (ts_data->stream != NULL)
+    return TRUE;
 
-    if (ts_data->stream == NULL) {
-      ret = mpegtsmux_create_stream (mux, ts_data);
-      if (ret != GST_FLOW_OK)
-        goto no_stream;
+  /* Pads without data yet (e.g. requested while running) get their stream
+   * once they have something to mux */
+  buf = gst_aggregator_pad_get_buffer (aggpad);
+  if (buf == NULL)
+    return TRUE;
+  gst_buffer_unref (buf);
+
+  if (ts_data->prog_id == -1) {
+    name = GST_PAD_NAME (aggpad);
+    if (mux->prog_map != NULL && gst_structure_has_field (mux->prog_map, name)) {
+      gint idx;
+
+      if (!gst_structure_get_int (mux->prog_map, name, &idx)) {
+        GST_ELEMENT_ERROR (mux, STREAM, MUX,
+            ("Reading program map failed. Assuming default"), (NULL));
+        idx = DEFAULT_PROG_ID;
+      }
+      if (idx < 0 || idx >= MAX_PROG_NUMBER) {
+        GST_DEBUG_OBJECT (mux, "Program number %d associate with pad %s out "
+            "of range (max = %d); DEFAULT_PROGRAM = %d is used instead",
+            idx, name, MAX_PROG_NUMBER, DEFAULT_PROG_ID);
+        idx = DEFAULT_PROG_ID;
+      }
+      ts_data->prog_id = idx;
+    } else {
+      ts_data->prog_id = DEFAULT_PROG_ID;
     }
   }
 
-  return GST_FLOW_OK;
+  ts_data->prog = mux->programs[ts_data->prog_id];
+  if (ts_data->prog == NULL) {
+    ts_data->prog = tsmux_program_new (mux->tsmux, ts_data->prog_id);
+    if (ts_data->prog == NULL)
+      goto no_program;
+    tsmux_set_pmt_interval (ts_data->prog, mux->pmt_interval);
+    mux->programs[ts_data->prog_id] = ts_data->prog;
+  }
+
+  *ret = mpegtsmux_create_stream (mux, ts_data);
+  if (*ret != GST_FLOW_OK)
+    goto no_stream;
+
+  return TRUE;
 
   /* ERRORS */
 no_program:
   {
     GST_ELEMENT_ERROR (mux, STREAM, MUX,
         ("Could not create new program"), (NULL));
-    return GST_FLOW_ERROR;
+    *ret = GST_FLOW_ERROR;
+    return FALSE;
   }
 no_stream:
   {
     GST_ELEMENT_ERROR (mux, STREAM, MUX,
         ("Could not create handler for stream"), (NULL));
-    return ret;
+    return FALSE;
   }
 }
 
+/* Create the streams of all the pads that have data queued */
+static GstFlowReturn
+mpegtsmux_create_streams (MpegTsMux * mux)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+
+  gst_aggregator_iterate_sinkpads (GST_AGGREGATOR (mux),
+      mpegtsmux_create_pad_stream, &ret);
+
+  return ret;
+}
+
+/* Drop the streams of the pads released since the last call, from the
+ * streaming thread so that they are never removed while being muxed */
+static void
+mpegtsmux_remove_released_streams (MpegTsMux * mux)
+{
+  GList *released, *walk;
+
+  GST_OBJECT_LOCK (mux);
+  released = mux->released_pads;
+  mux->released_pads = NULL;
+  GST_OBJECT_UNLOCK (mux);
+
+  for (walk = released; walk; walk = walk->next) {
+    MpegTsPadData *ts_data = MPEG_TS_PAD_DATA (walk->data);
 
-#define COLLECT_DATA_PAD(collect_data) (((GstCollectData *)(collect_data))->pad)
+    if (ts_data->stream) {
+      GST_DEBUG_OBJECT (mux, "Removing stream with PID 0x%04x", ts_data->pid);
+      tsmux_remove_stream (mux->tsmux, ts_data->stream);
+      ts_data->stream = NULL;
+    }
+    ts_data->prog = NULL;
+  }
+  g_list_free_full (released, gst_object_unref);
+}
 
 static gboolean
-mpegtsmux_sink_event (GstCollectPads * pads, GstCollectData * data,
-    GstEvent * event, gpointer user_data)
+mpegtsmux_sink_event (GstAggregator * agg, GstAggregatorPad * aggpad,
+    GstEvent * event)
 {
-  MpegTsMux *mux = GST_MPEG_TSMUX (user_data);
+  MpegTsMux *mux = GST_MPEG_TSMUX (agg);
   gboolean res = FALSE;
   gboolean forward = TRUE;
-  MpegTsPadData *pad_data = (MpegTsPadData *) data;
+  MpegTsPadData *pad_data = MPEG_TS_PAD_DATA (aggpad);
 
 #ifndef GST_DISABLE_GST_DEBUG
   GstPad *pad;
 
-  pad = data->pad;
+  pad = GST_PAD (aggpad);
 #endif
 
   switch (GST_EVENT_TYPE (event)) {
@@ -837,17 +943,18 @@ mpegtsmux_sink_event (GstCollectPads * pads, GstCollectData * data,
           "seqnum %d, running-time %" GST_TIME_FORMAT " count %d",
           gst_event_get_seqnum (event), GST_TIME_ARGS (running_time), count);
 
+      if (!all_headers)
+        goto out;
+
+      GST_OBJECT_LOCK (mux);
       if (mux->force_key_unit_event != NULL) {
         GST_INFO_OBJECT (mux, "skipping downstream force key unit event "
             "as an upstream force key unit is already queued");
-        goto out;
+      } else {
+        mux->pending_key_unit_ts = running_time;
+        gst_event_replace (&mux->force_key_unit_event, event);
       }
-
-      if (!all_headers)
-        goto out;
-
-      mux->pending_key_unit_ts = running_time;
-      gst_event_replace (&mux->force_key_unit_event, event);
+      GST_OBJECT_UNLOCK (mux);
       break;
     }
     case GST_EVENT_TAG:{
@@ -871,7 +978,7 @@ mpegtsmux_sink_event (GstCollectPads * pads, GstCollectData * data,
         g_free (lang);
       }
 
-      /* handled this, don't want collectpads to forward it downstream */
+      /* handled this, only global tags are forwarded downstream */
       res = TRUE;
       forward = gst_tag_list_get_scope (list) == GST_TAG_SCOPE_GLOBAL;
       break;
@@ -884,15 +991,15 @@ out:
   if (!forward)
     gst_event_unref (event);
   else
-    res = gst_collect_pads_event_default (pads, data, event, FALSE);
+    res = GST_AGGREGATOR_CLASS (parent_class)->sink_event (agg, aggpad, event);
 
   return res;
 }
 
 static gboolean
-mpegtsmux_src_event (GstPad * pad, GstObject * parent, GstEvent * event)
+mpegtsmux_src_event (GstAggregator * agg, GstEvent * event)
 {
-  MpegTsMux *mux = GST_MPEG_TSMUX (gst_pad_get_parent (pad));
+  MpegTsMux *mux = GST_MPEG_TSMUX (agg);
   gboolean res = TRUE, forward = TRUE;
 
   switch (GST_EVENT_TYPE (event)) {
@@ -922,8 +1029,10 @@ mpegtsmux_src_event (GstPad * pad, GstObject * parent, GstEvent * event)
       if (!all_headers)
         break;
 
+      GST_OBJECT_LOCK (mux);
       mux->pending_key_unit_ts = running_time;
       gst_event_replace (&mux->force_key_unit_event, event);
+      GST_OBJECT_UNLOCK (mux);
 
       iter = gst_element_iterate_sink_pads (GST_ELEMENT_CAST (mux));
       done = FALSE;
@@ -937,7 +1046,7 @@ mpegtsmux_src_event (GstPad * pad, GstObject * parent, GstEvent * event)
             done = TRUE;
             break;
           case GST_ITERATOR_OK:
-            GST_INFO_OBJECT (pad, "forwarding");
+            GST_INFO_OBJECT (sinkpad, "forwarding");
             tmp = gst_pad_push_event (sinkpad, gst_event_ref (event));
             GST_INFO_OBJECT (mux, "result %d", tmp);
             /* succeed if at least one pad succeeds */
@@ -960,11 +1069,10 @@ mpegtsmux_src_event (GstPad * pad, GstObject * parent, GstEvent * event)
   }
 
   if (forward)
-    res = gst_pad_event_default (pad, parent, event);
+    res = GST_AGGREGATOR_CLASS (parent_class)->src_event (agg, event);
   else
     gst_event_unref (event);
 
-  gst_object_unref (mux);
   return res;
 }
 
@@ -1016,12 +1124,11 @@ out:
   return event;
 }
 
-GstFlowReturn
-mpegtsmux_clip_inc_running_time (GstCollectPads * pads,
-    GstCollectData * cdata, GstBuffer * buf, GstBuffer ** outbuf,
-    gpointer user_data)
+static GstFlowReturn
+mpegtsmux_clip_inc_running_time (GstAggregator * agg,
+    GstAggregatorPad * aggpad, GstBuffer * buf, GstBuffer ** outbuf)
 {
-  MpegTsPadData *pad_data = (MpegTsPadData *) cdata;
+  MpegTsPadData *pad_data = MPEG_TS_PAD_DATA (aggpad);
   GstClockTime time;
 
   *outbuf = buf;
@@ -1031,14 +1138,14 @@ mpegtsmux_clip_inc_running_time (GstCollectPads * pads,
 
   /* invalid left alone and passed */
   if (G_LIKELY (GST_CLOCK_TIME_IS_VALID (time))) {
-    time = gst_segment_to_running_time (&cdata->segment, GST_FORMAT_TIME, time);
+    time = gst_segment_to_running_time (&aggpad->segment, GST_FORMAT_TIME, time);
     if (G_UNLIKELY (!GST_CLOCK_TIME_IS_VALID (time))) {
-      GST_DEBUG_OBJECT (cdata->pad, "clipping buffer on pad outside segment");
+      GST_DEBUG_OBJECT (aggpad, "clipping buffer on pad outside segment");
       gst_buffer_unref (buf);
       *outbuf = NULL;
       goto beach;
     } else {
-      GST_LOG_OBJECT (cdata->pad, "buffer pts %" GST_TIME_FORMAT " -> %"
+      GST_LOG_OBJECT (aggpad, "buffer pts %" GST_TIME_FORMAT " -> %"
           GST_TIME_FORMAT " running time",
           GST_TIME_ARGS (GST_BUFFER_TIMESTAMP (buf)), GST_TIME_ARGS (time));
       buf = *outbuf = gst_buffer_make_writable (buf);
@@ -1051,18 +1158,18 @@ mpegtsmux_clip_inc_running_time (GstCollectPads * pads,
 
   /* invalid left alone and passed */
   if (G_LIKELY (GST_CLOCK_TIME_IS_VALID (time))) {
-    time = gst_segment_to_running_time (&cdata->segment, GST_FORMAT_TIME, time);
+    time = gst_segment_to_running_time (&aggpad->segment, GST_FORMAT_TIME, time);
     /* may have to decode out-of-segment, so pass INVALID */
     if (G_UNLIKELY (!GST_CLOCK_TIME_IS_VALID (time))) {
-      GST_DEBUG_OBJECT (cdata->pad, "running dts outside segment");
+      GST_DEBUG_OBJECT (aggpad, "running dts outside segment");
     } else {
-      GST_LOG_OBJECT (cdata->pad, "buffer dts %" GST_TIME_FORMAT " -> %"
+      GST_LOG_OBJECT (aggpad, "buffer dts %" GST_TIME_FORMAT " -> %"
           GST_TIME_FORMAT " running time",
           GST_TIME_ARGS (GST_BUFFER_TIMESTAMP (buf)), GST_TIME_ARGS (time));
       if (GST_CLOCK_TIME_IS_VALID (pad_data->min_dts) &&
           time < pad_data->min_dts) {
         /* Ignore DTS going backward */
-        GST_WARNING_OBJECT (cdata->pad, "ignoring DTS going backward");
+        GST_WARNING_OBJECT (aggpad, "ignoring DTS going backward");
         time = pad_data->min_dts;
       }
       buf = *outbuf = gst_buffer_make_writable (buf);
@@ -1070,106 +1177,184 @@ mpegtsmux_clip_inc_running_time (GstCollectPads * pads,
     }
   }
 
-  buf = *outbuf;
-  if (pad_data->prepare_func) {
-    MpegTsMux *mux = (MpegTsMux *) user_data;
-
-    *outbuf = pad_data->prepare_func (buf, pad_data, mux);
-    g_assert (*outbuf);
-    gst_buffer_unref (buf);
-  }
-
 beach:
   return GST_FLOW_OK;
 }
 
-static GstFlowReturn
-mpegtsmux_collected_buffer (GstCollectPads * pads, GstCollectData * data,
-    GstBuffer * buf, MpegTsMux * mux)
+typedef struct
 {
-  GstFlowReturn ret = GST_FLOW_OK;
-  MpegTsPadData *best = (MpegTsPadData *) data;
-  TsMuxProgram *prog;
-  gint64 pts = -1;
-  guint64 dts = -1;
-  gboolean delta = TRUE;
-  StreamData *stream_data;
+  MpegTsPadData *best;
+  GstClockTime best_ts;
+  gboolean all_eos;
+} MpegTsMuxBestPad;
 
-  GST_DEBUG_OBJECT (mux, "Pads collected");
+/* Pick the pad with the earliest (running time) buffer, buffers without
+ * timestamp go first */
+static gboolean
+mpegtsmux_find_best_pad (GstAggregator * agg, GstAggregatorPad * aggpad,
+    gpointer user_data)
+{
+  MpegTsMuxBestPad *data = (MpegTsMuxBestPad *) user_data;
+  GstBuffer *buf;
+  GstClockTime ts;
 
-  if (G_UNLIKELY (mux->first)) {
-    ret = mpegtsmux_create_streams (mux);
-    if (G_UNLIKELY (ret != GST_FLOW_OK))
-      return ret;
+  buf = gst_aggregator_pad_get_buffer (aggpad);
+  if (buf == NULL) {
+    if (!aggpad->eos)
+      data->all_eos = FALSE;
+    return TRUE;
+  }
 
-    mpegtsdemux_prepare_srcpad (mux);
+  data->all_eos = FALSE;
+  ts = GST_BUFFER_DTS (buf);
+  if (!GST_CLOCK_TIME_IS_VALID (ts))
+    ts = GST_BUFFER_PTS (buf);
+  gst_buffer_unref (buf);
 
-    mux->first = FALSE;
+  if (data->best == NULL || (GST_CLOCK_TIME_IS_VALID (data->best_ts) &&
+          (!GST_CLOCK_TIME_IS_VALID (ts) || ts < data->best_ts))) {
+    gst_object_replace ((GstObject **) & data->best, GST_OBJECT (aggpad));
+    data->best_ts = ts;
   }
 
-  if (G_UNLIKELY (best == NULL)) {
+  return TRUE;
+}
+
+/* In live mode, the running time after which we stop waiting for the
+ * missing streams and mux what we have */
+static GstClockTime
+mpegtsmux_get_next_time (GstAggregator * agg)
+{
+  MpegTsMuxBestPad data = { NULL, GST_CLOCK_TIME_NONE, TRUE };
+
+  gst_aggregator_iterate_sinkpads (agg, mpegtsmux_find_best_pad, &data);
+  if (data.best == NULL)
+    return GST_CLOCK_TIME_NONE;
+
+  gst_object_unref (data.best);
+  return data.best_ts;
+}
+
+static GstFlowReturn
+mpegtsmux_aggregate (GstAggregator * agg, gboolean timeout)
+{
+  MpegTsMux *mux = GST_MPEG_TSMUX (agg);
+  MpegTsMuxBestPad data = { NULL, GST_CLOCK_TIME_NONE, TRUE };
+  MpegTsPadData *best;
+  GstFlowReturn ret;
+  GstBuffer *buf;
+
+  mpegtsmux_remove_released_streams (mux);
+
+  gst_aggregator_iterate_sinkpads (agg, mpegtsmux_find_best_pad, &data);
+  best = data.best;
+
+  if (best == NULL) {
+    if (!data.all_eos)
+      return GST_FLOW_OK;
+
     /* EOS */
     /* drain some possibly cached data */
     new_packet_m2ts (mux, NULL, -1);
-    mpegtsmux_push_packets (mux, TRUE);
-    gst_pad_push_event (mux->srcpad, gst_event_new_eos ());
+    ret = mpegtsmux_push_packets (mux, TRUE);
+
+    return ret == GST_FLOW_OK ? GST_FLOW_EOS : ret;
+  }
+
+  if (timeout)
+    GST_DEBUG_OBJECT (mux, "Timed out, muxing without waiting for all pads");
+
+  ret = mpegtsmux_create_streams (mux);
+  if (G_UNLIKELY (ret != GST_FLOW_OK))
+    goto done;
+
+  if (G_UNLIKELY (mux->first)) {
+    mpegtsdemux_prepare_srcpad (mux);
+    mux->first = FALSE;
+  }
 
-    return GST_FLOW_OK;
+  buf = gst_aggregator_pad_steal_buffer (GST_AGGREGATOR_PAD (best));
+  if (G_UNLIKELY (buf == NULL))
+    goto done;
+
+  if (best->prepare_func) {
+    GstBuffer *prepared = best->prepare_func (buf, best, mux);
+
+    g_assert (prepared);
+    gst_buffer_unref (buf);
+    buf = prepared;
   }
 
+  ret = mpegtsmux_write_buffer (mux, best, buf);
+
+done:
+  gst_object_unref (best);
+  return ret;
+}
+
+static GstFlowReturn
+mpegtsmux_write_buffer (MpegTsMux * mux, MpegTsPadData * best,
+    GstBuffer * buf)
+{
+  TsMuxProgram *prog;
+  gint64 pts = -1;
+  guint64 dts = -1;
+  gboolean delta = TRUE;
+  StreamData *stream_data;
+  GstEvent *event = NULL;
+
   prog = best->prog;
   if (prog == NULL)
     goto no_program;
 
-  g_assert (buf != NULL);
-
+  GST_OBJECT_LOCK (mux);
   if (mux->force_key_unit_event != NULL && best->stream->is_video_stream) {
-    GstEvent *event;
-
     event = check_pending_key_unit_event (mux->force_key_unit_event,
-        &best->collect.segment, GST_BUFFER_TIMESTAMP (buf),
+        &GST_AGGREGATOR_PAD (best)->segment, GST_BUFFER_TIMESTAMP (buf),
         GST_BUFFER_FLAGS (buf), mux->pending_key_unit_ts);
     if (event) {
-      GstClockTime running_time;
-      guint count;
-      GList *cur;
-
       mux->pending_key_unit_ts = GST_CLOCK_TIME_NONE;
       gst_event_replace (&mux->force_key_unit_event, NULL);
+    }
+  }
+  GST_OBJECT_UNLOCK (mux);
 
-      gst_video_event_parse_downstream_force_key_unit (event,
-          NULL, NULL, &running_time, NULL, &count);
+  if (event) {
+    GstClockTime running_time;
+    guint count;
+    GList *cur;
 
-      GST_INFO_OBJECT (mux, "pushing downstream force-key-unit event %d "
-          "%" GST_TIME_FORMAT " count %d", gst_event_get_seqnum (event),
-          GST_TIME_ARGS (running_time), count);
-      gst_pad_push_event (mux->srcpad, event);
+    gst_video_event_parse_downstream_force_key_unit (event,
+        NULL, NULL, &running_time, NULL, &count);
 
-      /* output PAT */
-      mux->tsmux->last_pat_ts = -1;
+    GST_INFO_OBJECT (mux, "pushing downstream force-key-unit event %d "
+        "%" GST_TIME_FORMAT " count %d", gst_event_get_seqnum (event),
+        GST_TIME_ARGS (running_time), count);
+    gst_pad_push_event (GST_AGGREGATOR (mux)->srcpad, event);
 
-      /* output PMT for each program */
-      for (cur = mux->tsmux->programs; cur; cur = cur->next) {
-        TsMuxProgram *program = (TsMuxProgram *) cur->data;
+    /* output PAT */
+    mux->tsmux->last_pat_ts = -1;
 
-        program->last_pmt_ts = -1;
-      }
-      tsmux_program_set_pcr_stream (prog, NULL);
+    /* output PMT for each program */
+    for (cur = mux->tsmux->programs; cur; cur = cur->next) {
+      TsMuxProgram *program = (TsMuxProgram *) cur->data;
+
+      program->last_pmt_ts = -1;
     }
+    tsmux_program_set_pcr_stream (prog, NULL);
   }
 
   if (G_UNLIKELY (prog->pcr_stream == NULL)) {
     /* Take the first data stream for the PCR */
-    GST_DEBUG_OBJECT (COLLECT_DATA_PAD (best),
+    GST_DEBUG_OBJECT (best,
         "Use stream (pid=%d) from pad as PCR for program (prog_id = %d)",
-        MPEG_TS_PAD_DATA (best)->pid, MPEG_TS_PAD_DATA (best)->prog_id);
+        best->pid, best->prog_id);
 
     /* Set the chosen PCR stream */
     tsmux_program_set_pcr_stream (prog, best->stream);
   }
 
-  GST_DEBUG_OBJECT (COLLECT_DATA_PAD (best),
-      "Chose stream for output (PID: 0x%04x)", best->pid);
+  GST_DEBUG_OBJECT (best, "Chose stream for output (PID: 0x%04x)", best->pid);
 
   if (GST_CLOCK_TIME_IS_VALID (GST_BUFFER_PTS (buf))) {
     pts = GSTTIME_TO_MPEGTIME (GST_BUFFER_PTS (buf));
@@ -1227,6 +1412,19 @@ mpegtsmux_collected_buffer (GstCollectPads * pads, GstCollectData * data,
       goto write_fail;
     }
   }
+  if (G_UNLIKELY (best->stream->tstd_underflows + best->stream->tstd_overflows
+          != best->tstd_errors)) {
+    /* Only post a message for the first error of each stream */
+    if (best->tstd_errors == 0)
+      GST_ELEMENT_WARNING (mux, STREAM, MUX,
+          ("Stream %04x does not comply with the T-STD buffer model, "
+              "the bitrate might be too low", best->stream->pi.pid),
+          ("%u underflows, %u overflows", best->stream->tstd_underflows,
+              best->stream->tstd_overflows));
+    best->tstd_errors =
+        best->stream->tstd_underflows + best->stream->tstd_overflows;
+  }
+
   /* flush packet cache */
   return mpegtsmux_push_packets (mux, FALSE);
 
@@ -1237,10 +1435,10 @@ write_fail:
   }
 no_program:
   {
+    gst_buffer_unref (buf);
     GST_ELEMENT_ERROR (mux, STREAM, MUX,
         ("Stream on pad %" GST_PTR_FORMAT
-            " is not associated with any program", COLLECT_DATA_PAD (best)),
-        (NULL));
+            " is not associated with any program", best), (NULL));
     return GST_FLOW_ERROR;
   }
 }
@@ -1263,16 +1461,11 @@ mpegtsmux_request_new_pad (GstElement * element, GstPadTemplate * templ,
   }
 
   pad_name = g_strdup_printf ("sink_%d", pid);
-  pad = gst_pad_new_from_template (templ, pad_name);
+  pad = g_object_new (GST_TYPE_MPEG_TSMUX_PAD, "name", pad_name,
+      "direction", GST_PAD_SINK, "template", templ, NULL);
   g_free (pad_name);
 
-  pad_data = (MpegTsPadData *)
-      gst_collect_pads_add_pad (mux->collect, pad, sizeof (MpegTsPadData),
-      (GstCollectDataDestroyNotify) (mpegtsmux_pad_reset), TRUE);
-  if (pad_data == NULL)
-    goto pad_failure;
-
-  mpegtsmux_pad_reset (pad_data);
+  pad_data = MPEG_TS_PAD_DATA (pad);
   pad_data->pid = pid;
 
   if (G_UNLIKELY (!gst_element_add_pad (element, pad)))
@@ -1291,14 +1484,6 @@ could_not_add:
   {
     GST_ELEMENT_ERROR (element, STREAM, FAILED,
         ("Internal data stream error."), ("Could not add pad to element"));
-    gst_collect_pads_remove_pad (mux->collect, pad);
-    gst_object_unref (pad);
-    return NULL;
-  }
-pad_failure:
-  {
-    GST_ELEMENT_ERROR (element, STREAM, FAILED,
-        ("Internal data stream error."), ("Could not add pad to collectpads"));
     gst_object_unref (pad);
     return NULL;
   }
@@ -1311,12 +1496,15 @@ mpegtsmux_release_pad (GstElement * element, GstPad * pad)
 
   GST_DEBUG_OBJECT (mux, "Pad %" GST_PTR_FORMAT " being released", pad);
 
-  if (mux->collect) {
-    gst_collect_pads_remove_pad (mux->collect, pad);
-  }
+  /* the streaming thread might be muxing data of this pad right now, its
+   * stream is removed from there */
+  GST_OBJECT_LOCK (mux);
+  mux->released_pads = g_list_prepend (mux->released_pads,
+      gst_object_ref (pad));
+  GST_OBJECT_UNLOCK (mux);
 
   /* chain up */
-  gst_element_remove_pad (element, pad);
+  GST_ELEMENT_CLASS (parent_class)->release_pad (element, pad);
 }
 
 static void
@@ -1392,7 +1580,7 @@ mpegtsmux_push_packets (MpegTsMux * mux, gboolean force)
     g_assert (buf);
     GST_BUFFER_PTS (buf) = ts;
 
-    ret = gst_pad_push (mux->srcpad, buf);
+    ret = gst_aggregator_finish_buffer (GST_AGGREGATOR (mux), buf);
     av = av % align;
   }
 
@@ -1441,7 +1629,7 @@ mpegtsmux_push_packets (MpegTsMux * mux, gboolean force)
 
     gst_buffer_unmap (buf, &map);
 
-    ret = gst_pad_push (mux->srcpad, buf);
+    ret = gst_aggregator_finish_buffer (GST_AGGREGATOR (mux), buf);
   }
 
   return ret;
@@ -1595,7 +1783,10 @@ new_packet_cb (GstBuffer * buf, void *user_data, gint64 new_pcr)
     memmove (map.data + offset, map.data, map.size - offset);
   }
 
-  GST_BUFFER_PTS (buf) = mux->last_ts;
+  /* In constant bitrate mode, packets are timestamped with their sending
+   * time already */
+  if (!GST_BUFFER_PTS_IS_VALID (buf))
+    GST_BUFFER_PTS (buf) = mux->last_ts;
   /* do common init (flags and streamheaders) */
   new_packet_common_init (mux, buf, map.data + offset, map.size);
 
@@ -1637,7 +1828,8 @@ mpegtsdemux_set_header_on_caps (MpegTsMux * mux)
   GstCaps *caps;
   GList *sh;
 
-  caps = gst_caps_make_writable (gst_pad_get_current_caps (mux->srcpad));
+  caps = gst_caps_make_writable (gst_pad_get_current_caps (GST_AGGREGATOR
+          (mux)->srcpad));
   structure = gst_caps_get_structure (caps, 0);
 
   g_value_init (&array, GST_TYPE_ARRAY);
@@ -1656,7 +1848,7 @@ mpegtsdemux_set_header_on_caps (MpegTsMux * mux)
   mux->streamheader = NULL;
 
   gst_structure_set_value (structure, "streamheader", &array);
-  gst_pad_set_caps (mux->srcpad, caps);
+  gst_aggregator_set_src_caps (GST_AGGREGATOR (mux), caps);
   g_value_unset (&array);
   gst_caps_unref (caps);
 }
@@ -1664,70 +1856,41 @@ mpegtsdemux_set_header_on_caps (MpegTsMux * mux)
 static void
 mpegtsdemux_prepare_srcpad (MpegTsMux * mux)
 {
-  GstSegment seg;
-  /* we are not going to seek */
-  GstEvent *new_seg;
-  gchar s_id[32];
   GstCaps *caps = gst_caps_new_simple ("video/mpegts",
       "systemstream", G_TYPE_BOOLEAN, TRUE,
       "packetsize", G_TYPE_INT,
       (mux->m2ts_mode ? M2TS_PACKET_LENGTH : NORMAL_TS_PACKET_LENGTH),
       NULL);
 
-  /* stream-start (FIXME: create id based on input ids) */
-  g_snprintf (s_id, sizeof (s_id), "mpegtsmux-%08x", g_random_int ());
-  gst_pad_push_event (mux->srcpad, gst_event_new_stream_start (s_id));
-
-  gst_segment_init (&seg, GST_FORMAT_TIME);
-  new_seg = gst_event_new_segment (&seg);
-
-  /* Set caps on src pad from our template and push new segment */
-  gst_pad_set_caps (mux->srcpad, caps);
+  /* stream-start and the (time) segment are sent by the base class */
+  gst_aggregator_set_src_caps (GST_AGGREGATOR (mux), caps);
   gst_caps_unref (caps);
-
-  if (!gst_pad_push_event (mux->srcpad, new_seg)) {
-    GST_WARNING_OBJECT (mux, "New segment event was not handled downstream");
-  }
 }
 
-static GstStateChangeReturn
-mpegtsmux_change_state (GstElement * element, GstStateChange transition)
+static gboolean
+mpegtsmux_start (GstAggregator * agg)
 {
-  MpegTsMux *mux = GST_MPEG_TSMUX (element);
-  GstStateChangeReturn ret;
+  MpegTsMux *mux = GST_MPEG_TSMUX (agg);
+  GstClockTime latency = 0;
 
-  switch (transition) {
-    case GST_STATE_CHANGE_NULL_TO_READY:
-      break;
-    case GST_STATE_CHANGE_READY_TO_PAUSED:
-      gst_collect_pads_start (mux->collect);
-      break;
-    case GST_STATE_CHANGE_PAUSED_TO_PLAYING:
-      break;
-    case GST_STATE_CHANGE_PAUSED_TO_READY:
-      gst_collect_pads_stop (mux->collect);
-      break;
-    case GST_STATE_CHANGE_READY_TO_NULL:
-      break;
-    default:
-      break;
-  }
+  /* In m2ts mode, packets are held back until the next PCR to interpolate
+   * their timestamp header */
+  if (mux->m2ts_mode)
+    latency = MPEGTIME_TO_GSTTIME (mux->pcr_interval);
 
-  ret = GST_ELEMENT_CLASS (parent_class)->change_state (element, transition);
+  GST_DEBUG_OBJECT (mux, "reporting latency %" GST_TIME_FORMAT,
+      GST_TIME_ARGS (latency));
+  gst_aggregator_set_latency (agg, latency, latency);
 
-  switch (transition) {
-    case GST_STATE_CHANGE_PLAYING_TO_PAUSED:
-      break;
-    case GST_STATE_CHANGE_PAUSED_TO_READY:
-      mpegtsmux_reset (mux, TRUE);
-      break;
-    case GST_STATE_CHANGE_READY_TO_NULL:
-      break;
-    default:
-      break;
-  }
+  return TRUE;
+}
 
-  return ret;
+static gboolean
+mpegtsmux_stop (GstAggregator * agg)
+{
+  mpegtsmux_reset (GST_MPEG_TSMUX (agg), TRUE);
+
+  return TRUE;
 }
 
 static gboolean
@@ -1739,10 +1902,10 @@ mpegtsmux_send_event (GstElement * element, GstEvent * event)
   g_return_val_if_fail (event != NULL, FALSE);
 
   section = gst_event_parse_mpegts_section (event);
-  gst_event_unref (event);
 
   if (section) {
     GST_DEBUG ("Received event with mpegts section");
+    gst_event_unref (event);
 
     /* TODO: Check that the section type is supported */
     tsmux_add_mpegts_si_section (mux->tsmux, section);
@@ -1750,7 +1913,7 @@ mpegtsmux_send_event (GstElement * element, GstEvent * event)
     return TRUE;
   }
 
-  return FALSE;
+  return GST_ELEMENT_CLASS (parent_class)->send_event (element, event);
 }
 
 static gboolean
@@ -84,8 +84,8 @@
 #define __MPEGTSMUX_H__
 
 #include <gst/gst.h>
-#include <gst/base/gstcollectpads.h>
 #include <gst/base/gstadapter.h>
+#include <gst/base/gstaggregator.h>
 
 G_BEGIN_DECLS
 
@@ -94,6 +94,9 @@ G_BEGIN_DECLS
 #define GST_TYPE_MPEG_TSMUX  (mpegtsmux_get_type())
 #define GST_MPEG_TSMUX(obj)  (G_TYPE_CHECK_INSTANCE_CAST((obj), GST_TYPE_MPEG_TSMUX, MpegTsMux))
 
+#define GST_TYPE_MPEG_TSMUX_PAD  (mpegtsmux_pad_get_type())
+#define GST_MPEG_TSMUX_PAD(obj)  (G_TYPE_CHECK_INSTANCE_CAST((obj), GST_TYPE_MPEG_TSMUX_PAD, MpegTsPadData))
+
 #define CLOCK_BASE 9LL
 #define CLOCK_FREQ (CLOCK_BASE * 10000)   /* 90 kHz PTS clock */
 #define CLOCK_FREQ_SCR (CLOCK_FREQ * 300) /* 27 MHz SCR clock */
@@ -118,6 +121,7 @@ G_BEGIN_DECLS
 typedef struct MpegTsMux MpegTsMux;
 typedef struct MpegTsMuxClass MpegTsMuxClass;
 typedef struct MpegTsPadData MpegTsPadData;
+typedef struct MpegTsPadDataClass MpegTsPadDataClass;
 
 typedef GstBuffer * (*MpegTsPadDataPrepareFunction) (GstBuffer * buf,
     MpegTsPadData * data, MpegTsMux * mux);
@@ -125,11 +129,7 @@ typedef GstBuffer * (*MpegTsPadDataPrepareFunction) (GstBuffer * buf,
 typedef void (*MpegTsPadDataFreePrepareDataFunction) (gpointer prepare_data);
 
 struct MpegTsMux {
-  GstElement parent;
-
-  GstPad *srcpad;
-
-  GstCollectPads *collect;
+  GstAggregator parent;
 
   TsMux *tsmux;
   TsMuxProgram *programs[MAX_PROG_NUMBER];
@@ -141,9 +141,14 @@ struct MpegTsMux {
   guint pmt_interval;
   gint alignment;
   guint si_interval;
+  guint64 bitrate;
+  guint pcr_interval;
 
   /* state */
   gboolean first;
+  /* pads released while running, their stream is removed from the
+   * streaming thread (protected by the object lock) */
+  GList *released_pads;
   GstClockTime pending_key_unit_ts;
   GstEvent *force_key_unit_event;
 
@@ -173,14 +178,14 @@ struct MpegTsMux {
 };
 
 struct MpegTsMuxClass {
-  GstElementClass parent_class;
+  GstAggregatorClass parent_class;
 };
 
 #define MPEG_TS_PAD_DATA(data)  ((MpegTsPadData *)(data))
 
 struct MpegTsPadData {
   /* parent */
-  GstCollectData collect;
+  GstAggregatorPad parent;
 
   gint pid;
   TsMuxStream *stream;
@@ -210,9 +215,17 @@ struct MpegTsPadData {
   TsMuxProgram *prog;
 
   gchar *language;
+
+  /* number of T-STD buffer errors already reported */
+  guint tstd_errors;
+};
+
+struct MpegTsPadDataClass {
+  GstAggregatorPadClass parent_class;
 };
 
 GType mpegtsmux_get_type (void);
+GType mpegtsmux_pad_get_type (void);
 
 
 G_END_DECLS
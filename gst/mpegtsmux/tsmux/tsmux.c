@@ -106,13 +106,16 @@
  * 1/8 second atm */
 #define TSMUX_PCR_OFFSET (TSMUX_CLOCK_FREQ / 8)
 
-/* Times per second to write PCR */
-#define TSMUX_DEFAULT_PCR_FREQ (25)
-
 /* Base for all written PCR and DTS/PTS,
  * so we have some slack to go backwards */
 #define CLOCK_BASE (TSMUX_CLOCK_FREQ * 10 * 360)
 
+#define TSMUX_NULL_PID 0x1FFF
+
+/* Largest gap (in 27MHz units) stuffed with null packets in constant bitrate
+ * mode, bigger ones are considered timestamp discontinuities */
+#define TSMUX_MAX_PAD_GAP TSMUX_SYS_CLOCK_FREQ
+
 static gboolean tsmux_write_pat (TsMux * mux);
 static gboolean tsmux_write_pmt (TsMux * mux, TsMuxProgram * program);
 static void
@@ -150,6 +153,11 @@ tsmux_new (void)
   mux->last_si_ts = -1;
   mux->si_interval = TSMUX_DEFAULT_SI_INTERVAL;
 
+  mux->pcr_interval = TSMUX_DEFAULT_PCR_INTERVAL;
+  mux->bitrate = 0;
+  mux->n_bytes = 0;
+  mux->first_pcr = -1;
+
   mux->si_sections = g_hash_table_new_full (g_direct_hash, g_direct_equal,
       NULL, (GDestroyNotify) tsmux_section_free);
 
@@ -228,6 +236,73 @@ tsmux_get_pat_interval (TsMux * mux)
   return mux->pat_interval;
 }
 
+/**
+ * tsmux_set_pcr_interval:
+ * @mux: a #TsMux
+ * @freq: a new PCR interval
+ *
+ * Set the maximum interval (in cycles of the 90kHz clock) between two PCRs
+ * of a program.
+ */
+void
+tsmux_set_pcr_interval (TsMux * mux, guint freq)
+{
+  g_return_if_fail (mux != NULL);
+
+  mux->pcr_interval = freq;
+}
+
+/**
+ * tsmux_get_pcr_interval:
+ * @mux: a #TsMux
+ *
+ * Get the configured PCR interval. See also tsmux_set_pcr_interval().
+ *
+ * Returns: the configured PCR interval
+ */
+guint
+tsmux_get_pcr_interval (TsMux * mux)
+{
+  g_return_val_if_fail (mux != NULL, 0);
+
+  return mux->pcr_interval;
+}
+
+/**
+ * tsmux_set_bitrate:
+ * @mux: a #TsMux
+ * @bitrate: the mux rate in bits per second, or 0
+ *
+ * Set a constant mux rate for the output. Packets are then scheduled on a
+ * constant rate timeline: null packets are inserted when no data is due
+ * yet, PCR reflect the position of the packet on that timeline and
+ * output buffers are timestamped with the time they should be sent at.
+ * 0 disables this, packets are output as soon as data is available.
+ */
+void
+tsmux_set_bitrate (TsMux * mux, guint64 bitrate)
+{
+  g_return_if_fail (mux != NULL);
+
+  mux->bitrate = bitrate;
+}
+
+/**
+ * tsmux_get_bitrate:
+ * @mux: a #TsMux
+ *
+ * Get the configured mux rate. See also tsmux_set_bitrate().
+ *
+ * Returns: the configured mux rate in bits per second, 0 if disabled
+ */
+guint64
+tsmux_get_bitrate (TsMux * mux)
+{
+  g_return_val_if_fail (mux != NULL, 0);
+
+  return mux->bitrate;
+}
+
 /**
  * tsmux_set_si_interval:
  * @mux: a #TsMux
@@ -470,6 +545,62 @@ tsmux_program_set_pcr_stream (TsMuxProgram * program, TsMuxStream * stream)
   program->pmt_changed = TRUE;
 }
 
+/**
+ * tsmux_program_remove_stream:
+ * @program: a #TsMuxProgram
+ * @stream: a #TsMuxStream
+ *
+ * Remove @stream from @program. When @stream carries the PCR of @program,
+ * the program is left without PCR stream.
+ *
+ * Returns: TRUE if @stream was part of @program.
+ */
+gboolean
+tsmux_program_remove_stream (TsMuxProgram * program, TsMuxStream * stream)
+{
+  guint i;
+
+  g_return_val_if_fail (program != NULL, FALSE);
+  g_return_val_if_fail (stream != NULL, FALSE);
+
+  for (i = 0; i < program->streams->len; i++) {
+    if (g_array_index (program->streams, TsMuxStream *, i) == stream) {
+      g_array_remove_index (program->streams, i);
+      if (program->pcr_stream == stream)
+        tsmux_program_set_pcr_stream (program, NULL);
+      program->pmt_changed = TRUE;
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+/**
+ * tsmux_remove_stream:
+ * @mux: a #TsMux
+ * @stream: a #TsMuxStream
+ *
+ * Remove @stream from the programs it belongs to and from @mux, and free it.
+ * Pending data of @stream is released without being written.
+ */
+void
+tsmux_remove_stream (TsMux * mux, TsMuxStream * stream)
+{
+  GList *cur;
+
+  g_return_if_fail (mux != NULL);
+  g_return_if_fail (stream != NULL);
+
+  for (cur = mux->programs; cur; cur = cur->next)
+    tsmux_program_remove_stream ((TsMuxProgram *) cur->data, stream);
+
+  mux->streams = g_list_remove (mux->streams, stream);
+  mux->nb_streams--;
+
+  tsmux_stream_free (stream);
+}
+
 /**
  * tsmux_get_new_pid:
  * @mux: a #TsMux
@@ -582,9 +713,28 @@ tsmux_get_buffer (TsMux * mux, GstBuffer ** buf)
   return TRUE;
 }
 
+/* Time (in 27MHz units) at which the next packet goes out, in
+ * constant bitrate mode */
+static inline gint64
+tsmux_get_current_pcr (TsMux * mux)
+{
+  return mux->first_pcr + gst_util_uint64_scale (mux->n_bytes,
+      8 * TSMUX_SYS_CLOCK_FREQ, mux->bitrate);
+}
+
 static gboolean
 tsmux_packet_out (TsMux * mux, GstBuffer * buf, gint64 pcr)
 {
+  if (mux->bitrate && mux->first_pcr != -1) {
+    gint64 cur_pcr = tsmux_get_current_pcr (mux);
+
+    /* Timestamp the packet with its sending time */
+    if (buf && cur_pcr >= CLOCK_BASE * 300)
+      GST_BUFFER_PTS (buf) = gst_util_uint64_scale (cur_pcr - CLOCK_BASE * 300,
+          GST_SECOND, TSMUX_SYS_CLOCK_FREQ);
+    mux->n_bytes += TSMUX_PACKET_LENGTH;
+  }
+
   if (G_UNLIKELY (mux->write_func == NULL)) {
     if (buf)
       gst_buffer_unref (buf);
@@ -942,6 +1092,122 @@ fail:
   return FALSE;
 }
 
+static gboolean
+tsmux_write_null_packet (TsMux * mux)
+{
+  GstBuffer *buf = NULL;
+  GstMapInfo map;
+
+  if (!tsmux_get_buffer (mux, &buf))
+    return FALSE;
+
+  gst_buffer_map (buf, &map, GST_MAP_WRITE);
+  map.data[0] = TSMUX_SYNC_BYTE;
+  map.data[1] = TSMUX_NULL_PID >> 8;
+  map.data[2] = TSMUX_NULL_PID & 0xff;
+  /* payload only, continuity counter is not checked */
+  map.data[3] = 0x10;
+  memset (map.data + TSMUX_HEADER_LENGTH, 0xff, TSMUX_PAYLOAD_LENGTH);
+  gst_buffer_unmap (buf, &map);
+
+  return tsmux_packet_out (mux, buf, -1);
+}
+
+/* Writes a packet with only an adaptation field carrying the current PCR
+ * on the PID of @stream */
+static gboolean
+tsmux_write_pcr_packet (TsMux * mux, TsMuxStream * stream)
+{
+  TsMuxPacketInfo pi = { 0, };
+  guint payload_len, payload_offs;
+  GstBuffer *buf = NULL;
+  GstMapInfo map;
+  gboolean res;
+
+  pi.pid = stream->pi.pid;
+  /* No payload, the packet repeats the continuity counter of the last
+   * payload packet. stream->pi.packet_count is already the next one */
+  pi.packet_count = (stream->pi.packet_count - 1) & 0x0f;
+  pi.flags = TSMUX_PACKET_FLAG_ADAPTATION | TSMUX_PACKET_FLAG_WRITE_PCR;
+  pi.pcr = tsmux_get_current_pcr (mux);
+  pi.stream_avail = 0;
+
+  if (!tsmux_get_buffer (mux, &buf))
+    return FALSE;
+
+  gst_buffer_map (buf, &map, GST_MAP_WRITE);
+  res = tsmux_write_ts_header (map.data, &pi, &payload_len, &payload_offs);
+  gst_buffer_unmap (buf, &map);
+
+  if (!res) {
+    gst_buffer_unref (buf);
+    return FALSE;
+  }
+
+  stream->last_pcr = pi.pcr;
+
+  return tsmux_packet_out (mux, buf, pi.pcr);
+}
+
+/* In constant bitrate mode, writes PCR-only packets for the programs
+ * whose PCR is due and whose PCR stream is not @stream */
+static gboolean
+tsmux_write_pending_pcrs (TsMux * mux, TsMuxStream * stream)
+{
+  gint64 interval = mux->pcr_interval *
+      (TSMUX_SYS_CLOCK_FREQ / TSMUX_CLOCK_FREQ);
+  GList *cur;
+
+  for (cur = mux->programs; cur; cur = cur->next) {
+    TsMuxProgram *program = (TsMuxProgram *) cur->data;
+    TsMuxStream *pcr_stream = program->pcr_stream;
+
+    if (pcr_stream == NULL || pcr_stream == stream)
+      continue;
+
+    if (pcr_stream->last_pcr != -1 &&
+        tsmux_get_current_pcr (mux) - pcr_stream->last_pcr < interval)
+      continue;
+
+    if (!tsmux_write_pcr_packet (mux, pcr_stream))
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* In constant bitrate mode, stuffs the output until @pcr (in 27MHz units)
+ * is reached, keeping the PCR interval */
+static gboolean
+tsmux_pad_until (TsMux * mux, gint64 pcr)
+{
+  gint64 gap = pcr - tsmux_get_current_pcr (mux);
+  guint n_null = 0;
+
+  /* Don't stuff through a timestamp jump, move the timeline to it */
+  if (G_UNLIKELY (gap > TSMUX_MAX_PAD_GAP)) {
+    GST_WARNING ("Timestamp jump of %" G_GINT64_FORMAT " (27MHz units), "
+        "resyncing the PCR", gap);
+    mux->first_pcr += gap;
+    return TRUE;
+  }
+
+  while (tsmux_get_current_pcr (mux) < pcr) {
+    if (!tsmux_write_pending_pcrs (mux, NULL))
+      return FALSE;
+    if (tsmux_get_current_pcr (mux) >= pcr)
+      break;
+    if (!tsmux_write_null_packet (mux))
+      return FALSE;
+    n_null++;
+  }
+
+  if (n_null)
+    TS_DEBUG ("Wrote %u null packets", n_null);
+
+  return TRUE;
+}
+
 static gboolean
 tsmux_write_si (TsMux * mux)
 {
@@ -976,6 +1242,37 @@ tsmux_write_stream_packet (TsMux * mux, TsMuxStream * stream)
   g_return_val_if_fail (mux != NULL, FALSE);
   g_return_val_if_fail (stream != NULL, FALSE);
 
+  pi->packet_start_unit_indicator = tsmux_stream_at_pes_start (stream);
+  if (pi->packet_start_unit_indicator) {
+    tsmux_stream_initialize_pes_packet (stream);
+    if (stream->dts != -1)
+      stream->dts += CLOCK_BASE;
+    if (stream->pts != -1)
+      stream->pts += CLOCK_BASE;
+  }
+
+  if (mux->bitrate) {
+    gint64 cur_ts = stream->dts != -1 ? stream->dts : stream->pts;
+
+    /* The constant rate timeline starts with the first timestamped data */
+    if (mux->first_pcr == -1) {
+      if (cur_ts == -1)
+        cur_ts = CLOCK_BASE;
+      mux->first_pcr = (cur_ts - TSMUX_PCR_OFFSET) *
+          (TSMUX_SYS_CLOCK_FREQ / TSMUX_CLOCK_FREQ);
+      TS_DEBUG ("First PCR %" G_GINT64_FORMAT, mux->first_pcr);
+    }
+
+    /* Send the data at the same offset from its decoding time as in
+     * variable bitrate mode, stuffing until then */
+    if (cur_ts != -1 && !tsmux_pad_until (mux, (cur_ts - TSMUX_PCR_OFFSET) *
+            (TSMUX_SYS_CLOCK_FREQ / TSMUX_CLOCK_FREQ)))
+      return FALSE;
+
+    if (!tsmux_write_pending_pcrs (mux, stream))
+      return FALSE;
+  }
+
   if (tsmux_stream_is_pcr (stream)) {
     gint64 cur_pts = tsmux_stream_get_pts (stream);
     gboolean write_pat;
@@ -989,7 +1286,11 @@ tsmux_write_stream_packet (TsMux * mux, TsMuxStream * stream)
 
     /* FIXME: The current PCR needs more careful calculation than just
      * writing a fixed offset */
-    if (cur_pts != -1) {
+    if (mux->bitrate) {
+      /* Position on the constant rate timeline, updated below once the
+       * tables were written */
+      cur_pcr = tsmux_get_current_pcr (mux);
+    } else if (cur_pts != -1) {
       /* CLOCK_BASE >= TSMUX_PCR_OFFSET */
       cur_pts += CLOCK_BASE;
       cur_pcr = (cur_pts - TSMUX_PCR_OFFSET) *
@@ -999,7 +1300,7 @@ tsmux_write_stream_packet (TsMux * mux, TsMuxStream * stream)
     /* Need to decide whether to write a new PCR in this packet */
     if (stream->last_pcr == -1 ||
         (cur_pcr - stream->last_pcr >
-            (TSMUX_SYS_CLOCK_FREQ / TSMUX_DEFAULT_PCR_FREQ))) {
+            mux->pcr_interval * (TSMUX_SYS_CLOCK_FREQ / TSMUX_CLOCK_FREQ))) {
 
       stream->pi.flags |=
           TSMUX_PACKET_FLAG_ADAPTATION | TSMUX_PACKET_FLAG_WRITE_PCR;
@@ -1055,16 +1356,14 @@ tsmux_write_stream_packet (TsMux * mux, TsMuxStream * stream)
           return FALSE;
       }
     }
-  }
 
-  pi->packet_start_unit_indicator = tsmux_stream_at_pes_start (stream);
-  if (pi->packet_start_unit_indicator) {
-    tsmux_stream_initialize_pes_packet (stream);
-    if (stream->dts != -1)
-      stream->dts += CLOCK_BASE;
-    if (stream->pts != -1)
-      stream->pts += CLOCK_BASE;
+    if (mux->bitrate && cur_pcr != -1) {
+      cur_pcr = tsmux_get_current_pcr (mux);
+      stream->pi.pcr = cur_pcr;
+      stream->last_pcr = cur_pcr;
+    }
   }
+
   pi->stream_avail = tsmux_stream_bytes_avail (stream);
 
   /* obtain buffer */
@@ -1076,6 +1375,9 @@ tsmux_write_stream_packet (TsMux * mux, TsMuxStream * stream)
   if (!tsmux_write_ts_header (map.data, pi, &payload_len, &payload_offs))
     goto fail;
 
+  if (mux->bitrate)
+    tsmux_stream_tstd_add_bytes (stream, tsmux_get_current_pcr (mux),
+        payload_len, pi->packet_start_unit_indicator);
 
   if (!tsmux_stream_get_data (stream, map.data + payload_offs, payload_len))
     goto fail;
@@ -169,6 +169,16 @@ struct TsMux {
   /* last time SIT written in MPEG PTS clock time */
   gint64   last_si_ts;
 
+  /* interval between PCR in MPEG PTS clock time */
+  guint    pcr_interval;
+
+  /* constant mux rate in bits per second, 0 for variable bitrate */
+  guint64  bitrate;
+  /* number of bytes written since the first PCR (in CBR mode) */
+  guint64  n_bytes;
+  /* PCR of the first byte written (in CBR mode), -1 if not known yet */
+  gint64   first_pcr;
+
   /* callback to write finished packet */
   TsMuxWriteFunc write_func;
   void *write_func_data;
@@ -190,6 +200,10 @@ void 		tsmux_set_alloc_func 		(TsMux *mux, TsMuxAllocFunc func, void *user_data)
 void 		tsmux_set_pat_interval          (TsMux *mux, guint interval);
 guint 		tsmux_get_pat_interval          (TsMux *mux);
 guint16		tsmux_get_new_pid 		(TsMux *mux);
+void 		tsmux_set_pcr_interval          (TsMux *mux, guint interval);
+guint 		tsmux_get_pcr_interval          (TsMux *mux);
+void 		tsmux_set_bitrate               (TsMux *mux, guint64 bitrate);
+guint64 	tsmux_get_bitrate               (TsMux *mux);
 
 /* pid/program management */
 TsMuxProgram *	tsmux_program_new 		(TsMux *mux, gint prog_id);
@@ -205,9 +219,11 @@ gboolean        tsmux_add_mpegts_si_section     (TsMux * mux, GstMpegtsSection *
 /* stream management */
 TsMuxStream *	tsmux_create_stream 		(TsMux *mux, TsMuxStreamType stream_type, guint16 pid, gchar *language);
 TsMuxStream *	tsmux_find_stream 		(TsMux *mux, guint16 pid);
+void 		tsmux_remove_stream 		(TsMux *mux, TsMuxStream *stream);
 
 void 		tsmux_program_add_stream 	(TsMuxProgram *program, TsMuxStream *stream);
 void 		tsmux_program_set_pcr_stream 	(TsMuxProgram *program, TsMuxStream *stream);
+gboolean 	tsmux_program_remove_stream 	(TsMuxProgram *program, TsMuxStream *stream);
 
 /* writing stuff */
 gboolean 	tsmux_write_stream_packet 	(TsMux *mux, TsMuxStream *stream);
@@ -111,6 +111,41 @@ struct TsMuxStreamBuffer
   void *user_data;
 };
 
+/* PES packet in the T-STD buffer */
+typedef struct
+{
+  /* decoding time, in 27MHz units */
+  gint64 dts;
+  guint32 size;
+  /* TRUE if it was not complete at its decoding time */
+  gboolean late;
+} TsMuxStreamTStdUnit;
+
+/* Size of the T-STD elementary stream buffer for @stream_type, 0 for
+ * stream types which are not checked. Video sizes are for the highest
+ * profiles/levels we can produce (MPEG-2 MP@HL VBV, H.264 level 4 CPB),
+ * audio ones are the BSn values of ISO/IEC 13818-1 and ATSC A/52 */
+static guint32
+tsmux_stream_tstd_buffer_size (TsMuxStreamType stream_type)
+{
+  switch (stream_type) {
+    case TSMUX_ST_VIDEO_MPEG1:
+    case TSMUX_ST_VIDEO_MPEG2:
+      return 9781248 / 8;
+    case TSMUX_ST_VIDEO_MPEG4:
+    case TSMUX_ST_VIDEO_H264:
+      return 30000000 / 8;
+    case TSMUX_ST_AUDIO_MPEG1:
+    case TSMUX_ST_AUDIO_MPEG2:
+    case TSMUX_ST_AUDIO_AAC:
+      return 3584;
+    case TSMUX_ST_PS_AUDIO_AC3:
+      return 5696;
+    default:
+      return 0;
+  }
+}
+
 /**
  * tsmux_stream_new:
  * @pid: a PID
@@ -201,6 +236,9 @@ tsmux_stream_new (guint16 pid, TsMuxStreamType stream_type)
   stream->pcr_ref = 0;
   stream->last_pcr = -1;
 
+  stream->tstd_size = tsmux_stream_tstd_buffer_size (stream_type);
+  g_queue_init (&stream->tstd_units);
+
   return stream;
 }
 
@@ -243,6 +281,9 @@ tsmux_stream_free (TsMuxStream * stream)
   }
   g_list_free (stream->buffers);
 
+  while (!g_queue_is_empty (&stream->tstd_units))
+    g_slice_free (TsMuxStreamTStdUnit, g_queue_pop_head (&stream->tstd_units));
+
   g_slice_free (TsMuxStream, stream);
 }
 
@@ -960,3 +1001,66 @@ tsmux_stream_get_pts (TsMuxStream * stream)
 
   return stream->last_pts;
 }
+
+/**
+ * tsmux_stream_tstd_add_bytes:
+ * @stream: a #TsMuxStream
+ * @pcr: the time at which the bytes enter the decoder, in 27MHz units
+ * @len: the number of bytes
+ * @pes_start: whether the bytes start a new PES packet
+ *
+ * Update the T-STD buffer model of @stream with @len bytes of the current
+ * PES packet arriving at @pcr. PES packets are removed from the buffer at
+ * their DTS. An underflow is counted when a PES packet is still not
+ * completely received at its decoding time, an overflow when the buffer
+ * holds more than its size.
+ */
+void
+tsmux_stream_tstd_add_bytes (TsMuxStream * stream, gint64 pcr, guint len,
+    gboolean pes_start)
+{
+  TsMuxStreamTStdUnit *unit;
+
+  g_return_if_fail (stream != NULL);
+
+  if (stream->tstd_size == 0)
+    return;
+
+  /* Remove what was decoded by now */
+  while ((unit = g_queue_peek_head (&stream->tstd_units)) && unit->dts <= pcr) {
+    if (!pes_start && unit == g_queue_peek_tail (&stream->tstd_units)) {
+      /* Still receiving the PES packet which should be decoded already */
+      if (!unit->late) {
+        GST_WARNING ("PID 0x%04x: T-STD buffer underflow, PES packet late "
+            "by %" G_GINT64_FORMAT " (27MHz)", stream->pi.pid, pcr - unit->dts);
+        unit->late = TRUE;
+        stream->tstd_underflows++;
+      }
+      break;
+    }
+    stream->tstd_fill -= unit->size;
+    g_slice_free (TsMuxStreamTStdUnit, g_queue_pop_head (&stream->tstd_units));
+  }
+
+  unit = g_queue_peek_tail (&stream->tstd_units);
+
+  /* PES packets without timestamp are decoded with the previous one */
+  if (pes_start && (stream->dts != -1 || stream->pts != -1)) {
+    unit = g_slice_new0 (TsMuxStreamTStdUnit);
+    unit->dts = (stream->dts != -1 ? stream->dts : stream->pts) *
+        (TSMUX_SYS_CLOCK_FREQ / TSMUX_CLOCK_FREQ);
+    g_queue_push_tail (&stream->tstd_units, unit);
+  }
+
+  if (unit == NULL)
+    return;
+
+  unit->size += len;
+  if (stream->tstd_fill <= stream->tstd_size &&
+      stream->tstd_fill + len > stream->tstd_size) {
+    GST_WARNING ("PID 0x%04x: T-STD buffer overflow, %u bytes in a %u bytes "
+        "buffer", stream->pi.pid, stream->tstd_fill + len, stream->tstd_size);
+    stream->tstd_overflows++;
+  }
+  stream->tstd_fill += len;
+}
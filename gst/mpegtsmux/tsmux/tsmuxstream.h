@@ -206,6 +206,16 @@ struct TsMuxStream {
 
   gboolean is_dvb_sub;
   gchar language[4];
+
+  /* T-STD buffer model, only checked in constant bitrate mode.
+   * Size of the buffer in bytes (0 if not checked), its current fullness
+   * and the PES packets in it waiting for their decoding time */
+  guint32 tstd_size;
+  guint32 tstd_fill;
+  GQueue tstd_units;
+  /* number of detected buffer underflows/overflows */
+  guint tstd_underflows;
+  guint tstd_overflows;
 };
 
 /* stream management */
@@ -237,6 +247,9 @@ gboolean 	tsmux_stream_get_data 		(TsMuxStream *stream, guint8 *buf, guint len);
 
 guint64 	tsmux_stream_get_pts 		(TsMuxStream *stream);
 
+void 		tsmux_stream_tstd_add_bytes 	(TsMuxStream *stream, gint64 pcr, guint len,
+						 gboolean pes_start);
+
 G_END_DECLS
 
 #endif
@@ -0,0 +1,218 @@
+/* GStreamer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Serialization of the buffer metadata that shmsink sends along with
+ * each buffer when "send-meta" is enabled. Both sides run on the same
+ * machine, so the fields are in host byte order.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstshmmeta.h"
+
+#include <gst/video/video.h>
+
+#include <string.h>
+
+#define GST_SHM_META_MAGIC 0x4d534753
+
+/* The buffer flags that are meaningful on the other side */
+#define GST_SHM_META_FLAGS_MASK \
+  (GST_BUFFER_FLAG_LIVE | GST_BUFFER_FLAG_DECODE_ONLY | \
+   GST_BUFFER_FLAG_DISCONT | GST_BUFFER_FLAG_RESYNC | \
+   GST_BUFFER_FLAG_CORRUPTED | GST_BUFFER_FLAG_MARKER | \
+   GST_BUFFER_FLAG_HEADER | GST_BUFFER_FLAG_GAP | \
+   GST_BUFFER_FLAG_DROPPABLE | GST_BUFFER_FLAG_DELTA_UNIT)
+
+typedef struct
+{
+  guint32 magic;
+  guint32 flags;
+
+  guint64 pts;
+  guint64 dts;
+  guint64 duration;
+  guint64 offset;
+  guint64 offset_end;
+
+  /* Size of the caps string that follows, including the terminating
+   * nul, or 0 if the caps are not sent with this buffer */
+  guint32 caps_size;
+
+  /* Number of planes of the GstVideoMeta, or 0 if there is none */
+  guint32 n_planes;
+  guint32 video_flags;
+  guint32 video_format;
+  guint32 width;
+  guint32 height;
+  guint64 plane_offset[GST_VIDEO_MAX_PLANES];
+  gint32 stride[GST_VIDEO_MAX_PLANES];
+} GstShmMetaHeader;
+
+gsize
+gst_shm_meta_get_size (const gchar * caps)
+{
+  gsize size = sizeof (GstShmMetaHeader);
+
+  if (caps)
+    size += strlen (caps) + 1;
+
+  return size;
+}
+
+/* data must be at least gst_shm_meta_get_size() bytes */
+void
+gst_shm_meta_serialize (GstBuffer * buffer, const gchar * caps, guint8 * data)
+{
+  GstShmMetaHeader header;
+  GstVideoMeta *vmeta;
+
+  memset (&header, 0, sizeof (header));
+  header.magic = GST_SHM_META_MAGIC;
+  header.flags = GST_BUFFER_FLAGS (buffer) & GST_SHM_META_FLAGS_MASK;
+  header.pts = GST_BUFFER_PTS (buffer);
+  header.dts = GST_BUFFER_DTS (buffer);
+  header.duration = GST_BUFFER_DURATION (buffer);
+  header.offset = GST_BUFFER_OFFSET (buffer);
+  header.offset_end = GST_BUFFER_OFFSET_END (buffer);
+
+  vmeta = gst_buffer_get_video_meta (buffer);
+  if (vmeta) {
+    guint i;
+
+    header.n_planes = vmeta->n_planes;
+    header.video_flags = vmeta->flags;
+    header.video_format = vmeta->format;
+    header.width = vmeta->width;
+    header.height = vmeta->height;
+    for (i = 0; i < vmeta->n_planes; i++) {
+      header.plane_offset[i] = vmeta->offset[i];
+      header.stride[i] = vmeta->stride[i];
+    }
+  }
+
+  if (caps) {
+    header.caps_size = strlen (caps) + 1;
+    memcpy (data + sizeof (header), caps, header.caps_size);
+  }
+
+  memcpy (data, &header, sizeof (header));
+}
+
+/* Checks that the video meta of @header describes planes that are within
+ * a buffer of @bufsize bytes */
+static gboolean
+gst_shm_meta_check_video (const GstShmMetaHeader * header, gsize bufsize)
+{
+  const GstVideoFormatInfo *finfo;
+  GEnumClass *klass;
+  gboolean known;
+  guint i;
+
+  if (header->n_planes > GST_VIDEO_MAX_PLANES)
+    return FALSE;
+
+  klass = g_type_class_ref (GST_TYPE_VIDEO_FORMAT);
+  known = g_enum_get_value (klass, header->video_format) != NULL;
+  g_type_class_unref (klass);
+
+  if (!known || header->video_format == GST_VIDEO_FORMAT_UNKNOWN ||
+      header->video_format == GST_VIDEO_FORMAT_ENCODED)
+    return FALSE;
+
+  finfo = gst_video_format_get_info (header->video_format);
+  if (GST_VIDEO_FORMAT_INFO_N_PLANES (finfo) != header->n_planes)
+    return FALSE;
+
+  for (i = 0; i < header->n_planes; i++) {
+    if (header->plane_offset[i] >= bufsize || header->stride[i] <= 0)
+      return FALSE;
+  }
+
+  /* Every line of every component must be in the buffer */
+  for (i = 0; i < GST_VIDEO_FORMAT_INFO_N_COMPONENTS (finfo); i++) {
+    guint plane = GST_VIDEO_FORMAT_INFO_PLANE (finfo, i);
+    guint64 height =
+        GST_VIDEO_FORMAT_INFO_SCALE_HEIGHT (finfo, i, header->height);
+
+    if ((guint64) header->stride[plane] * height >
+        bufsize - header->plane_offset[plane])
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Applies the metadata to the buffer, and returns the caps in @caps if
+ * they were sent. Returns FALSE if the metadata is invalid */
+gboolean
+gst_shm_meta_deserialize (const guint8 * data, gsize size, GstBuffer * buffer,
+    gchar ** caps)
+{
+  GstShmMetaHeader header;
+
+  *caps = NULL;
+
+  if (size < sizeof (header))
+    return FALSE;
+
+  /* The data is in memory that the other side can still write to */
+  memcpy (&header, data, sizeof (header));
+
+  if (header.magic != GST_SHM_META_MAGIC)
+    return FALSE;
+
+  if (header.caps_size > size - sizeof (header))
+    return FALSE;
+
+  if (header.n_planes > 0 &&
+      !gst_shm_meta_check_video (&header, gst_buffer_get_size (buffer)))
+    return FALSE;
+
+  if (header.n_planes > 0) {
+    gsize offset[GST_VIDEO_MAX_PLANES] = { 0, };
+    gint stride[GST_VIDEO_MAX_PLANES] = { 0, };
+    guint i;
+
+    for (i = 0; i < header.n_planes; i++) {
+      offset[i] = header.plane_offset[i];
+      stride[i] = header.stride[i];
+    }
+
+    gst_buffer_add_video_meta_full (buffer, header.video_flags,
+        header.video_format, header.width, header.height, header.n_planes,
+        offset, stride);
+  }
+
+  if (header.caps_size > 0) {
+    *caps = g_strndup ((const gchar *) data + sizeof (header),
+        header.caps_size - 1);
+  }
+
+  GST_BUFFER_FLAG_SET (buffer, header.flags & GST_SHM_META_FLAGS_MASK);
+  GST_BUFFER_PTS (buffer) = header.pts;
+  GST_BUFFER_DTS (buffer) = header.dts;
+  GST_BUFFER_DURATION (buffer) = header.duration;
+  GST_BUFFER_OFFSET (buffer) = header.offset;
+  GST_BUFFER_OFFSET_END (buffer) = header.offset_end;
+
+  return TRUE;
+}
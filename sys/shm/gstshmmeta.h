@@ -0,0 +1,33 @@
+/* GStreamer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_SHM_META_H__
+#define __GST_SHM_META_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+gsize gst_shm_meta_get_size (const gchar * caps);
+void gst_shm_meta_serialize (GstBuffer * buffer, const gchar * caps,
+    guint8 * data);
+gboolean gst_shm_meta_deserialize (const guint8 * data, gsize size,
+    GstBuffer * buffer, gchar ** caps);
+
+G_END_DECLS
+#endif /* __GST_SHM_META_H__ */
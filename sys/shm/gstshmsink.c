@@ -28,6 +28,14 @@
  * |[
  * gst-launch -v videotestsrc !  shmsink socket-path=/tmp/blah shm-size=1000000
  * ]| Send video to shm buffers.
+ * |[
+ * gst-launch -v videotestsrc !  shmsink socket-path=/tmp/blah ring-size=64
+ * ]| Send video to shm buffers, passing the buffer descriptors through a
+ * ring in shared memory instead of the control socket.
+ * |[
+ * gst-launch -v videotestsrc !  shmsink socket-path=/tmp/blah send-meta=true
+ * ]| Send video to shm buffers along with their timestamps, caps and video
+ * metadata, for a shmsrc with use-meta=true.
  * </refsect2>
  */
 #ifdef HAVE_CONFIG_H
@@ -35,8 +43,10 @@
 #endif
 
 #include "gstshmsink.h"
+#include "gstshmmeta.h"
 
 #include <gst/gst.h>
+#include <gst/video/video.h>
 
 #include <string.h>
 
@@ -56,7 +66,11 @@ enum
   PROP_PERMS,
   PROP_SHM_SIZE,
   PROP_WAIT_FOR_CONNECTION,
-  PROP_BUFFER_TIME
+  PROP_BUFFER_TIME,
+  PROP_RING_SIZE,
+  PROP_BLOCK_ALIGNMENT,
+  PROP_STATS,
+  PROP_SEND_META
 };
 
 struct GstShmClient
@@ -67,6 +81,12 @@ struct GstShmClient
 
 #define DEFAULT_SIZE ( 64 * 1024 * 1024 )
 #define DEFAULT_WAIT_FOR_CONNECTION (TRUE)
+#define DEFAULT_RING_SIZE 0
+#define DEFAULT_BLOCK_ALIGNMENT SHM_PIPE_DEFAULT_ALIGNMENT
+#define DEFAULT_SEND_META FALSE
+
+/* Buffers with more memories than that are copied */
+#define MAX_EXTENTS 16
 /* Default is user read/write, group read */
 #define DEFAULT_PERMS ( S_IRUSR | S_IWUSR | S_IRGRP )
 
@@ -90,6 +110,7 @@ static void gst_shm_sink_get_property (GObject * object, guint prop_id,
 
 static gboolean gst_shm_sink_start (GstBaseSink * bsink);
 static gboolean gst_shm_sink_stop (GstBaseSink * bsink);
+static gboolean gst_shm_sink_set_caps (GstBaseSink * bsink, GstCaps * caps);
 static GstFlowReturn gst_shm_sink_render (GstBaseSink * bsink, GstBuffer * buf);
 
 static gboolean gst_shm_sink_event (GstBaseSink * bsink, GstEvent * event);
@@ -255,8 +276,10 @@ gst_shm_sink_allocator_alloc_locked (GstShmSinkAllocator * self, gsize size,
 
   /* ensure configured alignment */
   align |= gst_memory_alignment;
-  /* allocate more to compensate for alignment */
-  maxsize += align;
+  /* allocate more to compensate for alignment, unless all blocks are
+   * already aligned enough */
+  if (align >= sp_writer_get_alignment (self->sink->pipe))
+    maxsize += align;
 
   block = sp_writer_alloc_block (self->sink->pipe, maxsize);
   if (block) {
@@ -349,6 +372,9 @@ gst_shm_sink_init (GstShmSink * self)
   self->size = DEFAULT_SIZE;
   self->wait_for_connection = DEFAULT_WAIT_FOR_CONNECTION;
   self->perms = DEFAULT_PERMS;
+  self->ring_size = DEFAULT_RING_SIZE;
+  self->block_alignment = DEFAULT_BLOCK_ALIGNMENT;
+  self->send_meta = DEFAULT_SEND_META;
 
   gst_allocation_params_init (&self->params);
 }
@@ -370,6 +396,7 @@ gst_shm_sink_class_init (GstShmSinkClass * klass)
 
   gstbasesink_class->start = GST_DEBUG_FUNCPTR (gst_shm_sink_start);
   gstbasesink_class->stop = GST_DEBUG_FUNCPTR (gst_shm_sink_stop);
+  gstbasesink_class->set_caps = GST_DEBUG_FUNCPTR (gst_shm_sink_set_caps);
   gstbasesink_class->render = GST_DEBUG_FUNCPTR (gst_shm_sink_render);
   gstbasesink_class->event = GST_DEBUG_FUNCPTR (gst_shm_sink_event);
   gstbasesink_class->unlock = GST_DEBUG_FUNCPTR (gst_shm_sink_unlock);
@@ -411,6 +438,36 @@ gst_shm_sink_class_init (GstShmSinkClass * klass)
           -1, G_MAXINT64, -1,
           G_PARAM_CONSTRUCT | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_RING_SIZE,
+      g_param_spec_uint ("ring-size",
+          "Size of the descriptor ring",
+          "Number of buffers that can be in the ring shared with the "
+          "clients, rounded up to a power of 2 (0 = send the buffers over "
+          "the control socket). This may be modified during the NULL->READY "
+          "transition", 0, 1 << 20, DEFAULT_RING_SIZE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_BLOCK_ALIGNMENT,
+      g_param_spec_uint ("block-alignment",
+          "Alignment of the shm blocks",
+          "Minimum alignment in bytes of the blocks allocated in the shared "
+          "memory area, must be a power of 2. It applies to a new area, or "
+          "to the current one if none of its memory is in use",
+          1, 1 << 20, DEFAULT_BLOCK_ALIGNMENT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_STATS,
+      g_param_spec_boxed ("stats", "Statistics",
+          "Usage and fragmentation statistics of the shared memory area",
+          GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SEND_META,
+      g_param_spec_boolean ("send-meta",
+          "Send the buffer metadata",
+          "Send the timestamps, flags, caps and video metadata of each "
+          "buffer in the shared memory, for a shmsrc with use-meta enabled",
+          DEFAULT_SEND_META, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   signals[SIGNAL_CLIENT_CONNECTED] = g_signal_new ("client-connected",
       GST_TYPE_SHM_SINK, G_SIGNAL_RUN_LAST, 0, NULL, NULL,
       g_cclosure_marshal_VOID__INT, G_TYPE_NONE, 1, G_TYPE_INT);
@@ -438,6 +495,7 @@ gst_shm_sink_finalize (GObject * object)
 
   g_cond_clear (&self->cond);
   g_free (self->socket_path);
+  g_free (self->caps);
 
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
@@ -500,11 +558,65 @@ gst_shm_sink_set_property (GObject * object, guint prop_id,
       GST_OBJECT_UNLOCK (object);
       g_cond_broadcast (&self->cond);
       break;
+    case PROP_RING_SIZE:
+      GST_OBJECT_LOCK (object);
+      self->ring_size = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (object);
+      break;
+    case PROP_BLOCK_ALIGNMENT:{
+      guint alignment = g_value_get_uint (value);
+
+      if (alignment & (alignment - 1)) {
+        GST_WARNING_OBJECT (object, "Block alignment %u is not a power of 2",
+            alignment);
+        break;
+      }
+
+      GST_OBJECT_LOCK (object);
+      self->block_alignment = alignment;
+      if (self->pipe)
+        sp_writer_set_alignment (self->pipe, alignment);
+      GST_OBJECT_UNLOCK (object);
+      break;
+    }
+    case PROP_SEND_META:
+      GST_OBJECT_LOCK (object);
+      self->send_meta = g_value_get_boolean (value);
+      self->send_caps = TRUE;
+      GST_OBJECT_UNLOCK (object);
+      break;
     default:
       break;
   }
 }
 
+/* Must be called with the object lock */
+static GstStructure *
+gst_shm_sink_get_stats (GstShmSink * self)
+{
+  ShmAllocStats stats = { 0, };
+  gdouble fragmentation = 0.0;
+
+  if (self->pipe)
+    sp_writer_get_alloc_stats (self->pipe, &stats);
+
+  /* How much of the free space can't be used for a single allocation */
+  if (stats.free > 0)
+    fragmentation = 1.0 - (gdouble) stats.largest_free / stats.free;
+
+  return gst_structure_new ("application/x-shm-stats",
+      "size", G_TYPE_UINT64, (guint64) stats.size,
+      "alignment", G_TYPE_UINT64, (guint64) stats.alignment,
+      "used", G_TYPE_UINT64, (guint64) stats.used,
+      "requested", G_TYPE_UINT64, (guint64) stats.requested,
+      "free", G_TYPE_UINT64, (guint64) stats.free,
+      "largest-free", G_TYPE_UINT64, (guint64) stats.largest_free,
+      "used-blocks", G_TYPE_UINT64, (guint64) stats.used_blocks,
+      "free-blocks", G_TYPE_UINT64, (guint64) stats.free_blocks,
+      "failed-allocations", G_TYPE_UINT64, (guint64) stats.failed_allocs,
+      "fragmentation", G_TYPE_DOUBLE, fragmentation, NULL);
+}
+
 static void
 gst_shm_sink_get_property (GObject * object, guint prop_id,
     GValue * value, GParamSpec * pspec)
@@ -529,6 +641,18 @@ gst_shm_sink_get_property (GObject * object, guint prop_id,
     case PROP_BUFFER_TIME:
       g_value_set_int64 (value, self->buffer_time);
       break;
+    case PROP_RING_SIZE:
+      g_value_set_uint (value, self->ring_size);
+      break;
+    case PROP_BLOCK_ALIGNMENT:
+      g_value_set_uint (value, self->block_alignment);
+      break;
+    case PROP_STATS:
+      g_value_take_boxed (value, gst_shm_sink_get_stats (self));
+      break;
+    case PROP_SEND_META:
+      g_value_set_boolean (value, self->send_meta);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -564,6 +688,18 @@ gst_shm_sink_start (GstBaseSink * bsink)
     return FALSE;
   }
 
+  if (self->block_alignment != SHM_PIPE_DEFAULT_ALIGNMENT)
+    sp_writer_set_alignment (self->pipe, self->block_alignment);
+
+  if (self->ring_size > 0) {
+    if (sp_writer_enable_ring (self->pipe, self->ring_size) < 0)
+      GST_WARNING_OBJECT (self, "Could not create a ring of %u buffers, "
+          "sending them over the socket", self->ring_size);
+    else
+      GST_DEBUG_OBJECT (self, "Sending buffers through a ring of %u slots",
+          self->ring_size);
+  }
+
   sp_set_data (self->pipe, self);
   g_free (self->socket_path);
   self->socket_path = g_strdup (sp_writer_get_path (self->pipe));
@@ -632,14 +768,79 @@ gst_shm_sink_stop (GstBaseSink * bsink)
   sp_writer_close (self->pipe, NULL, NULL);
   self->pipe = NULL;
 
+  GST_OBJECT_LOCK (self);
+  g_free (self->caps);
+  self->caps = NULL;
+  GST_OBJECT_UNLOCK (self);
+
   return TRUE;
 }
 
+static gboolean
+gst_shm_sink_set_caps (GstBaseSink * bsink, GstCaps * caps)
+{
+  GstShmSink *self = GST_SHM_SINK (bsink);
+  gchar *str = gst_caps_to_string (caps);
+
+  GST_OBJECT_LOCK (self);
+  g_free (self->caps);
+  self->caps = str;
+  self->send_caps = TRUE;
+  GST_OBJECT_UNLOCK (self);
+
+  return TRUE;
+}
+
+static void
+free_buffer_locked (GstBuffer * buffer, void *data)
+{
+  GSList **list = data;
+
+  g_assert (buffer != NULL);
+
+  *list = g_slist_prepend (*list, buffer);
+}
+
+/* Frees the buffers that the clients released through the ring */
+static void
+gst_shm_sink_reclaim (GstShmSink * self)
+{
+  GSList *list = NULL;
+
+  GST_OBJECT_LOCK (self);
+  sp_writer_ring_reclaim (self->pipe,
+      (sp_buffer_free_callback) free_buffer_locked, &list);
+  GST_OBJECT_UNLOCK (self);
+
+  g_slist_free_full (list, (GDestroyNotify) gst_buffer_unref);
+}
+
+/* Waits for the clients to release buffers, must be called with the object
+ * lock, which may be released in the meantime */
+static void
+gst_shm_sink_wait_locked (GstShmSink * self)
+{
+  GSList *list = NULL;
+
+  if (sp_writer_ring_prepare_wait (self->pipe,
+          (sp_buffer_free_callback) free_buffer_locked, &list)) {
+    GST_OBJECT_UNLOCK (self);
+    g_slist_free_full (list, (GDestroyNotify) gst_buffer_unref);
+    GST_OBJECT_LOCK (self);
+    return;
+  }
+
+  g_cond_wait (&self->cond, GST_OBJECT_GET_LOCK (self));
+}
+
 static gboolean
 gst_shm_sink_can_render (GstShmSink * self, GstClockTime time)
 {
   ShmBuffer *b;
 
+  if (sp_writer_ring_is_full (self->pipe))
+    return FALSE;
+
   if (time == GST_CLOCK_TIME_NONE || self->buffer_time == GST_CLOCK_TIME_NONE)
     return TRUE;
 
@@ -653,17 +854,83 @@ gst_shm_sink_can_render (GstShmSink * self, GstClockTime time)
   return TRUE;
 }
 
+/* Allocates a block in the shared memory and serializes the metadata of
+ * buf in it, must be called with the object lock. Returns NULL if the
+ * sink was unlocked while waiting for memory */
+static GstMemory *
+gst_shm_sink_alloc_meta_locked (GstShmSink * self, GstBuffer * buf,
+    gboolean * caps_sent)
+{
+  GstAllocationParams params;
+  GstMemory *memory;
+  GstMapInfo map;
+  const gchar *caps = self->send_caps ? self->caps : NULL;
+
+  gst_allocation_params_init (&params);
+
+  while ((memory =
+          gst_shm_sink_allocator_alloc_locked (self->allocator,
+              gst_shm_meta_get_size (caps), &params)) == NULL) {
+    gst_shm_sink_wait_locked (self);
+    if (self->unlock)
+      return NULL;
+    caps = self->send_caps ? self->caps : NULL;
+  }
+
+  gst_memory_map (memory, &map, GST_MAP_WRITE);
+  gst_shm_meta_serialize (buf, caps, map.data);
+  gst_memory_unmap (memory, &map);
+
+  *caps_sent = (caps != NULL);
+
+  return memory;
+}
+
+/* Whether all the memories of the buffer are in our shared memory area,
+ * so that it can be sent without copying */
+static gboolean
+gst_shm_sink_buffer_is_ours (GstShmSink * self, GstBuffer * buf)
+{
+  guint i, n = gst_buffer_n_memory (buf);
+
+  if (n == 0 || n > MAX_EXTENTS) {
+    GST_LOG_OBJECT (self, "Buffer %p has %u GstMemory, need to do a memcpy",
+        buf, n);
+    return FALSE;
+  }
+
+  for (i = 0; i < n; i++) {
+    GstMemory *memory = gst_buffer_peek_memory (buf, i);
+
+    if (memory->allocator != GST_ALLOCATOR (self->allocator)) {
+      GST_LOG_OBJECT (self, "Memory %u in buffer %p was not allocated by "
+          "%" GST_PTR_FORMAT ", will memcpy", i, buf, memory->allocator);
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
 static GstFlowReturn
 gst_shm_sink_render (GstBaseSink * bsink, GstBuffer * buf)
 {
   GstShmSink *self = GST_SHM_SINK (bsink);
   int rv = 0;
   GstMapInfo map;
+  GstMapInfo maps[MAX_EXTENTS];
+  ShmExtent extents[MAX_EXTENTS];
+  guint i, n_extents;
+  GstMapInfo meta_map = { NULL, };
   gboolean need_new_memory = FALSE;
   GstFlowReturn ret = GST_FLOW_OK;
   GstMemory *memory = NULL;
+  GstMemory *meta_memory = NULL;
+  gboolean caps_sent = FALSE;
   GstBuffer *sendbuf = NULL;
 
+  gst_shm_sink_reclaim (self);
+
   GST_OBJECT_LOCK (self);
   while (self->wait_for_connection && !self->clients) {
     g_cond_wait (&self->cond, GST_OBJECT_GET_LOCK (self));
@@ -672,30 +939,25 @@ gst_shm_sink_render (GstBaseSink * bsink, GstBuffer * buf)
   }
 
   while (!gst_shm_sink_can_render (self, GST_BUFFER_TIMESTAMP (buf))) {
-    g_cond_wait (&self->cond, GST_OBJECT_GET_LOCK (self));
+    gst_shm_sink_wait_locked (self);
     if (self->unlock)
       goto flushing;
   }
 
-
-  if (gst_buffer_n_memory (buf) > 1) {
-    GST_LOG_OBJECT (self, "Buffer %p has %d GstMemory, we only support a single"
-        " one, need to do a memcpy", buf, gst_buffer_n_memory (buf));
-    need_new_memory = TRUE;
-  } else {
-    memory = gst_buffer_peek_memory (buf, 0);
-
-    if (memory->allocator != GST_ALLOCATOR (self->allocator)) {
-      need_new_memory = TRUE;
-      GST_LOG_OBJECT (self, "Memory in buffer %p was not allocated by "
-          "%" GST_PTR_FORMAT ", will memcpy", buf, memory->allocator);
-    }
+  if (self->send_meta) {
+    meta_memory = gst_shm_sink_alloc_meta_locked (self, buf, &caps_sent);
+    if (!meta_memory)
+      goto flushing;
   }
 
+  need_new_memory = !gst_shm_sink_buffer_is_ours (self, buf);
+
   if (need_new_memory) {
     if (gst_buffer_get_size (buf) > sp_writer_get_max_buf_size (self->pipe)) {
       gsize area_size = sp_writer_get_max_buf_size (self->pipe);
       GST_OBJECT_UNLOCK (self);
+      if (meta_memory)
+        gst_memory_unref (meta_memory);
       GST_ELEMENT_ERROR (self, RESOURCE, NO_SPACE_LEFT,
           ("Shared memory area is too small"),
           ("Shared memory area of size %" G_GSIZE_FORMAT " is smaller than"
@@ -707,18 +969,15 @@ gst_shm_sink_render (GstBaseSink * bsink, GstBuffer * buf)
     while ((memory =
             gst_shm_sink_allocator_alloc_locked (self->allocator,
                 gst_buffer_get_size (buf), &self->params)) == NULL) {
-      g_cond_wait (&self->cond, GST_OBJECT_GET_LOCK (self));
+      gst_shm_sink_wait_locked (self);
       if (self->unlock)
         goto flushing;
     }
 
     while (self->wait_for_connection && !self->clients) {
       g_cond_wait (&self->cond, GST_OBJECT_GET_LOCK (self));
-      if (self->unlock) {
-        gst_memory_unref (memory);
-        GST_OBJECT_UNLOCK (self);
-        return GST_FLOW_FLUSHING;
-      }
+      if (self->unlock)
+        goto flushing;
     }
 
     gst_memory_map (memory, &map, GST_MAP_WRITE);
@@ -732,24 +991,56 @@ gst_shm_sink_render (GstBaseSink * bsink, GstBuffer * buf)
     sendbuf = gst_buffer_ref (buf);
   }
 
-  gst_buffer_map (sendbuf, &map, GST_MAP_READ);
-  /* Make the memory readonly as of now as we've sent it to the other side
-   * We know it's not mapped for writing anywhere as we just mapped it for
-   * reading
-   */
+  /* Each memory is sent as a piece of the buffer, they are all in our
+   * area. We know they are not mapped for writing anywhere as we just
+   * mapped them for reading */
+  n_extents = gst_buffer_n_memory (sendbuf);
+  for (i = 0; i < n_extents; i++) {
+    gst_memory_map (gst_buffer_peek_memory (sendbuf, i), &maps[i],
+        GST_MAP_READ);
+    extents[i].buf = (char *) maps[i].data;
+    extents[i].size = maps[i].size;
+  }
+
+  if (meta_memory)
+    gst_memory_map (meta_memory, &meta_map, GST_MAP_READ);
+
+  /* There may be no room for the table of pieces yet */
+  while ((rv = sp_writer_send_bufv (self->pipe, extents, n_extents,
+              (char *) meta_map.data, meta_map.size, sendbuf)) == -3) {
+    gst_shm_sink_wait_locked (self);
+    if (self->unlock)
+      break;
+  }
 
-  rv = sp_writer_send_buf (self->pipe, (char *) map.data, map.size, sendbuf);
+  if (meta_memory)
+    gst_memory_unmap (meta_memory, &meta_map);
+  for (i = 0; i < n_extents; i++)
+    gst_memory_unmap (gst_buffer_peek_memory (sendbuf, i), &maps[i]);
 
-  gst_buffer_unmap (sendbuf, &map);
+  if (rv > 0 && caps_sent)
+    self->send_caps = FALSE;
 
   GST_OBJECT_UNLOCK (self);
 
+  if (rv == -3) {
+    if (meta_memory)
+      gst_memory_unref (meta_memory);
+    gst_buffer_unref (sendbuf);
+    return GST_FLOW_FLUSHING;
+  }
+
+  /* The pipe keeps its own reference to the metadata block */
+  if (meta_memory)
+    gst_memory_unref (meta_memory);
+
   if (rv == 0) {
     GST_DEBUG_OBJECT (self, "No clients connected, unreffing buffer");
     gst_buffer_unref (sendbuf);
-  } else if (rv == -1) {
+  } else if (rv < 0) {
     GST_ELEMENT_ERROR (self, STREAM, FAILED, ("Invalid allocated buffer"),
         ("The shmpipe library rejects our buffer, this is a bug"));
+    gst_buffer_unref (sendbuf);
     ret = GST_FLOW_ERROR;
   }
 
@@ -759,19 +1050,14 @@ gst_shm_sink_render (GstBaseSink * bsink, GstBuffer * buf)
 
 flushing:
   GST_OBJECT_UNLOCK (self);
+  /* Our memory is freed with the object lock taken */
+  if (need_new_memory && memory)
+    gst_memory_unref (memory);
+  if (meta_memory)
+    gst_memory_unref (meta_memory);
   return GST_FLOW_FLUSHING;
 }
 
-static void
-free_buffer_locked (GstBuffer * buffer, void *data)
-{
-  GSList **list = data;
-
-  g_assert (buffer != NULL);
-
-  *list = g_slist_prepend (*list, buffer);
-}
-
 static gpointer
 pollthread_func (gpointer data)
 {
@@ -807,6 +1093,8 @@ pollthread_func (gpointer data)
 
       GST_OBJECT_LOCK (self);
       client = sp_writer_accept_client (self->pipe);
+      /* The new client doesn't know the current caps */
+      self->send_caps = TRUE;
       GST_OBJECT_UNLOCK (self);
 
       if (!client) {
@@ -887,6 +1175,8 @@ pollthread_func (gpointer data)
       goto again;
     }
 
+    gst_shm_sink_reclaim (self);
+
     g_cond_broadcast (&self->cond);
   }
 
@@ -903,7 +1193,7 @@ gst_shm_sink_event (GstBaseSink * bsink, GstEvent * event)
       GST_OBJECT_LOCK (self);
       while (self->wait_for_connection && sp_writer_pending_writes (self->pipe)
           && !self->unlock)
-        g_cond_wait (&self->cond, GST_OBJECT_GET_LOCK (self));
+        gst_shm_sink_wait_locked (self);
       GST_OBJECT_UNLOCK (self);
       break;
     default:
@@ -943,10 +1233,22 @@ static gboolean
 gst_shm_sink_propose_allocation (GstBaseSink * sink, GstQuery * query)
 {
   GstShmSink *self = GST_SHM_SINK (sink);
+  GstAllocationParams params;
 
-  if (self->allocator)
+  /* All the memories of a buffer can be sent without copying if they come
+   * from our allocator, whose blocks are already aligned */
+  GST_OBJECT_LOCK (self);
+  if (self->allocator) {
+    gst_allocation_params_init (&params);
+    params.align = self->block_alignment - 1;
     gst_query_add_allocation_param (query, GST_ALLOCATOR (self->allocator),
-        NULL);
+        &params);
+  }
+
+  /* The strides and offsets of the frames are sent to the other side */
+  if (self->send_meta)
+    gst_query_add_allocation_meta (query, GST_VIDEO_META_API_TYPE, NULL);
+  GST_OBJECT_UNLOCK (self);
 
   return TRUE;
 }
@@ -52,6 +52,9 @@ struct _GstShmSink
 
   guint perms;
   guint size;
+  guint ring_size;
+  guint block_alignment;
+  gboolean send_meta;
 
   GList *clients;
 
@@ -69,6 +72,11 @@ struct _GstShmSink
   GstShmSinkAllocator *allocator;
 
   GstAllocationParams params;
+
+  /* Caps to serialize with the next buffer, and whether they must be sent
+   * again because they changed or a client connected */
+  gchar *caps;
+  gboolean send_caps;
 };
 
 struct _GstShmSinkClass
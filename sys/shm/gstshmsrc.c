@@ -30,6 +30,10 @@
  * "video/x-raw-yuv, format=(fourcc)YUY2, color-matrix=(string)sdtv, \
  * chroma-site=(string)mpeg2, width=(int)320, height=(int)240, framerate=(fraction)30/1" ! autovideosink
  * ]| Render video from shm buffers.
+ * |[
+ * gst-launch shmsrc socket-path=/tmp/blah use-meta=true ! autovideosink
+ * ]| Render video from a shmsink with send-meta=true, the caps and the
+ * timestamps are taken from the sink.
  * </refsect2>
  */
 
@@ -38,6 +42,7 @@
 #endif
 
 #include "gstshmsrc.h"
+#include "gstshmmeta.h"
 
 #include <gst/gst.h>
 
@@ -54,13 +59,18 @@ enum
 {
   PROP_0,
   PROP_SOCKET_PATH,
-  PROP_IS_LIVE
+  PROP_IS_LIVE,
+  PROP_USE_META
 };
 
+#define DEFAULT_USE_META FALSE
+
 struct GstShmBuffer
 {
   char *buf;
   GstShmPipe *pipe;
+  /* One per GstMemory wrapping a piece of the buffer */
+  gint refcount;
 };
 
 
@@ -131,6 +141,14 @@ gst_shm_src_class_init (GstShmSrcClass * klass)
           "True if the element cannot produce data in PAUSED", FALSE,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_USE_META,
+      g_param_spec_boolean ("use-meta", "Use the buffer metadata",
+          "Use the timestamps, flags, caps and video metadata sent by a "
+          "shmsink with send-meta enabled, renegotiating when the caps "
+          "change. The source then operates in time format. This may only "
+          "be modified in the NULL or READY state", DEFAULT_USE_META,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   gst_element_class_add_pad_template (gstelement_class,
       gst_static_pad_template_get (&srctemplate));
 
@@ -157,6 +175,7 @@ gst_shm_src_finalize (GObject * object)
 
   gst_poll_free (self->poll);
   g_free (self->socket_path);
+  g_free (self->caps);
 
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
@@ -184,6 +203,13 @@ gst_shm_src_set_property (GObject * object, guint prop_id,
       gst_base_src_set_live (GST_BASE_SRC (object),
           g_value_get_boolean (value));
       break;
+    case PROP_USE_META:
+      GST_OBJECT_LOCK (object);
+      self->use_meta = g_value_get_boolean (value);
+      GST_OBJECT_UNLOCK (object);
+      gst_base_src_set_format (GST_BASE_SRC (object),
+          self->use_meta ? GST_FORMAT_TIME : GST_FORMAT_BYTES);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -205,6 +231,11 @@ gst_shm_src_get_property (GObject * object, guint prop_id,
     case PROP_IS_LIVE:
       g_value_set_boolean (value, gst_base_src_is_live (GST_BASE_SRC (object)));
       break;
+    case PROP_USE_META:
+      GST_OBJECT_LOCK (object);
+      g_value_set_boolean (value, self->use_meta);
+      GST_OBJECT_UNLOCK (object);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -280,8 +311,13 @@ gst_shm_src_start (GstBaseSrc * bsrc)
 static gboolean
 gst_shm_src_stop (GstBaseSrc * bsrc)
 {
+  GstShmSrc *self = GST_SHM_SRC (bsrc);
+
   if (!gst_base_src_is_live (bsrc))
-    gst_shm_src_stop_reading (GST_SHM_SRC (bsrc));
+    gst_shm_src_stop_reading (self);
+
+  g_free (self->caps);
+  self->caps = NULL;
 
   return TRUE;
 }
@@ -294,6 +330,9 @@ free_buffer (gpointer data)
   g_return_if_fail (gsb->pipe != NULL);
   g_return_if_fail (gsb->pipe->src != NULL);
 
+  if (!g_atomic_int_dec_and_test (&gsb->refcount))
+    return;
+
   GST_LOG ("Freeing buffer %p", gsb->buf);
 
   GST_OBJECT_LOCK (gsb->pipe->src);
@@ -305,16 +344,76 @@ free_buffer (gpointer data)
   g_slice_free (struct GstShmBuffer, gsb);
 }
 
+/* Applies the metadata sent by the sink to the buffer, and sets the new
+ * caps if they changed */
+static GstFlowReturn
+gst_shm_src_apply_meta (GstShmSrc * self, GstBuffer * buffer,
+    const gchar * meta, gsize meta_size)
+{
+  gchar *caps_str = NULL;
+  GstCaps *caps;
+
+  if (!gst_shm_meta_deserialize ((const guint8 *) meta, meta_size, buffer,
+          &caps_str)) {
+    GST_ELEMENT_ERROR (self, STREAM, DECODE, ("Failed to read from shmsrc"),
+        ("Invalid buffer metadata of size %" G_GSIZE_FORMAT, meta_size));
+    return GST_FLOW_ERROR;
+  }
+
+  if (caps_str == NULL || g_strcmp0 (caps_str, self->caps) == 0) {
+    g_free (caps_str);
+    return GST_FLOW_OK;
+  }
+
+  GST_DEBUG_OBJECT (self, "Caps changed to %s", caps_str);
+
+  caps = gst_caps_from_string (caps_str);
+  g_free (self->caps);
+  self->caps = caps_str;
+
+  if (!caps || !gst_base_src_set_caps (GST_BASE_SRC (self), caps)) {
+    if (caps)
+      gst_caps_unref (caps);
+    GST_ELEMENT_ERROR (self, CORE, NEGOTIATION, (NULL),
+        ("Could not set the caps %s", self->caps));
+    return GST_FLOW_NOT_NEGOTIATED;
+  }
+
+  gst_caps_unref (caps);
+
+  return GST_FLOW_OK;
+}
+
 static GstFlowReturn
 gst_shm_src_create (GstPushSrc * psrc, GstBuffer ** outbuf)
 {
   GstShmSrc *self = GST_SHM_SRC (psrc);
   gchar *buf = NULL;
+  ShmBufferInfo info = { NULL, };
   int rv = 0;
   struct GstShmBuffer *gsb;
+  GstFlowReturn ret;
 
   do {
-    if (gst_poll_wait (self->poll, GST_CLOCK_TIME_NONE) < 0) {
+    GstClockTime timeout = GST_CLOCK_TIME_NONE;
+
+    /* If the sink uses a ring, the buffers can be taken from it without
+     * going through the socket */
+    GST_OBJECT_LOCK (self);
+    rv = sp_client_ring_recv (self->pipe->pipe, &buf, &info);
+    if (rv == 0 && sp_client_ring_prepare_wait (self->pipe->pipe))
+      timeout = 0;
+    GST_OBJECT_UNLOCK (self);
+
+    if (rv < 0) {
+      GST_ELEMENT_ERROR (self, RESOURCE, READ, ("Failed to read from shmsrc"),
+          ("Error reading from the ring: %d", rv));
+      return GST_FLOW_ERROR;
+    } else if (buf != NULL) {
+      break;
+    }
+
+    if (gst_poll_wait (self->poll, timeout) < 0) {
       if (errno == EBUSY)
         return GST_FLOW_FLUSHING;
       GST_ELEMENT_ERROR (self, RESOURCE, READ, ("Failed to read from shmsrc"),
@@ -341,7 +440,7 @@ gst_shm_src_create (GstPushSrc * psrc, GstBuffer ** outbuf)
       buf = NULL;
       GST_LOG_OBJECT (self, "Reading from pipe");
       GST_OBJECT_LOCK (self);
-      rv = sp_client_recv (self->pipe->pipe, &buf);
+      rv = sp_client_recv_full (self->pipe->pipe, &buf, &info);
       GST_OBJECT_UNLOCK (self);
       if (rv < 0) {
         GST_ELEMENT_ERROR (self, RESOURCE, READ, ("Failed to read from shmsrc"),
@@ -358,8 +457,35 @@ gst_shm_src_create (GstPushSrc * psrc, GstBuffer ** outbuf)
   gsb->pipe = self->pipe;
   gst_shm_pipe_inc (self->pipe);
 
-  *outbuf = gst_buffer_new_wrapped_full (GST_MEMORY_FLAG_READONLY,
-      buf, rv, 0, rv, gsb, free_buffer);
+  if (info.n_extents == 0) {
+    gsb->refcount = 1;
+    *outbuf = gst_buffer_new_wrapped_full (GST_MEMORY_FLAG_READONLY,
+        buf, rv, 0, rv, gsb, free_buffer);
+  } else {
+    guint i;
+
+    /* The pieces of a scattered buffer are wrapped without copying, the
+     * whole buffer is released with the last of them */
+    GST_LOG_OBJECT (self, "Buffer is made of %u pieces", info.n_extents);
+    gsb->refcount = info.n_extents;
+    *outbuf = gst_buffer_new ();
+    for (i = 0; i < info.n_extents; i++) {
+      gst_buffer_append_memory (*outbuf,
+          gst_memory_new_wrapped (GST_MEMORY_FLAG_READONLY,
+              info.extents[i].buf, info.extents[i].size, 0,
+              info.extents[i].size, gsb, free_buffer));
+    }
+  }
+
+  /* The metadata can be read until the next receive */
+  if (self->use_meta && info.meta) {
+    ret = gst_shm_src_apply_meta (self, *outbuf, info.meta, info.meta_size);
+    if (ret != GST_FLOW_OK) {
+      gst_buffer_unref (*outbuf);
+      *outbuf = NULL;
+      return ret;
+    }
+  }
 
   return GST_FLOW_OK;
 }
@@ -56,6 +56,10 @@ struct _GstShmSrc
 
   GstFlowReturn flow_return;
   gboolean unlocked;
+
+  gboolean use_meta;
+  /* Last caps received from the sink */
+  gchar *caps;
 };
 
 struct _GstShmSrcClass
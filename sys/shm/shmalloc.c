@@ -33,14 +33,56 @@
 #include <string.h>
 #include <assert.h>
 
+/*
+ * The space is managed in granules, a power of 2 that is at least the
+ * requested alignment, so all the blocks are aligned on a granule.
+ *
+ * Free blocks are kept in segregated lists of size classes, two levels
+ * deep: the first level is the power of 2 of the size, the second level
+ * splits each power of 2 in SL_COUNT classes. A bitmap of the non empty
+ * lists makes it possible to find a big enough free block in constant
+ * time. Blocks know their physical neighbours so they can be merged with
+ * them in constant time when they are freed.
+ *
+ * The descriptors of the blocks are not stored in the shared memory, so
+ * the readers don't see them and all of the space can be used.
+ */
+
+#define SL_BITS 4
+#define SL_COUNT (1 << SL_BITS)
+#define FL_COUNT 32
+
+/* The granule grows with the size of the space to bound the size of the
+ * offset map */
+#define MIN_GRANULE 64
+#define MAX_GRANULES (1 << 17)
+
 /* This is the allocated space to hold multiple blocks */
 struct _ShmAllocSpace
 {
   /* The total size of this space */
   size_t size;
 
-  /* chained list of the blocks contained in this space */
-  ShmAllocBlock *blocks;
+  /* Size of the allocation unit, a power of 2 */
+  unsigned long granule;
+  unsigned int granule_shift;
+  unsigned long n_granules;
+
+  /* The block starting at each granule, NULL for the other granules */
+  ShmAllocBlock **map;
+
+  /* Free lists of each size class, and bitmaps of the non empty ones */
+  unsigned int fl_bitmap;
+  unsigned int sl_bitmap[FL_COUNT];
+  ShmAllocBlock *free_lists[FL_COUNT][SL_COUNT];
+
+  /* Statistics */
+  unsigned long used_size;
+  unsigned long requested_size;
+  unsigned long free_size;
+  unsigned long n_used_blocks;
+  unsigned long n_free_blocks;
+  unsigned long n_failed_allocs;
 };
 
 /* A single block of data */
@@ -53,16 +95,157 @@ struct _ShmAllocBlock
 
   /* The offset of this block in the alloc space */
   unsigned long offset;
-  /* The size of the block */
+  /* The size of the block, a multiple of the granule */
   unsigned long size;
+  /* The size that was asked for */
+  unsigned long requested_size;
+
+  int is_free;
 
-  /* Pointer to the next block in the chain */
-  ShmAllocBlock *next;
+  /* The blocks just before and after this one in the space */
+  ShmAllocBlock *prev_phys;
+  ShmAllocBlock *next_phys;
+
+  /* The other blocks of the same free list */
+  ShmAllocBlock *prev_free;
+  ShmAllocBlock *next_free;
 };
 
 
+/* Index of the highest bit set */
+static int
+shm_alloc_fls (unsigned long x)
+{
+  return (int) (sizeof (unsigned long) * 8 - 1) - __builtin_clzl (x);
+}
+
+/* Index of the lowest bit set */
+static int
+shm_alloc_ffs (unsigned int x)
+{
+  return __builtin_ctz (x);
+}
+
+/* Size class of a block of @n granules */
+static void
+shm_alloc_mapping (unsigned long n, int *fl, int *sl)
+{
+  if (n < SL_COUNT) {
+    *fl = 0;
+    *sl = n;
+  } else {
+    int t = shm_alloc_fls (n);
+
+    *sl = (n >> (t - SL_BITS)) ^ SL_COUNT;
+    *fl = t - SL_BITS + 1;
+  }
+}
+
+static ShmAllocBlock *
+shm_alloc_block_new (ShmAllocSpace * self, unsigned long offset,
+    unsigned long size)
+{
+  ShmAllocBlock *block = spalloc_new (ShmAllocBlock);
+
+  memset (block, 0, sizeof (ShmAllocBlock));
+  block->space = self;
+  block->offset = offset;
+  block->size = size;
+  self->map[offset >> self->granule_shift] = block;
+
+  return block;
+}
+
+static void
+shm_alloc_block_destroy (ShmAllocSpace * self, ShmAllocBlock * block)
+{
+  self->map[block->offset >> self->granule_shift] = NULL;
+  spalloc_free (ShmAllocBlock, block);
+}
+
+static void
+shm_alloc_space_insert_free (ShmAllocSpace * self, ShmAllocBlock * block)
+{
+  int fl, sl;
+
+  shm_alloc_mapping (block->size >> self->granule_shift, &fl, &sl);
+
+  block->is_free = 1;
+  block->prev_free = NULL;
+  block->next_free = self->free_lists[fl][sl];
+  if (block->next_free)
+    block->next_free->prev_free = block;
+  self->free_lists[fl][sl] = block;
+
+  self->fl_bitmap |= 1U << fl;
+  self->sl_bitmap[fl] |= 1U << sl;
+
+  self->free_size += block->size;
+  self->n_free_blocks++;
+}
+
+static void
+shm_alloc_space_remove_free (ShmAllocSpace * self, ShmAllocBlock * block)
+{
+  int fl, sl;
+
+  shm_alloc_mapping (block->size >> self->granule_shift, &fl, &sl);
+
+  if (block->prev_free)
+    block->prev_free->next_free = block->next_free;
+  else
+    self->free_lists[fl][sl] = block->next_free;
+  if (block->next_free)
+    block->next_free->prev_free = block->prev_free;
+
+  if (!self->free_lists[fl][sl]) {
+    self->sl_bitmap[fl] &= ~(1U << sl);
+    if (!self->sl_bitmap[fl])
+      self->fl_bitmap &= ~(1U << fl);
+  }
+
+  block->is_free = 0;
+  block->prev_free = block->next_free = NULL;
+
+  self->free_size -= block->size;
+  self->n_free_blocks--;
+}
+
+/* Returns the head of the first non empty list of class @fl, @sl or
+ * bigger */
+static ShmAllocBlock *
+shm_alloc_space_find_free (ShmAllocSpace * self, int fl, int sl)
+{
+  unsigned int sl_map;
+
+  if (fl >= FL_COUNT)
+    return NULL;
+
+  sl_map = self->sl_bitmap[fl] & (~0U << sl);
+  if (!sl_map) {
+    unsigned int fl_map = 0;
+
+    if (fl + 1 < FL_COUNT)
+      fl_map = self->fl_bitmap & (~0U << (fl + 1));
+    if (!fl_map)
+      return NULL;
+
+    fl = shm_alloc_ffs (fl_map);
+    sl_map = self->sl_bitmap[fl];
+  }
+
+  return self->free_lists[fl][shm_alloc_ffs (sl_map)];
+}
+
+
 ShmAllocSpace *
 shm_alloc_space_new (size_t size)
+{
+  return shm_alloc_space_new_aligned (size, 0);
+}
+
+ShmAllocSpace *
+shm_alloc_space_new_aligned (size_t size, size_t alignment)
 {
   ShmAllocSpace *self = spalloc_new (ShmAllocSpace);
 
@@ -70,13 +253,37 @@ shm_alloc_space_new (size_t size)
 
   self->size = size;
 
+  self->granule = MIN_GRANULE;
+  while (self->granule < alignment || size / self->granule > MAX_GRANULES)
+    self->granule <<= 1;
+  self->granule_shift = shm_alloc_fls (self->granule);
+  self->n_granules = size >> self->granule_shift;
+
+  /* The last partial granule, if any, is not used */
+  self->map = spalloc_alloc (sizeof (ShmAllocBlock *) * (self->n_granules +
+          1));
+  memset (self->map, 0, sizeof (ShmAllocBlock *) * (self->n_granules + 1));
+
+  if (self->n_granules > 0)
+    shm_alloc_space_insert_free (self, shm_alloc_block_new (self, 0,
+            self->n_granules << self->granule_shift));
+
   return self;
 }
 
 void
 shm_alloc_space_free (ShmAllocSpace * self)
 {
-  assert (self && self->blocks == NULL);
+  assert (self && self->n_used_blocks == 0);
+
+  if (self->n_granules > 0) {
+    assert (self->n_free_blocks == 1);
+    shm_alloc_space_remove_free (self, self->map[0]);
+    shm_alloc_block_destroy (self, self->map[0]);
+  }
+
+  spalloc_free1 (sizeof (ShmAllocBlock *) * (self->n_granules + 1),
+      self->map);
   spalloc_free (ShmAllocSpace, self);
 }
 
@@ -85,44 +292,67 @@ ShmAllocBlock *
 shm_alloc_space_alloc_block (ShmAllocSpace * self, unsigned long size)
 {
   ShmAllocBlock *block;
-  ShmAllocBlock *item = NULL;
-  ShmAllocBlock *prev_item = NULL;
-  unsigned long prev_end_offset = 0;
+  unsigned long n, search;
+  int fl, sl;
+
+  n = (size + self->granule - 1) >> self->granule_shift;
+  if (n == 0)
+    n = 1;
+
+  if (n > self->n_granules)
+    goto failed;
+
+  /* Round up to the next class, so that any block of that class fits */
+  search = n;
+  if (n >= SL_COUNT)
+    search += (1UL << (shm_alloc_fls (n) - SL_BITS)) - 1;
+  shm_alloc_mapping (search, &fl, &sl);
+
+  block = shm_alloc_space_find_free (self, fl, sl);
+
+  /* Otherwise, blocks of the class of @n might still be big enough, this
+   * matters when the space is almost full */
+  if (!block) {
+    shm_alloc_mapping (n, &fl, &sl);
+    for (block = self->free_lists[fl][sl]; block; block = block->next_free) {
+      if (block->size >> self->granule_shift >= n)
+        break;
+    }
+  }
 
+  if (!block)
+    goto failed;
 
-  for (item = self->blocks; item; item = item->next) {
-    unsigned long max_size = 0;
+  shm_alloc_space_remove_free (self, block);
 
-    max_size = item->offset - prev_end_offset;
+  /* Give back what is not needed */
+  if (block->size > n << self->granule_shift) {
+    ShmAllocBlock *rest = shm_alloc_block_new (self,
+        block->offset + (n << self->granule_shift),
+        block->size - (n << self->granule_shift));
 
-    if (max_size >= size)
-      break;
+    rest->prev_phys = block;
+    rest->next_phys = block->next_phys;
+    if (rest->next_phys)
+      rest->next_phys->prev_phys = rest;
+    block->next_phys = rest;
+    block->size = n << self->granule_shift;
 
-    prev_end_offset = item->offset + item->size;
-    prev_item = item;
+    shm_alloc_space_insert_free (self, rest);
   }
 
-  /* Return NULL if there is no big enough space, otherwise, there is space
-   * at the end */
-  assert (prev_end_offset <= self->size);
-  if (!item && self->size - prev_end_offset < size)
-    return NULL;
-
-  block = spalloc_new (ShmAllocBlock);
-  memset (block, 0, sizeof (ShmAllocBlock));
-  block->offset = prev_end_offset;
-  block->size = size;
   block->use_count = 1;
-  block->space = self;
-
-  if (prev_item)
-    prev_item->next = block;
-  else
-    self->blocks = block;
+  block->requested_size = size;
 
-  block->next = item;
+  self->used_size += block->size;
+  self->requested_size += size;
+  self->n_used_blocks++;
 
   return block;
+
+failed:
+  self->n_failed_allocs++;
+  return NULL;
 }
 
 unsigned long
@@ -131,38 +361,96 @@ shm_alloc_space_alloc_block_get_offset (ShmAllocBlock * block)
   return block->offset;
 }
 
+/* Merges @block into @prev, its previous physical neighbour */
+static void
+shm_alloc_space_merge (ShmAllocSpace * self, ShmAllocBlock * prev,
+    ShmAllocBlock * block)
+{
+  prev->size += block->size;
+  prev->next_phys = block->next_phys;
+  if (prev->next_phys)
+    prev->next_phys->prev_phys = prev;
+
+  shm_alloc_block_destroy (self, block);
+}
+
 static void
 shm_alloc_space_free_block (ShmAllocBlock * block)
 {
-  ShmAllocBlock *item = NULL;
-  ShmAllocBlock *prev_item = NULL;
   ShmAllocSpace *self = block->space;
 
-  for (item = self->blocks; item; item = item->next) {
-    if (item == block) {
-      if (prev_item)
-        prev_item->next = item->next;
-      else
-        self->blocks = item->next;
-      break;
-    }
-    prev_item = item;
+  self->used_size -= block->size;
+  self->requested_size -= block->requested_size;
+  self->n_used_blocks--;
+
+  if (block->prev_phys && block->prev_phys->is_free) {
+    ShmAllocBlock *prev = block->prev_phys;
+
+    shm_alloc_space_remove_free (self, prev);
+    shm_alloc_space_merge (self, prev, block);
+    block = prev;
   }
 
-  spalloc_free (ShmAllocBlock, block);
+  if (block->next_phys && block->next_phys->is_free) {
+    ShmAllocBlock *next = block->next_phys;
+
+    shm_alloc_space_remove_free (self, next);
+    shm_alloc_space_merge (self, block, next);
+  }
+
+  shm_alloc_space_insert_free (self, block);
 }
 
 ShmAllocBlock *
 shm_alloc_space_block_get (ShmAllocSpace * self, unsigned long offset)
 {
-  ShmAllocBlock *block = NULL;
+  ShmAllocBlock *block;
+  unsigned long i;
 
-  for (block = self->blocks; block; block = block->next) {
-    if (block->offset <= offset && (block->offset + block->size) > offset)
-      return block;
-  }
+  if (offset >= self->n_granules << self->granule_shift)
+    return NULL;
 
-  return NULL;
+  /* The offsets given are usually in the first granule of the block */
+  for (i = offset >> self->granule_shift; !self->map[i]; i--);
+  block = self->map[i];
+
+  if (block->is_free || offset >= block->offset + block->size)
+    return NULL;
+
+  return block;
+}
+
+size_t
+shm_alloc_space_get_alignment (ShmAllocSpace * self)
+{
+  return self->granule;
+}
+
+void
+shm_alloc_space_get_stats (ShmAllocSpace * self, ShmAllocStats * stats)
+{
+  memset (stats, 0, sizeof (ShmAllocStats));
+
+  stats->size = self->n_granules << self->granule_shift;
+  stats->alignment = self->granule;
+  stats->used = self->used_size;
+  stats->requested = self->requested_size;
+  stats->free = self->free_size;
+  stats->used_blocks = self->n_used_blocks;
+  stats->free_blocks = self->n_free_blocks;
+  stats->failed_allocs = self->n_failed_allocs;
+
+  /* The largest free block is in the highest non empty class */
+  if (self->fl_bitmap) {
+    int fl = shm_alloc_fls (self->fl_bitmap);
+    int sl = shm_alloc_fls (self->sl_bitmap[fl]);
+    ShmAllocBlock *block;
+
+    for (block = self->free_lists[fl][sl]; block; block = block->next_free) {
+      if (block->size > stats->largest_free)
+        stats->largest_free = block->size;
+    }
+  }
 }
 
 
@@ -52,9 +52,31 @@ extern "C" {
 
 typedef struct _ShmAllocSpace ShmAllocSpace;
 typedef struct _ShmAllocBlock ShmAllocBlock;
+typedef struct _ShmAllocStats ShmAllocStats;
+
+struct _ShmAllocStats
+{
+  /* The usable size of the space and the alignment of its blocks */
+  size_t size;
+  size_t alignment;
+
+  /* Bytes in the allocated blocks and bytes that were asked for */
+  size_t used;
+  size_t requested;
+
+  size_t free;
+  size_t largest_free;
+
+  unsigned long used_blocks;
+  unsigned long free_blocks;
+  unsigned long failed_allocs;
+};
 
 ShmAllocSpace *shm_alloc_space_new (size_t size);
+ShmAllocSpace *shm_alloc_space_new_aligned (size_t size, size_t alignment);
 void shm_alloc_space_free (ShmAllocSpace * self);
+size_t shm_alloc_space_get_alignment (ShmAllocSpace * self);
+void shm_alloc_space_get_stats (ShmAllocSpace * self, ShmAllocStats * stats);
 
 
 ShmAllocBlock *shm_alloc_space_alloc_block (ShmAllocSpace * self,
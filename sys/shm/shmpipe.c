@@ -63,13 +63,43 @@
  * type 3: shm buffer
  * offset
  * bufsize
+ * id of the area of the metadata
+ * offset of the metadata
+ * size of the metadata (0 if there is none)
+ * number of extents (0 if the buffer is contiguous)
  *
  * type 4: ack buffer
  * offset
  *
- * Type 4 goes from the client to the server
+ * type 5: new ring
+ * Ring length
+ * Size of path (followed by path)
+ * Index of the client in the ring
+ *
+ * type 6: ring attached
+ * No payload
+ *
+ * type 7: ring wake up
+ * No payload
+ *
+ * Types 4 and 6 go from the client to the server
+ * Type 7 goes both ways
  * The rest are from the server to the client
- * The client should never write in the SHM
+ * The client should never write in the SHM, except in the ring
+ *
+ * When a ring is used, the server sends a new ring command to each
+ * client after the first shm area. The client maps the ring and replies
+ * with a ring attached command, from then on the buffers for this client
+ * are published in the ring instead of being sent on the socket. Each
+ * slot has a bitmask of the clients that still use it, which the clients
+ * clear when they release the buffer. A side only sends a wake up
+ * command when the other side flagged itself as waiting in the ring.
+ *
+ * A buffer made of several pieces of the same area is sent as a table of
+ * extents (offset and size of each piece) that the server allocates in
+ * that area. The offset of the buffer is then the offset of the table,
+ * its size is the total size of the pieces and the number of extents is
+ * set.
  */
 
 
@@ -80,9 +110,15 @@ enum
   COMMAND_NEW_SHM_AREA = 1,
   COMMAND_CLOSE_SHM_AREA = 2,
   COMMAND_NEW_BUFFER = 3,
-  COMMAND_ACK_BUFFER = 4
+  COMMAND_ACK_BUFFER = 4,
+  COMMAND_NEW_RING = 5,
+  COMMAND_RING_ATTACHED = 6,
+  COMMAND_RING_WAKE = 7
 };
 
+#define RING_MAGIC 0x53524e47
+#define RING_MAX_CLIENTS 32
+
 typedef struct _ShmArea ShmArea;
 
 struct _ShmArea
@@ -113,6 +149,17 @@ struct _ShmBuffer
 
   ShmAllocBlock *ablock;
 
+  /* The blocks of the pieces of a scattered buffer, whose ablock is the
+   * table of extents */
+  unsigned int n_extents;
+  ShmAllocBlock **extent_blocks;
+
+  /* Optional block of serialized metadata sent along with the buffer */
+  ShmArea *meta_area;
+  unsigned long meta_offset;
+  size_t meta_size;
+  ShmAllocBlock *meta_ablock;
+
   ShmBuffer *next;
 
   void *tag;
@@ -123,6 +170,98 @@ struct _ShmBuffer
 };
 
 
+/* Layout of the ring shm area, shared between the processes. The
+ * sequence numbers wrap around, the number of slots is a power of 2 */
+
+typedef struct _ShmRingSlot ShmRingSlot;
+
+struct _ShmRingSlot
+{
+  /* Bitmask of the clients that have not released this buffer yet */
+  volatile uint32_t pending;
+  uint32_t seq;
+  int32_t area_id;
+  int32_t meta_area_id;
+  uint64_t offset;
+  uint64_t size;
+  uint64_t meta_offset;
+  uint64_t meta_size;
+  uint32_t n_extents;
+  uint32_t reserved;
+};
+
+typedef struct _ShmExtentDesc ShmExtentDesc;
+
+/* An entry in the table of extents of a scattered buffer */
+struct _ShmExtentDesc
+{
+  uint64_t offset;
+  uint64_t size;
+};
+
+typedef struct _ShmRingClient ShmRingClient;
+
+struct _ShmRingClient
+{
+  /* Set by a client before it goes to sleep on its socket */
+  volatile uint32_t waiting;
+  uint32_t reserved[15];
+};
+
+typedef struct _ShmRingHeader ShmRingHeader;
+
+struct _ShmRingHeader
+{
+  uint32_t magic;
+  uint32_t n_slots;
+  volatile uint32_t write_seq;
+  uint32_t reserved[13];
+
+  /* Set by the server before it waits for buffers to be released */
+  volatile uint32_t writer_waiting;
+  uint32_t reserved2[15];
+
+  ShmRingClient clients[RING_MAX_CLIENTS];
+  /* This must ALWAYS stay last in the struct */
+  ShmRingSlot slots[0];
+};
+
+typedef struct _ShmRingRef ShmRingRef;
+
+/* A buffer that the client received from the ring */
+struct _ShmRingRef
+{
+  char *buf;
+  uint32_t seq;
+
+  ShmRingRef *next;
+};
+
+typedef struct _ShmRing ShmRing;
+
+struct _ShmRing
+{
+  int shm_fd;
+  char *shm_ring_name;
+
+  ShmRingHeader *header;
+  size_t len;
+  uint32_t n_slots;
+
+  /* Server side */
+  ShmBuffer **buffers;
+  uint32_t tail;
+  uint32_t used_mask;
+  uint32_t active_mask;
+  ShmClient *clients[RING_MAX_CLIENTS];
+
+  /* Client side */
+  int client_id;
+  uint32_t read_seq;
+  int started;
+  ShmRingRef *refs;
+};
+
 struct _ShmPipe
 {
   int main_socket;
@@ -139,13 +278,23 @@ struct _ShmPipe
   int num_clients;
   ShmClient *clients;
 
+  ShmRing *ring;
+
   mode_t perms;
+  size_t alignment;
+
+  /* Client side, extents of the last scattered buffer received */
+  ShmExtent *extents;
+  unsigned int extents_len;
 };
 
 struct _ShmClient
 {
   int fd;
 
+  /* Index in the ring, -1 if the client doesn't use it */
+  int ring_id;
+
   ShmClient *next;
 };
 
@@ -173,19 +322,34 @@ struct CommandBuffer
     {
       unsigned long offset;
       unsigned long size;
+      int meta_area_id;
+      unsigned long meta_offset;
+      unsigned long meta_size;
+      unsigned int n_extents;
     } buffer;
     struct
     {
       unsigned long offset;
     } ack_buffer;
+    struct
+    {
+      size_t size;
+      unsigned int path_size;
+      unsigned int client_id;
+      /* Followed by path */
+    } new_ring;
   } payload;
 };
 
-static ShmArea *sp_open_shm (char *path, int id, mode_t perms, size_t size);
+static ShmArea *sp_open_shm (char *path, int id, mode_t perms, size_t size,
+    size_t alignment);
 static void sp_close_shm (ShmArea * area);
 static int sp_shmbuf_dec (ShmPipe * self, ShmBuffer * buf,
     ShmBuffer * prev_buf, ShmClient * client, void **tag);
 static void sp_shm_area_dec (ShmPipe * self, ShmArea * area);
+static void sp_close_ring (ShmRing * ring);
+static int send_command (int fd, struct CommandBuffer *cb,
+    unsigned short int type, int area_id);
 
 
 
@@ -243,7 +407,9 @@ sp_writer_create (const char *path, size_t size, mode_t perms)
   if (listen (self->main_socket, LISTEN_BACKLOG) < 0)
     RETURN_ERROR ("listen() failed (%d): %s\n", errno, strerror (errno));
 
-  self->shm_area = sp_open_shm (NULL, ++self->next_area_id, perms, size);
+  self->alignment = SHM_PIPE_DEFAULT_ALIGNMENT;
+  self->shm_area = sp_open_shm (NULL, ++self->next_area_id, perms, size,
+      self->alignment);
 
   self->perms = perms;
 
@@ -266,12 +432,13 @@ sp_writer_create (const char *path, size_t size, mode_t perms)
  * sp_open_shm:
  * @path: Path of the shm area for a reader,
  *  NULL if this is a writer (then it will allocate its own path)
+ * @alignment: Minimum alignment of the blocks allocated by a writer
  *
  * Opens a ShmArea
  */
 
 static ShmArea *
-sp_open_shm (char *path, int id, mode_t perms, size_t size)
+sp_open_shm (char *path, int id, mode_t perms, size_t size, size_t alignment)
 {
   ShmArea *area = spalloc_new (ShmArea);
   char tmppath[32];
@@ -331,7 +498,8 @@ sp_open_shm (char *path, int id, mode_t perms, size_t size)
   area->id = id;
 
   if (!path)
-    area->allocspace = shm_alloc_space_new (area->shm_area_len);
+    area->allocspace = shm_alloc_space_new_aligned (area->shm_area_len,
+        alignment);
 
   return area;
 }
@@ -360,6 +528,60 @@ sp_close_shm (ShmArea * area)
   spalloc_free (ShmArea, area);
 }
 
+static size_t
+sp_ring_size (uint32_t n_slots)
+{
+  return sizeof (ShmRingHeader) + n_slots * sizeof (ShmRingSlot);
+}
+
+/* The clients write in the ring, so everyone who can read it can also
+ * write to it */
+static mode_t
+sp_ring_perms (mode_t perms)
+{
+  return perms | ((perms & (S_IRUSR | S_IRGRP | S_IROTH)) >> 1);
+}
+
+static ShmRing *
+sp_ring_new (void)
+{
+  ShmRing *ring = spalloc_new (ShmRing);
+
+  memset (ring, 0, sizeof (ShmRing));
+  ring->shm_fd = -1;
+  ring->header = MAP_FAILED;
+  ring->client_id = -1;
+
+  return ring;
+}
+
+static void
+sp_close_ring (ShmRing * ring)
+{
+  while (ring->refs) {
+    ShmRingRef *ref = ring->refs;
+
+    ring->refs = ref->next;
+    spalloc_free (ShmRingRef, ref);
+  }
+
+  if (ring->buffers)
+    spalloc_free1 (sizeof (ShmBuffer *) * ring->n_slots, ring->buffers);
+
+  if (ring->header != MAP_FAILED)
+    munmap (ring->header, ring->len);
+
+  if (ring->shm_fd >= 0)
+    close (ring->shm_fd);
+
+  if (ring->shm_ring_name) {
+    shm_unlink (ring->shm_ring_name);
+    free (ring->shm_ring_name);
+  }
+
+  spalloc_free (ShmRing, ring);
+}
+
 static void
 sp_shm_area_inc (ShmArea * area)
 {
@@ -375,6 +597,7 @@ sp_shm_area_dec (ShmPipe * self, ShmArea * area)
   if (area->use_count == 0) {
     ShmArea *item = NULL;
     ShmArea *prev_item = NULL;
+    ShmClient *client;
 
     for (item = self->shm_area; item; item = item->next) {
       if (item == area) {
@@ -388,6 +611,15 @@ sp_shm_area_dec (ShmPipe * self, ShmArea * area)
     }
     assert (item);
 
+    /* The clients of the ring are only told to close an area once it can
+     * not appear in the ring anymore, see sp_writer_resize() */
+    for (client = self->clients; client; client = client->next) {
+      struct CommandBuffer cb = { 0 };
+
+      if (client->ring_id >= 0)
+        send_command (client->fd, &cb, COMMAND_CLOSE_SHM_AREA, area->id);
+    }
+
     sp_close_shm (area);
   }
 }
@@ -421,6 +653,7 @@ sp_dec (ShmPipe * self)
   while (self->shm_area)
     sp_shm_area_dec (self, self->shm_area);
 
+  free (self->extents);
   spalloc_free (ShmPipe, self);
 }
 
@@ -441,6 +674,11 @@ sp_writer_close (ShmPipe * self, sp_buffer_free_callback callback,
   while (self->clients)
     sp_writer_close_client (self, self->clients, callback, user_data);
 
+  if (self->ring) {
+    sp_close_ring (self->ring);
+    self->ring = NULL;
+  }
+
   sp_dec (self);
 }
 
@@ -461,6 +699,9 @@ sp_writer_setperms_shm (ShmPipe * self, mode_t perms)
   for (area = self->shm_area; area; area = area->next)
     ret |= fchmod (area->shm_fd, perms);
 
+  if (self->ring)
+    ret |= fchmod (self->ring->shm_fd, sp_ring_perms (perms));
+
   ret |= chmod (self->socket_path, perms);
 
   return ret;
@@ -492,7 +733,8 @@ sp_writer_resize (ShmPipe * self, size_t size)
   if (self->shm_area->shm_area_len == size)
     return 0;
 
-  newarea = sp_open_shm (NULL, ++self->next_area_id, self->perms, size);
+  newarea = sp_open_shm (NULL, ++self->next_area_id, self->perms, size,
+      self->alignment);
 
   if (!newarea)
     return -1;
@@ -506,8 +748,10 @@ sp_writer_resize (ShmPipe * self, size_t size)
   for (client = self->clients; client; client = client->next) {
     struct CommandBuffer cb = { 0 };
 
-    if (!send_command (client->fd, &cb, COMMAND_CLOSE_SHM_AREA,
-            old_current->id))
+    /* Buffers from the old area can still be published in the ring after
+     * the new area, its clients are told to close it once it is freed */
+    if (client->ring_id < 0 && !send_command (client->fd, &cb,
+            COMMAND_CLOSE_SHM_AREA, old_current->id))
       continue;
 
     cb.payload.new_shm_area.size = newarea->shm_area_len;
@@ -568,65 +812,267 @@ sp_writer_free_block (ShmBlock * block)
   spalloc_free (ShmBlock, block);
 }
 
-/* Returns the number of client this has successfully been sent to */
+static void
+sp_writer_ring_publish (ShmPipe * self, ShmBuffer * sb, uint32_t mask)
+{
+  ShmRing *ring = self->ring;
+  ShmRingHeader *header = ring->header;
+  uint32_t seq = header->write_seq;
+  uint32_t idx = seq & (ring->n_slots - 1);
+  ShmRingSlot *slot = &header->slots[idx];
+  int i;
+
+  assert (ring->buffers[idx] == NULL);
+
+  slot->seq = seq;
+  slot->area_id = sb->shm_area->id;
+  slot->offset = sb->offset;
+  slot->size = sb->size;
+  slot->meta_area_id = sb->meta_area ? sb->meta_area->id : -1;
+  slot->meta_offset = sb->meta_offset;
+  slot->meta_size = sb->meta_size;
+  slot->n_extents = sb->n_extents;
+  ring->buffers[idx] = sb;
+
+  /* The descriptor must be complete before the clients can claim it, and
+   * claimable before it is published */
+  __sync_synchronize ();
+  slot->pending = mask;
+  __sync_synchronize ();
+  header->write_seq = seq + 1;
+  __sync_synchronize ();
+
+  /* Only the clients that went to sleep need a syscall */
+  for (i = 0; i < RING_MAX_CLIENTS; i++) {
+    if ((mask & (1U << i)) && header->clients[i].waiting &&
+        __sync_lock_test_and_set (&header->clients[i].waiting, 0)) {
+      struct CommandBuffer cb = { 0 };
+
+      send_command (ring->clients[i]->fd, &cb, COMMAND_RING_WAKE,
+          sb->shm_area->id);
+    }
+  }
+}
+
+/* Finds the area and the block that contain buf */
+static ShmAllocBlock *
+sp_writer_find_block (ShmPipe * self, char *buf, ShmArea ** area_out,
+    unsigned long *offset_out)
+{
+  ShmArea *area;
+
+  for (area = self->shm_area; area; area = area->next) {
+    if (buf >= area->shm_area_buf &&
+        buf < (area->shm_area_buf + area->shm_area_len)) {
+      ShmAllocBlock *ablock;
+
+      *offset_out = buf - area->shm_area_buf;
+      ablock = shm_alloc_space_block_get (area->allocspace, *offset_out);
+      assert (ablock);
+      *area_out = area;
+      return ablock;
+    }
+  }
+
+  return NULL;
+}
 
 int
 sp_writer_send_buf (ShmPipe * self, char *buf, size_t size, void *tag)
+{
+  return sp_writer_send_buf_full (self, buf, size, NULL, 0, tag);
+}
+
+int
+sp_writer_send_buf_full (ShmPipe * self, char *buf, size_t size, char *meta,
+    size_t meta_size, void *tag)
+{
+  ShmExtent extent;
+
+  extent.buf = buf;
+  extent.size = size;
+
+  return sp_writer_send_bufv (self, &extent, 1, meta, meta_size, tag);
+}
+
+/* Looks up the blocks of the pieces of a scattered buffer, which must all
+ * be in area, and writes their table in a new block of that area. Returns
+ * the table block or NULL with *error set */
+static ShmAllocBlock *
+sp_writer_alloc_extents (ShmArea * area,
+    const ShmExtent * extents, unsigned int n_extents,
+    ShmAllocBlock ** extent_blocks, unsigned long *total_size, int *error)
+{
+  ShmAllocBlock *table_block;
+  ShmExtentDesc *table;
+  unsigned int i;
+
+  *total_size = 0;
+
+  for (i = 0; i < n_extents; i++) {
+    char *buf = extents[i].buf;
+    size_t size = extents[i].size;
+
+    if (buf < area->shm_area_buf ||
+        buf + size > area->shm_area_buf + area->shm_area_len) {
+      *error = -4;
+      return NULL;
+    }
+
+    extent_blocks[i] = shm_alloc_space_block_get (area->allocspace,
+        buf - area->shm_area_buf);
+    if (!extent_blocks[i]) {
+      *error = -1;
+      return NULL;
+    }
+    *total_size += size;
+  }
+
+  table_block = shm_alloc_space_alloc_block (area->allocspace,
+      sizeof (ShmExtentDesc) * n_extents);
+  if (!table_block) {
+    *error = -3;
+    return NULL;
+  }
+
+  table = (ShmExtentDesc *) (area->shm_area_buf +
+      shm_alloc_space_alloc_block_get_offset (table_block));
+  for (i = 0; i < n_extents; i++) {
+    table[i].offset = extents[i].buf - area->shm_area_buf;
+    table[i].size = extents[i].size;
+  }
+
+  return table_block;
+}
+
+/* Returns the number of client this has successfully been sent to,
+ * -1 if the buffer or the metadata is not in the shm area, -2 if the
+ * ring is full, -3 if there is no space for the table of extents and -4
+ * if the extents are not all in the same area */
+
+int
+sp_writer_send_bufv (ShmPipe * self, const ShmExtent * extents,
+    unsigned int n_extents, char *meta, size_t meta_size, void *tag)
 {
   ShmArea *area = NULL;
+  ShmArea *meta_area = NULL;
   unsigned long offset = 0;
-  unsigned long bsize = size;
+  unsigned long meta_offset = 0;
+  unsigned long bsize = 0;
   ShmBuffer *sb;
   ShmClient *client = NULL;
   ShmAllocBlock *ablock = NULL;
+  ShmAllocBlock *meta_ablock = NULL;
+  ShmAllocBlock **extent_blocks = NULL;
+  uint32_t ring_mask = 0;
+  unsigned int e;
   int i = 0;
   int c = 0;
 
   if (self->num_clients == 0)
     return 0;
 
-  for (area = self->shm_area; area; area = area->next) {
-    if (buf >= area->shm_area_buf &&
-        buf < (area->shm_area_buf + area->shm_area_len)) {
-      offset = buf - area->shm_area_buf;
-      ablock = shm_alloc_space_block_get (area->allocspace, offset);
-      assert (ablock);
-      break;
-    }
-  }
+  if (n_extents == 0)
+    return -1;
 
+  ablock = sp_writer_find_block (self, extents[0].buf, &area, &offset);
   if (!ablock)
     return -1;
+  bsize = extents[0].size;
+
+  if (meta && meta_size) {
+    meta_ablock = sp_writer_find_block (self, meta, &meta_area, &meta_offset);
+    if (!meta_ablock || meta_offset + meta_size > meta_area->shm_area_len)
+      return -1;
+  }
+
+  if (self->ring && self->ring->active_mask) {
+    if (sp_writer_ring_is_full (self))
+      return -2;
+    ring_mask = self->ring->active_mask;
+  }
+
+  if (n_extents > 1) {
+    int error = 0;
+
+    extent_blocks = spalloc_alloc (sizeof (ShmAllocBlock *) * n_extents);
+    ablock = sp_writer_alloc_extents (area, extents, n_extents,
+        extent_blocks, &bsize, &error);
+    if (!ablock) {
+      spalloc_free1 (sizeof (ShmAllocBlock *) * n_extents, extent_blocks);
+      return error;
+    }
+    offset = shm_alloc_space_alloc_block_get_offset (ablock);
+  }
 
   sb = spalloc_alloc (sizeof (ShmBuffer) + sizeof (int) * self->num_clients);
   memset (sb, 0, sizeof (ShmBuffer));
   memset (sb->clients, -1, sizeof (int) * self->num_clients);
   sb->shm_area = area;
   sb->offset = offset;
-  sb->size = size;
+  sb->size = bsize;
   sb->num_clients = self->num_clients;
   sb->ablock = ablock;
+  if (extent_blocks) {
+    sb->n_extents = n_extents;
+    sb->extent_blocks = extent_blocks;
+  }
+  if (meta_ablock) {
+    sb->meta_area = meta_area;
+    sb->meta_offset = meta_offset;
+    sb->meta_size = meta_size;
+    sb->meta_ablock = meta_ablock;
+  }
   sb->tag = tag;
 
   for (client = self->clients; client; client = client->next) {
     struct CommandBuffer cb = { 0 };
+
+    /* Those get it from the ring */
+    if (client->ring_id >= 0 && (ring_mask & (1U << client->ring_id)))
+      continue;
+
     cb.payload.buffer.offset = offset;
     cb.payload.buffer.size = bsize;
+    cb.payload.buffer.meta_area_id = meta_area ? meta_area->id : -1;
+    cb.payload.buffer.meta_offset = sb->meta_offset;
+    cb.payload.buffer.meta_size = sb->meta_size;
+    cb.payload.buffer.n_extents = sb->n_extents;
     if (!send_command (client->fd, &cb, COMMAND_NEW_BUFFER, self->shm_area->id))
       continue;
     sb->clients[i++] = client->fd;
     c++;
   }
 
+  if (ring_mask) {
+    sp_writer_ring_publish (self, sb, ring_mask);
+    c += __builtin_popcount (ring_mask);
+  }
+
   if (c == 0) {
+    if (extent_blocks) {
+      shm_alloc_space_block_dec (ablock);
+      spalloc_free1 (sizeof (ShmAllocBlock *) * n_extents, extent_blocks);
+    }
     spalloc_free1 (sizeof (ShmBuffer) + sizeof (int) * sb->num_clients, sb);
     return 0;
   }
 
   sp_shm_area_inc (area);
-  shm_alloc_space_block_inc (ablock);
+  /* The table of extents is already ours */
+  if (extent_blocks) {
+    for (e = 0; e < n_extents; e++)
+      shm_alloc_space_block_inc (extent_blocks[e]);
+  } else {
+    shm_alloc_space_block_inc (ablock);
+  }
+  if (meta_ablock) {
+    sp_shm_area_inc (meta_area);
+    shm_alloc_space_block_inc (meta_ablock);
+  }
 
-  sb->use_count = c;
+  /* The ring holds a single reference for all of its clients */
+  sb->use_count = i + (ring_mask ? 1 : 0);
 
   sb->next = self->buffers;
   self->buffers = sb;
@@ -647,8 +1093,134 @@ recv_command (int fd, struct CommandBuffer *cb)
   }
 }
 
+static int
+sp_client_open_ring (ShmPipe * self, const char *path, size_t size,
+    unsigned int client_id)
+{
+  ShmRing *ring;
+  uint32_t n_slots;
+
+  if (self->ring || client_id >= RING_MAX_CLIENTS ||
+      size < sizeof (ShmRingHeader))
+    return -1;
+
+  ring = sp_ring_new ();
+  ring->client_id = client_id;
+  ring->len = size;
+
+  ring->shm_fd = shm_open (path, O_RDWR, 0);
+  if (ring->shm_fd < 0)
+    goto error;
+
+  ring->header = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+      ring->shm_fd, 0);
+  if (ring->header == MAP_FAILED)
+    goto error;
+
+  n_slots = ring->header->n_slots;
+  if (ring->header->magic != RING_MAGIC || n_slots == 0 ||
+      (n_slots & (n_slots - 1)) || size < sp_ring_size (n_slots))
+    goto error;
+
+  ring->n_slots = n_slots;
+  ring->read_seq = ring->header->write_seq;
+  self->ring = ring;
+
+  return 0;
+
+error:
+  sp_close_ring (ring);
+  return -1;
+}
+
+/* Finds the metadata sent with a buffer, it stays valid until the next
+ * call to one of the receive functions. Returns -1 if the area is not
+ * known and -2 if the metadata is not inside of it */
+static int
+sp_client_get_meta (ShmPipe * self, int area_id, unsigned long offset,
+    unsigned long size, ShmBufferInfo * info)
+{
+  ShmArea *area;
+
+  if (size == 0)
+    return 0;
+
+  for (area = self->shm_area; area; area = area->next) {
+    if (area->id == area_id)
+      break;
+  }
+
+  if (!area)
+    return -1;
+  if (offset + size > area->shm_area_len)
+    return -2;
+
+  if (info) {
+    info->meta = area->shm_area_buf + offset;
+    info->meta_size = size;
+  }
+
+  return 0;
+}
+
+/* Reads the table of extents of a scattered buffer, returns -2 if it is
+ * not valid */
+static int
+sp_client_get_extents (ShmPipe * self, ShmArea * area, unsigned long offset,
+    unsigned long size, unsigned int n_extents, ShmBufferInfo * info)
+{
+  ShmExtentDesc *table;
+  unsigned long total = 0;
+  unsigned int i;
+
+  if (n_extents == 0)
+    return 0;
+
+  if (!info || n_extents > area->shm_area_len / sizeof (ShmExtentDesc) ||
+      offset > area->shm_area_len - sizeof (ShmExtentDesc) * n_extents)
+    return -2;
+
+  if (self->extents_len < n_extents) {
+    free (self->extents);
+    self->extents = malloc (sizeof (ShmExtent) * n_extents);
+    if (!self->extents) {
+      self->extents_len = 0;
+      return -2;
+    }
+    self->extents_len = n_extents;
+  }
+
+  table = (ShmExtentDesc *) (area->shm_area_buf + offset);
+  for (i = 0; i < n_extents; i++) {
+    uint64_t extent_offset = table[i].offset;
+    uint64_t extent_size = table[i].size;
+
+    if (extent_offset > area->shm_area_len ||
+        extent_size > area->shm_area_len - extent_offset)
+      return -2;
+
+    self->extents[i].buf = area->shm_area_buf + extent_offset;
+    self->extents[i].size = extent_size;
+    total += extent_size;
+  }
+
+  if (total != size)
+    return -2;
+
+  info->extents = self->extents;
+  info->n_extents = n_extents;
+
+  return 0;
+}
+
 long int
 sp_client_recv (ShmPipe * self, char **buf)
+{
+  return sp_client_recv_full (self, buf, NULL);
+}
+
+long int
+sp_client_recv_full (ShmPipe * self, char **buf, ShmBufferInfo * info)
 {
   char *area_name = NULL;
   ShmArea *newarea;
@@ -673,7 +1245,7 @@ sp_client_recv (ShmPipe * self, char **buf)
       }
 
       newarea = sp_open_shm (area_name, cb.area_id, 0,
-          cb.payload.new_shm_area.size);
+          cb.payload.new_shm_area.size, 0);
       free (area_name);
       if (!newarea)
         return -4;
@@ -693,8 +1265,18 @@ sp_client_recv (ShmPipe * self, char **buf)
 
     case COMMAND_NEW_BUFFER:
       assert (buf);
+      if (info)
+        memset (info, 0, sizeof (ShmBufferInfo));
+      if (sp_client_get_meta (self, cb.payload.buffer.meta_area_id,
+              cb.payload.buffer.meta_offset, cb.payload.buffer.meta_size,
+              info) < 0)
+        return -23;
       for (area = self->shm_area; area; area = area->next) {
         if (area->id == cb.area_id) {
+          if (sp_client_get_extents (self, area, cb.payload.buffer.offset,
+                  cb.payload.buffer.size, cb.payload.buffer.n_extents,
+                  info) < 0)
+            return -24;
           *buf = area->shm_area_buf + cb.payload.buffer.offset;
           sp_shm_area_inc (area);
           return cb.payload.buffer.size;
@@ -702,6 +1284,34 @@ sp_client_recv (ShmPipe * self, char **buf)
       }
       return -23;
 
+    case COMMAND_NEW_RING:
+      assert (cb.payload.new_ring.path_size > 0);
+
+      area_name = malloc (cb.payload.new_ring.path_size);
+      retval = recv (self->main_socket, area_name,
+          cb.payload.new_ring.path_size, 0);
+      if (retval != cb.payload.new_ring.path_size) {
+        free (area_name);
+        return -3;
+      }
+
+      /* If the ring can't be used, the server keeps sending the buffers
+       * on the socket */
+      retval = sp_client_open_ring (self, area_name, cb.payload.new_ring.size,
+          cb.payload.new_ring.client_id);
+      free (area_name);
+      if (retval == 0) {
+        struct CommandBuffer reply = { 0 };
+
+        if (!send_command (self->main_socket, &reply, COMMAND_RING_ATTACHED,
+                0))
+          return -5;
+      }
+      break;
+
+    case COMMAND_RING_WAKE:
+      break;
+
     default:
       return -99;
   }
@@ -730,6 +1340,14 @@ sp_writer_recv (ShmPipe * self, ShmClient * client, void **tag)
       }
 
       return -2;
+    case COMMAND_RING_ATTACHED:
+      if (!self->ring || client->ring_id < 0)
+        return -3;
+      self->ring->active_mask |= 1U << client->ring_id;
+      return 1;
+    case COMMAND_RING_WAKE:
+      /* The buffers are collected by sp_writer_ring_reclaim() */
+      return 1;
     default:
       return -99;
   }
@@ -737,6 +1355,28 @@ sp_writer_recv (ShmPipe * self, ShmClient * client, void **tag)
   return 0;
 }
 
+static int
+sp_client_ring_release (ShmPipe * self, ShmRingRef * ref)
+{
+  ShmRing *ring = self->ring;
+  ShmRingHeader *header = ring->header;
+  uint32_t bit = 1U << ring->client_id;
+  ShmRingSlot *slot = &header->slots[ref->seq & (ring->n_slots - 1)];
+  uint32_t pending;
+
+  pending = __sync_fetch_and_and (&slot->pending, ~bit);
+
+  /* The last release of a slot wakes up the server if it is waiting */
+  if (pending == bit && header->writer_waiting &&
+      __sync_lock_test_and_set (&header->writer_waiting, 0)) {
+    struct CommandBuffer cb = { 0 };
+
+    return send_command (self->main_socket, &cb, COMMAND_RING_WAKE, 0);
+  }
+
+  return 1;
+}
+
 int
 sp_client_recv_finish (ShmPipe * self, char *buf)
 {
@@ -756,6 +1396,29 @@ sp_client_recv_finish (ShmPipe * self, char *buf)
 
   sp_shm_area_dec (self, shm_area);
 
+  if (self->ring) {
+    ShmRingRef *ref, *prev_ref = NULL;
+
+    for (ref = self->ring->refs; ref; ref = ref->next) {
+      if (ref->buf == buf)
+        break;
+      prev_ref = ref;
+    }
+
+    if (ref) {
+      int ret;
+
+      if (prev_ref)
+        prev_ref->next = ref->next;
+      else
+        self->ring->refs = ref->next;
+
+      ret = sp_client_ring_release (self, ref);
+      spalloc_free (ShmRingRef, ref);
+      return ret;
+    }
+  }
+
   cb.payload.ack_buffer.offset = offset;
   return send_command (self->main_socket, &cb, COMMAND_ACK_BUFFER,
       self->shm_area->id);
@@ -805,6 +1468,7 @@ sp_writer_accept_client (ShmPipe * self)
   int fd;
   struct CommandBuffer cb = { 0 };
   int pathlen = strlen (self->shm_area->shm_area_name) + 1;
+  int ring_id = -1;
 
 
   fd = accept (self->main_socket, NULL, NULL);
@@ -827,8 +1491,37 @@ sp_writer_accept_client (ShmPipe * self)
     goto error;
   }
 
+  /* Clients past the size of the bitmask use the socket */
+  if (self->ring && self->ring->used_mask != 0xffffffff) {
+    ShmRing *ring = self->ring;
+
+    for (ring_id = 0; ring->used_mask & (1U << ring_id); ring_id++);
+
+    pathlen = strlen (ring->shm_ring_name) + 1;
+    memset (&cb, 0, sizeof (cb));
+    cb.payload.new_ring.size = ring->len;
+    cb.payload.new_ring.path_size = pathlen;
+    cb.payload.new_ring.client_id = ring_id;
+    if (!send_command (fd, &cb, COMMAND_NEW_RING, self->shm_area->id)) {
+      fprintf (stderr, "Sending new ring failed: %s", strerror (errno));
+      goto error;
+    }
+
+    if (send (fd, ring->shm_ring_name, pathlen, MSG_NOSIGNAL) != pathlen) {
+      fprintf (stderr, "Sending new ring path failed: %s", strerror (errno));
+      goto error;
+    }
+  }
+
   client = spalloc_new (ShmClient);
   client->fd = fd;
+  client->ring_id = ring_id;
+
+  if (ring_id >= 0) {
+    self->ring->used_mask |= 1U << ring_id;
+    self->ring->clients[ring_id] = client;
+    self->ring->header->clients[ring_id].waiting = 0;
+  }
 
   /* Prepend ot linked list */
   client->next = self->clients;
@@ -843,6 +1536,35 @@ error:
   return NULL;
 }
 
+static void
+sp_shmbuf_free (ShmPipe * self, ShmBuffer * buf, ShmBuffer * prev_buf,
+    void **tag)
+{
+  /* Remove from linked list */
+  if (prev_buf)
+    prev_buf->next = buf->next;
+  else
+    self->buffers = buf->next;
+
+  if (tag)
+    *tag = buf->tag;
+  if (buf->extent_blocks) {
+    unsigned int i;
+
+    for (i = 0; i < buf->n_extents; i++)
+      shm_alloc_space_block_dec (buf->extent_blocks[i]);
+    spalloc_free1 (sizeof (ShmAllocBlock *) * buf->n_extents,
+        buf->extent_blocks);
+  }
+  shm_alloc_space_block_dec (buf->ablock);
+  sp_shm_area_dec (self, buf->shm_area);
+  if (buf->meta_ablock) {
+    shm_alloc_space_block_dec (buf->meta_ablock);
+    sp_shm_area_dec (self, buf->meta_area);
+  }
+  spalloc_free1 (sizeof (ShmBuffer) + sizeof (int) * buf->num_clients, buf);
+}
+
 static int
 sp_shmbuf_dec (ShmPipe * self, ShmBuffer * buf, ShmBuffer * prev_buf,
     ShmClient * client, void **tag)
@@ -868,17 +1590,29 @@ sp_shmbuf_dec (ShmPipe * self, ShmBuffer * buf, ShmBuffer * prev_buf,
   buf->use_count--;
 
   if (buf->use_count == 0) {
-    /* Remove from linked list */
-    if (prev_buf)
-      prev_buf->next = buf->next;
-    else
-      self->buffers = buf->next;
-
-    if (tag)
-      *tag = buf->tag;
-    shm_alloc_space_block_dec (buf->ablock);
-    sp_shm_area_dec (self, buf->shm_area);
-    spalloc_free1 (sizeof (ShmBuffer) + sizeof (int) * buf->num_clients, buf);
+    sp_shmbuf_free (self, buf, prev_buf, tag);
+    return 0;
+  }
+  return 1;
+}
+
+/* Drops the reference held by the ring, returns 0 if the buffer was freed */
+static int
+sp_shmbuf_ring_dec (ShmPipe * self, ShmBuffer * buf, void **tag)
+{
+  ShmBuffer *item = NULL, *prev_item = NULL;
+
+  for (item = self->buffers; item; item = item->next) {
+    if (item == buf)
+      break;
+    prev_item = item;
+  }
+  assert (item);
+
+  buf->use_count--;
+
+  if (buf->use_count == 0) {
+    sp_shmbuf_free (self, buf, prev_item, tag);
     return 0;
   }
   return 1;
@@ -891,8 +1625,28 @@ sp_writer_close_client (ShmPipe * self, ShmClient * client,
   ShmBuffer *buffer = NULL, *prev_buf = NULL;
   ShmClient *item = NULL, *prev_item = NULL;
 
+  /* The fd is only closed at the end, so nothing else gets its number
+   * while it still identifies the client in the buffers */
   shutdown (client->fd, SHUT_RDWR);
-  close (client->fd);
+
+  if (client->ring_id >= 0) {
+    ShmRing *ring = self->ring;
+    uint32_t bit = 1U << client->ring_id;
+    uint32_t seq;
+
+    ring->used_mask &= ~bit;
+    ring->active_mask &= ~bit;
+    ring->clients[client->ring_id] = NULL;
+    client->ring_id = -1;
+
+    for (seq = ring->tail; seq != ring->header->write_seq; seq++) {
+      ShmRingSlot *slot = &ring->header->slots[seq & (ring->n_slots - 1)];
+
+      __sync_fetch_and_and (&slot->pending, ~bit);
+    }
+
+    sp_writer_ring_reclaim (self, callback, user_data);
+  }
 
 again:
   for (buffer = self->buffers; buffer; buffer = buffer->next) {
@@ -926,6 +1680,7 @@ again:
 
   self->num_clients--;
 
+  close (client->fd);
   spalloc_free (ShmClient, client);
 }
 
@@ -974,8 +1729,284 @@ sp_writer_buf_get_tag (ShmBuffer * buffer)
 size_t
 sp_writer_get_max_buf_size (ShmPipe * self)
 {
+  ShmAllocStats stats;
+
   if (self->shm_area == NULL)
     return 0;
 
-  return self->shm_area->shm_area_len;
+  /* The end of the area that doesn't fill a whole block is not used */
+  shm_alloc_space_get_stats (self->shm_area->allocspace, &stats);
+
+  return stats.size;
+}
+
+/* Sets the minimum alignment of the blocks, a power of 2. It applies
+ * immediately if no block is allocated, otherwise from the next resize */
+
+int
+sp_writer_set_alignment (ShmPipe * self, size_t alignment)
+{
+  ShmAllocStats stats;
+
+  if (alignment & (alignment - 1))
+    return -1;
+
+  self->alignment = alignment;
+
+  shm_alloc_space_get_stats (self->shm_area->allocspace, &stats);
+  if (stats.used_blocks == 0) {
+    shm_alloc_space_free (self->shm_area->allocspace);
+    self->shm_area->allocspace =
+        shm_alloc_space_new_aligned (self->shm_area->shm_area_len, alignment);
+  }
+
+  return 0;
+}
+
+size_t
+sp_writer_get_alignment (ShmPipe * self)
+{
+  return shm_alloc_space_get_alignment (self->shm_area->allocspace);
+}
+
+void
+sp_writer_get_alloc_stats (ShmPipe * self, ShmAllocStats * stats)
+{
+  shm_alloc_space_get_stats (self->shm_area->allocspace, stats);
+}
+
+int
+sp_writer_enable_ring (ShmPipe * self, unsigned int n_slots)
+{
+  ShmRing *ring;
+  char tmppath[32];
+  uint32_t n = 1;
+  int i = 0;
+
+  if (self->ring || self->clients || n_slots == 0 || n_slots > (1U << 20))
+    return -1;
+
+  while (n < n_slots)
+    n <<= 1;
+
+  ring = sp_ring_new ();
+  ring->n_slots = n;
+  ring->len = sp_ring_size (n);
+
+  do {
+    snprintf (tmppath, sizeof (tmppath), "/shmring.%5d.%5d", getpid (), i++);
+    ring->shm_fd = shm_open (tmppath, O_RDWR | O_CREAT | O_EXCL,
+        sp_ring_perms (self->perms));
+  } while (ring->shm_fd < 0 && errno == EEXIST);
+
+  if (ring->shm_fd < 0)
+    goto error;
+
+  ring->shm_ring_name = strdup (tmppath);
+
+  /* The umask would otherwise remove the write permission */
+  if (fchmod (ring->shm_fd, sp_ring_perms (self->perms)) < 0)
+    goto error;
+
+  if (ftruncate (ring->shm_fd, ring->len))
+    goto error;
+
+  ring->header = mmap (NULL, ring->len, PROT_READ | PROT_WRITE, MAP_SHARED,
+      ring->shm_fd, 0);
+  if (ring->header == MAP_FAILED)
+    goto error;
+
+  ring->header->magic = RING_MAGIC;
+  ring->header->n_slots = n;
+
+  ring->buffers = spalloc_alloc (sizeof (ShmBuffer *) * n);
+  memset (ring->buffers, 0, sizeof (ShmBuffer *) * n);
+
+  self->ring = ring;
+
+  return 0;
+
+error:
+  fprintf (stderr, "Could not create ring (%d): %s\n", errno,
+      strerror (errno));
+  sp_close_ring (ring);
+  return -1;
+}
+
+int
+sp_writer_ring_is_full (ShmPipe * self)
+{
+  ShmRing *ring = self->ring;
+
+  if (!ring || !ring->active_mask)
+    return 0;
+
+  return ring->buffers[ring->header->write_seq & (ring->n_slots - 1)] != NULL;
+}
+
+/* Frees the buffers released by all the clients of the ring, calling
+ * @callback for each of them. Returns the number of slots freed */
+
+int
+sp_writer_ring_reclaim (ShmPipe * self, sp_buffer_free_callback callback,
+    void *user_data)
+{
+  ShmRing *ring = self->ring;
+  uint32_t write_seq;
+  uint32_t seq;
+  int freed = 0;
+
+  if (!ring)
+    return 0;
+
+  write_seq = ring->header->write_seq;
+
+  /* Slots can be released out of order, but they are reused in order */
+  for (seq = ring->tail; seq != write_seq; seq++) {
+    uint32_t idx = seq & (ring->n_slots - 1);
+    ShmBuffer *sb = ring->buffers[idx];
+
+    if (sb && ring->header->slots[idx].pending == 0) {
+      void *tag = NULL;
+
+      /* The clients are done reading the memory */
+      __sync_synchronize ();
+      ring->buffers[idx] = NULL;
+      freed++;
+
+      if (sp_shmbuf_ring_dec (self, sb, &tag) == 0 && callback)
+        callback (tag, user_data);
+    }
+
+    if (seq == ring->tail && ring->buffers[idx] == NULL)
+      ring->tail++;
+  }
+
+  return freed;
+}
+
+/* To be called before waiting on the client fds for buffers to be
+ * released. Returns 1 if some were released in the meantime, and the
+ * wait must be skipped */
+
+int
+sp_writer_ring_prepare_wait (ShmPipe * self, sp_buffer_free_callback callback,
+    void *user_data)
+{
+  if (!self->ring || !self->ring->active_mask)
+    return 0;
+
+  if (sp_writer_ring_reclaim (self, callback, user_data) > 0)
+    return 1;
+
+  self->ring->header->writer_waiting = 1;
+  __sync_synchronize ();
+
+  return sp_writer_ring_reclaim (self, callback, user_data) > 0;
+}
+
+/* Returns the size of the buffer if there was one for this client in the
+ * ring, 0 otherwise and a negative number on error */
+
+long int
+sp_client_ring_recv (ShmPipe * self, char **buf, ShmBufferInfo * info)
+{
+  ShmRing *ring = self->ring;
+  ShmRingHeader *header;
+  uint32_t bit;
+  int retval;
+
+  if (!ring)
+    return 0;
+
+  header = ring->header;
+  bit = 1U << ring->client_id;
+
+  while (ring->read_seq != header->write_seq) {
+    ShmRingSlot *slot = &header->slots[ring->read_seq & (ring->n_slots - 1)];
+    ShmArea *area;
+    ShmRingRef *ref;
+
+    /* Read the slot after the sequence number */
+    __sync_synchronize ();
+
+    /* Skip the slots published before we were attached, the slot can
+     * also already be reused if it was never ours */
+    if (!(slot->pending & bit) || slot->seq != ring->read_seq) {
+      ring->read_seq++;
+      continue;
+    }
+
+    /* Buffers sent on the socket before the server got our attach
+     * message must be received first */
+    if (!ring->started) {
+      char c;
+
+      if (recv (self->main_socket, &c, 1, MSG_PEEK | MSG_DONTWAIT) > 0)
+        return 0;
+    }
+
+    /* The new area is announced on the socket */
+    for (area = self->shm_area; area; area = area->next) {
+      if (area->id == slot->area_id)
+        break;
+    }
+    if (!area)
+      return 0;
+
+    if (info)
+      memset (info, 0, sizeof (ShmBufferInfo));
+
+    retval = sp_client_get_meta (self, slot->meta_area_id, slot->meta_offset,
+        slot->meta_size, info);
+    if (retval == -1)
+      return 0;
+    else if (retval < 0)
+      return -23;
+
+    if (slot->n_extents) {
+      if (sp_client_get_extents (self, area, slot->offset, slot->size,
+              slot->n_extents, info) < 0)
+        return -24;
+    } else if (slot->offset + slot->size > area->shm_area_len) {
+      return -23;
+    }
+
+    ref = spalloc_new (ShmRingRef);
+    ref->buf = area->shm_area_buf + slot->offset;
+    ref->seq = ring->read_seq;
+    ref->next = ring->refs;
+    ring->refs = ref;
+
+    sp_shm_area_inc (area);
+    ring->started = 1;
+    ring->read_seq++;
+
+    *buf = ref->buf;
+    return slot->size;
+  }
+
+  return 0;
+}
+
+/* To be called before select()ing on the fd. Returns 1 if there is
+ * already something in the ring, and the select() must not block */
+
+int
+sp_client_ring_prepare_wait (ShmPipe * self)
+{
+  ShmRing *ring = self->ring;
+
+  if (!ring)
+    return 0;
+
+  ring->header->clients[ring->client_id].waiting = 1;
+  __sync_synchronize ();
+
+  if (ring->read_seq != ring->header->write_seq) {
+    ring->header->clients[ring->client_id].waiting = 0;
+    return 1;
+  }
+
+  return 0;
 }
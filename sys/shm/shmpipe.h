@@ -56,6 +56,35 @@
  * buffers are no longer valid. If was valid buffer was received, the
  * client must release it with sp_client_recv_finish() when it is done
  * reading from it.
+ *
+ * A buffer can carry an opaque block of metadata, which must also have
+ * been allocated with sp_writer_alloc_block(). The writer passes it to
+ * sp_writer_send_buf_full(), the block is kept alive until all the
+ * clients have released the buffer. The reader gets it from
+ * sp_client_recv_full(), it can only be read until the next call to one
+ * of the receive functions.
+ *
+ * A buffer can also be made of several pieces of the same shm area,
+ * which the writer sends with sp_writer_send_bufv() without copying
+ * them. That function returns -3 if there was no room for the table
+ * describing the pieces, the writer must then wait like for a failed
+ * allocation. The reader gets the pieces in the ShmBufferInfo filled by
+ * sp_client_recv_full(), and releases the whole buffer by passing the
+ * returned pointer to sp_client_recv_finish().
+ *
+ * Optionally, the writer can call sp_writer_enable_ring() before any
+ * client connects. The buffer descriptors are then passed to the
+ * clients through a ring in a separate shm area instead of the socket,
+ * and the clients release them by writing in that same ring. The socket
+ * is then only used for control messages, and to wake up a side that
+ * said it was going to sleep. The writer must not send a buffer while
+ * sp_writer_ring_is_full() returns true, and must call
+ * sp_writer_ring_reclaim() to get back the buffers released through the
+ * ring. Before waiting for buffers to be released, it calls
+ * sp_writer_ring_prepare_wait(), which will make the next release wake
+ * up the client fd. The reader calls sp_client_ring_recv() to get
+ * buffers from the ring without any syscall, and
+ * sp_client_ring_prepare_wait() before select()ing on its fd.
  */
 
 
@@ -68,6 +97,8 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 
+#include "shmalloc.h"
+
 
 #ifdef __cplusplus
 extern "C" {
@@ -78,8 +109,34 @@ typedef struct _ShmPipe ShmPipe;
 typedef struct _ShmBlock ShmBlock;
 typedef struct _ShmBuffer ShmBuffer;
 
+typedef struct _ShmExtent ShmExtent;
+typedef struct _ShmBufferInfo ShmBufferInfo;
+
 typedef void (*sp_buffer_free_callback) (void * tag, void * user_data);
 
+/* A piece of a buffer */
+struct _ShmExtent
+{
+  char *buf;
+  size_t size;
+};
+
+/* What was received with a buffer, only valid until the next call to one
+ * of the receive functions */
+struct _ShmBufferInfo
+{
+  /* The serialized metadata, NULL if there is none */
+  char *meta;
+  size_t meta_size;
+
+  /* The pieces of a scattered buffer, n_extents is 0 if the buffer is
+   * contiguous */
+  ShmExtent *extents;
+  unsigned int n_extents;
+};
+
+#define SHM_PIPE_DEFAULT_ALIGNMENT 64
+
 ShmPipe *sp_writer_create (const char *path, size_t size, mode_t perms);
 const char *sp_writer_get_path (ShmPipe *pipe);
 void sp_writer_close (ShmPipe * self, sp_buffer_free_callback callback,
@@ -96,9 +153,16 @@ int sp_writer_get_client_fd (ShmClient * client);
 ShmBlock *sp_writer_alloc_block (ShmPipe * self, size_t size);
 void sp_writer_free_block (ShmBlock *block);
 int sp_writer_send_buf (ShmPipe * self, char *buf, size_t size, void * tag);
+int sp_writer_send_buf_full (ShmPipe * self, char *buf, size_t size,
+    char *meta, size_t meta_size, void * tag);
+int sp_writer_send_bufv (ShmPipe * self, const ShmExtent * extents,
+    unsigned int n_extents, char *meta, size_t meta_size, void * tag);
 char *sp_writer_block_get_buf (ShmBlock *block);
 ShmPipe *sp_writer_block_get_pipe (ShmBlock *block);
 size_t sp_writer_get_max_buf_size (ShmPipe * self);
+int sp_writer_set_alignment (ShmPipe * self, size_t alignment);
+size_t sp_writer_get_alignment (ShmPipe * self);
+void sp_writer_get_alloc_stats (ShmPipe * self, ShmAllocStats * stats);
 
 ShmClient * sp_writer_accept_client (ShmPipe * self);
 void sp_writer_close_client (ShmPipe *self, ShmClient * client,
@@ -107,14 +171,26 @@ int sp_writer_recv (ShmPipe * self, ShmClient * client, void ** tag);
 
 int sp_writer_pending_writes (ShmPipe * self);
 
+int sp_writer_enable_ring (ShmPipe * self, unsigned int n_slots);
+int sp_writer_ring_is_full (ShmPipe * self);
+int sp_writer_ring_reclaim (ShmPipe * self, sp_buffer_free_callback callback,
+    void * user_data);
+int sp_writer_ring_prepare_wait (ShmPipe * self,
+    sp_buffer_free_callback callback, void * user_data);
+
 ShmBuffer *sp_writer_get_pending_buffers (ShmPipe * self);
 ShmBuffer *sp_writer_get_next_buffer (ShmBuffer * buffer);
 void *sp_writer_buf_get_tag (ShmBuffer * buffer);
 
 ShmPipe *sp_client_open (const char *path);
 long int sp_client_recv (ShmPipe * self, char **buf);
+long int sp_client_recv_full (ShmPipe * self, char **buf,
+    ShmBufferInfo * info);
 int sp_client_recv_finish (ShmPipe * self, char *buf);
 void sp_client_close (ShmPipe * self);
+long int sp_client_ring_recv (ShmPipe * self, char **buf,
+    ShmBufferInfo * info);
+int sp_client_ring_prepare_wait (ShmPipe * self);
 
 #ifdef __cplusplus
 }
@@ -34,6 +34,10 @@
 #include <gst/check/gstcheck.h>
 #include <gst/check/gstconsistencychecker.h>
 #include <gst/base/gstbasesrc.h>
+#include <gst/video/gstvideoaggregator.h>
+
+/* to look at the conversion pool and converters of the pads */
+#include "compositorpad.h"
 
 #define VIDEO_CAPS_STRING               \
     "video/x-raw, "                 \
@@ -1035,6 +1039,368 @@ GST_START_TEST (test_flush_start_flush_stop)
 
 GST_END_TEST;
 
+static void
+threads_handoff_cb (GstElement * fakesink, GstBuffer * buffer, GstPad * pad,
+    GstBuffer ** last)
+{
+  gst_buffer_replace (last, buffer);
+}
+
+/* Runs the pipeline described by @desc, which must contain a fakesink
+ * named "sink", and returns the last buffer it received and the number of
+ * buffers per second */
+static GstBuffer *
+run_pipeline (const gchar * desc, guint num_buffers, gdouble * fps)
+{
+  GstElement *pipeline, *sink;
+  GstBuffer *last = NULL;
+  GstMessage *msg;
+  GstBus *bus;
+  gint64 start, elapsed;
+
+  pipeline = gst_parse_launch (desc, NULL);
+  fail_unless (pipeline != NULL);
+
+  sink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+  g_object_set (sink, "signal-handoffs", TRUE, NULL);
+  g_signal_connect (sink, "handoff", (GCallback) threads_handoff_cb, &last);
+
+  bus = gst_element_get_bus (pipeline);
+  start = g_get_monotonic_time ();
+  fail_if (gst_element_set_state (pipeline,
+          GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE);
+  msg = gst_bus_timed_pop_filtered (bus, GST_CLOCK_TIME_NONE,
+      GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+  elapsed = g_get_monotonic_time () - start;
+  fail_unless (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_EOS);
+  gst_message_unref (msg);
+
+  if (fps)
+    *fps = (gdouble) num_buffers * G_USEC_PER_SEC / MAX (elapsed, 1);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (bus);
+  gst_object_unref (sink);
+  gst_object_unref (pipeline);
+
+  fail_unless (last != NULL);
+  return last;
+}
+
+/* Runs @n_inputs sources of @format through a compositor using @threads
+ * threads, and returns the last output buffer and the number of frames per
+ * second */
+static GstBuffer *
+run_threads_pipeline (guint threads, const gchar * format, guint n_inputs,
+    gint width, gint height, guint num_buffers, gdouble * fps)
+{
+  GstBuffer *last;
+  GString *desc;
+  guint i;
+
+  /* lay the inputs out as a grid with odd offsets, every other input
+   * being half transparent */
+  desc = g_string_new (NULL);
+  g_string_append_printf (desc, "compositor name=comp threads=%u", threads);
+  for (i = 0; i < n_inputs; i++)
+    g_string_append_printf (desc, " sink_%u::xpos=%d sink_%u::ypos=%d"
+        " sink_%u::alpha=%s", i, (i % 4) * width + 3, i, (i / 4) * height + 5,
+        i, (i % 2) ? "0.5" : "1.0");
+  g_string_append_printf (desc, " ! video/x-raw,format=%s ! fakesink name=sink",
+      format);
+  for (i = 0; i < n_inputs; i++)
+    g_string_append_printf (desc, " videotestsrc num-buffers=%u pattern=%u"
+        " ! video/x-raw,format=%s,width=%d,height=%d,framerate=25/1"
+        " ! comp.sink_%u", num_buffers, i % 12, format, width, height, i);
+
+  last = run_pipeline (desc->str, num_buffers, fps);
+  g_string_free (desc, TRUE);
+
+  return last;
+}
+
+static void
+check_buffers_equal (GstBuffer * a, GstBuffer * b)
+{
+  GstMapInfo map_a, map_b;
+
+  fail_unless (gst_buffer_map (a, &map_a, GST_MAP_READ));
+  fail_unless (gst_buffer_map (b, &map_b, GST_MAP_READ));
+  fail_unless_equals_int (map_a.size, map_b.size);
+  fail_unless (memcmp (map_a.data, map_b.data, map_a.size) == 0);
+  gst_buffer_unmap (b, &map_b);
+  gst_buffer_unmap (a, &map_a);
+}
+
+/* blending in stripes on several threads must not change the output, with
+ * inputs taller than a stripe so that most of them start above it */
+GST_START_TEST (test_threads)
+{
+  GstBuffer *reference, *buffer;
+  const gchar *formats[] = { "I420", "NV12", "NV21" };
+  guint threads[] = { 2, 3, 8 };
+  gdouble fps;
+  guint i, j;
+
+  for (i = 0; i < G_N_ELEMENTS (formats); i++) {
+    reference = run_threads_pipeline (1, formats[i], 6, 161, 117, 5, &fps);
+    for (j = 0; j < G_N_ELEMENTS (threads); j++) {
+      buffer = run_threads_pipeline (threads[j], formats[i], 6, 161, 117, 5,
+          &fps);
+      check_buffers_equal (reference, buffer);
+      gst_buffer_unref (buffer);
+    }
+    gst_buffer_unref (reference);
+  }
+}
+
+GST_END_TEST;
+
+/* 16 inputs mixed into a 1080p grid, reports frames/second per thread count */
+GST_START_TEST (test_threads_benchmark)
+{
+  GstBuffer *buffer;
+  guint threads[] = { 1, 2, 4, 8 };
+  gdouble fps;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (threads); i++) {
+    buffer = run_threads_pipeline (threads[i], "I420", 16, 480, 270, 30,
+        &fps);
+    GST_INFO ("%u threads: %.1f frames/second", threads[i], fps);
+    gst_buffer_unref (buffer);
+  }
+}
+
+GST_END_TEST;
+
+/* inputs hidden by an opaque input, and the background under it, must not
+ * change the output */
+GST_START_TEST (test_occlusion)
+{
+  GstBuffer *reference, *buffer;
+  const gchar *formats[] = { "AYUV", "I420", "BGRx" };
+  gchar *desc;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (formats); i++) {
+    desc = g_strdup_printf ("compositor name=comp ! video/x-raw,format=%s"
+        " ! fakesink name=sink videotestsrc num-buffers=3 pattern=smpte"
+        " ! video/x-raw,format=I420,width=320,height=240 ! comp.sink_0",
+        formats[i]);
+    reference = run_pipeline (desc, 3, NULL);
+    g_free (desc);
+
+    desc = g_strdup_printf ("compositor name=comp sink_1::zorder=1"
+        " sink_1::xpos=40 sink_1::ypos=30 sink_2::zorder=2 sink_2::alpha=0.5"
+        " sink_2::xpos=100 sink_3::zorder=3"
+        " ! video/x-raw,format=%s ! fakesink name=sink"
+        " videotestsrc num-buffers=3 pattern=snow"
+        " ! video/x-raw,format=AYUV,width=160,height=120 ! comp.sink_2"
+        " videotestsrc num-buffers=3 pattern=ball"
+        " ! video/x-raw,format=I420,width=160,height=120 ! comp.sink_1"
+        " videotestsrc num-buffers=3 pattern=smpte"
+        " ! video/x-raw,format=I420,width=320,height=240 ! comp.sink_3",
+        formats[i]);
+    buffer = run_pipeline (desc, 3, NULL);
+    g_free (desc);
+
+    check_buffers_equal (reference, buffer);
+    gst_buffer_unref (buffer);
+    gst_buffer_unref (reference);
+  }
+}
+
+GST_END_TEST;
+
+#define CONVERSION_FRAMES 50
+
+/* converted frames are taken from a pool instead of being allocated for
+ * every frame */
+GST_START_TEST (test_conversion_pool)
+{
+  GstElement *pipeline, *compositor;
+  GstCompositorPad *cpad;
+  GstMessage *msg;
+  GstPad *pad;
+  GstBus *bus;
+  gchar *desc;
+
+  desc = g_strdup_printf ("compositor name=comp ! video/x-raw,format=AYUV"
+      " ! fakesink sync=false videotestsrc num-buffers=%u pattern=smpte"
+      " ! video/x-raw,format=I420,width=320,height=240,framerate=25/1"
+      " ! comp.sink_0", CONVERSION_FRAMES);
+  pipeline = gst_parse_launch (desc, NULL);
+  g_free (desc);
+  fail_unless (pipeline != NULL);
+
+  compositor = gst_bin_get_by_name (GST_BIN (pipeline), "comp");
+  pad = gst_element_get_static_pad (compositor, "sink_0");
+  fail_unless (pad != NULL);
+
+  bus = gst_element_get_bus (pipeline);
+  fail_if (gst_element_set_state (pipeline,
+          GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE);
+  msg = gst_bus_timed_pop_filtered (bus, GST_CLOCK_TIME_NONE,
+      GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+  fail_unless (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_EOS);
+  gst_message_unref (msg);
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+
+  cpad = (GstCompositorPad *) pad;
+  GST_INFO ("Conversion pool: %" G_GUINT64_FORMAT " hits, %" G_GUINT64_FORMAT
+      " misses", cpad->pool_hits, cpad->pool_misses);
+  fail_unless_equals_uint64 (cpad->pool_hits + cpad->pool_misses,
+      CONVERSION_FRAMES);
+  fail_unless (cpad->pool_misses <= 2);
+
+  gst_object_unref (pad);
+  gst_object_unref (compositor);
+  gst_object_unref (bus);
+  gst_object_unref (pipeline);
+}
+
+GST_END_TEST;
+
+#define SIZE_CHANGE_FRAMES 40
+/* input size switches every that many frames */
+#define SIZE_CHANGE_PERIOD 4
+#define FRAME_DURATION (40 * GST_MSECOND)
+
+static void
+collect_handoff_cb (GstElement * fakesink, GstBuffer * buffer, GstPad * pad,
+    GPtrArray * buffers)
+{
+  g_ptr_array_add (buffers, gst_buffer_ref (buffer));
+}
+
+/* Returns a gray I420 frame of @luma */
+static GstBuffer *
+create_gray_frame (gint width, gint height, guint8 luma)
+{
+  gsize luma_size = width * height;
+  GstBuffer *buffer;
+
+  buffer = gst_buffer_new_allocate (NULL, luma_size + luma_size / 2, NULL);
+  gst_buffer_memset (buffer, 0, luma, luma_size);
+  gst_buffer_memset (buffer, luma_size, 128, luma_size / 2);
+
+  return buffer;
+}
+
+/* the converters of both input sizes are cached and reused when the
+ * input switches back and forth between them, without changing the
+ * output */
+GST_START_TEST (test_conversion_size_change)
+{
+  const guint8 lumas[] = { 80, 200 };
+  GstBuffer *reference[2] = { NULL, NULL };
+  GstElement *pipeline, *compositor, *sink;
+  GPtrArray *buffers;
+  GstCompositorPad *cpad;
+  GstSegment segment;
+  GstMessage *msg;
+  GstPad *pad;
+  GstBus *bus;
+  guint i;
+
+  pipeline = gst_parse_launch ("compositor name=comp"
+      " ! video/x-raw,format=AYUV,width=320,height=240,colorimetry=bt601"
+      " ! fakesink name=sink sync=false", NULL);
+  fail_unless (pipeline != NULL);
+
+  buffers = g_ptr_array_new_with_free_func ((GDestroyNotify) gst_buffer_unref);
+  sink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+  g_object_set (sink, "signal-handoffs", TRUE, NULL);
+  g_signal_connect (sink, "handoff", (GCallback) collect_handoff_cb, buffers);
+
+  /* both input sizes are scaled to the output size */
+  compositor = gst_bin_get_by_name (GST_BIN (pipeline), "comp");
+  pad = gst_element_get_request_pad (compositor, "sink_%u");
+  fail_unless (pad != NULL);
+  g_object_set (pad, "width", 320, "height", 240, NULL);
+
+  bus = gst_element_get_bus (pipeline);
+  fail_if (gst_element_set_state (pipeline,
+          GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE);
+
+  gst_pad_send_event (pad, gst_event_new_stream_start ("test"));
+
+  for (i = 0; i < SIZE_CHANGE_FRAMES; i++) {
+    guint small = (i / SIZE_CHANGE_PERIOD) % 2;
+    gint width = small ? 160 : 320;
+    gint height = small ? 120 : 240;
+    GstBuffer *buffer;
+
+    if (i % SIZE_CHANGE_PERIOD == 0) {
+      GstCaps *caps;
+
+      caps = gst_caps_new_simple ("video/x-raw",
+          "format", G_TYPE_STRING, "I420",
+          "width", G_TYPE_INT, width, "height", G_TYPE_INT, height,
+          "framerate", GST_TYPE_FRACTION, 25, 1,
+          "pixel-aspect-ratio", GST_TYPE_FRACTION, 1, 1,
+          "colorimetry", G_TYPE_STRING, "bt601", NULL);
+      fail_unless (gst_pad_set_caps (pad, caps));
+      gst_caps_unref (caps);
+    }
+
+    if (i == 0) {
+      gst_segment_init (&segment, GST_FORMAT_TIME);
+      gst_pad_send_event (pad, gst_event_new_segment (&segment));
+    }
+
+    buffer = create_gray_frame (width, height, lumas[small]);
+    GST_BUFFER_PTS (buffer) = i * FRAME_DURATION;
+    GST_BUFFER_DURATION (buffer) = FRAME_DURATION;
+    fail_unless_equals_int (gst_pad_chain (pad, buffer), GST_FLOW_OK);
+  }
+  gst_pad_send_event (pad, gst_event_new_eos ());
+
+  msg = gst_bus_timed_pop_filtered (bus, GST_CLOCK_TIME_NONE,
+      GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+  fail_unless (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_EOS);
+  gst_message_unref (msg);
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+
+  /* A converter would have been created, and the cache filled, on every
+   * switch if they weren't reused */
+  cpad = (GstCompositorPad *) pad;
+  fail_unless_equals_int (cpad->n_converters, 2);
+  /* The converted frames have the output size, whatever the input size */
+  fail_unless (cpad->pool_misses <= 2);
+
+  /* Frames converted by a reused converter are the same as the ones
+   * converted right after it was created */
+  fail_unless_equals_int (buffers->len, SIZE_CHANGE_FRAMES);
+  for (i = 0; i < buffers->len; i++) {
+    GstBuffer *buffer = g_ptr_array_index (buffers, i);
+    guint index = GST_BUFFER_PTS (buffer) / FRAME_DURATION;
+    guint small = (index / SIZE_CHANGE_PERIOD) % 2;
+    guint8 luma;
+
+    /* AYUV, luma of the pixel in the center */
+    fail_unless_equals_int (gst_buffer_extract (buffer,
+            (120 * 320 + 160) * 4 + 1, &luma, 1), 1);
+    fail_unless (ABS (luma - lumas[small]) <= 4);
+
+    if (reference[small] == NULL)
+      reference[small] = buffer;
+    else
+      check_buffers_equal (reference[small], buffer);
+  }
+
+  g_ptr_array_unref (buffers);
+  gst_element_release_request_pad (compositor, pad);
+  gst_object_unref (pad);
+  gst_object_unref (compositor);
+  gst_object_unref (sink);
+  gst_object_unref (bus);
+  gst_object_unref (pipeline);
+}
+
+GST_END_TEST;
+
 
 static Suite *
 compositor_suite (void)
@@ -1054,6 +1420,11 @@ compositor_suite (void)
   tcase_add_test (tc_chain, test_duration_unknown_overrides);
   tcase_add_test (tc_chain, test_loop);
   tcase_add_test (tc_chain, test_flush_start_flush_stop);
+  tcase_add_test (tc_chain, test_threads);
+  tcase_add_test (tc_chain, test_threads_benchmark);
+  tcase_add_test (tc_chain, test_occlusion);
+  tcase_add_test (tc_chain, test_conversion_pool);
+  tcase_add_test (tc_chain, test_conversion_size_change);
 
   /* Use a longer timeout */
 #ifdef HAVE_VALGRIND
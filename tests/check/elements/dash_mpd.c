@@ -0,0 +1,394 @@
+/* GStreamer
+ *
+ * unit test for the dashdemux MPD parser
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <gst/check/gstcheck.h>
+
+#undef GST_CAT_DEFAULT
+#include "gstmpdparser.h"
+#include "gstmpdparser.c"
+
+GST_DEBUG_CATEGORY (gst_dash_demux_debug);
+
+#define MPD_URI "http://example.com/dash/test.mpd"
+
+/* 6 segments of timescale 10: 4 of 2s given by two S nodes that continue
+ * each other, a gap, and 2 of 3s with the last one cut by the end of the
+ * period at 15s */
+static const gchar *TIMELINE_MPD = "<?xml version=\"1.0\"?>\
+<MPD xmlns=\"urn:mpeg:dash:schema:mpd:2011\"\
+     profiles=\"urn:mpeg:dash:profile:isoff-live:2011\"\
+     type=\"static\" mediaPresentationDuration=\"PT15S\">\
+  <Period id=\"p0\" start=\"PT0S\" duration=\"PT15S\">\
+    <AdaptationSet mimeType=\"video/mp4\">\
+      <SegmentTemplate timescale=\"10\" startNumber=\"1\"\
+                       media=\"$RepresentationID$/$Number$.m4s\">\
+        <SegmentTimeline>\
+          <S t=\"0\" d=\"20\" r=\"2\"/>\
+          <S d=\"20\"/>\
+          <S t=\"100\" d=\"30\" r=\"1\"/>\
+        </SegmentTimeline>\
+      </SegmentTemplate>\
+      <Representation id=\"v1\" bandwidth=\"250000\"/>\
+      <Representation id=\"v2\" bandwidth=\"1000000\"/>\
+    </AdaptationSet>\
+  </Period>\
+</MPD>";
+
+static GstMpdClient *
+setup_client (const gchar * mpd)
+{
+  GstMpdClient *client;
+  GList *adapt_sets;
+
+  client = gst_mpd_client_new ();
+  client->mpd_uri = g_strdup (MPD_URI);
+  fail_unless (gst_mpd_parse (client, mpd, strlen (mpd)));
+  fail_unless (gst_mpd_client_setup_media_presentation (client));
+
+  adapt_sets = gst_mpd_client_get_adaptation_sets (client);
+  fail_unless (adapt_sets != NULL);
+  fail_unless (gst_mpd_client_setup_streaming (client, adapt_sets->data));
+
+  return client;
+}
+
+GST_START_TEST (test_segment_timeline)
+{
+  GstMpdClient *client;
+  GstActiveStream *stream;
+  GstMediaSegment segment;
+  GstMediaFragmentInfo fragment;
+
+  client = setup_client (TIMELINE_MPD);
+  stream = gst_mpdparser_get_active_stream_by_index (client, 0);
+
+  /* no list is built for the template, the S nodes are merged in runs */
+  fail_unless (stream->segments == NULL);
+  fail_unless (stream->cur_timeline != NULL);
+  fail_unless_equals_int (stream->cur_timeline->runs->len, 2);
+  fail_unless_equals_int (stream->cur_timeline->n_segments, 6);
+
+  fail_unless (gst_mpdparser_get_chunk_by_index (client, 0, 3, &segment));
+  fail_unless_equals_int (segment.number, 4);
+  fail_unless_equals_uint64 (segment.start, 60);
+  fail_unless_equals_uint64 (segment.start_time, 6 * GST_SECOND);
+  fail_unless_equals_uint64 (segment.duration, 2 * GST_SECOND);
+
+  fail_unless (gst_mpdparser_get_chunk_by_index (client, 0, 4, &segment));
+  fail_unless_equals_int (segment.number, 5);
+  fail_unless_equals_uint64 (segment.start, 100);
+  fail_unless_equals_uint64 (segment.start_time, 10 * GST_SECOND);
+  fail_unless_equals_uint64 (segment.duration, 3 * GST_SECOND);
+
+  /* the last segment ends with the period */
+  fail_unless (gst_mpdparser_get_chunk_by_index (client, 0, 5, &segment));
+  fail_unless_equals_uint64 (segment.start_time, 13 * GST_SECOND);
+  fail_unless_equals_uint64 (segment.duration, 2 * GST_SECOND);
+  fail_if (gst_mpdparser_get_chunk_by_index (client, 0, 6, &segment));
+
+  fail_unless (gst_mpd_client_stream_seek (client, stream, 5 * GST_SECOND));
+  fail_unless_equals_int (gst_mpd_client_get_segment_index (stream), 2);
+  fail_unless (gst_mpd_client_stream_seek (client, stream, 11 * GST_SECOND));
+  fail_unless_equals_int (gst_mpd_client_get_segment_index (stream), 4);
+  /* nothing in the gap */
+  fail_if (gst_mpd_client_stream_seek (client, stream, 9 * GST_SECOND));
+
+  fail_unless (gst_mpd_client_get_next_fragment (client, 0, &fragment));
+  fail_unless_equals_string (fragment.uri, "http://example.com/dash/v1/5.m4s");
+  fail_unless_equals_uint64 (fragment.timestamp, 10 * GST_SECOND);
+  gst_media_fragment_info_clear (&fragment);
+
+  /* switching keeps the runs of the shared timeline */
+  fail_unless (gst_mpd_client_setup_representation (client, stream,
+          g_list_nth_data (stream->cur_adapt_set->Representations, 1)));
+  fail_unless_equals_int (stream->cur_timeline->n_segments, 6);
+  fail_unless (gst_mpd_client_get_next_fragment (client, 0, &fragment));
+  fail_unless_equals_string (fragment.uri, "http://example.com/dash/v2/5.m4s");
+  gst_media_fragment_info_clear (&fragment);
+
+  gst_mpd_client_free (client);
+}
+
+GST_END_TEST;
+
+#define LARGE_SEGMENTS (24 * 60 * 30)
+
+/* A 24 hours window of 2 seconds segments, one S node each, alternating
+ * every 10 segments with a slightly shorter duration */
+static gchar *
+build_large_mpd (void)
+{
+  GString *mpd = g_string_new (NULL);
+  gint i;
+
+  g_string_append (mpd, "<?xml version=\"1.0\"?>"
+      "<MPD xmlns=\"urn:mpeg:dash:schema:mpd:2011\""
+      " profiles=\"urn:mpeg:dash:profile:isoff-live:2011\""
+      " type=\"static\" mediaPresentationDuration=\"PT24H\">"
+      "<Period id=\"p0\" start=\"PT0S\" duration=\"PT24H\">"
+      "<AdaptationSet mimeType=\"video/mp4\">"
+      "<SegmentTemplate timescale=\"1000\" startNumber=\"1\""
+      " media=\"$RepresentationID$/$Time$.m4s\">" "<SegmentTimeline>");
+  for (i = 0; i < LARGE_SEGMENTS; i++)
+    g_string_append_printf (mpd, "<S d=\"%d\"/>",
+        (i / 10) % 2 ? 1980 : 2000);
+  g_string_append (mpd, "</SegmentTimeline></SegmentTemplate>"
+      "<Representation id=\"v1\" bandwidth=\"250000\"/>"
+      "<Representation id=\"v2\" bandwidth=\"1000000\"/>"
+      "<Representation id=\"v3\" bandwidth=\"2500000\"/>"
+      "<Representation id=\"v4\" bandwidth=\"5000000\"/>"
+      "</AdaptationSet></Period></MPD>");
+
+  return g_string_free (mpd, FALSE);
+}
+
+/* Logs how long representation switches and seeks take on the large MPD,
+ * neither should depend on the number of segments of the window */
+GST_START_TEST (test_segment_timeline_large)
+{
+  GstMpdClient *client;
+  GstActiveStream *stream;
+  GstMediaSegment segment;
+  GstClockTime start, position;
+  gchar *mpd;
+  gint i;
+
+  mpd = build_large_mpd ();
+  start = gst_util_get_timestamp ();
+  client = setup_client (mpd);
+  GST_INFO ("parsing and setting up %d segments took %" GST_TIME_FORMAT,
+      LARGE_SEGMENTS, GST_TIME_ARGS (gst_util_get_timestamp () - start));
+  g_free (mpd);
+
+  stream = gst_mpdparser_get_active_stream_by_index (client, 0);
+  fail_unless_equals_int (stream->cur_timeline->n_segments, LARGE_SEGMENTS);
+  fail_unless_equals_int (stream->cur_timeline->runs->len,
+      LARGE_SEGMENTS / 10);
+
+  start = gst_util_get_timestamp ();
+  for (i = 0; i < 10000; i++) {
+    fail_unless (gst_mpd_client_setup_representation (client, stream,
+            g_list_nth_data (stream->cur_adapt_set->Representations, i % 4)));
+  }
+  GST_INFO ("10000 representation switches took %" GST_TIME_FORMAT,
+      GST_TIME_ARGS (gst_util_get_timestamp () - start));
+
+  /* 20 segments of 2s and 1.98s every 39.8s */
+  fail_unless (gst_mpdparser_get_chunk_by_index (client, 0,
+          LARGE_SEGMENTS - 1, &segment));
+  fail_unless_equals_uint64 (segment.start,
+      (LARGE_SEGMENTS / 20) * 39800 - 1980);
+  fail_if (gst_mpdparser_get_chunk_by_index (client, 0, LARGE_SEGMENTS,
+          &segment));
+
+  start = gst_util_get_timestamp ();
+  for (i = 0; i < 10000; i++) {
+    guint index = (i * 7919) % LARGE_SEGMENTS;
+
+    fail_unless (gst_mpdparser_get_chunk_by_index (client, 0, index,
+            &segment));
+    position = segment.start_time + segment.duration / 2;
+    fail_unless (gst_mpd_client_stream_seek (client, stream, position));
+    fail_unless_equals_int (gst_mpd_client_get_segment_index (stream), index);
+  }
+  GST_INFO ("10000 lookups and seeks took %" GST_TIME_FORMAT,
+      GST_TIME_ARGS (gst_util_get_timestamp () - start));
+
+  gst_mpd_client_free (client);
+}
+
+GST_END_TEST;
+
+/* A live window of @count segments of 2s, starting with segment @first */
+static gchar *
+build_live_mpd (const gchar * rep_id, guint first, guint count,
+    gboolean one_s_per_segment)
+{
+  GString *mpd = g_string_new (NULL);
+  guint i;
+
+  g_string_append_printf (mpd, "<?xml version=\"1.0\"?>"
+      "<MPD xmlns=\"urn:mpeg:dash:schema:mpd:2011\""
+      " profiles=\"urn:mpeg:dash:profile:isoff-live:2011\""
+      " type=\"dynamic\" minimumUpdatePeriod=\"PT1S\">"
+      "<Period id=\"p0\" start=\"PT0S\">"
+      "<AdaptationSet mimeType=\"video/mp4\">"
+      "<SegmentTemplate timescale=\"10\" startNumber=\"%u\""
+      " media=\"$RepresentationID$/$Number$.m4s\">" "<SegmentTimeline>",
+      first + 1);
+  if (one_s_per_segment) {
+    g_string_append_printf (mpd, "<S t=\"%u\" d=\"20\"/>", first * 20);
+    for (i = 1; i < count; i++)
+      g_string_append (mpd, "<S d=\"20\"/>");
+  } else {
+    g_string_append_printf (mpd, "<S t=\"%u\" d=\"20\" r=\"%u\"/>",
+        first * 20, count - 1);
+  }
+  g_string_append_printf (mpd, "</SegmentTimeline></SegmentTemplate>"
+      "<Representation id=\"%s\" bandwidth=\"250000\"/>"
+      "</AdaptationSet></Period></MPD>", rep_id);
+
+  return g_string_free (mpd, FALSE);
+}
+
+static GstMpdClient *
+parse_update (const gchar * mpd)
+{
+  GstMpdClient *update = gst_mpd_client_new ();
+
+  update->mpd_uri = g_strdup (MPD_URI);
+  fail_unless (gst_mpd_parse (update, mpd, strlen (mpd)));
+
+  return update;
+}
+
+GST_START_TEST (test_live_update_merge)
+{
+  GstMpdClient *client, *update;
+  GstActiveStream *stream;
+  GstMediaSegment segment;
+  GstMediaFragmentInfo fragment;
+  gchar *mpd;
+
+  mpd = build_live_mpd ("v1", 0, 10, FALSE);
+  client = setup_client (mpd);
+  g_free (mpd);
+  stream = gst_mpdparser_get_active_stream_by_index (client, 0);
+
+  fail_unless (gst_mpd_client_stream_seek (client, stream, 9 * GST_SECOND));
+  fail_unless_equals_int (gst_mpd_client_get_segment_index (stream), 4);
+
+  /* the window moved by 3 segments */
+  mpd = build_live_mpd ("v1", 3, 10, FALSE);
+  update = parse_update (mpd);
+  g_free (mpd);
+  fail_unless (gst_mpd_client_merge (client, update));
+  gst_mpd_client_free (update);
+
+  /* same stream, still on the same segment */
+  fail_unless (gst_mpdparser_get_active_stream_by_index (client, 0) == stream);
+  fail_unless_equals_int (stream->cur_timeline->n_segments, 10);
+  fail_unless_equals_int (gst_mpd_client_get_segment_index (stream), 1);
+  fail_unless (gst_mpd_client_get_next_fragment (client, 0, &fragment));
+  fail_unless_equals_string (fragment.uri, "http://example.com/dash/v1/5.m4s");
+  fail_unless_equals_uint64 (fragment.timestamp, 8 * GST_SECOND);
+  gst_media_fragment_info_clear (&fragment);
+
+  fail_unless (gst_mpdparser_get_chunk_by_index (client, 0, 9, &segment));
+  fail_unless_equals_int (segment.number, 13);
+  fail_unless_equals_uint64 (segment.start_time, 24 * GST_SECOND);
+
+  /* the last known segment (24s to 26s) was provisional and got longer,
+   * the update doesn't line up with the known segments */
+  update = parse_update ("<?xml version=\"1.0\"?>"
+      "<MPD xmlns=\"urn:mpeg:dash:schema:mpd:2011\""
+      " profiles=\"urn:mpeg:dash:profile:isoff-live:2011\""
+      " type=\"dynamic\" minimumUpdatePeriod=\"PT1S\">"
+      "<Period id=\"p0\" start=\"PT0S\">"
+      "<AdaptationSet mimeType=\"video/mp4\">"
+      "<SegmentTemplate timescale=\"10\" startNumber=\"5\""
+      " media=\"$RepresentationID$/$Number$.m4s\">" "<SegmentTimeline>"
+      "<S t=\"80\" d=\"20\" r=\"7\"/><S d=\"30\"/><S d=\"20\" r=\"1\"/>"
+      "</SegmentTimeline></SegmentTemplate>"
+      "<Representation id=\"v1\" bandwidth=\"250000\"/>"
+      "</AdaptationSet></Period></MPD>");
+  fail_if (gst_mpd_client_merge (client, update));
+  gst_mpd_client_free (update);
+  fail_unless_equals_int (stream->cur_timeline->n_segments, 10);
+  fail_unless (gst_mpdparser_get_chunk_by_index (client, 0, 9, &segment));
+  fail_unless_equals_uint64 (segment.duration, 2 * GST_SECOND);
+
+  /* other representations can't be merged */
+  mpd = build_live_mpd ("v2", 4, 10, FALSE);
+  update = parse_update (mpd);
+  g_free (mpd);
+  fail_if (gst_mpd_client_merge (client, update));
+  gst_mpd_client_free (update);
+  fail_unless_equals_int (stream->cur_timeline->n_segments, 10);
+
+  gst_mpd_client_free (client);
+}
+
+GST_END_TEST;
+
+/* Logs how long parsing the large MPDs takes, and refreshing a live one */
+GST_START_TEST (test_parse_large)
+{
+  GstMpdClient *client, *update;
+  GstActiveStream *stream;
+  GstClockTime start;
+  gchar *mpd;
+  gint i;
+
+  mpd = build_large_mpd ();
+  start = gst_util_get_timestamp ();
+  for (i = 0; i < 10; i++) {
+    client = gst_mpd_client_new ();
+    fail_unless (gst_mpd_parse (client, mpd, strlen (mpd)));
+    gst_mpd_client_free (client);
+  }
+  GST_INFO ("parsing a %" G_GSIZE_FORMAT " bytes MPD took %" GST_TIME_FORMAT,
+      strlen (mpd), GST_TIME_ARGS ((gst_util_get_timestamp () - start) / 10));
+  g_free (mpd);
+
+  mpd = build_live_mpd ("v1", 0, LARGE_SEGMENTS, TRUE);
+  client = setup_client (mpd);
+  g_free (mpd);
+  stream = gst_mpdparser_get_active_stream_by_index (client, 0);
+  gst_mpd_client_set_segment_index (stream, LARGE_SEGMENTS - 1);
+
+  mpd = build_live_mpd ("v1", 30, LARGE_SEGMENTS, TRUE);
+  start = gst_util_get_timestamp ();
+  update = parse_update (mpd);
+  fail_unless (gst_mpd_client_merge (client, update));
+  gst_mpd_client_free (update);
+  GST_INFO ("refreshing a %d segments window took %" GST_TIME_FORMAT,
+      LARGE_SEGMENTS, GST_TIME_ARGS (gst_util_get_timestamp () - start));
+  g_free (mpd);
+
+  fail_unless_equals_int (stream->cur_timeline->n_segments, LARGE_SEGMENTS);
+  fail_unless_equals_int (stream->cur_timeline->runs->len, 1);
+  fail_unless_equals_int (gst_mpd_client_get_segment_index (stream),
+      LARGE_SEGMENTS - 31);
+
+  gst_mpd_client_free (client);
+}
+
+GST_END_TEST;
+
+static Suite *
+dash_mpd_suite (void)
+{
+  Suite *s = suite_create ("dash_mpd");
+  TCase *tc_core = tcase_create ("mpdparser");
+
+  GST_DEBUG_CATEGORY_INIT (gst_dash_demux_debug, "dashdemux", 0,
+      "dashdemux mpd test");
+
+  suite_add_tcase (s, tc_core);
+  tcase_add_test (tc_core, test_segment_timeline);
+  tcase_add_test (tc_core, test_segment_timeline_large);
+  tcase_add_test (tc_core, test_live_update_merge);
+  tcase_add_test (tc_core, test_parse_large);
+
+  return s;
+}
+
+GST_CHECK_MAIN (dash_mpd);
@@ -84,6 +84,19 @@ https://priv.example.com/fileSequence3003.ts\n\
 #EXTINF:8,\n\
 https://priv.example.com/fileSequence3004.ts";
 
+static const gchar *LIVE_SLIDED_PLAYLIST = "#EXTM3U\n\
+#EXT-X-TARGETDURATION:8\n\
+#EXT-X-MEDIA-SEQUENCE:2682\n\
+\n\
+#EXTINF:8,\n\
+https://priv.example.com/fileSequence2682.ts\n\
+#EXTINF:8,\n\
+https://priv.example.com/fileSequence2683.ts\n\
+#EXTINF:8,\n\
+https://priv.example.com/fileSequence2684.ts\n\
+#EXTINF:8,\n\
+https://priv.example.com/fileSequence2685.ts";
+
 static const gchar *VARIANT_PLAYLIST = "#EXTM3U \n\
 #EXT-X-STREAM-INF:PROGRAM-ID=1,BANDWIDTH=128000\n\
 http://example.com/low.m3u8\n\
@@ -345,8 +358,8 @@ GST_START_TEST (test_load_main_playlist_rendition)
 
   client = load_playlist (ON_DEMAND_PLAYLIST);
 
-  assert_equals_int (g_list_length (client->main->files), 4);
-  assert_equals_int (g_list_length (client->current->files), 4);
+  assert_equals_int (client->main->files->len, 4);
+  assert_equals_int (client->current->files->len, 4);
   assert_equals_int (client->sequence, 0);
 
   gst_m3u8_client_free (client);
@@ -444,13 +457,14 @@ check_on_demand_playlist (const gchar * data)
   /* Check that we are not live */
   assert_equals_int (gst_m3u8_client_is_live (client), FALSE);
   /* Check number of entries */
-  assert_equals_int (g_list_length (pl->files), 4);
+  assert_equals_int (pl->files->len, 4);
   /* Check first media segments */
-  file = GST_M3U8_MEDIA_FILE (g_list_first (pl->files)->data);
+  file = GST_M3U8_MEDIA_FILE (g_ptr_array_index (pl->files, 0));
   assert_equals_string (file->uri, "http://media.example.com/001.ts");
   assert_equals_int (file->sequence, 0);
   /* Check last media segments */
-  file = GST_M3U8_MEDIA_FILE (g_list_last (pl->files)->data);
+  file =
+      GST_M3U8_MEDIA_FILE (g_ptr_array_index (pl->files, pl->files->len - 1));
   assert_equals_string (file->uri, "http://media.example.com/004.ts");
   assert_equals_int (file->sequence, 3);
 
@@ -499,14 +513,15 @@ GST_START_TEST (test_live_playlist)
   /* FIXME: Sequence should last - 3. Should it? */
   assert_equals_int (client->sequence, 2680);
   /* Check number of entries */
-  assert_equals_int (g_list_length (pl->files), 4);
+  assert_equals_int (pl->files->len, 4);
   /* Check first media segments */
-  file = GST_M3U8_MEDIA_FILE (g_list_first (pl->files)->data);
+  file = GST_M3U8_MEDIA_FILE (g_ptr_array_index (pl->files, 0));
   assert_equals_string (file->uri,
       "https://priv.example.com/fileSequence2680.ts");
   assert_equals_int (file->sequence, 2680);
   /* Check last media segments */
-  file = GST_M3U8_MEDIA_FILE (g_list_last (pl->files)->data);
+  file =
+      GST_M3U8_MEDIA_FILE (g_ptr_array_index (pl->files, pl->files->len - 1));
   assert_equals_string (file->uri,
       "https://priv.example.com/fileSequence2683.ts");
   assert_equals_int (file->sequence, 2683);
@@ -531,7 +546,7 @@ GST_START_TEST (test_live_playlist_rotated)
   /* FIXME: Sequence should last - 3. Should it? */
   assert_equals_int (client->sequence, 2680);
   /* Check first media segments */
-  file = GST_M3U8_MEDIA_FILE (g_list_first (pl->files)->data);
+  file = GST_M3U8_MEDIA_FILE (g_ptr_array_index (pl->files, 0));
   assert_equals_int (file->sequence, 2680);
 
   ret = gst_m3u8_client_update (client, g_strdup (LIVE_ROTATED_PLAYLIST));
@@ -541,7 +556,7 @@ GST_START_TEST (test_live_playlist_rotated)
   /* FIXME: Sequence should last - 3. Should it? */
   assert_equals_int (client->sequence, 3001);
   /* Check first media segments */
-  file = GST_M3U8_MEDIA_FILE (g_list_first (pl->files)->data);
+  file = GST_M3U8_MEDIA_FILE (g_ptr_array_index (pl->files, 0));
   assert_equals_int (file->sequence, 3001);
 
   gst_m3u8_client_free (client);
@@ -559,13 +574,13 @@ GST_START_TEST (test_playlist_with_doubles_duration)
 
   pl = client->current;
   /* Check first media segments */
-  file = GST_M3U8_MEDIA_FILE (g_list_nth_data (pl->files, 0));
+  file = GST_M3U8_MEDIA_FILE (g_ptr_array_index (pl->files, 0));
   assert_equals_uint64 (file->duration, 10.321 * GST_SECOND);
-  file = GST_M3U8_MEDIA_FILE (g_list_nth_data (pl->files, 1));
+  file = GST_M3U8_MEDIA_FILE (g_ptr_array_index (pl->files, 1));
   assert_equals_uint64 (file->duration, 9.6789 * GST_SECOND);
-  file = GST_M3U8_MEDIA_FILE (g_list_nth_data (pl->files, 2));
+  file = GST_M3U8_MEDIA_FILE (g_ptr_array_index (pl->files, 2));
   assert_equals_uint64 (file->duration, 10.2344 * GST_SECOND);
-  file = GST_M3U8_MEDIA_FILE (g_list_nth_data (pl->files, 3));
+  file = GST_M3U8_MEDIA_FILE (g_ptr_array_index (pl->files, 3));
   assert_equals_uint64 (file->duration, 9.92 * GST_SECOND);
   gst_m3u8_client_free (client);
 }
@@ -586,26 +601,26 @@ GST_START_TEST (test_playlist_with_encryption)
   client = load_playlist (AES_128_ENCRYPTED_PLAYLIST);
 
   pl = client->current;
-  assert_equals_int (g_list_length (pl->files), 5);
+  assert_equals_int (pl->files->len, 5);
 
   /* Check all media segments */
-  file = GST_M3U8_MEDIA_FILE (g_list_nth_data (pl->files, 0));
+  file = GST_M3U8_MEDIA_FILE (g_ptr_array_index (pl->files, 0));
   fail_unless (file->key == NULL);
 
-  file = GST_M3U8_MEDIA_FILE (g_list_nth_data (pl->files, 1));
+  file = GST_M3U8_MEDIA_FILE (g_ptr_array_index (pl->files, 1));
   fail_unless (file->key == NULL);
 
-  file = GST_M3U8_MEDIA_FILE (g_list_nth_data (pl->files, 2));
+  file = GST_M3U8_MEDIA_FILE (g_ptr_array_index (pl->files, 2));
   fail_unless (file->key != NULL);
   assert_equals_string (file->key, "https://priv.example.com/key.bin");
   fail_unless (memcmp (&file->iv, iv2, 16) == 0);
 
-  file = GST_M3U8_MEDIA_FILE (g_list_nth_data (pl->files, 3));
+  file = GST_M3U8_MEDIA_FILE (g_ptr_array_index (pl->files, 3));
   fail_unless (file->key != NULL);
   assert_equals_string (file->key, "https://priv.example.com/key2.bin");
   fail_unless (memcmp (&file->iv, iv1, 16) == 0);
 
-  file = GST_M3U8_MEDIA_FILE (g_list_nth_data (pl->files, 4));
+  file = GST_M3U8_MEDIA_FILE (g_ptr_array_index (pl->files, 4));
   fail_unless (file->key != NULL);
   assert_equals_string (file->key, "https://priv.example.com/key2.bin");
   fail_unless (memcmp (&file->iv, iv1, 16) == 0);
@@ -624,7 +639,7 @@ GST_START_TEST (test_update_invalid_playlist)
   /* Test updates in on-demand playlists */
   client = load_playlist (ON_DEMAND_PLAYLIST);
   pl = client->current;
-  assert_equals_int (g_list_length (pl->files), 4);
+  assert_equals_int (pl->files->len, 4);
   ret = gst_m3u8_client_update (client, g_strdup ("#INVALID"));
   assert_equals_int (ret, FALSE);
 
@@ -643,26 +658,26 @@ GST_START_TEST (test_update_playlist)
   /* Test updates in on-demand playlists */
   client = load_playlist (ON_DEMAND_PLAYLIST);
   pl = client->current;
-  assert_equals_int (g_list_length (pl->files), 4);
+  assert_equals_int (pl->files->len, 4);
   ret = gst_m3u8_client_update (client, g_strdup (ON_DEMAND_PLAYLIST));
   assert_equals_int (ret, TRUE);
-  assert_equals_int (g_list_length (pl->files), 4);
+  assert_equals_int (pl->files->len, 4);
   gst_m3u8_client_free (client);
 
   /* Test updates in live playlists */
   client = load_playlist (LIVE_PLAYLIST);
   pl = client->current;
-  assert_equals_int (g_list_length (pl->files), 4);
+  assert_equals_int (pl->files->len, 4);
   /* Add a new entry to the playlist and check the update */
   live_pl = g_strdup_printf ("%s\n%s\n%s", LIVE_PLAYLIST, "#EXTINF:8",
       "https://priv.example.com/fileSequence2683.ts");
   ret = gst_m3u8_client_update (client, live_pl);
   assert_equals_int (ret, TRUE);
-  assert_equals_int (g_list_length (pl->files), 5);
+  assert_equals_int (pl->files->len, 5);
   /* Test sliding window */
   ret = gst_m3u8_client_update (client, g_strdup (LIVE_PLAYLIST));
   assert_equals_int (ret, TRUE);
-  assert_equals_int (g_list_length (pl->files), 4);
+  assert_equals_int (pl->files->len, 4);
   gst_m3u8_client_free (client);
 }
 
@@ -678,9 +693,9 @@ GST_START_TEST (test_playlist_media_files)
   pl = client->current;
 
   /* Check number of entries */
-  assert_equals_int (g_list_length (pl->files), 4);
+  assert_equals_int (pl->files->len, 4);
   /* Check first media segments */
-  file = GST_M3U8_MEDIA_FILE (g_list_first (pl->files)->data);
+  file = GST_M3U8_MEDIA_FILE (g_ptr_array_index (pl->files, 0));
   assert_equals_string (file->uri, "http://media.example.com/001.ts");
   assert_equals_int (file->sequence, 0);
   assert_equals_float (file->duration, 10 * (double) GST_SECOND);
@@ -703,16 +718,17 @@ GST_START_TEST (test_playlist_byte_range_media_files)
   pl = client->current;
 
   /* Check number of entries */
-  assert_equals_int (g_list_length (pl->files), 4);
+  assert_equals_int (pl->files->len, 4);
   /* Check first media segments */
-  file = GST_M3U8_MEDIA_FILE (g_list_first (pl->files)->data);
+  file = GST_M3U8_MEDIA_FILE (g_ptr_array_index (pl->files, 0));
   assert_equals_string (file->uri, "http://media.example.com/all.ts");
   assert_equals_int (file->sequence, 0);
   assert_equals_float (file->duration, 10 * (double) GST_SECOND);
   assert_equals_int (file->offset, 100);
   assert_equals_int (file->size, 1000);
   /* Check last media segments */
-  file = GST_M3U8_MEDIA_FILE (g_list_last (pl->files)->data);
+  file =
+      GST_M3U8_MEDIA_FILE (g_ptr_array_index (pl->files, pl->files->len - 1));
   assert_equals_string (file->uri, "http://media.example.com/all.ts");
   assert_equals_int (file->sequence, 3);
   assert_equals_float (file->duration, 10 * (double) GST_SECOND);
@@ -726,16 +742,17 @@ GST_START_TEST (test_playlist_byte_range_media_files)
   pl = client->current;
 
   /* Check number of entries */
-  assert_equals_int (g_list_length (pl->files), 4);
+  assert_equals_int (pl->files->len, 4);
   /* Check first media segments */
-  file = GST_M3U8_MEDIA_FILE (g_list_first (pl->files)->data);
+  file = GST_M3U8_MEDIA_FILE (g_ptr_array_index (pl->files, 0));
   assert_equals_string (file->uri, "http://media.example.com/all.ts");
   assert_equals_int (file->sequence, 0);
   assert_equals_float (file->duration, 10 * (double) GST_SECOND);
   assert_equals_int (file->offset, 0);
   assert_equals_int (file->size, 1000);
   /* Check last media segments */
-  file = GST_M3U8_MEDIA_FILE (g_list_last (pl->files)->data);
+  file =
+      GST_M3U8_MEDIA_FILE (g_ptr_array_index (pl->files, pl->files->len - 1));
   assert_equals_string (file->uri, "http://media.example.com/all.ts");
   assert_equals_int (file->sequence, 3);
   assert_equals_float (file->duration, 10 * (double) GST_SECOND);
@@ -854,6 +871,136 @@ GST_START_TEST (test_get_stream_for_bitrate)
 
 GST_END_TEST;
 
+/* A live playlist of @count fragments of 2 seconds starting at @first */
+static gchar *
+build_live_playlist (guint first, guint count)
+{
+  GString *pl = g_string_new (NULL);
+  guint i;
+
+  g_string_append_printf (pl, "#EXTM3U\n#EXT-X-TARGETDURATION:2\n"
+      "#EXT-X-MEDIA-SEQUENCE:%u\n", first);
+  for (i = first; i < first + count; i++)
+    g_string_append_printf (pl, "#EXTINF:2,\nfileSequence%u.ts\n", i);
+
+  return g_string_free (pl, FALSE);
+}
+
+GST_START_TEST (test_live_playlist_incremental_update)
+{
+  GstM3U8Client *client;
+  GstM3U8 *pl;
+  GstM3U8MediaFile *file, *known;
+  gboolean ret;
+
+  client = load_playlist (LIVE_PLAYLIST);
+  pl = client->current;
+  known = g_ptr_array_index (pl->files, 2);
+
+  /* two fragments left the window and two were added */
+  ret = gst_m3u8_client_update (client, g_strdup (LIVE_SLIDED_PLAYLIST));
+  assert_equals_int (ret, TRUE);
+  assert_equals_int (pl->files->len, 4);
+
+  /* the known fragments were kept */
+  fail_unless (g_ptr_array_index (pl->files, 0) == known);
+  assert_equals_uint64 (known->start, 16 * GST_SECOND);
+  file = g_ptr_array_index (pl->files, 3);
+  assert_equals_string (file->uri,
+      "https://priv.example.com/fileSequence2685.ts");
+  assert_equals_int (file->sequence, 2685);
+  assert_equals_uint64 (file->start, 40 * GST_SECOND);
+  assert_equals_uint64 (client->last_file_end, 48 * GST_SECOND);
+
+  /* positions are counted from the first fragment of the window */
+  fail_unless (gst_m3u8_client_seek (client, 10 * GST_SECOND));
+  assert_equals_int (client->sequence, 2683);
+  assert_equals_uint64 (client->sequence_position, 8 * GST_SECOND);
+
+  gst_m3u8_client_free (client);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_seek_on_demand)
+{
+  GstM3U8Client *client;
+  GstM3U8MediaFile *file1, *file2;
+
+  client = load_playlist (DOUBLES_PLAYLIST);
+  file1 = g_ptr_array_index (client->current->files, 0);
+  file2 = g_ptr_array_index (client->current->files, 1);
+
+  fail_unless (gst_m3u8_client_seek (client, 0));
+  assert_equals_int (client->sequence, 0);
+  assert_equals_uint64 (client->sequence_position, 0);
+
+  fail_unless (gst_m3u8_client_seek (client, 25 * GST_SECOND));
+  assert_equals_int (client->sequence, 2);
+  assert_equals_uint64 (client->sequence_position,
+      file1->duration + file2->duration);
+
+  /* after the end, the client is placed after the last fragment */
+  fail_if (gst_m3u8_client_seek (client, 50 * GST_SECOND));
+  assert_equals_int (client->sequence, 4);
+  assert_equals_uint64 (client->sequence_position,
+      gst_m3u8_client_get_duration (client));
+
+  gst_m3u8_client_free (client);
+}
+
+GST_END_TEST;
+
+#define LARGE_PLAYLIST_FRAGMENTS 10000
+
+/* Logs how long loading, refreshing and seeking in a long live playlist
+ * take */
+GST_START_TEST (test_live_playlist_large)
+{
+  GstM3U8Client *client;
+  GstM3U8MediaFile *file;
+  GstClockTime start;
+  gchar *data;
+  guint i;
+
+  data = build_live_playlist (0, LARGE_PLAYLIST_FRAGMENTS);
+  start = gst_util_get_timestamp ();
+  client = load_playlist (data);
+  GST_INFO ("loading %d fragments took %" GST_TIME_FORMAT,
+      LARGE_PLAYLIST_FRAGMENTS,
+      GST_TIME_ARGS (gst_util_get_timestamp () - start));
+  assert_equals_int (client->current->files->len, LARGE_PLAYLIST_FRAGMENTS);
+  g_free (data);
+
+  start = gst_util_get_timestamp ();
+  for (i = 1; i <= 100; i++) {
+    fail_unless (gst_m3u8_client_update (client,
+            build_live_playlist (i, LARGE_PLAYLIST_FRAGMENTS)));
+  }
+  GST_INFO ("100 updates took %" GST_TIME_FORMAT,
+      GST_TIME_ARGS (gst_util_get_timestamp () - start));
+
+  assert_equals_int (client->current->files->len, LARGE_PLAYLIST_FRAGMENTS);
+  file = g_ptr_array_index (client->current->files, 0);
+  assert_equals_int (file->sequence, 100);
+  file = g_ptr_array_index (client->current->files,
+      LARGE_PLAYLIST_FRAGMENTS - 1);
+  assert_equals_int (file->sequence, LARGE_PLAYLIST_FRAGMENTS + 99);
+  assert_equals_string (file->uri, "http://localhost/fileSequence10099.ts");
+
+  start = gst_util_get_timestamp ();
+  for (i = 0; i < LARGE_PLAYLIST_FRAGMENTS; i++) {
+    fail_unless (gst_m3u8_client_seek (client, i * 2 * GST_SECOND + 1));
+    assert_equals_int (client->sequence, 100 + i);
+  }
+  GST_INFO ("%d seeks took %" GST_TIME_FORMAT, LARGE_PLAYLIST_FRAGMENTS,
+      GST_TIME_ARGS (gst_util_get_timestamp () - start));
+
+  gst_m3u8_client_free (client);
+}
+
+GST_END_TEST;
+
 #if 0
 static void
 do_test_seek (GstM3U8Client * client, guint seek_pos, gint pos)
@@ -1330,6 +1477,9 @@ hlsdemux_suite (void)
   tcase_add_test (tc_m3u8, test_get_duration);
   tcase_add_test (tc_m3u8, test_get_target_duration);
   tcase_add_test (tc_m3u8, test_get_stream_for_bitrate);
+  tcase_add_test (tc_m3u8, test_live_playlist_incremental_update);
+  tcase_add_test (tc_m3u8, test_seek_on_demand);
+  tcase_add_test (tc_m3u8, test_live_playlist_large);
 #if 0
   tcase_add_test (tc_m3u8, test_seek);
   tcase_add_test (tc_m3u8, test_alternate_audio_playlist);
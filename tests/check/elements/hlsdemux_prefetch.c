@@ -0,0 +1,426 @@
+/* GStreamer
+ *
+ * unit test for the fragment prefetching of hlsdemux
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+
+#include <gst/check/gstcheck.h>
+#include <gst/base/gstbasesrc.h>
+
+#define N_FRAGMENTS 8
+#define PACKETS_PER_FRAGMENT 64
+#define FRAGMENT_SIZE (PACKETS_PER_FRAGMENT * 188)
+/* Time it takes the fake server to answer a request */
+#define REQUEST_LATENCY (50 * G_TIME_SPAN_MILLISECOND)
+
+/* A stand-in for an http source, that serves a playlist and its fragments
+ * from memory after some latency */
+typedef struct
+{
+  GstBaseSrc parent;
+
+  gchar *uri;
+  gchar *data;
+  gsize size;
+  gsize offset;
+} TestHttpSrc;
+
+typedef struct
+{
+  GstBaseSrcClass parent_class;
+} TestHttpSrcClass;
+
+static GType test_http_src_get_type (void);
+static void test_http_src_uri_handler_init (gpointer g_iface,
+    gpointer iface_data);
+
+G_DEFINE_TYPE_WITH_CODE (TestHttpSrc, test_http_src, GST_TYPE_BASE_SRC,
+    G_IMPLEMENT_INTERFACE (GST_TYPE_URI_HANDLER,
+        test_http_src_uri_handler_init));
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC, GST_PAD_ALWAYS, GST_STATIC_CAPS_ANY);
+
+/* requests being answered, and the most there were at the same time */
+G_LOCK_DEFINE_STATIC (requests);
+static guint requests_in_flight, max_requests_in_flight;
+
+static gchar *
+make_playlist (void)
+{
+  GString *s = g_string_new ("#EXTM3U\n#EXT-X-TARGETDURATION:1\n");
+  guint i;
+
+  for (i = 0; i < N_FRAGMENTS; i++)
+    g_string_append_printf (s, "#EXTINF:1,\nfragment%u.ts\n", i);
+  g_string_append (s, "#EXT-X-ENDLIST\n");
+
+  return g_string_free (s, FALSE);
+}
+
+/* MPEG-TS null packets, with the fragment number as payload */
+static gchar *
+make_fragment (guint index)
+{
+  gchar *data = g_malloc (FRAGMENT_SIZE);
+  guint i;
+
+  memset (data, index, FRAGMENT_SIZE);
+  for (i = 0; i < PACKETS_PER_FRAGMENT; i++) {
+    data[i * 188] = 0x47;
+    data[i * 188 + 1] = 0x1f;
+    data[i * 188 + 2] = (gchar) 0xff;
+    data[i * 188 + 3] = 0x10;
+  }
+
+  return data;
+}
+
+static gboolean
+test_http_src_start (GstBaseSrc * src)
+{
+  TestHttpSrc *self = (TestHttpSrc *) src;
+  guint index;
+
+  G_LOCK (requests);
+  requests_in_flight++;
+  max_requests_in_flight = MAX (max_requests_in_flight, requests_in_flight);
+  G_UNLOCK (requests);
+
+  g_usleep (REQUEST_LATENCY);
+
+  G_LOCK (requests);
+  requests_in_flight--;
+  G_UNLOCK (requests);
+
+  g_free (self->data);
+  self->offset = 0;
+  if (g_str_has_suffix (self->uri, ".m3u8")) {
+    self->data = make_playlist ();
+    self->size = strlen (self->data);
+  } else if (sscanf (strrchr (self->uri, '/'), "/fragment%u.ts", &index) == 1) {
+    self->data = make_fragment (index);
+    self->size = FRAGMENT_SIZE;
+  } else {
+    self->data = NULL;
+    GST_ELEMENT_ERROR (src, RESOURCE, NOT_FOUND, (NULL), ("%s", self->uri));
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+test_http_src_stop (GstBaseSrc * src)
+{
+  TestHttpSrc *self = (TestHttpSrc *) src;
+
+  g_free (self->data);
+  self->data = NULL;
+
+  return TRUE;
+}
+
+static GstFlowReturn
+test_http_src_create (GstBaseSrc * src, guint64 offset, guint length,
+    GstBuffer ** buf)
+{
+  TestHttpSrc *self = (TestHttpSrc *) src;
+
+  if (self->offset >= self->size)
+    return GST_FLOW_EOS;
+
+  length = MIN (4096, self->size - self->offset);
+  *buf = gst_buffer_new_allocate (NULL, length, NULL);
+  gst_buffer_fill (*buf, 0, self->data + self->offset, length);
+  self->offset += length;
+
+  return GST_FLOW_OK;
+}
+
+static void
+test_http_src_finalize (GObject * object)
+{
+  TestHttpSrc *self = (TestHttpSrc *) object;
+
+  g_free (self->uri);
+  g_free (self->data);
+
+  G_OBJECT_CLASS (test_http_src_parent_class)->finalize (object);
+}
+
+static void
+test_http_src_class_init (TestHttpSrcClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+  GstBaseSrcClass *basesrc_class = GST_BASE_SRC_CLASS (klass);
+
+  gobject_class->finalize = test_http_src_finalize;
+
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&src_template));
+  gst_element_class_set_static_metadata (element_class, "Test HTTP source",
+      "Source/Network", "Serves HLS content from memory", "GStreamer");
+
+  basesrc_class->start = test_http_src_start;
+  basesrc_class->stop = test_http_src_stop;
+  basesrc_class->create = test_http_src_create;
+}
+
+static void
+test_http_src_init (TestHttpSrc * self)
+{
+}
+
+static GstURIType
+test_http_src_uri_get_type (GType type)
+{
+  return GST_URI_SRC;
+}
+
+static const gchar *const *
+test_http_src_uri_get_protocols (GType type)
+{
+  static const gchar *protocols[] = { "http", NULL };
+
+  return protocols;
+}
+
+static gchar *
+test_http_src_uri_get_uri (GstURIHandler * handler)
+{
+  return g_strdup (((TestHttpSrc *) handler)->uri);
+}
+
+static gboolean
+test_http_src_uri_set_uri (GstURIHandler * handler, const gchar * uri,
+    GError ** error)
+{
+  TestHttpSrc *self = (TestHttpSrc *) handler;
+
+  g_free (self->uri);
+  self->uri = g_strdup (uri);
+
+  return TRUE;
+}
+
+static void
+test_http_src_uri_handler_init (gpointer g_iface, gpointer iface_data)
+{
+  GstURIHandlerInterface *iface = (GstURIHandlerInterface *) g_iface;
+
+  iface->get_type = test_http_src_uri_get_type;
+  iface->get_protocols = test_http_src_uri_get_protocols;
+  iface->get_uri = test_http_src_uri_get_uri;
+  iface->set_uri = test_http_src_uri_set_uri;
+}
+
+typedef struct
+{
+  gsize bytes;
+  guint last_fragment;
+  gboolean in_order;
+} OutputData;
+
+static GstPadProbeReturn
+output_probe (GstPad * pad, GstPadProbeInfo * info, OutputData * data)
+{
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  GstMapInfo map;
+  guint i;
+
+  gst_buffer_map (buffer, &map, GST_MAP_READ);
+  /* Look at the payload of every packet that starts in this buffer */
+  for (i = (188 - data->bytes % 188) % 188; i + 4 < map.size; i += 188) {
+    guint fragment = map.data[i + 4];
+
+    if (fragment < data->last_fragment)
+      data->in_order = FALSE;
+    data->last_fragment = fragment;
+  }
+  data->bytes += map.size;
+  gst_buffer_unmap (buffer, &map);
+
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+on_pad_added (GstElement * demux, GstPad * pad, GstElement * sink)
+{
+  GstPad *sinkpad = gst_element_get_static_pad (sink, "sink");
+
+  fail_unless (gst_pad_link (pad, sinkpad) == GST_PAD_LINK_OK);
+  gst_object_unref (sinkpad);
+}
+
+/* Plays the playlist with the given prefetch settings and returns how long
+ * it took. @max_in_flight is set to the maximum number of requests at the
+ * same time */
+static GstClockTime
+run_pipeline (guint prefetch_depth, guint64 prefetch_max_size,
+    guint * max_in_flight, GstStructure ** pool_stats)
+{
+  GstElement *pipeline, *src, *demux, *sink;
+  GstMessage *msg;
+  GstBus *bus;
+  GstPad *pad;
+  OutputData data = { 0, 0, TRUE };
+  gint64 start_time;
+
+  pipeline = gst_pipeline_new (NULL);
+  src = gst_element_make_from_uri (GST_URI_SRC,
+      "http://127.0.0.1/media.m3u8", NULL, NULL);
+  fail_unless (src != NULL);
+  fail_unless (G_TYPE_FROM_INSTANCE (src) == test_http_src_get_type ());
+  demux = gst_check_setup_element ("hlsdemux");
+  g_object_set (demux, "prefetch-depth", prefetch_depth, NULL);
+  if (prefetch_max_size)
+    g_object_set (demux, "prefetch-max-size", prefetch_max_size, NULL);
+  sink = gst_check_setup_element ("fakesink");
+  g_object_set (sink, "sync", FALSE, NULL);
+
+  pad = gst_element_get_static_pad (sink, "sink");
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER,
+      (GstPadProbeCallback) output_probe, &data, NULL);
+  gst_object_unref (pad);
+
+  gst_bin_add_many (GST_BIN (pipeline), src, demux, sink, NULL);
+  fail_unless (gst_element_link (src, demux));
+  g_signal_connect (demux, "pad-added", G_CALLBACK (on_pad_added), sink);
+
+  G_LOCK (requests);
+  max_requests_in_flight = 0;
+  G_UNLOCK (requests);
+
+  start_time = g_get_monotonic_time ();
+  fail_unless (gst_element_set_state (pipeline,
+          GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE);
+
+  bus = gst_element_get_bus (pipeline);
+  msg = gst_bus_timed_pop_filtered (bus, 10 * GST_SECOND,
+      GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+  fail_unless (msg != NULL);
+  fail_unless_equals_int (GST_MESSAGE_TYPE (msg), GST_MESSAGE_EOS);
+  gst_message_unref (msg);
+  gst_object_unref (bus);
+
+  start_time = g_get_monotonic_time () - start_time;
+
+  fail_unless_equals_int (data.bytes, N_FRAGMENTS * FRAGMENT_SIZE);
+  fail_unless (data.in_order);
+  fail_unless_equals_int (data.last_fragment, N_FRAGMENTS - 1);
+
+  if (max_in_flight) {
+    G_LOCK (requests);
+    *max_in_flight = max_requests_in_flight;
+    G_UNLOCK (requests);
+  }
+  if (pool_stats)
+    g_object_get (demux, "source-pool-stats", pool_stats, NULL);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (pipeline);
+
+  return start_time * GST_USECOND;
+}
+
+GST_START_TEST (test_prefetch)
+{
+  GstClockTime sequential, prefetched;
+  guint max_in_flight;
+
+  fail_unless (gst_element_register (NULL, "testhttpsrc",
+          GST_RANK_PRIMARY + 1, test_http_src_get_type ()));
+
+  sequential = run_pipeline (0, 0, &max_in_flight, NULL);
+  fail_unless_equals_int (max_in_flight, 1);
+
+  prefetched = run_pipeline (4, 0, &max_in_flight, NULL);
+  fail_unless (max_in_flight > 1);
+
+  GST_INFO ("%u fragments with %" GST_TIME_FORMAT " of latency: %"
+      GST_TIME_FORMAT " sequentially, %" GST_TIME_FORMAT " with prefetching",
+      N_FRAGMENTS, GST_TIME_ARGS (REQUEST_LATENCY * GST_USECOND),
+      GST_TIME_ARGS (sequential), GST_TIME_ARGS (prefetched));
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_prefetch_max_size)
+{
+  guint max_in_flight;
+
+  fail_unless (gst_element_register (NULL, "testhttpsrc",
+          GST_RANK_PRIMARY + 1, test_http_src_get_type ()));
+
+  /* the downloads still running count against the maximum size, so only
+   * one fragment is prefetched at a time, next to the current one */
+  run_pipeline (4, FRAGMENT_SIZE, &max_in_flight, NULL);
+  fail_unless (max_in_flight <= 2);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_source_pool)
+{
+  GstStructure *stats = NULL;
+  guint64 requests, reused, created;
+  GstClockTime first_byte_new;
+
+  fail_unless (gst_element_register (NULL, "testhttpsrc",
+          GST_RANK_PRIMARY + 1, test_http_src_get_type ()));
+
+  /* the prefetch downloaders take their sources from the pool for each
+   * fragment, so they must get the ones released by the previous ones */
+  run_pipeline (2, 0, NULL, &stats);
+  fail_unless (stats != NULL);
+
+  fail_unless (gst_structure_get_uint64 (stats, "requests", &requests));
+  fail_unless (gst_structure_get_uint64 (stats, "reused", &reused));
+  fail_unless (gst_structure_get_uint64 (stats, "created", &created));
+  fail_unless (gst_structure_get_clock_time (stats, "first-byte-time-new",
+          &first_byte_new));
+  GST_INFO ("source pool: %" GST_PTR_FORMAT, stats);
+
+  fail_unless_equals_uint64 (requests, reused + created);
+  fail_unless (reused > 0);
+  fail_unless (created < N_FRAGMENTS);
+  fail_unless (GST_CLOCK_TIME_IS_VALID (first_byte_new));
+
+  gst_structure_free (stats);
+}
+
+GST_END_TEST;
+
+static Suite *
+hlsdemux_prefetch_suite (void)
+{
+  Suite *s = suite_create ("hlsdemux_prefetch");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_prefetch);
+  tcase_add_test (tc_chain, test_prefetch_max_size);
+  tcase_add_test (tc_chain, test_source_pool);
+
+  return s;
+}
+
+GST_CHECK_MAIN (hlsdemux_prefetch);
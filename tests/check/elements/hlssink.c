@@ -0,0 +1,340 @@
+/* GStreamer
+ *
+ * unit test for the low-latency mode and the outputs of hlssink
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+
+#include <gst/check/gstcheck.h>
+#include <gst/video/video.h>
+
+#define BUFFER_SIZE 1000
+#define BUFFER_DURATION (100 * GST_MSECOND)
+
+static GstStaticPadTemplate srctemplate = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC, GST_PAD_ALWAYS, GST_STATIC_CAPS_ANY);
+
+static GstElement *
+setup_hlssink (const gchar * output, guint part_duration, GstPad ** srcpad)
+{
+  GstElement *sink;
+
+  sink = gst_check_setup_element ("hlssink");
+  gst_util_set_object_arg (G_OBJECT (sink), "output", output);
+  g_object_set (sink, "part-duration", part_duration, "target-duration", 0,
+      NULL);
+
+  *srcpad = gst_check_setup_src_pad (sink, &srctemplate);
+  gst_pad_set_active (*srcpad, TRUE);
+  fail_unless_equals_int (gst_element_set_state (sink, GST_STATE_PLAYING),
+      GST_STATE_CHANGE_SUCCESS);
+  gst_check_setup_events (*srcpad, sink, NULL, GST_FORMAT_TIME);
+
+  return sink;
+}
+
+static void
+cleanup_hlssink (GstElement * sink)
+{
+  gst_element_set_state (sink, GST_STATE_NULL);
+  gst_check_teardown_src_pad (sink);
+  gst_check_teardown_element (sink);
+}
+
+/* Pushes @n buffers of 100ms, starting a new segment with a key unit every
+ * 10 buffers like an encoder answering to force-key-unit events would */
+static void
+push_buffers (GstPad * srcpad, guint n)
+{
+  guint i;
+
+  for (i = 0; i < n; i++) {
+    GstBuffer *buffer = gst_buffer_new_allocate (NULL, BUFFER_SIZE, NULL);
+
+    GST_BUFFER_TIMESTAMP (buffer) = i * BUFFER_DURATION;
+    GST_BUFFER_DURATION (buffer) = BUFFER_DURATION;
+    if (i % 10 == 0 && i > 0) {
+      fail_unless (gst_pad_push_event (srcpad,
+              gst_video_event_new_downstream_force_key_unit (i *
+                  BUFFER_DURATION, i * BUFFER_DURATION, i * BUFFER_DURATION,
+                  TRUE, i / 10)));
+    } else if (i % 10 != 0) {
+      GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+    }
+    fail_unless_equals_int (gst_pad_push (srcpad, buffer), GST_FLOW_OK);
+  }
+}
+
+static gsize
+fragment_size (GstElement * sink, const gchar * location)
+{
+  GBytes *bytes = NULL;
+  gsize size;
+
+  g_signal_emit_by_name (sink, "get-fragment", location, &bytes);
+  fail_unless (bytes != NULL);
+  size = g_bytes_get_size (bytes);
+  g_bytes_unref (bytes);
+
+  return size;
+}
+
+GST_START_TEST (test_partial_segments)
+{
+  GstElement *sink;
+  GstPad *srcpad;
+  gchar *playlist = NULL;
+
+  sink = setup_hlssink ("memory", 200, &srcpad);
+  push_buffers (srcpad, 25);
+
+  /* segment 2 is being written, with 2 parts of 200ms so far */
+  g_signal_emit_by_name (sink, "get-playlist", (gint64) - 1, -1,
+      (guint64) 0, &playlist);
+  fail_unless (playlist != NULL);
+  GST_DEBUG ("playlist:\n%s", playlist);
+  fail_unless (strstr (playlist, "#EXT-X-PART-INF:PART-TARGET=0.20000\n"));
+  fail_unless (strstr (playlist,
+          "#EXT-X-SERVER-CONTROL:CAN-BLOCK-RELOAD=YES"));
+  fail_unless (strstr (playlist, "#EXT-X-PART:DURATION=0.20000,"
+          "URI=\"segment00002.ts\",BYTERANGE=\"2000@0\",INDEPENDENT=YES\n"));
+  fail_unless (strstr (playlist, "#EXT-X-PART:DURATION=0.20000,"
+          "URI=\"segment00002.ts\",BYTERANGE=\"2000@2000\"\n"));
+  fail_unless (strstr (playlist, "#EXT-X-PRELOAD-HINT:TYPE=PART,"
+          "URI=\"segment00002.ts\",BYTERANGE-START=4000\n"));
+  fail_unless (strstr (playlist, "segment00001.ts\n"));
+  g_free (playlist);
+
+  fail_unless_equals_int (fragment_size (sink, "segment00001.ts"),
+      10 * BUFFER_SIZE);
+  fail_unless_equals_int (fragment_size (sink, "segment00002.ts"),
+      5 * BUFFER_SIZE);
+
+  cleanup_hlssink (sink);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_part_target)
+{
+  GstElement *sink;
+  GstPad *srcpad;
+  gchar *playlist = NULL;
+  const gchar *part;
+  guint n_parts = 0;
+
+  /* the buffer duration doesn't divide the part target, parts are closed
+   * before they would get longer than it */
+  sink = setup_hlssink ("memory", 250, &srcpad);
+  push_buffers (srcpad, 25);
+
+  g_signal_emit_by_name (sink, "get-playlist", (gint64) - 1, -1,
+      (guint64) 0, &playlist);
+  fail_unless (playlist != NULL);
+  GST_DEBUG ("playlist:\n%s", playlist);
+  fail_unless (strstr (playlist, "#EXT-X-PART-INF:PART-TARGET=0.25000\n"));
+  fail_unless (strstr (playlist, "#EXT-X-PART:DURATION=0.20000,"
+          "URI=\"segment00002.ts\",BYTERANGE=\"2000@0\",INDEPENDENT=YES\n"));
+  fail_unless (strstr (playlist, "#EXT-X-PART:DURATION=0.20000,"
+          "URI=\"segment00002.ts\",BYTERANGE=\"2000@2000\"\n"));
+
+  for (part = strstr (playlist, "#EXT-X-PART:DURATION="); part;
+      part = strstr (part + 1, "#EXT-X-PART:DURATION=")) {
+    gdouble duration =
+        g_ascii_strtod (part + strlen ("#EXT-X-PART:DURATION="), NULL);
+
+    fail_unless (duration <= 0.25, "part of %f seconds", duration);
+    n_parts++;
+  }
+  fail_unless (n_parts >= 2);
+  g_free (playlist);
+
+  cleanup_hlssink (sink);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_blocking_reload)
+{
+  GstElement *sink;
+  GstPad *srcpad;
+  gchar *playlist = NULL;
+
+  sink = setup_hlssink ("memory", 200, &srcpad);
+  push_buffers (srcpad, 25);
+
+  /* part 1 of segment 2 is published, part 2 is not yet */
+  g_signal_emit_by_name (sink, "get-playlist", (gint64) 2, 1, (guint64) 0,
+      &playlist);
+  fail_unless (playlist != NULL);
+  g_free (playlist);
+  playlist = NULL;
+  g_signal_emit_by_name (sink, "get-playlist", (gint64) 2, 2, (guint64) 0,
+      &playlist);
+  fail_unless (playlist == NULL);
+
+  /* segment 3 doesn't come before the timeout */
+  g_signal_emit_by_name (sink, "get-playlist", (gint64) 3, -1,
+      (guint64) (10 * GST_MSECOND), &playlist);
+  fail_unless (playlist == NULL);
+
+  cleanup_hlssink (sink);
+}
+
+GST_END_TEST;
+
+static gpointer
+get_playlist_thread (GstElement * sink)
+{
+  gchar *playlist = NULL;
+
+  g_signal_emit_by_name (sink, "get-playlist", (gint64) 100, -1,
+      GST_CLOCK_TIME_NONE, &playlist);
+
+  return playlist;
+}
+
+GST_START_TEST (test_blocking_reload_stop)
+{
+  GstElement *sink;
+  GstPad *srcpad;
+  GThread *thread;
+
+  sink = setup_hlssink ("memory", 200, &srcpad);
+  push_buffers (srcpad, 5);
+
+  /* a request without timeout is released when the element stops */
+  thread = g_thread_new ("get-playlist", (GThreadFunc) get_playlist_thread,
+      sink);
+  g_usleep (50 * 1000);
+  fail_unless_equals_int (gst_element_set_state (sink, GST_STATE_READY),
+      GST_STATE_CHANGE_SUCCESS);
+  fail_unless (g_thread_join (thread) == NULL);
+
+  /* and fails right away while stopped */
+  fail_unless (get_playlist_thread (sink) == NULL);
+
+  cleanup_hlssink (sink);
+}
+
+GST_END_TEST;
+
+GstElement * sink, const gchar * location, GstBuffer * buffer,
+    GHashTable * sizes)
+{
+  gsize size = GPOINTER_TO_SIZE (g_hash_table_lookup (sizes, location));
+
+  size += gst_buffer_get_size (buffer);
+  g_hash_table_insert (sizes, g_strdup (location), GSIZE_TO_POINTER (size));
+}
+
+static void
+on_write_playlist (GstElement * sink, const gchar * location,
+    const gchar * content, guint * n_playlists)
+{
+  fail_unless_equals_string (location, "playlist.m3u8");
+  fail_unless (g_str_has_prefix (content, "#EXTM3U\n"));
+  (*n_playlists)++;
+}
+
+GST_START_TEST (test_callback_output)
+{
+  GstElement *sink;
+  GstPad *srcpad;
+  GHashTable *sizes;
+  guint n_playlists = 0;
+
+  sizes = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  sink = setup_hlssink ("callback", 0, &srcpad);
+  g_signal_connect (sink, "write-data", G_CALLBACK (on_write_data), sizes);
+  g_signal_connect (sink, "write-playlist", G_CALLBACK (on_write_playlist),
+      &n_playlists);
+
+  push_buffers (srcpad, 25);
+  fail_unless (gst_pad_push_event (srcpad, gst_event_new_eos ()));
+
+  /* one playlist per segment boundary: 3 segments starting, 1 ending at EOS */
+  fail_unless_equals_int (n_playlists, 4);
+  fail_unless_equals_int (GPOINTER_TO_SIZE (g_hash_table_lookup (sizes,
+              "segment00000.ts")), 10 * BUFFER_SIZE);
+  fail_unless_equals_int (GPOINTER_TO_SIZE (g_hash_table_lookup (sizes,
+              "segment00002.ts")), 5 * BUFFER_SIZE);
+
+  cleanup_hlssink (sink);
+  g_hash_table_unref (sizes);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_output_change)
+{
+  GstElement *sink;
+  GstPad *srcpad;
+  GHashTable *sizes;
+  guint n_playlists = 0, part_duration;
+
+  sizes = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  sink = setup_hlssink ("memory", 200, &srcpad);
+  g_signal_connect (sink, "write-data", G_CALLBACK (on_write_data), sizes);
+  g_signal_connect (sink, "write-playlist", G_CALLBACK (on_write_playlist),
+      &n_playlists);
+
+  /* ignored while running */
+  g_object_set (sink, "part-duration", 0, NULL);
+  g_object_get (sink, "part-duration", &part_duration, NULL);
+  fail_unless_equals_int (part_duration, 200);
+
+  /* taken into account from READY */
+  fail_unless_equals_int (gst_element_set_state (sink, GST_STATE_READY),
+      GST_STATE_CHANGE_SUCCESS);
+  gst_util_set_object_arg (G_OBJECT (sink), "output", "callback");
+  g_object_set (sink, "part-duration", 0, NULL);
+  fail_unless_equals_int (gst_element_set_state (sink, GST_STATE_PLAYING),
+      GST_STATE_CHANGE_SUCCESS);
+  gst_check_setup_events (srcpad, sink, NULL, GST_FORMAT_TIME);
+
+  push_buffers (srcpad, 25);
+  fail_unless (gst_pad_push_event (srcpad, gst_event_new_eos ()));
+  fail_unless_equals_int (n_playlists, 4);
+  fail_unless_equals_int (GPOINTER_TO_SIZE (g_hash_table_lookup (sizes,
+              "segment00000.ts")), 10 * BUFFER_SIZE);
+
+  cleanup_hlssink (sink);
+  g_hash_table_unref (sizes);
+}
+
+GST_END_TEST;
+
+static Suite *
+hlssink_suite (void)
+{
+  Suite *s = suite_create ("hlssink");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_partial_segments);
+  tcase_add_test (tc_chain, test_part_target);
+  tcase_add_test (tc_chain, test_blocking_reload);
+  tcase_add_test (tc_chain, test_blocking_reload_stop);
+  tcase_add_test (tc_chain, test_callback_output);
+  tcase_add_test (tc_chain, test_output_change);
+
+  return s;
+}
+
+GST_CHECK_MAIN (hlssink);
@@ -0,0 +1,562 @@
+/* GStreamer
+ *
+ * unit test for the inter elements
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/check/gstcheck.h>
+#include <string.h>
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS_ANY);
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS_ANY);
+
+#define NUM_READERS 2
+#define NUM_BUFFERS 10
+
+typedef struct
+{
+  GstElement *src;
+  GstPad *pad;
+
+  GMutex lock;
+  GCond cond;
+  GstBuffer *buffers[NUM_BUFFERS];
+  guint n_buffers;
+} Reader;
+
+static GstElement *sink;
+static GstPad *mysrcpad;
+
+static GstFlowReturn
+reader_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
+{
+  Reader *reader = g_object_get_data (G_OBJECT (pad), "reader");
+
+  g_mutex_lock (&reader->lock);
+  if (reader->n_buffers < NUM_BUFFERS)
+    reader->buffers[reader->n_buffers++] = buffer;
+  else
+    gst_buffer_unref (buffer);
+  g_cond_signal (&reader->cond);
+  g_mutex_unlock (&reader->lock);
+
+  return GST_FLOW_OK;
+}
+
+static void
+setup_inter_app_sink (void)
+{
+  GstCaps *caps;
+
+  sink = gst_check_setup_element ("interappsink");
+  g_object_set (sink, "channel", "inter-unit-test", NULL);
+  mysrcpad = gst_check_setup_src_pad (sink, &src_template);
+  gst_pad_set_active (mysrcpad, TRUE);
+
+  fail_unless (gst_element_set_state (sink, GST_STATE_PLAYING) ==
+      GST_STATE_CHANGE_ASYNC);
+
+  caps = gst_caps_new_empty_simple ("application/x-inter-test");
+  gst_check_setup_events (mysrcpad, sink, caps, GST_FORMAT_TIME);
+  gst_caps_unref (caps);
+}
+
+static void
+cleanup_inter_app_sink (void)
+{
+  gst_element_set_state (sink, GST_STATE_NULL);
+  gst_pad_set_active (mysrcpad, FALSE);
+  gst_check_teardown_src_pad (sink);
+  gst_check_teardown_element (sink);
+}
+
+static void
+setup_reader (Reader * reader, const gchar * buffer_mode)
+{
+  GstPad *srcpad;
+
+  memset (reader, 0, sizeof (Reader));
+  g_mutex_init (&reader->lock);
+  g_cond_init (&reader->cond);
+
+  reader->src = gst_element_factory_make ("interappsrc", NULL);
+  fail_unless (reader->src != NULL);
+  gst_util_set_object_arg (G_OBJECT (reader->src), "buffer-mode",
+      buffer_mode);
+  g_object_set (reader->src, "channel", "inter-unit-test", NULL);
+
+  reader->pad = gst_pad_new_from_static_template (&sink_template, "sink");
+  g_object_set_data (G_OBJECT (reader->pad), "reader", reader);
+  gst_pad_set_chain_function (reader->pad, reader_chain);
+  srcpad = gst_element_get_static_pad (reader->src, "src");
+  fail_unless (gst_pad_link (srcpad, reader->pad) == GST_PAD_LINK_OK);
+  gst_object_unref (srcpad);
+  gst_pad_set_active (reader->pad, TRUE);
+}
+
+static void
+cleanup_reader (Reader * reader)
+{
+  guint i;
+
+  gst_element_set_state (reader->src, GST_STATE_NULL);
+  gst_pad_set_active (reader->pad, FALSE);
+  gst_object_unref (reader->pad);
+  gst_object_unref (reader->src);
+
+  for (i = 0; i < reader->n_buffers; i++)
+    gst_buffer_unref (reader->buffers[i]);
+  g_mutex_clear (&reader->lock);
+  g_cond_clear (&reader->cond);
+}
+
+static void
+wait_buffers (Reader * reader, guint n_buffers)
+{
+  gint64 end_time = g_get_monotonic_time () + 5 * G_TIME_SPAN_SECOND;
+
+  g_mutex_lock (&reader->lock);
+  while (reader->n_buffers < n_buffers) {
+    if (!g_cond_wait_until (&reader->cond, &reader->lock, end_time))
+      break;
+  }
+  g_mutex_unlock (&reader->lock);
+
+  fail_unless (reader->n_buffers >= n_buffers);
+}
+
+static void
+push_buffer (gboolean keyframe)
+{
+  GstBuffer *buf = gst_buffer_new_allocate (NULL, 16, NULL);
+
+  if (!keyframe)
+    GST_BUFFER_FLAG_SET (buf, GST_BUFFER_FLAG_DELTA_UNIT);
+  fail_unless (gst_pad_push (mysrcpad, buf) == GST_FLOW_OK);
+}
+
+static void
+get_stats (Reader * reader, guint64 * delivered, guint64 * dropped,
+    guint64 * lag)
+{
+  GstStructure *stats;
+
+  g_object_get (reader->src, "stats", &stats, NULL);
+  fail_unless (gst_structure_get_uint64 (stats, "delivered", delivered));
+  fail_unless (gst_structure_get_uint64 (stats, "dropped", dropped));
+  fail_unless (gst_structure_get_uint64 (stats, "lag", lag));
+  gst_structure_free (stats);
+}
+
+GST_START_TEST (test_inter_app_fan_out)
+{
+  Reader readers[NUM_READERS];
+  guint64 delivered, dropped, lag;
+  guint i, j;
+
+  setup_inter_app_sink ();
+
+  for (i = 0; i < NUM_READERS; i++) {
+    setup_reader (&readers[i], "latest-keyframe");
+    fail_unless (gst_element_set_state (readers[i].src, GST_STATE_PLAYING) ==
+        GST_STATE_CHANGE_NO_PREROLL);
+  }
+
+  /* A single GOP, all the readers get all of it */
+  push_buffer (TRUE);
+  for (i = 1; i < NUM_BUFFERS; i++)
+    push_buffer (FALSE);
+
+  for (i = 0; i < NUM_READERS; i++) {
+    wait_buffers (&readers[i], NUM_BUFFERS);
+
+    get_stats (&readers[i], &delivered, &dropped, &lag);
+    fail_unless_equals_uint64 (delivered, NUM_BUFFERS);
+    fail_unless_equals_uint64 (dropped, 0);
+    fail_unless_equals_uint64 (lag, 0);
+  }
+
+  /* The readers share the buffers from the sink */
+  for (i = 1; i < NUM_READERS; i++) {
+    for (j = 0; j < NUM_BUFFERS; j++)
+      fail_unless (readers[i].buffers[j] == readers[0].buffers[j]);
+  }
+
+  for (i = 0; i < NUM_READERS; i++)
+    cleanup_reader (&readers[i]);
+  cleanup_inter_app_sink ();
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_inter_app_reader_modes)
+{
+  Reader latest, keyframe;
+  guint64 delivered, dropped, lag;
+  guint i;
+
+  setup_inter_app_sink ();
+
+  /* Live sources don't produce anything in PAUSED */
+  setup_reader (&latest, "latest");
+  setup_reader (&keyframe, "latest-keyframe");
+  fail_unless (gst_element_set_state (latest.src, GST_STATE_PAUSED) ==
+      GST_STATE_CHANGE_NO_PREROLL);
+  fail_unless (gst_element_set_state (keyframe.src, GST_STATE_PAUSED) ==
+      GST_STATE_CHANGE_NO_PREROLL);
+
+  push_buffer (TRUE);
+  for (i = 1; i < 5; i++)
+    push_buffer (FALSE);
+
+  /* Only the last buffer is pending for the latest reader, the whole GOP for
+   * the other one */
+  get_stats (&latest, &delivered, &dropped, &lag);
+  fail_unless_equals_uint64 (lag, 1);
+  get_stats (&keyframe, &delivered, &dropped, &lag);
+  fail_unless_equals_uint64 (lag, 5);
+
+  fail_unless (gst_element_set_state (latest.src, GST_STATE_PLAYING) ==
+      GST_STATE_CHANGE_SUCCESS);
+  wait_buffers (&latest, 1);
+  fail_unless (GST_BUFFER_FLAG_IS_SET (latest.buffers[0],
+          GST_BUFFER_FLAG_DELTA_UNIT));
+
+  fail_unless (gst_element_set_state (keyframe.src, GST_STATE_PLAYING) ==
+      GST_STATE_CHANGE_SUCCESS);
+  wait_buffers (&keyframe, 5);
+  fail_unless (!GST_BUFFER_FLAG_IS_SET (keyframe.buffers[0],
+          GST_BUFFER_FLAG_DELTA_UNIT));
+  get_stats (&keyframe, &delivered, &dropped, &lag);
+  fail_unless_equals_uint64 (delivered, 5);
+  fail_unless_equals_uint64 (lag, 0);
+
+  cleanup_reader (&latest);
+  cleanup_reader (&keyframe);
+  cleanup_inter_app_sink ();
+}
+
+GST_END_TEST;
+
+/* Must match GST_DEFERRED_CLIENT_MAX_BUFFERS */
+#define RETENTION_MAX_BUFFERS 1000
+
+GST_START_TEST (test_inter_app_retention)
+{
+  Reader latest, keyframe;
+  guint64 delivered, dropped, lag;
+  guint i;
+
+  setup_inter_app_sink ();
+
+  /* With only latest readers, the last keyframe is not kept for later */
+  setup_reader (&latest, "latest");
+  fail_unless (gst_element_set_state (latest.src, GST_STATE_PAUSED) ==
+      GST_STATE_CHANGE_NO_PREROLL);
+  push_buffer (TRUE);
+  for (i = 1; i < 5; i++)
+    push_buffer (FALSE);
+
+  setup_reader (&keyframe, "latest-keyframe");
+  fail_unless (gst_element_set_state (keyframe.src, GST_STATE_PAUSED) ==
+      GST_STATE_CHANGE_NO_PREROLL);
+  get_stats (&keyframe, &delivered, &dropped, &lag);
+  fail_unless_equals_uint64 (lag, 0);
+  cleanup_reader (&latest);
+
+  /* A stream with a single keyframe does not make the pending GOP grow
+   * without bound */
+  push_buffer (TRUE);
+  for (i = 1; i < 2 * RETENTION_MAX_BUFFERS; i++)
+    push_buffer (FALSE);
+  get_stats (&keyframe, &delivered, &dropped, &lag);
+  fail_unless (lag <= RETENTION_MAX_BUFFERS);
+
+  /* The reader was cut off and restarts at the next keyframe */
+  push_buffer (TRUE);
+  push_buffer (FALSE);
+  get_stats (&keyframe, &delivered, &dropped, &lag);
+  fail_unless_equals_uint64 (lag, 2);
+  fail_unless (gst_element_set_state (keyframe.src, GST_STATE_PLAYING) ==
+      GST_STATE_CHANGE_SUCCESS);
+  wait_buffers (&keyframe, 2);
+  fail_unless (!GST_BUFFER_FLAG_IS_SET (keyframe.buffers[0],
+          GST_BUFFER_FLAG_DELTA_UNIT));
+
+  cleanup_reader (&keyframe);
+  cleanup_inter_app_sink ();
+}
+
+GST_END_TEST;
+
+#define STRESS_CHANNELS 8
+#define STRESS_BUFFERS 500
+
+typedef struct
+{
+  gboolean video;
+  GstElement *sink;
+  GstPad *srcpad;
+  GstElement *pipeline;
+  gint consumed;
+
+  /* Time spent pushing into the sink, which includes any wait for the
+   * consumer on the surface */
+  gint64 push_time, max_push_time;
+} StressChannel;
+
+static GstPadProbeReturn
+stress_count_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  StressChannel *channel = user_data;
+
+  g_atomic_int_inc (&channel->consumed);
+
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+setup_stress_channel (StressChannel * channel, gboolean video, guint index)
+{
+  gchar *name, *desc;
+  GstElement *fakesink;
+  GstPad *pad;
+  GstCaps *caps;
+  GstSegment segment;
+
+  memset (channel, 0, sizeof (StressChannel));
+  channel->video = video;
+  name = g_strdup_printf ("inter-stress-%s-%u", video ? "video" : "audio",
+      index);
+
+  /* The consumers poll the surface every millisecond */
+  if (video) {
+    desc = g_strdup_printf ("intervideosrc channel=%s ! "
+        "fakesink name=sink sync=false", name);
+  } else {
+    desc = g_strdup_printf ("interaudiosrc channel=%s period-time=1000000 ! "
+        "fakesink name=sink sync=false", name);
+  }
+  channel->pipeline = gst_parse_launch (desc, NULL);
+  fail_unless (channel->pipeline != NULL);
+  g_free (desc);
+  fakesink = gst_bin_get_by_name (GST_BIN (channel->pipeline), "sink");
+  pad = gst_element_get_static_pad (fakesink, "sink");
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, stress_count_probe,
+      channel, NULL);
+  gst_object_unref (pad);
+  gst_object_unref (fakesink);
+  fail_unless (gst_element_set_state (channel->pipeline,
+          GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE);
+
+  channel->sink = gst_element_factory_make (video ? "intervideosink" :
+      "interaudiosink", NULL);
+  fail_unless (channel->sink != NULL);
+  g_object_set (channel->sink, "channel", name, NULL);
+  g_free (name);
+
+  channel->srcpad = gst_pad_new_from_static_template (&src_template, "src");
+  pad = gst_element_get_static_pad (channel->sink, "sink");
+  fail_unless (gst_pad_link (channel->srcpad, pad) == GST_PAD_LINK_OK);
+  gst_object_unref (pad);
+  gst_pad_set_active (channel->srcpad, TRUE);
+
+  fail_unless (gst_element_set_state (channel->sink, GST_STATE_PLAYING) ==
+      GST_STATE_CHANGE_ASYNC);
+
+  if (video) {
+    caps = gst_caps_from_string ("video/x-raw, format=I420, width=64, "
+        "height=48, framerate=1000/1");
+  } else {
+    caps = gst_caps_from_string ("audio/x-raw, format=S16LE, "
+        "layout=interleaved, rate=48000, channels=2");
+  }
+  gst_segment_init (&segment, GST_FORMAT_TIME);
+  fail_unless (gst_pad_push_event (channel->srcpad,
+          gst_event_new_stream_start ("inter-stress")));
+  fail_unless (gst_pad_push_event (channel->srcpad,
+          gst_event_new_caps (caps)));
+  fail_unless (gst_pad_push_event (channel->srcpad,
+          gst_event_new_segment (&segment)));
+  gst_caps_unref (caps);
+}
+
+static void
+cleanup_stress_channel (StressChannel * channel)
+{
+  gst_element_set_state (channel->pipeline, GST_STATE_NULL);
+  gst_object_unref (channel->pipeline);
+
+  gst_element_set_state (channel->sink, GST_STATE_NULL);
+  gst_pad_set_active (channel->srcpad, FALSE);
+  gst_object_unref (channel->srcpad);
+  gst_object_unref (channel->sink);
+}
+
+static gpointer
+stress_push_thread (gpointer data)
+{
+  StressChannel *channel = data;
+  /* A frame, or 1 ms of audio */
+  gsize size = channel->video ? 64 * 48 * 3 / 2 : 48 * 4;
+  guint i;
+
+  for (i = 0; i < STRESS_BUFFERS; i++) {
+    GstBuffer *buf = gst_buffer_new_allocate (NULL, size, NULL);
+    gint64 start, elapsed;
+
+    gst_buffer_memset (buf, 0, 0, size);
+
+    start = g_get_monotonic_time ();
+    fail_unless (gst_pad_push (channel->srcpad, buf) == GST_FLOW_OK);
+    elapsed = g_get_monotonic_time () - start;
+
+    channel->push_time += elapsed;
+    channel->max_push_time = MAX (channel->max_push_time, elapsed);
+
+    g_usleep (200);
+  }
+
+  return NULL;
+}
+
+typedef struct
+{
+  gint64 push_time, max_push_time;
+  guint64 lock_waits, lock_wait_time;
+  guint64 sync_waits, sync_time;
+  guint retries;
+} StressTotals;
+
+/* Adds the contention counters of the surface behind @channel */
+static void
+add_stress_stats (StressChannel * channel, StressTotals * totals)
+{
+  GstStructure *stats;
+  guint64 waits, time;
+  guint retries;
+
+  g_object_get (channel->sink, "stats", &stats, NULL);
+  fail_unless (stats != NULL);
+
+  fail_unless (gst_structure_get_uint64 (stats, "lock-waits", &waits));
+  fail_unless (gst_structure_get_uint64 (stats, "lock-wait-time", &time));
+  totals->lock_waits += waits;
+  totals->lock_wait_time += time;
+
+  fail_unless (gst_structure_get_uint64 (stats, "video-sync-waits", &waits));
+  fail_unless (gst_structure_get_uint64 (stats, "video-sync-time", &time));
+  totals->sync_waits += waits;
+  totals->sync_time += time;
+
+  fail_unless (gst_structure_get_uint (stats, channel->video ?
+          "video-read-retries" : "audio-pop-retries", &retries));
+  totals->retries += retries;
+
+  gst_structure_free (stats);
+}
+
+/* Runs @n_channels video and @n_channels audio channels at once and reports
+ * the time spent pushing, and how much of it was spent waiting on the
+ * surfaces. The contention counters stay at 0 without the debug system */
+static void
+run_inter_stress (guint n_channels)
+{
+  StressChannel channels[2 * STRESS_CHANNELS];
+  GThread *threads[2 * STRESS_CHANNELS];
+  StressTotals totals[2];
+  guint i;
+
+  fail_unless (n_channels <= STRESS_CHANNELS);
+  memset (totals, 0, sizeof (totals));
+
+  for (i = 0; i < 2 * n_channels; i++)
+    setup_stress_channel (&channels[i], i < n_channels, i % n_channels);
+
+  for (i = 0; i < 2 * n_channels; i++)
+    threads[i] = g_thread_new ("inter-stress", stress_push_thread,
+        &channels[i]);
+
+  for (i = 0; i < 2 * n_channels; i++) {
+    StressChannel *channel = &channels[i];
+    StressTotals *t = &totals[channel->video];
+
+    g_thread_join (threads[i]);
+
+    t->push_time += channel->push_time;
+    t->max_push_time = MAX (t->max_push_time, channel->max_push_time);
+    fail_unless (g_atomic_int_get (&channel->consumed) > 0);
+
+    add_stress_stats (channel, t);
+  }
+
+  GST_INFO ("%u video channels: %.2f us per frame, at most %" G_GINT64_FORMAT
+      " us; %" G_GUINT64_FORMAT " lock waits for %" GST_TIME_FORMAT ", %"
+      G_GUINT64_FORMAT " reader waits for %" GST_TIME_FORMAT ", %u read "
+      "retries", n_channels,
+      (gdouble) totals[1].push_time / (n_channels * STRESS_BUFFERS),
+      totals[1].max_push_time, totals[1].lock_waits,
+      GST_TIME_ARGS (totals[1].lock_wait_time), totals[1].sync_waits,
+      GST_TIME_ARGS (totals[1].sync_time), totals[1].retries);
+  GST_INFO ("%u audio channels: %.2f us per buffer, at most %"
+      G_GINT64_FORMAT " us; %" G_GUINT64_FORMAT " lock waits for %"
+      GST_TIME_FORMAT ", %u pop retries", n_channels,
+      (gdouble) totals[0].push_time / (n_channels * STRESS_BUFFERS),
+      totals[0].max_push_time, totals[0].lock_waits,
+      GST_TIME_ARGS (totals[0].lock_wait_time), totals[0].retries);
+
+  for (i = 0; i < 2 * n_channels; i++)
+    cleanup_stress_channel (&channels[i]);
+}
+
+GST_START_TEST (test_inter_stress)
+{
+  guint n_channels;
+
+  for (n_channels = 1; n_channels <= STRESS_CHANNELS; n_channels *= 2)
+    run_inter_stress (n_channels);
+}
+
+GST_END_TEST;
+
+static Suite *
+inter_suite (void)
+{
+  Suite *s = suite_create ("inter");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_inter_app_fan_out);
+  tcase_add_test (tc_chain, test_inter_app_reader_modes);
+  tcase_add_test (tc_chain, test_inter_app_retention);
+  tcase_add_test (tc_chain, test_inter_stress);
+
+  return s;
+}
+
+GST_CHECK_MAIN (inter);
@@ -0,0 +1,919 @@
+/* GStreamer
+ *
+ * unit test for the mpegtsdemux plugin (tsparse/tsdemux)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/check/gstcheck.h>
+#include <string.h>
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS_ANY);
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("video/mpegts, systemstream = (boolean) true"));
+
+#define TS_PACKET_SIZE 188
+#define PACKETS_PER_BUFFER 1024
+#define NUM_BUFFERS 64
+#define NUM_PIDS 16
+
+#define PMT_PID 0x100
+#define PES_PID 0x101
+#define MAX_STREAMS 4
+
+static GstPad *mysrcpad, *mysinkpad;
+static guint64 bytes_out;
+
+/* tsdemux output accounting, split between buffers referencing the
+ * input memory and buffers that were copied */
+static guint64 bytes_shared, bytes_copied;
+/* number of output buffers, and of those starting a PES */
+static guint n_buffers, n_pes;
+
+static GstFlowReturn
+count_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
+{
+  bytes_out += gst_buffer_get_size (buffer);
+  gst_buffer_unref (buffer);
+
+  return GST_FLOW_OK;
+}
+
+static GstElement *
+setup_tsparse (void)
+{
+  GstElement *parse;
+
+  parse = gst_check_setup_element ("tsparse");
+  mysrcpad = gst_check_setup_src_pad (parse, &src_template);
+  mysinkpad = gst_check_setup_sink_pad (parse, &sink_template);
+  gst_pad_set_chain_function (mysinkpad, count_chain);
+  gst_pad_set_active (mysrcpad, TRUE);
+  gst_pad_set_active (mysinkpad, TRUE);
+  bytes_out = 0;
+
+  return parse;
+}
+
+static void
+cleanup_tsparse (GstElement * parse)
+{
+  gst_element_set_state (parse, GST_STATE_NULL);
+  gst_pad_set_active (mysrcpad, FALSE);
+  gst_pad_set_active (mysinkpad, FALSE);
+  gst_check_teardown_src_pad (parse);
+  gst_check_teardown_sink_pad (parse);
+  gst_check_teardown_element (parse);
+}
+
+/* Fills @data with @n_packets null-payload packets spread over NUM_PIDS
+ * PIDs, with valid continuity counters */
+static void
+fill_packets (guint8 * data, guint n_packets, guint8 * cc)
+{
+  guint i;
+
+  for (i = 0; i < n_packets; i++) {
+    guint8 *p = data + i * TS_PACKET_SIZE;
+    guint16 pid = 0x100 + (i % NUM_PIDS);
+
+    p[0] = 0x47;
+    p[1] = (pid >> 8) & 0x1f;
+    p[2] = pid & 0xff;
+    p[3] = 0x10 | (cc[i % NUM_PIDS]++ & 0x0f);
+    memset (p + 4, 0xff, TS_PACKET_SIZE - 4);
+  }
+}
+
+static void
+push_and_measure (GstElement * parse, gsize garbage)
+{
+  guint8 cc[NUM_PIDS] = { 0, };
+  gsize buffer_size = PACKETS_PER_BUFFER * TS_PACKET_SIZE;
+  gint64 start, elapsed;
+  GstCaps *caps;
+  guint i;
+
+  fail_unless (gst_element_set_state (parse, GST_STATE_PLAYING) ==
+      GST_STATE_CHANGE_SUCCESS);
+  caps = gst_caps_from_string ("video/mpegts, systemstream = (boolean) true");
+  gst_check_setup_events (mysrcpad, parse, caps, GST_FORMAT_BYTES);
+  gst_caps_unref (caps);
+
+  /* Some leading garbage, to exercise the sync byte scanner */
+  if (garbage) {
+    GstBuffer *buf = gst_buffer_new_allocate (NULL, garbage, NULL);
+
+    gst_buffer_memset (buf, 0, 0x00, garbage);
+    fail_unless (gst_pad_push (mysrcpad, buf) == GST_FLOW_OK);
+  }
+
+  start = g_get_monotonic_time ();
+  for (i = 0; i < NUM_BUFFERS; i++) {
+    GstBuffer *buf = gst_buffer_new_allocate (NULL, buffer_size, NULL);
+    GstMapInfo map;
+
+    gst_buffer_map (buf, &map, GST_MAP_WRITE);
+    fill_packets (map.data, PACKETS_PER_BUFFER, cc);
+    gst_buffer_unmap (buf, &map);
+
+    GST_BUFFER_OFFSET (buf) = garbage + i * buffer_size;
+    fail_unless (gst_pad_push (mysrcpad, buf) == GST_FLOW_OK);
+  }
+  elapsed = g_get_monotonic_time () - start;
+
+  GST_INFO ("%u packets in %" G_GINT64_FORMAT " us, %.0f packets/s",
+      NUM_BUFFERS * PACKETS_PER_BUFFER, elapsed,
+      (gdouble) NUM_BUFFERS * PACKETS_PER_BUFFER * G_USEC_PER_SEC /
+      MAX (elapsed, 1));
+
+  /* tsparse passes input buffers through, all the packets must come out */
+  fail_unless (bytes_out >= (guint64) (NUM_BUFFERS - 1) * buffer_size);
+}
+
+GST_START_TEST (test_packet_throughput)
+{
+  GstElement *parse = setup_tsparse ();
+
+  push_and_measure (parse, 0);
+  cleanup_tsparse (parse);
+}
+
+GST_END_TEST;
+
+/* Sync byte search one byte at a time, as the packetizer did before it
+ * used memchr(), kept as a reference for the resync benchmark */
+static gsize
+scalar_find_sync_byte (const guint8 * data, gsize size)
+{
+  gsize i;
+
+  for (i = 0; i < size; i++) {
+    if (data[i] == 0x47)
+      break;
+  }
+
+  return i;
+}
+
+static gsize
+memchr_find_sync_byte (const guint8 * data, gsize size)
+{
+  const guint8 *res = memchr (data, 0x47, size);
+
+  return res ? res - data : size;
+}
+
+#define SCAN_SIZE (1024 * 1024)
+#define SCAN_ROUNDS 64
+
+/* Times finding the sync byte at the end of SCAN_SIZE bytes of garbage,
+ * in bytes/s */
+static gdouble
+measure_sync_scan (gsize (*find) (const guint8 *, gsize), const guint8 * data)
+{
+  gint64 start, elapsed;
+  guint i;
+
+  start = g_get_monotonic_time ();
+  for (i = 0; i < SCAN_ROUNDS; i++)
+    fail_unless_equals_uint64 (find (data, SCAN_SIZE), SCAN_SIZE - 1);
+  elapsed = g_get_monotonic_time () - start;
+
+  return (gdouble) SCAN_SIZE * SCAN_ROUNDS * G_USEC_PER_SEC / MAX (elapsed, 1);
+}
+
+GST_START_TEST (test_packet_throughput_resync)
+{
+  GstElement *parse = setup_tsparse ();
+  gdouble scalar, vectorized;
+  guint8 *garbage;
+
+  push_and_measure (parse, 4096 + 17);
+  cleanup_tsparse (parse);
+
+  /* Compare the sync byte search the packetizer uses to resync with the
+   * byte at a time loop it replaced */
+  garbage = g_malloc0 (SCAN_SIZE);
+  garbage[SCAN_SIZE - 1] = 0x47;
+  scalar = measure_sync_scan (scalar_find_sync_byte, garbage);
+  vectorized = measure_sync_scan (memchr_find_sync_byte, garbage);
+  g_free (garbage);
+
+  GST_INFO ("sync byte scan: byte at a time %.0f MB/s, memchr %.0f MB/s "
+      "(x%.1f)", scalar / 1e6, vectorized / 1e6, vectorized / scalar);
+}
+
+GST_END_TEST;
+
+static GstFlowReturn
+pes_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
+{
+  guint i, n = gst_buffer_n_memory (buffer);
+  gboolean shared = TRUE;
+
+  /* Memories created with gst_memory_share() have a parent */
+  for (i = 0; i < n; i++) {
+    if (gst_buffer_peek_memory (buffer, i)->parent == NULL)
+      shared = FALSE;
+  }
+
+  if (shared)
+    bytes_shared += gst_buffer_get_size (buffer);
+  else
+    bytes_copied += gst_buffer_get_size (buffer);
+  n_buffers++;
+  if (GST_BUFFER_PTS_IS_VALID (buffer))
+    n_pes++;
+  gst_buffer_unref (buffer);
+
+  return GST_FLOW_OK;
+}
+
+static void
+demux_pad_added (GstElement * demux, GstPad * pad, gpointer user_data)
+{
+  mysinkpad = gst_pad_new_from_static_template (&sink_template, "sink");
+  gst_pad_set_chain_function (mysinkpad, pes_chain);
+  gst_pad_set_active (mysinkpad, TRUE);
+  fail_unless (gst_pad_link (pad, mysinkpad) == GST_PAD_LINK_OK);
+}
+
+static guint32
+calc_crc32 (const guint8 * data, guint len)
+{
+  guint32 crc = 0xffffffff;
+  guint i, j;
+
+  for (i = 0; i < len; i++) {
+    crc ^= (guint32) data[i] << 24;
+    for (j = 0; j < 8; j++)
+      crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04c11db7 : crc << 1;
+  }
+
+  return crc;
+}
+
+/* Writes a single packet containing the PSI @section (without CRC) */
+static void
+write_section_packet (guint8 * p, guint16 pid, const guint8 * section,
+    guint len)
+{
+  guint32 crc;
+
+  p[0] = 0x47;
+  p[1] = 0x40 | (pid >> 8);
+  p[2] = pid & 0xff;
+  p[3] = 0x10;
+  p[4] = 0x00;
+  memcpy (p + 5, section, len);
+  crc = calc_crc32 (section, len);
+  GST_WRITE_UINT32_BE (p + 5 + len, crc);
+  memset (p + 9 + len, 0xff, TS_PACKET_SIZE - 9 - len);
+}
+
+/* Writes a PAT and a PMT of @version with @n_streams streams of
+ * @stream_type on the PIDs following @pid, the first one also carrying the
+ * PCR */
+static void
+write_psi (guint8 * data, guint8 version, guint16 pid, guint8 stream_type,
+    guint n_streams)
+{
+  const guint8 pat[] = {
+    0x00, 0xb0, 13, 0x00, 0x01, 0xc1, 0x00, 0x00,
+    0x00, 0x01, 0xe0 | (PMT_PID >> 8), PMT_PID & 0xff
+  };
+  guint8 pmt[12 + 5 * MAX_STREAMS];
+  guint i, len = 12 + 5 * n_streams;
+
+  fail_unless (n_streams <= MAX_STREAMS);
+
+  pmt[0] = 0x02;
+  pmt[1] = 0xb0;
+  /* the section length includes the CRC */
+  pmt[2] = len - 3 + 4;
+  pmt[3] = 0x00;
+  pmt[4] = 0x01;
+  pmt[5] = 0xc1 | ((version & 0x1f) << 1);
+  pmt[6] = 0x00;
+  pmt[7] = 0x00;
+  pmt[8] = 0xe0 | (pid >> 8);
+  pmt[9] = pid & 0xff;
+  pmt[10] = 0xf0;
+  pmt[11] = 0x00;
+  for (i = 0; i < n_streams; i++) {
+    guint8 *es = pmt + 12 + 5 * i;
+
+    es[0] = stream_type;
+    es[1] = 0xe0 | ((pid + i) >> 8);
+    es[2] = (pid + i) & 0xff;
+    es[3] = 0xf0;
+    es[4] = 0x00;
+  }
+
+  write_section_packet (data, 0, pat, sizeof (pat));
+  write_section_packet (data + TS_PACKET_SIZE, PMT_PID, pmt, len);
+}
+
+/* Writes a PES of @stream_id on @pid spread over @n_packets packets, with a
+ * PCR in the first one and the payload filled with @fill. Returns the size
+ * of the PES payload */
+static guint
+write_pes (guint8 * data, guint16 pid, guint8 stream_id, guint n_packets,
+    guint64 pcr, guint64 pts, guint8 fill, guint8 * cc)
+{
+  guint8 *p = data;
+  guint i, payload = 0;
+
+  for (i = 0; i < n_packets; i++, p += TS_PACKET_SIZE) {
+    guint8 *d = p + 4;
+
+    p[0] = 0x47;
+    p[1] = (i == 0 ? 0x40 : 0x00) | (pid >> 8);
+    p[2] = pid & 0xff;
+    p[3] = (i == 0 ? 0x30 : 0x10) | ((*cc)++ & 0x0f);
+
+    if (i == 0) {
+      /* adaptation field with PCR */
+      d[0] = 7;
+      d[1] = 0x10;
+      d[2] = pcr >> 25;
+      d[3] = pcr >> 17;
+      d[4] = pcr >> 9;
+      d[5] = pcr >> 1;
+      d[6] = ((pcr & 1) << 7) | 0x7e;
+      d[7] = 0x00;
+      d += 8;
+
+      /* PES header, unbounded length, PTS only */
+      d[0] = 0x00;
+      d[1] = 0x00;
+      d[2] = 0x01;
+      d[3] = stream_id;
+      d[4] = 0x00;
+      d[5] = 0x00;
+      d[6] = 0x80;
+      d[7] = 0x80;
+      d[8] = 5;
+      d[9] = 0x21 | ((pts >> 29) & 0x0e);
+      d[10] = pts >> 22;
+      d[11] = 0x01 | ((pts >> 14) & 0xfe);
+      d[12] = pts >> 7;
+      d[13] = 0x01 | ((pts << 1) & 0xfe);
+      d += 14;
+    }
+
+    memset (d, fill, p + TS_PACKET_SIZE - d);
+    payload += p + TS_PACKET_SIZE - d;
+  }
+
+  return payload;
+}
+
+/* Pushes NUM_BUFFERS buffers of PES with @pes_packets packets each through
+ * tsdemux, either as MPEG-1 audio or MPEG-2 video, and returns the number
+ * of PES */
+static guint
+push_pes_and_measure (gboolean video, guint pes_packets)
+{
+  GstElement *demux;
+  guint pes_per_buffer = PACKETS_PER_BUFFER / pes_packets;
+  gsize buffer_size = pes_per_buffer * pes_packets * TS_PACKET_SIZE;
+  guint64 pcr = 90000, expected = 0, offset;
+  gint64 start, elapsed;
+  guint8 cc = 0;
+  GstMapInfo map;
+  GstBuffer *buf;
+  GstCaps *caps;
+  guint i, j;
+
+  demux = gst_check_setup_element ("tsdemux");
+  mysrcpad = gst_check_setup_src_pad (demux, &src_template);
+  gst_pad_set_active (mysrcpad, TRUE);
+  g_signal_connect (demux, "pad-added", G_CALLBACK (demux_pad_added), NULL);
+  mysinkpad = NULL;
+  bytes_shared = bytes_copied = 0;
+  n_buffers = n_pes = 0;
+
+  fail_unless (gst_element_set_state (demux, GST_STATE_PLAYING) ==
+      GST_STATE_CHANGE_SUCCESS);
+  caps = gst_caps_from_string ("video/mpegts, systemstream = (boolean) true");
+  gst_check_setup_events (mysrcpad, demux, caps, GST_FORMAT_BYTES);
+  gst_caps_unref (caps);
+
+  buf = gst_buffer_new_allocate (NULL, 2 * TS_PACKET_SIZE, NULL);
+  gst_buffer_map (buf, &map, GST_MAP_WRITE);
+  write_psi (map.data, 0, PES_PID, video ? 0x02 : 0x03, 1);
+  gst_buffer_unmap (buf, &map);
+  GST_BUFFER_OFFSET (buf) = 0;
+  fail_unless (gst_pad_push (mysrcpad, buf) == GST_FLOW_OK);
+  offset = 2 * TS_PACKET_SIZE;
+
+  start = g_get_monotonic_time ();
+  for (i = 0; i < NUM_BUFFERS; i++) {
+    buf = gst_buffer_new_allocate (NULL, buffer_size, NULL);
+    gst_buffer_map (buf, &map, GST_MAP_WRITE);
+    for (j = 0; j < pes_per_buffer; j++) {
+      expected += write_pes (map.data + j * pes_packets * TS_PACKET_SIZE,
+          PES_PID, video ? 0xe0 : 0xc0, pes_packets, pcr, pcr + 9000, 0xaa,
+          &cc);
+      pcr += 3600;
+    }
+    gst_buffer_unmap (buf, &map);
+
+    GST_BUFFER_OFFSET (buf) = offset;
+    offset += buffer_size;
+    fail_unless (gst_pad_push (mysrcpad, buf) == GST_FLOW_OK);
+  }
+  fail_unless (gst_pad_push_event (mysrcpad, gst_event_new_eos ()));
+  elapsed = g_get_monotonic_time () - start;
+
+  GST_INFO ("PES of %u packets: %" G_GUINT64_FORMAT " bytes shared, %"
+      G_GUINT64_FORMAT " bytes copied in %" G_GINT64_FORMAT " us, "
+      "%.0f bytes copied/s", pes_packets, bytes_shared, bytes_copied, elapsed,
+      (gdouble) bytes_copied * G_USEC_PER_SEC / MAX (elapsed, 1));
+
+  fail_unless (mysinkpad != NULL);
+  fail_unless_equals_uint64 (bytes_shared + bytes_copied, expected);
+  fail_unless_equals_int (n_pes, NUM_BUFFERS * pes_per_buffer);
+
+  gst_element_set_state (demux, GST_STATE_NULL);
+  gst_pad_set_active (mysrcpad, FALSE);
+  gst_pad_set_active (mysinkpad, FALSE);
+  gst_object_unref (mysinkpad);
+  gst_check_teardown_src_pad (demux);
+  gst_check_teardown_element (demux);
+
+  return NUM_BUFFERS * pes_per_buffer;
+}
+
+GST_START_TEST (test_pes_zero_copy)
+{
+  /* PES fitting in a single buffer are not copied */
+  push_pes_and_measure (FALSE, 8);
+  fail_unless_equals_uint64 (bytes_copied, 0);
+  fail_unless_equals_int (n_buffers, n_pes);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_pes_zero_copy_split)
+{
+  guint pes;
+
+  /* Video PES of more packets than a buffer has memories are not copied
+   * either, but pushed as several buffers with the timestamps on the
+   * first one */
+  pes = push_pes_and_measure (TRUE, 64);
+  fail_unless_equals_uint64 (bytes_copied, 0);
+  fail_unless_equals_int (n_buffers, pes * 4);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_pes_single_buffer)
+{
+  /* Other streams may not go through a parser and always get a PES per
+   * buffer */
+  push_pes_and_measure (FALSE, 64);
+  fail_unless_equals_int (n_buffers, n_pes);
+}
+
+GST_END_TEST;
+
+/* Number of packets of the PES pushed in the worker-threads tests, small
+ * enough for each PES to be output as a single buffer */
+#define WORKER_PES_PACKETS 8
+/* Payload of the first PES pushed after a flush, the ones pushed before
+ * start at 0 */
+#define FLUSH_SEQ 0x80
+
+typedef struct
+{
+  GstPad *pad;
+  /* Thread the last buffer was received from */
+  GThread *thread;
+  /* Expected payload of the next buffer */
+  guint8 next;
+  guint n_buffers;
+  /* Buffers out of order, or left from before a flush */
+  guint n_errors;
+  guint n_flushes;
+  /* TRUE while a buffer is held in the chain function */
+  gboolean held;
+  gboolean flushing;
+  gboolean eos;
+} DemuxOutput;
+
+static GMutex output_lock;
+static GCond output_cond;
+/* DemuxOutput, in the order the pads were added */
+static GPtrArray *outputs;
+/* While TRUE, the chain function blocks until the pad is flushed */
+static gboolean hold_output;
+
+static guint64 push_offset, push_pcr;
+static guint8 push_cc[MAX_STREAMS];
+static gboolean seek_received;
+static guint32 seek_seqnum;
+
+static GstFlowReturn
+output_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
+{
+  DemuxOutput *output = gst_pad_get_element_private (pad);
+  GstFlowReturn ret = GST_FLOW_OK;
+  guint8 seq;
+
+  fail_unless_equals_int (gst_buffer_extract (buffer, 0, &seq, 1), 1);
+  gst_buffer_unref (buffer);
+
+  g_mutex_lock (&output_lock);
+  output->held = TRUE;
+  g_cond_broadcast (&output_cond);
+  while (hold_output && !output->flushing)
+    g_cond_wait (&output_cond, &output_lock);
+  output->held = FALSE;
+
+  if (output->flushing) {
+    ret = GST_FLOW_FLUSHING;
+  } else {
+    if (seq != output->next)
+      output->n_errors++;
+    output->next = seq + 1;
+    output->n_buffers++;
+    output->thread = g_thread_self ();
+  }
+  g_mutex_unlock (&output_lock);
+
+  return ret;
+}
+
+static gboolean
+output_event (GstPad * pad, GstObject * parent, GstEvent * event)
+{
+  DemuxOutput *output = gst_pad_get_element_private (pad);
+
+  g_mutex_lock (&output_lock);
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_FLUSH_START:
+      output->flushing = TRUE;
+      break;
+    case GST_EVENT_FLUSH_STOP:
+      output->flushing = FALSE;
+      output->next = FLUSH_SEQ;
+      output->n_flushes++;
+      break;
+    case GST_EVENT_EOS:
+      output->eos = TRUE;
+      break;
+    default:
+      break;
+  }
+  g_cond_broadcast (&output_cond);
+  g_mutex_unlock (&output_lock);
+
+  gst_event_unref (event);
+
+  return TRUE;
+}
+
+static void
+output_pad_added (GstElement * demux, GstPad * pad, gpointer user_data)
+{
+  DemuxOutput *output = g_new0 (DemuxOutput, 1);
+
+  output->pad = gst_pad_new_from_static_template (&sink_template, "sink");
+  gst_pad_set_element_private (output->pad, output);
+  gst_pad_set_chain_function (output->pad, output_chain);
+  gst_pad_set_event_function (output->pad, output_event);
+  gst_pad_set_active (output->pad, TRUE);
+  fail_unless (gst_pad_link (pad, output->pad) == GST_PAD_LINK_OK);
+
+  g_mutex_lock (&output_lock);
+  g_ptr_array_add (outputs, output);
+  g_cond_broadcast (&output_cond);
+  g_mutex_unlock (&output_lock);
+}
+
+static void
+output_free (DemuxOutput * output)
+{
+  gst_pad_set_active (output->pad, FALSE);
+  gst_object_unref (output->pad);
+  g_free (output);
+}
+
+/* Acts as an upstream element able to seek in TIME */
+static gboolean
+upstream_event (GstPad * pad, GstObject * parent, GstEvent * event)
+{
+  if (GST_EVENT_TYPE (event) == GST_EVENT_SEEK) {
+    seek_received = TRUE;
+    seek_seqnum = GST_EVENT_SEQNUM (event);
+  }
+
+  gst_event_unref (event);
+
+  return TRUE;
+}
+
+static GstElement *
+setup_tsdemux_workers (guint n_workers)
+{
+  GstElement *demux;
+  GstCaps *caps;
+
+  demux = gst_check_setup_element ("tsdemux");
+  g_object_set (demux, "worker-threads", n_workers, NULL);
+  mysrcpad = gst_check_setup_src_pad (demux, &src_template);
+  gst_pad_set_event_function (mysrcpad, upstream_event);
+  gst_pad_set_active (mysrcpad, TRUE);
+  g_signal_connect (demux, "pad-added", G_CALLBACK (output_pad_added), NULL);
+
+  outputs = g_ptr_array_new_with_free_func ((GDestroyNotify) output_free);
+  hold_output = FALSE;
+  push_offset = 0;
+  push_pcr = 90000;
+  memset (push_cc, 0, sizeof (push_cc));
+  seek_received = FALSE;
+
+  fail_unless (gst_element_set_state (demux, GST_STATE_PLAYING) ==
+      GST_STATE_CHANGE_SUCCESS);
+  caps = gst_caps_from_string ("video/mpegts, systemstream = (boolean) true");
+  gst_check_setup_events (mysrcpad, demux, caps, GST_FORMAT_BYTES);
+  gst_caps_unref (caps);
+
+  return demux;
+}
+
+static void
+cleanup_tsdemux_workers (GstElement * demux)
+{
+  gst_element_set_state (demux, GST_STATE_NULL);
+  g_ptr_array_unref (outputs);
+  outputs = NULL;
+  gst_pad_set_active (mysrcpad, FALSE);
+  gst_check_teardown_src_pad (demux);
+  gst_check_teardown_element (demux);
+}
+
+/* Pushes a PAT and a PMT of @version with @n_streams MPEG audio streams on
+ * the PIDs following @pid */
+static void
+push_worker_psi (guint8 version, guint16 pid, guint n_streams)
+{
+  GstBuffer *buf = gst_buffer_new_allocate (NULL, 2 * TS_PACKET_SIZE, NULL);
+  GstMapInfo map;
+
+  gst_buffer_map (buf, &map, GST_MAP_WRITE);
+  write_psi (map.data, version, pid, 0x03, n_streams);
+  gst_buffer_unmap (buf, &map);
+
+  GST_BUFFER_OFFSET (buf) = push_offset;
+  push_offset += 2 * TS_PACKET_SIZE;
+  fail_unless (gst_pad_push (mysrcpad, buf) == GST_FLOW_OK);
+}
+
+/* Pushes @n_pes PES on each of the @n_streams streams following @pid, the
+ * payload of the n-th PES of a stream being filled with @first_seq + n */
+static void
+push_worker_pes (guint16 pid, guint n_streams, guint n_pes, guint8 first_seq)
+{
+  gsize pes_size = WORKER_PES_PACKETS * TS_PACKET_SIZE;
+  gsize size = n_pes * n_streams * pes_size;
+  GstBuffer *buf = gst_buffer_new_allocate (NULL, size, NULL);
+  GstMapInfo map;
+  guint8 *p;
+  guint i, j;
+
+  gst_buffer_map (buf, &map, GST_MAP_WRITE);
+  p = map.data;
+  for (i = 0; i < n_pes; i++) {
+    for (j = 0; j < n_streams; j++, p += pes_size)
+      write_pes (p, pid + j, 0xc0 + j, WORKER_PES_PACKETS, push_pcr,
+          push_pcr + 9000, first_seq + i, &push_cc[j]);
+    push_pcr += 3600;
+  }
+  gst_buffer_unmap (buf, &map);
+
+  GST_BUFFER_OFFSET (buf) = push_offset;
+  push_offset += size;
+  fail_unless (gst_pad_push (mysrcpad, buf) == GST_FLOW_OK);
+}
+
+/* Waits until @n_outputs pads were added and all of them received EOS */
+static void
+wait_outputs_eos (guint n_outputs)
+{
+  gint64 end_time = g_get_monotonic_time () + 10 * G_TIME_SPAN_SECOND;
+  guint i;
+
+  g_mutex_lock (&output_lock);
+  while (outputs->len < n_outputs)
+    fail_unless (g_cond_wait_until (&output_cond, &output_lock, end_time));
+  for (i = 0; i < outputs->len; i++) {
+    DemuxOutput *output = g_ptr_array_index (outputs, i);
+
+    while (!output->eos)
+      fail_unless (g_cond_wait_until (&output_cond, &output_lock, end_time));
+  }
+  g_mutex_unlock (&output_lock);
+
+  fail_unless_equals_int (outputs->len, n_outputs);
+}
+
+/* Waits until @n_outputs pads were added and all of them hold a buffer */
+static void
+wait_outputs_held (guint n_outputs)
+{
+  gint64 end_time = g_get_monotonic_time () + 10 * G_TIME_SPAN_SECOND;
+  guint i;
+
+  g_mutex_lock (&output_lock);
+  while (outputs->len < n_outputs)
+    fail_unless (g_cond_wait_until (&output_cond, &output_lock, end_time));
+  for (i = 0; i < outputs->len; i++) {
+    DemuxOutput *output = g_ptr_array_index (outputs, i);
+
+    while (!output->held)
+      fail_unless (g_cond_wait_until (&output_cond, &output_lock, end_time));
+  }
+  g_mutex_unlock (&output_lock);
+}
+
+static void
+check_output (guint index, guint n_buffers)
+{
+  DemuxOutput *output = g_ptr_array_index (outputs, index);
+
+  fail_unless_equals_int (output->n_errors, 0);
+  fail_unless_equals_int (output->n_buffers, n_buffers);
+  fail_unless (output->eos);
+  /* Pushed from a worker, not from the streaming thread */
+  fail_unless (output->thread != NULL);
+  fail_unless (output->thread != g_thread_self ());
+}
+
+GST_START_TEST (test_worker_threads_order)
+{
+  GstElement *demux = setup_tsdemux_workers (2);
+  DemuxOutput *output[3];
+  guint i;
+
+  /* Three streams on two workers, with more PES than a worker queues */
+  push_worker_psi (0, PES_PID, 3);
+  push_worker_pes (PES_PID, 3, 200, 0);
+  fail_unless (gst_pad_push_event (mysrcpad, gst_event_new_eos ()));
+
+  wait_outputs_eos (3);
+  for (i = 0; i < 3; i++) {
+    check_output (i, 200);
+    output[i] = g_ptr_array_index (outputs, i);
+  }
+
+  /* The streams on even and odd PIDs are pushed by different workers */
+  fail_unless (output[0]->thread == output[2]->thread);
+  fail_unless (output[0]->thread != output[1]->thread);
+
+  cleanup_tsdemux_workers (demux);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_worker_threads_flushing_seek)
+{
+  GstElement *demux = setup_tsdemux_workers (2);
+  DemuxOutput *output;
+  GstSegment segment;
+  GstEvent *event;
+  guint i;
+
+  /* Block the outputs so that the workers have buffers queued when
+   * the seek happens */
+  hold_output = TRUE;
+  push_worker_psi (0, PES_PID, 2);
+  push_worker_pes (PES_PID, 2, 32, 0);
+  wait_outputs_held (2);
+
+  output = g_ptr_array_index (outputs, 0);
+  event = gst_event_new_seek (1.0, GST_FORMAT_TIME, GST_SEEK_FLAG_FLUSH,
+      GST_SEEK_TYPE_SET, 0, GST_SEEK_TYPE_NONE, -1);
+  fail_unless (gst_pad_push_event (output->pad, event));
+  fail_unless (seek_received);
+
+  /* Upstream handles the seek, flushes and restarts from the beginning */
+  event = gst_event_new_flush_start ();
+  gst_event_set_seqnum (event, seek_seqnum);
+  fail_unless (gst_pad_push_event (mysrcpad, event));
+
+  g_mutex_lock (&output_lock);
+  hold_output = FALSE;
+  g_cond_broadcast (&output_cond);
+  g_mutex_unlock (&output_lock);
+
+  event = gst_event_new_flush_stop (TRUE);
+  gst_event_set_seqnum (event, seek_seqnum);
+  fail_unless (gst_pad_push_event (mysrcpad, event));
+
+  gst_segment_init (&segment, GST_FORMAT_BYTES);
+  event = gst_event_new_segment (&segment);
+  gst_event_set_seqnum (event, seek_seqnum);
+  fail_unless (gst_pad_push_event (mysrcpad, event));
+
+  push_offset = 0;
+  push_pcr = 90000;
+  push_worker_psi (0, PES_PID, 2);
+  push_worker_pes (PES_PID, 2, 32, FLUSH_SEQ);
+  fail_unless (gst_pad_push_event (mysrcpad, gst_event_new_eos ()));
+
+  /* Only what was pushed after the flush comes out, in order */
+  wait_outputs_eos (2);
+  for (i = 0; i < 2; i++) {
+    check_output (i, 32);
+    output = g_ptr_array_index (outputs, i);
+    fail_unless_equals_int (output->n_flushes, 1);
+  }
+
+  cleanup_tsdemux_workers (demux);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_worker_threads_change)
+{
+  GstElement *demux = setup_tsdemux_workers (2);
+  DemuxOutput *output[4];
+  guint i;
+
+  push_worker_psi (0, PES_PID, 2);
+  push_worker_pes (PES_PID, 2, 16, 0);
+
+  /* Only applied when the next program starts */
+  g_object_set (demux, "worker-threads", 1, NULL);
+  push_worker_pes (PES_PID, 2, 16, 16);
+
+  /* New PMT version with other streams, the first program is removed */
+  push_worker_psi (1, PES_PID + 2, 2);
+  push_worker_pes (PES_PID + 2, 2, 16, 0);
+  fail_unless (gst_pad_push_event (mysrcpad, gst_event_new_eos ()));
+
+  wait_outputs_eos (4);
+  check_output (0, 32);
+  check_output (1, 32);
+  check_output (2, 16);
+  check_output (3, 16);
+
+  for (i = 0; i < 4; i++)
+    output[i] = g_ptr_array_index (outputs, i);
+  /* Two workers for the first program, a single one for the second */
+  fail_unless (output[0]->thread != output[1]->thread);
+  fail_unless (output[2]->thread == output[3]->thread);
+
+  cleanup_tsdemux_workers (demux);
+}
+
+GST_END_TEST;
+
+static Suite *
+mpegtsdemux_suite (void)
+{
+  Suite *s = suite_create ("mpegtsdemux");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_packet_throughput);
+  tcase_add_test (tc_chain, test_packet_throughput_resync);
+  tcase_add_test (tc_chain, test_pes_zero_copy);
+  tcase_add_test (tc_chain, test_pes_zero_copy_split);
+  tcase_add_test (tc_chain, test_pes_single_buffer);
+  tcase_add_test (tc_chain, test_worker_threads_order);
+  tcase_add_test (tc_chain, test_worker_threads_flushing_seek);
+  tcase_add_test (tc_chain, test_worker_threads_change);
+
+  return s;
+}
+
+GST_CHECK_MAIN (mpegtsdemux);
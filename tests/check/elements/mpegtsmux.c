@@ -19,6 +19,7 @@
  */
 
 #include <gst/check/gstcheck.h>
+#include <stdio.h>
 #include <string.h>
 #include <gst/video/video.h>
 
@@ -71,14 +72,14 @@ setup_src_pad (GstElement * element,
     sinkpad = gst_element_get_request_pad (element, sinkname);
   fail_if (sinkpad == NULL, "Could not get sink pad from %s",
       GST_ELEMENT_NAME (element));
-  /* references are owned by: 1) us, 2) tsmux, 3) collect pads */
-  ASSERT_OBJECT_REFCOUNT (sinkpad, "sinkpad", 3);
+  /* references are owned by: 1) us, 2) tsmux */
+  ASSERT_OBJECT_REFCOUNT (sinkpad, "sinkpad", 2);
   fail_unless (gst_pad_link (srcpad, sinkpad) == GST_PAD_LINK_OK,
       "Could not link source and %s sink pads", GST_ELEMENT_NAME (element));
   gst_object_unref (sinkpad);   /* because we got it higher up */
 
-  /* references are owned by: 1) tsmux, 2) collect pads */
-  ASSERT_OBJECT_REFCOUNT (sinkpad, "sinkpad", 2);
+  /* references are owned by: 1) tsmux */
+  ASSERT_OBJECT_REFCOUNT (sinkpad, "sinkpad", 1);
 
   if (padname)
     *padname = g_strdup (GST_PAD_NAME (sinkpad));
@@ -94,16 +95,16 @@ teardown_src_pad (GstElement * element, const gchar * sinkname)
   /* clean up floating src pad */
   if (!(sinkpad = gst_element_get_static_pad (element, sinkname)))
     sinkpad = gst_element_get_request_pad (element, sinkname);
-  /* pad refs held by 1) tsmux 2) collectpads and 3) us (through _get) */
-  ASSERT_OBJECT_REFCOUNT (sinkpad, "sinkpad", 3);
+  /* pad refs held by 1) tsmux and 2) us (through _get) */
+  ASSERT_OBJECT_REFCOUNT (sinkpad, "sinkpad", 2);
   srcpad = gst_pad_get_peer (sinkpad);
 
   gst_pad_unlink (srcpad, sinkpad);
   GST_DEBUG ("src %p", srcpad);
 
   /* after unlinking, pad refs still held by
-   * 1) tsmux and 2) collectpads and 3) us (through _get) */
-  ASSERT_OBJECT_REFCOUNT (sinkpad, "sinkpad", 3);
+   * 1) tsmux and 2) us (through _get) */
+  ASSERT_OBJECT_REFCOUNT (sinkpad, "sinkpad", 2);
   gst_object_unref (sinkpad);
   /* one more ref is held by element itself */
 
@@ -114,6 +115,41 @@ teardown_src_pad (GstElement * element, const gchar * sinkname)
 
 }
 
+/* Output is produced from the muxer's own streaming thread */
+static gboolean got_eos;
+
+static gboolean
+eos_sink_event (GstPad * pad, GstObject * parent, GstEvent * event)
+{
+  if (GST_EVENT_TYPE (event) == GST_EVENT_EOS) {
+    g_mutex_lock (&check_mutex);
+    got_eos = TRUE;
+    g_cond_broadcast (&check_cond);
+    g_mutex_unlock (&check_mutex);
+  }
+
+  gst_event_unref (event);
+  return TRUE;
+}
+
+static void
+wait_for_buffers (guint n_buffers)
+{
+  g_mutex_lock (&check_mutex);
+  while (g_list_length (buffers) < n_buffers)
+    g_cond_wait (&check_cond, &check_mutex);
+  g_mutex_unlock (&check_mutex);
+}
+
+static void
+wait_for_eos (void)
+{
+  g_mutex_lock (&check_mutex);
+  while (!got_eos)
+    g_cond_wait (&check_cond, &check_mutex);
+  g_mutex_unlock (&check_mutex);
+}
+
 static GstElement *
 setup_tsmux (GstStaticPadTemplate * srctemplate, const gchar * sinkname,
     gchar ** padname)
@@ -124,6 +160,8 @@ setup_tsmux (GstStaticPadTemplate * srctemplate, const gchar * sinkname,
   mux = gst_check_setup_element ("mpegtsmux");
   mysrcpad = setup_src_pad (mux, srctemplate, sinkname, padname);
   mysinkpad = gst_check_setup_sink_pad (mux, &sink_template);
+  gst_pad_set_event_function (mysinkpad, eos_sink_event);
+  got_eos = FALSE;
   gst_pad_set_active (mysrcpad, TRUE);
   gst_pad_set_active (mysinkpad, TRUE);
 
@@ -168,9 +206,9 @@ check_tsmux_pad (GstStaticPadTemplate * srctemplate,
   GST_BUFFER_TIMESTAMP (inbuffer) = 0;
   ASSERT_BUFFER_REFCOUNT (inbuffer, "inbuffer", 1);
   fail_unless (gst_pad_push (mysrcpad, inbuffer) == GST_FLOW_OK);
-  num_buffers = g_list_length (buffers);
   /* all output might get aggregated */
-  fail_unless (num_buffers >= 1);
+  wait_for_buffers (1);
+  num_buffers = g_list_length (buffers);
 
   /* collect buffers in adapter for convenience */
   for (i = 0; i < num_buffers; ++i) {
@@ -363,13 +401,26 @@ sink_event (GstPad * pad, GstObject * parent, GstEvent * event)
 {
   TestData *data = (TestData *) gst_pad_get_element_private (pad);
 
-  if (event->type == GST_EVENT_CUSTOM_DOWNSTREAM)
+  if (event->type == GST_EVENT_CUSTOM_DOWNSTREAM) {
+    g_mutex_lock (&check_mutex);
     data->sink_event = event;
+    g_cond_broadcast (&check_cond);
+    g_mutex_unlock (&check_mutex);
+  }
 
   gst_event_unref (event);
   return TRUE;
 }
 
+static void
+wait_for_sink_event (TestData * data)
+{
+  g_mutex_lock (&check_mutex);
+  while (data->sink_event == NULL)
+    g_cond_wait (&check_cond, &check_mutex);
+  g_mutex_unlock (&check_mutex);
+}
+
 static void
 link_sinks (GstElement * mpegtsmux,
     GstPad ** src1, GstPad ** src2, GstPad ** src3, TestData * test_data)
@@ -511,7 +562,7 @@ GST_START_TEST (test_force_key_unit_event_downstream)
   thread_data_4 = pad_push (src1, gst_buffer_new (), 4 * GST_SECOND);
 
   g_thread_join (thread_data_2->thread);
-  fail_unless (test_data.sink_event != NULL);
+  wait_for_sink_event (&test_data);
 
   gst_element_set_state (mpegtsmux, GST_STATE_NULL);
 
@@ -585,7 +636,7 @@ GST_START_TEST (test_force_key_unit_event_upstream)
   thread_data_4 = pad_push (src1, gst_buffer_new (), 4 * GST_SECOND);
 
   g_thread_join (thread_data_2->thread);
-  fail_unless (test_data.sink_event != NULL);
+  wait_for_sink_event (&test_data);
 
   gst_element_set_state (mpegtsmux, GST_STATE_NULL);
 
@@ -607,59 +658,85 @@ GST_START_TEST (test_force_key_unit_event_upstream)
 GST_END_TEST;
 
 static GstFlowReturn expected_flow;
+static guint flow_test_buffers;
 
 static GstFlowReturn
 flow_test_stat_chain_func (GstPad * pad, GstObject * parent, GstBuffer * buffer)
 {
   gst_buffer_unref (buffer);
 
+  g_mutex_lock (&check_mutex);
+  flow_test_buffers++;
+  g_cond_broadcast (&check_cond);
+  g_mutex_unlock (&check_mutex);
+
   GST_INFO ("returning flow %s (%d)", gst_flow_get_name (expected_flow),
       expected_flow);
   return expected_flow;
 }
 
+static void
+wait_for_flow_test_buffers (guint n_buffers)
+{
+  g_mutex_lock (&check_mutex);
+  while (flow_test_buffers < n_buffers)
+    g_cond_wait (&check_cond, &check_mutex);
+  g_mutex_unlock (&check_mutex);
+}
+
 GST_START_TEST (test_propagate_flow_status)
 {
   GstElement *mux;
   gchar *padname;
   GstBuffer *inbuffer;
   GstCaps *caps;
-  guint i;
+  guint i, n;
 
   GstFlowReturn expected[] = { GST_FLOW_OK, GST_FLOW_FLUSHING, GST_FLOW_EOS,
     GST_FLOW_NOT_NEGOTIATED, GST_FLOW_ERROR, GST_FLOW_NOT_SUPPORTED
   };
 
-  mux = setup_tsmux (&video_src_template, "sink_%d", &padname);
-  gst_pad_set_chain_function (mysinkpad, flow_test_stat_chain_func);
-
-  fail_unless (gst_element_set_state (mux,
-          GST_STATE_PLAYING) == GST_STATE_CHANGE_SUCCESS,
-      "could not set to playing");
+  for (i = 0; i < G_N_ELEMENTS (expected); ++i) {
+    GstFlowReturn res = GST_FLOW_OK;
 
-  caps = gst_caps_from_string (VIDEO_CAPS_STRING);
-  gst_check_setup_events (mysrcpad, mux, caps, GST_FORMAT_TIME);
-  gst_caps_unref (caps);
+    /* the muxer stops after a fatal flow, so use a new one each time */
+    mux = setup_tsmux (&video_src_template, "sink_%d", &padname);
+    gst_pad_set_chain_function (mysinkpad, flow_test_stat_chain_func);
+    flow_test_buffers = 0;
 
-  for (i = 0; i < G_N_ELEMENTS (expected); ++i) {
-    GstFlowReturn res;
+    fail_unless (gst_element_set_state (mux,
+            GST_STATE_PLAYING) == GST_STATE_CHANGE_SUCCESS,
+        "could not set to playing");
 
-    inbuffer = gst_buffer_new_and_alloc (1);
-    ASSERT_BUFFER_REFCOUNT (inbuffer, "inbuffer", 1);
+    caps = gst_caps_from_string (VIDEO_CAPS_STRING);
+    gst_check_setup_events (mysrcpad, mux, caps, GST_FORMAT_TIME);
+    gst_caps_unref (caps);
 
     expected_flow = expected[i];
     GST_INFO ("expecting flow %s (%d)", gst_flow_get_name (expected_flow),
         expected_flow);
 
-    GST_BUFFER_TIMESTAMP (inbuffer) = i * GST_SECOND;
+    /* the flow returned downstream is reported upstream on the next push */
+    for (n = 0; n < 10; n++) {
+      inbuffer = gst_buffer_new_and_alloc (1);
+      ASSERT_BUFFER_REFCOUNT (inbuffer, "inbuffer", 1);
+      GST_BUFFER_TIMESTAMP (inbuffer) = n * GST_SECOND;
 
-    res = gst_pad_push (mysrcpad, inbuffer);
+      res = gst_pad_push (mysrcpad, inbuffer);
+      if (res == expected[i])
+        break;
+      fail_unless_equals_int (res, GST_FLOW_OK);
 
+      wait_for_flow_test_buffers (n + 1);
+      /* an EOS flow makes the muxer go EOS and stop */
+      if (expected[i] == GST_FLOW_EOS)
+        wait_for_eos ();
+    }
     fail_unless_equals_int (res, expected[i]);
-  }
 
-  cleanup_tsmux (mux, padname);
-  g_free (padname);
+    cleanup_tsmux (mux, padname);
+    g_free (padname);
+  }
 }
 
 GST_END_TEST;
@@ -716,6 +793,263 @@ GST_START_TEST (test_multiple_state_change)
 
 GST_END_TEST;
 
+#define CBR_BITRATE 500000
+#define CBR_PCR_INTERVAL 1800
+
+GST_START_TEST (test_constant_bitrate)
+{
+  GstElement *mux;
+  gchar *padname;
+  GstCaps *caps;
+  GstClockTime last_ts = 0;
+  gint64 prev_pcr = -1;
+  guint64 offset = 0, prev_pcr_offset = 0;
+  guint n_null = 0, n_pcr = 0;
+  gint cc[0x2000];
+  gint i;
+
+  for (i = 0; i < G_N_ELEMENTS (cc); i++)
+    cc[i] = -1;
+
+  mux = setup_tsmux (&audio_src_template, "sink_%d", &padname);
+  g_object_set (mux, "bitrate", (guint64) CBR_BITRATE, "pcr-interval",
+      CBR_PCR_INTERVAL, NULL);
+  fail_unless (gst_element_set_state (mux,
+          GST_STATE_PLAYING) == GST_STATE_CHANGE_SUCCESS,
+      "could not set to playing");
+
+  caps = gst_caps_from_string (AUDIO_CAPS_STRING);
+  gst_check_setup_events (mysrcpad, mux, caps, GST_FORMAT_TIME);
+  gst_caps_unref (caps);
+
+  /* 100 small audio frames over 2 seconds, a lot less than the bitrate */
+  for (i = 0; i < 100; i++) {
+    GstBuffer *inbuffer = gst_buffer_new_and_alloc (100);
+
+    gst_buffer_memset (inbuffer, 0, 0, 100);
+    GST_BUFFER_PTS (inbuffer) = i * 20 * GST_MSECOND;
+    fail_unless (gst_pad_push (mysrcpad, inbuffer) == GST_FLOW_OK);
+  }
+  fail_unless (gst_pad_push_event (mysrcpad, gst_event_new_eos ()));
+  wait_for_eos ();
+
+  fail_unless (buffers != NULL);
+  while (buffers) {
+    GstBuffer *outbuffer = GST_BUFFER (buffers->data);
+    GstMapInfo map;
+    guint8 *data;
+    gsize size;
+
+    buffers = g_list_remove (buffers, outbuffer);
+
+    /* Output is timestamped for paced sending */
+    fail_unless (GST_BUFFER_PTS_IS_VALID (outbuffer));
+    fail_unless (GST_BUFFER_PTS (outbuffer) >= last_ts);
+    last_ts = GST_BUFFER_PTS (outbuffer);
+
+    gst_buffer_map (outbuffer, &map, GST_MAP_READ);
+    fail_unless (map.size % 188 == 0);
+    for (data = map.data, size = map.size; size;
+        data += 188, size -= 188, offset += 188) {
+      guint pid = GST_READ_UINT16_BE (data + 1) & 0x1FFF;
+      gint64 pcr, expected;
+
+      fail_unless (data[0] == 0x47);
+
+      if (pid == 0x1FFF) {
+        n_null++;
+        continue;
+      }
+
+      /* The continuity counter only increments with a payload, PCR-only
+       * packets repeat the previous one */
+      if (cc[pid] != -1) {
+        if (data[3] & 0x10)
+          fail_unless_equals_int (data[3] & 0x0f, (cc[pid] + 1) & 0x0f);
+        else
+          fail_unless_equals_int (data[3] & 0x0f, cc[pid]);
+      }
+      cc[pid] = data[3] & 0x0f;
+
+      /* adaptation field with PCR flag */
+      if (!(data[3] & 0x20) || data[4] == 0 || !(data[5] & 0x10))
+        continue;
+
+      pcr = ((gint64) GST_READ_UINT32_BE (data + 6) << 1 | data[10] >> 7) * 300
+          + ((data[10] & 0x1) << 8 | data[11]);
+      n_pcr++;
+
+      if (prev_pcr != -1) {
+        /* PCR interval is respected, give or take a packet */
+        fail_unless (pcr - prev_pcr <= (CBR_PCR_INTERVAL + 300) * 300);
+        /* and PCR advance at the mux rate */
+        expected = gst_util_uint64_scale (offset - prev_pcr_offset,
+            8 * 27000000, CBR_BITRATE);
+        fail_unless (ABS (pcr - prev_pcr - expected) <= 1);
+      }
+      prev_pcr = pcr;
+      prev_pcr_offset = offset;
+    }
+    gst_buffer_unmap (outbuffer, &map);
+    gst_buffer_unref (outbuffer);
+  }
+
+  GST_INFO ("%u null packets, %u PCR in %" G_GUINT64_FORMAT " bytes", n_null,
+      n_pcr, offset);
+  fail_unless (n_null > 0);
+  fail_unless (n_pcr > 10);
+  /* about 2 seconds at the mux rate */
+  fail_unless (offset >= CBR_BITRATE / 8 * 3 / 2);
+
+  cleanup_tsmux (mux, padname);
+  g_free (padname);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_constant_bitrate_jump)
+{
+  GstElement *mux;
+  gchar *padname;
+  GstCaps *caps;
+  guint64 size = 0;
+  gint i;
+
+  mux = setup_tsmux (&audio_src_template, "sink_%d", &padname);
+  g_object_set (mux, "bitrate", (guint64) CBR_BITRATE, NULL);
+  fail_unless (gst_element_set_state (mux,
+          GST_STATE_PLAYING) == GST_STATE_CHANGE_SUCCESS,
+      "could not set to playing");
+
+  caps = gst_caps_from_string (AUDIO_CAPS_STRING);
+  gst_check_setup_events (mysrcpad, mux, caps, GST_FORMAT_TIME);
+  gst_caps_unref (caps);
+
+  /* a jump of an hour must not be stuffed with null packets */
+  for (i = 0; i < 10; i++) {
+    GstBuffer *inbuffer = gst_buffer_new_and_alloc (100);
+
+    gst_buffer_memset (inbuffer, 0, 0, 100);
+    GST_BUFFER_PTS (inbuffer) = i * 20 * GST_MSECOND;
+    if (i >= 5)
+      GST_BUFFER_PTS (inbuffer) += 3600 * GST_SECOND;
+    fail_unless (gst_pad_push (mysrcpad, inbuffer) == GST_FLOW_OK);
+  }
+  fail_unless (gst_pad_push_event (mysrcpad, gst_event_new_eos ()));
+  wait_for_eos ();
+
+  while (buffers) {
+    GstBuffer *outbuffer = GST_BUFFER (buffers->data);
+
+    buffers = g_list_remove (buffers, outbuffer);
+    size += gst_buffer_get_size (outbuffer);
+    gst_buffer_unref (outbuffer);
+  }
+
+  /* less than a second at the mux rate */
+  fail_unless (size < CBR_BITRATE / 8);
+
+  cleanup_tsmux (mux, padname);
+  g_free (padname);
+}
+
+GST_END_TEST;
+
+static guint
+count_pid_packets (GList * list, guint pid)
+{
+  guint count = 0;
+
+  for (; list; list = list->next) {
+    GstMapInfo map;
+    gsize offset;
+
+    gst_buffer_map (GST_BUFFER (list->data), &map, GST_MAP_READ);
+    for (offset = 0; offset + 188 <= map.size; offset += 188) {
+      fail_unless (map.data[offset] == 0x47);
+      if ((GST_READ_UINT16_BE (map.data + offset + 1) & 0x1FFF) == pid)
+        count++;
+    }
+    gst_buffer_unmap (GST_BUFFER (list->data), &map);
+  }
+
+  return count;
+}
+
+GST_START_TEST (test_add_remove_pad_while_playing)
+{
+  GstElement *mux;
+  gchar *padname;
+  GstPad *audio_src, *audio_sink;
+  GstBuffer *inbuffer;
+  GstSegment segment;
+  GstCaps *caps;
+  guint video_pid, audio_pid;
+
+  mux = setup_tsmux (&video_src_template, "sink_%d", &padname);
+  fail_unless (sscanf (padname, "sink_%u", &video_pid) == 1);
+  fail_unless (gst_element_set_state (mux,
+          GST_STATE_PLAYING) == GST_STATE_CHANGE_SUCCESS,
+      "could not set to playing");
+
+  caps = gst_caps_from_string (VIDEO_CAPS_STRING);
+  gst_check_setup_events (mysrcpad, mux, caps, GST_FORMAT_TIME);
+  gst_caps_unref (caps);
+
+  inbuffer = gst_buffer_new_and_alloc (1);
+  GST_BUFFER_PTS (inbuffer) = 0;
+  fail_unless (gst_pad_push (mysrcpad, inbuffer) == GST_FLOW_OK);
+  wait_for_buffers (1);
+
+  /* add an audio stream while running */
+  audio_src = gst_pad_new_from_static_template (&audio_src_template, "src");
+  audio_sink = gst_element_get_request_pad (mux, "sink_%d");
+  fail_unless (audio_sink != NULL);
+  fail_unless (sscanf (GST_PAD_NAME (audio_sink), "sink_%u", &audio_pid) == 1);
+  fail_unless (gst_pad_link (audio_src, audio_sink) == GST_PAD_LINK_OK);
+  gst_pad_set_active (audio_src, TRUE);
+
+  gst_segment_init (&segment, GST_FORMAT_TIME);
+  caps = gst_caps_from_string (AUDIO_CAPS_STRING);
+  gst_pad_push_event (audio_src, gst_event_new_stream_start ("audio"));
+  gst_pad_push_event (audio_src, gst_event_new_caps (caps));
+  gst_pad_push_event (audio_src, gst_event_new_segment (&segment));
+  gst_caps_unref (caps);
+
+  inbuffer = gst_buffer_new_and_alloc (1);
+  GST_BUFFER_PTS (inbuffer) = 10 * GST_MSECOND;
+  fail_unless (gst_pad_push (audio_src, inbuffer) == GST_FLOW_OK);
+  inbuffer = gst_buffer_new_and_alloc (1);
+  GST_BUFFER_PTS (inbuffer) = 20 * GST_MSECOND;
+  fail_unless (gst_pad_push (mysrcpad, inbuffer) == GST_FLOW_OK);
+
+  /* the audio frame goes first and is muxed into a stream of its own */
+  wait_for_buffers (2);
+  fail_unless (count_pid_packets (buffers, audio_pid) > 0);
+
+  /* and remove it again, the video stream must carry on alone */
+  gst_pad_set_active (audio_src, FALSE);
+  gst_pad_unlink (audio_src, audio_sink);
+  gst_element_release_request_pad (mux, audio_sink);
+  gst_object_unref (audio_sink);
+  gst_object_unref (audio_src);
+
+  inbuffer = gst_buffer_new_and_alloc (1);
+  GST_BUFFER_PTS (inbuffer) = 40 * GST_MSECOND;
+  fail_unless (gst_pad_push (mysrcpad, inbuffer) == GST_FLOW_OK);
+  fail_unless (gst_pad_push_event (mysrcpad, gst_event_new_eos ()));
+  wait_for_eos ();
+
+  fail_unless (g_list_length (buffers) >= 4);
+  fail_unless (count_pid_packets (buffers, video_pid) >= 3);
+
+  gst_check_drop_buffers ();
+  cleanup_tsmux (mux, padname);
+  g_free (padname);
+}
+
+GST_END_TEST;
+
 static Suite *
 mpegtsmux_suite (void)
 {
@@ -730,6 +1064,9 @@ mpegtsmux_suite (void)
   tcase_add_test (tc_chain, test_force_key_unit_event_upstream);
   tcase_add_test (tc_chain, test_propagate_flow_status);
   tcase_add_test (tc_chain, test_multiple_state_change);
+  tcase_add_test (tc_chain, test_constant_bitrate);
+  tcase_add_test (tc_chain, test_constant_bitrate_jump);
+  tcase_add_test (tc_chain, test_add_remove_pad_while_playing);
 
   return s;
 }
@@ -0,0 +1,116 @@
+/* GStreamer
+ *
+ * unit test for the mpegtsdemux packetizer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/check/gstcheck.h>
+
+#include "mpegtspacketizer.c"
+
+#define TS_PACKET_SIZE 188
+
+/* Pushes @n_bytes of null packets, cut at any byte */
+static void
+push_null_packets (MpegTSPacketizer2 * packetizer, gsize n_bytes,
+    gsize * written)
+{
+  GstBuffer *buf = gst_buffer_new_allocate (NULL, n_bytes, NULL);
+  GstMapInfo map;
+  gsize i;
+
+  gst_buffer_map (buf, &map, GST_MAP_WRITE);
+  for (i = 0; i < n_bytes; i++, (*written)++) {
+    switch (*written % TS_PACKET_SIZE) {
+      case 0:
+        map.data[i] = 0x47;
+        break;
+      case 1:
+        map.data[i] = 0x1f;
+        break;
+      case 2:
+        map.data[i] = 0xff;
+        break;
+      case 3:
+        map.data[i] = 0x10;
+        break;
+      default:
+        map.data[i] = 0xff;
+        break;
+    }
+  }
+  gst_buffer_unmap (buf, &map);
+
+  GST_BUFFER_OFFSET (buf) = *written - n_bytes;
+  mpegts_packetizer_push (packetizer, buf);
+}
+
+GST_START_TEST (test_has_packets)
+{
+  MpegTSPacketizer2 *packetizer = mpegts_packetizer_new ();
+  gsize written = 0;
+  guint i;
+
+  push_null_packets (packetizer, 10 * TS_PACKET_SIZE, &written);
+  fail_unless (mpegts_packetizer_has_packets (packetizer));
+  fail_unless_equals_int (packetizer->packet_size, TS_PACKET_SIZE);
+
+  /* Partially consume the mapped data, one packet is left */
+  for (i = 0; i < 9; i++)
+    fail_unless (mpegts_packetizer_process_next_packet (packetizer) !=
+        PACKET_NEED_MORE);
+  fail_unless (packetizer->map_data != NULL);
+  fail_unless (mpegts_packetizer_has_packets (packetizer));
+
+  /* Less than one packet, the consumed data that is still in the adapter
+   * doesn't count */
+  push_null_packets (packetizer, 100, &written);
+  fail_unless (mpegts_packetizer_process_next_packet (packetizer) !=
+      PACKET_NEED_MORE);
+  fail_if (mpegts_packetizer_has_packets (packetizer));
+  fail_unless (mpegts_packetizer_process_next_packet (packetizer) ==
+      PACKET_NEED_MORE);
+  fail_if (mpegts_packetizer_has_packets (packetizer));
+
+  push_null_packets (packetizer, TS_PACKET_SIZE - 100, &written);
+  fail_unless (mpegts_packetizer_has_packets (packetizer));
+  fail_unless (mpegts_packetizer_process_next_packet (packetizer) !=
+      PACKET_NEED_MORE);
+  fail_if (mpegts_packetizer_has_packets (packetizer));
+
+  g_object_unref (packetizer);
+}
+
+GST_END_TEST;
+
+static Suite *
+mpegtspacketizer_suite (void)
+{
+  Suite *s = suite_create ("mpegtspacketizer");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_has_packets);
+
+  return s;
+}
+
+GST_CHECK_MAIN (mpegtspacketizer);
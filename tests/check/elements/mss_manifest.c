@@ -0,0 +1,404 @@
+/* GStreamer
+ *
+ * unit test for the Smooth Streaming manifest
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <gst/check/gstcheck.h>
+
+#undef GST_CAT_DEFAULT
+#include "gstmssmanifest.h"
+#include "gstmssmanifest.c"
+
+GST_DEBUG_CATEGORY (mssdemux_debug);
+
+/* Video fragments of timescale 10000000: 3 of 2s, one more of 2s following
+ * them, a gap and 4 of 1s */
+static const gchar *VOD_MANIFEST = "<?xml version=\"1.0\"?>\
+<SmoothStreamingMedia MajorVersion=\"2\" MinorVersion=\"0\"\
+    Duration=\"140000000\">\
+  <StreamIndex Type=\"video\" Chunks=\"8\"\
+      Url=\"QualityLevels({bitrate})/Fragments(video={start time})\">\
+    <QualityLevel Index=\"0\" Bitrate=\"800000\" FourCC=\"H264\"/>\
+    <QualityLevel Index=\"1\" Bitrate=\"200000\" FourCC=\"H264\"/>\
+    <c t=\"0\" d=\"20000000\" r=\"3\"/>\
+    <c d=\"20000000\"/>\
+    <c t=\"100000000\" d=\"10000000\" r=\"4\"/>\
+  </StreamIndex>\
+  <StreamIndex Type=\"audio\" Chunks=\"7\"\
+      Url=\"QualityLevels({bitrate})/Fragments(audio={start time})\">\
+    <QualityLevel Index=\"0\" Bitrate=\"64000\" FourCC=\"AACL\"\
+        SamplingRate=\"48000\" Channels=\"2\"/>\
+    <c t=\"0\" d=\"20000000\" r=\"7\"/>\
+  </StreamIndex>\
+</SmoothStreamingMedia>";
+
+static GstMssManifest *
+parse_manifest (const gchar * xml)
+{
+  GstBuffer *buffer;
+  GstMssManifest *manifest;
+  GSList *iter;
+
+  buffer = gst_buffer_new_wrapped (g_strdup (xml), strlen (xml));
+  manifest = gst_mss_manifest_new (buffer);
+  gst_buffer_unref (buffer);
+  fail_unless (manifest != NULL);
+
+  for (iter = gst_mss_manifest_get_streams (manifest); iter;
+      iter = g_slist_next (iter))
+    gst_mss_stream_set_active (iter->data, TRUE);
+
+  return manifest;
+}
+
+static void
+reload_manifest (GstMssManifest * manifest, const gchar * xml)
+{
+  GstBuffer *buffer;
+
+  buffer = gst_buffer_new_wrapped (g_strdup (xml), strlen (xml));
+  gst_mss_manifest_reload_fragments (manifest, buffer);
+  gst_buffer_unref (buffer);
+}
+
+static GstMssStream *
+get_stream (GstMssManifest * manifest, guint index)
+{
+  return g_slist_nth_data (gst_mss_manifest_get_streams (manifest), index);
+}
+
+#define assert_fragment_url(stream, expected) \
+  G_STMT_START { \
+    gchar *url = NULL; \
+    fail_unless_equals_int (gst_mss_stream_get_fragment_url (stream, &url), \
+        GST_FLOW_OK); \
+    fail_unless_equals_string (url, expected); \
+    g_free (url); \
+  } G_STMT_END
+
+GST_START_TEST (test_seek)
+{
+  GstMssManifest *manifest = parse_manifest (VOD_MANIFEST);
+  GstMssStream *video = get_stream (manifest, 0);
+
+  /* inside a run */
+  gst_mss_stream_seek (video, TRUE, 5 * GST_SECOND);
+  assert_fragment_url (video,
+      "QualityLevels(200000)/Fragments(video=40000000)");
+  fail_unless_equals_uint64 (gst_mss_stream_get_fragment_gst_timestamp (video),
+      4 * GST_SECOND);
+  fail_unless_equals_uint64 (gst_mss_stream_get_fragment_gst_duration (video),
+      2 * GST_SECOND);
+
+  /* the run continuing the first one */
+  gst_mss_stream_seek (video, TRUE, 7 * GST_SECOND);
+  assert_fragment_url (video,
+      "QualityLevels(200000)/Fragments(video=60000000)");
+
+  /* in the gap, the next fragment is used */
+  gst_mss_stream_seek (video, TRUE, 9 * GST_SECOND);
+  assert_fragment_url (video,
+      "QualityLevels(200000)/Fragments(video=100000000)");
+
+  gst_mss_stream_seek (video, TRUE, 13500 * GST_MSECOND);
+  assert_fragment_url (video,
+      "QualityLevels(200000)/Fragments(video=130000000)");
+
+  /* after the end */
+  gst_mss_stream_seek (video, TRUE, 14 * GST_SECOND);
+  fail_if (gst_mss_stream_has_next_fragment (video));
+
+  gst_mss_stream_seek (video, TRUE, 0);
+  assert_fragment_url (video, "QualityLevels(200000)/Fragments(video=0)");
+
+  gst_mss_manifest_free (manifest);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_advance_regress)
+{
+  GstMssManifest *manifest = parse_manifest (VOD_MANIFEST);
+  GstMssStream *video = get_stream (manifest, 0);
+  gchar *url = NULL;
+  gint i;
+
+  for (i = 0; i < 3; i++)
+    fail_unless_equals_int (gst_mss_stream_advance_fragment (video),
+        GST_FLOW_OK);
+  assert_fragment_url (video,
+      "QualityLevels(200000)/Fragments(video=60000000)");
+
+  /* peeking goes over the gap without moving */
+  fail_unless_equals_int (gst_mss_stream_peek_fragment_url (video, 2, TRUE,
+          &url), GST_FLOW_OK);
+  fail_unless_equals_string (url,
+      "QualityLevels(200000)/Fragments(video=110000000)");
+  g_free (url);
+  fail_unless_equals_int (gst_mss_stream_peek_fragment_url (video, 5, TRUE,
+          &url), GST_FLOW_EOS);
+
+  fail_unless_equals_int (gst_mss_stream_advance_fragment (video),
+      GST_FLOW_OK);
+  assert_fragment_url (video,
+      "QualityLevels(200000)/Fragments(video=100000000)");
+  fail_unless_equals_int (gst_mss_stream_regress_fragment (video),
+      GST_FLOW_OK);
+  fail_unless_equals_int (gst_mss_stream_regress_fragment (video),
+      GST_FLOW_OK);
+  assert_fragment_url (video,
+      "QualityLevels(200000)/Fragments(video=40000000)");
+
+  gst_mss_stream_seek (video, TRUE, 13 * GST_SECOND);
+  fail_unless_equals_int (gst_mss_stream_advance_fragment (video),
+      GST_FLOW_EOS);
+  fail_if (gst_mss_stream_has_next_fragment (video));
+
+  gst_mss_manifest_free (manifest);
+}
+
+GST_END_TEST;
+
+/* A live manifest of @count fragments of 2s from fragment @first, each
+ * given with its own c node */
+static gchar *
+build_live_manifest (guint first, guint count)
+{
+  GString *s = g_string_new (NULL);
+  guint i;
+
+  g_string_append (s, "<?xml version=\"1.0\"?>"
+      "<SmoothStreamingMedia MajorVersion=\"2\" MinorVersion=\"0\" "
+      "Duration=\"0\" IsLive=\"TRUE\" LookAheadFragmentCount=\"2\" "
+      "DVRWindowLength=\"0\">"
+      "<StreamIndex Type=\"video\" "
+      "Url=\"QualityLevels({bitrate})/Fragments(video={start time})\">"
+      "<QualityLevel Index=\"0\" Bitrate=\"200000\" FourCC=\"H264\"/>");
+  for (i = first; i < first + count; i++)
+    g_string_append_printf (s,
+        "<c t=\"%" G_GUINT64_FORMAT "\" d=\"20000000\"/>",
+        (guint64) i * 20000000);
+  g_string_append (s, "</StreamIndex></SmoothStreamingMedia>");
+
+  return g_string_free (s, FALSE);
+}
+
+GST_START_TEST (test_live_reload)
+{
+  GstMssManifest *manifest;
+  GstMssStream *video;
+  gchar *xml;
+
+  xml = build_live_manifest (0, 3);
+  manifest = parse_manifest (xml);
+  g_free (xml);
+  video = get_stream (manifest, 0);
+  fail_unless (gst_mss_manifest_is_live (manifest));
+
+  fail_unless_equals_int (gst_mss_stream_advance_fragment (video),
+      GST_FLOW_OK);
+  fail_unless_equals_int (gst_mss_stream_advance_fragment (video),
+      GST_FLOW_OK);
+  fail_unless_equals_int (gst_mss_stream_advance_fragment (video),
+      GST_FLOW_EOS);
+
+  /* the window slid by 2 fragments, the stream continues where it was */
+  xml = build_live_manifest (2, 3);
+  reload_manifest (manifest, xml);
+  g_free (xml);
+  assert_fragment_url (video,
+      "QualityLevels(200000)/Fragments(video=60000000)");
+
+  /* the new fragments extend the last run, the runs that left the window
+   * are dropped */
+  fail_unless_equals_int (video->fragments->len, 1);
+  fail_unless_equals_uint64 (FRAGMENT (video->fragments, 0)->time, 40000000);
+  fail_unless_equals_int (FRAGMENT (video->fragments, 0)->repetitions, 3);
+
+  /* a run with a different duration after a gap */
+  reload_manifest (manifest, "<?xml version=\"1.0\"?>"
+      "<SmoothStreamingMedia IsLive=\"TRUE\">"
+      "<StreamIndex Type=\"video\" Url=\"Fragments(video={start time})\">"
+      "<c t=\"80000000\" d=\"20000000\"/>"
+      "<c t=\"120000000\" d=\"10000000\" r=\"2\"/>"
+      "</StreamIndex></SmoothStreamingMedia>");
+  fail_unless_equals_int (video->fragments->len, 2);
+  fail_unless_equals_int (gst_mss_stream_advance_fragment (video),
+      GST_FLOW_OK);
+  fail_unless_equals_int (gst_mss_stream_advance_fragment (video),
+      GST_FLOW_OK);
+  assert_fragment_url (video,
+      "QualityLevels(200000)/Fragments(video=120000000)");
+
+  gst_mss_manifest_free (manifest);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_live_reload_large)
+{
+  GstMssManifest *manifest;
+  GstMssStream *video;
+  GstClockTime start;
+  gchar *xml;
+
+  xml = build_live_manifest (0, 10000);
+  manifest = parse_manifest (xml);
+  g_free (xml);
+  video = get_stream (manifest, 0);
+  /* contiguous fragments of the same duration are kept as a single run */
+  fail_unless_equals_int (video->fragments->len, 1);
+
+  gst_mss_stream_seek (video, TRUE, 15000 * GST_SECOND);
+
+  xml = build_live_manifest (100, 10000);
+  start = gst_util_get_timestamp ();
+  reload_manifest (manifest, xml);
+  GST_INFO ("reload took %" GST_TIME_FORMAT,
+      GST_TIME_ARGS (gst_util_get_timestamp () - start));
+  g_free (xml);
+  fail_unless_equals_int (video->fragments->len, 1);
+
+  assert_fragment_url (video,
+      "QualityLevels(200000)/Fragments(video=150000000000)");
+  gst_mss_stream_seek (video, TRUE, 20198 * GST_SECOND);
+  assert_fragment_url (video,
+      "QualityLevels(200000)/Fragments(video=201980000000)");
+
+  gst_mss_manifest_free (manifest);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_trick_mode)
+{
+  GstMssManifest *manifest = parse_manifest (VOD_MANIFEST);
+  GstMssStream *video = get_stream (manifest, 0);
+  GstMssStream *audio = get_stream (manifest, 1);
+
+  fail_unless (gst_mss_stream_select_bitrate (video, 1000000));
+  fail_unless_equals_uint64 (gst_mss_stream_get_current_bitrate (video),
+      800000);
+
+  /* fast forward uses the lowest bitrate and skips fragments */
+  fail_unless (gst_mss_stream_set_trick_mode (video, 4.0));
+  fail_if (gst_mss_stream_set_trick_mode (audio, 4.0));
+  fail_unless_equals_uint64 (gst_mss_stream_get_current_bitrate (video),
+      200000);
+  fail_if (gst_mss_stream_select_bitrate (video, 1000000));
+  fail_if (gst_mss_stream_has_next_fragment (audio));
+
+  assert_fragment_url (video, "QualityLevels(200000)/Fragments(video=0)");
+  fail_unless_equals_int (gst_mss_stream_advance_fragment (video),
+      GST_FLOW_OK);
+  assert_fragment_url (video,
+      "QualityLevels(200000)/Fragments(video=100000000)");
+  fail_unless_equals_int (gst_mss_stream_advance_fragment (video),
+      GST_FLOW_EOS);
+
+  /* rewinding */
+  fail_if (gst_mss_stream_set_trick_mode (video, -2.0));
+  gst_mss_stream_seek (video, TRUE, 13 * GST_SECOND);
+  fail_unless_equals_int (gst_mss_stream_regress_fragment (video),
+      GST_FLOW_OK);
+  assert_fragment_url (video,
+      "QualityLevels(200000)/Fragments(video=110000000)");
+
+  /* back to normal playback and bitrate */
+  fail_unless (gst_mss_stream_set_trick_mode (video, 1.0));
+  fail_if (gst_mss_stream_set_trick_mode (audio, 1.0));
+  fail_unless_equals_uint64 (gst_mss_stream_get_current_bitrate (video),
+      800000);
+  fail_unless (gst_mss_stream_has_next_fragment (audio));
+  fail_unless_equals_int (gst_mss_stream_advance_fragment (video),
+      GST_FLOW_OK);
+  assert_fragment_url (video,
+      "QualityLevels(800000)/Fragments(video=120000000)");
+
+  gst_mss_manifest_free (manifest);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_reverse_seek)
+{
+  GstMssManifest *manifest = parse_manifest (VOD_MANIFEST);
+  GstMssStream *video = get_stream (manifest, 0);
+  GstMssStream *audio = get_stream (manifest, 1);
+
+  /* rewinding from the stop position of the segment, which is the end of
+   * the last fragment */
+  fail_unless (gst_mss_stream_set_trick_mode (video, -2.0));
+  fail_if (gst_mss_stream_set_trick_mode (audio, -2.0));
+  gst_mss_manifest_seek (manifest, FALSE, 14 * GST_SECOND);
+  assert_fragment_url (video,
+      "QualityLevels(200000)/Fragments(video=130000000)");
+  fail_unless_equals_int (gst_mss_stream_regress_fragment (video),
+      GST_FLOW_OK);
+  assert_fragment_url (video,
+      "QualityLevels(200000)/Fragments(video=110000000)");
+  fail_unless_equals_int (gst_mss_stream_regress_fragment (video),
+      GST_FLOW_OK);
+  assert_fragment_url (video,
+      "QualityLevels(200000)/Fragments(video=60000000)");
+  fail_unless_equals_int (gst_mss_stream_regress_fragment (video),
+      GST_FLOW_OK);
+  assert_fragment_url (video,
+      "QualityLevels(200000)/Fragments(video=20000000)");
+  fail_unless_equals_int (gst_mss_stream_regress_fragment (video),
+      GST_FLOW_EOS);
+
+  /* without a stop position, from the last fragment */
+  gst_mss_manifest_seek (manifest, FALSE, GST_CLOCK_TIME_NONE);
+  assert_fragment_url (video,
+      "QualityLevels(200000)/Fragments(video=130000000)");
+
+  /* the fragment before a gap */
+  gst_mss_stream_seek (video, FALSE, 9 * GST_SECOND);
+  assert_fragment_url (video,
+      "QualityLevels(200000)/Fragments(video=60000000)");
+
+  /* nothing before the first fragment */
+  gst_mss_stream_seek (video, FALSE, 0);
+  fail_if (gst_mss_stream_has_next_fragment (video));
+
+  gst_mss_manifest_free (manifest);
+}
+
+GST_END_TEST;
+
+static Suite *
+mss_manifest_suite (void)
+{
+  Suite *s = suite_create ("mss_manifest");
+  TCase *tc_core = tcase_create ("mssmanifest");
+
+  GST_DEBUG_CATEGORY_INIT (mssdemux_debug, "mssdemux", 0, "mssdemux tests");
+
+  suite_add_tcase (s, tc_core);
+  tcase_add_test (tc_core, test_seek);
+  tcase_add_test (tc_core, test_advance_regress);
+  tcase_add_test (tc_core, test_live_reload);
+  tcase_add_test (tc_core, test_live_reload_large);
+  tcase_add_test (tc_core, test_trick_mode);
+  tcase_add_test (tc_core, test_reverse_seek);
+
+  return s;
+}
+
+GST_CHECK_MAIN (mss_manifest);
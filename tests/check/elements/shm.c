@@ -26,6 +26,10 @@
 
 #include <gst/gst.h>
 #include <gst/check/gstcheck.h>
+#include <gst/video/video.h>
+#include <string.h>
+
+#include "gstshmmeta.c"
 
 
 static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
@@ -42,13 +46,18 @@ GstElement *src, *sink;
 GstPad *sinkpad, *srcpad;
 
 static void
-setup_shm (void)
+setup_shm_full (gboolean use_meta)
 {
   gchar *socket_path = NULL;
 
   sink = gst_check_setup_element ("shmsink");
   src = gst_check_setup_element ("shmsrc");
 
+  if (use_meta) {
+    g_object_set (sink, "send-meta", TRUE, NULL);
+    g_object_set (src, "use-meta", TRUE, NULL);
+  }
+
   srcpad = gst_check_setup_src_pad (sink, &src_template);
   sinkpad = gst_check_setup_sink_pad (src, &sink_template);
 
@@ -69,6 +78,12 @@ setup_shm (void)
       GST_STATE_CHANGE_SUCCESS);
 }
 
+static void
+setup_shm (void)
+{
+  setup_shm_full (FALSE);
+}
+
 static void
 teardown_shm (void)
 {
@@ -169,6 +184,506 @@ GST_START_TEST (test_shm_alloc)
 
 GST_END_TEST;
 
+GST_START_TEST (test_shm_scatter_gather)
+{
+  GstBuffer *buf;
+  GstMemory *mem;
+  GstQuery *query;
+  GstCaps *caps = gst_caps_new_empty_simple ("application/x-test");
+  GstAllocator *alloc;
+  GstAllocationParams params;
+  GstSegment segment;
+  GstMapInfo map;
+  guint8 data[500];
+  guint i;
+
+  gst_pad_push_event (srcpad, gst_event_new_stream_start ("test"));
+  gst_pad_push_event (srcpad, gst_event_new_caps (caps));
+  gst_segment_init (&segment, GST_FORMAT_BYTES);
+  gst_pad_push_event (srcpad, gst_event_new_segment (&segment));
+
+  query = gst_query_new_allocation (caps, FALSE);
+  gst_caps_unref (caps);
+  fail_unless (gst_pad_peer_query (srcpad, query));
+  gst_query_parse_nth_allocation_param (query, 0, &alloc, &params);
+  fail_unless (alloc != NULL);
+  gst_query_unref (query);
+
+  /* A header, a payload and a part of another block, like a payloader
+   * would produce */
+  buf = gst_buffer_new ();
+  for (i = 0; i < 3; i++) {
+    mem = gst_allocator_alloc (alloc, 200, &params);
+    fail_unless (mem->allocator == alloc);
+    gst_memory_map (mem, &map, GST_MAP_WRITE);
+    memset (map.data, i + 1, map.size);
+    gst_memory_unmap (mem, &map);
+    if (i == 2) {
+      GstMemory *sub = gst_memory_share (mem, 100, 100);
+
+      gst_memory_unref (mem);
+      mem = sub;
+    }
+    gst_buffer_append_memory (buf, mem);
+  }
+  gst_object_unref (alloc);
+
+  fail_unless (gst_pad_push (srcpad, buf) == GST_FLOW_OK);
+
+  g_mutex_lock (&check_mutex);
+  while (buffers == NULL)
+    g_cond_wait (&check_cond, &check_mutex);
+  g_mutex_unlock (&check_mutex);
+  fail_unless_equals_int (g_list_length (buffers), 1);
+
+  /* The pieces were not copied into a single block */
+  buf = buffers->data;
+  fail_unless_equals_int (gst_buffer_n_memory (buf), 3);
+  fail_unless_equals_int (gst_buffer_get_size (buf), 500);
+  fail_unless_equals_int (gst_buffer_extract (buf, 0, data, 500), 500);
+  for (i = 0; i < 500; i++)
+    fail_unless_equals_int (data[i], i < 200 ? 1 : (i < 400 ? 2 : 3));
+
+  gst_check_drop_buffers ();
+  teardown_shm ();
+}
+
+GST_END_TEST;
+
+static void
+check_shm_stats (guint64 used_blocks, guint64 free_blocks,
+    gboolean fragmented)
+{
+  GstStructure *stats;
+  guint64 value, free_size, largest_free;
+  gdouble fragmentation;
+
+  g_object_get (sink, "stats", &stats, NULL);
+  fail_unless (stats != NULL);
+
+  fail_unless (gst_structure_get_uint64 (stats, "used-blocks", &value));
+  fail_unless_equals_uint64 (value, used_blocks);
+  fail_unless (gst_structure_get_uint64 (stats, "free-blocks", &value));
+  fail_unless_equals_uint64 (value, free_blocks);
+  fail_unless (gst_structure_get_uint64 (stats, "free", &free_size));
+  fail_unless (gst_structure_get_uint64 (stats, "largest-free",
+          &largest_free));
+  fail_unless (largest_free <= free_size);
+  fail_unless (gst_structure_get_double (stats, "fragmentation",
+          &fragmentation));
+  if (fragmented)
+    fail_unless (fragmentation > 0.0 && fragmentation < 1.0);
+  else
+    fail_unless (fragmentation == 0.0);
+
+  gst_structure_free (stats);
+}
+
+GST_START_TEST (test_shm_alloc_stats)
+{
+  GstQuery *query;
+  GstAllocator *alloc;
+  GstAllocationParams params;
+  GstMemory *mems[16];
+  GstMapInfo map;
+  guint i;
+
+  /* Nothing is allocated yet, so this applies to the current area */
+  g_object_set (sink, "block-alignment", 4096, NULL);
+
+  query = gst_query_new_allocation (NULL, FALSE);
+  fail_unless (gst_pad_peer_query (srcpad, query));
+  fail_unless (gst_query_get_n_allocation_params (query) == 1);
+  gst_query_parse_nth_allocation_param (query, 0, &alloc, &params);
+  fail_unless (alloc != NULL);
+  gst_query_unref (query);
+
+  check_shm_stats (0, 1, FALSE);
+
+  for (i = 0; i < G_N_ELEMENTS (mems); i++) {
+    mems[i] = gst_allocator_alloc (alloc, 1000 + i * 5000, &params);
+    fail_unless (gst_memory_map (mems[i], &map, GST_MAP_READ));
+    fail_unless (((guintptr) map.data & 4095) == 0);
+    gst_memory_unmap (mems[i], &map);
+  }
+  check_shm_stats (16, 1, FALSE);
+
+  /* Leave holes between the blocks still in use */
+  for (i = 0; i < G_N_ELEMENTS (mems); i += 2)
+    gst_memory_unref (mems[i]);
+  check_shm_stats (8, 9, TRUE);
+
+  /* Freed blocks are merged with their free neighbours */
+  for (i = 1; i < G_N_ELEMENTS (mems); i += 2)
+    gst_memory_unref (mems[i]);
+  check_shm_stats (0, 1, FALSE);
+
+  gst_object_unref (alloc);
+  teardown_shm ();
+}
+
+GST_END_TEST;
+
+static GstBuffer *
+push_meta_buffer (GstClockTime pts, gsize offset, gint stride)
+{
+  GstBuffer *buf;
+  gsize offsets[GST_VIDEO_MAX_PLANES] = { offset, };
+  gint strides[GST_VIDEO_MAX_PLANES] = { stride, };
+
+  buf = gst_buffer_new_allocate (NULL, 1000, NULL);
+  GST_BUFFER_PTS (buf) = pts;
+  GST_BUFFER_DTS (buf) = pts - GST_MSECOND;
+  GST_BUFFER_DURATION (buf) = 40 * GST_MSECOND;
+  GST_BUFFER_OFFSET (buf) = 12;
+  GST_BUFFER_FLAG_SET (buf, GST_BUFFER_FLAG_DELTA_UNIT);
+  gst_buffer_add_video_meta_full (buf, GST_VIDEO_FRAME_FLAG_NONE,
+      GST_VIDEO_FORMAT_GRAY8, 16, 16, 1, offsets, strides);
+
+  fail_unless (gst_pad_push (srcpad, buf) == GST_FLOW_OK);
+
+  g_mutex_lock (&check_mutex);
+  while (buffers == NULL)
+    g_cond_wait (&check_cond, &check_mutex);
+  g_mutex_unlock (&check_mutex);
+  fail_unless_equals_int (g_list_length (buffers), 1);
+
+  return buffers->data;
+}
+
+GST_START_TEST (test_shm_meta)
+{
+  GstBuffer *buf;
+  GstVideoMeta *vmeta;
+  GstCaps *caps, *caps2, *srccaps;
+  GstSegment segment;
+
+  setup_shm_full (TRUE);
+
+  caps = gst_caps_from_string ("video/x-raw, format=GRAY8, width=16, "
+      "height=16, framerate=25/1");
+  caps2 = gst_caps_from_string ("video/x-raw, format=GRAY8, width=16, "
+      "height=16, framerate=50/1");
+
+  gst_pad_push_event (srcpad, gst_event_new_stream_start ("test"));
+  gst_pad_push_event (srcpad, gst_event_new_caps (caps));
+  gst_segment_init (&segment, GST_FORMAT_TIME);
+  gst_pad_push_event (srcpad, gst_event_new_segment (&segment));
+
+  buf = push_meta_buffer (GST_SECOND, 8, 32);
+
+  fail_unless_equals_uint64 (GST_BUFFER_PTS (buf), GST_SECOND);
+  fail_unless_equals_uint64 (GST_BUFFER_DTS (buf), GST_SECOND - GST_MSECOND);
+  fail_unless_equals_uint64 (GST_BUFFER_DURATION (buf), 40 * GST_MSECOND);
+  fail_unless_equals_uint64 (GST_BUFFER_OFFSET (buf), 12);
+  fail_unless (GST_BUFFER_FLAG_IS_SET (buf, GST_BUFFER_FLAG_DELTA_UNIT));
+
+  vmeta = gst_buffer_get_video_meta (buf);
+  fail_unless (vmeta != NULL);
+  fail_unless_equals_int (vmeta->format, GST_VIDEO_FORMAT_GRAY8);
+  fail_unless_equals_int (vmeta->n_planes, 1);
+  fail_unless_equals_int (vmeta->offset[0], 8);
+  fail_unless_equals_int (vmeta->stride[0], 32);
+
+  srccaps = gst_pad_get_current_caps (sinkpad);
+  fail_unless (srccaps != NULL);
+  fail_unless (gst_caps_is_equal (srccaps, caps));
+  gst_caps_unref (srccaps);
+  gst_check_drop_buffers ();
+
+  /* The source renegotiates when the caps change */
+  gst_pad_push_event (srcpad, gst_event_new_caps (caps2));
+  buf = push_meta_buffer (2 * GST_SECOND, 0, 16);
+
+  fail_unless_equals_uint64 (GST_BUFFER_PTS (buf), 2 * GST_SECOND);
+  vmeta = gst_buffer_get_video_meta (buf);
+  fail_unless (vmeta != NULL);
+  fail_unless_equals_int (vmeta->stride[0], 16);
+
+  srccaps = gst_pad_get_current_caps (sinkpad);
+  fail_unless (srccaps != NULL);
+  fail_unless (gst_caps_is_equal (srccaps, caps2));
+  gst_caps_unref (srccaps);
+  gst_check_drop_buffers ();
+
+  gst_caps_unref (caps);
+  gst_caps_unref (caps2);
+  teardown_shm ();
+}
+
+GST_END_TEST;
+
+/* Serializes a buffer of @size bytes with a GRAY8 16x16 video meta, lets
+ * @corrupt modify the header, and returns whether it can be deserialized */
+static gboolean
+deserialize_meta (gsize size, void (*corrupt) (GstShmMetaHeader * header))
+{
+  GstBuffer *buf, *outbuf;
+  gsize offsets[GST_VIDEO_MAX_PLANES] = { 8, };
+  gint strides[GST_VIDEO_MAX_PLANES] = { 32, };
+  guint8 data[sizeof (GstShmMetaHeader)];
+  GstShmMetaHeader header;
+  gchar *caps = NULL;
+  gboolean ret;
+
+  buf = gst_buffer_new_allocate (NULL, 1000, NULL);
+  gst_buffer_add_video_meta_full (buf, GST_VIDEO_FRAME_FLAG_NONE,
+      GST_VIDEO_FORMAT_GRAY8, 16, 16, 1, offsets, strides);
+  gst_shm_meta_serialize (buf, NULL, data);
+  gst_buffer_unref (buf);
+
+  if (corrupt) {
+    memcpy (&header, data, sizeof (header));
+    corrupt (&header);
+    memcpy (data, &header, sizeof (header));
+  }
+
+  outbuf = gst_buffer_new_allocate (NULL, size, NULL);
+  ret = gst_shm_meta_deserialize (data, sizeof (data), outbuf, &caps);
+  fail_unless (caps == NULL);
+  fail_unless (ret == (gst_buffer_get_video_meta (outbuf) != NULL));
+  gst_buffer_unref (outbuf);
+
+  return ret;
+}
+
+static void
+corrupt_format (GstShmMetaHeader * header)
+{
+  header->video_format = 0xffff;
+}
+
+static void
+corrupt_n_planes (GstShmMetaHeader * header)
+{
+  header->n_planes = GST_VIDEO_MAX_PLANES + 1;
+}
+
+static void
+corrupt_stride (GstShmMetaHeader * header)
+{
+  header->stride[0] = 64;
+}
+
+static void
+corrupt_negative_stride (GstShmMetaHeader * header)
+{
+  header->stride[0] = -32;
+}
+
+static void
+corrupt_offset (GstShmMetaHeader * header)
+{
+  header->plane_offset[0] = 500;
+}
+
+GST_START_TEST (test_shm_meta_invalid)
+{
+  fail_unless (deserialize_meta (1000, NULL));
+  /* 8 + 32 * 16 bytes are needed */
+  fail_unless (deserialize_meta (520, NULL));
+  fail_if (deserialize_meta (519, NULL));
+
+  fail_if (deserialize_meta (1000, corrupt_format));
+  fail_if (deserialize_meta (1000, corrupt_n_planes));
+  fail_if (deserialize_meta (1000, corrupt_stride));
+  fail_if (deserialize_meta (1000, corrupt_negative_stride));
+  fail_if (deserialize_meta (1000, corrupt_offset));
+}
+
+GST_END_TEST;
+
+#define TRANSPORT_BUFFER_SIZE 1000
+#define TRANSPORT_MAX_CONSUMERS 2
+
+typedef struct
+{
+  guint received;
+  guint errors;
+  gint64 latency;
+} TransportConsumer;
+
+static GMutex transport_lock;
+static GCond transport_cond;
+static guint transport_connected;
+static guint transport_sent;
+static gint64 *transport_send_times;
+
+static void
+transport_client_connected (GstElement * shmsink, gint fd, gpointer user_data)
+{
+  g_mutex_lock (&transport_lock);
+  transport_connected++;
+  g_cond_broadcast (&transport_cond);
+  g_mutex_unlock (&transport_lock);
+}
+
+static void
+transport_send_handoff (GstElement * identity, GstBuffer * buf,
+    gpointer user_data)
+{
+  g_mutex_lock (&transport_lock);
+  transport_send_times[transport_sent++] = g_get_monotonic_time ();
+  g_mutex_unlock (&transport_lock);
+}
+
+static void
+transport_recv_handoff (GstElement * fakesink, GstBuffer * buf, GstPad * pad,
+    TransportConsumer * consumer)
+{
+  gint64 now = g_get_monotonic_time ();
+  guint8 first = 0;
+
+  /* fakesrc continues its pattern from one buffer to the next, so this
+   * also checks the ordering */
+  gst_buffer_extract (buf, 0, &first, 1);
+
+  g_mutex_lock (&transport_lock);
+  if (gst_buffer_get_size (buf) != TRANSPORT_BUFFER_SIZE ||
+      first != ((consumer->received * TRANSPORT_BUFFER_SIZE) & 0xff))
+    consumer->errors++;
+  consumer->latency += now - transport_send_times[consumer->received];
+  consumer->received++;
+  g_cond_broadcast (&transport_cond);
+  g_mutex_unlock (&transport_lock);
+}
+
+/* Sends @n_buffers from a shmsink to @n_consumers shmsrc, either over the
+ * socket or through a ring if @ring_size is not 0, and returns the number
+ * of buffers per second and the average latency in microseconds */
+static void
+run_transport (guint ring_size, guint n_consumers, guint n_buffers,
+    gdouble * throughput, gdouble * latency)
+{
+  GstElement *sink_pipeline, *src_pipelines[TRANSPORT_MAX_CONSUMERS];
+  TransportConsumer consumers[TRANSPORT_MAX_CONSUMERS];
+  GstElement *element;
+  gchar *desc, *socket_path;
+  gint64 start, elapsed, end_time, total_latency = 0;
+  gboolean done = FALSE;
+  guint i;
+
+  fail_unless (n_consumers <= TRANSPORT_MAX_CONSUMERS);
+  memset (consumers, 0, sizeof (consumers));
+  transport_connected = 0;
+  transport_sent = 0;
+  transport_send_times = g_new0 (gint64, n_buffers);
+
+  /* Room for about as many buffers in the shm area as in the ring */
+  desc = g_strdup_printf ("fakesrc is-live=true num-buffers=%u sizetype=fixed"
+      " sizemax=%u filltype=pattern-span ! identity name=identity"
+      " ! shmsink name=sink socket-path=shm-transport-test sync=false"
+      " shm-size=%u ring-size=%u", n_buffers, TRANSPORT_BUFFER_SIZE,
+      64 * 1024, ring_size);
+  sink_pipeline = gst_parse_launch (desc, NULL);
+  g_free (desc);
+  fail_unless (sink_pipeline != NULL);
+
+  element = gst_bin_get_by_name (GST_BIN (sink_pipeline), "identity");
+  g_signal_connect (element, "handoff", G_CALLBACK (transport_send_handoff),
+      NULL);
+  gst_object_unref (element);
+
+  /* The live source only starts in PLAYING, once all the clients are
+   * connected */
+  element = gst_bin_get_by_name (GST_BIN (sink_pipeline), "sink");
+  g_signal_connect (element, "client-connected",
+      G_CALLBACK (transport_client_connected), NULL);
+  fail_if (gst_element_set_state (sink_pipeline, GST_STATE_PAUSED) ==
+      GST_STATE_CHANGE_FAILURE);
+  g_object_get (element, "socket-path", &socket_path, NULL);
+  gst_object_unref (element);
+  fail_unless (socket_path != NULL);
+
+  for (i = 0; i < n_consumers; i++) {
+    desc = g_strdup_printf ("shmsrc socket-path=%s ! fakesink name=fakesink"
+        " signal-handoffs=true sync=false", socket_path);
+    src_pipelines[i] = gst_parse_launch (desc, NULL);
+    g_free (desc);
+    fail_unless (src_pipelines[i] != NULL);
+
+    element = gst_bin_get_by_name (GST_BIN (src_pipelines[i]), "fakesink");
+    g_signal_connect (element, "handoff", G_CALLBACK (transport_recv_handoff),
+        &consumers[i]);
+    gst_object_unref (element);
+
+    fail_if (gst_element_set_state (src_pipelines[i], GST_STATE_PLAYING) ==
+        GST_STATE_CHANGE_FAILURE);
+  }
+  g_free (socket_path);
+
+  g_mutex_lock (&transport_lock);
+  while (transport_connected < n_consumers)
+    g_cond_wait (&transport_cond, &transport_lock);
+  g_mutex_unlock (&transport_lock);
+
+  start = g_get_monotonic_time ();
+  fail_if (gst_element_set_state (sink_pipeline, GST_STATE_PLAYING) ==
+      GST_STATE_CHANGE_FAILURE);
+
+  end_time = start + 60 * G_USEC_PER_SEC;
+  g_mutex_lock (&transport_lock);
+  while (!done) {
+    done = TRUE;
+    for (i = 0; i < n_consumers; i++) {
+      if (consumers[i].received < n_buffers)
+        done = FALSE;
+    }
+    if (!done && !g_cond_wait_until (&transport_cond, &transport_lock,
+            end_time))
+      break;
+  }
+  g_mutex_unlock (&transport_lock);
+  elapsed = g_get_monotonic_time () - start;
+
+  for (i = 0; i < n_consumers; i++) {
+    fail_unless_equals_int (gst_element_set_state (src_pipelines[i],
+            GST_STATE_NULL), GST_STATE_CHANGE_SUCCESS);
+    gst_object_unref (src_pipelines[i]);
+  }
+  fail_unless_equals_int (gst_element_set_state (sink_pipeline,
+          GST_STATE_NULL), GST_STATE_CHANGE_SUCCESS);
+  gst_object_unref (sink_pipeline);
+
+  for (i = 0; i < n_consumers; i++) {
+    fail_unless_equals_int (consumers[i].received, n_buffers);
+    fail_unless_equals_int (consumers[i].errors, 0);
+    total_latency += consumers[i].latency;
+  }
+
+  g_free (transport_send_times);
+  transport_send_times = NULL;
+
+  if (throughput)
+    *throughput = (gdouble) n_buffers * G_USEC_PER_SEC / MAX (elapsed, 1);
+  if (latency)
+    *latency = (gdouble) total_latency / (n_buffers * n_consumers);
+}
+
+GST_START_TEST (test_shm_ring)
+{
+  /* A small ring, so it wraps around many times */
+  run_transport (8, 1, 500, NULL, NULL);
+  run_transport (8, 2, 500, NULL, NULL);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_shm_transport_benchmark)
+{
+  guint ring_sizes[] = { 0, 64 };
+  gdouble throughput, latency;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (ring_sizes); i++) {
+    run_transport (ring_sizes[i], 1, 20000, &throughput, &latency);
+    GST_INFO ("%s: %.0f buffers/second, %.1f us average latency",
+        ring_sizes[i] ? "ring" : "socket", throughput, latency);
+  }
+}
+
+GST_END_TEST;
+
 static Suite *
 shm_suite (void)
 {
@@ -179,6 +694,18 @@ shm_suite (void)
   tcase_add_checked_fixture (tc, setup_shm, NULL);
   tcase_add_test (tc, test_shm_sysmem_alloc);
   tcase_add_test (tc, test_shm_alloc);
+  tcase_add_test (tc, test_shm_alloc_stats);
+  tcase_add_test (tc, test_shm_scatter_gather);
+  suite_add_tcase (s, tc);
+
+  tc = tcase_create ("meta");
+  tcase_add_test (tc, test_shm_meta);
+  tcase_add_test (tc, test_shm_meta_invalid);
+  suite_add_tcase (s, tc);
+
+  tc = tcase_create ("transport");
+  tcase_add_test (tc, test_shm_ring);
+  tcase_add_test (tc, test_shm_transport_benchmark);
   suite_add_tcase (s, tc);
 
   return s;
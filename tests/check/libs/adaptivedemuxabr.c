@@ -0,0 +1,321 @@
+/* GStreamer
+ *
+ * unit test for the adaptive demuxers bitrate adaptation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <gst/check/gstcheck.h>
+#include <gst/adaptivedemux/gstadaptivedemuxabr.h>
+
+#define MBPS 1000000
+#define CHUNK_SIZE 16384
+#define FRAGMENT_DURATION (2 * GST_SECOND)
+
+/* Replays the download of a fragment of @size bytes at @rate bits per second,
+ * received in chunks like from a http source */
+static void
+replay_fragment (GstAdaptiveDemuxAbr * abr, guint64 size, guint64 rate)
+{
+  guint64 left = size;
+
+  while (left > 0) {
+    guint64 chunk = MIN (left, CHUNK_SIZE);
+
+    gst_adaptive_demux_abr_add_sample (abr, chunk,
+        gst_util_uint64_scale (chunk, 8 * GST_SECOND, rate));
+    left -= chunk;
+  }
+
+  gst_adaptive_demux_abr_fragment_finished (abr, size,
+      gst_util_uint64_scale (size, 8 * GST_SECOND, rate), FRAGMENT_DURATION);
+}
+
+#define assert_close(a, b) \
+  fail_unless (ABS ((gint64) (a) - (gint64) (b)) <= (gint64) (b) / 100, \
+      "%" G_GUINT64_FORMAT " is not close to %" G_GUINT64_FORMAT, \
+      (guint64) (a), (guint64) (b))
+
+GST_START_TEST (test_abr_steady)
+{
+  GstAdaptiveDemuxAbrAlgorithm algorithms[] = {
+    GST_ADAPTIVE_DEMUX_ABR_EWMA, GST_ADAPTIVE_DEMUX_ABR_HARMONIC,
+    GST_ADAPTIVE_DEMUX_ABR_BUFFER
+  };
+  gint i, j;
+
+  for (i = 0; i < G_N_ELEMENTS (algorithms); i++) {
+    GstAdaptiveDemuxAbr *abr = gst_adaptive_demux_abr_new (algorithms[i], 10);
+
+    fail_unless_equals_int (gst_adaptive_demux_abr_get_algorithm (abr),
+        algorithms[i]);
+    for (j = 0; j < 5; j++)
+      replay_fragment (abr, 1024 * 1024, 4 * MBPS);
+
+    assert_close (gst_adaptive_demux_abr_get_bandwidth (abr), 4 * MBPS);
+    assert_close (gst_adaptive_demux_abr_get_bitrate (abr, GST_CLOCK_TIME_NONE),
+        4 * MBPS);
+    gst_adaptive_demux_abr_free (abr);
+  }
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_abr_harmonic_reacts_to_drop)
+{
+  GstAdaptiveDemuxAbr *ewma, *harmonic;
+  gint i;
+
+  ewma = gst_adaptive_demux_abr_new (GST_ADAPTIVE_DEMUX_ABR_EWMA, 10);
+  harmonic = gst_adaptive_demux_abr_new (GST_ADAPTIVE_DEMUX_ABR_HARMONIC, 10);
+
+  for (i = 0; i < 5; i++) {
+    replay_fragment (ewma, 2 * 1024 * 1024, 10 * MBPS);
+    replay_fragment (harmonic, 2 * 1024 * 1024, 10 * MBPS);
+  }
+
+  /* a single slow fragment is enough for the harmonic mean to follow, as
+   * it fills the whole window with low samples */
+  replay_fragment (ewma, 2 * 1024 * 1024, 1 * MBPS);
+  replay_fragment (harmonic, 2 * 1024 * 1024, 1 * MBPS);
+
+  assert_close (gst_adaptive_demux_abr_get_bandwidth (harmonic), 1 * MBPS);
+  fail_unless (gst_adaptive_demux_abr_get_bandwidth (ewma) > 3 * MBPS);
+
+  gst_adaptive_demux_abr_free (ewma);
+  gst_adaptive_demux_abr_free (harmonic);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_abr_harmonic_ignores_spikes)
+{
+  GstAdaptiveDemuxAbr *abr;
+  guint64 bandwidth;
+  gint i;
+
+  abr = gst_adaptive_demux_abr_new (GST_ADAPTIVE_DEMUX_ABR_HARMONIC, 10);
+
+  /* 9 samples at 2 Mbps and one burst from a cache at 100 Mbps */
+  for (i = 0; i < 9; i++)
+    gst_adaptive_demux_abr_add_sample (abr, 25000, 100 * GST_MSECOND);
+  gst_adaptive_demux_abr_add_sample (abr, 1250000, 100 * GST_MSECOND);
+
+  bandwidth = gst_adaptive_demux_abr_get_bandwidth (abr);
+  fail_unless (bandwidth < 2300000, "bandwidth %" G_GUINT64_FORMAT,
+      bandwidth);
+
+  gst_adaptive_demux_abr_free (abr);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_abr_harmonic_ignores_tails)
+{
+  GstAdaptiveDemuxAbr *abr;
+
+  abr = gst_adaptive_demux_abr_new (GST_ADAPTIVE_DEMUX_ABR_HARMONIC, 10);
+
+  /* a 4 Mbps fragment ending with a short and slow read */
+  gst_adaptive_demux_abr_add_sample (abr, 500000, GST_SECOND);
+  gst_adaptive_demux_abr_add_sample (abr, 100, 50 * GST_MSECOND);
+  gst_adaptive_demux_abr_fragment_finished (abr, 500100,
+      GST_SECOND + 50 * GST_MSECOND, FRAGMENT_DURATION);
+  assert_close (gst_adaptive_demux_abr_get_bandwidth (abr), 4 * MBPS);
+  gst_adaptive_demux_abr_free (abr);
+
+  /* a whole fragment downloaded faster than a sample is still measured */
+  abr = gst_adaptive_demux_abr_new (GST_ADAPTIVE_DEMUX_ABR_HARMONIC, 10);
+  gst_adaptive_demux_abr_add_sample (abr, 50000, 50 * GST_MSECOND);
+  gst_adaptive_demux_abr_fragment_finished (abr, 50000, 50 * GST_MSECOND,
+      FRAGMENT_DURATION);
+  assert_close (gst_adaptive_demux_abr_get_bandwidth (abr), 8 * MBPS);
+  gst_adaptive_demux_abr_free (abr);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_abr_buffer_level)
+{
+  GstAdaptiveDemuxAbr *abr;
+  gint i;
+
+  abr = gst_adaptive_demux_abr_new (GST_ADAPTIVE_DEMUX_ABR_BUFFER, 10);
+  for (i = 0; i < 5; i++)
+    replay_fragment (abr, 1024 * 1024, 4 * MBPS);
+
+  /* unknown level uses the throughput */
+  assert_close (gst_adaptive_demux_abr_get_bitrate (abr, GST_CLOCK_TIME_NONE),
+      4 * MBPS);
+  /* empty buffer requests the lowest bitrate */
+  fail_unless_equals_uint64 (gst_adaptive_demux_abr_get_bitrate (abr, 0), 0);
+  /* 2 fragments buffered: half the throughput */
+  assert_close (gst_adaptive_demux_abr_get_bitrate (abr,
+          2 * FRAGMENT_DURATION), 2 * MBPS);
+  /* full buffer: above the throughput */
+  assert_close (gst_adaptive_demux_abr_get_bitrate (abr,
+          30 * FRAGMENT_DURATION), 5 * MBPS);
+
+  /* monotonic in between */
+  fail_unless (gst_adaptive_demux_abr_get_bitrate (abr, 3 * FRAGMENT_DURATION)
+      < gst_adaptive_demux_abr_get_bitrate (abr, 5 * FRAGMENT_DURATION));
+
+  gst_adaptive_demux_abr_free (abr);
+}
+
+GST_END_TEST;
+
+typedef struct
+{
+  guint samples;
+  guint fragments;
+} CustomState;
+
+static void
+custom_add_sample (GstAdaptiveDemuxAbr * abr, guint64 bytes, GstClockTime time)
+{
+  CustomState *state = gst_adaptive_demux_abr_get_state (abr);
+
+  state->samples++;
+}
+
+static void
+custom_fragment_finished (GstAdaptiveDemuxAbr * abr, guint64 bytes,
+    GstClockTime download_time, GstClockTime duration)
+{
+  CustomState *state = gst_adaptive_demux_abr_get_state (abr);
+
+  state->fragments++;
+}
+
+static guint64
+custom_get_bitrate (GstAdaptiveDemuxAbr * abr, GstClockTime buffer_level)
+{
+  CustomState *state = gst_adaptive_demux_abr_get_state (abr);
+
+  return state->fragments * MBPS;
+}
+
+static const GstAdaptiveDemuxAbrFuncs custom_funcs = {
+  sizeof (CustomState),
+  NULL,
+  NULL,
+  custom_add_sample,
+  custom_fragment_finished,
+  NULL,
+  custom_get_bitrate
+};
+
+GST_START_TEST (test_abr_custom)
+{
+  GstAdaptiveDemuxAbr *abr;
+  CustomState *state;
+
+  abr = gst_adaptive_demux_abr_new_custom (&custom_funcs);
+  fail_unless_equals_int (gst_adaptive_demux_abr_get_algorithm (abr),
+      GST_ADAPTIVE_DEMUX_ABR_CUSTOM);
+
+  replay_fragment (abr, 4 * CHUNK_SIZE, MBPS);
+  replay_fragment (abr, 4 * CHUNK_SIZE, MBPS);
+
+  state = gst_adaptive_demux_abr_get_state (abr);
+  fail_unless_equals_int (state->samples, 8);
+  fail_unless_equals_int (state->fragments, 2);
+  fail_unless_equals_uint64 (gst_adaptive_demux_abr_get_bitrate (abr, 0),
+      2 * MBPS);
+  /* without get_bandwidth the bitrate is used */
+  fail_unless_equals_uint64 (gst_adaptive_demux_abr_get_bandwidth (abr),
+      2 * MBPS);
+
+  gst_adaptive_demux_abr_free (abr);
+}
+
+GST_END_TEST;
+
+/* Replays a long trace alternating between good and bad network conditions
+ * through each algorithm and logs how long it takes and how often the
+ * requested bitrate crossed between the rungs of a typical ladder */
+GST_START_TEST (test_abr_replay_trace)
+{
+  static const guint64 ladder[] = { 400000, 1200000, 2500000, 5000000 };
+  GstAdaptiveDemuxAbrAlgorithm algorithm;
+
+  for (algorithm = GST_ADAPTIVE_DEMUX_ABR_EWMA;
+      algorithm <= GST_ADAPTIVE_DEMUX_ABR_BUFFER; algorithm++) {
+    GstAdaptiveDemuxAbr *abr = gst_adaptive_demux_abr_new (algorithm, 10);
+    GstClockTime level = 4 * FRAGMENT_DURATION;
+    gint rung = -1, switches = 0, i, j;
+    GstClockTime start;
+
+    start = gst_util_get_timestamp ();
+    for (i = 0; i < 2000; i++) {
+      /* 3 Mbps with some jitter, and a 1 Mbps dip every 100 fragments */
+      guint64 rate = (i % 100) < 10 ? 1 * MBPS : (3 * MBPS + (i % 7) * 100000);
+      guint64 bitrate;
+      gint new_rung = 0;
+
+      replay_fragment (abr, 500000, rate);
+
+      bitrate = gst_adaptive_demux_abr_get_bitrate (abr, level);
+      for (j = 0; j < G_N_ELEMENTS (ladder); j++)
+        if (ladder[j] <= bitrate)
+          new_rung = j;
+      if (rung != -1 && new_rung != rung)
+        switches++;
+      rung = new_rung;
+
+      /* the buffer drains when the fragments download slower than real-time */
+      level += FRAGMENT_DURATION;
+      level -= MIN (level, gst_util_uint64_scale (500000, 8 * GST_SECOND,
+              rate));
+      level = MIN (level, 10 * FRAGMENT_DURATION);
+    }
+
+    GST_INFO ("algorithm %d: %d switches, replay took %" GST_TIME_FORMAT,
+        algorithm, switches, GST_TIME_ARGS (gst_util_get_timestamp () -
+            start));
+    fail_unless (switches > 0);
+
+    gst_adaptive_demux_abr_free (abr);
+  }
+}
+
+GST_END_TEST;
+
+static Suite *
+adaptivedemuxabr_suite (void)
+{
+  Suite *s = suite_create ("adaptivedemuxabr");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_abr_steady);
+  tcase_add_test (tc_chain, test_abr_harmonic_reacts_to_drop);
+  tcase_add_test (tc_chain, test_abr_harmonic_ignores_spikes);
+  tcase_add_test (tc_chain, test_abr_harmonic_ignores_tails);
+  tcase_add_test (tc_chain, test_abr_buffer_level);
+  tcase_add_test (tc_chain, test_abr_custom);
+  tcase_add_test (tc_chain, test_abr_replay_trace);
+
+  return s;
+}
+
+GST_CHECK_MAIN (adaptivedemuxabr);
@@ -1087,6 +1087,80 @@ GST_START_TEST (test_change_state_intensive)
 
 GST_END_TEST;
 
+GST_START_TEST (test_pad_queue)
+{
+  GstElement *agg;
+  GstPad *srcpad, *sinkpad, *sinkpad2;
+  GstAggregatorPad *aggpad;
+  GstBuffer *bufs[3], *buf;
+  GstSegment segment;
+  GstCaps *caps;
+  guint i, max_size_buffers;
+
+  agg = gst_element_factory_make ("testaggregator", NULL);
+  sinkpad = gst_element_get_request_pad (agg, "sink_%u");
+  sinkpad2 = gst_element_get_request_pad (agg, "sink_%u");
+  aggpad = GST_AGGREGATOR_PAD (sinkpad);
+
+  g_object_get (sinkpad, "max-size-buffers", &max_size_buffers, NULL);
+  fail_unless_equals_int (max_size_buffers, 1);
+  g_object_set (sinkpad, "max-size-buffers", 3, NULL);
+
+  srcpad = gst_pad_new_from_static_template (&srctemplate, "src");
+  gst_pad_set_active (srcpad, TRUE);
+  fail_unless (gst_pad_link (srcpad, sinkpad) == GST_PAD_LINK_OK);
+  gst_element_set_state (agg, GST_STATE_PLAYING);
+
+  gst_pad_push_event (srcpad, gst_event_new_stream_start ("test"));
+  caps = gst_caps_new_empty_simple ("foo/x-bar");
+  gst_pad_push_event (srcpad, gst_event_new_caps (caps));
+  gst_caps_unref (caps);
+  gst_segment_init (&segment, GST_FORMAT_TIME);
+  gst_pad_push_event (srcpad, gst_event_new_segment (&segment));
+
+  /* Nothing is ever queued on the second pad so aggregate is never called,
+   * the first pad has to accept all the buffers without blocking */
+  for (i = 0; i < 3; i++) {
+    bufs[i] = gst_buffer_new ();
+    GST_BUFFER_PTS (bufs[i]) = i * BUFFER_DURATION;
+    GST_BUFFER_DURATION (bufs[i]) = BUFFER_DURATION;
+    fail_unless_equals_int (gst_pad_push (srcpad, gst_buffer_ref (bufs[i])),
+        GST_FLOW_OK);
+  }
+
+  fail_unless_equals_int (gst_aggregator_pad_get_queued_buffers (aggpad), 3);
+  for (i = 0; i < 3; i++) {
+    buf = gst_aggregator_pad_peek_buffer (aggpad, i);
+    fail_unless (buf == bufs[i]);
+    gst_buffer_unref (buf);
+  }
+  fail_unless (gst_aggregator_pad_peek_buffer (aggpad, 3) == NULL);
+
+  buf = gst_aggregator_pad_steal_buffer (aggpad);
+  fail_unless (buf == bufs[0]);
+  gst_buffer_unref (buf);
+  fail_unless (aggpad->buffer == bufs[1]);
+  fail_unless_equals_int (gst_aggregator_pad_get_queued_buffers (aggpad), 2);
+
+  gst_element_set_state (agg, GST_STATE_NULL);
+  fail_unless_equals_int (gst_aggregator_pad_get_queued_buffers (aggpad), 0);
+  fail_unless (gst_aggregator_pad_peek_buffer (aggpad, 0) == NULL);
+
+  for (i = 0; i < 3; i++) {
+    ASSERT_BUFFER_REFCOUNT (bufs[i], "buf", 1);
+    gst_buffer_unref (bufs[i]);
+  }
+
+  gst_element_release_request_pad (agg, sinkpad);
+  gst_element_release_request_pad (agg, sinkpad2);
+  gst_object_unref (sinkpad);
+  gst_object_unref (sinkpad2);
+  gst_object_unref (srcpad);
+  gst_object_unref (agg);
+}
+
+GST_END_TEST;
+
 static Suite *
 gst_aggregator_suite (void)
 {
@@ -1110,6 +1184,7 @@ gst_aggregator_suite (void)
   tcase_add_test (general, test_timeout_pipeline_with_wait);
   tcase_add_test (general, test_add_remove);
   tcase_add_test (general, test_change_state_intensive);
+  tcase_add_test (general, test_pad_queue);
 
   return suite;
 }